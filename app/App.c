@@ -6,14 +6,28 @@
 //  http://www.boost.org/LICENSE_1_0.txt
 
 #include <HAP.h>
+#include <HAPPlatformRunLoop+Init.h>
 
 #include "App.h"
 #include "AppDomains.h"
-#include "Board.h"
 #include "DB.h"
 #include "FanControl.h"
 #include "UART.h"
 
+/**
+ * Delay after the last change of the accessory state before it is saved.
+ *
+ * - Bursts of changes, e.g. from a brightness slider, are saved with a single write.
+ */
+#define kAppStateSaveDelay ((HAPTime)(2 * HAPSecond))
+
+/**
+ * Maximum delay after the first unsaved change of the accessory state before it is saved.
+ *
+ * - Bounds the changes that are lost on a power cut while changes keep arriving.
+ */
+#define kAppStateMaxSaveDelay ((HAPTime)(10 * HAPSecond))
+
 /**
  * Global accessory configuration.
  */
@@ -24,6 +38,11 @@ typedef struct {
         bool lightBulbOn;
         int32_t lightBulbBrightness;
     } state;
+    struct {
+        HAPPlatformTimerRef timer;
+        HAPTime firstChangeTime;
+        bool isPending;
+    } save;
     HAPAccessoryServerRef *server;
     HAPPlatformKeyValueStoreRef keyValueStore;
 } AccessoryConfiguration;
@@ -91,9 +110,9 @@ static void LoadAccessoryState(void)
 }
 
 /**
- * Save the accessory state to persistent memory.
+ * Write the accessory state to persistent memory.
  */
-static void SaveAccessoryState(void)
+static void WriteAccessoryState(void)
 {
     HAPPrecondition(accessoryConfiguration.keyValueStore);
     HAPLogInfo(&kHAPLog_Default, "%s", __func__);
@@ -109,6 +128,78 @@ static void SaveAccessoryState(void)
         HAPAssert(err == kHAPError_Unknown);
         HAPFatalError();
     }
+    accessoryConfiguration.save.isPending = false;
+}
+
+/**
+ * Timer callback that writes the pending accessory state.
+ */
+static void SaveAccessoryStateTimerExpired(HAPPlatformTimerRef timer, void *_Nullable context HAP_UNUSED)
+{
+    HAPPrecondition(timer == accessoryConfiguration.save.timer);
+    accessoryConfiguration.save.timer = 0;
+
+    WriteAccessoryState();
+}
+
+/**
+ * Save the accessory state to persistent memory.
+ *
+ * The state is written once no further change arrived for kAppStateSaveDelay, but no later than
+ * kAppStateMaxSaveDelay after the first unsaved change.
+ */
+static void SaveAccessoryState(void)
+{
+    HAPError err;
+
+    HAPTime now = HAPPlatformClockGetCurrent();
+    if (!accessoryConfiguration.save.isPending) {
+        accessoryConfiguration.save.isPending = true;
+        accessoryConfiguration.save.firstChangeTime = now;
+    }
+    HAPTime deadline = now + kAppStateSaveDelay;
+    if (deadline > accessoryConfiguration.save.firstChangeTime + kAppStateMaxSaveDelay) {
+        deadline = accessoryConfiguration.save.firstChangeTime + kAppStateMaxSaveDelay;
+    }
+
+    if (accessoryConfiguration.save.timer) {
+        HAPPlatformTimerDeregister(accessoryConfiguration.save.timer);
+        accessoryConfiguration.save.timer = 0;
+    }
+    err = HAPPlatformTimerRegister(&accessoryConfiguration.save.timer, deadline, SaveAccessoryStateTimerExpired, NULL);
+    if (err) {
+        HAPLogError(&kHAPLog_Default, "Save timer could not be registered. Saving immediately.");
+        WriteAccessoryState();
+    }
+}
+
+void AppFlushAccessoryState(void)
+{
+    HAPPrecondition(accessoryConfiguration.keyValueStore);
+
+    if (accessoryConfiguration.save.timer) {
+        HAPPlatformTimerDeregister(accessoryConfiguration.save.timer);
+        accessoryConfiguration.save.timer = 0;
+    }
+    if (accessoryConfiguration.save.isPending) {
+        WriteAccessoryState();
+    }
+
+    // Writes that the key-value store holds back to limit flash wear are written as well.
+    HAPError err = HAPPlatformKeyValueStoreFlush(accessoryConfiguration.keyValueStore);
+    if (err) {
+        HAPAssert(err == kHAPError_Unknown);
+        HAPFatalError();
+    }
+}
+
+void AppDiscardAccessoryState(void)
+{
+    if (accessoryConfiguration.save.timer) {
+        HAPPlatformTimerDeregister(accessoryConfiguration.save.timer);
+        accessoryConfiguration.save.timer = 0;
+    }
+    accessoryConfiguration.save.isPending = false;
 }
 
 static void ToggleFanActive(void)
@@ -126,7 +217,7 @@ static void ToggleFanActive(void)
         break;
     }
 
-    //SaveAccessoryState();
+    SaveAccessoryState();
     //HAPAccessoryServerRaiseEvent(accessoryConfiguration.server, &fanActiveCharacteristic, &fanService, &accessory);
 }
 
@@ -150,7 +241,7 @@ static void ToggleLightBulbState(void)
         SendLightControlCommand(0x0000);
     }
 
-    //SaveAccessoryState();
+    SaveAccessoryState();
     //HAPAccessoryServerRaiseEvent(accessoryConfiguration.server, &fanActiveCharacteristic, &fanService, &accessory);
 }
 
@@ -201,11 +292,18 @@ static void HandleRemoteControlEventCallback(void *_Nullable context, size_t con
 
 void HandleRemoteControlEvent(uint16_t event)
 {
-    // TODO: Static allocation of context.
-    HAPError err = HAPPlatformRunLoopScheduleCallback(HandleRemoteControlEventCallback, &event, sizeof event);
+    // Called from the UART task. Events are dropped if the run loop falls behind.
+    uint16_t *payload = HAPPlatformRunLoopAllocatePayload(sizeof *payload);
+    if (!payload) {
+        HAPLogError(&kHAPLog_Default, "Remote control event dropped: payload pool exhausted.");
+        return;
+    }
+    *payload = event;
+
+    HAPError err = HAPPlatformRunLoopSchedulePayloadCallback(HandleRemoteControlEventCallback, payload, sizeof *payload);
     if (err) {
-        HAPLogError(&kHAPLog_Default, "HAPPlatformRunLoopScheduleCallback failed.");
-        HAPFatalError();
+        HAPLogError(&kHAPLog_Default, "HAPPlatformRunLoopSchedulePayloadCallback failed.");
+        HAPPlatformRunLoopReleasePayload(payload);
     }
 }
 
@@ -261,7 +359,7 @@ HAPError HandleFanActiveWrite(HAPAccessoryServerRef* server,
         accessoryConfiguration.state.active = active;
         // TODO: Send fan control command and wait for response.
         //ToggleFanActive();
-        //SaveAccessoryState();
+        SaveAccessoryState();
         //HAPAccessoryServerRaiseEvent(server, request->characteristic, request->service, request->accessory);
     }
     return kHAPError_None;
@@ -288,7 +386,7 @@ HAPError HandleFanRotationSpeedWrite(HAPAccessoryServerRef *server,
     if (accessoryConfiguration.state.fanRotationSpeed != value) {
         accessoryConfiguration.state.fanRotationSpeed = value;
         // TODO: Send fan control command and wait for response.
-        //SaveAccessoryState();
+        SaveAccessoryState();
         //HAPAccessoryServerRaiseEvent(server, request->characteristic, request->service, request->accessory);
     }
     return kHAPError_None;
@@ -316,7 +414,7 @@ HAPError HandleLightBulbOnWrite(HAPAccessoryServerRef *server,
         accessoryConfiguration.state.lightBulbOn = value;
         // TODO: Send light control command and wait for response.
         //ToggleLightBulbState();
-        //SaveAccessoryState();
+        SaveAccessoryState();
         //HAPAccessoryServerRaiseEvent(server, request->characteristic, request->service, request->accessory);
     }
     return kHAPError_None;
@@ -343,7 +441,7 @@ HAPError HandleLightBulbBrightnessWrite(HAPAccessoryServerRef *server,
     if (accessoryConfiguration.state.lightBulbBrightness != value) {
         accessoryConfiguration.state.lightBulbBrightness = value;
         // TODO: Send light control command and wait for response.
-        //SaveAccessoryState();
+        SaveAccessoryState();
         //HAPAccessoryServerRaiseEvent(server, request->characteristic, request->service, request->accessory);
     }
     return kHAPError_None;
@@ -373,7 +471,9 @@ void AppCreate(HAPAccessoryServerRef *server, HAPPlatformKeyValueStoreRef keyVal
 void AppRelease(void)
 {
     HAPLogDebug(&kHAPLog_Default, "%s", __func__);
-    // Not Implemented
+
+    // Covers shutdown, factory reset and the activation of a firmware update.
+    AppFlushAccessoryState();
 }
 
 void AppAccessoryServerStart(void)
@@ -116,9 +116,24 @@ void AppCreate(HAPAccessoryServerRef *server, HAPPlatformKeyValueStoreRef keyVal
 
 /**
  * Release the application.
+ *
+ * Pending changes of the accessory state are written to persistent memory.
  */
 void AppRelease(void);
 
+/**
+ * Write pending changes of the accessory state to persistent memory.
+ */
+void AppFlushAccessoryState(void);
+
+/**
+ * Drop pending changes of the accessory state without writing them.
+ *
+ * Used before the accessory state is purged, so that a pending change is neither written before the purge nor
+ * written back after it.
+ */
+void AppDiscardAccessoryState(void);
+
 /**
  * Deinitialize the application.
  */
@@ -0,0 +1,266 @@
+//  Copyright 2022 John Buonagurio
+//
+//  Distributed under the Boost Software License, Version 1.0.
+//
+//  See accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt
+
+// Tests of the debounced persistence of the accessory state, run by the host
+// build on a virtual clock and the serial flash file system emulation.
+
+#include <dirent.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <HAP.h>
+#include <HAPPlatformClock+Init.h>
+#include <HAPPlatformKeyValueStore+Init.h>
+#include <HAPPlatformRunLoop+Init.h>
+#include <SimpleLinkFS+Init.h>
+
+#include "App.h"
+#include "FanControl.h"
+
+/**
+ * Delay after the last change of the accessory state before it is saved. Mirrors App.c.
+ */
+#define kAppStateSaveDelay ((HAPTime)(2 * HAPSecond))
+
+/**
+ * Maximum delay after the first unsaved change of the accessory state before it is saved. Mirrors App.c.
+ */
+#define kAppStateMaxSaveDelay ((HAPTime)(10 * HAPSecond))
+
+/**
+ * Directory of the file system emulation.
+ */
+static char fileSystemDirectory[] = "/tmp/AppTest.XXXXXX";
+
+static HAPPlatformKeyValueStore keyValueStore;
+
+static HAPAccessoryServerRef accessoryServer;
+
+static HAP_ALIGNAS(8) uint8_t runLoopPayloadPool[512];
+
+/**
+ * Removes a directory and its contents.
+ */
+static void RemoveDirectory(const char *path)
+{
+    DIR *dir = opendir(path);
+    HAPAssert(dir);
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (HAPStringAreEqual(entry->d_name, ".") || HAPStringAreEqual(entry->d_name, "..")) {
+            continue;
+        }
+
+        char entryPath[PATH_MAX];
+        HAPError err = HAPStringWithFormat(entryPath, sizeof entryPath, "%s/%s", path, entry->d_name);
+        HAPAssert(!err);
+        struct stat st;
+        int e = lstat(entryPath, &st);
+        HAPAssert(!e);
+        if (S_ISDIR(st.st_mode)) {
+            RemoveDirectory(entryPath);
+        } else {
+            e = unlink(entryPath);
+            HAPAssert(!e);
+        }
+    }
+    closedir(dir);
+
+    int e = rmdir(path);
+    HAPAssert(!e);
+}
+
+static void StopRunLoop(HAPPlatformTimerRef timer HAP_UNUSED, void *_Nullable context HAP_UNUSED)
+{
+    HAPPlatformRunLoopStop();
+}
+
+/**
+ * Runs the run loop for a while.
+ */
+static void RunFor(HAPTime duration)
+{
+    HAPPlatformTimerRef timer;
+    HAPError err = HAPPlatformTimerRegisterWithLeeway(
+        &timer, HAPPlatformClockGetCurrent() + duration, /* leeway: */ 0, StopRunLoop, NULL);
+    HAPAssert(!err);
+    HAPPlatformRunLoopRun();
+}
+
+static uint64_t GetNumFlashWrites(void)
+{
+    HAPPlatformKeyValueStoreStatistics statistics;
+    HAPPlatformKeyValueStoreGetStatistics(&keyValueStore, &statistics);
+    return statistics.numFlashWrites;
+}
+
+static void SetBrightness(int32_t brightness)
+{
+    static const HAPIntCharacteristicWriteRequest request;
+    HAPError err = HandleLightBulbBrightnessWrite(&accessoryServer, &request, brightness, NULL);
+    HAPAssert(!err);
+}
+
+static int32_t GetBrightness(void)
+{
+    static const HAPIntCharacteristicReadRequest request;
+    int32_t brightness;
+    HAPError err = HandleLightBulbBrightnessRead(&accessoryServer, &request, &brightness, NULL);
+    HAPAssert(!err);
+    return brightness;
+}
+
+static bool GetLightBulbOn(void)
+{
+    static const HAPBoolCharacteristicReadRequest request;
+    bool on;
+    HAPError err = HandleLightBulbOnRead(&accessoryServer, &request, &on, NULL);
+    HAPAssert(!err);
+    return on;
+}
+
+/**
+ * Restarts the app after a power cut. Changes that have not been saved are lost.
+ */
+static void PowerCut(void)
+{
+    AppDiscardAccessoryState();
+    AppCreate(&accessoryServer, &keyValueStore);
+}
+
+/**
+ * A burst of changes, e.g. from a brightness slider, is saved with a single write once the changes stop.
+ */
+static void TestBurst(void)
+{
+    HAPLogInfo(&kHAPLog_Default, "%s", __func__);
+
+    uint64_t numFlashWrites = GetNumFlashWrites();
+    for (int32_t i = 1; i <= 50; i++) {
+        SetBrightness(i);
+        RunFor(60 * HAPMillisecond);
+    }
+    HAPAssert(GetNumFlashWrites() == numFlashWrites);
+
+    RunFor(kAppStateSaveDelay);
+    HAPAssert(GetNumFlashWrites() == numFlashWrites + 1);
+    RunFor(kAppStateMaxSaveDelay);
+    HAPAssert(GetNumFlashWrites() == numFlashWrites + 1);
+
+    PowerCut();
+    HAPAssert(GetBrightness() == 50);
+}
+
+/**
+ * Changes that keep arriving are saved at least once per kAppStateMaxSaveDelay, so the number of writes is bounded by
+ * the duration and not by the number of changes.
+ */
+static void TestContinuousChanges(void)
+{
+    HAPLogInfo(&kHAPLog_Default, "%s", __func__);
+
+    uint64_t numFlashWrites = GetNumFlashWrites();
+    uint64_t numSaves = 0;
+    HAPTime lastSaveTime = HAPPlatformClockGetCurrent();
+    for (int32_t i = 1; i <= 600; i++) {
+        SetBrightness(i);
+        RunFor(100 * HAPMillisecond);
+
+        uint64_t newNumFlashWrites = GetNumFlashWrites();
+        if (newNumFlashWrites != numFlashWrites + numSaves) {
+            HAPAssert(newNumFlashWrites == numFlashWrites + numSaves + 1);
+            numSaves++;
+            lastSaveTime = HAPPlatformClockGetCurrent();
+        }
+        HAPAssert(HAPPlatformClockGetCurrent() - lastSaveTime <= kAppStateMaxSaveDelay);
+    }
+    RunFor(kAppStateSaveDelay);
+
+    // 600 changes in 60 s are saved once per kAppStateMaxSaveDelay, plus the final change.
+    uint64_t numWrites = GetNumFlashWrites() - numFlashWrites;
+    HAPLogInfo(&kHAPLog_Default, "600 changes in 60 s saved with %llu writes.", (unsigned long long) numWrites);
+    HAPAssert(numWrites >= 6 && numWrites <= 7);
+
+    PowerCut();
+    HAPAssert(GetBrightness() == 600);
+}
+
+/**
+ * Toggles from the remote control are dispatched through the run loop and saved with a single write.
+ */
+static void TestRemoteControlBurst(void)
+{
+    HAPLogInfo(&kHAPLog_Default, "%s", __func__);
+
+    bool on = GetLightBulbOn();
+    uint64_t numFlashWrites = GetNumFlashWrites();
+    for (size_t i = 0; i < 21; i++) {
+        HandleRemoteControlEvent(kRemoteControlEvent_LightOnOff);
+        RunFor(10 * HAPMillisecond);
+    }
+    HAPAssert(GetLightBulbOn() == !on);
+    RunFor(kAppStateMaxSaveDelay);
+    HAPAssert(GetNumFlashWrites() == numFlashWrites + 1);
+
+    PowerCut();
+    HAPAssert(GetLightBulbOn() == !on);
+}
+
+/**
+ * A flush writes the pending change right away, and the pending save does not write it again.
+ */
+static void TestFlush(void)
+{
+    HAPLogInfo(&kHAPLog_Default, "%s", __func__);
+
+    uint64_t numFlashWrites = GetNumFlashWrites();
+    SetBrightness(7);
+    AppFlushAccessoryState();
+    HAPAssert(GetNumFlashWrites() == numFlashWrites + 1);
+    RunFor(kAppStateMaxSaveDelay);
+    HAPAssert(GetNumFlashWrites() == numFlashWrites + 1);
+
+    // Without pending changes, a flush does not write.
+    AppFlushAccessoryState();
+    HAPAssert(GetNumFlashWrites() == numFlashWrites + 1);
+
+    // Releasing the app flushes as well.
+    SetBrightness(8);
+    AppRelease();
+    HAPAssert(GetNumFlashWrites() == numFlashWrites + 2);
+    AppCreate(&accessoryServer, &keyValueStore);
+    HAPAssert(GetBrightness() == 8);
+}
+
+int main(void)
+{
+    char *directory = mkdtemp(fileSystemDirectory);
+    HAPAssert(directory);
+    SimpleLinkFSCreate(&(const SimpleLinkFSOptions){ .rootDirectory = fileSystemDirectory });
+
+    HAPPlatformClockEnableVirtualTime(HAPPlatformClockGetCurrent());
+    HAPPlatformKeyValueStoreCreate(
+        &keyValueStore, &(const HAPPlatformKeyValueStoreOptions){ .rootDirectory = ".homekitstore" });
+    HAPPlatformRunLoopCreate(&(const HAPPlatformRunLoopOptions){
+        .keyValueStore = &keyValueStore,
+        .payloadPool = { .bytes = runLoopPayloadPool, .numBytes = sizeof runLoopPayloadPool } });
+    AppCreate(&accessoryServer, &keyValueStore);
+
+    TestBurst();
+    TestContinuousChanges();
+    TestRemoteControlBurst();
+    TestFlush();
+
+    AppRelease();
+    HAPPlatformRunLoopRelease();
+
+    RemoveDirectory(fileSystemDirectory);
+    return 0;
+}
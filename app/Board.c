@@ -244,7 +244,7 @@ const PowerCC32XX_ConfigV1 PowerCC32XX_config = {
     .policyFxn = &PowerCC32XX_sleepPolicy,
     .enterLPDSHookFxn = NULL,
     .resumeLPDSHookFxn = NULL,
-    .enablePolicy = false,
+    .enablePolicy = true,
     .enableGPIOWakeupLPDS = true,
     .enableGPIOWakeupShutdown = true,
     .enableNetworkWakeupLPDS = true,
@@ -24,10 +24,13 @@
 #include <HAPPlatformKeyValueStore+Init.h>
 #include <HAPPlatformMFiTokenAuth+Init.h>
 #include <HAPPlatformOTA+Init.h>
+#include <HAPPlatformRandomNumber+Init.h>
 #include <HAPPlatformRunLoop+Init.h>
 #include <HAPPlatformServiceDiscovery+Init.h>
 #include <HAPPlatformSyslog+Init.h>
 #include <HAPPlatformTCPStreamManager+Init.h>
+#include <HAPPlatformWakeup+Init.h>
+#include <HAPPlatformWorker+Init.h>
 
 #include <ti/devices/cc32xx/inc/hw_nvic.h>
 #include <ti/devices/cc32xx/inc/hw_types.h>
@@ -55,6 +58,10 @@
 #define kApp_HTTPTaskPriority (tskIDLE_PRIORITY + 4)
 #define kApp_HTTPTaskStackSize (2048) // 64K
 
+// The worker task runs expensive computations below the priority of the main task.
+#define kApp_WorkerTaskPriority (tskIDLE_PRIORITY + 1)
+#define kApp_WorkerTaskStackSize (1024) // 32K
+
 // NWP stop timeout in milliseconds.
 #define kSimpleLink_StopTimeout (200)
 
@@ -67,6 +74,88 @@
 #define kHAPIPSession_OutboundBufferSize ((size_t) 1536)
 #define kHAPIPSession_ScratchBufferSize ((size_t) 1536)
 
+// The TCP stream buffers below come on top of the IP session buffers above, which the HomeKit ADK owns and which
+// keep their size. Sharing them between all TCP streams bounds the RAM that write coalescing and read-ahead add to
+// 2048 bytes for any number of sessions, plus the large transmit buffer if enabled, but does not reduce the 22272
+// bytes of the session buffers.
+
+// Small writes to a TCP stream are gathered into a transmit buffer and sent together before the run loop waits.
+// The transmit buffers are shared by all TCP streams and only held until their bytes are sent, so a few suffice
+// for any number of sessions.
+#define kHAPPlatformTCPStreamManager_NumTransmitBuffers ((size_t) 2)
+#define kHAPPlatformTCPStreamManager_TransmitBufferSize ((size_t) 256)
+
+// Small reads from a TCP stream are served from a receive buffer that holds everything available on the socket.
+// The receive buffers are shared by all TCP streams, so this bounds the memory for reading ahead.
+#define kHAPPlatformTCPStreamManager_NumReceiveBuffers ((size_t) 3)
+#define kHAPPlatformTCPStreamManager_ReceiveBufferSize ((size_t) 512)
+
+// With APP_LARGE_TCP_TRANSMIT_BUFFERS, a session that writes a response in several outbound buffers, e.g. the
+// accessory attribute database, grows to a large transmit buffer, so that the response takes fewer sends. It goes back
+// to the small transmit buffers after a while. The HomeKit ADK writes such responses in chunks of the outbound buffer
+// size, so the large transmit buffer only helps if it holds several of them. On the host, it cut the sends of a
+// 5200 byte attribute database from 4 to 2-3 and of a 12000 byte one from 8 to 4-7, but it raises the RAM of the TCP
+// stream buffers from 2048 to 6144 bytes. It is off by default, as the attribute database of this accessory is only
+// read when a controller connects.
+#if APP_LARGE_TCP_TRANSMIT_BUFFERS
+#define kHAPPlatformTCPStreamManager_NumLargeTransmitBuffers ((size_t) 1)
+#define kHAPPlatformTCPStreamManager_LargeTransmitBufferSize ((size_t) 4096)
+#define kHAPPlatformTCPStreamManager_LargeTransmitBufferTimeout ((HAPTime) 10 * HAPSecond)
+#endif
+
+// Timers may be deferred by up to this amount so that nearby deadlines share a single run loop wakeup.
+#define kHAPPlatformRunLoop_TimerLeeway ((HAPTime) 50) // ms
+
+// Storage for payloads passed to the run loop from other tasks.
+#define kHAPPlatformRunLoop_PayloadPoolSize ((size_t) 512)
+
+// Run loop dispatches that take longer than this are recorded as stalls.
+#define kHAPPlatformRunLoop_DispatchBudget ((HAPTime) 200) // ms
+
+// Number of key-value store values cached in RAM. Holds the pairings, the configuration number, the long-term
+// secret key and the accessory state.
+#define kHAPPlatformKeyValueStore_NumCacheEntries ((size_t) 12)
+
+// Number of key-value store domains indexed in RAM. Covers the app, SDK and HAP domains.
+#define kHAPPlatformKeyValueStore_NumKeyIndexEntries ((size_t) 8)
+
+// Maximum number of key-value store operations of a transaction. Removing all pairings removes up to 16 pairings one
+// by one in a single transaction. A factory reset purges whole domains, one operation each.
+#define kHAPPlatformKeyValueStore_MaxTransactionOperations ((size_t) 48)
+
+// Capacity for the values that are set within a key-value store transaction.
+#define kHAPPlatformKeyValueStore_MaxTransactionBytes ((size_t) 256)
+
+// Number of key-value store values whose flash writes are counted. Covers the pairings, the HAP configuration and
+// the app state.
+#define kHAPPlatformKeyValueStore_NumWriteCounters ((size_t) 32)
+
+// Flash write budget of the key-value store. While it is exceeded, app state writes are deferred and merged.
+#define kHAPPlatformKeyValueStore_MaxWritesPerHour ((uint32_t) 6)
+
+// Maximum time for which an app state write is deferred. Bounds the state that is lost on a power failure.
+#define kHAPPlatformKeyValueStore_MaxWriteDeferral ((HAPTime)(10 * HAPMinute))
+
+// Number of pairings held in RAM by the key-value store, so that pair-verify does not read the pairings from flash.
+// One per pairing of the accessory server.
+#define kHAPPlatformKeyValueStore_NumPairingEntries ((size_t) kHAPPairingStorage_MinElements)
+
+// Key-value store domain in which the accessory server stores the pairings.
+#define kHAPPlatformKeyValueStore_PairingsDomain ((HAPPlatformKeyValueStoreDomain) 0xA0)
+
+// Length of a pairing record: controller identifier (36), its length (1), long-term public key (32), permissions (1).
+#define kHAPPlatformKeyValueStore_NumPairingBytes ((size_t) 70)
+
+// Key-value store values read into RAM at initialization, so that startup reads do not access flash. Covers the
+// setup info, the software token, the HAP configuration, the app state and the run loop diagnostics.
+#define kHAPPlatformKeyValueStore_PreloadBytes ((size_t) 1536)
+
+// Maximum number of jobs pending on the worker.
+#define kHAPPlatformWorker_MaxJobs ((size_t) 4)
+
+// Interval at which the key-value store and TCP stream manager statistics are logged.
+#define kApp_StatisticsLogInterval ((HAPTime)(60 * HAPMinute))
+
 static bool requestedFactoryReset = false;
 static bool clearPairings = false;
 
@@ -136,8 +225,41 @@ static void PlatformInitialize()
     platform.hapPlatform.ip.serviceDiscovery = &serviceDiscovery;
 
     // Key-value store.  
+    static HAPPlatformKeyValueStoreCacheEntry keyValueStoreCacheEntries[kHAPPlatformKeyValueStore_NumCacheEntries];
+    static HAPPlatformKeyValueStoreKeyIndexEntry keyValueStoreKeyIndexEntries[kHAPPlatformKeyValueStore_NumKeyIndexEntries];
+    static HAPPlatformKeyValueStoreOperation
+            keyValueStoreTransactionOperations[kHAPPlatformKeyValueStore_MaxTransactionOperations];
+    static uint8_t keyValueStoreTransactionBytes[kHAPPlatformKeyValueStore_MaxTransactionBytes];
+    static HAPPlatformKeyValueStoreWriteCounter keyValueStoreWriteCounters[kHAPPlatformKeyValueStore_NumWriteCounters];
+    static const HAPPlatformKeyValueStoreDomain keyValueStoreDeferrableDomains[] = {
+        kAppKeyValueStoreDomain_Configuration
+    };
+    static HAPPlatformKeyValueStorePairingEntry keyValueStorePairingEntries[kHAPPlatformKeyValueStore_NumPairingEntries];
+    static uint8_t keyValueStorePreloadBytes[kHAPPlatformKeyValueStore_PreloadBytes];
     HAPPlatformKeyValueStoreCreate(&platform.keyValueStore,
-        &(const HAPPlatformKeyValueStoreOptions){ .rootDirectory = ".homekitstore" });
+        &(const HAPPlatformKeyValueStoreOptions){ .rootDirectory = ".homekitstore",
+                                                  .cacheEntries = keyValueStoreCacheEntries,
+                                                  .numCacheEntries = HAPArrayCount(keyValueStoreCacheEntries),
+                                                  .keyIndexEntries = keyValueStoreKeyIndexEntries,
+                                                  .numKeyIndexEntries = HAPArrayCount(keyValueStoreKeyIndexEntries),
+                                                  .transactionOperations = keyValueStoreTransactionOperations,
+                                                  .maxTransactionOperations =
+                                                          HAPArrayCount(keyValueStoreTransactionOperations),
+                                                  .transactionBytes = keyValueStoreTransactionBytes,
+                                                  .maxTransactionBytes = sizeof keyValueStoreTransactionBytes,
+                                                  .writeCounters = keyValueStoreWriteCounters,
+                                                  .numWriteCounters = HAPArrayCount(keyValueStoreWriteCounters),
+                                                  .maxWritesPerHour = kHAPPlatformKeyValueStore_MaxWritesPerHour,
+                                                  .deferrableDomains = keyValueStoreDeferrableDomains,
+                                                  .numDeferrableDomains =
+                                                          HAPArrayCount(keyValueStoreDeferrableDomains),
+                                                  .maxWriteDeferral = kHAPPlatformKeyValueStore_MaxWriteDeferral,
+                                                  .pairingEntries = keyValueStorePairingEntries,
+                                                  .numPairingEntries = HAPArrayCount(keyValueStorePairingEntries),
+                                                  .pairingsDomain = kHAPPlatformKeyValueStore_PairingsDomain,
+                                                  .numPairingBytes = kHAPPlatformKeyValueStore_NumPairingBytes,
+                                                  .preloadBytes = keyValueStorePreloadBytes,
+                                                  .maxPreloadBytes = sizeof keyValueStorePreloadBytes });
     platform.hapPlatform.keyValueStore = &platform.keyValueStore;
 
     // Accessory setup manager. Depends on key-value store.
@@ -145,11 +267,38 @@ static void PlatformInitialize()
         &accessorySetup, &(const HAPPlatformAccessorySetupOptions){ .keyValueStore = &platform.keyValueStore });
     platform.hapPlatform.accessorySetup = &accessorySetup;
 
-    // TCP stream manager.
+    // TCP stream manager. When all sessions are in use, a session that has been idle for a minute, e.g. from a
+    // sleeping controller, is closed to accept a new connection. A session whose controller has left the network
+    // without closing it is probed after a minute, and reclaimed once the network processor gives up on the probes.
+    static uint8_t tcpStreamTransmitBuffers[kHAPPlatformTCPStreamManager_NumTransmitBuffers]
+                                           [kHAPPlatformTCPStreamManager_TransmitBufferSize];
+    static uint8_t tcpStreamReceiveBuffers[kHAPPlatformTCPStreamManager_NumReceiveBuffers]
+                                          [kHAPPlatformTCPStreamManager_ReceiveBufferSize];
+#if APP_LARGE_TCP_TRANSMIT_BUFFERS
+    static uint8_t tcpStreamLargeTransmitBuffers[kHAPPlatformTCPStreamManager_NumLargeTransmitBuffers]
+                                                [kHAPPlatformTCPStreamManager_LargeTransmitBufferSize];
+#endif
     HAPPlatformTCPStreamManagerCreate(&platform.tcpStreamManager,
         &(const HAPPlatformTCPStreamManagerOptions){ .interfaceName = NULL,
                                                      .port = kHAPNetworkPort_Default,
-                                                     .maxConcurrentTCPStreams = kHAPIPSessionStorage_NumElements });
+                                                     .maxConcurrentTCPStreams = kHAPIPSessionStorage_NumElements,
+                                                     .minIdleTimeBeforeEviction = 60 * HAPSecond,
+                                                     .deadPeerTimeout = 2 * HAPMinute,
+                                                     .transmitBuffers = tcpStreamTransmitBuffers,
+                                                     .transmitBufferSize = sizeof tcpStreamTransmitBuffers[0],
+                                                     .numTransmitBuffers = HAPArrayCount(tcpStreamTransmitBuffers),
+                                                     .receiveBuffers = tcpStreamReceiveBuffers,
+                                                     .receiveBufferSize = sizeof tcpStreamReceiveBuffers[0],
+                                                     .numReceiveBuffers = HAPArrayCount(tcpStreamReceiveBuffers),
+#if APP_LARGE_TCP_TRANSMIT_BUFFERS
+                                                     .largeTransmitBuffers = tcpStreamLargeTransmitBuffers,
+                                                     .largeTransmitBufferSize = sizeof tcpStreamLargeTransmitBuffers[0],
+                                                     .numLargeTransmitBuffers =
+                                                             HAPArrayCount(tcpStreamLargeTransmitBuffers),
+                                                     .largeTransmitBufferTimeout =
+                                                             kHAPPlatformTCPStreamManager_LargeTransmitBufferTimeout,
+#endif
+                                                   });
 
     // Software Token provider. Depends on key-value store.
     HAPPlatformMFiTokenAuthCreate(&platform.mfiTokenAuth,
@@ -158,7 +307,17 @@ static void PlatformInitialize()
         HAPPlatformMFiTokenAuthIsProvisioned(&platform.mfiTokenAuth) ? &platform.mfiTokenAuth : NULL;
     
     // Run loop.
-    HAPPlatformRunLoopCreate(&(const HAPPlatformRunLoopOptions){ .keyValueStore = &platform.keyValueStore });
+    static HAP_ALIGNAS(8) uint8_t runLoopPayloadPool[kHAPPlatformRunLoop_PayloadPoolSize];
+    HAPPlatformRunLoopCreate(&(const HAPPlatformRunLoopOptions){
+        .keyValueStore = &platform.keyValueStore,
+        .timerLeeway = kHAPPlatformRunLoop_TimerLeeway,
+        .payloadPool = { .bytes = runLoopPayloadPool, .numBytes = sizeof runLoopPayloadPool },
+        .dispatchBudget = kHAPPlatformRunLoop_DispatchBudget });
+
+    // Worker. Depends on run loop.
+    HAPPlatformWorkerCreate(&(const HAPPlatformWorkerOptions){ .priority = kApp_WorkerTaskPriority,
+                                                               .stackDepth = kApp_WorkerTaskStackSize,
+                                                               .maxJobs = kHAPPlatformWorker_MaxJobs });
 
     // Accessory server.
     platform.hapAccessoryServerOptions.maxPairings = kHAPPairingStorage_MinElements;
@@ -199,6 +358,7 @@ static void PlatformInitialize()
 static void PlatformDeinitialize()
 {
     HAPPlatformTCPStreamManagerRelease(&platform.tcpStreamManager);
+    HAPPlatformWorkerRelease();
     HAPPlatformRunLoopRelease();
 }
 
@@ -256,6 +416,13 @@ void HandleUpdatedState(HAPAccessoryServerRef *_Nonnull server, void *_Nullable
     if (HAPAccessoryServerGetState(server) == kHAPAccessoryServerState_Idle && requestedFactoryReset) {
         HAPPrecondition(server);
         HAPLogInfo(&kHAPLog_Default, "A factory reset has been requested.");
+        HAPTime resetStart = HAPPlatformClockGetCurrent();
+
+        // Pending app state is dropped, as it is purged. Writing it first would only wear the flash.
+        AppDiscardAccessoryState();
+
+        // App state and HomeKit state are reset together, so a reset in between cannot leave a half-reset store.
+        HAPPlatformKeyValueStoreBeginTransaction(&platform.keyValueStore);
 
         // Purge app state.
         err = HAPPlatformKeyValueStorePurgeDomain(&platform.keyValueStore, kAppKeyValueStoreDomain_Configuration);
@@ -274,28 +441,120 @@ void HandleUpdatedState(HAPAccessoryServerRef *_Nonnull server, void *_Nullable
             HAPAssert(err == kHAPError_Unknown);
             HAPFatalError();
         }
+        err = HAPPlatformKeyValueStoreCommitTransaction(&platform.keyValueStore);
+        if (err) {
+            HAPAssert(err == kHAPError_Unknown);
+            HAPFatalError();
+        }
 
         // Restore platform specific factory settings.
         PlatformRestoreFactorySettings();
-        AppRelease();
         requestedFactoryReset = false;
         AppCreate(server, &platform.keyValueStore);
         AppAccessoryServerStart();
+        HAPLogInfo(
+                &kHAPLog_Default,
+                "Factory reset completed in %lu ms.",
+                (unsigned long) (HAPPlatformClockGetCurrent() - resetStart));
         return;
     }
     else if (HAPAccessoryServerGetState(server) == kHAPAccessoryServerState_Idle && clearPairings) {
         HAPLogInfo(&kHAPLog_Default, "Removing pairings.");
+        HAPPlatformKeyValueStoreBeginTransaction(&platform.keyValueStore);
         err = HAPRemoveAllPairings(&platform.keyValueStore);
         if (err) {
             HAPAssert(err == kHAPError_Unknown);
             HAPFatalError();
         }
+        err = HAPPlatformKeyValueStoreCommitTransaction(&platform.keyValueStore);
+        if (err) {
+            HAPAssert(err == kHAPError_Unknown);
+            HAPFatalError();
+        }
         AppAccessoryServerStart();
     } else {
         AccessoryServerHandleUpdatedState(server, context);
     }
 }
 
+// Entropy for the random number generator, collected on the worker.
+typedef struct {
+    uint8_t seedBytes[kHAPPlatformRandomNumber_NumSeedBytes];
+    HAPTime collectTime;
+} RandomNumberSeedJob;
+
+// Runs on the worker. Reads the entropy, which takes several round trips to the network processor on the device.
+static void CollectRandomNumberSeed(void *context, size_t contextSize)
+{
+    HAPPrecondition(context);
+    HAPPrecondition(contextSize == sizeof(RandomNumberSeedJob));
+    RandomNumberSeedJob *job = context;
+
+    HAPTime startTime = HAPPlatformClockGetCurrent();
+    HAPPlatformRandomNumberCollectSeed(job->seedBytes);
+    job->collectTime = HAPPlatformClockGetCurrent() - startTime;
+}
+
+// Runs on the run loop. Seeds the generator from the collected entropy, unless it was already seeded on first use.
+static void SeedRandomNumber(void *context, size_t contextSize)
+{
+    HAPPrecondition(context);
+    HAPPrecondition(contextSize == sizeof(RandomNumberSeedJob));
+    RandomNumberSeedJob *job = context;
+
+    HAPTime startTime = HAPPlatformClockGetCurrent();
+    bool isSeeded = HAPPlatformRandomNumberSeed(job->seedBytes);
+    HAPTime seedTime = HAPPlatformClockGetCurrent() - startTime;
+    HAPRawBufferZero(job->seedBytes, sizeof job->seedBytes);
+    if (!isSeeded) {
+        HAPLogInfo(&kHAPLog_Default, "Random number generator was seeded on first use before the worker finished.");
+        return;
+    }
+    HAPLogInfo(
+        &kHAPLog_Default,
+        "Random number generator seeded in %lu ms on the run loop. Entropy took %lu ms on the worker.",
+        (unsigned long) seedTime,
+        (unsigned long) job->collectTime);
+}
+
+// Submit the entropy collection to the worker.
+static void SubmitRandomNumberSeedJob(void)
+{
+    RandomNumberSeedJob job;
+    HAPRawBufferZero(&job, sizeof job);
+    HAPError err = HAPPlatformWorkerSubmit(CollectRandomNumberSeed, SeedRandomNumber, &job, sizeof job);
+    if (err) {
+        HAPAssert(err == kHAPError_OutOfResources);
+        HAPLogError(&kHAPLog_Default, "Random number seed job rejected. Seeding on first use.");
+    }
+}
+
+// Timer that logs the statistics periodically.
+static HAPPlatformTimerRef statisticsLogTimer;
+
+static void StatisticsLogTimerExpired(HAPPlatformTimerRef timer, void *_Nullable context);
+
+// Schedule the next statistics log.
+static void ScheduleStatisticsLog(void)
+{
+    HAPTime deadline = HAPPlatformClockGetCurrent() + kApp_StatisticsLogInterval;
+    HAPError err = HAPPlatformTimerRegister(&statisticsLogTimer, deadline, StatisticsLogTimerExpired, NULL);
+    if (err) {
+        HAPLogError(&kHAPLog_Default, "Statistics log timer could not be registered.");
+        statisticsLogTimer = 0;
+    }
+}
+
+static void StatisticsLogTimerExpired(HAPPlatformTimerRef timer, void *_Nullable context HAP_UNUSED)
+{
+    HAPPrecondition(timer == statisticsLogTimer);
+    statisticsLogTimer = 0;
+
+    PrintKeyValueStoreInfo(&platform.keyValueStore);
+    PrintTCPStreamManagerInfo(&platform.tcpStreamManager);
+    ScheduleStatisticsLog();
+}
+
 //----------------------------------------------------------------------------------------------------------------------
 // Main task.
 //----------------------------------------------------------------------------------------------------------------------
@@ -320,6 +579,7 @@ void MainTask(void *pvParameters)
     PrintDeviceInfo();
 
     PlatformInitialize();
+    SubmitRandomNumberSeedJob();
 
     // Perform Application-specific initializations such as setting up callbacks
     // and configure any additional unique platform dependencies.
@@ -336,6 +596,10 @@ void MainTask(void *pvParameters)
     AppCreate(&accessoryServer, &platform.keyValueStore);
     AppAccessoryServerStart();
 
+    // The key-value store statistics cover the startup reads, so they are logged once right away.
+    PrintKeyValueStoreInfo(&platform.keyValueStore);
+    ScheduleStatisticsLog();
+
     // Image should be operational at this point. If we have an OTA image pending
     // commit, stop the watchdog timer and accept.
     switch (HAPPlatformOTAGetImageState(NULL)) {
@@ -355,6 +619,10 @@ void MainTask(void *pvParameters)
     vTaskSuspend(uartTaskHandle);
 
     // Cleanup.
+    if (statisticsLogTimer) {
+        HAPPlatformTimerDeregister(statisticsLogTimer);
+        statisticsLogTimer = 0;
+    }
     AppAccessoryServerStop();
     AppRelease();
     AppDeinitialize();
@@ -380,6 +648,16 @@ void vApplicationMallocFailedHook(void)
     HAPLogFault(&kHAPLog_Default, "pvPortMalloc failed (%u bytes free).", xPortGetFreeHeapSize());
 }
 
+HAP_STATIC_ASSERT(configTICK_RATE_HZ == 1000, TicksAreMilliseconds);
+
+void vApplicationPreSuppressTicksHook(TickType_t *pxExpectedIdleTime)
+{
+    // The kernel already bounds the idle time by the timeouts of the run loop and the UART task, so this does not
+    // shorten the sleep unless a published deadline is missed by them. The sleep is then entered by the power policy
+    // in vPortSuppressTicksAndSleep: LPDS if no driver holds a constraint against it, otherwise sleep (clock gating).
+    *pxExpectedIdleTime = HAPPlatformWakeupLimitIdleTime(*pxExpectedIdleTime);
+}
+
 void vApplicationStackOverflowHook(TaskHandle_t xTask, char *pcTaskName)
 {
     // Set a breakpoint if debugger is connected (DHCSR[C_DEBUGEN] == 1).
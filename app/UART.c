@@ -11,6 +11,7 @@
 #include "UART.h"
 
 #include <HAP.h>
+#include <HAPPlatformWakeup+Init.h>
 
 #include <ti/devices/cc32xx/inc/hw_dthe.h>
 #include <ti/devices/cc32xx/inc/hw_memmap.h>
@@ -26,8 +27,14 @@
 #include <semphr.h>
 #include <task.h>
 
-// Block time used used for UART RX and TX.
-#define kUART_BlockTime pdMS_TO_TICKS((TickType_t) 10000UL)
+// Time to wait for a response before the last message is resent.
+#define kUART_ResponseTimeout ((HAPTime)(10 * HAPSecond))
+#define kUART_BlockTime pdMS_TO_TICKS((TickType_t) kUART_ResponseTimeout)
+
+// Time to wait for the rest of a message once its SOM has been received. A message of 64 bytes takes about 6 ms at
+// 115200 baud. The driver only reports complete reads, so the timeout covers the whole message rather than each byte.
+#define kUART_MessageTimeout ((HAPTime)(50 * HAPMillisecond))
+#define kUART_MessageBlockTime pdMS_TO_TICKS((TickType_t) kUART_MessageTimeout)
 
 // Maximum number of messages in RX amd TX queues.
 #define kUART_RXQueueDepth ((size_t) 10)
@@ -57,7 +64,9 @@ HAP_ENUM_BEGIN(uint8_t, MessageStatus) {
     kMessageStatus_OK = 0,
     kMessageStatus_InvalidSOM,
     kMessageStatus_InvalidPayloadSize,
-    kMessageStatus_InvalidCRC
+    kMessageStatus_InvalidCRC,
+    kMessageStatus_TXPending,
+    kMessageStatus_RXPending
 } HAP_ENUM_END(uint8_t, MessageStatus);
 
 // Device handles.
@@ -66,13 +75,16 @@ static UART_Handle uartHandle = NULL;
 // FreeRTOS task handle.
 static TaskHandle_t uartTaskHandle = NULL;
 
+// Publishes the response timeout and counts the timeouts in the wakeup statistics.
+static HAPPlatformWakeupSource wakeupSource;
+
 // UART RX message data.
 static Message_t rxBuffer;
 static volatile size_t rxTotalBytes;
 
 // Queues used to send and receive complete message structures.
-QueueHandle_t rxMessageQueue = NULL;
-QueueHandle_t txMessageQueue = NULL;
+static QueueHandle_t rxMessageQueue = NULL;
+static QueueHandle_t txMessageQueue = NULL;
 
 // Initialization state.
 static uint16_t initFlags;
@@ -254,8 +266,9 @@ static void ReadCallback(UART_Handle handle, void *buffer, size_t count)
     else if (rxTotalBytes == sizeof(rxBuffer.header.som)) {
         // Check SOM; logic low pulse for approx. 35us, interpreted as 0xf8.
         if (rxBuffer.header.som == 0xf8) {
-            // Valid SOM; read opcode and payload size.
+            // Valid SOM; read opcode and payload size. Wake the UART task to time the rest of the message.
             UART_read(handle, &rxBuffer.header.opcode, sizeof(rxBuffer.header.opcode) + sizeof(rxBuffer.header.payloadSize));
+            xTaskNotifyFromISR(uartTaskHandle, kMessageStatus_RXPending, eSetValueWithoutOverwrite, &xHigherPriorityTaskWoken);
         }
         else {
             xTaskNotifyFromISR(uartTaskHandle, kMessageStatus_InvalidSOM, eSetValueWithOverwrite, &xHigherPriorityTaskWoken);
@@ -290,6 +303,29 @@ static void ReadCallback(UART_Handle handle, void *buffer, size_t count)
     taskEXIT_CRITICAL_FROM_ISR(uxSavedInterruptStatus);
 }
 
+// Block until notification from RX callback or EnqueueMessage. A timed wait ignores notifications of new TX messages
+// and of started RX messages, and times out after blockTime. A wait with portMAX_DELAY does not time out.
+static BaseType_t WaitForNotification(uint32_t *notificationValue, TickType_t blockTime)
+{
+    bool isTimed = blockTime != portMAX_DELAY;
+    TimeOut_t timeOut;
+    vTaskSetTimeOutState(&timeOut);
+
+    for (;;) {
+        *notificationValue = kMessageStatus_OK;
+        if (xTaskNotifyWait(0x00, ULONG_MAX, notificationValue, blockTime) == pdFAIL) {
+            return pdFAIL;
+        }
+        if (!isTimed || (*notificationValue != kMessageStatus_TXPending && *notificationValue != kMessageStatus_RXPending)) {
+            return pdPASS;
+        }
+        if (xTaskCheckForTimeOut(&timeOut, &blockTime) == pdTRUE) {
+            *notificationValue = kMessageStatus_OK;
+            return pdFAIL;
+        }
+    }
+}
+
 void UARTTask(void *pvParameters)
 {
     uartTaskHandle = xTaskGetCurrentTaskHandle();
@@ -342,6 +378,8 @@ void UARTTask(void *pvParameters)
         HAPFatalError();
     }
 
+    HAPPlatformWakeupSourceRegister(&wakeupSource, "UART");
+
     HAPLogInfo(&kHAPLog_Default, "Starting UART loop.");
     FlushBuffers(uartHandle);
 
@@ -362,13 +400,36 @@ void UARTTask(void *pvParameters)
         HAPRawBufferZero(&rxBuffer, sizeof rxBuffer);
         UART_read(uartHandle, &rxBuffer.header.som, sizeof(rxBuffer.header.som));
 
-        // Block until notification from RX callback.
-        uint32_t notificationValue = kMessageStatus_OK;
-        if (xTaskNotifyWait(0x00, ULONG_MAX, &notificationValue, kUART_BlockTime) == pdFAIL) {
+        // Block until notification. Only a sent message or a started RX message requires a timed wakeup.
+        bool isAwaitingResponse = messagePending == pdPASS;
+        HAPPlatformWakeupSourceSetDeadline(
+            &wakeupSource, isAwaitingResponse ? HAPPlatformClockGetCurrent() + kUART_ResponseTimeout : 0);
+        uint32_t notificationValue;
+        if (WaitForNotification(&notificationValue, isAwaitingResponse ? kUART_BlockTime : portMAX_DELAY) == pdFAIL) {
             // Receive timeout; cancel read and resend last message.
+            HAPPlatformWakeupSourceRecordWakeup(&wakeupSource);
             UART_readCancel(uartHandle);
-            if (messagePending == pdPASS) {
-                xQueueSendToBack(txMessageQueue, (void *)&message, (TickType_t)0);
+            xQueueSendToBack(txMessageQueue, (void *)&message, (TickType_t)0);
+        }
+        else if (notificationValue == kMessageStatus_TXPending || notificationValue == kMessageStatus_RXPending) {
+            // Message enqueued or started while idle. Cancelling the read drops the bytes received so far, so a
+            // message that is being received is completed first. It is dropped if the rest does not arrive within
+            // kUART_MessageTimeout, so that a stuck partial message neither blocks the TX queue nor keeps the UART
+            // task waiting without a deadline.
+            taskENTER_CRITICAL();
+            bool isReceiving = rxTotalBytes != 0;
+            if (!isReceiving) {
+                UART_readCancel(uartHandle);
+            }
+            taskEXIT_CRITICAL();
+            if (isReceiving) {
+                HAPPlatformWakeupSourceSetDeadline(&wakeupSource, HAPPlatformClockGetCurrent() + kUART_MessageTimeout);
+                if (WaitForNotification(&notificationValue, kUART_MessageBlockTime) == pdFAIL) {
+                    HAPPlatformWakeupSourceRecordWakeup(&wakeupSource);
+                    HAPLogBufferError(&kHAPLog_Default, &rxBuffer, rxTotalBytes, "Incomplete message dropped.");
+                    UART_readCancel(uartHandle);
+                    FlushBuffers(uartHandle);
+                }
             }
         }
 
@@ -418,7 +479,11 @@ void EnqueueMessage(uint8_t opcode, uint16_t payloadSize, void *payload)
     
     if (xQueueSendToBack(txMessageQueue, (void *)&message, (TickType_t)0) != pdTRUE) {
         HAPLogError(&kHAPLog_Default, "Failed to post message to TX queue.");
+        return;
     }
+
+    // Wake the UART task if it is idle. A pending RX status is not overwritten.
+    xTaskNotify(uartTaskHandle, kMessageStatus_TXPending, eSetValueWithoutOverwrite);
 }
 
 void SendFanControlCommand(uint16_t value)
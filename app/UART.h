@@ -7,16 +7,12 @@
 
 #pragma once
 
-#include <FreeRTOS.h>
-#include <queue.h>
+#include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-extern QueueHandle_t rxMessageQueue;
-extern QueueHandle_t txMessageQueue;
-
 void UARTTask(void *pvParameters);
 void EnqueueMessage(uint8_t opcode, uint16_t payloadSize, void *payload);
 void SendFanControlCommand(uint16_t value);
@@ -84,6 +84,88 @@ void PrintStorageInfo(void)
     HAPLogInfo(&kHAPLog_Default, "FilesUsage.FATWriteCounter = %u", storageInfo.FilesUsage.FATWriteCounter);
 }
 
+void PrintKeyValueStoreInfo(HAPPlatformKeyValueStoreRef keyValueStore)
+{
+    HAPPlatformKeyValueStoreStatistics statistics;
+    HAPPlatformKeyValueStoreGetStatistics(keyValueStore, &statistics);
+
+    HAPLogInfo(&kHAPLog_Default, "KeyValueStore.NumFlashWrites = %lu", (unsigned long)statistics.numFlashWrites);
+    HAPLogInfo(&kHAPLog_Default, "KeyValueStore.NumFlashRemoves = %lu", (unsigned long)statistics.numFlashRemoves);
+    HAPLogInfo(&kHAPLog_Default, "KeyValueStore.NumFlashBytesWritten = %lu", (unsigned long)statistics.numFlashBytesWritten);
+    HAPLogInfo(&kHAPLog_Default, "KeyValueStore.NumFlashWritesPerHour = %lu", (unsigned long)statistics.numFlashWritesPerHour);
+    HAPLogInfo(&kHAPLog_Default, "KeyValueStore.NumWritesDeferred = %lu", (unsigned long)statistics.numWritesDeferred);
+    HAPLogInfo(&kHAPLog_Default, "KeyValueStore.NumWritesCoalesced = %lu", (unsigned long)statistics.numWritesCoalesced);
+
+    // Writes per domain, from the values with a write counter.
+    for (unsigned domain = 0; domain <= UINT8_MAX; ++domain) {
+        uint32_t numWrites, numBytes;
+        HAPPlatformKeyValueStoreGetDomainWriteCount(keyValueStore, (HAPPlatformKeyValueStoreDomain)domain, &numWrites, &numBytes);
+        if (numWrites) {
+            HAPLogInfo(&kHAPLog_Default, "KeyValueStore.Domain[%02X] = %lu writes, %lu bytes",
+                domain, (unsigned long)numWrites, (unsigned long)numBytes);
+        }
+    }
+}
+
+static void PrintTCPStreamStatistics(const char* name, const HAPPlatformTCPStreamStatistics* statistics)
+{
+    HAPLogInfo(&kHAPLog_Default, "%s = accepted %lu ms, closed %lu ms, "
+        "%lu bytes in %lu receives (%lu would block, up to %lu buffered), "
+        "%lu bytes in %lu sends (%lu would block, up to %lu buffered), up to %lu bytes of buffers", name,
+        (unsigned long)statistics->acceptTime, (unsigned long)statistics->closeTime,
+        (unsigned long)statistics->numBytesReceived, (unsigned long)statistics->numReceives,
+        (unsigned long)statistics->numReceivesWouldBlock, (unsigned long)statistics->maxReceiveBytes,
+        (unsigned long)statistics->numBytesSent, (unsigned long)statistics->numSends,
+        (unsigned long)statistics->numSendsWouldBlock, (unsigned long)statistics->maxTransmitBytes,
+        (unsigned long)statistics->maxBufferBytes);
+}
+
+static void PrintTCPStream(
+    void* _Nullable context,
+    HAPPlatformTCPStreamManagerRef tcpStreamManager,
+    HAPPlatformTCPStreamRef tcpStream,
+    bool* shouldContinue HAP_UNUSED)
+{
+    HAPPrecondition(context);
+
+    HAPPlatformTCPStreamStatistics statistics;
+    HAPPlatformTCPStreamGetStatistics(tcpStreamManager, tcpStream, &statistics);
+
+    char name[32];
+    HAPError err = HAPStringWithFormat(name, sizeof name, "TCPStream[%u]", (unsigned)(*(size_t*)context)++);
+    if (err) {
+        HAPAssert(err == kHAPError_OutOfResources);
+        HAPLogError(&kHAPLog_Default, "TCP stream name too long. Logging without index.");
+        PrintTCPStreamStatistics("TCPStream", &statistics);
+        return;
+    }
+    PrintTCPStreamStatistics(name, &statistics);
+}
+
+void PrintTCPStreamManagerInfo(HAPPlatformTCPStreamManagerRef tcpStreamManager)
+{
+    HAPPlatformTCPStreamManagerStatistics statistics;
+    HAPPlatformTCPStreamManagerGetStatistics(tcpStreamManager, &statistics);
+
+    HAPLogInfo(&kHAPLog_Default, "TCPStreamManager.NumBytesReceived = %lu", (unsigned long)statistics.numBytesReceived);
+    HAPLogInfo(&kHAPLog_Default, "TCPStreamManager.NumReceives = %lu", (unsigned long)statistics.numReceives);
+    HAPLogInfo(&kHAPLog_Default, "TCPStreamManager.NumReceivesWouldBlock = %lu", (unsigned long)statistics.numReceivesWouldBlock);
+    HAPLogInfo(&kHAPLog_Default, "TCPStreamManager.NumBytesSent = %lu", (unsigned long)statistics.numBytesSent);
+    HAPLogInfo(&kHAPLog_Default, "TCPStreamManager.NumSends = %lu", (unsigned long)statistics.numSends);
+    HAPLogInfo(&kHAPLog_Default, "TCPStreamManager.NumSendsWouldBlock = %lu", (unsigned long)statistics.numSendsWouldBlock);
+    HAPLogInfo(&kHAPLog_Default, "TCPStreamManager.MaxTransmitBuffersInUse = %lu", (unsigned long)statistics.maxTransmitBuffersInUse);
+    HAPLogInfo(&kHAPLog_Default, "TCPStreamManager.MaxLargeTransmitBuffersInUse = %lu", (unsigned long)statistics.maxLargeTransmitBuffersInUse);
+    HAPLogInfo(&kHAPLog_Default, "TCPStreamManager.NumTransmitBufferGrowths = %lu", (unsigned long)statistics.numTransmitBufferGrowths);
+    HAPLogInfo(&kHAPLog_Default, "TCPStreamManager.NumHeldTransmitBuffers = %lu", (unsigned long)statistics.numHeldTransmitBuffers);
+    HAPLogInfo(&kHAPLog_Default, "TCPStreamManager.MaxReceiveBuffersInUse = %lu", (unsigned long)statistics.maxReceiveBuffersInUse);
+    if (statistics.lastClosedTCPStream.closeTime) {
+        PrintTCPStreamStatistics("TCPStreamManager.LastClosedTCPStream", &statistics.lastClosedTCPStream);
+    }
+
+    size_t index = 0;
+    HAPPlatformTCPStreamManagerEnumerateTCPStreams(tcpStreamManager, PrintTCPStream, &index);
+}
+
 void PrintFileList(void)
 {
     typedef struct {
@@ -9,6 +9,9 @@
 
 #include <stdint.h>
 
+#include <HAPPlatformKeyValueStore+Init.h>
+#include <HAPPlatformTCPStreamManager+Init.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -17,6 +20,10 @@ void PrintDeviceInfo(void);
 
 void PrintStorageInfo(void);
 
+void PrintKeyValueStoreInfo(HAPPlatformKeyValueStoreRef keyValueStore);
+
+void PrintTCPStreamManagerInfo(HAPPlatformTCPStreamManagerRef tcpStreamManager);
+
 void PrintFileList(void);
 
 void RemoveInvalidFiles(uint32_t token);
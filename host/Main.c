@@ -0,0 +1,444 @@
+//  Copyright 2022 John Buonagurio
+//
+//  Distributed under the Boost Software License, Version 1.0.
+//
+//  See accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt
+
+#include "App.h"
+#include "AppDomains.h"
+#include "DB.h"
+
+#include <HAP.h>
+#include <HAPLog.h>
+#include <HAPPlatform+Init.h>
+#include <HAPPlatformAccessorySetup+Init.h>
+#include <HAPPlatformClock+Init.h>
+#include <HAPPlatformKeyValueStore+Init.h>
+#include <HAPPlatformMFiTokenAuth+Init.h>
+#include <HAPPlatformRandomNumber+Init.h>
+#include <HAPPlatformRunLoop+Init.h>
+#include <HAPPlatformServiceDiscovery+Init.h>
+#include <HAPPlatformTCPStreamManager+Init.h>
+#include <HAPPlatformWorker+Init.h>
+#include <SimpleLinkFS+Init.h>
+
+#include <signal.h>
+#include <stdlib.h>
+
+// Host directory emulating the serial flash file system.
+#define kSimpleLinkFS_DefaultRootDirectory ".fanboard"
+
+// Unused port number from the ephemeral port range, or kHAPNetworkPort_Any.
+#define kHAPNetworkPort_Default (10000)
+
+// HomeKit ADK Integration Guide for ADK 2.0, Section 3.2.4.
+#define kHAPIPSessionStorage_NumElements ((size_t) 9)
+#define kHAPIPSession_InboundBufferSize ((size_t) 768)
+#define kHAPIPSession_OutboundBufferSize ((size_t) 1536)
+#define kHAPIPSession_ScratchBufferSize ((size_t) 1536)
+
+// Small writes to a TCP stream are gathered into a transmit buffer and sent together before the run loop waits.
+// The transmit buffers are shared by all TCP streams and only held until their bytes are sent, so a few suffice
+// for any number of sessions.
+#define kHAPPlatformTCPStreamManager_NumTransmitBuffers ((size_t) 2)
+#define kHAPPlatformTCPStreamManager_TransmitBufferSize ((size_t) 256)
+
+// Small reads from a TCP stream are served from a receive buffer that holds everything available on the socket.
+// The receive buffers are shared by all TCP streams, so this bounds the memory for reading ahead.
+#define kHAPPlatformTCPStreamManager_NumReceiveBuffers ((size_t) 3)
+#define kHAPPlatformTCPStreamManager_ReceiveBufferSize ((size_t) 512)
+
+// The inbound and outbound buffers of the IP sessions are owned by the HomeKit ADK and keep their size. A session that
+// writes a response in several outbound buffers, e.g. the accessory attribute database, grows to a large transmit
+// buffer instead, so that the response takes fewer sends. It goes back to the small transmit buffers after a while.
+#define kHAPPlatformTCPStreamManager_NumLargeTransmitBuffers ((size_t) 1)
+#define kHAPPlatformTCPStreamManager_LargeTransmitBufferSize ((size_t) 4096)
+#define kHAPPlatformTCPStreamManager_LargeTransmitBufferTimeout ((HAPTime) 10 * HAPSecond)
+
+// Timers may be deferred by up to this amount so that nearby deadlines share a single run loop wakeup.
+#define kHAPPlatformRunLoop_TimerLeeway ((HAPTime) 50) // ms
+
+// Storage for payloads passed to the run loop from other tasks.
+#define kHAPPlatformRunLoop_PayloadPoolSize ((size_t) 512)
+
+// Run loop dispatches that take longer than this are recorded as stalls.
+#define kHAPPlatformRunLoop_DispatchBudget ((HAPTime) 200) // ms
+
+// Number of key-value store values cached in RAM. Holds the pairings, the configuration number, the long-term
+// secret key and the accessory state.
+#define kHAPPlatformKeyValueStore_NumCacheEntries ((size_t) 12)
+
+// Number of key-value store domains indexed in RAM. Covers the app, SDK and HAP domains.
+#define kHAPPlatformKeyValueStore_NumKeyIndexEntries ((size_t) 8)
+
+// Maximum number of key-value store operations of a transaction. Removing all pairings removes up to 16 pairings one
+// by one in a single transaction. A factory reset purges whole domains, one operation each.
+#define kHAPPlatformKeyValueStore_MaxTransactionOperations ((size_t) 48)
+
+// Capacity for the values that are set within a key-value store transaction.
+#define kHAPPlatformKeyValueStore_MaxTransactionBytes ((size_t) 256)
+
+// Number of key-value store values whose flash writes are counted. Covers the pairings, the HAP configuration and
+// the app state.
+#define kHAPPlatformKeyValueStore_NumWriteCounters ((size_t) 32)
+
+// Flash write budget of the key-value store. While it is exceeded, app state writes are deferred and merged.
+#define kHAPPlatformKeyValueStore_MaxWritesPerHour ((uint32_t) 6)
+
+// Maximum time for which an app state write is deferred. Bounds the state that is lost on a power failure.
+#define kHAPPlatformKeyValueStore_MaxWriteDeferral ((HAPTime)(10 * HAPMinute))
+
+// Number of pairings held in RAM by the key-value store, so that pair-verify does not read the pairings from flash.
+// One per pairing of the accessory server.
+#define kHAPPlatformKeyValueStore_NumPairingEntries ((size_t) kHAPPairingStorage_MinElements)
+
+// Key-value store domain in which the accessory server stores the pairings.
+#define kHAPPlatformKeyValueStore_PairingsDomain ((HAPPlatformKeyValueStoreDomain) 0xA0)
+
+// Length of a pairing record: controller identifier (36), its length (1), long-term public key (32), permissions (1).
+#define kHAPPlatformKeyValueStore_NumPairingBytes ((size_t) 70)
+
+// Key-value store values read into RAM at initialization, so that startup reads do not access flash. Covers the
+// setup info, the software token, the HAP configuration, the app state and the run loop diagnostics.
+#define kHAPPlatformKeyValueStore_PreloadBytes ((size_t) 1536)
+
+// Maximum number of jobs pending on the worker.
+#define kHAPPlatformWorker_MaxJobs ((size_t) 4)
+
+// The worker thread runs expensive computations below the priority of the main thread.
+#define kHAPPlatformWorker_NiceIncrement (5)
+
+static bool requestedFactoryReset = false;
+static bool clearPairings = false;
+
+// Global platform objects.
+static struct {
+    HAPPlatformKeyValueStore keyValueStore;
+    HAPAccessoryServerOptions hapAccessoryServerOptions;
+    HAPPlatform hapPlatform;
+    HAPAccessoryServerCallbacks hapAccessoryServerCallbacks;
+    HAPPlatformTCPStreamManager tcpStreamManager;
+    HAPPlatformMFiTokenAuth mfiTokenAuth;
+} platform;
+
+static HAPPlatformAccessorySetup accessorySetup;
+static HAPPlatformServiceDiscovery serviceDiscovery;
+static HAPAccessoryServerRef accessoryServer;
+
+void HandleUpdatedState(HAPAccessoryServerRef *_Nonnull server, void *_Nullable context);
+
+// Initialize global platform objects.
+static void PlatformInitialize()
+{
+    // Serial flash file system emulation.
+    const char *rootDirectory = getenv("FANBOARD_FS_ROOT");
+    SimpleLinkFSCreate(&(const SimpleLinkFSOptions){
+        .rootDirectory = rootDirectory ? rootDirectory : kSimpleLinkFS_DefaultRootDirectory });
+
+    // Service discovery.
+    HAPPlatformServiceDiscoveryCreate(&serviceDiscovery);
+    platform.hapPlatform.ip.serviceDiscovery = &serviceDiscovery;
+
+    // Key-value store.
+    static HAPPlatformKeyValueStoreCacheEntry keyValueStoreCacheEntries[kHAPPlatformKeyValueStore_NumCacheEntries];
+    static HAPPlatformKeyValueStoreKeyIndexEntry keyValueStoreKeyIndexEntries[kHAPPlatformKeyValueStore_NumKeyIndexEntries];
+    static HAPPlatformKeyValueStoreOperation
+            keyValueStoreTransactionOperations[kHAPPlatformKeyValueStore_MaxTransactionOperations];
+    static uint8_t keyValueStoreTransactionBytes[kHAPPlatformKeyValueStore_MaxTransactionBytes];
+    static HAPPlatformKeyValueStoreWriteCounter keyValueStoreWriteCounters[kHAPPlatformKeyValueStore_NumWriteCounters];
+    static const HAPPlatformKeyValueStoreDomain keyValueStoreDeferrableDomains[] = {
+        kAppKeyValueStoreDomain_Configuration
+    };
+    static HAPPlatformKeyValueStorePairingEntry keyValueStorePairingEntries[kHAPPlatformKeyValueStore_NumPairingEntries];
+    static uint8_t keyValueStorePreloadBytes[kHAPPlatformKeyValueStore_PreloadBytes];
+    HAPPlatformKeyValueStoreCreate(&platform.keyValueStore,
+        &(const HAPPlatformKeyValueStoreOptions){ .rootDirectory = ".homekitstore",
+                                                  .cacheEntries = keyValueStoreCacheEntries,
+                                                  .numCacheEntries = HAPArrayCount(keyValueStoreCacheEntries),
+                                                  .keyIndexEntries = keyValueStoreKeyIndexEntries,
+                                                  .numKeyIndexEntries = HAPArrayCount(keyValueStoreKeyIndexEntries),
+                                                  .transactionOperations = keyValueStoreTransactionOperations,
+                                                  .maxTransactionOperations =
+                                                          HAPArrayCount(keyValueStoreTransactionOperations),
+                                                  .transactionBytes = keyValueStoreTransactionBytes,
+                                                  .maxTransactionBytes = sizeof keyValueStoreTransactionBytes,
+                                                  .writeCounters = keyValueStoreWriteCounters,
+                                                  .numWriteCounters = HAPArrayCount(keyValueStoreWriteCounters),
+                                                  .maxWritesPerHour = kHAPPlatformKeyValueStore_MaxWritesPerHour,
+                                                  .deferrableDomains = keyValueStoreDeferrableDomains,
+                                                  .numDeferrableDomains =
+                                                          HAPArrayCount(keyValueStoreDeferrableDomains),
+                                                  .maxWriteDeferral = kHAPPlatformKeyValueStore_MaxWriteDeferral,
+                                                  .pairingEntries = keyValueStorePairingEntries,
+                                                  .numPairingEntries = HAPArrayCount(keyValueStorePairingEntries),
+                                                  .pairingsDomain = kHAPPlatformKeyValueStore_PairingsDomain,
+                                                  .numPairingBytes = kHAPPlatformKeyValueStore_NumPairingBytes,
+                                                  .preloadBytes = keyValueStorePreloadBytes,
+                                                  .maxPreloadBytes = sizeof keyValueStorePreloadBytes });
+    platform.hapPlatform.keyValueStore = &platform.keyValueStore;
+
+    // Accessory setup manager. Depends on key-value store.
+    HAPPlatformAccessorySetupCreate(
+        &accessorySetup, &(const HAPPlatformAccessorySetupOptions){ .keyValueStore = &platform.keyValueStore });
+    platform.hapPlatform.accessorySetup = &accessorySetup;
+
+    // TCP stream manager. When all sessions are in use, a session that has been idle for a minute, e.g. from a
+    // sleeping controller, is closed to accept a new connection. A session whose controller has left the network
+    // without closing it is reclaimed after two minutes.
+    static uint8_t tcpStreamTransmitBuffers[kHAPPlatformTCPStreamManager_NumTransmitBuffers]
+                                           [kHAPPlatformTCPStreamManager_TransmitBufferSize];
+    static uint8_t tcpStreamReceiveBuffers[kHAPPlatformTCPStreamManager_NumReceiveBuffers]
+                                          [kHAPPlatformTCPStreamManager_ReceiveBufferSize];
+    static uint8_t tcpStreamLargeTransmitBuffers[kHAPPlatformTCPStreamManager_NumLargeTransmitBuffers]
+                                                [kHAPPlatformTCPStreamManager_LargeTransmitBufferSize];
+    HAPPlatformTCPStreamManagerCreate(&platform.tcpStreamManager,
+        &(const HAPPlatformTCPStreamManagerOptions){ .interfaceName = NULL,
+                                                     .port = kHAPNetworkPort_Default,
+                                                     .maxConcurrentTCPStreams = kHAPIPSessionStorage_NumElements,
+                                                     .minIdleTimeBeforeEviction = 60 * HAPSecond,
+                                                     .deadPeerTimeout = 2 * HAPMinute,
+                                                     .transmitBuffers = tcpStreamTransmitBuffers,
+                                                     .transmitBufferSize = sizeof tcpStreamTransmitBuffers[0],
+                                                     .numTransmitBuffers = HAPArrayCount(tcpStreamTransmitBuffers),
+                                                     .receiveBuffers = tcpStreamReceiveBuffers,
+                                                     .receiveBufferSize = sizeof tcpStreamReceiveBuffers[0],
+                                                     .numReceiveBuffers = HAPArrayCount(tcpStreamReceiveBuffers),
+                                                     .largeTransmitBuffers = tcpStreamLargeTransmitBuffers,
+                                                     .largeTransmitBufferSize = sizeof tcpStreamLargeTransmitBuffers[0],
+                                                     .numLargeTransmitBuffers =
+                                                             HAPArrayCount(tcpStreamLargeTransmitBuffers),
+                                                     .largeTransmitBufferTimeout =
+                                                             kHAPPlatformTCPStreamManager_LargeTransmitBufferTimeout });
+
+    // Software Token provider. Depends on key-value store.
+    HAPPlatformMFiTokenAuthCreate(&platform.mfiTokenAuth,
+        &(const HAPPlatformMFiTokenAuthOptions){ .keyValueStore = &platform.keyValueStore });
+    platform.hapPlatform.authentication.mfiTokenAuth =
+        HAPPlatformMFiTokenAuthIsProvisioned(&platform.mfiTokenAuth) ? &platform.mfiTokenAuth : NULL;
+
+    // Virtual time. Must be enabled before any timers are registered.
+    if (getenv("FANBOARD_VIRTUAL_TIME")) {
+        HAPPlatformClockEnableVirtualTime(HAPPlatformClockGetCurrent());
+    }
+
+    // Run loop.
+    static HAP_ALIGNAS(8) uint8_t runLoopPayloadPool[kHAPPlatformRunLoop_PayloadPoolSize];
+    HAPPlatformRunLoopCreate(&(const HAPPlatformRunLoopOptions){
+        .keyValueStore = &platform.keyValueStore,
+        .timerLeeway = kHAPPlatformRunLoop_TimerLeeway,
+        .payloadPool = { .bytes = runLoopPayloadPool, .numBytes = sizeof runLoopPayloadPool },
+        .dispatchBudget = kHAPPlatformRunLoop_DispatchBudget });
+
+    // Worker. Depends on run loop.
+    HAPPlatformWorkerCreate(&(const HAPPlatformWorkerOptions){ .niceIncrement = kHAPPlatformWorker_NiceIncrement,
+                                                               .maxJobs = kHAPPlatformWorker_MaxJobs });
+
+    // Accessory server.
+    platform.hapAccessoryServerOptions.maxPairings = kHAPPairingStorage_MinElements;
+    platform.hapAccessoryServerCallbacks.handleUpdatedState = HandleUpdatedState;
+
+    static HAPIPSession ipSessions[kHAPIPSessionStorage_NumElements];
+    static uint8_t ipInboundBuffers[HAPArrayCount(ipSessions)][kHAPIPSession_InboundBufferSize];
+    static uint8_t ipOutboundBuffers[HAPArrayCount(ipSessions)][kHAPIPSession_OutboundBufferSize];
+    static HAPIPEventNotificationRef ipEventNotifications[HAPArrayCount(ipSessions)][kAttributeCount];
+    for (size_t i = 0; i < HAPArrayCount(ipSessions); i++) {
+        ipSessions[i].inboundBuffer.bytes = ipInboundBuffers[i];
+        ipSessions[i].inboundBuffer.numBytes = sizeof ipInboundBuffers[i];
+        ipSessions[i].outboundBuffer.bytes = ipOutboundBuffers[i];
+        ipSessions[i].outboundBuffer.numBytes = sizeof ipOutboundBuffers[i];
+        ipSessions[i].eventNotifications = ipEventNotifications[i];
+        ipSessions[i].numEventNotifications = HAPArrayCount(ipEventNotifications[i]);
+    }
+
+    static HAPIPReadContextRef ipReadContexts[kAttributeCount];
+    static HAPIPWriteContextRef ipWriteContexts[kAttributeCount];
+    static uint8_t ipScratchBuffer[kHAPIPSession_ScratchBufferSize];
+    static HAPIPAccessoryServerStorage ipAccessoryServerStorage = {
+        .sessions = ipSessions,
+        .numSessions = HAPArrayCount(ipSessions),
+        .readContexts = ipReadContexts,
+        .numReadContexts = HAPArrayCount(ipReadContexts),
+        .writeContexts = ipWriteContexts,
+        .numWriteContexts = HAPArrayCount(ipWriteContexts),
+        .scratchBuffer = {.bytes = ipScratchBuffer, .numBytes = sizeof ipScratchBuffer}};
+
+    platform.hapAccessoryServerOptions.ip.transport = &kHAPAccessoryServerTransport_IP;
+    platform.hapAccessoryServerOptions.ip.accessoryServerStorage = &ipAccessoryServerStorage;
+
+    platform.hapPlatform.ip.tcpStreamManager = &platform.tcpStreamManager;
+}
+
+// Deinitialize global platform objects.
+static void PlatformDeinitialize()
+{
+    HAPPlatformTCPStreamManagerRelease(&platform.tcpStreamManager);
+    HAPPlatformWorkerRelease();
+    HAPPlatformRunLoopRelease();
+}
+
+// Either simply passes State handling to app, or processes Factory Reset
+void HandleUpdatedState(HAPAccessoryServerRef *_Nonnull server, void *_Nullable context)
+{
+    HAPError err;
+
+    if (HAPAccessoryServerGetState(server) == kHAPAccessoryServerState_Idle && requestedFactoryReset) {
+        HAPPrecondition(server);
+        HAPLogInfo(&kHAPLog_Default, "A factory reset has been requested.");
+        HAPTime resetStart = HAPPlatformClockGetCurrent();
+
+        // Pending app state is dropped, as it is purged. Writing it first would only wear the flash.
+        AppDiscardAccessoryState();
+
+        // App state and HomeKit state are reset together, so a reset in between cannot leave a half-reset store.
+        HAPPlatformKeyValueStoreBeginTransaction(&platform.keyValueStore);
+
+        // Purge app state.
+        err = HAPPlatformKeyValueStorePurgeDomain(&platform.keyValueStore, kAppKeyValueStoreDomain_Configuration);
+        if (err) {
+            HAPAssert(err == kHAPError_Unknown);
+            HAPFatalError();
+        }
+
+        // Reset HomeKit state.
+        err = HAPRestoreFactorySettings(&platform.keyValueStore);
+        if (err) {
+            HAPAssert(err == kHAPError_Unknown);
+            HAPFatalError();
+        }
+        err = HAPPlatformKeyValueStoreCommitTransaction(&platform.keyValueStore);
+        if (err) {
+            HAPAssert(err == kHAPError_Unknown);
+            HAPFatalError();
+        }
+
+        // There are no platform specific factory settings on the host.
+        requestedFactoryReset = false;
+        AppCreate(server, &platform.keyValueStore);
+        AppAccessoryServerStart();
+        HAPLogInfo(
+                &kHAPLog_Default,
+                "Factory reset completed in %lu ms.",
+                (unsigned long) (HAPPlatformClockGetCurrent() - resetStart));
+        return;
+    }
+    else if (HAPAccessoryServerGetState(server) == kHAPAccessoryServerState_Idle && clearPairings) {
+        HAPLogInfo(&kHAPLog_Default, "Removing pairings.");
+        HAPPlatformKeyValueStoreBeginTransaction(&platform.keyValueStore);
+        err = HAPRemoveAllPairings(&platform.keyValueStore);
+        if (err) {
+            HAPAssert(err == kHAPError_Unknown);
+            HAPFatalError();
+        }
+        err = HAPPlatformKeyValueStoreCommitTransaction(&platform.keyValueStore);
+        if (err) {
+            HAPAssert(err == kHAPError_Unknown);
+            HAPFatalError();
+        }
+        AppAccessoryServerStart();
+    } else {
+        AccessoryServerHandleUpdatedState(server, context);
+    }
+}
+
+// Stop the run loop on SIGINT and SIGTERM.
+static void HandleSignal(int signum HAP_UNUSED)
+{
+    // HAPPlatformRunLoopRequestStop only writes a stop request to the loopback pipe.
+    HAPPlatformRunLoopRequestStop();
+}
+
+// Entropy for the random number generator, collected on the worker.
+typedef struct {
+    uint8_t seedBytes[kHAPPlatformRandomNumber_NumSeedBytes];
+    HAPTime collectTime;
+} RandomNumberSeedJob;
+
+// Runs on the worker. Reads the entropy, which takes several round trips to the network processor on the device.
+static void CollectRandomNumberSeed(void *context, size_t contextSize)
+{
+    HAPPrecondition(context);
+    HAPPrecondition(contextSize == sizeof(RandomNumberSeedJob));
+    RandomNumberSeedJob *job = context;
+
+    HAPTime startTime = HAPPlatformClockGetCurrent();
+    HAPPlatformRandomNumberCollectSeed(job->seedBytes);
+    job->collectTime = HAPPlatformClockGetCurrent() - startTime;
+}
+
+// Runs on the run loop. Seeds the generator from the collected entropy, unless it was already seeded on first use.
+static void SeedRandomNumber(void *context, size_t contextSize)
+{
+    HAPPrecondition(context);
+    HAPPrecondition(contextSize == sizeof(RandomNumberSeedJob));
+    RandomNumberSeedJob *job = context;
+
+    HAPTime startTime = HAPPlatformClockGetCurrent();
+    bool isSeeded = HAPPlatformRandomNumberSeed(job->seedBytes);
+    HAPTime seedTime = HAPPlatformClockGetCurrent() - startTime;
+    HAPRawBufferZero(job->seedBytes, sizeof job->seedBytes);
+    if (!isSeeded) {
+        HAPLogInfo(&kHAPLog_Default, "Random number generator was seeded on first use before the worker finished.");
+        return;
+    }
+    HAPLogInfo(
+        &kHAPLog_Default,
+        "Random number generator seeded in %lu ms on the run loop. Entropy took %lu ms on the worker.",
+        (unsigned long) seedTime,
+        (unsigned long) job->collectTime);
+}
+
+// Submit the entropy collection to the worker.
+static void SubmitRandomNumberSeedJob(void)
+{
+    RandomNumberSeedJob job;
+    HAPRawBufferZero(&job, sizeof job);
+    HAPError err = HAPPlatformWorkerSubmit(CollectRandomNumberSeed, SeedRandomNumber, &job, sizeof job);
+    if (err) {
+        HAPAssert(err == kHAPError_OutOfResources);
+        HAPLogError(&kHAPLog_Default, "Random number seed job rejected. Seeding on first use.");
+    }
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+// Application entry point.
+//----------------------------------------------------------------------------------------------------------------------
+
+int main(void)
+{
+    HAPLogInfo(&kHAPLog_Default, "Starting host accessory.");
+
+    PlatformInitialize();
+    SubmitRandomNumberSeedJob();
+
+    struct sigaction action = { .sa_handler = HandleSignal };
+    sigemptyset(&action.sa_mask);
+    (void) sigaction(SIGINT, &action, NULL);
+    (void) sigaction(SIGTERM, &action, NULL);
+
+    // Perform Application-specific initializations such as setting up callbacks
+    // and configure any additional unique platform dependencies.
+    AppInitialize(&platform.hapAccessoryServerOptions, &platform.hapPlatform, &platform.hapAccessoryServerCallbacks);
+
+    // Initialize accessory server.
+    HAPAccessoryServerCreate(
+        &accessoryServer,
+        &platform.hapAccessoryServerOptions,
+        &platform.hapPlatform,
+        &platform.hapAccessoryServerCallbacks,
+        NULL);
+
+    AppCreate(&accessoryServer, &platform.keyValueStore);
+    AppAccessoryServerStart();
+
+    // Run main loop until explicitly stopped.
+    HAPPlatformRunLoopRun();
+
+    // Cleanup.
+    AppAccessoryServerStop();
+    AppRelease();
+    AppDeinitialize();
+    PlatformDeinitialize();
+
+    return 0;
+}
@@ -0,0 +1,35 @@
+//  Copyright 2022 John Buonagurio
+//
+//  Distributed under the Boost Software License, Version 1.0.
+//
+//  See accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt
+
+// The host has no fan controller attached. Outgoing messages are logged
+// and dropped, and no remote control events are ever received.
+
+#include "FanControl.h"
+#include "UART.h"
+
+#include <HAP.h>
+
+void UARTTask(void *pvParameters HAP_UNUSED)
+{
+}
+
+void EnqueueMessage(uint8_t opcode, uint16_t payloadSize, void *payload)
+{
+    HAPLogBufferInfo(&kHAPLog_Default, payload, payloadSize, "UART TX (0x%02X), not sent.", opcode);
+}
+
+void SendFanControlCommand(uint16_t value)
+{
+    FanControlTXPayload payload = { .value = value };
+    EnqueueMessage(0x50, sizeof(payload), &payload);
+}
+
+void SendLightControlCommand(uint16_t value)
+{
+    LightControlTXPayload payload = { .value = value };
+    EnqueueMessage(0x60, sizeof(payload), &payload);
+}
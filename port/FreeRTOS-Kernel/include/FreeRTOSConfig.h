@@ -33,6 +33,7 @@
 #define configUSE_PORT_OPTIMISED_TASK_SELECTION    1
 #define configUSE_TICKLESS_IDLE                    1
 #define configEXPECTED_IDLE_TIME_BEFORE_SLEEP      5
+#define configPRE_SUPPRESS_TICKS_AND_SLEEP_PROCESSING(x) vApplicationPreSuppressTicksHook(&(x))
 #define configCPU_CLOCK_HZ                         ((unsigned long)80000000)
 #define configTICK_RATE_HZ                         ((TickType_t)1000)
 #define configMAX_PRIORITIES                       (10UL)
@@ -123,6 +124,11 @@
 #define INCLUDE_xTaskGetCurrentTaskHandle          1
 #define INCLUDE_pxTaskGetStackStart                1
 
+/* Tickless idle processing. The application limits the expected idle time to
+ * the earliest published wakeup deadline. The sleep itself is entered by the
+ * power policy through vPortSuppressTicksAndSleep. */
+void vApplicationPreSuppressTicksHook(uint32_t *pxExpectedIdleTime);
+
 /* SEGGER SystemView support. */
 #include "SEGGER_SYSVIEW_FreeRTOS.h"
 
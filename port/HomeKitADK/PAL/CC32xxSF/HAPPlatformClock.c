@@ -10,6 +10,9 @@
 #include <ti/devices/cc32xx/driverlib/prcm.h>
 #include <ti/devices/cc32xx/driverlib/rom_map.h>
 
+#include <FreeRTOS.h>
+#include <task.h>
+
 #include "HAPPlatform.h"
 
 static const HAPLogObject logObject = { .subsystem = kHAPPlatform_LogSubsystem, .category = "Clock" };
@@ -25,15 +28,24 @@ HAPTime HAPPlatformClockGetCurrent(void)
     // 40 MHz domain are automatically latched, but we need to read the SCC
     // three times and compare values to ensure we are correctly synchronized
     // with the 32.768 kHz RTC when both clocks are exactly aligned.
+    //
+    // The clock is read from several tasks, e.g., the run loop and the idle task. The reads and the update of
+    // previousNow must not be interleaved.
+    taskENTER_CRITICAL();
     uint64_t scc[3];
     for (size_t i = 0; i < 3; ++i)
         scc[i] = MAP_PRCMSlowClkCtrFastGet();
 
     // Select the SCC value which matches in at least two of the reads.
     HAPTime now = (scc[1] - scc[0] <= 1 ? scc[1] : scc[2]) * 1000ull / 32768ull;
+    HAPTime previous = previousNow;
+    if (now >= previous) {
+        previousNow = now;
+    }
+    taskEXIT_CRITICAL();
 
-    if (now < previousNow) {
-        HAPLogFault(&logObject, "Time jumped backwards by %llu ms.", previousNow - now);
+    if (now < previous) {
+        HAPLogFault(&logObject, "Time jumped backwards by %llu ms.", previous - now);
         HAPFatalError();
     }
 
@@ -42,6 +54,5 @@ HAPTime HAPPlatformClockGetCurrent(void)
         HAPFatalError();
     }
 
-    previousNow = now;
     return now;
 }
@@ -0,0 +1,21 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+#include <FreeRTOS.h>
+#include <task.h> // taskENTER_CRITICAL
+
+#include "HAPPlatform.h"
+#include "HAPPlatformCriticalSection.h"
+
+void HAPPlatformEnterCriticalSection(void)
+{
+    taskENTER_CRITICAL();
+}
+
+void HAPPlatformExitCriticalSection(void)
+{
+    taskEXIT_CRITICAL();
+}
@@ -14,11 +14,47 @@ extern "C" {
 #endif
 
 #include "HAPPlatform.h"
+#include "HAPPlatformKeyValueStoreCache.h"
+#include "HAPPlatformKeyValueStoreFiles.h"
+#include "HAPPlatformKeyValueStoreGenerations.h"
+#include "HAPPlatformKeyValueStoreJournal.h"
+#include "HAPPlatformKeyValueStoreKeyIndex.h"
+#include "HAPPlatformKeyValueStoreLog.h"
+#include "HAPPlatformKeyValueStorePairingTable.h"
+#include "HAPPlatformKeyValueStorePreload.h"
+#include "HAPPlatformKeyValueStoreTransaction.h"
+#include "HAPPlatformKeyValueStoreWriteBack.h"
+#include "HAPPlatformKeyValueStoreWriteGovernor.h"
 
 #if __has_feature(nullability)
 #pragma clang assume_nonnull begin
 #endif
 
+/**@file
+ * Key-value store on the SimpleLink serial flash file system.
+ *
+ * By default, each value is stored in a separate file, see HAPPlatformKeyValueStoreFiles.h. Alternatively, values
+ * are stored as records in a log, see HAPPlatformKeyValueStoreLog.h. Existing values are not migrated between the
+ * two layouts.
+ *
+ * The optional features are implemented in separate files:
+ *
+ * - RAM cache: HAPPlatformKeyValueStoreCache.h, written back by HAPPlatformKeyValueStoreWriteBack.h.
+ *
+ * - Key index of the per-file layout: HAPPlatformKeyValueStoreKeyIndex.h.
+ *
+ * - Transactions: HAPPlatformKeyValueStoreTransaction.h, with HAPPlatformKeyValueStoreJournal.h for the per-file
+ *   layout.
+ *
+ * - Bulk purges of the per-file layout: HAPPlatformKeyValueStoreGenerations.h.
+ *
+ * - Write counters and write budget: HAPPlatformKeyValueStoreWriteGovernor.h.
+ *
+ * - Pairing table: HAPPlatformKeyValueStorePairingTable.h.
+ *
+ * - Preloaded values: HAPPlatformKeyValueStorePreload.h.
+ */
+
 /**
  * Key-value store initialization options.
  */
@@ -27,8 +63,268 @@ typedef struct {
      * Root directory into which the values will be stored as files.
      */
     const char* rootDirectory;
+
+    /**
+     * Cache entries. Optional.
+     *
+     * - If no cache entries are provided, every access goes to flash.
+     */
+    HAPPlatformKeyValueStoreCacheEntry* _Nullable cacheEntries;
+
+    /**
+     * Number of cache entries.
+     */
+    size_t numCacheEntries;
+
+    /**
+     * Whether writes of cacheable values are deferred until HAPPlatformKeyValueStoreFlush is called.
+     */
+    bool useWriteBack;
+
+    /**
+     * Log index entries. Optional.
+     *
+     * - If log index entries are provided, values are stored in a log instead of separate files.
+     *   One index entry is needed per stored value.
+     */
+    HAPPlatformKeyValueStoreLogIndexEntry* _Nullable logIndexEntries;
+
+    /**
+     * Number of log index entries.
+     */
+    size_t numLogIndexEntries;
+
+    /**
+     * Size of each of the two log files in bytes.
+     */
+    size_t logFileSize;
+
+    /**
+     * Key index entries. Optional. Not used with the log.
+     *
+     * - One key index entry is needed per domain that contains values. If there are more domains, the key index is
+     *   disabled and every enumeration lists the files.
+     */
+    HAPPlatformKeyValueStoreKeyIndexEntry* _Nullable keyIndexEntries;
+
+    /**
+     * Number of key index entries.
+     */
+    size_t numKeyIndexEntries;
+
+    /**
+     * Buffer for the operations of a transaction. Optional.
+     *
+     * - Transactions are only available if a buffer for their operations is provided.
+     */
+    HAPPlatformKeyValueStoreOperation* _Nullable transactionOperations;
+
+    /**
+     * Maximum number of operations of a transaction.
+     */
+    size_t maxTransactionOperations;
+
+    /**
+     * Buffer for the values that are set by a transaction.
+     *
+     * - With the per-file layout, it also holds each value while a journal is applied,
+     *   so it needs to be at least as large as the largest value that is set in a transaction.
+     */
+    void* _Nullable transactionBytes;
+
+    /**
+     * Capacity of the transaction bytes buffer.
+     */
+    size_t maxTransactionBytes;
+
+    /**
+     * Write counters. Optional.
+     *
+     * - One write counter is needed per value whose writes are counted. Writes of further values are only included
+     *   in the statistics.
+     */
+    HAPPlatformKeyValueStoreWriteCounter* _Nullable writeCounters;
+
+    /**
+     * Number of write counters.
+     */
+    size_t numWriteCounters;
+
+    /**
+     * Write budget in flash writes per hour. Optional.
+     *
+     * - If 0, writes are never deferred.
+     *
+     * - Deferral requires cache entries in write-through mode.
+     */
+    uint32_t maxWritesPerHour;
+
+    /**
+     * Domains whose writes may be deferred while the write budget is exceeded.
+     */
+    const HAPPlatformKeyValueStoreDomain* _Nullable deferrableDomains;
+
+    /**
+     * Number of deferrable domains.
+     */
+    size_t numDeferrableDomains;
+
+    /**
+     * Maximum time for which a write is deferred.
+     */
+    HAPTime maxWriteDeferral;
+
+    /**
+     * Pairing table entries. Optional.
+     *
+     * - One pairing table entry is needed per pairing. If there are more pairings, or a value in the pairings domain
+     *   is not a pairing, the pairing table is disabled and the pairings are read from flash.
+     */
+    HAPPlatformKeyValueStorePairingEntry* _Nullable pairingEntries;
+
+    /**
+     * Number of pairing table entries.
+     */
+    size_t numPairingEntries;
+
+    /**
+     * Domain in which the accessory server stores the pairings.
+     */
+    HAPPlatformKeyValueStoreDomain pairingsDomain;
+
+    /**
+     * Length of a pairing record.
+     *
+     * - Must be larger than kHAPPlatformKeyValueStorePairing_MaxIdentifierBytes and at most
+     *   kHAPPlatformKeyValueStorePairing_MaxBytes. Shorter records are held as well. A longer value in the pairings
+     *   domain disables the pairing table.
+     */
+    size_t numPairingBytes;
+
+    /**
+     * Buffer for the values that are preloaded at initialization. Optional.
+     *
+     * - Each value takes kHAPPlatformKeyValueStorePreload_NumHeaderBytes in addition to its length. Values that do
+     *   not fit are read from flash. Pairings are not preloaded if the pairing table holds them.
+     */
+    void* _Nullable preloadBytes;
+
+    /**
+     * Capacity of the preload buffer.
+     */
+    size_t maxPreloadBytes;
 } HAPPlatformKeyValueStoreOptions;
 
+/**
+ * Key-value store statistics.
+ */
+typedef struct {
+    /**
+     * Number of reads that were served from the cache.
+     */
+    uint64_t numCacheHits;
+
+    /**
+     * Number of reads that were not served from the cache.
+     */
+    uint64_t numCacheMisses;
+
+    /**
+     * Number of writes that replaced a value in the cache that had not been flushed yet.
+     */
+    uint64_t numWritesCoalesced;
+
+    /**
+     * Number of files that were read from flash, including lookups of files that do not exist.
+     */
+    uint64_t numFlashReads;
+
+    /**
+     * Number of files that were written to flash.
+     */
+    uint64_t numFlashWrites;
+
+    /**
+     * Number of files that were removed from flash.
+     */
+    uint64_t numFlashRemoves;
+
+    /**
+     * Number of file listings.
+     */
+    uint64_t numFlashListings;
+
+    /**
+     * Number of reads and removals of values that do not exist that were answered by the key index.
+     */
+    uint64_t numKeyIndexHits;
+
+    /**
+     * Number of reads and enumerations of the pairings domain that were answered by the pairing table.
+     */
+    uint64_t numPairingTableHits;
+
+    /**
+     * Number of reads that were served from the preloaded values.
+     */
+    uint64_t numPreloadHits;
+
+    /**
+     * Number of committed transactions.
+     */
+    uint64_t numTransactions;
+
+    /**
+     * Number of operations that replaced an earlier operation on the same value in the same transaction.
+     */
+    uint64_t numTransactionOperationsCoalesced;
+
+    /**
+     * Number of bytes written to flash, including log record headers and compaction.
+     */
+    uint64_t numFlashBytesWritten;
+
+    /**
+     * Number of value bytes read from flash.
+     */
+    uint64_t numFlashBytesRead;
+
+    /**
+     * Number of log compactions.
+     */
+    uint64_t numLogCompactions;
+
+    /**
+     * Number of domains that were purged by advancing their generation or by appending a purge record.
+     */
+    uint64_t numBulkPurges;
+
+    /**
+     * Number of files of earlier generations that were removed in the background.
+     */
+    uint64_t numStaleFilesRemoved;
+
+    /**
+     * Number of writes that were deferred because the write budget was exceeded.
+     */
+    uint64_t numWritesDeferred;
+
+    /**
+     * Estimated number of flash writes and removals per hour.
+     */
+    uint32_t numFlashWritesPerHour;
+
+    /**
+     * Time spent in flash writes and removals of values, including log compactions that they triggered.
+     */
+    HAPTime flashWriteTime;
+
+    /**
+     * Longest time spent in a single flash write or removal of a value.
+     */
+    HAPTime maxFlashWriteTime;
+} HAPPlatformKeyValueStoreStatistics;
+
 /**
  * Key-value store.
  */
@@ -36,6 +332,47 @@ struct HAPPlatformKeyValueStore {
     // Opaque type. Do not access the instance fields directly.
     /**@cond */
     const char* rootDirectory;
+    HAPPlatformKeyValueStoreCacheEntry* _Nullable cacheEntries;
+    size_t numCacheEntries;
+    uint32_t cacheAccessCounter;
+    bool useWriteBack;
+    bool useLog;
+    HAPPlatformKeyValueStoreLog log;
+    HAPPlatformKeyValueStoreKeyIndexEntry* _Nullable keyIndexEntries;
+    size_t numKeyIndexEntries;
+    bool isKeyIndexValid;
+    HAPPlatformKeyValueStoreOperation* _Nullable transactionOperations;
+    size_t maxTransactionOperations;
+    size_t numTransactionOperations;
+    uint8_t* _Nullable transactionBytes;
+    size_t maxTransactionBytes;
+    size_t numTransactionBytes;
+    bool isTransactionActive;
+    bool isTransactionFailed;
+    bool isJournalPending;
+    HAPPlatformKeyValueStoreWriteCounter* _Nullable writeCounters;
+    size_t numWriteCounters;
+    uint32_t maxWritesPerHour;
+    const HAPPlatformKeyValueStoreDomain* _Nullable deferrableDomains;
+    size_t numDeferrableDomains;
+    HAPTime maxWriteDeferral;
+    HAPTime writeRateWindowStart;
+    uint32_t numWindowWrites;
+    uint32_t numPreviousWindowWrites;
+    HAPPlatformTimerRef deferredWriteTimer;
+    HAPTime deferredWriteDeadline;
+    HAPPlatformKeyValueStorePairingEntry* _Nullable pairingEntries;
+    size_t maxPairingEntries;
+    size_t numPairingEntries;
+    HAPPlatformKeyValueStoreDomain pairingsDomain;
+    size_t numPairingBytes;
+    bool isPairingTableValid;
+    HAPPlatformKeyValueStoreGenerationTable generationTable;
+    HAPPlatformTimerRef collectionTimer;
+    uint8_t* _Nullable preloadBytes;
+    size_t maxPreloadBytes;
+    size_t numPreloadBytes;
+    HAPPlatformKeyValueStoreStatistics statistics;
     /**@endcond */
 };
 
@@ -49,6 +386,119 @@ void HAPPlatformKeyValueStoreCreate(
         HAPPlatformKeyValueStoreRef keyValueStore,
         const HAPPlatformKeyValueStoreOptions* options);
 
+/**
+ * Writes all modified cached values to flash.
+ *
+ * - In write-through mode, only values whose write was deferred by the write budget are modified.
+ *
+ * @param      keyValueStore        Key-value store.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_Unknown        If the file access failed. Values that could not be written remain modified.
+ */
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformKeyValueStoreFlush(HAPPlatformKeyValueStoreRef keyValueStore);
+
+/**
+ * Gets the length of a value without reading it.
+ *
+ * - With the per-file layout, the length is taken from the file metadata. With the log, it is taken from the index.
+ *
+ * @param      keyValueStore        Key-value store.
+ * @param      domain               Domain.
+ * @param      key                  Key.
+ * @param[out] numBytes             Length of the value, if found.
+ * @param[out] found                Whether the value exists.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_Unknown        If the file access failed.
+ */
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformKeyValueStoreGetSize(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain,
+        HAPPlatformKeyValueStoreKey key,
+        size_t* numBytes,
+        bool* found);
+
+/**
+ * Begins a transaction.
+ *
+ * - Until the transaction is committed or aborted, sets and removals are staged in RAM,
+ *   and purging a domain stages the removal of its values.
+ *
+ * @param      keyValueStore        Key-value store.
+ */
+void HAPPlatformKeyValueStoreBeginTransaction(HAPPlatformKeyValueStoreRef keyValueStore);
+
+/**
+ * Commits the active transaction. All staged operations take effect, or none of them.
+ *
+ * - If an operation could not be staged because the transaction buffers were full, no operation takes effect.
+ *
+ * - With the per-file layout, once the journal is written, the operations are applied again until they take effect.
+ *   If they still fail, the journal is pending: writes are refused until it is applied, at the latest when the
+ *   key-value store is created the next time.
+ *
+ * @param      keyValueStore        Key-value store.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_Unknown        If the transaction could not be committed. The transaction is ended.
+ */
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformKeyValueStoreCommitTransaction(HAPPlatformKeyValueStoreRef keyValueStore);
+
+/**
+ * Discards the operations of the active transaction.
+ *
+ * @param      keyValueStore        Key-value store.
+ */
+void HAPPlatformKeyValueStoreAbortTransaction(HAPPlatformKeyValueStoreRef keyValueStore);
+
+/**
+ * Gets the number of flash writes and removals of a value since initialization.
+ *
+ * - Values without a write counter report 0.
+ *
+ * @param      keyValueStore        Key-value store.
+ * @param      domain               Domain.
+ * @param      key                  Key.
+ * @param[out] numWrites            Number of writes and removals.
+ * @param[out] numBytes             Number of bytes written.
+ */
+void HAPPlatformKeyValueStoreGetWriteCount(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain,
+        HAPPlatformKeyValueStoreKey key,
+        uint32_t* numWrites,
+        uint32_t* numBytes);
+
+/**
+ * Gets the number of flash writes and removals of the values of a domain since initialization.
+ *
+ * - Only values with a write counter are included.
+ *
+ * @param      keyValueStore        Key-value store.
+ * @param      domain               Domain.
+ * @param[out] numWrites            Number of writes and removals.
+ * @param[out] numBytes             Number of bytes written.
+ */
+void HAPPlatformKeyValueStoreGetDomainWriteCount(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain,
+        uint32_t* numWrites,
+        uint32_t* numBytes);
+
+/**
+ * Gets the key-value store statistics.
+ *
+ * @param      keyValueStore        Key-value store.
+ * @param[out] statistics           Key-value store statistics.
+ */
+void HAPPlatformKeyValueStoreGetStatistics(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreStatistics* statistics);
+
 #if __has_feature(nullability)
 #pragma clang assume_nonnull end
 #endif
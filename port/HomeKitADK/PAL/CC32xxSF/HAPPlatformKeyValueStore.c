@@ -8,8 +8,6 @@
 
 #include "HAPPlatformKeyValueStore+Init.h"
 
-#include <ti/drivers/net/wifi/simplelink.h>
-
 static const HAPLogObject logObject = { .subsystem = kHAPPlatform_LogSubsystem, .category = "KeyValueStore" };
 
 void HAPPlatformKeyValueStoreCreate(
@@ -18,66 +16,150 @@ void HAPPlatformKeyValueStoreCreate(
     HAPPrecondition(keyValueStore);
     HAPPrecondition(options);
     HAPPrecondition(options->rootDirectory);
+    HAPPrecondition(!options->numCacheEntries || options->cacheEntries);
+    HAPPrecondition(options->numCacheEntries || !options->useWriteBack);
+    HAPPrecondition(!options->numLogIndexEntries || (options->logIndexEntries && options->logFileSize));
+    HAPPrecondition(!options->numKeyIndexEntries || options->keyIndexEntries);
+    HAPPrecondition(!options->maxTransactionOperations || options->transactionOperations);
+    HAPPrecondition(!options->maxTransactionOperations || options->transactionBytes);
+    HAPPrecondition(!options->maxTransactionBytes || options->transactionBytes);
+    HAPPrecondition(options->maxTransactionBytes <= UINT16_MAX);
+    HAPPrecondition(!options->numWriteCounters || options->writeCounters);
+    HAPPrecondition(!options->numDeferrableDomains || options->deferrableDomains);
+    HAPPrecondition(!options->maxWritesPerHour || options->maxWriteDeferral);
+    HAPPrecondition(!options->numPairingEntries || options->pairingEntries);
+    HAPPrecondition(
+            !options->numPairingEntries ||
+            (options->numPairingBytes > kHAPPlatformKeyValueStorePairing_MaxIdentifierBytes &&
+             options->numPairingBytes <= kHAPPlatformKeyValueStorePairing_MaxBytes));
+    HAPPrecondition(!options->maxPreloadBytes || options->preloadBytes);
 
     HAPLogDebug(&logObject, "Storage configuration: keyValueStore = %lu", (unsigned long) sizeof *keyValueStore);
-
+    HAPLogDebug(
+            &logObject,
+            "Storage configuration: cacheEntries = %lu",
+            (unsigned long) (options->numCacheEntries * sizeof(HAPPlatformKeyValueStoreCacheEntry)));
+    HAPLogDebug(
+            &logObject,
+            "Storage configuration: logIndexEntries = %lu",
+            (unsigned long) (options->numLogIndexEntries * sizeof(HAPPlatformKeyValueStoreLogIndexEntry)));
+    HAPLogDebug(
+            &logObject,
+            "Storage configuration: keyIndexEntries = %lu",
+            (unsigned long) (options->numKeyIndexEntries * sizeof(HAPPlatformKeyValueStoreKeyIndexEntry)));
+    HAPLogDebug(
+            &logObject,
+            "Storage configuration: writeCounters = %lu",
+            (unsigned long) (options->numWriteCounters * sizeof(HAPPlatformKeyValueStoreWriteCounter)));
+    HAPLogDebug(
+            &logObject,
+            "Storage configuration: pairingEntries = %lu",
+            (unsigned long) (options->numPairingEntries * sizeof(HAPPlatformKeyValueStorePairingEntry)));
+    HAPLogDebug(&logObject, "Storage configuration: preloadBytes = %lu", (unsigned long) options->maxPreloadBytes);
+
+    HAPRawBufferZero(keyValueStore, sizeof *keyValueStore);
     keyValueStore->rootDirectory = options->rootDirectory;
+    keyValueStore->cacheEntries = options->cacheEntries;
+    keyValueStore->numCacheEntries = options->numCacheEntries;
+    keyValueStore->useWriteBack = options->useWriteBack;
+    keyValueStore->transactionOperations = options->transactionOperations;
+    keyValueStore->maxTransactionOperations = options->maxTransactionOperations;
+    keyValueStore->transactionBytes = options->transactionBytes;
+    keyValueStore->maxTransactionBytes = options->maxTransactionBytes;
+    keyValueStore->writeCounters = options->writeCounters;
+    keyValueStore->numWriteCounters = options->numWriteCounters;
+    keyValueStore->maxWritesPerHour = options->maxWritesPerHour;
+    keyValueStore->deferrableDomains = options->deferrableDomains;
+    keyValueStore->numDeferrableDomains = options->numDeferrableDomains;
+    keyValueStore->maxWriteDeferral = options->maxWriteDeferral;
+    keyValueStore->writeRateWindowStart = HAPPlatformClockGetCurrent();
+    if (keyValueStore->cacheEntries) {
+        HAPRawBufferZero(
+                HAPNonnull(keyValueStore->cacheEntries),
+                keyValueStore->numCacheEntries * sizeof(HAPPlatformKeyValueStoreCacheEntry));
+    }
+    if (keyValueStore->writeCounters) {
+        HAPRawBufferZero(
+                HAPNonnull(keyValueStore->writeCounters),
+                keyValueStore->numWriteCounters * sizeof(HAPPlatformKeyValueStoreWriteCounter));
+    }
+    if (options->numLogIndexEntries) {
+        keyValueStore->useLog = true;
+        HAPPlatformKeyValueStoreLogCreate(
+                &keyValueStore->log,
+                options->rootDirectory,
+                HAPNonnull(options->logIndexEntries),
+                options->numLogIndexEntries,
+                options->logFileSize);
+    } else {
+        // File names depend on the generations.
+        HAPError err = HAPPlatformKeyValueStoreLoadGenerations(keyValueStore);
+        if (err) {
+            HAPAssert(err == kHAPError_Unknown);
+            HAPLogError(&logObject, "Failed to load generations. Values of purged domains may reappear.");
+        }
+        if (options->numKeyIndexEntries) {
+            keyValueStore->keyIndexEntries = options->keyIndexEntries;
+            keyValueStore->numKeyIndexEntries = options->numKeyIndexEntries;
+            err = HAPPlatformKeyValueStoreBuildKeyIndex(keyValueStore);
+            if (err) {
+                HAPAssert(err == kHAPError_Unknown);
+                HAPLogError(&logObject, "Failed to build key index. Enumeration lists the files.");
+            }
+        }
+
+        // Complete a transaction that was interrupted by a reset.
+        err = HAPPlatformKeyValueStoreApplyJournal(keyValueStore);
+        if (err) {
+            HAPAssert(err == kHAPError_Unknown);
+            HAPLogError(&logObject, "Failed to apply journal. Writes are refused until it is applied.");
+            keyValueStore->isJournalPending = true;
+        }
+
+        // Files of earlier generations are left over by a reset during their removal.
+        if (keyValueStore->generationTable.needsCollection) {
+            HAPPlatformKeyValueStoreScheduleCollection(keyValueStore, /* deadline: */ 0);
+        }
+    }
+    if (options->numPairingEntries) {
+        keyValueStore->pairingEntries = options->pairingEntries;
+        keyValueStore->maxPairingEntries = options->numPairingEntries;
+        keyValueStore->pairingsDomain = options->pairingsDomain;
+        keyValueStore->numPairingBytes = options->numPairingBytes;
+        HAPError err = HAPPlatformKeyValueStoreLoadPairingTable(keyValueStore);
+        if (err) {
+            HAPAssert(err == kHAPError_Unknown);
+            HAPLogError(&logObject, "Failed to load pairing table. Pairings are read from flash.");
+        }
+    }
+
+    // Preload after the pairing table, so that pairings held by the table are not read twice.
+    if (options->maxPreloadBytes) {
+        keyValueStore->preloadBytes = options->preloadBytes;
+        keyValueStore->maxPreloadBytes = options->maxPreloadBytes;
+        HAPError err = HAPPlatformKeyValueStorePreloadValues(keyValueStore);
+        if (err) {
+            HAPAssert(err == kHAPError_Unknown);
+            keyValueStore->numPreloadBytes = 0;
+            HAPLogError(&logObject, "Failed to preload values. Values are read from flash.");
+        }
+    }
 }
 
-/**
- * Gets the file path under which data for a specified key is stored.
- *
- * @param      keyValueStore        Key-value store.
- * @param      domain               Domain.
- * @param      key                  Key.
- * @param[out] filePath             File path for the domain / key. NULL-terminated.
- * @param      maxFilePathLength    Maximum length that the filePath buffer may hold.
- *
- * @return kHAPError_None           If successful.
- * @return kHAPError_OutOfResources If @p cap not large enough.
- */
-HAP_RESULT_USE_CHECK
-static HAPError GetFilePath(
+void HAPPlatformKeyValueStoreGetStatistics(
         HAPPlatformKeyValueStoreRef keyValueStore,
-        HAPPlatformKeyValueStoreDomain domain,
-        HAPPlatformKeyValueStoreKey key,
-        char *filePath,
-        size_t maxFilePathLength) {
+        HAPPlatformKeyValueStoreStatistics* statistics) {
     HAPPrecondition(keyValueStore);
-    HAPPrecondition(keyValueStore->rootDirectory);
-    HAPPrecondition(filePath);
+    HAPPrecondition(statistics);
 
-    HAPAssert(sizeof domain == sizeof(uint8_t));
-    HAPAssert(sizeof key == sizeof(uint8_t));
-    HAPError err = HAPStringWithFormat(filePath, maxFilePathLength, "%s/%02X.%02X", keyValueStore->rootDirectory, domain, key);
-    if (err) {
-        HAPAssert(err == kHAPError_OutOfResources);
-        HAPLogError(
-                &logObject,
-                "Not enough resources to get path: %s/%02X.%02X",
-                keyValueStore->rootDirectory,
-                domain,
-                key);
-        return kHAPError_OutOfResources;
+    *statistics = keyValueStore->statistics;
+    statistics->numFlashWritesPerHour = HAPPlatformKeyValueStoreGetWriteRate(keyValueStore);
+    if (keyValueStore->useLog) {
+        statistics->numFlashBytesWritten = keyValueStore->log.numBytesWritten;
+        statistics->numLogCompactions = keyValueStore->log.numCompactions;
     }
-
-    return kHAPError_None;
 }
 
-/**
- * Reads a file.
- *
- * @param      keyValueStore        Key-value store.
- * @param      domain               Domain.
- * @param      key                  Key.
- * @param[out] bytes                Buffer for the content of the file, if exists.
- * @param      maxBytes             Capacity of the bytes buffer.
- * @param[out] numBytes             Effective length of the bytes buffer, if exists.
- * @param[out] found                Whether the file path exists and could be read.
- *
- * @return kHAPError_None           If successful.
- * @return kHAPError_Unknown        If the file access failed.
- */
 HAP_RESULT_USE_CHECK
 HAPError HAPPlatformKeyValueStoreGet(
         HAPPlatformKeyValueStoreRef keyValueStore,
@@ -93,54 +175,158 @@ HAPError HAPPlatformKeyValueStoreGet(
     HAPPrecondition((bytes == NULL) == (numBytes == NULL));
     HAPPrecondition(found);
 
+    HAPError err;
+
     *found = false;
 
-    // Get file name.
-    char filePath[SL_FS_MAX_FILE_NAME_LENGTH];
-    HAPError err = GetFilePath(keyValueStore, domain, key, filePath, sizeof filePath);
+    if (keyValueStore->isTransactionActive) {
+        const HAPPlatformKeyValueStoreOperation* _Nullable operation =
+                HAPPlatformKeyValueStoreFindTransactionOperation(keyValueStore, domain, key);
+        if (operation) {
+            *found = !operation->isRemove;
+            if (*found && numBytes) {
+                *numBytes = HAPMin(operation->numBytes, maxBytes);
+                if (*numBytes) {
+                    HAPRawBufferCopyBytes(HAPNonnullVoid(bytes), HAPNonnullVoid(operation->bytes), *numBytes);
+                }
+            }
+            return kHAPError_None;
+        }
+        if (HAPPlatformKeyValueStoreIsPurgedByTransaction(keyValueStore, domain)) {
+            return kHAPError_None;
+        }
+    }
+
+    if (domain == keyValueStore->pairingsDomain && keyValueStore->isPairingTableValid) {
+        keyValueStore->statistics.numPairingTableHits++;
+        const HAPPlatformKeyValueStorePairingEntry* _Nullable pairingEntry =
+                HAPPlatformKeyValueStoreFindPairingEntry(keyValueStore, key);
+        *found = pairingEntry != NULL;
+        if (pairingEntry && numBytes) {
+            *numBytes = HAPMin(pairingEntry->numBytes, maxBytes);
+            if (*numBytes) {
+                HAPRawBufferCopyBytes(HAPNonnullVoid(bytes), pairingEntry->bytes, *numBytes);
+            }
+        }
+        return kHAPError_None;
+    }
+
+    HAPPlatformKeyValueStoreCacheEntry* _Nullable entry =
+            HAPPlatformKeyValueStoreFindCacheEntry(keyValueStore, domain, key);
+    if (entry) {
+        keyValueStore->statistics.numCacheHits++;
+        *found = entry->isFound;
+        if (entry->isFound && numBytes) {
+            *numBytes = HAPMin(entry->numBytes, maxBytes);
+            if (*numBytes) {
+                HAPRawBufferCopyBytes(HAPNonnullVoid(bytes), entry->bytes, *numBytes);
+            }
+        }
+        return kHAPError_None;
+    }
+    keyValueStore->statistics.numCacheMisses++;
+
+    err = HAPPlatformKeyValueStoreAllocateCacheEntry(keyValueStore, domain, key, &entry);
     if (err) {
-        HAPAssert(err == kHAPError_OutOfResources);
-        return kHAPError_Unknown;
+        HAPAssert(err == kHAPError_Unknown);
+        return err;
+    }
+    if (!entry) {
+        return HAPPlatformKeyValueStoreReadFile(keyValueStore, domain, key, bytes, maxBytes, numBytes, found);
+    }
+
+    // Read directly into the caller's buffer if it is large enough to hold any cacheable value.
+    // Otherwise, read into the cache entry, so that the full value is known.
+    size_t numValueBytes = 0;
+    if (maxBytes >= sizeof entry->bytes) {
+        err = HAPPlatformKeyValueStoreReadFile(keyValueStore, domain, key, bytes, maxBytes, &numValueBytes, found);
+        if (!err && numValueBytes < sizeof entry->bytes) {
+            HAPPlatformKeyValueStoreSetCacheEntry(entry, bytes, numValueBytes, *found);
+        } else {
+            entry->isValid = false;
+        }
+        if (!err && numBytes) {
+            *numBytes = numValueBytes;
+        }
+    } else {
+        err = HAPPlatformKeyValueStoreReadFile(
+                keyValueStore, domain, key, entry->bytes, sizeof entry->bytes, &numValueBytes, found);
+        if (!err && numValueBytes < sizeof entry->bytes) {
+            entry->numBytes = (uint8_t) numValueBytes;
+            entry->isFound = *found;
+        } else {
+            entry->isValid = false;
+        }
+        if (!err && numBytes) {
+            *numBytes = HAPMin(numValueBytes, maxBytes);
+            if (*numBytes) {
+                HAPRawBufferCopyBytes(HAPNonnullVoid(bytes), entry->bytes, *numBytes);
+            }
+        }
+    }
+    if (err) {
+        HAPAssert(err == kHAPError_Unknown);
+        *found = false;
+        return err;
     }
+    return kHAPError_None;
+}
 
-    int32_t handle = sl_FsOpen((unsigned char *)filePath, SL_FS_READ, NULL);
-    if (handle < 0) {
-        if (handle == SL_ERROR_FS_FILE_NOT_EXISTS) {
-            // File does not exist.
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformKeyValueStoreGetSize(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain,
+        HAPPlatformKeyValueStoreKey key,
+        size_t* numBytes,
+        bool* found) {
+    HAPPrecondition(keyValueStore);
+    HAPPrecondition(keyValueStore->rootDirectory);
+    HAPPrecondition(numBytes);
+    HAPPrecondition(found);
+
+    *found = false;
+
+    if (keyValueStore->isTransactionActive) {
+        const HAPPlatformKeyValueStoreOperation* _Nullable operation =
+                HAPPlatformKeyValueStoreFindTransactionOperation(keyValueStore, domain, key);
+        if (operation) {
+            *found = !operation->isRemove;
+            *numBytes = operation->numBytes;
+            return kHAPError_None;
+        }
+        if (HAPPlatformKeyValueStoreIsPurgedByTransaction(keyValueStore, domain)) {
+            *numBytes = 0;
             return kHAPError_None;
         }
-        HAPLogError(&logObject, "sl_FsOpen %s failed: %d.", filePath, (int)handle);
-        return kHAPError_Unknown;
     }
-    
-    *found = true;
 
-    int32_t retval = sl_FsRead(handle, 0, (unsigned char *)bytes, maxBytes);
-    if (retval < 0) {
-        HAPLogError(&logObject, "sl_FsRead %s failed: %d.", filePath, (int)retval);
-        return kHAPError_Unknown;
+    if (domain == keyValueStore->pairingsDomain && keyValueStore->isPairingTableValid) {
+        keyValueStore->statistics.numPairingTableHits++;
+        const HAPPlatformKeyValueStorePairingEntry* _Nullable pairingEntry =
+                HAPPlatformKeyValueStoreFindPairingEntry(keyValueStore, key);
+        *found = pairingEntry != NULL;
+        *numBytes = pairingEntry ? pairingEntry->numBytes : 0;
+        return kHAPError_None;
     }
-    
-    HAPLogBufferDebug(&logObject, bytes, maxBytes, "Read %02X.%02X", domain, key);
 
-    // Return the size of the output buffer.
-    *numBytes = maxBytes;
-    sl_FsClose(handle, 0, 0, 0);
+    const HAPPlatformKeyValueStoreCacheEntry* _Nullable entry =
+            HAPPlatformKeyValueStoreFindCacheEntry(keyValueStore, domain, key);
+    if (entry) {
+        keyValueStore->statistics.numCacheHits++;
+        *found = entry->isFound;
+        *numBytes = entry->numBytes;
+        return kHAPError_None;
+    }
+
+    HAPError err = HAPPlatformKeyValueStoreGetFileSize(keyValueStore, domain, key, numBytes, found);
+    if (err) {
+        HAPAssert(err == kHAPError_Unknown);
+        *found = false;
+        return err;
+    }
     return kHAPError_None;
 }
 
-/**
- * Writes a file atomically.
- *
- * @param      keyValueStore        Key-value store.
- * @param      domain               Domain.
- * @param      key                  Key.
- * @param      bytes                Buffer with the content of the file, if exists. numBytes != 0 implies bytes.
- * @param      numBytes             Effective length of the bytes buffer.
- *
- * @return kHAPError_None           If successful.
- * @return kHAPError_Unknown        If the file access failed.
- */
 HAP_RESULT_USE_CHECK
 HAPError HAPPlatformKeyValueStoreSet(
         HAPPlatformKeyValueStoreRef keyValueStore,
@@ -152,44 +338,65 @@ HAPError HAPPlatformKeyValueStoreSet(
     HAPPrecondition(keyValueStore->rootDirectory);
     HAPPrecondition(bytes || numBytes);
 
-    HAPLogBufferDebug(&logObject, bytes, numBytes, "Write %02X.%02X", domain, key);
-    
-    // Get file name.
-    char filePath[SL_FS_MAX_FILE_NAME_LENGTH];
-    HAPError err = GetFilePath(keyValueStore, domain, key, filePath, sizeof filePath);
+    HAPError err;
+
+    if (keyValueStore->isTransactionActive) {
+        return HAPPlatformKeyValueStoreStageOperation(
+                keyValueStore, domain, key, bytes, numBytes, /* isRemove: */ false, /* isPurge: */ false);
+    }
+
+    err = HAPPlatformKeyValueStoreApplyPendingJournal(keyValueStore);
     if (err) {
-        HAPAssert(err == kHAPError_OutOfResources);
-        return kHAPError_Unknown;
+        HAPAssert(err == kHAPError_Unknown);
+        return err;
     }
 
-    // Write the KVS file.
-    int32_t handle = sl_FsOpen((unsigned char *)filePath,
-        SL_FS_CREATE | SL_FS_CREATE_FAILSAFE | SL_FS_OVERWRITE | SL_FS_CREATE_MAX_SIZE(numBytes), NULL);
-    if (handle < 0) {
-        HAPLogError(&logObject, "sl_FsOpen %s failed: %d.", filePath, (int)handle);
-        return kHAPError_Unknown;
+    HAPPlatformKeyValueStoreCacheEntry* _Nullable entry =
+            HAPPlatformKeyValueStoreFindCacheEntry(keyValueStore, domain, key);
+    bool isCacheable = numBytes < kHAPPlatformKeyValueStoreCache_MaxValueBytes;
+    if (!entry && isCacheable) {
+        err = HAPPlatformKeyValueStoreAllocateCacheEntry(keyValueStore, domain, key, &entry);
+        if (err) {
+            HAPAssert(err == kHAPError_Unknown);
+            return err;
+        }
     }
 
-    int32_t retval = sl_FsWrite(handle, 0, (unsigned char *)bytes, numBytes);
-    if (retval < 0) {
-        HAPLogError(&logObject, "sl_FsWrite %s failed: %d.", filePath, (int)retval);
-        return kHAPError_Unknown;
+    // In write-back mode, defer the write until the cache is flushed.
+    // In write-through mode, defer writes of non-critical values while the write budget is exceeded.
+    if (entry && isCacheable &&
+        (keyValueStore->useWriteBack || HAPPlatformKeyValueStoreDeferWrite(keyValueStore, domain))) {
+        if (entry->isDirty) {
+            keyValueStore->statistics.numWritesCoalesced++;
+        }
+        HAPPlatformKeyValueStoreSetCacheEntry(entry, bytes, numBytes, /* found: */ true);
+        entry->isDirty = true;
+        HAPPlatformKeyValueStoreUpdatePairingTable(
+                keyValueStore, domain, key, bytes, numBytes, /* isRemove: */ false);
+        return kHAPError_None;
     }
 
-    sl_FsClose(handle, 0, 0, 0);
+    err = HAPPlatformKeyValueStoreWriteFile(keyValueStore, domain, key, bytes, numBytes);
+    if (err) {
+        HAPAssert(err == kHAPError_Unknown);
+        if (entry) {
+            entry->isValid = false;
+        }
+        HAPPlatformKeyValueStoreInvalidatePairingTable(keyValueStore, domain);
+        return err;
+    }
+    HAPPlatformKeyValueStoreUpdatePairingTable(keyValueStore, domain, key, bytes, numBytes, /* isRemove: */ false);
+    if (entry) {
+        if (isCacheable) {
+            HAPPlatformKeyValueStoreSetCacheEntry(entry, bytes, numBytes, /* found: */ true);
+            entry->isDirty = false;
+        } else {
+            entry->isValid = false;
+        }
+    }
     return kHAPError_None;
 }
 
-/**
- * Removes a file.
- *
- * @param      keyValueStore        Key-value store.
- * @param      domain               Domain.
- * @param      key                  Key.
- *
- * @return kHAPError_None           If successful.
- * @return kHAPError_Unknown        If the file removal failed.
- */
 HAP_RESULT_USE_CHECK
 HAPError HAPPlatformKeyValueStoreRemove(
         HAPPlatformKeyValueStoreRef keyValueStore,
@@ -198,43 +405,41 @@ HAPError HAPPlatformKeyValueStoreRemove(
     HAPPrecondition(keyValueStore);
     HAPPrecondition(keyValueStore->rootDirectory);
 
-    // Get file name.
-    char filePath[SL_FS_MAX_FILE_NAME_LENGTH];
-    HAPError err = GetFilePath(keyValueStore, domain, key, filePath, sizeof filePath);
+    if (keyValueStore->isTransactionActive) {
+        return HAPPlatformKeyValueStoreStageOperation(
+                keyValueStore, domain, key, NULL, 0, /* isRemove: */ true, /* isPurge: */ false);
+    }
+
+    HAPError err = HAPPlatformKeyValueStoreApplyPendingJournal(keyValueStore);
     if (err) {
-        HAPAssert(err == kHAPError_OutOfResources);
-        return kHAPError_Unknown;
+        HAPAssert(err == kHAPError_Unknown);
+        return err;
     }
 
-    HAPLogDebug(&logObject, "Delete %s", filePath);
+    HAPPlatformKeyValueStoreCacheEntry* _Nullable entry =
+            HAPPlatformKeyValueStoreFindCacheEntry(keyValueStore, domain, key);
+    if (entry && !entry->isFound) {
+        // Value is known not to exist.
+        return kHAPError_None;
+    }
 
-    // Remove file.
-    int16_t rc = sl_FsDel((unsigned char *)filePath, 0);
-    if (rc < 0) {
-        if (rc == SL_ERROR_FS_FILE_NOT_EXISTS) {
-            // File does not exist.
-            return kHAPError_None;
+    err = HAPPlatformKeyValueStoreRemoveFile(keyValueStore, domain, key);
+    if (err) {
+        HAPAssert(err == kHAPError_Unknown);
+        if (entry) {
+            entry->isValid = false;
         }
-        HAPLogError(&logObject, "sl_FsDel %s failed: %d.", filePath, rc);
-        return kHAPError_Unknown;
+        HAPPlatformKeyValueStoreInvalidatePairingTable(keyValueStore, domain);
+        return err;
+    }
+    HAPPlatformKeyValueStoreUpdatePairingTable(keyValueStore, domain, key, NULL, 0, /* isRemove: */ true);
+    if (entry) {
+        HAPPlatformKeyValueStoreSetCacheEntry(entry, NULL, 0, /* found: */ false);
+        entry->isDirty = false;
     }
-
     return kHAPError_None;
 }
 
-static uint8_t ParseHexByte(const char *str) {
-    HAPPrecondition(str);
-
-    char hex[3] = { '\0' };
-    HAPRawBufferCopyBytes(hex, str, 2);
-
-    char *end;
-    unsigned long value = strtoul(hex, &end, 16);
-    HAPAssert(end == &hex[2]);
-    HAPAssert(value < UINT8_MAX);
-    return (uint8_t)value;
-}
-
 HAP_RESULT_USE_CHECK
 HAPError HAPPlatformKeyValueStoreEnumerate(
         HAPPlatformKeyValueStoreRef keyValueStore,
@@ -245,95 +450,117 @@ HAPError HAPPlatformKeyValueStoreEnumerate(
     HAPPrecondition(keyValueStore->rootDirectory);
     HAPPrecondition(callback);
 
-    typedef struct {
-        SlFileAttributes_t attribute;
-        char filePath[SL_FS_MAX_FILE_NAME_LENGTH];
-    } FsEntry;
-    
-    FsEntry entries[5];
-    long chunkIndex = -1;
-    int32_t fileCount = 1;
-    bool shouldContinue = true;
-    size_t separatorPos = HAPStringGetNumBytes(keyValueStore->rootDirectory);
-    HAPAssert(separatorPos + 5 < SL_FS_MAX_FILE_NAME_LENGTH);
-
-    do {
-        fileCount = sl_FsGetFileList(&chunkIndex, HAPArrayCount(entries),
-            sizeof(FsEntry), (uint8_t *)entries, SL_FS_GET_FILE_ATTRIBUTES);
-        
-        if (fileCount < 0) {
-            HAPLogError(&logObject, "sl_FsGetFileList failed: %d.", (int)fileCount);
-            return kHAPError_Unknown;
-        }
-        
-        for (int32_t i = 0; i < fileCount; ++i) {
-            char *fileName = &entries[i].filePath[separatorPos + 1];
-            
-            // Check root directory.
-            if (!HAPRawBufferAreEqual(entries[i].filePath, keyValueStore->rootDirectory, separatorPos))
-                continue;
-
-            // Check path format ("%s/%02X.%02X").
-            if ((entries[i].filePath[separatorPos] != '/') ||
-                (fileName[2] != '.') || (fileName[5] != '\0'))
-                continue;
-
-            // Check domain.
-            if (domain != ParseHexByte(&fileName[0]))
-                continue;
-
-            // Extract key and invoke callback.
-            HAPPlatformKeyValueStoreKey key = ParseHexByte(&fileName[3]);
-            HAPError err = callback(context, keyValueStore, domain, key, &shouldContinue);
+    HAPError err;
+
+    // Values of the domain that have not been written yet would not be listed.
+    err = HAPPlatformKeyValueStoreFlushDomain(keyValueStore, domain);
+    if (err) {
+        HAPAssert(err == kHAPError_Unknown);
+        return err;
+    }
+
+    if (domain == keyValueStore->pairingsDomain && keyValueStore->isPairingTableValid) {
+        return HAPPlatformKeyValueStoreEnumeratePairingTable(keyValueStore, callback, context);
+    }
+
+    if (keyValueStore->useLog) {
+        // The keys are listed first, as the callback may remove values.
+        HAPPlatformKeyValueStoreKey keys[256];
+        size_t numKeys = HAPPlatformKeyValueStoreLogListKeys(&keyValueStore->log, domain, keys);
+        bool shouldContinue = true;
+        for (size_t i = 0; i < numKeys && shouldContinue; i++) {
+            err = callback(context, keyValueStore, domain, keys[i], &shouldContinue);
             if (err) {
                 HAPAssert(err == kHAPError_Unknown);
                 return err;
             }
-
-            if (!shouldContinue)
-                return kHAPError_None;
         }
-    } while (fileCount > 0);
-    
-    return kHAPError_None;
+        return kHAPError_None;
+    }
+
+    if (keyValueStore->isKeyIndexValid) {
+        return HAPPlatformKeyValueStoreEnumerateKeyIndex(keyValueStore, domain, callback, context);
+    }
+
+    return HAPPlatformKeyValueStoreListFiles(keyValueStore, &domain, callback, context);
 }
 
 HAP_RESULT_USE_CHECK
-static HAPError PurgeDomainEnumerateCallback(
-        void* _Nullable context HAP_UNUSED,
+HAPError HAPPlatformKeyValueStorePurgeDomain(
         HAPPlatformKeyValueStoreRef keyValueStore,
-        HAPPlatformKeyValueStoreDomain domain,
-        HAPPlatformKeyValueStoreKey key,
-        bool* shouldContinue) {
+        HAPPlatformKeyValueStoreDomain domain) {
     HAPPrecondition(keyValueStore);
     HAPPrecondition(keyValueStore->rootDirectory);
-    HAPPrecondition(shouldContinue);
 
     HAPError err;
 
-    err = HAPPlatformKeyValueStoreRemove(keyValueStore, domain, key);
+    if (keyValueStore->isTransactionActive) {
+        return HAPPlatformKeyValueStoreStageOperation(
+                keyValueStore, domain, /* key: */ 0, NULL, 0, /* isRemove: */ true, /* isPurge: */ true);
+    }
+
+    err = HAPPlatformKeyValueStoreApplyPendingJournal(keyValueStore);
     if (err) {
         HAPAssert(err == kHAPError_Unknown);
         return err;
     }
 
-    return kHAPError_None;
-}
-
-HAP_RESULT_USE_CHECK
-HAPError HAPPlatformKeyValueStorePurgeDomain(
-        HAPPlatformKeyValueStoreRef keyValueStore,
-        HAPPlatformKeyValueStoreDomain domain) {
-    HAPPrecondition(keyValueStore);
-    HAPPrecondition(keyValueStore->rootDirectory);
+    // Drop cached values of the domain. Values that have not been written yet need not be written.
+    HAPPlatformKeyValueStoreDropCacheEntries(keyValueStore, domain);
+
+    if (keyValueStore->useLog) {
+        HAPPlatformKeyValueStoreKey logKeys[256];
+        if (HAPPlatformKeyValueStoreLogListKeys(&keyValueStore->log, domain, logKeys)) {
+            HAPTime startTime = HAPPlatformClockGetCurrent();
+            keyValueStore->statistics.numFlashWrites++;
+            HAPPlatformKeyValueStoreRecordFlashWrite(keyValueStore);
+            err = HAPPlatformKeyValueStoreLogPurgeDomain(&keyValueStore->log, domain);
+            HAPPlatformKeyValueStoreRecordFlashWriteTime(keyValueStore, startTime);
+            if (err) {
+                HAPAssert(err == kHAPError_Unknown);
+                HAPPlatformKeyValueStoreInvalidatePairingTable(keyValueStore, domain);
+                return err;
+            }
+            keyValueStore->statistics.numBulkPurges++;
+        }
+        HAPPlatformKeyValueStoreForgetDomain(keyValueStore, domain);
+        return kHAPError_None;
+    }
 
-    HAPError err;
+    if (keyValueStore->isKeyIndexValid && !HAPPlatformKeyValueStoreFindKeyIndexEntry(keyValueStore, domain)) {
+        // The domain contains no files.
+        HAPPlatformKeyValueStoreForgetDomain(keyValueStore, domain);
+        return kHAPError_None;
+    }
 
-    err = HAPPlatformKeyValueStoreEnumerate(keyValueStore, domain, PurgeDomainEnumerateCallback, NULL);
+    // Advancing the generation takes a single write of the generations file.
+    HAPPlatformKeyValueStoreGenerationTable generationTable = keyValueStore->generationTable;
+    bool isGenerationAdvanced = false;
+    err = HAPPlatformKeyValueStorePurgeDomainFiles(keyValueStore, domain, &isGenerationAdvanced);
+    if (!err && isGenerationAdvanced) {
+        HAPTime startTime = HAPPlatformClockGetCurrent();
+        err = HAPPlatformKeyValueStoreWriteGenerations(keyValueStore);
+        HAPPlatformKeyValueStoreRecordFlashWriteTime(keyValueStore, startTime);
+        if (err) {
+            // The files of the domain remain in effect. The key index is rebuilt to list them again.
+            keyValueStore->generationTable = generationTable;
+            if (keyValueStore->keyIndexEntries) {
+                HAPError indexErr = HAPPlatformKeyValueStoreBuildKeyIndex(keyValueStore);
+                if (indexErr) {
+                    HAPAssert(indexErr == kHAPError_Unknown);
+                    HAPLogError(&logObject, "Failed to rebuild key index. Enumeration lists the files.");
+                }
+            }
+        }
+    }
     if (err) {
         HAPAssert(err == kHAPError_Unknown);
+        HAPPlatformKeyValueStoreInvalidatePairingTable(keyValueStore, domain);
         return err;
     }
-
+    if (isGenerationAdvanced) {
+        HAPPlatformKeyValueStoreScheduleCollection(keyValueStore, /* deadline: */ 0);
+    }
+    HAPPlatformKeyValueStoreForgetDomain(keyValueStore, domain);
     return kHAPError_None;
 }
@@ -0,0 +1,107 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+#include "HAPPlatformKeyValueStore+Init.h"
+
+HAPPlatformKeyValueStoreCacheEntry* _Nullable HAPPlatformKeyValueStoreFindCacheEntry(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain,
+        HAPPlatformKeyValueStoreKey key) {
+    HAPPrecondition(keyValueStore);
+
+    for (size_t i = 0; i < keyValueStore->numCacheEntries; i++) {
+        HAPPlatformKeyValueStoreCacheEntry* entry = &keyValueStore->cacheEntries[i];
+        if (entry->isValid && entry->domain == domain && entry->key == key) {
+            entry->lastAccess = ++keyValueStore->cacheAccessCounter;
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformKeyValueStoreAllocateCacheEntry(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain,
+        HAPPlatformKeyValueStoreKey key,
+        HAPPlatformKeyValueStoreCacheEntry* _Nullable* entry) {
+    HAPPrecondition(keyValueStore);
+    HAPPrecondition(entry);
+
+    *entry = NULL;
+    if (!keyValueStore->numCacheEntries) {
+        return kHAPError_None;
+    }
+
+    HAPPlatformKeyValueStoreCacheEntry* victim = &keyValueStore->cacheEntries[0];
+    for (size_t i = 0; i < keyValueStore->numCacheEntries && victim->isValid; i++) {
+        HAPPlatformKeyValueStoreCacheEntry* candidate = &keyValueStore->cacheEntries[i];
+        if (!candidate->isValid || candidate->lastAccess < victim->lastAccess) {
+            victim = candidate;
+        }
+    }
+    if (victim->isValid && victim->isDirty) {
+        HAPError err = HAPPlatformKeyValueStoreFlushCacheEntry(keyValueStore, victim);
+        if (err) {
+            HAPAssert(err == kHAPError_Unknown);
+            return err;
+        }
+    }
+
+    HAPRawBufferZero(victim, sizeof *victim);
+    victim->isValid = true;
+    victim->domain = domain;
+    victim->key = key;
+    victim->lastAccess = ++keyValueStore->cacheAccessCounter;
+    *entry = victim;
+    return kHAPError_None;
+}
+
+void HAPPlatformKeyValueStoreSetCacheEntry(
+        HAPPlatformKeyValueStoreCacheEntry* entry,
+        const void* _Nullable bytes,
+        size_t numBytes,
+        bool found) {
+    HAPPrecondition(entry);
+    HAPPrecondition(entry->isValid);
+    HAPPrecondition(!numBytes || bytes);
+    HAPPrecondition(numBytes < sizeof entry->bytes);
+    HAPPrecondition(found || !numBytes);
+
+    if (numBytes) {
+        HAPRawBufferCopyBytes(entry->bytes, HAPNonnullVoid(bytes), numBytes);
+    }
+    entry->numBytes = (uint8_t) numBytes;
+    entry->isFound = found;
+}
+
+void HAPPlatformKeyValueStoreDropCacheEntries(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain) {
+    HAPPrecondition(keyValueStore);
+
+    for (size_t i = 0; i < keyValueStore->numCacheEntries; i++) {
+        HAPPlatformKeyValueStoreCacheEntry* entry = &keyValueStore->cacheEntries[i];
+        if (entry->isValid && entry->domain == domain) {
+            entry->isValid = false;
+        }
+    }
+}
+
+void HAPPlatformKeyValueStoreForgetDomain(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain) {
+    HAPPrecondition(keyValueStore);
+
+    HAPPlatformKeyValueStoreDropPreloadedValues(keyValueStore, domain, /* key: */ NULL);
+    HAPPlatformKeyValueStoreDropCacheEntries(keyValueStore, domain);
+
+    // An empty pairings domain is held completely by the pairing table.
+    if (domain == keyValueStore->pairingsDomain && keyValueStore->pairingEntries) {
+        keyValueStore->numPairingEntries = 0;
+        keyValueStore->isPairingTableValid = true;
+    }
+}
@@ -0,0 +1,128 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+#ifndef HAP_PLATFORM_KEY_VALUE_STORE_CACHE_H
+#define HAP_PLATFORM_KEY_VALUE_STORE_CACHE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "HAPPlatform.h"
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull begin
+#endif
+
+/**@file
+ * RAM cache of the key-value store.
+ *
+ * The cache serves repeated reads of small values, including values that do not exist, without accessing the
+ * network processor. When all entries are in use, the least recently used entry is evicted. A modified entry is
+ * written to flash before it is evicted, see HAPPlatformKeyValueStoreWriteBack.h.
+ */
+
+/**
+ * Capacity of a cache entry. Values of this size or larger are not cached.
+ *
+ * - Covers pairings, the configuration number, the long-term secret key and small application state.
+ */
+#define kHAPPlatformKeyValueStoreCache_MaxValueBytes ((size_t) 128)
+
+/**
+ * Cache entry.
+ */
+typedef struct {
+    // Opaque type. Do not access the instance fields directly.
+    /**@cond */
+    uint8_t bytes[kHAPPlatformKeyValueStoreCache_MaxValueBytes];
+    uint32_t lastAccess;
+    uint8_t numBytes;
+    HAPPlatformKeyValueStoreDomain domain;
+    HAPPlatformKeyValueStoreKey key;
+    bool isValid : 1;
+    bool isFound : 1;
+    bool isDirty : 1;
+    /**@endcond */
+} HAPPlatformKeyValueStoreCacheEntry;
+
+/**
+ * Finds the cache entry of a key.
+ *
+ * @param      keyValueStore        Key-value store.
+ * @param      domain               Domain.
+ * @param      key                  Key.
+ *
+ * @return Cache entry of the key, or NULL if the key is not cached.
+ */
+HAPPlatformKeyValueStoreCacheEntry* _Nullable HAPPlatformKeyValueStoreFindCacheEntry(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain,
+        HAPPlatformKeyValueStoreKey key);
+
+/**
+ * Allocates a cache entry for a key that is not cached. The least recently used entry is evicted if necessary.
+ *
+ * @param      keyValueStore        Key-value store.
+ * @param      domain               Domain.
+ * @param      key                  Key.
+ * @param[out] entry                Cache entry, or NULL if caching is disabled. Not found and not modified.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_Unknown        If the evicted value could not be written to flash.
+ */
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformKeyValueStoreAllocateCacheEntry(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain,
+        HAPPlatformKeyValueStoreKey key,
+        HAPPlatformKeyValueStoreCacheEntry* _Nullable* _Nonnull entry);
+
+/**
+ * Stores a value in a cache entry.
+ *
+ * @param      entry                Cache entry.
+ * @param      bytes                Value, if found.
+ * @param      numBytes             Length of the value. Must be less than kHAPPlatformKeyValueStoreCache_MaxValueBytes.
+ * @param      found                Whether the value exists.
+ */
+void HAPPlatformKeyValueStoreSetCacheEntry(
+        HAPPlatformKeyValueStoreCacheEntry* entry,
+        const void* _Nullable bytes,
+        size_t numBytes,
+        bool found);
+
+/**
+ * Drops the cached values of a domain. Values that have not been written yet are discarded.
+ *
+ * @param      keyValueStore        Key-value store.
+ * @param      domain               Domain.
+ */
+void HAPPlatformKeyValueStoreDropCacheEntries(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain);
+
+/**
+ * Drops the values of a domain that are held in RAM after the domain has been purged.
+ *
+ * - Covers the cache entries, the preloaded values and the pairing table.
+ *
+ * @param      keyValueStore        Key-value store.
+ * @param      domain               Domain.
+ */
+void HAPPlatformKeyValueStoreForgetDomain(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain);
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull end
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
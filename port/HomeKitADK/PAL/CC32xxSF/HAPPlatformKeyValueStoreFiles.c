@@ -0,0 +1,512 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Copyright (c) 2021 John Buonagurio
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+#include "HAPPlatformKeyValueStore+Init.h"
+
+#include <ti/drivers/net/wifi/simplelink.h>
+
+static const HAPLogObject logObject = { .subsystem = kHAPPlatform_LogSubsystem, .category = "KeyValueStore" };
+
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformKeyValueStoreGetFilePathOfGeneration(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain,
+        HAPPlatformKeyValueStoreKey key,
+        uint8_t generation,
+        char *filePath,
+        size_t maxFilePathLength) {
+    HAPPrecondition(keyValueStore);
+    HAPPrecondition(keyValueStore->rootDirectory);
+    HAPPrecondition(filePath);
+
+    HAPAssert(sizeof domain == sizeof(uint8_t));
+    HAPAssert(sizeof key == sizeof(uint8_t));
+    HAPError err;
+    if (generation) {
+        err = HAPStringWithFormat(
+                filePath,
+                maxFilePathLength,
+                "%s/%02X.%02X.%02X",
+                keyValueStore->rootDirectory,
+                domain,
+                key,
+                generation);
+    } else {
+        err = HAPStringWithFormat(
+                filePath, maxFilePathLength, "%s/%02X.%02X", keyValueStore->rootDirectory, domain, key);
+    }
+    if (err) {
+        HAPAssert(err == kHAPError_OutOfResources);
+        HAPLogError(
+                &logObject,
+                "Not enough resources to get path: %s/%02X.%02X",
+                keyValueStore->rootDirectory,
+                domain,
+                key);
+        return kHAPError_OutOfResources;
+    }
+
+    return kHAPError_None;
+}
+
+/**
+ * Gets the file path under which data for a specified key is stored.
+ *
+ * @param      keyValueStore        Key-value store.
+ * @param      domain               Domain.
+ * @param      key                  Key.
+ * @param[out] filePath             File path for the domain / key. NULL-terminated.
+ * @param      maxFilePathLength    Maximum length that the filePath buffer may hold.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_OutOfResources If @p cap not large enough.
+ */
+HAP_RESULT_USE_CHECK
+static HAPError GetFilePath(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain,
+        HAPPlatformKeyValueStoreKey key,
+        char *filePath,
+        size_t maxFilePathLength) {
+    HAPPrecondition(keyValueStore);
+
+    return HAPPlatformKeyValueStoreGetFilePathOfGeneration(
+            keyValueStore,
+            domain,
+            key,
+            HAPPlatformKeyValueStoreGetGeneration(keyValueStore, domain),
+            filePath,
+            maxFilePathLength);
+}
+
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformKeyValueStoreGetInternalFilePath(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        const char* fileName,
+        char *filePath,
+        size_t maxFilePathLength) {
+    HAPPrecondition(keyValueStore);
+    HAPPrecondition(keyValueStore->rootDirectory);
+    HAPPrecondition(fileName);
+    HAPPrecondition(filePath);
+
+    HAPError err = HAPStringWithFormat(filePath, maxFilePathLength, "%s/%s", keyValueStore->rootDirectory, fileName);
+    if (err) {
+        HAPAssert(err == kHAPError_OutOfResources);
+        HAPLogError(&logObject, "Not enough resources to get path: %s/%s", keyValueStore->rootDirectory, fileName);
+        return kHAPError_Unknown;
+    }
+    return kHAPError_None;
+}
+
+static uint8_t ParseHexByte(const char *str) {
+    HAPPrecondition(str);
+
+    char hex[3] = { '\0' };
+    HAPRawBufferCopyBytes(hex, str, 2);
+
+    char *end;
+    unsigned long value = strtoul(hex, &end, 16);
+    HAPAssert(end == &hex[2]);
+    HAPAssert(value <= UINT8_MAX);
+    return (uint8_t)value;
+}
+
+HAP_RESULT_USE_CHECK
+bool HAPPlatformKeyValueStoreParseFilePath(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        const char* filePath,
+        HAPPlatformKeyValueStoreDomain* domain,
+        HAPPlatformKeyValueStoreKey* key,
+        uint8_t* generation) {
+    HAPPrecondition(keyValueStore);
+    HAPPrecondition(keyValueStore->rootDirectory);
+    HAPPrecondition(filePath);
+    HAPPrecondition(domain);
+    HAPPrecondition(key);
+    HAPPrecondition(generation);
+
+    size_t separatorPos = HAPStringGetNumBytes(keyValueStore->rootDirectory);
+    HAPAssert(separatorPos + 9 < SL_FS_MAX_FILE_NAME_LENGTH);
+
+    // Check root directory.
+    if (!HAPRawBufferAreEqual(filePath, keyValueStore->rootDirectory, separatorPos) || filePath[separatorPos] != '/') {
+        return false;
+    }
+
+    // Check name format.
+    const char* fileName = &filePath[separatorPos + 1];
+    if (fileName[2] != '.') {
+        return false;
+    }
+    if (fileName[5] == '\0') {
+        *generation = 0;
+    } else if (fileName[5] == '.' && fileName[8] == '\0') {
+        *generation = ParseHexByte(&fileName[6]);
+    } else {
+        return false;
+    }
+    *domain = ParseHexByte(&fileName[0]);
+    *key = ParseHexByte(&fileName[3]);
+    return true;
+}
+
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformKeyValueStoreReadFile(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain,
+        HAPPlatformKeyValueStoreKey key,
+        void* _Nullable bytes,
+        size_t maxBytes,
+        size_t* _Nullable numBytes,
+        bool* found) {
+    HAPPrecondition(keyValueStore);
+    HAPPrecondition(keyValueStore->rootDirectory);
+    HAPPrecondition(!maxBytes || bytes);
+    HAPPrecondition((bytes == NULL) == (numBytes == NULL));
+    HAPPrecondition(found);
+
+    *found = false;
+    if (HAPPlatformKeyValueStoreIsKeyKnownMissing(keyValueStore, domain, key)) {
+        keyValueStore->statistics.numKeyIndexHits++;
+        return kHAPError_None;
+    }
+    const uint8_t* _Nullable preloadedValue = HAPPlatformKeyValueStoreFindPreloadedValue(keyValueStore, domain, key);
+    if (preloadedValue) {
+        keyValueStore->statistics.numPreloadHits++;
+        *found = true;
+        if (numBytes) {
+            *numBytes = HAPMin((size_t) HAPReadLittleUInt16(&preloadedValue[2]), maxBytes);
+            if (*numBytes) {
+                HAPRawBufferCopyBytes(
+                        HAPNonnullVoid(bytes),
+                        &preloadedValue[kHAPPlatformKeyValueStorePreload_NumHeaderBytes],
+                        *numBytes);
+            }
+        }
+        return kHAPError_None;
+    }
+    keyValueStore->statistics.numFlashReads++;
+
+    if (keyValueStore->useLog) {
+        HAPError err = HAPPlatformKeyValueStoreLogRead(
+                &keyValueStore->log, domain, key, bytes, maxBytes, numBytes, found);
+        if (!err && numBytes) {
+            keyValueStore->statistics.numFlashBytesRead += *numBytes;
+        }
+        return err;
+    }
+
+    // Get file name.
+    char filePath[SL_FS_MAX_FILE_NAME_LENGTH];
+    HAPError err = GetFilePath(keyValueStore, domain, key, filePath, sizeof filePath);
+    if (err) {
+        HAPAssert(err == kHAPError_OutOfResources);
+        return kHAPError_Unknown;
+    }
+
+    // Get the stored length from the file metadata, so that only the stored bytes are transferred.
+    SlFsFileInfo_t fileInfo;
+    int16_t rc = sl_FsGetInfo((unsigned char *)filePath, 0, &fileInfo);
+    if (rc < 0) {
+        if (rc == SL_ERROR_FS_FILE_NOT_EXISTS) {
+            // File does not exist.
+            HAPPlatformKeyValueStoreRemoveFromKeyIndex(keyValueStore, domain, key);
+            return kHAPError_None;
+        }
+        HAPLogError(&logObject, "sl_FsGetInfo %s failed: %d.", filePath, rc);
+        return kHAPError_Unknown;
+    }
+
+    size_t numReadBytes = HAPMin((size_t) fileInfo.Len, maxBytes);
+    if (numReadBytes) {
+        int32_t handle = sl_FsOpen((unsigned char *)filePath, SL_FS_READ, NULL);
+        if (handle < 0) {
+            HAPLogError(&logObject, "sl_FsOpen %s failed: %d.", filePath, (int)handle);
+            return kHAPError_Unknown;
+        }
+
+        int32_t retval = sl_FsRead(handle, 0, (unsigned char *)bytes, numReadBytes);
+        sl_FsClose(handle, 0, 0, 0);
+        if (retval < 0) {
+            HAPLogError(&logObject, "sl_FsRead %s failed: %d.", filePath, (int)retval);
+            return kHAPError_Unknown;
+        }
+        numReadBytes = (size_t) retval;
+    }
+
+    *found = true;
+    HAPLogBufferDebug(&logObject, bytes, numReadBytes, "Read %02X.%02X", domain, key);
+
+    // Return the number of bytes read. The cache needs to know where the value ends.
+    if (numBytes) {
+        *numBytes = numReadBytes;
+    }
+    keyValueStore->statistics.numFlashBytesRead += numReadBytes;
+    return kHAPError_None;
+}
+
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformKeyValueStoreGetFileSize(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain,
+        HAPPlatformKeyValueStoreKey key,
+        size_t* numBytes,
+        bool* found) {
+    HAPPrecondition(keyValueStore);
+    HAPPrecondition(keyValueStore->rootDirectory);
+    HAPPrecondition(numBytes);
+    HAPPrecondition(found);
+
+    *found = false;
+    if (HAPPlatformKeyValueStoreIsKeyKnownMissing(keyValueStore, domain, key)) {
+        keyValueStore->statistics.numKeyIndexHits++;
+        return kHAPError_None;
+    }
+    const uint8_t* _Nullable preloadedValue = HAPPlatformKeyValueStoreFindPreloadedValue(keyValueStore, domain, key);
+    if (preloadedValue) {
+        keyValueStore->statistics.numPreloadHits++;
+        *found = true;
+        *numBytes = HAPReadLittleUInt16(&preloadedValue[2]);
+        return kHAPError_None;
+    }
+
+    if (keyValueStore->useLog) {
+        *found = HAPPlatformKeyValueStoreLogGetSize(&keyValueStore->log, domain, key, numBytes);
+        return kHAPError_None;
+    }
+
+    // Get file name.
+    char filePath[SL_FS_MAX_FILE_NAME_LENGTH];
+    HAPError err = GetFilePath(keyValueStore, domain, key, filePath, sizeof filePath);
+    if (err) {
+        HAPAssert(err == kHAPError_OutOfResources);
+        return kHAPError_Unknown;
+    }
+
+    SlFsFileInfo_t fileInfo;
+    int16_t rc = sl_FsGetInfo((unsigned char *)filePath, 0, &fileInfo);
+    if (rc < 0) {
+        if (rc == SL_ERROR_FS_FILE_NOT_EXISTS) {
+            HAPPlatformKeyValueStoreRemoveFromKeyIndex(keyValueStore, domain, key);
+            return kHAPError_None;
+        }
+        HAPLogError(&logObject, "sl_FsGetInfo %s failed: %d.", filePath, rc);
+        return kHAPError_Unknown;
+    }
+    *found = true;
+    *numBytes = fileInfo.Len;
+    return kHAPError_None;
+}
+
+/**
+ * Writes a file atomically.
+ *
+ * @param      keyValueStore        Key-value store.
+ * @param      domain               Domain.
+ * @param      key                  Key.
+ * @param      bytes                Buffer with the content of the file, if exists. numBytes != 0 implies bytes.
+ * @param      numBytes             Effective length of the bytes buffer.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_Unknown        If the file access failed.
+ */
+HAP_RESULT_USE_CHECK
+static HAPError WriteFileToFlash(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain,
+        HAPPlatformKeyValueStoreKey key,
+        const void* bytes,
+        size_t numBytes) {
+    HAPPrecondition(keyValueStore);
+    HAPPrecondition(keyValueStore->rootDirectory);
+    HAPPrecondition(bytes || numBytes);
+
+    HAPPlatformKeyValueStoreDropPreloadedValues(keyValueStore, domain, &key);
+    keyValueStore->statistics.numFlashWrites++;
+    HAPPlatformKeyValueStoreRecordValueWrite(keyValueStore, domain, key, numBytes);
+
+    HAPLogBufferDebug(&logObject, bytes, numBytes, "Write %02X.%02X", domain, key);
+
+    if (keyValueStore->useLog) {
+        return HAPPlatformKeyValueStoreLogWrite(&keyValueStore->log, domain, key, bytes, numBytes);
+    }
+
+    // Get file name.
+    char filePath[SL_FS_MAX_FILE_NAME_LENGTH];
+    HAPError err = GetFilePath(keyValueStore, domain, key, filePath, sizeof filePath);
+    if (err) {
+        HAPAssert(err == kHAPError_OutOfResources);
+        return kHAPError_Unknown;
+    }
+
+    // Write the KVS file.
+    int32_t handle = sl_FsOpen((unsigned char *)filePath,
+        SL_FS_CREATE | SL_FS_CREATE_FAILSAFE | SL_FS_OVERWRITE | SL_FS_CREATE_MAX_SIZE(numBytes), NULL);
+    if (handle < 0) {
+        HAPLogError(&logObject, "sl_FsOpen %s failed: %d.", filePath, (int)handle);
+        return kHAPError_Unknown;
+    }
+
+    int32_t retval = sl_FsWrite(handle, 0, (unsigned char *)bytes, numBytes);
+    if (retval < 0) {
+        HAPLogError(&logObject, "sl_FsWrite %s failed: %d.", filePath, (int)retval);
+        sl_FsClose(handle, 0, (unsigned char *)"A", 1);
+        return kHAPError_Unknown;
+    }
+
+    // The failsafe file is committed on close.
+    int16_t rc = sl_FsClose(handle, 0, 0, 0);
+    if (rc < 0) {
+        HAPLogError(&logObject, "sl_FsClose %s failed: %d.", filePath, rc);
+        return kHAPError_Unknown;
+    }
+    keyValueStore->statistics.numFlashBytesWritten += numBytes;
+    HAPPlatformKeyValueStoreAddToKeyIndex(keyValueStore, domain, key);
+    return kHAPError_None;
+}
+
+/**
+ * Removes a file.
+ *
+ * @param      keyValueStore        Key-value store.
+ * @param      domain               Domain.
+ * @param      key                  Key.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_Unknown        If the file removal failed.
+ */
+HAP_RESULT_USE_CHECK
+static HAPError RemoveFileFromFlash(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain,
+        HAPPlatformKeyValueStoreKey key) {
+    HAPPrecondition(keyValueStore);
+    HAPPrecondition(keyValueStore->rootDirectory);
+
+    if (HAPPlatformKeyValueStoreIsKeyKnownMissing(keyValueStore, domain, key)) {
+        keyValueStore->statistics.numKeyIndexHits++;
+        return kHAPError_None;
+    }
+    HAPPlatformKeyValueStoreDropPreloadedValues(keyValueStore, domain, &key);
+    keyValueStore->statistics.numFlashRemoves++;
+    HAPPlatformKeyValueStoreRecordValueWrite(keyValueStore, domain, key, 0);
+
+    if (keyValueStore->useLog) {
+        return HAPPlatformKeyValueStoreLogRemove(&keyValueStore->log, domain, key);
+    }
+
+    // Get file name.
+    char filePath[SL_FS_MAX_FILE_NAME_LENGTH];
+    HAPError err = GetFilePath(keyValueStore, domain, key, filePath, sizeof filePath);
+    if (err) {
+        HAPAssert(err == kHAPError_OutOfResources);
+        return kHAPError_Unknown;
+    }
+
+    HAPLogDebug(&logObject, "Delete %s", filePath);
+
+    // Remove file.
+    int16_t rc = sl_FsDel((unsigned char *)filePath, 0);
+    if (rc < 0 && rc != SL_ERROR_FS_FILE_NOT_EXISTS) {
+        HAPLogError(&logObject, "sl_FsDel %s failed: %d.", filePath, rc);
+        return kHAPError_Unknown;
+    }
+
+    HAPPlatformKeyValueStoreRemoveFromKeyIndex(keyValueStore, domain, key);
+    return kHAPError_None;
+}
+
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformKeyValueStoreWriteFile(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain,
+        HAPPlatformKeyValueStoreKey key,
+        const void* bytes,
+        size_t numBytes) {
+    HAPPrecondition(keyValueStore);
+
+    HAPTime startTime = HAPPlatformClockGetCurrent();
+    HAPError err = WriteFileToFlash(keyValueStore, domain, key, bytes, numBytes);
+    HAPPlatformKeyValueStoreRecordFlashWriteTime(keyValueStore, startTime);
+    return err;
+}
+
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformKeyValueStoreRemoveFile(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain,
+        HAPPlatformKeyValueStoreKey key) {
+    HAPPrecondition(keyValueStore);
+
+    HAPTime startTime = HAPPlatformClockGetCurrent();
+    HAPError err = RemoveFileFromFlash(keyValueStore, domain, key);
+    HAPPlatformKeyValueStoreRecordFlashWriteTime(keyValueStore, startTime);
+    return err;
+}
+
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformKeyValueStoreListFiles(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        const HAPPlatformKeyValueStoreDomain* _Nullable domain,
+        HAPPlatformKeyValueStoreEnumerateCallback callback,
+        void* _Nullable context) {
+    HAPPrecondition(keyValueStore);
+    HAPPrecondition(keyValueStore->rootDirectory);
+    HAPPrecondition(callback);
+
+    typedef struct {
+        SlFileAttributes_t attribute;
+        char filePath[SL_FS_MAX_FILE_NAME_LENGTH];
+    } FsEntry;
+
+    FsEntry entries[5];
+    int32_t chunkIndex = -1;
+    int32_t fileCount = 1;
+    bool shouldContinue = true;
+
+    do {
+        keyValueStore->statistics.numFlashListings++;
+        fileCount = sl_FsGetFileList(&chunkIndex, HAPArrayCount(entries),
+            sizeof(FsEntry), (uint8_t *)entries, SL_FS_GET_FILE_ATTRIBUTES);
+
+        if (fileCount < 0) {
+            HAPLogError(&logObject, "sl_FsGetFileList failed: %d.", (int)fileCount);
+            return kHAPError_Unknown;
+        }
+
+        for (int32_t i = 0; i < fileCount; ++i) {
+            HAPPlatformKeyValueStoreDomain fileDomain;
+            HAPPlatformKeyValueStoreKey key;
+            uint8_t generation;
+            if (!HAPPlatformKeyValueStoreParseFilePath(
+                        keyValueStore, entries[i].filePath, &fileDomain, &key, &generation))
+                continue;
+
+            // Check domain.
+            if (domain && *domain != fileDomain)
+                continue;
+
+            // Check generation.
+            if (generation != HAPPlatformKeyValueStoreGetGeneration(keyValueStore, fileDomain))
+                continue;
+
+            // Invoke callback.
+            HAPError err = callback(context, keyValueStore, fileDomain, key, &shouldContinue);
+            if (err) {
+                HAPAssert(err == kHAPError_Unknown);
+                return err;
+            }
+
+            if (!shouldContinue)
+                return kHAPError_None;
+        }
+    } while (fileCount > 0);
+
+    return kHAPError_None;
+}
@@ -0,0 +1,201 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+#ifndef HAP_PLATFORM_KEY_VALUE_STORE_FILES_H
+#define HAP_PLATFORM_KEY_VALUE_STORE_FILES_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "HAPPlatform.h"
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull begin
+#endif
+
+/**@file
+ * Value storage of the key-value store.
+ *
+ * By default, each value is stored in a separate file. Alternatively, values are stored as records in a log, see
+ * HAPPlatformKeyValueStoreLog.h. The functions in this file dispatch to the layout that is in use.
+ *
+ * - With the per-file layout, a read first takes the stored length from the file metadata, so that only the stored
+ *   bytes are transferred.
+ *
+ * - Reads of values that are known not to exist are answered by the key index, and reads of preloaded values are
+ *   served from the preload buffer. Neither accesses the network processor.
+ *
+ * - Every write and removal is counted, see HAPPlatformKeyValueStoreWriteGovernor.h.
+ */
+
+/**
+ * Gets the file path under which data for a specified key of a specified generation is stored.
+ *
+ * @param      keyValueStore        Key-value store.
+ * @param      domain               Domain.
+ * @param      key                  Key.
+ * @param      generation           Generation of the domain.
+ * @param[out] filePath             File path for the domain / key. NULL-terminated.
+ * @param      maxFilePathLength    Maximum length that the filePath buffer may hold.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_OutOfResources If @p cap not large enough.
+ */
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformKeyValueStoreGetFilePathOfGeneration(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain,
+        HAPPlatformKeyValueStoreKey key,
+        uint8_t generation,
+        char* filePath,
+        size_t maxFilePathLength);
+
+/**
+ * Gets the path of an internal file of the key-value store, such as the journal file.
+ *
+ * @param      keyValueStore        Key-value store.
+ * @param      fileName             Name of the file, relative to the root directory.
+ * @param[out] filePath             Path of the file. NULL-terminated.
+ * @param      maxFilePathLength    Maximum length that the filePath buffer may hold.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_Unknown        If the buffer is not large enough.
+ */
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformKeyValueStoreGetInternalFilePath(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        const char* fileName,
+        char* filePath,
+        size_t maxFilePathLength);
+
+/**
+ * Parses the path of a value file ("%s/%02X.%02X", or "%s/%02X.%02X.%02X" with the generation of the domain).
+ *
+ * @param      keyValueStore        Key-value store.
+ * @param      filePath             Path of the file.
+ * @param[out] domain               Domain of the value.
+ * @param[out] key                  Key of the value.
+ * @param[out] generation           Generation of the domain.
+ *
+ * @return true                     If the file is a value file of the key-value store.
+ * @return false                    Otherwise.
+ */
+HAP_RESULT_USE_CHECK
+bool HAPPlatformKeyValueStoreParseFilePath(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        const char* filePath,
+        HAPPlatformKeyValueStoreDomain* domain,
+        HAPPlatformKeyValueStoreKey* key,
+        uint8_t* generation);
+
+/**
+ * Reads a file.
+ *
+ * @param      keyValueStore        Key-value store.
+ * @param      domain               Domain.
+ * @param      key                  Key.
+ * @param[out] bytes                Buffer for the content of the file, if exists.
+ * @param      maxBytes             Capacity of the bytes buffer.
+ * @param[out] numBytes             Effective length of the bytes buffer, if exists.
+ * @param[out] found                Whether the file path exists and could be read.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_Unknown        If the file access failed.
+ */
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformKeyValueStoreReadFile(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain,
+        HAPPlatformKeyValueStoreKey key,
+        void* _Nullable bytes,
+        size_t maxBytes,
+        size_t* _Nullable numBytes,
+        bool* found);
+
+/**
+ * Gets the length of a stored value without reading it.
+ *
+ * @param      keyValueStore        Key-value store.
+ * @param      domain               Domain.
+ * @param      key                  Key.
+ * @param[out] numBytes             Length of the value, if found.
+ * @param[out] found                Whether the value exists.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_Unknown        If the file access failed.
+ */
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformKeyValueStoreGetFileSize(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain,
+        HAPPlatformKeyValueStoreKey key,
+        size_t* numBytes,
+        bool* found);
+
+/**
+ * Writes a file atomically and accounts the time spent.
+ *
+ * @param      keyValueStore        Key-value store.
+ * @param      domain               Domain.
+ * @param      key                  Key.
+ * @param      bytes                Buffer with the content of the file, if exists. numBytes != 0 implies bytes.
+ * @param      numBytes             Effective length of the bytes buffer.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_Unknown        If the file access failed.
+ */
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformKeyValueStoreWriteFile(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain,
+        HAPPlatformKeyValueStoreKey key,
+        const void* bytes,
+        size_t numBytes);
+
+/**
+ * Removes a file and accounts the time spent.
+ *
+ * @param      keyValueStore        Key-value store.
+ * @param      domain               Domain.
+ * @param      key                  Key.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_Unknown        If the file removal failed.
+ */
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformKeyValueStoreRemoveFile(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain,
+        HAPPlatformKeyValueStoreKey key);
+
+/**
+ * Lists the files of the key-value store. Files of earlier generations of a domain are skipped.
+ *
+ * @param      keyValueStore        Key-value store.
+ * @param      domain               Domain whose files are listed, or NULL to list all files.
+ * @param      callback             Function to call on each file.
+ * @param      context              Context that is passed to the callback.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_Unknown        If the listing failed or the callback returned an error.
+ */
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformKeyValueStoreListFiles(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        const HAPPlatformKeyValueStoreDomain* _Nullable domain,
+        HAPPlatformKeyValueStoreEnumerateCallback callback,
+        void* _Nullable context);
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull end
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
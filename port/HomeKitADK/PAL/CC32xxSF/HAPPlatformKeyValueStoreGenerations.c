@@ -0,0 +1,379 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+#include "HAPPlatformKeyValueStore+Init.h"
+
+#include <ti/drivers/net/wifi/simplelink.h>
+
+static const HAPLogObject logObject = { .subsystem = kHAPPlatform_LogSubsystem, .category = "KeyValueStore" };
+
+/**
+ * Name of the file that records the generations of the domains, relative to the root directory.
+ */
+#define kHAPPlatformKeyValueStore_GenerationsFileName "generations"
+
+/**
+ * Version of the generations file format.
+ */
+#define kHAPPlatformKeyValueStore_GenerationsFileVersion ((uint8_t) 1)
+
+/**
+ * Size of the generations file.
+ *
+ * - Version (1), flags (1), number of domains (1), followed by each domain (1) and its generation (1).
+ *   Unused entries are zero.
+ */
+#define kHAPPlatformKeyValueStore_NumGenerationsFileBytes \
+    ((size_t)(3 + 2 * kHAPPlatformKeyValueStore_MaxDomainGenerations))
+
+/**
+ * Flag of the generations file that is set while files of earlier generations may remain.
+ */
+#define kHAPPlatformKeyValueStore_GenerationsFlag_NeedsCollection ((uint8_t) 0x01)
+
+/**
+ * Maximum number of files of earlier generations that are removed per run loop iteration.
+ */
+#define kHAPPlatformKeyValueStore_NumCollectedFilesPerStep ((size_t) 4)
+
+/**
+ * Interval at which the removal of files of earlier generations is retried after a failure.
+ */
+#define kHAPPlatformKeyValueStore_CollectionRetryInterval ((HAPTime)(1 * HAPMinute))
+
+HAP_RESULT_USE_CHECK
+uint8_t HAPPlatformKeyValueStoreGetGeneration(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain) {
+    HAPPrecondition(keyValueStore);
+
+    const HAPPlatformKeyValueStoreGenerationTable* table = &keyValueStore->generationTable;
+    for (size_t i = 0; i < table->numDomains; i++) {
+        if (table->domains[i] == domain) {
+            return table->generations[i];
+        }
+    }
+    return 0;
+}
+
+/**
+ * Advances the generation of a domain in RAM, so that its current files no longer take effect.
+ * The generations need to be written with HAPPlatformKeyValueStoreWriteGenerations afterwards.
+ *
+ * @param      keyValueStore        Key-value store.
+ * @param      domain               Domain.
+ *
+ * @return true                     If successful.
+ * @return false                    If the generation table is full, or if the generation would wrap around while
+ *                                  files of earlier generations may remain.
+ */
+HAP_RESULT_USE_CHECK
+static bool AdvanceGeneration(HAPPlatformKeyValueStoreRef keyValueStore, HAPPlatformKeyValueStoreDomain domain) {
+    HAPPrecondition(keyValueStore);
+    HAPPrecondition(!keyValueStore->useLog);
+
+    HAPPlatformKeyValueStoreGenerationTable* table = &keyValueStore->generationTable;
+    size_t index = 0;
+    while (index < table->numDomains && table->domains[index] != domain) {
+        index++;
+    }
+    if (index == table->numDomains) {
+        if (table->numDomains == kHAPPlatformKeyValueStore_MaxDomainGenerations) {
+            return false;
+        }
+        table->domains[index] = domain;
+        table->generations[index] = 0;
+        table->numDomains++;
+    } else if (table->generations[index] == UINT8_MAX && table->needsCollection) {
+        // Generations are only reused once all files of earlier generations have been removed.
+        return false;
+    }
+
+    table->generations[index]++;
+    if (!table->generations[index]) {
+        // Generation 0 is implied for domains that are not in the table.
+        table->domains[index] = table->domains[table->numDomains - 1];
+        table->generations[index] = table->generations[table->numDomains - 1];
+        table->numDomains--;
+    }
+    table->needsCollection = true;
+    return true;
+}
+
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformKeyValueStoreWriteGenerations(HAPPlatformKeyValueStoreRef keyValueStore) {
+    HAPPrecondition(keyValueStore);
+
+    char filePath[SL_FS_MAX_FILE_NAME_LENGTH];
+    HAPError err = HAPPlatformKeyValueStoreGetInternalFilePath(
+            keyValueStore, kHAPPlatformKeyValueStore_GenerationsFileName, filePath, sizeof filePath);
+    if (err) {
+        HAPAssert(err == kHAPError_Unknown);
+        return err;
+    }
+
+    const HAPPlatformKeyValueStoreGenerationTable* table = &keyValueStore->generationTable;
+    uint8_t bytes[kHAPPlatformKeyValueStore_NumGenerationsFileBytes];
+    HAPRawBufferZero(bytes, sizeof bytes);
+    bytes[0] = kHAPPlatformKeyValueStore_GenerationsFileVersion;
+    bytes[1] = table->needsCollection ? kHAPPlatformKeyValueStore_GenerationsFlag_NeedsCollection : 0;
+    bytes[2] = (uint8_t) table->numDomains;
+    for (size_t i = 0; i < table->numDomains; i++) {
+        bytes[3 + 2 * i] = table->domains[i];
+        bytes[3 + 2 * i + 1] = table->generations[i];
+    }
+
+    HAPPlatformKeyValueStoreRecordFlashWrite(keyValueStore);
+    int32_t handle = sl_FsOpen((unsigned char *)filePath,
+        SL_FS_CREATE | SL_FS_CREATE_FAILSAFE | SL_FS_OVERWRITE | SL_FS_CREATE_MAX_SIZE(sizeof bytes), NULL);
+    if (handle < 0) {
+        HAPLogError(&logObject, "sl_FsOpen %s failed: %d.", filePath, (int)handle);
+        return kHAPError_Unknown;
+    }
+
+    int32_t retval = sl_FsWrite(handle, 0, bytes, sizeof bytes);
+    if (retval < 0) {
+        HAPLogError(&logObject, "sl_FsWrite %s failed: %d.", filePath, (int)retval);
+        // Abort the changes to the failsafe file.
+        sl_FsClose(handle, 0, (unsigned char *)"A", 1);
+        return kHAPError_Unknown;
+    }
+
+    int16_t rc = sl_FsClose(handle, 0, 0, 0);
+    if (rc < 0) {
+        HAPLogError(&logObject, "sl_FsClose %s failed: %d.", filePath, rc);
+        return kHAPError_Unknown;
+    }
+    return kHAPError_None;
+}
+
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformKeyValueStoreLoadGenerations(HAPPlatformKeyValueStoreRef keyValueStore) {
+    HAPPrecondition(keyValueStore);
+
+    char filePath[SL_FS_MAX_FILE_NAME_LENGTH];
+    HAPError err = HAPPlatformKeyValueStoreGetInternalFilePath(
+            keyValueStore, kHAPPlatformKeyValueStore_GenerationsFileName, filePath, sizeof filePath);
+    if (err) {
+        HAPAssert(err == kHAPError_Unknown);
+        return err;
+    }
+
+    int32_t handle = sl_FsOpen((unsigned char *)filePath, SL_FS_READ, NULL);
+    if (handle < 0) {
+        if (handle == SL_ERROR_FS_FILE_NOT_EXISTS) {
+            // No domain has been purged.
+            return kHAPError_None;
+        }
+        HAPLogError(&logObject, "sl_FsOpen %s failed: %d.", filePath, (int)handle);
+        return kHAPError_Unknown;
+    }
+
+    uint8_t bytes[kHAPPlatformKeyValueStore_NumGenerationsFileBytes];
+    int32_t retval = sl_FsRead(handle, 0, bytes, sizeof bytes);
+    sl_FsClose(handle, 0, 0, 0);
+    if (retval != (int32_t) sizeof bytes || bytes[0] != kHAPPlatformKeyValueStore_GenerationsFileVersion ||
+        bytes[2] > kHAPPlatformKeyValueStore_MaxDomainGenerations) {
+        HAPLogError(&logObject, "Invalid generations file %s.", filePath);
+        return kHAPError_Unknown;
+    }
+
+    HAPPlatformKeyValueStoreGenerationTable* table = &keyValueStore->generationTable;
+    table->needsCollection = (bytes[1] & kHAPPlatformKeyValueStore_GenerationsFlag_NeedsCollection) != 0;
+    table->numDomains = bytes[2];
+    for (size_t i = 0; i < table->numDomains; i++) {
+        table->domains[i] = bytes[3 + 2 * i];
+        table->generations[i] = bytes[3 + 2 * i + 1];
+    }
+    return kHAPError_None;
+}
+
+HAP_RESULT_USE_CHECK
+static HAPError PurgeDomainEnumerateCallback(
+        void* _Nullable context,
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain HAP_UNUSED,
+        HAPPlatformKeyValueStoreKey key,
+        bool* shouldContinue) {
+    HAPPrecondition(context);
+    uint8_t* keys = context;
+    HAPPrecondition(keyValueStore);
+    HAPPrecondition(keyValueStore->rootDirectory);
+    HAPPrecondition(shouldContinue);
+
+    keys[key / 8] |= (uint8_t)(1U << (key % 8));
+    return kHAPError_None;
+}
+
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformKeyValueStorePurgeDomainFiles(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain,
+        bool* isGenerationAdvanced) {
+    HAPPrecondition(keyValueStore);
+    HAPPrecondition(!keyValueStore->useLog);
+    HAPPrecondition(isGenerationAdvanced);
+
+    HAPError err;
+
+    if (AdvanceGeneration(keyValueStore, domain)) {
+        HAPPlatformKeyValueStoreRemoveDomainFromKeyIndex(keyValueStore, domain);
+        keyValueStore->statistics.numBulkPurges++;
+        *isGenerationAdvanced = true;
+        return kHAPError_None;
+    }
+    HAPLog(&logObject, "Generation of domain %02X cannot be advanced. Removing its files one by one.", domain);
+
+    // The keys are collected before removing them. Removing files while they are listed skips files.
+    uint8_t keys[256 / 8];
+    HAPRawBufferZero(keys, sizeof keys);
+    err = HAPPlatformKeyValueStoreEnumerate(keyValueStore, domain, PurgeDomainEnumerateCallback, keys);
+    if (err) {
+        HAPAssert(err == kHAPError_Unknown);
+        return err;
+    }
+    for (size_t key = 0; key < sizeof keys * 8; key++) {
+        if (keys[key / 8] & (1U << (key % 8))) {
+            err = HAPPlatformKeyValueStoreRemoveFile(keyValueStore, domain, (HAPPlatformKeyValueStoreKey) key);
+            if (err) {
+                HAPAssert(err == kHAPError_Unknown);
+                return err;
+            }
+        }
+    }
+    return kHAPError_None;
+}
+
+/**
+ * Removes some of the files of earlier generations.
+ *
+ * - The files are collected before removing them. Removing files while they are listed skips files.
+ *
+ * @param      keyValueStore        Key-value store.
+ * @param[out] isComplete           Whether no files of earlier generations remain.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_Unknown        If the listing or a removal failed.
+ */
+HAP_RESULT_USE_CHECK
+static HAPError CollectStaleFiles(HAPPlatformKeyValueStoreRef keyValueStore, bool* isComplete) {
+    HAPPrecondition(keyValueStore);
+    HAPPrecondition(isComplete);
+
+    typedef struct {
+        SlFileAttributes_t attribute;
+        char filePath[SL_FS_MAX_FILE_NAME_LENGTH];
+    } FsEntry;
+
+    typedef struct {
+        HAPPlatformKeyValueStoreDomain domain;
+        HAPPlatformKeyValueStoreKey key;
+        uint8_t generation;
+    } StaleFile;
+
+    FsEntry entries[5];
+    StaleFile staleFiles[kHAPPlatformKeyValueStore_NumCollectedFilesPerStep];
+    size_t numStaleFiles = 0;
+    int32_t chunkIndex = -1;
+    int32_t fileCount;
+
+    *isComplete = false;
+    do {
+        keyValueStore->statistics.numFlashListings++;
+        fileCount = sl_FsGetFileList(&chunkIndex, HAPArrayCount(entries),
+            sizeof(FsEntry), (uint8_t *)entries, SL_FS_GET_FILE_ATTRIBUTES);
+        if (fileCount < 0) {
+            HAPLogError(&logObject, "sl_FsGetFileList failed: %d.", (int)fileCount);
+            return kHAPError_Unknown;
+        }
+        for (int32_t i = 0; i < fileCount && numStaleFiles < HAPArrayCount(staleFiles); i++) {
+            StaleFile* staleFile = &staleFiles[numStaleFiles];
+            if (HAPPlatformKeyValueStoreParseFilePath(
+                        keyValueStore,
+                        entries[i].filePath,
+                        &staleFile->domain,
+                        &staleFile->key,
+                        &staleFile->generation) &&
+                staleFile->generation != HAPPlatformKeyValueStoreGetGeneration(keyValueStore, staleFile->domain)) {
+                numStaleFiles++;
+            }
+        }
+    } while (fileCount > 0 && numStaleFiles < HAPArrayCount(staleFiles));
+
+    for (size_t i = 0; i < numStaleFiles; i++) {
+        char filePath[SL_FS_MAX_FILE_NAME_LENGTH];
+        HAPError err = HAPPlatformKeyValueStoreGetFilePathOfGeneration(
+                keyValueStore,
+                staleFiles[i].domain,
+                staleFiles[i].key,
+                staleFiles[i].generation,
+                filePath,
+                sizeof filePath);
+        if (err) {
+            HAPAssert(err == kHAPError_OutOfResources);
+            return kHAPError_Unknown;
+        }
+
+        HAPLogDebug(&logObject, "Delete %s", filePath);
+        HAPPlatformKeyValueStoreRecordFlashWrite(keyValueStore);
+        int16_t rc = sl_FsDel((unsigned char *)filePath, 0);
+        if (rc < 0 && rc != SL_ERROR_FS_FILE_NOT_EXISTS) {
+            HAPLogError(&logObject, "sl_FsDel %s failed: %d.", filePath, rc);
+            return kHAPError_Unknown;
+        }
+        keyValueStore->statistics.numStaleFilesRemoved++;
+    }
+
+    // The listing is complete if it was not cut short.
+    *isComplete = fileCount <= 0;
+    return kHAPError_None;
+}
+
+static void CollectionTimerExpired(HAPPlatformTimerRef timer, void* _Nullable context) {
+    HAPPrecondition(context);
+    HAPPlatformKeyValueStoreRef keyValueStore = context;
+    HAPPrecondition(timer == keyValueStore->collectionTimer);
+    keyValueStore->collectionTimer = 0;
+
+    if (!keyValueStore->generationTable.needsCollection) {
+        return;
+    }
+
+    bool isComplete;
+    HAPError err = CollectStaleFiles(keyValueStore, &isComplete);
+    if (!err && isComplete) {
+        keyValueStore->generationTable.needsCollection = false;
+        err = HAPPlatformKeyValueStoreWriteGenerations(keyValueStore);
+        if (!err) {
+            HAPLogInfo(&logObject, "Removed the files of purged domains.");
+            return;
+        }
+        keyValueStore->generationTable.needsCollection = true;
+    }
+    if (err) {
+        HAPAssert(err == kHAPError_Unknown);
+        HAPLogError(&logObject, "Failed to remove the files of purged domains. Retrying.");
+        HAPPlatformKeyValueStoreScheduleCollection(
+                keyValueStore, HAPPlatformClockGetCurrent() + kHAPPlatformKeyValueStore_CollectionRetryInterval);
+        return;
+    }
+    HAPPlatformKeyValueStoreScheduleCollection(keyValueStore, /* deadline: */ 0);
+}
+
+void HAPPlatformKeyValueStoreScheduleCollection(HAPPlatformKeyValueStoreRef keyValueStore, HAPTime deadline) {
+    HAPPrecondition(keyValueStore);
+
+    if (keyValueStore->collectionTimer) {
+        return;
+    }
+    HAPError err = HAPPlatformTimerRegister(
+            &keyValueStore->collectionTimer, deadline, CollectionTimerExpired, keyValueStore);
+    if (err) {
+        HAPAssert(err == kHAPError_OutOfResources);
+        keyValueStore->collectionTimer = 0;
+        HAPLogError(&logObject, "Failed to schedule removal of stale files. Retrying on next purge or start.");
+    }
+}
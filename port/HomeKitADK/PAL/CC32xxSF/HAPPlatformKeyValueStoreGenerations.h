@@ -0,0 +1,117 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+#ifndef HAP_PLATFORM_KEY_VALUE_STORE_GENERATIONS_H
+#define HAP_PLATFORM_KEY_VALUE_STORE_GENERATIONS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "HAPPlatform.h"
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull begin
+#endif
+
+/**@file
+ * Domain generations of the key-value store.
+ *
+ * With the per-file layout, purging a domain advances the generation of the domain and records it in a failsafe
+ * file. Value files are named after the generation of their domain, so the files of earlier generations no longer
+ * take effect. They are removed in the background on the run loop, a few files at a time. If generations are
+ * tracked for too many domains already, the files of the domain are removed one by one.
+ */
+
+/**
+ * Maximum number of domains whose generation is tracked. Further domains are purged by removing their files.
+ */
+#define kHAPPlatformKeyValueStore_MaxDomainGenerations ((size_t) 8)
+
+/**
+ * Generations of the domains that have been purged with the per-file layout.
+ */
+typedef struct {
+    // Opaque type. Do not access the instance fields directly.
+    /**@cond */
+    HAPPlatformKeyValueStoreDomain domains[kHAPPlatformKeyValueStore_MaxDomainGenerations];
+    uint8_t generations[kHAPPlatformKeyValueStore_MaxDomainGenerations];
+    size_t numDomains;
+    bool needsCollection;
+    /**@endcond */
+} HAPPlatformKeyValueStoreGenerationTable;
+
+/**
+ * Gets the generation of a domain with the per-file layout.
+ *
+ * @param      keyValueStore        Key-value store.
+ * @param      domain               Domain.
+ *
+ * @return Generation of the domain. 0 if the domain is not in the generation table.
+ */
+HAP_RESULT_USE_CHECK
+uint8_t HAPPlatformKeyValueStoreGetGeneration(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain);
+
+/**
+ * Writes the generation table to the generations file atomically.
+ *
+ * @param      keyValueStore        Key-value store.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_Unknown        If the file access failed. The previous generations remain in effect.
+ */
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformKeyValueStoreWriteGenerations(HAPPlatformKeyValueStoreRef keyValueStore);
+
+/**
+ * Loads the generation table from the generations file.
+ *
+ * @param      keyValueStore        Key-value store.
+ *
+ * @return kHAPError_None           If successful, or if no domain has been purged.
+ * @return kHAPError_Unknown        If the file access failed or the file is invalid.
+ */
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformKeyValueStoreLoadGenerations(HAPPlatformKeyValueStoreRef keyValueStore);
+
+/**
+ * Removes all values of a domain from flash with the per-file layout.
+ *
+ * - If possible, the generation of the domain is advanced. The generations need to be written with
+ *   HAPPlatformKeyValueStoreWriteGenerations afterwards. Otherwise, the files of the domain are removed one by one.
+ *
+ * @param      keyValueStore        Key-value store.
+ * @param      domain               Domain.
+ * @param[out] isGenerationAdvanced Set to true if the generation of the domain was advanced. Unchanged otherwise.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_Unknown        If the files could not be listed or removed.
+ */
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformKeyValueStorePurgeDomainFiles(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain,
+        bool* isGenerationAdvanced);
+
+/**
+ * Schedules the removal of files of earlier generations on the run loop.
+ *
+ * @param      keyValueStore        Key-value store.
+ * @param      deadline             Deadline of the next removal step. 0 for the next run loop iteration.
+ */
+void HAPPlatformKeyValueStoreScheduleCollection(HAPPlatformKeyValueStoreRef keyValueStore, HAPTime deadline);
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull end
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,208 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+#include "HAPPlatformKeyValueStore+Init.h"
+
+#include <ti/drivers/net/wifi/simplelink.h>
+
+static const HAPLogObject logObject = { .subsystem = kHAPPlatform_LogSubsystem, .category = "KeyValueStore" };
+
+/**
+ * Name of the journal file of a transaction, relative to the root directory.
+ */
+#define kHAPPlatformKeyValueStore_JournalFileName "journal"
+
+/**
+ * Size of the header of an operation in the journal.
+ *
+ * - Operation type (1), domain (1), key (1), length of the value (2).
+ */
+#define kHAPPlatformKeyValueStore_NumJournalOperationHeaderBytes ((size_t) 5)
+
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformKeyValueStoreWriteJournal(HAPPlatformKeyValueStoreRef keyValueStore) {
+    HAPPrecondition(keyValueStore);
+    HAPPrecondition(keyValueStore->transactionOperations);
+
+    char filePath[SL_FS_MAX_FILE_NAME_LENGTH];
+    HAPError err = HAPPlatformKeyValueStoreGetInternalFilePath(
+            keyValueStore, kHAPPlatformKeyValueStore_JournalFileName, filePath, sizeof filePath);
+    if (err) {
+        HAPAssert(err == kHAPError_Unknown);
+        return err;
+    }
+
+    size_t numJournalBytes = sizeof(uint16_t);
+    for (size_t i = 0; i < keyValueStore->numTransactionOperations; i++) {
+        numJournalBytes += kHAPPlatformKeyValueStore_NumJournalOperationHeaderBytes +
+                           keyValueStore->transactionOperations[i].numBytes;
+    }
+
+    HAPPlatformKeyValueStoreRecordFlashWrite(keyValueStore);
+    int32_t handle = sl_FsOpen((unsigned char *)filePath,
+        SL_FS_CREATE | SL_FS_CREATE_FAILSAFE | SL_FS_OVERWRITE | SL_FS_CREATE_MAX_SIZE(numJournalBytes), NULL);
+    if (handle < 0) {
+        HAPLogError(&logObject, "sl_FsOpen %s failed: %d.", filePath, (int)handle);
+        return kHAPError_Unknown;
+    }
+
+    uint8_t numOperationsBytes[sizeof(uint16_t)];
+    HAPWriteLittleUInt16(numOperationsBytes, (uint16_t) keyValueStore->numTransactionOperations);
+    int32_t retval = sl_FsWrite(handle, 0, numOperationsBytes, sizeof numOperationsBytes);
+    uint32_t offset = sizeof numOperationsBytes;
+    for (size_t i = 0; retval >= 0 && i < keyValueStore->numTransactionOperations; i++) {
+        const HAPPlatformKeyValueStoreOperation* operation = &keyValueStore->transactionOperations[i];
+        uint8_t header[kHAPPlatformKeyValueStore_NumJournalOperationHeaderBytes];
+        header[0] = operation->isPurge ? 2 : operation->isRemove ? 1 : 0;
+        header[1] = operation->domain;
+        header[2] = operation->key;
+        HAPWriteLittleUInt16(&header[3], (uint16_t) operation->numBytes);
+        retval = sl_FsWrite(handle, offset, header, sizeof header);
+        offset += sizeof header;
+        if (retval >= 0 && operation->numBytes) {
+            retval = sl_FsWrite(handle, offset, (unsigned char *)operation->bytes, operation->numBytes);
+            offset += operation->numBytes;
+        }
+    }
+    if (retval < 0) {
+        HAPLogError(&logObject, "sl_FsWrite %s failed: %d.", filePath, (int)retval);
+        // Abort the changes to the failsafe file.
+        sl_FsClose(handle, 0, (unsigned char *)"A", 1);
+        return kHAPError_Unknown;
+    }
+
+    int16_t rc = sl_FsClose(handle, 0, 0, 0);
+    if (rc < 0) {
+        HAPLogError(&logObject, "sl_FsClose %s failed: %d.", filePath, rc);
+        return kHAPError_Unknown;
+    }
+    return kHAPError_None;
+}
+
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformKeyValueStoreRemoveJournal(HAPPlatformKeyValueStoreRef keyValueStore) {
+    HAPPrecondition(keyValueStore);
+
+    char filePath[SL_FS_MAX_FILE_NAME_LENGTH];
+    HAPError err = HAPPlatformKeyValueStoreGetInternalFilePath(
+            keyValueStore, kHAPPlatformKeyValueStore_JournalFileName, filePath, sizeof filePath);
+    if (err) {
+        HAPAssert(err == kHAPError_Unknown);
+        return err;
+    }
+
+    HAPPlatformKeyValueStoreRecordFlashWrite(keyValueStore);
+    int16_t rc = sl_FsDel((unsigned char *)filePath, 0);
+    if (rc < 0 && rc != SL_ERROR_FS_FILE_NOT_EXISTS) {
+        HAPLogError(&logObject, "sl_FsDel %s failed: %d.", filePath, rc);
+        return kHAPError_Unknown;
+    }
+    return kHAPError_None;
+}
+
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformKeyValueStoreApplyJournal(HAPPlatformKeyValueStoreRef keyValueStore) {
+    HAPPrecondition(keyValueStore);
+
+    char filePath[SL_FS_MAX_FILE_NAME_LENGTH];
+    HAPError err = HAPPlatformKeyValueStoreGetInternalFilePath(
+            keyValueStore, kHAPPlatformKeyValueStore_JournalFileName, filePath, sizeof filePath);
+    if (err) {
+        HAPAssert(err == kHAPError_Unknown);
+        return err;
+    }
+
+    int32_t handle = sl_FsOpen((unsigned char *)filePath, SL_FS_READ, NULL);
+    if (handle < 0) {
+        if (handle == SL_ERROR_FS_FILE_NOT_EXISTS) {
+            // No transaction was interrupted.
+            return kHAPError_None;
+        }
+        HAPLogError(&logObject, "sl_FsOpen %s failed: %d.", filePath, (int)handle);
+        return kHAPError_Unknown;
+    }
+    HAPPrecondition(!keyValueStore->isTransactionActive);
+    if (!keyValueStore->transactionOperations) {
+        HAPLogError(&logObject, "Journal found, but transactions are not configured.");
+        sl_FsClose(handle, 0, 0, 0);
+        return kHAPError_Unknown;
+    }
+    HAPLogInfo(&logObject, "Applying journal of an interrupted transaction.");
+
+    // Operations are applied in order. Applying them again after another reset has the same result.
+    bool isGenerationAdvanced = false;
+    uint8_t numOperationsBytes[sizeof(uint16_t)];
+    int32_t retval = sl_FsRead(handle, 0, numOperationsBytes, sizeof numOperationsBytes);
+    uint32_t offset = sizeof numOperationsBytes;
+    size_t numOperations = retval == (int32_t) sizeof numOperationsBytes ? HAPReadLittleUInt16(numOperationsBytes) : 0;
+    err = retval == (int32_t) sizeof numOperationsBytes ? kHAPError_None : kHAPError_Unknown;
+    for (size_t i = 0; !err && i < numOperations; i++) {
+        uint8_t header[kHAPPlatformKeyValueStore_NumJournalOperationHeaderBytes];
+        retval = sl_FsRead(handle, offset, header, sizeof header);
+        offset += sizeof header;
+        uint16_t numBytes = HAPReadLittleUInt16(&header[3]);
+        if (retval != (int32_t) sizeof header || numBytes > keyValueStore->maxTransactionBytes) {
+            err = kHAPError_Unknown;
+            break;
+        }
+        if (numBytes) {
+            retval = sl_FsRead(handle, offset, HAPNonnull(keyValueStore->transactionBytes), numBytes);
+            offset += numBytes;
+            if (retval != numBytes) {
+                err = kHAPError_Unknown;
+                break;
+            }
+        }
+        if (header[0] == 2) {
+            err = HAPPlatformKeyValueStorePurgeDomainFiles(keyValueStore, header[1], &isGenerationAdvanced);
+            HAPPlatformKeyValueStoreForgetDomain(keyValueStore, header[1]);
+        } else {
+            if (header[0]) {
+                err = HAPPlatformKeyValueStoreRemoveFile(keyValueStore, header[1], header[2]);
+            } else {
+                err = HAPPlatformKeyValueStoreWriteFile(
+                        keyValueStore, header[1], header[2], keyValueStore->transactionBytes, numBytes);
+            }
+            // Values that were read while the journal was pending are replaced.
+            HAPPlatformKeyValueStoreCacheEntry* _Nullable entry =
+                    HAPPlatformKeyValueStoreFindCacheEntry(keyValueStore, header[1], header[2]);
+            if (entry) {
+                entry->isValid = false;
+            }
+        }
+        HAPPlatformKeyValueStoreInvalidatePairingTable(keyValueStore, header[1]);
+    }
+    sl_FsClose(handle, 0, 0, 0);
+    if (!err && isGenerationAdvanced) {
+        err = HAPPlatformKeyValueStoreWriteGenerations(keyValueStore);
+    }
+    if (err) {
+        HAPLogError(&logObject, "Failed to apply journal %s.", filePath);
+        return kHAPError_Unknown;
+    }
+
+    return HAPPlatformKeyValueStoreRemoveJournal(keyValueStore);
+}
+
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformKeyValueStoreApplyPendingJournal(HAPPlatformKeyValueStoreRef keyValueStore) {
+    HAPPrecondition(keyValueStore);
+
+    if (!keyValueStore->isJournalPending) {
+        return kHAPError_None;
+    }
+    // While a transaction is active, its operations are staged in the buffers that are needed to read the journal.
+    if (!keyValueStore->isTransactionActive) {
+        HAPError err = HAPPlatformKeyValueStoreApplyJournal(keyValueStore);
+        if (!err) {
+            keyValueStore->isJournalPending = false;
+            return kHAPError_None;
+        }
+        HAPAssert(err == kHAPError_Unknown);
+    }
+    HAPLogError(&logObject, "Journal of a failed transaction is pending. Write refused.");
+    return kHAPError_Unknown;
+}
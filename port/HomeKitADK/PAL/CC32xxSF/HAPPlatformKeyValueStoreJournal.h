@@ -0,0 +1,96 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+#ifndef HAP_PLATFORM_KEY_VALUE_STORE_JOURNAL_H
+#define HAP_PLATFORM_KEY_VALUE_STORE_JOURNAL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "HAPPlatform.h"
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull begin
+#endif
+
+/**@file
+ * Transaction journal of the key-value store.
+ *
+ * With the per-file layout, a transaction is first written to a failsafe journal file and then applied to the value
+ * files. A journal that is left over by a reset is applied again by HAPPlatformKeyValueStoreCreate. Applying the
+ * operations of a journal again after another reset has the same result.
+ *
+ * Once its journal is written, a transaction is rolled forward. If it cannot be applied, its journal is pending and
+ * writes are refused until it is applied. Otherwise, a later write would be overwritten when the journal is applied.
+ */
+
+/**
+ * Number of times that a transaction whose journal has been written is applied before its journal is left pending.
+ */
+#define kHAPPlatformKeyValueStore_MaxJournalAttempts ((size_t) 3)
+
+/**
+ * Writes the operations of the active transaction to the journal file atomically.
+ *
+ * - Journal format: number of operations (2), followed by each operation: operation type (1), domain (1), key (1),
+ *   length of the value (2), value. The operation type is 0 for a set, 1 for a removal and 2 for a purge.
+ *
+ * @param      keyValueStore        Key-value store.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_Unknown        If the file access failed. No journal is left behind.
+ */
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformKeyValueStoreWriteJournal(HAPPlatformKeyValueStoreRef keyValueStore);
+
+/**
+ * Removes the journal file.
+ *
+ * @param      keyValueStore        Key-value store.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_Unknown        If the file removal failed.
+ */
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformKeyValueStoreRemoveJournal(HAPPlatformKeyValueStoreRef keyValueStore);
+
+/**
+ * Applies the journal of a transaction that was interrupted by a reset or that failed, and removes it.
+ *
+ * - Cached values that the journal replaces are dropped.
+ * - The transaction buffers are used to read the values, so no transaction may be active.
+ *
+ * @param      keyValueStore        Key-value store.
+ *
+ * @return kHAPError_None           If successful, or if there is no journal.
+ * @return kHAPError_Unknown        If the journal could not be applied. It is applied again on the next start.
+ */
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformKeyValueStoreApplyJournal(HAPPlatformKeyValueStoreRef keyValueStore);
+
+/**
+ * Applies the journal of a failed transaction, if it is pending. Must be called before each write.
+ *
+ * - While a transaction is active, a pending journal cannot be applied.
+ *
+ * @param      keyValueStore        Key-value store.
+ *
+ * @return kHAPError_None           If successful, or if no journal is pending.
+ * @return kHAPError_Unknown        If the journal is still pending. The write must be refused.
+ */
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformKeyValueStoreApplyPendingJournal(HAPPlatformKeyValueStoreRef keyValueStore);
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull end
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
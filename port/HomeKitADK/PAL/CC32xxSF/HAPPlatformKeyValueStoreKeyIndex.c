@@ -0,0 +1,169 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+#include "HAPPlatformKeyValueStore+Init.h"
+
+static const HAPLogObject logObject = { .subsystem = kHAPPlatform_LogSubsystem, .category = "KeyValueStore" };
+
+HAPPlatformKeyValueStoreKeyIndexEntry* _Nullable HAPPlatformKeyValueStoreFindKeyIndexEntry(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain) {
+    HAPPrecondition(keyValueStore);
+    HAPPrecondition(keyValueStore->isKeyIndexValid);
+
+    for (size_t i = 0; i < keyValueStore->numKeyIndexEntries; i++) {
+        HAPPlatformKeyValueStoreKeyIndexEntry* entry = &keyValueStore->keyIndexEntries[i];
+        if (entry->numKeys && entry->domain == domain) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+HAP_RESULT_USE_CHECK
+bool HAPPlatformKeyValueStoreIsKeyKnownMissing(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain,
+        HAPPlatformKeyValueStoreKey key) {
+    HAPPrecondition(keyValueStore);
+
+    if (!keyValueStore->isKeyIndexValid) {
+        return false;
+    }
+    const HAPPlatformKeyValueStoreKeyIndexEntry* _Nullable entry =
+            HAPPlatformKeyValueStoreFindKeyIndexEntry(keyValueStore, domain);
+    return !entry || !(entry->keys[key / 8] & (1U << (key % 8)));
+}
+
+void HAPPlatformKeyValueStoreAddToKeyIndex(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain,
+        HAPPlatformKeyValueStoreKey key) {
+    HAPPrecondition(keyValueStore);
+
+    if (!keyValueStore->isKeyIndexValid) {
+        return;
+    }
+    HAPPlatformKeyValueStoreKeyIndexEntry* _Nullable entry =
+            HAPPlatformKeyValueStoreFindKeyIndexEntry(keyValueStore, domain);
+    if (!entry) {
+        for (size_t i = 0; i < keyValueStore->numKeyIndexEntries; i++) {
+            if (!keyValueStore->keyIndexEntries[i].numKeys) {
+                entry = &keyValueStore->keyIndexEntries[i];
+                HAPRawBufferZero(entry, sizeof *entry);
+                entry->domain = domain;
+                break;
+            }
+        }
+        if (!entry) {
+            HAPLog(&logObject, "Key index is full. Domain %02X is not indexed. Enumeration lists the files.", domain);
+            keyValueStore->isKeyIndexValid = false;
+            return;
+        }
+    }
+    if (!(entry->keys[key / 8] & (1U << (key % 8)))) {
+        entry->keys[key / 8] |= (uint8_t)(1U << (key % 8));
+        entry->numKeys++;
+    }
+}
+
+void HAPPlatformKeyValueStoreRemoveFromKeyIndex(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain,
+        HAPPlatformKeyValueStoreKey key) {
+    HAPPrecondition(keyValueStore);
+
+    if (!keyValueStore->isKeyIndexValid) {
+        return;
+    }
+    HAPPlatformKeyValueStoreKeyIndexEntry* _Nullable entry =
+            HAPPlatformKeyValueStoreFindKeyIndexEntry(keyValueStore, domain);
+    if (entry && (entry->keys[key / 8] & (1U << (key % 8)))) {
+        entry->keys[key / 8] &= (uint8_t) ~(1U << (key % 8));
+        entry->numKeys--;
+    }
+}
+
+void HAPPlatformKeyValueStoreRemoveDomainFromKeyIndex(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain) {
+    HAPPrecondition(keyValueStore);
+
+    if (!keyValueStore->isKeyIndexValid) {
+        return;
+    }
+    HAPPlatformKeyValueStoreKeyIndexEntry* _Nullable entry =
+            HAPPlatformKeyValueStoreFindKeyIndexEntry(keyValueStore, domain);
+    if (entry) {
+        HAPRawBufferZero(entry, sizeof *entry);
+    }
+}
+
+HAP_RESULT_USE_CHECK
+static HAPError BuildKeyIndexEnumerateCallback(
+        void* _Nullable context HAP_UNUSED,
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain,
+        HAPPlatformKeyValueStoreKey key,
+        bool* shouldContinue) {
+    HAPPrecondition(keyValueStore);
+    HAPPrecondition(shouldContinue);
+
+    HAPPlatformKeyValueStoreAddToKeyIndex(keyValueStore, domain, key);
+    *shouldContinue = keyValueStore->isKeyIndexValid;
+    return kHAPError_None;
+}
+
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformKeyValueStoreBuildKeyIndex(HAPPlatformKeyValueStoreRef keyValueStore) {
+    HAPPrecondition(keyValueStore);
+    HAPPrecondition(keyValueStore->keyIndexEntries);
+
+    HAPRawBufferZero(
+            HAPNonnull(keyValueStore->keyIndexEntries),
+            keyValueStore->numKeyIndexEntries * sizeof(HAPPlatformKeyValueStoreKeyIndexEntry));
+    keyValueStore->isKeyIndexValid = true;
+
+    HAPError err = HAPPlatformKeyValueStoreListFiles(keyValueStore, NULL, BuildKeyIndexEnumerateCallback, NULL);
+    if (err) {
+        HAPAssert(err == kHAPError_Unknown);
+        keyValueStore->isKeyIndexValid = false;
+        return err;
+    }
+    return kHAPError_None;
+}
+
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformKeyValueStoreEnumerateKeyIndex(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain,
+        HAPPlatformKeyValueStoreEnumerateCallback callback,
+        void* _Nullable context) {
+    HAPPrecondition(keyValueStore);
+    HAPPrecondition(keyValueStore->isKeyIndexValid);
+    HAPPrecondition(callback);
+
+    const HAPPlatformKeyValueStoreKeyIndexEntry* _Nullable entry =
+            HAPPlatformKeyValueStoreFindKeyIndexEntry(keyValueStore, domain);
+    if (!entry) {
+        return kHAPError_None;
+    }
+
+    // The keys are copied first, as the callback may remove values.
+    uint8_t keys[sizeof entry->keys];
+    HAPRawBufferCopyBytes(keys, entry->keys, sizeof keys);
+    bool shouldContinue = true;
+    for (size_t key = 0; key < sizeof keys * 8 && shouldContinue; key++) {
+        if (keys[key / 8] & (1U << (key % 8))) {
+            HAPError err = callback(context, keyValueStore, domain, (HAPPlatformKeyValueStoreKey) key, &shouldContinue);
+            if (err) {
+                HAPAssert(err == kHAPError_Unknown);
+                return err;
+            }
+        }
+    }
+    return kHAPError_None;
+}
@@ -0,0 +1,141 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+#ifndef HAP_PLATFORM_KEY_VALUE_STORE_KEY_INDEX_H
+#define HAP_PLATFORM_KEY_VALUE_STORE_KEY_INDEX_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "HAPPlatform.h"
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull begin
+#endif
+
+/**@file
+ * Key index of the key-value store.
+ *
+ * With the per-file layout, an optional key index in RAM records which keys exist in each domain. It is built with a
+ * single file listing at initialization. Enumeration and purging then do not list files, and lookups and removals
+ * of values that do not exist do not access the network processor.
+ */
+
+/**
+ * Key index entry. Records the keys that exist in one domain.
+ */
+typedef struct {
+    // Opaque type. Do not access the instance fields directly.
+    /**@cond */
+    uint8_t keys[32]; // One bit per key.
+    uint16_t numKeys;
+    HAPPlatformKeyValueStoreDomain domain;
+    /**@endcond */
+} HAPPlatformKeyValueStoreKeyIndexEntry;
+
+/**
+ * Finds the key index entry of a domain.
+ *
+ * @param      keyValueStore        Key-value store.
+ * @param      domain               Domain.
+ *
+ * @return Key index entry, if the domain contains values.
+ */
+HAPPlatformKeyValueStoreKeyIndexEntry* _Nullable HAPPlatformKeyValueStoreFindKeyIndexEntry(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain);
+
+/**
+ * Checks whether a key is known not to exist.
+ *
+ * @param      keyValueStore        Key-value store.
+ * @param      domain               Domain.
+ * @param      key                  Key.
+ *
+ * @return true                     If the key index is valid and does not contain the key.
+ * @return false                    Otherwise.
+ */
+HAP_RESULT_USE_CHECK
+bool HAPPlatformKeyValueStoreIsKeyKnownMissing(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain,
+        HAPPlatformKeyValueStoreKey key);
+
+/**
+ * Adds a key to the key index. Disables the key index if the domain does not fit.
+ *
+ * @param      keyValueStore        Key-value store.
+ * @param      domain               Domain.
+ * @param      key                  Key.
+ */
+void HAPPlatformKeyValueStoreAddToKeyIndex(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain,
+        HAPPlatformKeyValueStoreKey key);
+
+/**
+ * Removes a key from the key index.
+ *
+ * @param      keyValueStore        Key-value store.
+ * @param      domain               Domain.
+ * @param      key                  Key.
+ */
+void HAPPlatformKeyValueStoreRemoveFromKeyIndex(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain,
+        HAPPlatformKeyValueStoreKey key);
+
+/**
+ * Removes all keys of a domain from the key index.
+ *
+ * @param      keyValueStore        Key-value store.
+ * @param      domain               Domain.
+ */
+void HAPPlatformKeyValueStoreRemoveDomainFromKeyIndex(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain);
+
+/**
+ * Builds the key index with a single file listing.
+ *
+ * @param      keyValueStore        Key-value store.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_Unknown        If the listing failed. The key index is disabled.
+ */
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformKeyValueStoreBuildKeyIndex(HAPPlatformKeyValueStoreRef keyValueStore);
+
+/**
+ * Enumerates the keys of a domain from the key index.
+ *
+ * - The key index needs to be valid.
+ *
+ * @param      keyValueStore        Key-value store.
+ * @param      domain               Domain.
+ * @param      callback             Function to call on each key.
+ * @param      context              Context that is passed to the callback.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_Unknown        If the callback returned an error.
+ */
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformKeyValueStoreEnumerateKeyIndex(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain,
+        HAPPlatformKeyValueStoreEnumerateCallback callback,
+        void* _Nullable context);
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull end
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
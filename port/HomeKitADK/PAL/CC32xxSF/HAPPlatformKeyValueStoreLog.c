@@ -0,0 +1,948 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+#include "HAPPlatform.h"
+#include "HAPPlatformKeyValueStoreLog.h"
+
+#include <ti/drivers/net/wifi/simplelink.h>
+
+static const HAPLogObject logObject = { .subsystem = kHAPPlatform_LogSubsystem, .category = "KeyValueStore" };
+
+/**
+ * Magic number identifying a log file header ('KVSL').
+ */
+#define kHAPPlatformKeyValueStoreLog_Magic ((uint32_t) 0x4C53564B)
+
+/**
+ * Magic number identifying the header of a log file that may contain purge records ('KVS2').
+ *
+ * - Firmware without purge records rejects the log file, and falls back to the other log file or to an empty log.
+ *   With the magic number of other log files, it would stop loading the log at the first purge record and append
+ *   its records after it.
+ */
+#define kHAPPlatformKeyValueStoreLog_PurgeMagic ((uint32_t) 0x3253564B)
+
+/**
+ * Size of the log file header.
+ *
+ * - Magic (4), sequence number (4), length of the compacted records (4), CRC of the compacted records (4),
+ *   CRC of the preceding header fields (4).
+ */
+#define kHAPPlatformKeyValueStoreLog_NumHeaderBytes ((uint32_t) 20)
+
+/**
+ * Size of a record header.
+ *
+ * - Type (1), domain (1), key (1), length of the value (2), CRC of the preceding fields and the value (4).
+ */
+#define kHAPPlatformKeyValueStoreLog_NumRecordHeaderBytes ((uint32_t) 9)
+
+/**
+ * Record types. Any other value marks the end of the log.
+ *
+ * - The value of a batch record is a sequence of set, remove and purge records that take effect together.
+ *
+ * - A purge record removes all values of its domain. Its key and length are 0.
+ */
+#define kHAPPlatformKeyValueStoreLog_RecordType_Set    ((uint8_t) 0x01)
+#define kHAPPlatformKeyValueStoreLog_RecordType_Remove ((uint8_t) 0x02)
+#define kHAPPlatformKeyValueStoreLog_RecordType_Batch  ((uint8_t) 0x03)
+#define kHAPPlatformKeyValueStoreLog_RecordType_Purge  ((uint8_t) 0x04)
+
+/**
+ * Size of the buffer used to scan and copy records.
+ */
+#define kHAPPlatformKeyValueStoreLog_NumChunkBytes ((size_t) 128)
+
+/**
+ * Computes a CRC-32 (IEEE 802.3).
+ *
+ * @param      crc                  CRC of the preceding bytes, or 0.
+ * @param      bytes                Bytes.
+ * @param      numBytes             Number of bytes.
+ *
+ * @return CRC of the preceding bytes and the given bytes.
+ */
+static uint32_t UpdateCRC(uint32_t crc, const void* _Nullable bytes, size_t numBytes)
+{
+    HAPPrecondition(!numBytes || bytes);
+
+    const uint8_t* b = bytes;
+    crc = ~crc;
+    for (size_t i = 0; i < numBytes; i++) {
+        crc ^= b[i];
+        for (int j = 0; j < 8; j++) {
+            crc = (crc >> 1) ^ (0xEDB88320 & (uint32_t) - (int32_t)(crc & 1));
+        }
+    }
+    return ~crc;
+}
+
+/**
+ * Gets the SimpleLink file name of a log file.
+ */
+HAP_RESULT_USE_CHECK
+static HAPError GetFileName(const HAPPlatformKeyValueStoreLog* log, uint8_t file, char* fileName, size_t maxFileName)
+{
+    HAPPrecondition(log);
+    HAPPrecondition(file < 2);
+    HAPPrecondition(fileName);
+
+    HAPError err = HAPStringWithFormat(fileName, maxFileName, "%s/log%u", log->rootDirectory, file);
+    if (err) {
+        HAPAssert(err == kHAPError_OutOfResources);
+        HAPLogError(&logObject, "Not enough resources to get path: %s/log%u", log->rootDirectory, file);
+        return kHAPError_Unknown;
+    }
+    return kHAPError_None;
+}
+
+/**
+ * Opens a log file.
+ *
+ * @return File handle, or a negative SimpleLink error code.
+ */
+static int32_t OpenFile(const HAPPlatformKeyValueStoreLog* log, uint8_t file, uint32_t accessMode)
+{
+    HAPPrecondition(log);
+
+    char fileName[SL_FS_MAX_FILE_NAME_LENGTH];
+    HAPError err = GetFileName(log, file, fileName, sizeof fileName);
+    if (err) {
+        return SL_ERROR_FS_INVALID_ARGS;
+    }
+    int32_t handle = sl_FsOpen((unsigned char*) fileName, accessMode, NULL);
+    if (handle < 0 && handle != SL_ERROR_FS_FILE_NOT_EXISTS) {
+        HAPLogError(&logObject, "sl_FsOpen %s failed: %d.", fileName, (int) handle);
+    }
+    return handle;
+}
+
+/**
+ * Reads exactly the requested number of bytes from a file.
+ */
+HAP_RESULT_USE_CHECK
+static bool ReadBytes(int32_t handle, uint32_t offset, void* bytes, size_t numBytes)
+{
+    int32_t retval = sl_FsRead(handle, offset, bytes, (uint32_t) numBytes);
+    return retval == (int32_t) numBytes;
+}
+
+/**
+ * Writes bytes to a file.
+ */
+HAP_RESULT_USE_CHECK
+static bool WriteBytes(HAPPlatformKeyValueStoreLog* log, int32_t handle, uint32_t offset, const void* bytes, size_t numBytes)
+{
+    HAPPrecondition(log);
+
+    int32_t retval = sl_FsWrite(handle, offset, (unsigned char*) bytes, (uint32_t) numBytes);
+    if (retval != (int32_t) numBytes) {
+        HAPLogError(&logObject, "sl_FsWrite failed: %d.", (int) retval);
+        return false;
+    }
+    log->numBytesWritten += numBytes;
+    return true;
+}
+
+static HAPPlatformKeyValueStoreLogIndexEntry* _Nullable FindIndexEntry(
+        const HAPPlatformKeyValueStoreLog* log,
+        HAPPlatformKeyValueStoreDomain domain,
+        HAPPlatformKeyValueStoreKey key)
+{
+    HAPPrecondition(log);
+
+    for (size_t i = 0; i < log->numIndexEntries; i++) {
+        HAPPlatformKeyValueStoreLogIndexEntry* entry = &log->indexEntries[i];
+        if (entry->domain == domain && entry->key == key) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+static uint32_t GetRecordSize(uint16_t numBytes)
+{
+    return kHAPPlatformKeyValueStoreLog_NumRecordHeaderBytes + numBytes;
+}
+
+/**
+ * Applies a record to the index.
+ *
+ * @return true                     If successful.
+ * @return false                    If the index is full.
+ */
+HAP_RESULT_USE_CHECK
+static bool ApplyRecord(
+        HAPPlatformKeyValueStoreLog* log,
+        uint8_t type,
+        HAPPlatformKeyValueStoreDomain domain,
+        HAPPlatformKeyValueStoreKey key,
+        uint32_t offset,
+        uint16_t numBytes)
+{
+    HAPPrecondition(log);
+
+    if (type == kHAPPlatformKeyValueStoreLog_RecordType_Purge) {
+        for (size_t i = log->numIndexEntries; i-- > 0;) {
+            HAPPlatformKeyValueStoreLogIndexEntry* entry = &log->indexEntries[i];
+            if (entry->domain == domain) {
+                log->numLiveBytes -= GetRecordSize(entry->numBytes);
+                *entry = log->indexEntries[--log->numIndexEntries];
+            }
+        }
+        return true;
+    }
+
+    HAPPlatformKeyValueStoreLogIndexEntry* entry = FindIndexEntry(log, domain, key);
+    if (entry) {
+        log->numLiveBytes -= GetRecordSize(entry->numBytes);
+    }
+
+    if (type == kHAPPlatformKeyValueStoreLog_RecordType_Remove) {
+        if (entry) {
+            *entry = log->indexEntries[--log->numIndexEntries];
+        }
+        return true;
+    }
+
+    if (!entry) {
+        if (log->numIndexEntries == log->maxIndexEntries) {
+            return false;
+        }
+        entry = &log->indexEntries[log->numIndexEntries++];
+        entry->domain = domain;
+        entry->key = key;
+    }
+    entry->offset = offset;
+    entry->numBytes = numBytes;
+    log->numLiveBytes += GetRecordSize(numBytes);
+    return true;
+}
+
+/**
+ * Reads and validates a log file header.
+ *
+ * @param      handle               File handle.
+ * @param[out] sequenceNumber       Sequence number of the log file.
+ * @param[out] bodyLength           Length of the compacted records.
+ * @param[out] allowsPurgeRecords   Whether the log file may contain purge records.
+ *
+ * @return true                     If the log file exists and its header and compacted records are valid.
+ */
+HAP_RESULT_USE_CHECK
+static bool ReadHeader(int32_t handle, uint32_t* sequenceNumber, uint32_t* bodyLength, bool* allowsPurgeRecords)
+{
+    HAPPrecondition(sequenceNumber);
+    HAPPrecondition(bodyLength);
+    HAPPrecondition(allowsPurgeRecords);
+
+    uint8_t header[kHAPPlatformKeyValueStoreLog_NumHeaderBytes];
+    if (!ReadBytes(handle, 0, header, sizeof header) ||
+        (HAPReadLittleUInt32(&header[0]) != kHAPPlatformKeyValueStoreLog_Magic &&
+         HAPReadLittleUInt32(&header[0]) != kHAPPlatformKeyValueStoreLog_PurgeMagic) ||
+        HAPReadLittleUInt32(&header[16]) != UpdateCRC(0, header, 16)) {
+        return false;
+    }
+    *allowsPurgeRecords = HAPReadLittleUInt32(&header[0]) == kHAPPlatformKeyValueStoreLog_PurgeMagic;
+    *sequenceNumber = HAPReadLittleUInt32(&header[4]);
+    *bodyLength = HAPReadLittleUInt32(&header[8]);
+
+    // The header is only valid together with all compacted records.
+    uint32_t crc = 0;
+    uint8_t chunk[kHAPPlatformKeyValueStoreLog_NumChunkBytes];
+    for (uint32_t o = 0; o < *bodyLength;) {
+        size_t n = HAPMin(sizeof chunk, *bodyLength - o);
+        if (!ReadBytes(handle, kHAPPlatformKeyValueStoreLog_NumHeaderBytes + o, chunk, n)) {
+            return false;
+        }
+        crc = UpdateCRC(crc, chunk, n);
+        o += n;
+    }
+    return crc == HAPReadLittleUInt32(&header[12]);
+}
+
+/**
+ * Applies the records contained in a batch record to the index. The CRC of the batch record must be valid.
+ *
+ * @return true                     If successful.
+ * @return false                    If the batch record is malformed, or if the index is full.
+ */
+HAP_RESULT_USE_CHECK
+static bool ApplyBatchRecord(HAPPlatformKeyValueStoreLog* log, int32_t handle, uint32_t offset, uint16_t numBytes)
+{
+    HAPPrecondition(log);
+
+    // The contained records are validated before any of them is applied.
+    for (int pass = 0; pass < 2; pass++) {
+        uint32_t o = 0;
+        while (o < numBytes) {
+            uint8_t recordHeader[kHAPPlatformKeyValueStoreLog_NumRecordHeaderBytes];
+            uint32_t recordOffset = offset + kHAPPlatformKeyValueStoreLog_NumRecordHeaderBytes + o;
+            if (numBytes - o < sizeof recordHeader || !ReadBytes(handle, recordOffset, recordHeader, sizeof recordHeader)) {
+                return false;
+            }
+            uint8_t type = recordHeader[0];
+            uint16_t numValueBytes = HAPReadLittleUInt16(&recordHeader[3]);
+            if ((type != kHAPPlatformKeyValueStoreLog_RecordType_Set &&
+                 type != kHAPPlatformKeyValueStoreLog_RecordType_Remove &&
+                 type != kHAPPlatformKeyValueStoreLog_RecordType_Purge) ||
+                GetRecordSize(numValueBytes) > numBytes - o) {
+                HAPLogError(&logObject, "Malformed batch record at offset %lu.", (unsigned long) offset);
+                return false;
+            }
+            if (pass && !ApplyRecord(log, type, recordHeader[1], recordHeader[2], recordOffset, numValueBytes)) {
+                HAPLogError(&logObject, "Key-value store log index is full.");
+                return false;
+            }
+            o += GetRecordSize(numValueBytes);
+        }
+    }
+    return true;
+}
+
+/**
+ * Scans the records of the active log file and builds the index.
+ *
+ * @return true                     If the log ends cleanly.
+ * @return false                    If the log ends with a torn or corrupted record, or if the index is full.
+ */
+HAP_RESULT_USE_CHECK
+static bool ScanRecords(HAPPlatformKeyValueStoreLog* log, int32_t handle)
+{
+    HAPPrecondition(log);
+
+    log->tail = kHAPPlatformKeyValueStoreLog_NumHeaderBytes;
+    while (log->tail + kHAPPlatformKeyValueStoreLog_NumRecordHeaderBytes <= log->fileSize) {
+        uint8_t recordHeader[kHAPPlatformKeyValueStoreLog_NumRecordHeaderBytes];
+        int32_t retval = sl_FsRead(handle, log->tail, recordHeader, sizeof recordHeader);
+        if (retval <= 0) {
+            // End of written content.
+            return true;
+        }
+        uint8_t type = recordHeader[0];
+        if (type != kHAPPlatformKeyValueStoreLog_RecordType_Set &&
+            type != kHAPPlatformKeyValueStoreLog_RecordType_Remove &&
+            type != kHAPPlatformKeyValueStoreLog_RecordType_Batch &&
+            type != kHAPPlatformKeyValueStoreLog_RecordType_Purge) {
+            // Unwritten space is all zeros or all ones.
+            return retval == (int32_t) sizeof recordHeader && (type == 0x00 || type == 0xFF);
+        }
+        if (retval != (int32_t) sizeof recordHeader) {
+            return false;
+        }
+
+        uint16_t numBytes = HAPReadLittleUInt16(&recordHeader[3]);
+        if (log->tail + GetRecordSize(numBytes) > log->fileSize) {
+            return false;
+        }
+        uint32_t crc = UpdateCRC(0, recordHeader, 5);
+        uint8_t chunk[kHAPPlatformKeyValueStoreLog_NumChunkBytes];
+        for (uint32_t o = 0; o < numBytes;) {
+            size_t n = HAPMin(sizeof chunk, (size_t)(numBytes - o));
+            if (!ReadBytes(handle, log->tail + kHAPPlatformKeyValueStoreLog_NumRecordHeaderBytes + o, chunk, n)) {
+                return false;
+            }
+            crc = UpdateCRC(crc, chunk, n);
+            o += n;
+        }
+        if (crc != HAPReadLittleUInt32(&recordHeader[5])) {
+            return false;
+        }
+
+        if (type == kHAPPlatformKeyValueStoreLog_RecordType_Batch) {
+            if (!ApplyBatchRecord(log, handle, log->tail, numBytes)) {
+                return false;
+            }
+        } else if (!ApplyRecord(log, type, recordHeader[1], recordHeader[2], log->tail, numBytes)) {
+            HAPLogError(&logObject, "Key-value store log index is full.");
+            return false;
+        }
+        log->tail += GetRecordSize(numBytes);
+    }
+    return true;
+}
+
+static void CompactionTimerExpired(HAPPlatformTimerRef timer, void* _Nullable context)
+{
+    HAPPrecondition(context);
+    HAPPlatformKeyValueStoreLog* log = context;
+    HAPPrecondition(timer == log->compactionTimer);
+    log->compactionTimer = 0;
+
+    HAPError err = HAPPlatformKeyValueStoreLogCompact(log);
+    if (err) {
+        HAPAssert(err == kHAPError_Unknown);
+        HAPLogError(&logObject, "Background compaction of key-value store log failed.");
+    }
+}
+
+/**
+ * Schedules a compaction on the run loop once the active log file is three quarters full, unless most of it is live.
+ */
+static void ScheduleCompactionIfNeeded(HAPPlatformKeyValueStoreLog* log)
+{
+    HAPPrecondition(log);
+
+    if (log->compactionTimer || log->tail < log->fileSize / 4 * 3 ||
+        kHAPPlatformKeyValueStoreLog_NumHeaderBytes + log->numLiveBytes > log->fileSize / 2) {
+        return;
+    }
+    HAPError err = HAPPlatformTimerRegister(&log->compactionTimer, 0, CompactionTimerExpired, log);
+    if (err) {
+        HAPAssert(err == kHAPError_OutOfResources);
+        log->compactionTimer = 0;
+    }
+}
+
+void HAPPlatformKeyValueStoreLogCreate(
+        HAPPlatformKeyValueStoreLog* log,
+        const char* rootDirectory,
+        HAPPlatformKeyValueStoreLogIndexEntry* indexEntries,
+        size_t maxIndexEntries,
+        size_t fileSize)
+{
+    HAPPrecondition(log);
+    HAPPrecondition(rootDirectory);
+    HAPPrecondition(indexEntries);
+    HAPPrecondition(maxIndexEntries);
+    HAPPrecondition(fileSize > kHAPPlatformKeyValueStoreLog_NumHeaderBytes);
+
+    HAPRawBufferZero(log, sizeof *log);
+    log->rootDirectory = rootDirectory;
+    log->indexEntries = indexEntries;
+    log->maxIndexEntries = maxIndexEntries;
+    log->fileSize = (uint32_t) fileSize;
+
+    // Select the valid log file with the highest sequence number.
+    bool isValid[2] = { false, false };
+    uint32_t sequenceNumbers[2] = { 0, 0 };
+    bool allowsPurgeRecords[2] = { false, false };
+    for (uint8_t file = 0; file < 2; file++) {
+        int32_t handle = OpenFile(log, file, SL_FS_READ);
+        if (handle < 0) {
+            continue;
+        }
+        uint32_t bodyLength;
+        isValid[file] = ReadHeader(handle, &sequenceNumbers[file], &bodyLength, &allowsPurgeRecords[file]);
+        sl_FsClose(handle, NULL, NULL, 0);
+    }
+    if (!isValid[0] && !isValid[1]) {
+        HAPLogInfo(&logObject, "Creating key-value store log.");
+        log->tail = kHAPPlatformKeyValueStoreLog_NumHeaderBytes;
+        log->activeFile = 1;
+        log->needsCompaction = true;
+    } else {
+        log->activeFile = (isValid[0] && (!isValid[1] || (int32_t)(sequenceNumbers[0] - sequenceNumbers[1]) > 0)) ?
+                                  0 :
+                                  1;
+        log->sequenceNumber = sequenceNumbers[log->activeFile];
+        log->allowsPurgeRecords = allowsPurgeRecords[log->activeFile];
+
+        int32_t handle = OpenFile(log, log->activeFile, SL_FS_READ);
+        if (handle < 0) {
+            HAPFatalError();
+        }
+        if (!ScanRecords(log, handle)) {
+            HAPLog(&logObject, "Key-value store log ends with an invalid record at offset %lu.", (unsigned long) log->tail);
+            log->needsCompaction = true;
+        }
+        sl_FsClose(handle, NULL, NULL, 0);
+    }
+
+    HAPLogInfo(
+            &logObject,
+            "Key-value store log %u (sequence number %lu): %lu values, %lu / %lu bytes used.",
+            log->activeFile,
+            (unsigned long) log->sequenceNumber,
+            (unsigned long) log->numIndexEntries,
+            (unsigned long) log->tail,
+            (unsigned long) log->fileSize);
+
+    // Records must not be appended after an invalid record, and a new store needs a valid header.
+    if (log->needsCompaction) {
+        HAPError err = HAPPlatformKeyValueStoreLogCompact(log);
+        if (err) {
+            HAPAssert(err == kHAPError_Unknown);
+            HAPLogError(&logObject, "Failed to compact key-value store log.");
+        }
+    }
+}
+
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformKeyValueStoreLogRead(
+        HAPPlatformKeyValueStoreLog* log,
+        HAPPlatformKeyValueStoreDomain domain,
+        HAPPlatformKeyValueStoreKey key,
+        void* _Nullable bytes,
+        size_t maxBytes,
+        size_t* _Nullable numBytes,
+        bool* found)
+{
+    HAPPrecondition(log);
+    HAPPrecondition(!maxBytes || bytes);
+    HAPPrecondition((bytes == NULL) == (numBytes == NULL));
+    HAPPrecondition(found);
+
+    const HAPPlatformKeyValueStoreLogIndexEntry* entry = FindIndexEntry(log, domain, key);
+    *found = entry != NULL;
+    if (!entry || !numBytes) {
+        return kHAPError_None;
+    }
+
+    size_t numReadBytes = HAPMin((size_t) entry->numBytes, maxBytes);
+    if (numReadBytes) {
+        int32_t handle = OpenFile(log, log->activeFile, SL_FS_READ);
+        if (handle < 0) {
+            *found = false;
+            return kHAPError_Unknown;
+        }
+        bool isRead = ReadBytes(
+                handle, entry->offset + kHAPPlatformKeyValueStoreLog_NumRecordHeaderBytes, HAPNonnullVoid(bytes), numReadBytes);
+        sl_FsClose(handle, NULL, NULL, 0);
+        if (!isRead) {
+            HAPLogError(&logObject, "Failed to read %02X.%02X from key-value store log.", domain, key);
+            *found = false;
+            return kHAPError_Unknown;
+        }
+    }
+    *numBytes = numReadBytes;
+    return kHAPError_None;
+}
+
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformKeyValueStoreLogReadAll(
+        HAPPlatformKeyValueStoreLog* log,
+        HAPPlatformKeyValueStoreLogReadAllCallback callback,
+        void* _Nullable context)
+{
+    HAPPrecondition(log);
+    HAPPrecondition(callback);
+
+    if (!log->numIndexEntries) {
+        return kHAPError_None;
+    }
+    int32_t handle = OpenFile(log, log->activeFile, SL_FS_READ);
+    if (handle < 0) {
+        return kHAPError_Unknown;
+    }
+    for (size_t i = 0; i < log->numIndexEntries; i++) {
+        const HAPPlatformKeyValueStoreLogIndexEntry* entry = &log->indexEntries[i];
+        void* _Nullable bytes = callback(context, entry->domain, entry->key, entry->numBytes);
+        if (!bytes || !entry->numBytes) {
+            continue;
+        }
+        if (!ReadBytes(
+                    handle,
+                    entry->offset + kHAPPlatformKeyValueStoreLog_NumRecordHeaderBytes,
+                    HAPNonnullVoid(bytes),
+                    entry->numBytes)) {
+            HAPLogError(
+                    &logObject, "Failed to read %02X.%02X from key-value store log.", entry->domain, entry->key);
+            sl_FsClose(handle, NULL, NULL, 0);
+            return kHAPError_Unknown;
+        }
+    }
+    sl_FsClose(handle, NULL, NULL, 0);
+    return kHAPError_None;
+}
+
+HAP_RESULT_USE_CHECK
+bool HAPPlatformKeyValueStoreLogGetSize(
+        const HAPPlatformKeyValueStoreLog* log,
+        HAPPlatformKeyValueStoreDomain domain,
+        HAPPlatformKeyValueStoreKey key,
+        size_t* numBytes)
+{
+    HAPPrecondition(log);
+    HAPPrecondition(numBytes);
+
+    const HAPPlatformKeyValueStoreLogIndexEntry* entry = FindIndexEntry(log, domain, key);
+    if (!entry) {
+        return false;
+    }
+    *numBytes = entry->numBytes;
+    return true;
+}
+
+/**
+ * Makes room for a record at the tail of the active log file, compacting the log first if the record does not fit.
+ */
+HAP_RESULT_USE_CHECK
+static HAPError ReserveSpace(HAPPlatformKeyValueStoreLog* log, uint32_t recordSize)
+{
+    HAPPrecondition(log);
+
+    if (log->needsCompaction || log->tail + recordSize > log->fileSize) {
+        HAPError err = HAPPlatformKeyValueStoreLogCompact(log);
+        if (err) {
+            HAPAssert(err == kHAPError_Unknown);
+            return err;
+        }
+        if (log->tail + recordSize > log->fileSize) {
+            HAPLogError(&logObject, "Key-value store log is full.");
+            return kHAPError_Unknown;
+        }
+    }
+    return kHAPError_None;
+}
+
+/**
+ * Prepares the log for purge records. A log file whose header does not allow them is compacted before the first
+ * purge record is appended.
+ */
+static void AllowPurgeRecords(HAPPlatformKeyValueStoreLog* log)
+{
+    HAPPrecondition(log);
+
+    if (!log->allowsPurgeRecords) {
+        log->allowsPurgeRecords = true;
+        log->needsCompaction = true;
+    }
+}
+
+/**
+ * Appends a record to the active log file, compacting the log first if the record does not fit.
+ */
+HAP_RESULT_USE_CHECK
+static HAPError AppendRecord(
+        HAPPlatformKeyValueStoreLog* log,
+        uint8_t type,
+        HAPPlatformKeyValueStoreDomain domain,
+        HAPPlatformKeyValueStoreKey key,
+        const void* _Nullable bytes,
+        size_t numBytes)
+{
+    HAPPrecondition(log);
+    HAPPrecondition(!numBytes || bytes);
+
+    HAPError err;
+
+    if (numBytes > UINT16_MAX ||
+        kHAPPlatformKeyValueStoreLog_NumHeaderBytes + GetRecordSize((uint16_t) numBytes) > log->fileSize) {
+        HAPLogError(&logObject, "Value %02X.%02X too large for key-value store log.", domain, key);
+        return kHAPError_Unknown;
+    }
+    if (type == kHAPPlatformKeyValueStoreLog_RecordType_Set && !FindIndexEntry(log, domain, key) &&
+        log->numIndexEntries == log->maxIndexEntries) {
+        HAPLogError(&logObject, "Key-value store log index is full.");
+        return kHAPError_Unknown;
+    }
+    err = ReserveSpace(log, GetRecordSize((uint16_t) numBytes));
+    if (err) {
+        HAPAssert(err == kHAPError_Unknown);
+        return err;
+    }
+
+    uint8_t recordHeader[kHAPPlatformKeyValueStoreLog_NumRecordHeaderBytes];
+    recordHeader[0] = type;
+    recordHeader[1] = domain;
+    recordHeader[2] = key;
+    HAPWriteLittleUInt16(&recordHeader[3], (uint16_t) numBytes);
+    HAPWriteLittleUInt32(&recordHeader[5], UpdateCRC(UpdateCRC(0, recordHeader, 5), bytes, numBytes));
+
+    int32_t handle = OpenFile(log, log->activeFile, SL_FS_WRITE);
+    if (handle < 0) {
+        return kHAPError_Unknown;
+    }
+    // The value is written before the header, so that an interrupted append never yields a record that looks valid.
+    bool isWritten = (!numBytes || WriteBytes(
+                                           log,
+                                           handle,
+                                           log->tail + kHAPPlatformKeyValueStoreLog_NumRecordHeaderBytes,
+                                           HAPNonnullVoid(bytes),
+                                           numBytes)) &&
+                     WriteBytes(log, handle, log->tail, recordHeader, sizeof recordHeader);
+    int16_t rc = sl_FsClose(handle, NULL, NULL, 0);
+    if (!isWritten || rc < 0) {
+        // The tail may contain a partial record now.
+        log->needsCompaction = true;
+        return kHAPError_Unknown;
+    }
+
+    bool isApplied = ApplyRecord(log, type, domain, key, log->tail, (uint16_t) numBytes);
+    HAPAssert(isApplied);
+    log->tail += GetRecordSize((uint16_t) numBytes);
+
+    ScheduleCompactionIfNeeded(log);
+    return kHAPError_None;
+}
+
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformKeyValueStoreLogWrite(
+        HAPPlatformKeyValueStoreLog* log,
+        HAPPlatformKeyValueStoreDomain domain,
+        HAPPlatformKeyValueStoreKey key,
+        const void* _Nullable bytes,
+        size_t numBytes)
+{
+    HAPPrecondition(log);
+
+    return AppendRecord(log, kHAPPlatformKeyValueStoreLog_RecordType_Set, domain, key, bytes, numBytes);
+}
+
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformKeyValueStoreLogRemove(
+        HAPPlatformKeyValueStoreLog* log,
+        HAPPlatformKeyValueStoreDomain domain,
+        HAPPlatformKeyValueStoreKey key)
+{
+    HAPPrecondition(log);
+
+    if (!FindIndexEntry(log, domain, key)) {
+        return kHAPError_None;
+    }
+    return AppendRecord(log, kHAPPlatformKeyValueStoreLog_RecordType_Remove, domain, key, NULL, 0);
+}
+
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformKeyValueStoreLogPurgeDomain(HAPPlatformKeyValueStoreLog* log, HAPPlatformKeyValueStoreDomain domain)
+{
+    HAPPrecondition(log);
+
+    for (size_t i = 0; i < log->numIndexEntries; i++) {
+        if (log->indexEntries[i].domain == domain) {
+            AllowPurgeRecords(log);
+            return AppendRecord(log, kHAPPlatformKeyValueStoreLog_RecordType_Purge, domain, 0, NULL, 0);
+        }
+    }
+    return kHAPError_None;
+}
+
+/**
+ * Gets the type of the record of an operation.
+ */
+HAP_RESULT_USE_CHECK
+static uint8_t GetOperationRecordType(const HAPPlatformKeyValueStoreOperation* operation)
+{
+    HAPPrecondition(operation);
+
+    if (operation->isPurge) {
+        return kHAPPlatformKeyValueStoreLog_RecordType_Purge;
+    }
+    return operation->isRemove ? kHAPPlatformKeyValueStoreLog_RecordType_Remove :
+                                 kHAPPlatformKeyValueStoreLog_RecordType_Set;
+}
+
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformKeyValueStoreLogWriteBatch(
+        HAPPlatformKeyValueStoreLog* log,
+        const HAPPlatformKeyValueStoreOperation* operations,
+        size_t numOperations)
+{
+    HAPPrecondition(log);
+    HAPPrecondition(operations);
+
+    HAPError err;
+
+    uint32_t numBatchBytes = 0;
+    size_t numNewKeys = 0;
+    bool containsPurge = false;
+    for (size_t i = 0; i < numOperations; i++) {
+        const HAPPlatformKeyValueStoreOperation* operation = &operations[i];
+        HAPPrecondition(operation->isRemove || !operation->numBytes || operation->bytes);
+        HAPPrecondition(!operation->isPurge || operation->isRemove);
+        containsPurge = containsPurge || operation->isPurge;
+        if (operation->numBytes > UINT16_MAX) {
+            HAPLogError(&logObject, "Batch too large for key-value store log.");
+            return kHAPError_Unknown;
+        }
+        numBatchBytes += GetRecordSize(operation->isRemove ? 0 : (uint16_t) operation->numBytes);
+        if (!operation->isRemove && !FindIndexEntry(log, operation->domain, operation->key)) {
+            numNewKeys++;
+        }
+    }
+    if (numBatchBytes > UINT16_MAX ||
+        kHAPPlatformKeyValueStoreLog_NumHeaderBytes + GetRecordSize((uint16_t) numBatchBytes) > log->fileSize) {
+        HAPLogError(&logObject, "Batch too large for key-value store log.");
+        return kHAPError_Unknown;
+    }
+    if (numNewKeys > log->maxIndexEntries - log->numIndexEntries) {
+        HAPLogError(&logObject, "Key-value store log index is full.");
+        return kHAPError_Unknown;
+    }
+    if (containsPurge) {
+        AllowPurgeRecords(log);
+    }
+    err = ReserveSpace(log, GetRecordSize((uint16_t) numBatchBytes));
+    if (err) {
+        HAPAssert(err == kHAPError_Unknown);
+        return err;
+    }
+
+    int32_t handle = OpenFile(log, log->activeFile, SL_FS_WRITE);
+    if (handle < 0) {
+        return kHAPError_Unknown;
+    }
+
+    // The contained records are written first. The batch only takes effect once its header is written.
+    uint8_t batchHeader[kHAPPlatformKeyValueStoreLog_NumRecordHeaderBytes];
+    batchHeader[0] = kHAPPlatformKeyValueStoreLog_RecordType_Batch;
+    batchHeader[1] = 0;
+    batchHeader[2] = 0;
+    HAPWriteLittleUInt16(&batchHeader[3], (uint16_t) numBatchBytes);
+    uint32_t batchCRC = UpdateCRC(0, batchHeader, 5);
+    bool isWritten = true;
+    uint32_t offset = log->tail + kHAPPlatformKeyValueStoreLog_NumRecordHeaderBytes;
+    for (size_t i = 0; isWritten && i < numOperations; i++) {
+        const HAPPlatformKeyValueStoreOperation* operation = &operations[i];
+        uint16_t numBytes = operation->isRemove ? 0 : (uint16_t) operation->numBytes;
+
+        uint8_t recordHeader[kHAPPlatformKeyValueStoreLog_NumRecordHeaderBytes];
+        recordHeader[0] = GetOperationRecordType(operation);
+        recordHeader[1] = operation->domain;
+        recordHeader[2] = operation->isPurge ? 0 : operation->key;
+        HAPWriteLittleUInt16(&recordHeader[3], numBytes);
+        HAPWriteLittleUInt32(&recordHeader[5], UpdateCRC(UpdateCRC(0, recordHeader, 5), operation->bytes, numBytes));
+        isWritten = WriteBytes(log, handle, offset, recordHeader, sizeof recordHeader) &&
+                    (!numBytes || WriteBytes(
+                                          log,
+                                          handle,
+                                          offset + kHAPPlatformKeyValueStoreLog_NumRecordHeaderBytes,
+                                          HAPNonnullVoid(operation->bytes),
+                                          numBytes));
+        batchCRC = UpdateCRC(batchCRC, recordHeader, sizeof recordHeader);
+        batchCRC = UpdateCRC(batchCRC, operation->bytes, numBytes);
+        offset += GetRecordSize(numBytes);
+    }
+    HAPWriteLittleUInt32(&batchHeader[5], batchCRC);
+    isWritten = isWritten && WriteBytes(log, handle, log->tail, batchHeader, sizeof batchHeader);
+    int16_t rc = sl_FsClose(handle, NULL, NULL, 0);
+    if (!isWritten || rc < 0) {
+        // The tail may contain a partial record now.
+        log->needsCompaction = true;
+        return kHAPError_Unknown;
+    }
+
+    offset = log->tail + kHAPPlatformKeyValueStoreLog_NumRecordHeaderBytes;
+    for (size_t i = 0; i < numOperations; i++) {
+        const HAPPlatformKeyValueStoreOperation* operation = &operations[i];
+        uint16_t numBytes = operation->isRemove ? 0 : (uint16_t) operation->numBytes;
+        bool isApplied = ApplyRecord(
+                log, GetOperationRecordType(operation), operation->domain, operation->key, offset, numBytes);
+        HAPAssert(isApplied);
+        offset += GetRecordSize(numBytes);
+    }
+    log->tail += GetRecordSize((uint16_t) numBatchBytes);
+
+    ScheduleCompactionIfNeeded(log);
+    return kHAPError_None;
+}
+
+HAP_RESULT_USE_CHECK
+size_t HAPPlatformKeyValueStoreLogListKeys(
+        const HAPPlatformKeyValueStoreLog* log,
+        HAPPlatformKeyValueStoreDomain domain,
+        HAPPlatformKeyValueStoreKey keys[_Nonnull 256])
+{
+    HAPPrecondition(log);
+    HAPPrecondition(keys);
+
+    size_t numKeys = 0;
+    for (size_t i = 0; i < log->numIndexEntries; i++) {
+        if (log->indexEntries[i].domain == domain) {
+            keys[numKeys++] = log->indexEntries[i].key;
+        }
+    }
+    return numKeys;
+}
+
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformKeyValueStoreLogCompact(HAPPlatformKeyValueStoreLog* log)
+{
+    HAPPrecondition(log);
+
+    if (log->compactionTimer) {
+        HAPPlatformTimerDeregister(log->compactionTimer);
+        log->compactionTimer = 0;
+    }
+
+    uint8_t targetFile = (uint8_t)(log->activeFile ^ 1);
+    HAPLogInfo(
+            &logObject,
+            "Compacting key-value store log %u into log %u (%lu of %lu bytes live).",
+            log->activeFile,
+            targetFile,
+            (unsigned long) log->numLiveBytes,
+            (unsigned long) (log->tail - kHAPPlatformKeyValueStoreLog_NumHeaderBytes));
+
+    int32_t sourceHandle = -1;
+    if (log->numIndexEntries) {
+        sourceHandle = OpenFile(log, log->activeFile, SL_FS_READ);
+        if (sourceHandle < 0) {
+            return kHAPError_Unknown;
+        }
+    }
+    int32_t targetHandle =
+            OpenFile(log, targetFile, SL_FS_CREATE | SL_FS_OVERWRITE | SL_FS_CREATE_MAX_SIZE(log->fileSize));
+    if (targetHandle < 0) {
+        if (sourceHandle >= 0) {
+            sl_FsClose(sourceHandle, NULL, NULL, 0);
+        }
+        return kHAPError_Unknown;
+    }
+
+    // Copy the live records. Their headers are rewritten, since the records of a removed value may be interleaved.
+    bool isCopied = true;
+    uint32_t bodyCRC = 0;
+    uint32_t offset = kHAPPlatformKeyValueStoreLog_NumHeaderBytes;
+    for (size_t i = 0; isCopied && i < log->numIndexEntries; i++) {
+        HAPPlatformKeyValueStoreLogIndexEntry* entry = &log->indexEntries[i];
+
+        uint8_t recordHeader[kHAPPlatformKeyValueStoreLog_NumRecordHeaderBytes];
+        if (!ReadBytes(sourceHandle, entry->offset, recordHeader, sizeof recordHeader)) {
+            isCopied = false;
+            break;
+        }
+        isCopied = WriteBytes(log, targetHandle, offset, recordHeader, sizeof recordHeader);
+        bodyCRC = UpdateCRC(bodyCRC, recordHeader, sizeof recordHeader);
+
+        uint8_t chunk[kHAPPlatformKeyValueStoreLog_NumChunkBytes];
+        for (uint32_t o = 0; isCopied && o < entry->numBytes;) {
+            size_t n = HAPMin(sizeof chunk, (size_t)(entry->numBytes - o));
+            isCopied = ReadBytes(sourceHandle, entry->offset + kHAPPlatformKeyValueStoreLog_NumRecordHeaderBytes + o, chunk, n) &&
+                       WriteBytes(log, targetHandle, offset + kHAPPlatformKeyValueStoreLog_NumRecordHeaderBytes + o, chunk, n);
+            bodyCRC = UpdateCRC(bodyCRC, chunk, n);
+            o += n;
+        }
+        offset += GetRecordSize(entry->numBytes);
+    }
+
+    // The header is written last. Until then, the target file is invalid and the active file remains in effect.
+    uint32_t sequenceNumber = log->sequenceNumber + 1;
+    if (isCopied) {
+        uint8_t header[kHAPPlatformKeyValueStoreLog_NumHeaderBytes];
+        HAPWriteLittleUInt32(
+                &header[0],
+                log->allowsPurgeRecords ? kHAPPlatformKeyValueStoreLog_PurgeMagic : kHAPPlatformKeyValueStoreLog_Magic);
+        HAPWriteLittleUInt32(&header[4], sequenceNumber);
+        HAPWriteLittleUInt32(&header[8], offset - kHAPPlatformKeyValueStoreLog_NumHeaderBytes);
+        HAPWriteLittleUInt32(&header[12], bodyCRC);
+        HAPWriteLittleUInt32(&header[16], UpdateCRC(0, header, 16));
+        isCopied = WriteBytes(log, targetHandle, 0, header, sizeof header);
+    }
+    if (sourceHandle >= 0) {
+        sl_FsClose(sourceHandle, NULL, NULL, 0);
+    }
+    int16_t rc = sl_FsClose(targetHandle, NULL, NULL, 0);
+    if (!isCopied || rc < 0) {
+        HAPLogError(&logObject, "Failed to compact key-value store log.");
+        return kHAPError_Unknown;
+    }
+
+    // Update the index to the new offsets, which follow the order of the index.
+    offset = kHAPPlatformKeyValueStoreLog_NumHeaderBytes;
+    for (size_t i = 0; i < log->numIndexEntries; i++) {
+        log->indexEntries[i].offset = offset;
+        offset += GetRecordSize(log->indexEntries[i].numBytes);
+    }
+    log->activeFile = targetFile;
+    log->sequenceNumber = sequenceNumber;
+    log->tail = offset;
+    log->needsCompaction = false;
+    log->numCompactions++;
+    return kHAPError_None;
+}
@@ -0,0 +1,290 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+#ifndef HAP_PLATFORM_KEY_VALUE_STORE_LOG_H
+#define HAP_PLATFORM_KEY_VALUE_STORE_LOG_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "HAPPlatform.h"
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull begin
+#endif
+
+/**@file
+ * Log-structured storage for the key-value store.
+ *
+ * Values are stored as records in one of two preallocated log files. Sets and removes append a record to the active
+ * log file. An index in RAM maps each key to its latest record, so reads need a single file access and enumeration
+ * needs none.
+ *
+ * When the active log file fills up, the live records are copied to the other log file, which then becomes the
+ * active one. Compaction is scheduled on the run loop when the log file is three quarters full, and is performed
+ * synchronously if a record does not fit.
+ *
+ * - Each record carries a CRC. A record that was torn by a reset is ignored when the log is loaded, and the log is
+ *   compacted before further records are appended.
+ *
+ * - A compacted log file only becomes valid once its header is written after all records, so a reset during
+ *   compaction leaves the previous log file in effect.
+ *
+ * - A batch of sets and removes is appended as a single record that takes effect as a whole.
+ *
+ * - Purging a domain appends a single record, regardless of the number of values in the domain. Before the first
+ *   purge record is appended, the log is compacted into a log file with a header that firmware without purge records
+ *   rejects, so that such firmware does not stop loading the log at the purge record and append after it.
+ *
+ * - Log files are not failsafe. Power-fail safety comes from the record CRCs and from alternating between the two
+ *   files during compaction.
+ */
+
+/**
+ * Index entry of a value in the log.
+ */
+typedef struct {
+    // Opaque type. Do not access the instance fields directly.
+    /**@cond */
+    uint32_t offset;
+    uint16_t numBytes;
+    HAPPlatformKeyValueStoreDomain domain;
+    HAPPlatformKeyValueStoreKey key;
+    /**@endcond */
+} HAPPlatformKeyValueStoreLogIndexEntry;
+
+/**
+ * Set or removal of a value, or purge of a domain.
+ */
+typedef struct {
+    // Opaque type. Do not access the instance fields directly.
+    /**@cond */
+    const void* _Nullable bytes;
+    size_t numBytes;
+    HAPPlatformKeyValueStoreDomain domain;
+    HAPPlatformKeyValueStoreKey key;
+    bool isRemove;
+    bool isPurge;
+    /**@endcond */
+} HAPPlatformKeyValueStoreOperation;
+
+/**
+ * Log-structured storage.
+ */
+typedef struct {
+    // Opaque type. Do not access the instance fields directly.
+    /**@cond */
+    const char* rootDirectory;
+    HAPPlatformKeyValueStoreLogIndexEntry* indexEntries;
+    size_t maxIndexEntries;
+    size_t numIndexEntries;
+    uint32_t fileSize;
+    uint32_t sequenceNumber;
+    uint32_t tail;
+    uint32_t numLiveBytes;
+    uint8_t activeFile;
+    bool needsCompaction;
+    bool allowsPurgeRecords;
+    HAPPlatformTimerRef compactionTimer;
+    uint64_t numBytesWritten;
+    uint64_t numCompactions;
+    /**@endcond */
+} HAPPlatformKeyValueStoreLog;
+
+/**
+ * Loads the log and builds the index.
+ *
+ * @param[out] log                  Log.
+ * @param      rootDirectory        Directory in which the log files are stored.
+ * @param      indexEntries         Index entries. One per stored value.
+ * @param      maxIndexEntries      Number of index entries.
+ * @param      fileSize             Size of each log file in bytes.
+ */
+void HAPPlatformKeyValueStoreLogCreate(
+        HAPPlatformKeyValueStoreLog* log,
+        const char* rootDirectory,
+        HAPPlatformKeyValueStoreLogIndexEntry* indexEntries,
+        size_t maxIndexEntries,
+        size_t fileSize);
+
+/**
+ * Reads a value.
+ *
+ * @param      log                  Log.
+ * @param      domain               Domain.
+ * @param      key                  Key.
+ * @param[out] bytes                Buffer for the value, if found.
+ * @param      maxBytes             Capacity of the bytes buffer.
+ * @param[out] numBytes             Number of bytes read, if found.
+ * @param[out] found                Whether the value exists.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_Unknown        If the file access failed.
+ */
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformKeyValueStoreLogRead(
+        HAPPlatformKeyValueStoreLog* log,
+        HAPPlatformKeyValueStoreDomain domain,
+        HAPPlatformKeyValueStoreKey key,
+        void* _Nullable bytes,
+        size_t maxBytes,
+        size_t* _Nullable numBytes,
+        bool* found);
+
+/**
+ * Callback that provides the buffer for a value that is read by HAPPlatformKeyValueStoreLogReadAll.
+ *
+ * @param      context              Context.
+ * @param      domain               Domain.
+ * @param      key                  Key.
+ * @param      numBytes             Length of the value.
+ *
+ * @return Buffer of at least numBytes bytes for the value, or NULL to skip the value.
+ */
+typedef void* _Nullable (*HAPPlatformKeyValueStoreLogReadAllCallback)(
+        void* _Nullable context,
+        HAPPlatformKeyValueStoreDomain domain,
+        HAPPlatformKeyValueStoreKey key,
+        size_t numBytes);
+
+/**
+ * Reads all values with a single open of the active log file.
+ *
+ * @param      log                  Log.
+ * @param      callback             Function that is called on each value to get the buffer for the value.
+ * @param      context              Context that is passed to the callback.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_Unknown        If the file access failed. The buffers may be partially filled.
+ */
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformKeyValueStoreLogReadAll(
+        HAPPlatformKeyValueStoreLog* log,
+        HAPPlatformKeyValueStoreLogReadAllCallback callback,
+        void* _Nullable context);
+
+/**
+ * Gets the length of a value from the index, without file access.
+ *
+ * @param      log                  Log.
+ * @param      domain               Domain.
+ * @param      key                  Key.
+ * @param[out] numBytes             Length of the value, if found.
+ *
+ * @return true                     If the value exists.
+ * @return false                    Otherwise.
+ */
+HAP_RESULT_USE_CHECK
+bool HAPPlatformKeyValueStoreLogGetSize(
+        const HAPPlatformKeyValueStoreLog* log,
+        HAPPlatformKeyValueStoreDomain domain,
+        HAPPlatformKeyValueStoreKey key,
+        size_t* numBytes);
+
+/**
+ * Appends a record that sets a value.
+ *
+ * @param      log                  Log.
+ * @param      domain               Domain.
+ * @param      key                  Key.
+ * @param      bytes                Value.
+ * @param      numBytes             Length of the value.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_Unknown        If the file access failed, or if the log or the index is full.
+ */
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformKeyValueStoreLogWrite(
+        HAPPlatformKeyValueStoreLog* log,
+        HAPPlatformKeyValueStoreDomain domain,
+        HAPPlatformKeyValueStoreKey key,
+        const void* _Nullable bytes,
+        size_t numBytes);
+
+/**
+ * Appends a record that removes a value. Has no effect if the value does not exist.
+ *
+ * @param      log                  Log.
+ * @param      domain               Domain.
+ * @param      key                  Key.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_Unknown        If the file access failed.
+ */
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformKeyValueStoreLogRemove(
+        HAPPlatformKeyValueStoreLog* log,
+        HAPPlatformKeyValueStoreDomain domain,
+        HAPPlatformKeyValueStoreKey key);
+
+/**
+ * Appends a record that removes all values of a domain. Has no effect if the domain contains no values.
+ *
+ * @param      log                  Log.
+ * @param      domain               Domain.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_Unknown        If the file access failed.
+ */
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformKeyValueStoreLogPurgeDomain(HAPPlatformKeyValueStoreLog* log, HAPPlatformKeyValueStoreDomain domain);
+
+/**
+ * Appends a record that sets and removes several values at once.
+ *
+ * - After a reset, either all or none of the operations are in effect.
+ *
+ * - A purge operation removes all values of its domain that are in effect at that point of the batch.
+ *
+ * @param      log                  Log.
+ * @param      operations           Operations, in the order in which they take effect.
+ * @param      numOperations        Number of operations.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_Unknown        If the file access failed, or if the log or the index is full.
+ */
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformKeyValueStoreLogWriteBatch(
+        HAPPlatformKeyValueStoreLog* log,
+        const HAPPlatformKeyValueStoreOperation* operations,
+        size_t numOperations);
+
+/**
+ * Lists the keys of a domain.
+ *
+ * @param      log                  Log.
+ * @param      domain               Domain.
+ * @param[out] keys                 Keys of the domain.
+ *
+ * @return Number of keys of the domain.
+ */
+HAP_RESULT_USE_CHECK
+size_t HAPPlatformKeyValueStoreLogListKeys(
+        const HAPPlatformKeyValueStoreLog* log,
+        HAPPlatformKeyValueStoreDomain domain,
+        HAPPlatformKeyValueStoreKey keys[_Nonnull 256]);
+
+/**
+ * Copies the live records into the other log file and makes it the active one.
+ *
+ * @param      log                  Log.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_Unknown        If the file access failed. The previous log file remains in effect.
+ */
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformKeyValueStoreLogCompact(HAPPlatformKeyValueStoreLog* log);
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull end
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
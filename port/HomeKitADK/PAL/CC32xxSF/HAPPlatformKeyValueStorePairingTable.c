@@ -0,0 +1,252 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+#include "HAPPlatformKeyValueStore+Init.h"
+
+static const HAPLogObject logObject = { .subsystem = kHAPPlatform_LogSubsystem, .category = "KeyValueStore" };
+
+HAP_RESULT_USE_CHECK
+int HAPPlatformKeyValueStoreComparePairingIdentifier(
+        const uint8_t* pairingBytes,
+        const uint8_t* identifier,
+        size_t numIdentifierBytes) {
+    HAPPrecondition(pairingBytes);
+    HAPPrecondition(identifier);
+
+    size_t numPairingIdentifierBytes = pairingBytes[kHAPPlatformKeyValueStorePairing_MaxIdentifierBytes];
+    if (numPairingIdentifierBytes != numIdentifierBytes) {
+        return numPairingIdentifierBytes < numIdentifierBytes ? -1 : 1;
+    }
+    for (size_t i = 0; i < numIdentifierBytes; i++) {
+        if (pairingBytes[i] != identifier[i]) {
+            return pairingBytes[i] < identifier[i] ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+bool HAPPlatformKeyValueStoreFindPairingEntryIndex(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        const uint8_t* identifier,
+        size_t numIdentifierBytes,
+        size_t* index) {
+    HAPPrecondition(keyValueStore);
+    HAPPrecondition(keyValueStore->pairingEntries);
+    HAPPrecondition(index);
+
+    size_t low = 0;
+    size_t high = keyValueStore->numPairingEntries;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        int order = HAPPlatformKeyValueStoreComparePairingIdentifier(
+                keyValueStore->pairingEntries[middle].bytes, identifier, numIdentifierBytes);
+        if (!order) {
+            *index = middle;
+            return true;
+        }
+        if (order < 0) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    *index = low;
+    return false;
+}
+
+HAPPlatformKeyValueStorePairingEntry* _Nullable HAPPlatformKeyValueStoreFindPairingEntry(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreKey key) {
+    HAPPrecondition(keyValueStore);
+    HAPPrecondition(keyValueStore->isPairingTableValid);
+
+    for (size_t i = 0; i < keyValueStore->numPairingEntries; i++) {
+        if (keyValueStore->pairingEntries[i].key == key) {
+            return &keyValueStore->pairingEntries[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Stores a pairing in the pairing table, replacing the pairing of the same key.
+ *
+ * @param      keyValueStore        Key-value store.
+ * @param      key                  Key in the pairings domain.
+ * @param      bytes                Value.
+ * @param      numBytes             Length of the value.
+ *
+ * @return true                     If successful.
+ * @return false                    If the value is not a pairing record, or if the pairing table is full.
+ */
+HAP_RESULT_USE_CHECK
+static bool StorePairingEntry(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreKey key,
+        const void* _Nullable bytes,
+        size_t numBytes) {
+    HAPPrecondition(keyValueStore);
+    HAPPrecondition(keyValueStore->pairingEntries);
+    HAPPrecondition(!numBytes || bytes);
+
+    const uint8_t* pairingBytes = bytes;
+    if (numBytes <= kHAPPlatformKeyValueStorePairing_MaxIdentifierBytes || numBytes > keyValueStore->numPairingBytes ||
+        pairingBytes[kHAPPlatformKeyValueStorePairing_MaxIdentifierBytes] >
+                kHAPPlatformKeyValueStorePairing_MaxIdentifierBytes) {
+        HAPLog(&logObject,
+               "Value %02X.%02X (%lu bytes) is not a pairing record. Pairings are read from flash.",
+               keyValueStore->pairingsDomain,
+               key,
+               (unsigned long) numBytes);
+        return false;
+    }
+
+    for (size_t i = 0; i < keyValueStore->numPairingEntries; i++) {
+        if (keyValueStore->pairingEntries[i].key == key) {
+            HAPRawBufferCopyBytes(
+                    &keyValueStore->pairingEntries[i],
+                    &keyValueStore->pairingEntries[i + 1],
+                    (keyValueStore->numPairingEntries - i - 1) * sizeof(HAPPlatformKeyValueStorePairingEntry));
+            keyValueStore->numPairingEntries--;
+            break;
+        }
+    }
+    if (keyValueStore->numPairingEntries == keyValueStore->maxPairingEntries) {
+        HAPLog(&logObject, "Pairing table is full. Pairings are read from flash.");
+        return false;
+    }
+
+    size_t index;
+    (void) HAPPlatformKeyValueStoreFindPairingEntryIndex(
+            keyValueStore, pairingBytes, pairingBytes[kHAPPlatformKeyValueStorePairing_MaxIdentifierBytes], &index);
+    HAPRawBufferCopyBytes(
+            &keyValueStore->pairingEntries[index + 1],
+            &keyValueStore->pairingEntries[index],
+            (keyValueStore->numPairingEntries - index) * sizeof(HAPPlatformKeyValueStorePairingEntry));
+    keyValueStore->numPairingEntries++;
+    HAPRawBufferCopyBytes(keyValueStore->pairingEntries[index].bytes, pairingBytes, numBytes);
+    keyValueStore->pairingEntries[index].numBytes = (uint8_t) numBytes;
+    keyValueStore->pairingEntries[index].key = key;
+    return true;
+}
+
+void HAPPlatformKeyValueStoreUpdatePairingTable(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain,
+        HAPPlatformKeyValueStoreKey key,
+        const void* _Nullable bytes,
+        size_t numBytes,
+        bool isRemove) {
+    HAPPrecondition(keyValueStore);
+
+    if (domain != keyValueStore->pairingsDomain || !keyValueStore->isPairingTableValid) {
+        return;
+    }
+    if (isRemove) {
+        HAPPlatformKeyValueStorePairingEntry* _Nullable entry =
+                HAPPlatformKeyValueStoreFindPairingEntry(keyValueStore, key);
+        if (entry) {
+            size_t index = (size_t)(entry - keyValueStore->pairingEntries);
+            HAPRawBufferCopyBytes(
+                    entry,
+                    entry + 1,
+                    (keyValueStore->numPairingEntries - index - 1) * sizeof *entry);
+            keyValueStore->numPairingEntries--;
+        }
+        return;
+    }
+    if (!StorePairingEntry(keyValueStore, key, bytes, numBytes)) {
+        keyValueStore->isPairingTableValid = false;
+    }
+}
+
+void HAPPlatformKeyValueStoreInvalidatePairingTable(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain) {
+    HAPPrecondition(keyValueStore);
+
+    if (domain == keyValueStore->pairingsDomain && keyValueStore->isPairingTableValid) {
+        HAPLogError(&logObject, "Pairing update failed. Pairings are read from flash.");
+        keyValueStore->isPairingTableValid = false;
+    }
+}
+
+HAP_RESULT_USE_CHECK
+static HAPError LoadPairingTableEnumerateCallback(
+        void* _Nullable context,
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain,
+        HAPPlatformKeyValueStoreKey key,
+        bool* shouldContinue) {
+    HAPPrecondition(context);
+    bool* isComplete = context;
+    HAPPrecondition(keyValueStore);
+    HAPPrecondition(shouldContinue);
+
+    // One extra byte detects values that are longer than a pairing record.
+    uint8_t bytes[kHAPPlatformKeyValueStorePairing_MaxBytes + 1];
+    size_t numBytes;
+    bool found;
+    HAPError err = HAPPlatformKeyValueStoreReadFile(
+            keyValueStore, domain, key, bytes, keyValueStore->numPairingBytes + 1, &numBytes, &found);
+    if (err) {
+        HAPAssert(err == kHAPError_Unknown);
+        return err;
+    }
+    if (found && !StorePairingEntry(keyValueStore, key, bytes, numBytes)) {
+        *isComplete = false;
+        *shouldContinue = false;
+    }
+    return kHAPError_None;
+}
+
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformKeyValueStoreLoadPairingTable(HAPPlatformKeyValueStoreRef keyValueStore) {
+    HAPPrecondition(keyValueStore);
+    HAPPrecondition(keyValueStore->pairingEntries);
+
+    keyValueStore->numPairingEntries = 0;
+    keyValueStore->isPairingTableValid = false;
+
+    bool isComplete = true;
+    HAPError err = HAPPlatformKeyValueStoreEnumerate(
+            keyValueStore, keyValueStore->pairingsDomain, LoadPairingTableEnumerateCallback, &isComplete);
+    if (err) {
+        HAPAssert(err == kHAPError_Unknown);
+        return err;
+    }
+    keyValueStore->isPairingTableValid = isComplete;
+    HAPLogDebug(&logObject, "Pairing table: %lu pairings.", (unsigned long) keyValueStore->numPairingEntries);
+    return kHAPError_None;
+}
+
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformKeyValueStoreEnumeratePairingTable(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreEnumerateCallback callback,
+        void* _Nullable context) {
+    HAPPrecondition(keyValueStore);
+    HAPPrecondition(keyValueStore->isPairingTableValid);
+    HAPPrecondition(callback);
+
+    keyValueStore->statistics.numPairingTableHits++;
+
+    HAPPlatformKeyValueStoreKey keys[256];
+    size_t numKeys = keyValueStore->numPairingEntries;
+    for (size_t i = 0; i < numKeys; i++) {
+        keys[i] = keyValueStore->pairingEntries[i].key;
+    }
+    bool shouldContinue = true;
+    for (size_t i = 0; i < numKeys && shouldContinue; i++) {
+        HAPError err = callback(
+                context, keyValueStore, keyValueStore->pairingsDomain, keys[i], &shouldContinue);
+        if (err) {
+            HAPAssert(err == kHAPError_Unknown);
+            return err;
+        }
+    }
+    return kHAPError_None;
+}
@@ -0,0 +1,163 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+#ifndef HAP_PLATFORM_KEY_VALUE_STORE_PAIRING_TABLE_H
+#define HAP_PLATFORM_KEY_VALUE_STORE_PAIRING_TABLE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "HAPPlatform.h"
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull begin
+#endif
+
+/**@file
+ * Pairing table of the key-value store.
+ *
+ * The pairing table holds all pairings in RAM, sorted by controller identifier. It is loaded once at initialization
+ * and kept up to date by every set and removal in the pairings domain. Reads and enumeration of the pairings domain
+ * are then served without accessing the network processor.
+ *
+ * The pairings domain and the length of a pairing record are passed in HAPPlatformKeyValueStoreOptions.
+ */
+
+/**
+ * Maximum length of a controller identifier.
+ */
+#define kHAPPlatformKeyValueStorePairing_MaxIdentifierBytes ((size_t) 36)
+
+/**
+ * Maximum length of a pairing record that the pairing table can hold.
+ */
+#define kHAPPlatformKeyValueStorePairing_MaxBytes ((size_t) 70)
+
+/**
+ * Pairing table entry. Holds one pairing.
+ */
+typedef struct {
+    // Opaque type. Do not access the instance fields directly.
+    /**@cond */
+    uint8_t bytes[kHAPPlatformKeyValueStorePairing_MaxBytes];
+    uint8_t numBytes;
+    HAPPlatformKeyValueStoreKey key;
+    /**@endcond */
+} HAPPlatformKeyValueStorePairingEntry;
+
+/**
+ * Compares the controller identifier of a pairing with a controller identifier.
+ *
+ * - Identifiers are ordered by length first, then by content.
+ *
+ * @param      pairingBytes         Pairing.
+ * @param      identifier           Controller identifier.
+ * @param      numIdentifierBytes   Length of the controller identifier.
+ *
+ * @return Negative, zero or positive, if the pairing orders before, with or after the controller identifier.
+ */
+HAP_RESULT_USE_CHECK
+int HAPPlatformKeyValueStoreComparePairingIdentifier(
+        const uint8_t* pairingBytes,
+        const uint8_t* identifier,
+        size_t numIdentifierBytes);
+
+/**
+ * Finds the position of a controller identifier in the pairing table.
+ *
+ * @param      keyValueStore        Key-value store.
+ * @param      identifier           Controller identifier.
+ * @param      numIdentifierBytes   Length of the controller identifier.
+ * @param[out] index                Index of the pairing, or index at which it would be inserted if not found.
+ *
+ * @return true                     If a pairing with the controller identifier exists.
+ * @return false                    Otherwise.
+ */
+bool HAPPlatformKeyValueStoreFindPairingEntryIndex(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        const uint8_t* identifier,
+        size_t numIdentifierBytes,
+        size_t* index);
+
+/**
+ * Finds the pairing table entry of a key.
+ *
+ * @param      keyValueStore        Key-value store.
+ * @param      key                  Key in the pairings domain.
+ *
+ * @return Pairing table entry, if the key contains a pairing.
+ */
+HAPPlatformKeyValueStorePairingEntry* _Nullable HAPPlatformKeyValueStoreFindPairingEntry(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreKey key);
+
+/**
+ * Applies a set or removal to the pairing table. Disables the pairing table if the value does not fit.
+ *
+ * @param      keyValueStore        Key-value store.
+ * @param      domain               Domain.
+ * @param      key                  Key.
+ * @param      bytes                Value to set. NULL for a removal.
+ * @param      numBytes             Length of the value.
+ * @param      isRemove             Whether the value is removed.
+ */
+void HAPPlatformKeyValueStoreUpdatePairingTable(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain,
+        HAPPlatformKeyValueStoreKey key,
+        const void* _Nullable bytes,
+        size_t numBytes,
+        bool isRemove);
+
+/**
+ * Disables the pairing table after a failed set or removal in the pairings domain, as the value on flash is unknown.
+ *
+ * @param      keyValueStore        Key-value store.
+ * @param      domain               Domain.
+ */
+void HAPPlatformKeyValueStoreInvalidatePairingTable(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain);
+
+/**
+ * Loads all pairings into the pairing table.
+ *
+ * @param      keyValueStore        Key-value store.
+ *
+ * @return kHAPError_None           If successful. The pairing table is disabled if the pairings do not fit.
+ * @return kHAPError_Unknown        If the file access failed. The pairing table is disabled.
+ */
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformKeyValueStoreLoadPairingTable(HAPPlatformKeyValueStoreRef keyValueStore);
+
+/**
+ * Enumerates the keys of the pairings that are held by the pairing table.
+ *
+ * - The keys are copied first, as the callback may remove values.
+ *
+ * @param      keyValueStore        Key-value store.
+ * @param      callback             Function to call on each key.
+ * @param      context              Context that is passed to the callback.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_Unknown        If the callback failed.
+ */
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformKeyValueStoreEnumeratePairingTable(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreEnumerateCallback callback,
+        void* _Nullable context);
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull end
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
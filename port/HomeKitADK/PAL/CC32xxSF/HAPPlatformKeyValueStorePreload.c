@@ -0,0 +1,227 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+#include "HAPPlatformKeyValueStore+Init.h"
+
+static const HAPLogObject logObject = { .subsystem = kHAPPlatform_LogSubsystem, .category = "KeyValueStore" };
+
+uint8_t* _Nullable HAPPlatformKeyValueStoreFindPreloadedValue(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain,
+        HAPPlatformKeyValueStoreKey key) {
+    HAPPrecondition(keyValueStore);
+
+    size_t offset = 0;
+    while (offset < keyValueStore->numPreloadBytes) {
+        uint8_t* header = &keyValueStore->preloadBytes[offset];
+        if (header[0] == domain && header[1] == key) {
+            return header;
+        }
+        offset += kHAPPlatformKeyValueStorePreload_NumHeaderBytes + HAPReadLittleUInt16(&header[2]);
+    }
+    return NULL;
+}
+
+void HAPPlatformKeyValueStoreDropPreloadedValues(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain,
+        const HAPPlatformKeyValueStoreKey* _Nullable key) {
+    HAPPrecondition(keyValueStore);
+
+    size_t offset = 0;
+    while (offset < keyValueStore->numPreloadBytes) {
+        uint8_t* header = &keyValueStore->preloadBytes[offset];
+        size_t numValueBytes = kHAPPlatformKeyValueStorePreload_NumHeaderBytes + HAPReadLittleUInt16(&header[2]);
+        if (header[0] != domain || (key && header[1] != *key)) {
+            offset += numValueBytes;
+            continue;
+        }
+        HAPRawBufferCopyBytes(
+                header, &header[numValueBytes], keyValueStore->numPreloadBytes - offset - numValueBytes);
+        keyValueStore->numPreloadBytes -= numValueBytes;
+    }
+}
+
+/**
+ * Reserves room for a value at the end of the preload buffer.
+ *
+ * @param      keyValueStore        Key-value store.
+ * @param      domain               Domain.
+ * @param      key                  Key.
+ * @param      maxBytes             Maximum length of the value.
+ *
+ * @return Buffer for the value, or NULL if the value does not fit.
+ */
+static uint8_t* _Nullable ReservePreloadedValue(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain,
+        HAPPlatformKeyValueStoreKey key,
+        size_t maxBytes) {
+    HAPPrecondition(keyValueStore);
+    HAPPrecondition(keyValueStore->preloadBytes);
+
+    size_t numFreeBytes = keyValueStore->maxPreloadBytes - keyValueStore->numPreloadBytes;
+    if (maxBytes > UINT16_MAX || numFreeBytes < kHAPPlatformKeyValueStorePreload_NumHeaderBytes + maxBytes) {
+        return NULL;
+    }
+    uint8_t* header = &keyValueStore->preloadBytes[keyValueStore->numPreloadBytes];
+    header[0] = domain;
+    header[1] = key;
+    return &header[kHAPPlatformKeyValueStorePreload_NumHeaderBytes];
+}
+
+/**
+ * Adds the value that has been read into the room reserved by ReservePreloadedValue to the preloaded values.
+ *
+ * @param      keyValueStore        Key-value store.
+ * @param      numBytes             Length of the value.
+ */
+static void CommitPreloadedValue(HAPPlatformKeyValueStoreRef keyValueStore, size_t numBytes) {
+    HAPPrecondition(keyValueStore);
+    HAPPrecondition(keyValueStore->preloadBytes);
+    HAPPrecondition(numBytes <= UINT16_MAX);
+
+    uint8_t* header = &keyValueStore->preloadBytes[keyValueStore->numPreloadBytes];
+    HAPWriteLittleUInt16(&header[2], (uint16_t) numBytes);
+    keyValueStore->numPreloadBytes += kHAPPlatformKeyValueStorePreload_NumHeaderBytes + numBytes;
+}
+
+/**
+ * Context of the preload.
+ */
+typedef struct {
+    HAPPlatformKeyValueStoreRef keyValueStore;
+    size_t numValues;
+    size_t numSkippedValues;
+} PreloadContext;
+
+static void* _Nullable PreloadLogValueCallback(
+        void* _Nullable context,
+        HAPPlatformKeyValueStoreDomain domain,
+        HAPPlatformKeyValueStoreKey key,
+        size_t numBytes) {
+    HAPPrecondition(context);
+    PreloadContext* preload = context;
+    HAPPrecondition(preload->keyValueStore);
+    HAPPlatformKeyValueStoreRef keyValueStore = preload->keyValueStore;
+
+    if (domain == keyValueStore->pairingsDomain && keyValueStore->isPairingTableValid) {
+        return NULL;
+    }
+    uint8_t* _Nullable bytes = ReservePreloadedValue(keyValueStore, domain, key, numBytes);
+    if (!bytes) {
+        preload->numSkippedValues++;
+        return NULL;
+    }
+    CommitPreloadedValue(keyValueStore, numBytes);
+    preload->numValues++;
+    return bytes;
+}
+
+/**
+ * Preloads the value of a file.
+ *
+ * @param      preload              Context of the preload.
+ * @param      domain               Domain.
+ * @param      key                  Key.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_Unknown        If the file access failed.
+ */
+HAP_RESULT_USE_CHECK
+static HAPError PreloadFile(
+        PreloadContext* preload,
+        HAPPlatformKeyValueStoreDomain domain,
+        HAPPlatformKeyValueStoreKey key) {
+    HAPPrecondition(preload);
+    HAPPrecondition(preload->keyValueStore);
+    HAPPlatformKeyValueStoreRef keyValueStore = preload->keyValueStore;
+
+    if (domain == keyValueStore->pairingsDomain && keyValueStore->isPairingTableValid) {
+        return kHAPError_None;
+    }
+
+    // The length is not known before reading, so the value is read into all remaining room.
+    // A value that fills the room completely may have been cut short.
+    size_t numFreeBytes = keyValueStore->maxPreloadBytes - keyValueStore->numPreloadBytes;
+    size_t maxBytes = numFreeBytes > kHAPPlatformKeyValueStorePreload_NumHeaderBytes ?
+                              HAPMin(numFreeBytes - kHAPPlatformKeyValueStorePreload_NumHeaderBytes, UINT16_MAX) :
+                              0;
+    uint8_t* _Nullable bytes = maxBytes ? ReservePreloadedValue(keyValueStore, domain, key, maxBytes) : NULL;
+    if (!bytes) {
+        preload->numSkippedValues++;
+        return kHAPError_None;
+    }
+    size_t numBytes;
+    bool found;
+    HAPError err = HAPPlatformKeyValueStoreReadFile(
+            keyValueStore, domain, key, HAPNonnull(bytes), maxBytes, &numBytes, &found);
+    if (err) {
+        HAPAssert(err == kHAPError_Unknown);
+        return err;
+    }
+    if (!found) {
+        return kHAPError_None;
+    }
+    if (numBytes == maxBytes) {
+        preload->numSkippedValues++;
+        return kHAPError_None;
+    }
+    CommitPreloadedValue(keyValueStore, numBytes);
+    preload->numValues++;
+    return kHAPError_None;
+}
+
+HAP_RESULT_USE_CHECK
+static HAPError PreloadFileEnumerateCallback(
+        void* _Nullable context,
+        HAPPlatformKeyValueStoreRef keyValueStore HAP_UNUSED,
+        HAPPlatformKeyValueStoreDomain domain,
+        HAPPlatformKeyValueStoreKey key,
+        bool* shouldContinue) {
+    HAPPrecondition(context);
+    PreloadContext* preload = context;
+    HAPPrecondition(shouldContinue);
+
+    return PreloadFile(preload, domain, key);
+}
+
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformKeyValueStorePreloadValues(HAPPlatformKeyValueStoreRef keyValueStore) {
+    HAPPrecondition(keyValueStore);
+    HAPPrecondition(keyValueStore->preloadBytes);
+
+    HAPError err = kHAPError_None;
+    PreloadContext preload = { .keyValueStore = keyValueStore };
+    if (keyValueStore->useLog) {
+        err = HAPPlatformKeyValueStoreLogReadAll(&keyValueStore->log, PreloadLogValueCallback, &preload);
+    } else if (keyValueStore->isKeyIndexValid) {
+        // The keys are copied, because reading a file that no longer exists removes it from the key index.
+        for (size_t i = 0; !err && i < keyValueStore->numKeyIndexEntries; i++) {
+            HAPPlatformKeyValueStoreKeyIndexEntry entry = keyValueStore->keyIndexEntries[i];
+            for (unsigned int key = 0; !err && entry.numKeys && key <= UINT8_MAX; key++) {
+                if (entry.keys[key / 8] & (1U << (key % 8))) {
+                    err = PreloadFile(&preload, entry.domain, (HAPPlatformKeyValueStoreKey) key);
+                }
+            }
+        }
+    } else {
+        err = HAPPlatformKeyValueStoreListFiles(
+                keyValueStore, /* domain: */ NULL, PreloadFileEnumerateCallback, &preload);
+    }
+    if (err) {
+        HAPAssert(err == kHAPError_Unknown);
+        return err;
+    }
+    HAPLogInfo(
+            &logObject,
+            "Preloaded %lu values (%lu / %lu bytes). %lu values are read from flash.",
+            (unsigned long) preload.numValues,
+            (unsigned long) keyValueStore->numPreloadBytes,
+            (unsigned long) keyValueStore->maxPreloadBytes,
+            (unsigned long) preload.numSkippedValues);
+    return kHAPError_None;
+}
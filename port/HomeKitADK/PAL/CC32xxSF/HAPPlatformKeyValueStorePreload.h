@@ -0,0 +1,80 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+#ifndef HAP_PLATFORM_KEY_VALUE_STORE_PRELOAD_H
+#define HAP_PLATFORM_KEY_VALUE_STORE_PRELOAD_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "HAPPlatform.h"
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull begin
+#endif
+
+/**@file
+ * Preloaded values of the key-value store.
+ *
+ * The preload buffer holds the values that are read during startup. At initialization, every value is read once
+ * into the buffer, in a single pass over the key index, the file listing or the log, as far as the buffer allows.
+ * Later reads of these values are served from the buffer without accessing the network processor, including values
+ * that are too large for the cache, such as the setup info and the software token. A preloaded value is dropped from
+ * the buffer when it is set, removed or purged.
+ */
+
+/**
+ * Length of the header of a preloaded value: domain (1), key (1), length (2, little endian).
+ */
+#define kHAPPlatformKeyValueStorePreload_NumHeaderBytes ((size_t) 4)
+
+/**
+ * Finds a preloaded value.
+ *
+ * @param      keyValueStore        Key-value store.
+ * @param      domain               Domain.
+ * @param      key                  Key.
+ *
+ * @return Header of the preloaded value, followed by the value, or NULL if the value is not preloaded.
+ */
+uint8_t* _Nullable HAPPlatformKeyValueStoreFindPreloadedValue(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain,
+        HAPPlatformKeyValueStoreKey key);
+
+/**
+ * Drops preloaded values. The remaining values are moved to the front of the preload buffer.
+ *
+ * @param      keyValueStore        Key-value store.
+ * @param      domain               Domain.
+ * @param      key                  Key, or NULL to drop all values of the domain.
+ */
+void HAPPlatformKeyValueStoreDropPreloadedValues(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain,
+        const HAPPlatformKeyValueStoreKey* _Nullable key);
+
+/**
+ * Reads all values into the preload buffer, as far as they fit.
+ *
+ * @param      keyValueStore        Key-value store.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_Unknown        If the file access failed. The preload buffer may be partially filled.
+ */
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformKeyValueStorePreloadValues(HAPPlatformKeyValueStoreRef keyValueStore);
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull end
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,1461 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Copyright (c) 2022 John Buonagurio
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+// Tests of the key-value store, run by the host build on the serial flash file system emulation.
+
+#include <dirent.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "HAPPlatform.h"
+#include "HAPPlatformClock+Init.h"
+#include "HAPPlatformKeyValueStore+Init.h"
+#include "HAPPlatformRunLoop+Init.h"
+#include "SimpleLinkFS+Init.h"
+
+#include <ti/drivers/net/wifi/simplelink.h>
+
+static const HAPLogObject logObject = { .subsystem = kHAPPlatform_LogSubsystem, .category = "KeyValueStoreTest" };
+
+/**
+ * Root directory of the key-value store within the file system.
+ */
+#define kRootDirectory ".homekitstore"
+
+/**
+ * Maximum length of a test value.
+ */
+#define kMaxValueBytes ((size_t) 128)
+
+/**
+ * Time that a file system command takes on the serial flash, and the additional time of a commit.
+ */
+#define kCommandLatency ((HAPTime)(2 * HAPMillisecond))
+#define kCommitLatency ((HAPTime)(15 * HAPMillisecond))
+
+/**
+ * Directory of the file system emulation.
+ */
+static char fileSystemDirectory[] = "/tmp/HAPPlatformKeyValueStoreTest.XXXXXX";
+
+/**
+ * Key-value store under test.
+ */
+static HAPPlatformKeyValueStore keyValueStore;
+
+/**
+ * Options with which the key-value store is initialized.
+ */
+static HAPPlatformKeyValueStoreOptions keyValueStoreOptions;
+
+/**
+ * Removes a directory and its contents.
+ *
+ * @param      path                 Path of the directory.
+ */
+static void RemoveDirectory(const char* path)
+{
+    DIR* dir = opendir(path);
+    HAPAssert(dir);
+
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (HAPStringAreEqual(entry->d_name, ".") || HAPStringAreEqual(entry->d_name, "..")) {
+            continue;
+        }
+
+        char entryPath[PATH_MAX];
+        HAPError err = HAPStringWithFormat(entryPath, sizeof entryPath, "%s/%s", path, entry->d_name);
+        HAPAssert(!err);
+        struct stat st;
+        int e = lstat(entryPath, &st);
+        HAPAssert(!e);
+        if (S_ISDIR(st.st_mode)) {
+            RemoveDirectory(entryPath);
+        } else {
+            e = unlink(entryPath);
+            HAPAssert(!e);
+        }
+    }
+    closedir(dir);
+
+    int e = rmdir(path);
+    HAPAssert(!e);
+}
+
+/**
+ * Power cut emulation.
+ *
+ * The file system calls of the key-value store are wrapped by the linker (--wrap). Writes, closes and removals are
+ * counted, and the power is cut at a given count: the write only writes half of its bytes, the close discards the
+ * changes to the file, the removal does not happen, and all further calls fail until the device restarts.
+ */
+static struct {
+    long numOperations;
+    long cutAt;
+    bool isCut;
+    _i32 openFiles[16];
+    size_t numOpenFiles;
+} powerCut = { .cutAt = -1 };
+
+_i32 __real_sl_FsOpen(const _u8* pFileName, const _u32 AccessModeAndMaxSize, _u32* pToken);
+_i16 __real_sl_FsClose(
+        const _i32 FileHdl,
+        const _u8* pCeritificateFileName,
+        const _u8* pSignature,
+        const _u32 SignatureLen);
+_i32 __real_sl_FsWrite(const _i32 FileHdl, _u32 Offset, _u8* pData, _u32 Len);
+_i16 __real_sl_FsDel(const _u8* pFileName, const _u32 Token);
+
+_i32 __wrap_sl_FsOpen(const _u8* pFileName, const _u32 AccessModeAndMaxSize, _u32* pToken);
+_i16 __wrap_sl_FsClose(
+        const _i32 FileHdl,
+        const _u8* pCeritificateFileName,
+        const _u8* pSignature,
+        const _u32 SignatureLen);
+_i32 __wrap_sl_FsWrite(const _i32 FileHdl, _u32 Offset, _u8* pData, _u32 Len);
+_i16 __wrap_sl_FsDel(const _u8* pFileName, const _u32 Token);
+
+/**
+ * Counts an operation that changes flash, and cuts the power when the count is reached.
+ *
+ * @return true                     If the power has been cut.
+ * @return false                    Otherwise.
+ */
+HAP_RESULT_USE_CHECK
+static bool CountOperation(void)
+{
+    if (!powerCut.isCut && ++powerCut.numOperations == powerCut.cutAt) {
+        powerCut.isCut = true;
+        return true;
+    }
+    return powerCut.isCut;
+}
+
+/**
+ * Cuts the power at an operation that changes flash.
+ *
+ * @param      cutAt                Number of the operation, counted from 1.
+ */
+static void SchedulePowerCut(long cutAt)
+{
+    powerCut.numOperations = 0;
+    powerCut.cutAt = cutAt;
+    powerCut.isCut = false;
+}
+
+_i32 __wrap_sl_FsOpen(const _u8* pFileName, const _u32 AccessModeAndMaxSize, _u32* pToken)
+{
+    if (powerCut.isCut) {
+        return SL_ERROR_FS_DEVICE_IO_ERROR;
+    }
+    _i32 fileHandle = __real_sl_FsOpen(pFileName, AccessModeAndMaxSize, pToken);
+    if (fileHandle >= 0) {
+        HAPAssert(powerCut.numOpenFiles < HAPArrayCount(powerCut.openFiles));
+        powerCut.openFiles[powerCut.numOpenFiles++] = fileHandle;
+    }
+    return fileHandle;
+}
+
+_i16 __wrap_sl_FsClose(
+        const _i32 FileHdl,
+        const _u8* pCeritificateFileName,
+        const _u8* pSignature,
+        const _u32 SignatureLen)
+{
+    for (size_t i = 0; i < powerCut.numOpenFiles; i++) {
+        if (powerCut.openFiles[i] == FileHdl) {
+            powerCut.openFiles[i] = powerCut.openFiles[--powerCut.numOpenFiles];
+            break;
+        }
+    }
+    if (CountOperation()) {
+        (void) __real_sl_FsClose(FileHdl, NULL, (const _u8*) "A", 1);
+        return SL_ERROR_FS_DEVICE_IO_ERROR;
+    }
+    return __real_sl_FsClose(FileHdl, pCeritificateFileName, pSignature, SignatureLen);
+}
+
+_i32 __wrap_sl_FsWrite(const _i32 FileHdl, _u32 Offset, _u8* pData, _u32 Len)
+{
+    if (powerCut.isCut) {
+        return SL_ERROR_FS_DEVICE_IO_ERROR;
+    }
+    if (CountOperation()) {
+        if (Len / 2) {
+            (void) __real_sl_FsWrite(FileHdl, Offset, pData, Len / 2);
+        }
+        return SL_ERROR_FS_DEVICE_IO_ERROR;
+    }
+    return __real_sl_FsWrite(FileHdl, Offset, pData, Len);
+}
+
+_i16 __wrap_sl_FsDel(const _u8* pFileName, const _u32 Token)
+{
+    if (CountOperation()) {
+        return SL_ERROR_FS_DEVICE_IO_ERROR;
+    }
+    return __real_sl_FsDel(pFileName, Token);
+}
+
+/**
+ * Initializes the key-value store, as after a reset. Background work that was pending is dropped.
+ */
+static void Open(void)
+{
+    if (keyValueStore.collectionTimer) {
+        HAPPlatformTimerDeregister(keyValueStore.collectionTimer);
+        keyValueStore.collectionTimer = 0;
+    }
+    if (keyValueStore.log.compactionTimer) {
+        HAPPlatformTimerDeregister(keyValueStore.log.compactionTimer);
+        keyValueStore.log.compactionTimer = 0;
+    }
+    HAPPlatformKeyValueStoreCreate(&keyValueStore, &keyValueStoreOptions);
+}
+
+/**
+ * Restarts the device after a power cut: files that were open lose their uncommitted changes, and the key-value
+ * store is initialized again.
+ */
+static void Restart(void)
+{
+    while (powerCut.numOpenFiles) {
+        _i32 fileHandle = powerCut.openFiles[--powerCut.numOpenFiles];
+        (void) __real_sl_FsClose(fileHandle, NULL, (const _u8*) "A", 1);
+    }
+    SchedulePowerCut(-1);
+    Open();
+}
+
+/**
+ * Initializes the key-value store on an empty file system.
+ *
+ * @param      options              Initialization options. The root directory is set by this function.
+ */
+static void OpenEmpty(const HAPPlatformKeyValueStoreOptions* options)
+{
+    RemoveDirectory(fileSystemDirectory);
+    SimpleLinkFSCreate(&(const SimpleLinkFSOptions) { .rootDirectory = fileSystemDirectory });
+
+    keyValueStoreOptions = *options;
+    keyValueStoreOptions.rootDirectory = kRootDirectory;
+    Open();
+}
+
+/**
+ * Sets a value whose bytes are derived from a version number.
+ */
+static void SetValue(
+        HAPPlatformKeyValueStoreDomain domain,
+        HAPPlatformKeyValueStoreKey key,
+        uint8_t version,
+        size_t numBytes)
+{
+    HAPPrecondition(numBytes <= kMaxValueBytes);
+
+    uint8_t bytes[kMaxValueBytes];
+    for (size_t i = 0; i < numBytes; i++) {
+        bytes[i] = (uint8_t)(version + i);
+    }
+    HAPError err = HAPPlatformKeyValueStoreSet(&keyValueStore, domain, key, bytes, numBytes);
+    HAPAssert(!err);
+}
+
+/**
+ * Checks whether a value exists and has been set by SetValue with a version number.
+ */
+HAP_RESULT_USE_CHECK
+static bool HasValue(
+        HAPPlatformKeyValueStoreDomain domain,
+        HAPPlatformKeyValueStoreKey key,
+        uint8_t version,
+        size_t numBytes)
+{
+    HAPPrecondition(numBytes <= kMaxValueBytes);
+
+    uint8_t bytes[kMaxValueBytes];
+    size_t numValueBytes;
+    bool found;
+    HAPError err =
+            HAPPlatformKeyValueStoreGet(&keyValueStore, domain, key, bytes, sizeof bytes, &numValueBytes, &found);
+    HAPAssert(!err);
+    if (!found || numValueBytes != numBytes) {
+        return false;
+    }
+    for (size_t i = 0; i < numBytes; i++) {
+        if (bytes[i] != (uint8_t)(version + i)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Checks whether a value exists.
+ */
+HAP_RESULT_USE_CHECK
+static bool Exists(HAPPlatformKeyValueStoreDomain domain, HAPPlatformKeyValueStoreKey key)
+{
+    uint8_t bytes[kMaxValueBytes];
+    size_t numBytes;
+    bool found;
+    HAPError err = HAPPlatformKeyValueStoreGet(&keyValueStore, domain, key, bytes, sizeof bytes, &numBytes, &found);
+    HAPAssert(!err);
+    return found;
+}
+
+/**
+ * Gets the statistics of the key-value store.
+ */
+HAP_RESULT_USE_CHECK
+static HAPPlatformKeyValueStoreStatistics GetStatistics(void)
+{
+    HAPPlatformKeyValueStoreStatistics statistics;
+    HAPPlatformKeyValueStoreGetStatistics(&keyValueStore, &statistics);
+    return statistics;
+}
+
+/**
+ * The cache evicts the least recently used entry, and writes a modified entry to flash before evicting it.
+ */
+static void TestCacheEviction(void)
+{
+    HAPLogInfo(&logObject, "%s", __func__);
+
+    static HAPPlatformKeyValueStoreCacheEntry cacheEntries[4];
+
+    // Write-through: every set is written, and reads of cached values, including missing ones, are hits.
+    OpenEmpty(&(const HAPPlatformKeyValueStoreOptions) { .cacheEntries = cacheEntries,
+                                                          .numCacheEntries = HAPArrayCount(cacheEntries) });
+    for (uint8_t key = 1; key <= 4; key++) {
+        SetValue(0x90, key, key, 8);
+    }
+    HAPPlatformKeyValueStoreStatistics statistics = GetStatistics();
+    for (uint8_t key = 1; key <= 4; key++) {
+        HAPAssert(HasValue(0x90, key, key, 8));
+    }
+    HAPAssert(HasValue(0x90, 1, 1, 8));
+    HAPAssert(GetStatistics().numCacheHits == statistics.numCacheHits + 5);
+    HAPAssert(GetStatistics().numFlashReads == statistics.numFlashReads);
+
+    // Key 2 is the least recently used, and is evicted by a miss.
+    HAPAssert(!Exists(0x90, 5));
+    HAPAssert(GetStatistics().numCacheMisses == statistics.numCacheMisses + 1);
+    HAPAssert(HasValue(0x90, 1, 1, 8));
+    HAPAssert(HasValue(0x90, 3, 3, 8));
+    HAPAssert(HasValue(0x90, 4, 4, 8));
+    HAPAssert(!Exists(0x90, 5));
+    HAPAssert(GetStatistics().numCacheHits == statistics.numCacheHits + 9);
+    HAPAssert(HasValue(0x90, 2, 2, 8));
+    HAPAssert(GetStatistics().numCacheMisses == statistics.numCacheMisses + 2);
+
+    // Key 2 evicted key 1, which is now read from flash again.
+    statistics = GetStatistics();
+    HAPAssert(HasValue(0x90, 1, 1, 8));
+    HAPAssert(GetStatistics().numCacheMisses == statistics.numCacheMisses + 1);
+    HAPAssert(GetStatistics().numFlashReads == statistics.numFlashReads + 1);
+
+    // Write-back: sets stay in the cache until the least recently used entry is evicted.
+    OpenEmpty(&(const HAPPlatformKeyValueStoreOptions) { .cacheEntries = cacheEntries,
+                                                          .numCacheEntries = HAPArrayCount(cacheEntries),
+                                                          .useWriteBack = true });
+    for (uint8_t key = 1; key <= 4; key++) {
+        SetValue(0x90, key, key, 8);
+    }
+    HAPAssert(HasValue(0x90, 1, 1, 8));
+    HAPAssert(GetStatistics().numFlashWrites == 0);
+    SetValue(0x90, 5, 5, 8);
+    HAPAssert(GetStatistics().numFlashWrites == 1);
+
+    // Only the evicted key 2 has been written when the device resets without a flush.
+    Open();
+    HAPAssert(HasValue(0x90, 2, 2, 8));
+    HAPAssert(!Exists(0x90, 1));
+    HAPAssert(!Exists(0x90, 3));
+    HAPAssert(!Exists(0x90, 4));
+    HAPAssert(!Exists(0x90, 5));
+}
+
+/**
+ * Value of a test state. A length of 0 denotes a value that does not exist.
+ */
+typedef struct {
+    HAPPlatformKeyValueStoreDomain domain;
+    HAPPlatformKeyValueStoreKey key;
+    uint8_t version;
+    size_t numBytes;
+} TestValue;
+
+/**
+ * Checks whether the key-value store holds the values of a test state.
+ */
+HAP_RESULT_USE_CHECK
+static bool HasValues(const TestValue* values, size_t numValues)
+{
+    for (size_t i = 0; i < numValues; i++) {
+        const TestValue* value = &values[i];
+        if (value->numBytes ? !HasValue(value->domain, value->key, value->version, value->numBytes) :
+                              Exists(value->domain, value->key)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Initializes the key-value store on an empty file system and stores the values of a test state.
+ *
+ * @param      options              Initialization options. The root directory is set by this function.
+ * @param      values               Values of the test state.
+ * @param      numValues            Number of values.
+ */
+static void OpenWithValues(const HAPPlatformKeyValueStoreOptions* options, const TestValue* values, size_t numValues)
+{
+    OpenEmpty(options);
+    for (size_t i = 0; i < numValues; i++) {
+        const TestValue* value = &values[i];
+        if (value->numBytes) {
+            SetValue(value->domain, value->key, value->version, value->numBytes);
+        }
+    }
+    HAPError err = HAPPlatformKeyValueStoreFlush(&keyValueStore);
+    HAPAssert(!err);
+}
+
+static const TestValue journalValuesBefore[] = {
+    { 0xA0, 0x00, 10, 70 }, { 0xA0, 0x01, 11, 70 },  { 0xA0, 0x02, 0, 0 },
+    { 0x90, 0x20, 1, 2 },   { 0x90, 0x21, 21, 32 },  { 0x00, 0x00, 200, 100 },
+};
+
+static const TestValue journalValuesAfter[] = {
+    { 0xA0, 0x00, 10, 70 }, { 0xA0, 0x01, 0, 0 },    { 0xA0, 0x02, 12, 70 },
+    { 0x90, 0x20, 2, 2 },   { 0x90, 0x21, 21, 32 },  { 0x00, 0x00, 230, 100 },
+};
+
+/**
+ * Commits the transaction that turns journalValuesBefore into journalValuesAfter.
+ */
+HAP_RESULT_USE_CHECK
+static HAPError CommitJournalTransaction(void)
+{
+    HAPPlatformKeyValueStoreBeginTransaction(&keyValueStore);
+    SetValue(0x00, 0x00, 99, 100);
+    HAPError err = HAPPlatformKeyValueStoreRemove(&keyValueStore, 0xA0, 0x01);
+    HAPAssert(!err);
+    SetValue(0xA0, 0x02, 12, 70);
+    SetValue(0x90, 0x20, 2, 2);
+    SetValue(0x00, 0x00, 230, 100);
+    return HAPPlatformKeyValueStoreCommitTransaction(&keyValueStore);
+}
+
+/**
+ * A transaction is applied completely or not at all when the power is cut at any point of the commit. A journal that
+ * is left over by the power cut is applied when the key-value store is initialized again.
+ */
+static void TestJournalReplay(void)
+{
+    HAPLogInfo(&logObject, "%s", __func__);
+
+    static HAPPlatformKeyValueStoreCacheEntry cacheEntries[4];
+    static HAPPlatformKeyValueStoreKeyIndexEntry keyIndexEntries[4];
+    static HAPPlatformKeyValueStoreOperation transactionOperations[8];
+    static uint8_t transactionBytes[512];
+
+    for (int useCache = 0; useCache <= 1; useCache++) {
+        const HAPPlatformKeyValueStoreOptions options = {
+            .cacheEntries = useCache ? cacheEntries : NULL,
+            .numCacheEntries = useCache ? HAPArrayCount(cacheEntries) : 0,
+            .useWriteBack = useCache,
+            .keyIndexEntries = useCache ? keyIndexEntries : NULL,
+            .numKeyIndexEntries = useCache ? HAPArrayCount(keyIndexEntries) : 0,
+            .transactionOperations = transactionOperations,
+            .maxTransactionOperations = HAPArrayCount(transactionOperations),
+            .transactionBytes = transactionBytes,
+            .maxTransactionBytes = sizeof transactionBytes
+        };
+
+        // Count the operations of the commit.
+        OpenWithValues(&options, journalValuesBefore, HAPArrayCount(journalValuesBefore));
+        SchedulePowerCut(-1);
+        HAPError err = CommitJournalTransaction();
+        HAPAssert(!err);
+        long numOperations = powerCut.numOperations;
+        HAPAssert(HasValues(journalValuesAfter, HAPArrayCount(journalValuesAfter)));
+        Open();
+        HAPAssert(HasValues(journalValuesAfter, HAPArrayCount(journalValuesAfter)));
+
+        // Cut the power at each of them.
+        size_t numApplied = 0;
+        for (long cutAt = 1; cutAt <= numOperations; cutAt++) {
+            OpenWithValues(&options, journalValuesBefore, HAPArrayCount(journalValuesBefore));
+            SchedulePowerCut(cutAt);
+            err = CommitJournalTransaction();
+            HAPAssert(err);
+            Restart();
+
+            bool isApplied = HasValues(journalValuesAfter, HAPArrayCount(journalValuesAfter));
+            HAPAssert(isApplied || HasValues(journalValuesBefore, HAPArrayCount(journalValuesBefore)));
+            if (isApplied) {
+                numApplied++;
+            }
+
+            // The key-value store remains usable, and a replayed journal is not applied again.
+            SetValue(0x40, 0x01, 5, 4);
+            err = HAPPlatformKeyValueStoreFlush(&keyValueStore);
+            HAPAssert(!err);
+            Open();
+            HAPAssert(HasValue(0x40, 0x01, 5, 4));
+            HAPAssert(HasValues(
+                    isApplied ? journalValuesAfter : journalValuesBefore,
+                    isApplied ? HAPArrayCount(journalValuesAfter) : HAPArrayCount(journalValuesBefore)));
+        }
+
+        // Power cuts before the journal has been written lose the transaction, later ones do not.
+        HAPLogInfo(
+                &logObject,
+                "%s: %ld power cuts, transaction applied after %zu.",
+                useCache ? "Write-back cache" : "No cache",
+                numOperations,
+                numApplied);
+        HAPAssert(numApplied && numApplied < (size_t) numOperations);
+
+        // Flash fails at each operation of the commit and recovers without a reset. A value that is written after the
+        // failed commit is not overwritten when a journal that was left over is applied.
+        for (long cutAt = 1; cutAt <= numOperations; cutAt++) {
+            OpenWithValues(&options, journalValuesBefore, HAPArrayCount(journalValuesBefore));
+            SchedulePowerCut(cutAt);
+            err = CommitJournalTransaction();
+            HAPAssert(err);
+            SchedulePowerCut(-1);
+
+            SetValue(0x90, 0x20, 7, 2);
+            err = HAPPlatformKeyValueStoreFlush(&keyValueStore);
+            HAPAssert(!err);
+            HAPAssert(HasValue(0x90, 0x20, 7, 2));
+            Restart();
+            HAPAssert(HasValue(0x90, 0x20, 7, 2));
+            HAPAssert(HasValue(0x00, 0x00, 230, 100) || HasValue(0x00, 0x00, 200, 100));
+            HAPAssert(HasValue(0x00, 0x00, 230, 100) == HasValue(0xA0, 0x02, 12, 70));
+            HAPAssert(HasValue(0x00, 0x00, 230, 100) == !Exists(0xA0, 0x01));
+        }
+    }
+}
+
+/**
+ * Domain of the pairings.
+ */
+#define kPairingsDomain ((HAPPlatformKeyValueStoreDomain) 0xA0)
+
+/**
+ * Length of a pairing record.
+ */
+#define kNumPairingBytes ((size_t) 70)
+
+/**
+ * Stores a pairing record of a controller identifier.
+ */
+static void SetPairing(HAPPlatformKeyValueStoreKey key, const char* identifier, uint8_t permissions)
+{
+    size_t numIdentifierBytes = HAPStringGetNumBytes(identifier);
+    HAPPrecondition(numIdentifierBytes <= kHAPPlatformKeyValueStorePairing_MaxIdentifierBytes);
+
+    uint8_t bytes[kNumPairingBytes];
+    HAPRawBufferZero(bytes, sizeof bytes);
+    HAPRawBufferCopyBytes(bytes, identifier, numIdentifierBytes);
+    bytes[kHAPPlatformKeyValueStorePairing_MaxIdentifierBytes] = (uint8_t) numIdentifierBytes;
+    bytes[kNumPairingBytes - 1] = permissions;
+    HAPError err = HAPPlatformKeyValueStoreSet(&keyValueStore, kPairingsDomain, key, bytes, sizeof bytes);
+    HAPAssert(!err);
+}
+
+/**
+ * Checks whether a key holds the pairing record of a controller identifier.
+ */
+HAP_RESULT_USE_CHECK
+static bool HasPairing(HAPPlatformKeyValueStoreKey key, const char* identifier)
+{
+    uint8_t bytes[kNumPairingBytes];
+    size_t numBytes;
+    bool found;
+    HAPError err =
+            HAPPlatformKeyValueStoreGet(&keyValueStore, kPairingsDomain, key, bytes, sizeof bytes, &numBytes, &found);
+    HAPAssert(!err);
+    return found && numBytes == kNumPairingBytes &&
+           !HAPPlatformKeyValueStoreComparePairingIdentifier(
+                   bytes, (const uint8_t*) identifier, HAPStringGetNumBytes(identifier));
+}
+
+/**
+ * Checks that the pairing table is sorted, and that the binary search finds each pairing and the insertion position
+ * of each identifier.
+ */
+static void CheckPairingTable(const char* const* identifiers, size_t numIdentifiers)
+{
+    HAPAssert(keyValueStore.isPairingTableValid);
+
+    for (size_t i = 1; i < keyValueStore.numPairingEntries; i++) {
+        const uint8_t* previous = keyValueStore.pairingEntries[i - 1].bytes;
+        HAPAssert(HAPPlatformKeyValueStoreComparePairingIdentifier(
+                          keyValueStore.pairingEntries[i].bytes,
+                          previous,
+                          previous[kHAPPlatformKeyValueStorePairing_MaxIdentifierBytes]) > 0);
+    }
+
+    for (size_t i = 0; i < numIdentifiers; i++) {
+        const uint8_t* identifier = (const uint8_t*) identifiers[i];
+        size_t numIdentifierBytes = HAPStringGetNumBytes(identifiers[i]);
+        size_t index;
+        bool found =
+                HAPPlatformKeyValueStoreFindPairingEntryIndex(&keyValueStore, identifier, numIdentifierBytes, &index);
+        HAPAssert(index <= keyValueStore.numPairingEntries);
+        if (found) {
+            HAPAssert(!HAPPlatformKeyValueStoreComparePairingIdentifier(
+                    keyValueStore.pairingEntries[index].bytes, identifier, numIdentifierBytes));
+            continue;
+        }
+        for (size_t j = 0; j < keyValueStore.numPairingEntries; j++) {
+            int order = HAPPlatformKeyValueStoreComparePairingIdentifier(
+                    keyValueStore.pairingEntries[j].bytes, identifier, numIdentifierBytes);
+            HAPAssert(j < index ? order < 0 : order > 0);
+        }
+    }
+}
+
+/**
+ * Keys of the pairings in the order of their enumeration.
+ */
+typedef struct {
+    HAPPlatformKeyValueStoreKey keys[16];
+    size_t numKeys;
+} EnumeratedKeys;
+
+HAP_RESULT_USE_CHECK
+static HAPError EnumerateKey(
+        void* _Nullable context,
+        HAPPlatformKeyValueStoreRef keyValueStore_,
+        HAPPlatformKeyValueStoreDomain domain,
+        HAPPlatformKeyValueStoreKey key,
+        bool* shouldContinue)
+{
+    HAPPrecondition(context);
+    EnumeratedKeys* enumeratedKeys = context;
+    HAPPrecondition(keyValueStore_);
+    HAPPrecondition(domain == kPairingsDomain);
+    HAPPrecondition(shouldContinue);
+
+    HAPAssert(enumeratedKeys->numKeys < HAPArrayCount(enumeratedKeys->keys));
+    enumeratedKeys->keys[enumeratedKeys->numKeys++] = key;
+    return kHAPError_None;
+}
+
+/**
+ * Checks that the pairings are enumerated in the order of their controller identifiers, without flash accesses.
+ */
+static void CheckPairingEnumeration(const HAPPlatformKeyValueStoreKey* keys, size_t numKeys)
+{
+    HAPPlatformKeyValueStoreStatistics statistics = GetStatistics();
+    EnumeratedKeys enumeratedKeys = { .numKeys = 0 };
+    HAPError err = HAPPlatformKeyValueStoreEnumerate(&keyValueStore, kPairingsDomain, EnumerateKey, &enumeratedKeys);
+    HAPAssert(!err);
+    HAPAssert(enumeratedKeys.numKeys == numKeys);
+    HAPAssert(HAPRawBufferAreEqual(enumeratedKeys.keys, keys, numKeys * sizeof keys[0]));
+    HAPAssert(GetStatistics().numPairingTableHits == statistics.numPairingTableHits + 1);
+    HAPAssert(GetStatistics().numFlashReads == statistics.numFlashReads);
+    HAPAssert(GetStatistics().numFlashListings == statistics.numFlashListings);
+}
+
+/**
+ * The pairing table holds the pairings sorted by controller identifier, shortest first, and serves reads and
+ * enumerations of the pairings domain. A pairing that does not fit disables it until the next initialization.
+ */
+static void TestPairingTable(void)
+{
+    HAPLogInfo(&logObject, "%s", __func__);
+
+    static HAPPlatformKeyValueStorePairingEntry pairingEntries[8];
+    static const char* const identifiers[] = {
+        "", "A", "C", "AB", "B9", "BA", "ZZZ", "controller-1", "controller-2",
+        "11111111-2222-3333-4444-555555555555", "F1111111-2222-3333-4444-555555555555",
+    };
+
+    OpenEmpty(&(const HAPPlatformKeyValueStoreOptions) { .pairingEntries = pairingEntries,
+                                                          .numPairingEntries = HAPArrayCount(pairingEntries),
+                                                          .pairingsDomain = kPairingsDomain,
+                                                          .numPairingBytes = kNumPairingBytes });
+    SetPairing(0, "controller-2", 1);
+    SetPairing(1, "BA", 0);
+    SetPairing(2, "F1111111-2222-3333-4444-555555555555", 0);
+    SetPairing(3, "C", 1);
+    SetPairing(4, "controller-1", 0);
+    SetPairing(5, "AB", 0);
+    CheckPairingTable(identifiers, HAPArrayCount(identifiers));
+    CheckPairingEnumeration((const HAPPlatformKeyValueStoreKey[]) { 3, 5, 1, 4, 0, 2 }, 6);
+
+    // Reads are served from the pairing table.
+    HAPPlatformKeyValueStoreStatistics statistics = GetStatistics();
+    HAPAssert(HasPairing(2, "F1111111-2222-3333-4444-555555555555"));
+    HAPAssert(HasPairing(5, "AB"));
+    HAPAssert(!Exists(kPairingsDomain, 6));
+    HAPAssert(GetStatistics().numPairingTableHits == statistics.numPairingTableHits + 3);
+    HAPAssert(GetStatistics().numFlashReads == statistics.numFlashReads);
+
+    // Replacing a pairing moves it to the position of its new identifier.
+    SetPairing(1, "A", 1);
+    HAPError err = HAPPlatformKeyValueStoreRemove(&keyValueStore, kPairingsDomain, 4);
+    HAPAssert(!err);
+    CheckPairingTable(identifiers, HAPArrayCount(identifiers));
+    CheckPairingEnumeration((const HAPPlatformKeyValueStoreKey[]) { 1, 3, 5, 0, 2 }, 5);
+
+    // The pairing table is loaded from flash at initialization.
+    Open();
+    CheckPairingTable(identifiers, HAPArrayCount(identifiers));
+    CheckPairingEnumeration((const HAPPlatformKeyValueStoreKey[]) { 1, 3, 5, 0, 2 }, 5);
+    HAPAssert(HasPairing(1, "A"));
+    HAPAssert(!Exists(kPairingsDomain, 4));
+
+    // More pairings than entries disable the pairing table. Pairings are then read from flash.
+    SetPairing(8, "", 0);
+    SetPairing(9, "B9", 0);
+    SetPairing(10, "ZZZ", 0);
+    SetPairing(11, "11111111-2222-3333-4444-555555555555", 0);
+    HAPAssert(!keyValueStore.isPairingTableValid);
+    HAPAssert(HasPairing(8, ""));
+    HAPAssert(HasPairing(2, "F1111111-2222-3333-4444-555555555555"));
+    Open();
+    HAPAssert(!keyValueStore.isPairingTableValid);
+    HAPAssert(HasPairing(11, "11111111-2222-3333-4444-555555555555"));
+    err = HAPPlatformKeyValueStoreRemove(&keyValueStore, kPairingsDomain, 11);
+    HAPAssert(!err);
+    Open();
+    CheckPairingTable(identifiers, HAPArrayCount(identifiers));
+    CheckPairingEnumeration((const HAPPlatformKeyValueStoreKey[]) { 8, 1, 3, 5, 9, 10, 0, 2 }, 8);
+}
+
+static void StopRunLoop(HAPPlatformTimerRef timer, void* _Nullable context)
+{
+    (void) timer;
+    (void) context;
+    HAPPlatformRunLoopStop();
+}
+
+/**
+ * Runs the background work of the key-value store that is due now. Retries after failures are not run.
+ */
+static void RunBackgroundWork(void)
+{
+    HAPPlatformTimerRef timer;
+    HAPError err = HAPPlatformTimerRegister(&timer, HAPPlatformClockGetCurrent() + 10 * HAPSecond, StopRunLoop, NULL);
+    HAPAssert(!err);
+    HAPPlatformRunLoopRun();
+}
+
+/**
+ * Counts the files of a domain on flash, including the files of earlier generations.
+ */
+HAP_RESULT_USE_CHECK
+static size_t CountDomainFiles(HAPPlatformKeyValueStoreDomain domain)
+{
+    char path[PATH_MAX];
+    HAPError err = HAPStringWithFormat(path, sizeof path, "%s/%s", fileSystemDirectory, kRootDirectory);
+    HAPAssert(!err);
+    char prefix[4];
+    err = HAPStringWithFormat(prefix, sizeof prefix, "%02X.", domain);
+    HAPAssert(!err);
+
+    DIR* dir = opendir(path);
+    HAPAssert(dir);
+    size_t numFiles = 0;
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (HAPRawBufferAreEqual(entry->d_name, prefix, sizeof prefix - 1)) {
+            numFiles++;
+        }
+    }
+    closedir(dir);
+    return numFiles;
+}
+
+/**
+ * Checks whether the values of domain 0x90 have been purged. The value in domain 0x91 is not affected.
+ */
+HAP_RESULT_USE_CHECK
+static bool IsPurged(void)
+{
+    HAPAssert(HasValue(0x91, 0x01, 91, 16));
+    for (HAPPlatformKeyValueStoreKey key = 1; key <= 4; key++) {
+        if (Exists(0x90, key)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Checks whether all values of domain 0x90 are intact.
+ */
+HAP_RESULT_USE_CHECK
+static bool IsIntact(void)
+{
+    HAPAssert(HasValue(0x91, 0x01, 91, 16));
+    for (HAPPlatformKeyValueStoreKey key = 1; key <= 4; key++) {
+        if (!HasValue(0x90, key, key, 32)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Longest time for which a step of the removal of files of earlier generations may block the run loop.
+ */
+#define kMaxCollectionStepDuration ((HAPTime)(64 * HAPMillisecond))
+
+/**
+ * Steps of the background work, measured by a probe timer that runs between them.
+ */
+static struct {
+    HAPTime lastProbeTime;
+    HAPTime maxStepDuration;
+    size_t numSteps;
+} backgroundSteps;
+
+static void ProbeBackgroundStep(HAPPlatformTimerRef timer, void* _Nullable context)
+{
+    (void) timer;
+    (void) context;
+
+    HAPTime now = HAPPlatformClockGetCurrent();
+    HAPTime duration = now - backgroundSteps.lastProbeTime;
+    backgroundSteps.lastProbeTime = now;
+    if (!duration) {
+        // No step ran since the last probe.
+        return;
+    }
+    backgroundSteps.numSteps++;
+    backgroundSteps.maxStepDuration = HAPMax(backgroundSteps.maxStepDuration, duration);
+
+    // A timer that is due now fires after the timers that are already due, i.e., after the next step.
+    HAPPlatformTimerRef nextTimer;
+    HAPError err = HAPPlatformTimerRegister(&nextTimer, 0, ProbeBackgroundStep, NULL);
+    HAPAssert(!err);
+}
+
+/**
+ * Runs the background work of the key-value store that is due now, and measures its steps. The work must have been
+ * scheduled already.
+ */
+static void RunBackgroundWorkSteps(void)
+{
+    HAPRawBufferZero(&backgroundSteps, sizeof backgroundSteps);
+    backgroundSteps.lastProbeTime = HAPPlatformClockGetCurrent();
+    HAPPlatformTimerRef timer;
+    HAPError err = HAPPlatformTimerRegister(&timer, 0, ProbeBackgroundStep, NULL);
+    HAPAssert(!err);
+    RunBackgroundWork();
+}
+
+static const TestValue purgeValues[] = {
+    { 0x90, 0x01, 1, 32 }, { 0x90, 0x02, 2, 32 }, { 0x90, 0x03, 3, 32 }, { 0x90, 0x04, 4, 32 }, { 0x91, 0x01, 91, 16 },
+};
+
+/**
+ * Purging a domain advances its generation with a single flash write, and the files of the earlier generation are
+ * removed in the background. Power cuts purge the domain completely or not at all, and leave no files behind once the
+ * background work has run. Generations are not reused while files of earlier generations remain.
+ */
+static void TestPurgeGenerations(void)
+{
+    HAPLogInfo(&logObject, "%s", __func__);
+
+    const HAPPlatformKeyValueStoreOptions options = { .numCacheEntries = 0 };
+
+    // The purge takes effect at once, and the files are removed in the background.
+    OpenWithValues(&options, purgeValues, HAPArrayCount(purgeValues));
+    HAPPlatformKeyValueStoreStatistics statistics = GetStatistics();
+    HAPError err = HAPPlatformKeyValueStorePurgeDomain(&keyValueStore, 0x90);
+    HAPAssert(!err);
+    HAPAssert(GetStatistics().numBulkPurges == statistics.numBulkPurges + 1);
+    HAPAssert(GetStatistics().numFlashRemoves == statistics.numFlashRemoves);
+    HAPAssert(IsPurged());
+    SetValue(0x90, 0x02, 20, 8);
+    Open();
+    HAPAssert(HasValue(0x90, 0x02, 20, 8));
+    HAPAssert(!Exists(0x90, 0x01));
+    HAPAssert(CountDomainFiles(0x90) == 5);
+    RunBackgroundWork();
+    HAPAssert(GetStatistics().numStaleFilesRemoved == 4);
+    HAPAssert(CountDomainFiles(0x90) == 1);
+    HAPAssert(HasValue(0x90, 0x02, 20, 8));
+
+    // Power cuts during the purge and during the removal of the files.
+    OpenWithValues(&options, purgeValues, HAPArrayCount(purgeValues));
+    SchedulePowerCut(-1);
+    err = HAPPlatformKeyValueStorePurgeDomain(&keyValueStore, 0x90);
+    HAPAssert(!err);
+    RunBackgroundWork();
+    long numOperations = powerCut.numOperations;
+    size_t numPurged = 0;
+    for (long cutAt = 1; cutAt <= numOperations; cutAt++) {
+        OpenWithValues(&options, purgeValues, HAPArrayCount(purgeValues));
+        SchedulePowerCut(cutAt);
+        (void) HAPPlatformKeyValueStorePurgeDomain(&keyValueStore, 0x90);
+        RunBackgroundWork();
+        Restart();
+
+        bool isPurged = IsPurged();
+        HAPAssert(isPurged || IsIntact());
+        if (isPurged) {
+            numPurged++;
+        }
+        RunBackgroundWork();
+        HAPAssert(CountDomainFiles(0x90) == (isPurged ? 0 : 4));
+        Open();
+        HAPAssert(isPurged ? IsPurged() : IsIntact());
+    }
+    HAPLogInfo(&logObject, "%ld power cuts, domain purged after %zu.", numOperations, numPurged);
+    HAPAssert(numPurged && numPurged < (size_t) numOperations);
+
+    // Domains beyond the generation table are purged by removing their files.
+    OpenEmpty(&options);
+    for (HAPPlatformKeyValueStoreDomain domain = 0x10; domain < 0x1A; domain++) {
+        SetValue(domain, 0x01, domain, 4);
+    }
+    for (HAPPlatformKeyValueStoreDomain domain = 0x10; domain < 0x1A; domain++) {
+        err = HAPPlatformKeyValueStorePurgeDomain(&keyValueStore, domain);
+        HAPAssert(!err);
+    }
+    HAPAssert(GetStatistics().numBulkPurges == kHAPPlatformKeyValueStore_MaxDomainGenerations);
+    Open();
+    for (HAPPlatformKeyValueStoreDomain domain = 0x10; domain < 0x1A; domain++) {
+        HAPAssert(!Exists(domain, 0x01));
+    }
+
+    // Generations wrap around only once the files of earlier generations have been removed.
+    OpenEmpty(&options);
+    for (int i = 0; i < 600; i++) {
+        SetValue(0x90, 0x01, (uint8_t) i, 2);
+        SetValue(0x90, 0x02, (uint8_t) i, 2);
+        err = HAPPlatformKeyValueStorePurgeDomain(&keyValueStore, 0x90);
+        HAPAssert(!err);
+        SetValue(0x90, 0x02, (uint8_t)(i + 1), 2);
+        if (i >= 300) {
+            RunBackgroundWork();
+        }
+        if (i % 50 == 0) {
+            Open();
+        }
+        HAPAssert(!Exists(0x90, 0x01));
+        HAPAssert(HasValue(0x90, 0x02, (uint8_t)(i + 1), 2));
+    }
+    RunBackgroundWork();
+    HAPAssert(CountDomainFiles(0x90) == 1);
+
+    // With flash latency, the purge takes the same time for any number of values. The files are removed in steps
+    // that each block the run loop for a bounded time.
+    HAPTime purgeDurations[2];
+    const size_t numValues[HAPArrayCount(purgeDurations)] = { 4, 32 };
+    for (size_t i = 0; i < HAPArrayCount(purgeDurations); i++) {
+        OpenEmpty(&options);
+        for (size_t key = 0; key < numValues[i]; key++) {
+            SetValue(0x90, (HAPPlatformKeyValueStoreKey) key, (uint8_t) key, 32);
+        }
+        SimpleLinkFSCreate(&(const SimpleLinkFSOptions) { .rootDirectory = fileSystemDirectory,
+                                                          .commandLatency = kCommandLatency,
+                                                          .commitLatency = kCommitLatency });
+
+        HAPTime startTime = HAPPlatformClockGetCurrent();
+        err = HAPPlatformKeyValueStorePurgeDomain(&keyValueStore, 0x90);
+        HAPAssert(!err);
+        purgeDurations[i] = HAPPlatformClockGetCurrent() - startTime;
+        statistics = GetStatistics();
+        RunBackgroundWorkSteps();
+        HAPAssert(GetStatistics().numStaleFilesRemoved - statistics.numStaleFilesRemoved == numValues[i]);
+        HAPAssert(CountDomainFiles(0x90) == 0);
+
+        HAPLogInfo(
+                &logObject,
+                "%zu values: purged in %llu ms, removed in %zu steps of at most %llu ms.",
+                numValues[i],
+                (unsigned long long) purgeDurations[i],
+                backgroundSteps.numSteps,
+                (unsigned long long) backgroundSteps.maxStepDuration);
+        HAPAssert(purgeDurations[i] <= kMaxCollectionStepDuration);
+        HAPAssert(backgroundSteps.numSteps > numValues[i] / 4);
+        HAPAssert(backgroundSteps.maxStepDuration <= kMaxCollectionStepDuration);
+
+        SimpleLinkFSCreate(&(const SimpleLinkFSOptions) { .rootDirectory = fileSystemDirectory });
+    }
+    HAPAssert(purgeDurations[1] == purgeDurations[0]);
+}
+
+/**
+ * Sets a new version of a value in the log, and cuts the power at each operation that changes flash. After the
+ * restart, the new or the previous version is in effect, other values are intact, and further writes take effect.
+ *
+ * @param      options              Initialization options. Must configure the log.
+ * @param      numVersions          Number of earlier versions of the value that are set before the new version.
+ * @param      numBytes             Length of the value.
+ *
+ * @return Number of power cuts that left a torn record at the tail of the log.
+ */
+HAP_RESULT_USE_CHECK
+static size_t CutPowerDuringLogWrite(
+        const HAPPlatformKeyValueStoreOptions* options,
+        uint8_t numVersions,
+        size_t numBytes)
+{
+    HAPPrecondition(options->numLogIndexEntries);
+    HAPPrecondition(numVersions);
+    HAPPrecondition(numBytes <= kMaxValueBytes);
+
+    uint8_t version = (uint8_t)(numVersions + 1);
+    uint8_t bytes[kMaxValueBytes];
+    for (size_t i = 0; i < numBytes; i++) {
+        bytes[i] = (uint8_t)(version + i);
+    }
+
+    // The first pass counts the operations of the write.
+    long numOperations = 0;
+    size_t numApplied = 0;
+    size_t numTorn = 0;
+    for (long cutAt = 0; cutAt <= numOperations; cutAt++) {
+        OpenEmpty(options);
+        SetValue(0x51, 0x01, 51, 8);
+        for (uint8_t i = 1; i <= numVersions; i++) {
+            SetValue(0x50, 0x01, i, numBytes);
+        }
+        SchedulePowerCut(cutAt ? cutAt : -1);
+        HAPError err = HAPPlatformKeyValueStoreSet(&keyValueStore, 0x50, 0x01, bytes, numBytes);
+        if (!cutAt) {
+            HAPAssert(!err);
+            numOperations = powerCut.numOperations;
+            continue;
+        }
+        Restart();
+
+        // The log is compacted at initialization only if it ends with a torn record.
+        if (GetStatistics().numLogCompactions) {
+            numTorn++;
+        }
+        bool isApplied = HasValue(0x50, 0x01, version, numBytes);
+        HAPAssert(isApplied || HasValue(0x50, 0x01, numVersions, numBytes));
+        if (isApplied) {
+            numApplied++;
+        }
+        HAPAssert(HasValue(0x51, 0x01, 51, 8));
+
+        SetValue(0x52, 0x01, 52, 8);
+        Open();
+        HAPAssert(HasValue(0x52, 0x01, 52, 8));
+        HAPAssert(HasValue(0x50, 0x01, isApplied ? version : numVersions, numBytes));
+        HAPAssert(HasValue(0x51, 0x01, 51, 8));
+    }
+    HAPLogInfo(
+            &logObject,
+            "%ld power cuts, value written after %zu, torn record after %zu.",
+            numOperations,
+            numApplied,
+            numTorn);
+    HAPAssert(numApplied && numApplied < (size_t) numOperations);
+    return numTorn;
+}
+
+/**
+ * The log takes a write completely or not at all when the power is cut at any point, including a compaction that the
+ * write triggers. A torn record at the tail of the log is dropped, and later records are appended after the last
+ * valid one. A batch of a transaction takes effect as a whole.
+ */
+static void TestLogPowerCut(void)
+{
+    HAPLogInfo(&logObject, "%s", __func__);
+
+    static HAPPlatformKeyValueStoreLogIndexEntry logIndexEntries[16];
+    static HAPPlatformKeyValueStoreOperation transactionOperations[8];
+    static uint8_t transactionBytes[512];
+
+    HAPPlatformKeyValueStoreOptions options = {
+        .logIndexEntries = logIndexEntries,
+        .numLogIndexEntries = HAPArrayCount(logIndexEntries),
+        .logFileSize = 1024,
+        .transactionOperations = transactionOperations,
+        .maxTransactionOperations = HAPArrayCount(transactionOperations),
+        .transactionBytes = transactionBytes,
+        .maxTransactionBytes = sizeof transactionBytes
+    };
+
+    // Records are appended at the tail of the log. Half of a write reaches flash when the power is cut.
+    size_t numTorn = CutPowerDuringLogWrite(&options, /* numVersions: */ 1, /* numBytes: */ 64);
+    HAPAssert(numTorn);
+
+    // The record does not fit: the log is compacted first. The previous log file remains in effect until the
+    // compacted one is complete.
+    options.logFileSize = 300;
+    numTorn = CutPowerDuringLogWrite(&options, /* numVersions: */ 5, /* numBytes: */ 40);
+    HAPAssert(numTorn);
+
+    // A transaction is appended as a single batch record.
+    options.logFileSize = 1024;
+    OpenWithValues(&options, journalValuesBefore, HAPArrayCount(journalValuesBefore));
+    SchedulePowerCut(-1);
+    HAPError err = CommitJournalTransaction();
+    HAPAssert(!err);
+    long numOperations = powerCut.numOperations;
+    size_t numApplied = 0;
+    for (long cutAt = 1; cutAt <= numOperations; cutAt++) {
+        OpenWithValues(&options, journalValuesBefore, HAPArrayCount(journalValuesBefore));
+        SchedulePowerCut(cutAt);
+        err = CommitJournalTransaction();
+        HAPAssert(err);
+        Restart();
+
+        bool isApplied = HasValues(journalValuesAfter, HAPArrayCount(journalValuesAfter));
+        HAPAssert(isApplied || HasValues(journalValuesBefore, HAPArrayCount(journalValuesBefore)));
+        if (isApplied) {
+            numApplied++;
+        }
+        SetValue(0x40, 0x01, 5, 4);
+        Open();
+        HAPAssert(HasValue(0x40, 0x01, 5, 4));
+        HAPAssert(HasValues(
+                isApplied ? journalValuesAfter : journalValuesBefore,
+                isApplied ? HAPArrayCount(journalValuesAfter) : HAPArrayCount(journalValuesBefore)));
+    }
+    HAPLogInfo(&logObject, "%ld power cuts, batch applied after %zu.", numOperations, numApplied);
+    HAPAssert(numApplied && numApplied < (size_t) numOperations);
+}
+
+/**
+ * Magic numbers of the log file headers. Mirror HAPPlatformKeyValueStoreLog.c.
+ */
+#define kLogMagic      ((uint32_t) 0x4C53564B)
+#define kLogPurgeMagic ((uint32_t) 0x3253564B)
+
+/**
+ * Reads the magic number of a log file.
+ */
+HAP_RESULT_USE_CHECK
+static uint32_t GetLogFileMagic(uint8_t file)
+{
+    char fileName[SL_FS_MAX_FILE_NAME_LENGTH];
+    HAPError err = HAPStringWithFormat(fileName, sizeof fileName, "%s/log%u", kRootDirectory, file);
+    HAPAssert(!err);
+    _i32 fileHandle = sl_FsOpen((const _u8*) fileName, SL_FS_READ, NULL);
+    HAPAssert(fileHandle >= 0);
+    uint8_t magic[4];
+    _i32 numBytes = sl_FsRead(fileHandle, 0, magic, sizeof magic);
+    HAPAssert(numBytes == (_i32) sizeof magic);
+    _i16 rc = sl_FsClose(fileHandle, NULL, NULL, 0);
+    HAPAssert(!rc);
+    return HAPReadLittleUInt32(magic);
+}
+
+/**
+ * Before the first purge record, the log is compacted into a log file whose header firmware without purge records
+ * rejects. The other log file keeps the previous header, and later purges and compactions keep the new one. Power cuts
+ * purge the domain completely or not at all.
+ */
+static void TestLogPurgeFormat(void)
+{
+    HAPLogInfo(&logObject, "%s", __func__);
+
+    static HAPPlatformKeyValueStoreLogIndexEntry logIndexEntries[16];
+    const HAPPlatformKeyValueStoreOptions options = { .logIndexEntries = logIndexEntries,
+                                                      .numLogIndexEntries = HAPArrayCount(logIndexEntries),
+                                                      .logFileSize = 1024 };
+
+    OpenWithValues(&options, purgeValues, HAPArrayCount(purgeValues));
+    uint8_t activeFile = keyValueStore.log.activeFile;
+    HAPAssert(GetLogFileMagic(activeFile) == kLogMagic);
+
+    uint64_t numLogCompactions = GetStatistics().numLogCompactions;
+    HAPError err = HAPPlatformKeyValueStorePurgeDomain(&keyValueStore, 0x90);
+    HAPAssert(!err);
+    HAPAssert(IsPurged());
+    HAPAssert(GetStatistics().numLogCompactions == numLogCompactions + 1);
+    HAPAssert(keyValueStore.log.activeFile != activeFile);
+    HAPAssert(GetLogFileMagic(keyValueStore.log.activeFile) == kLogPurgeMagic);
+    HAPAssert(GetLogFileMagic(activeFile) == kLogMagic);
+
+    // Later purges append a single record.
+    SetValue(0x90, 0x01, 1, 32);
+    err = HAPPlatformKeyValueStorePurgeDomain(&keyValueStore, 0x90);
+    HAPAssert(!err);
+    HAPAssert(GetStatistics().numLogCompactions == numLogCompactions + 1);
+    Open();
+    HAPAssert(IsPurged());
+    err = HAPPlatformKeyValueStoreLogCompact(&keyValueStore.log);
+    HAPAssert(!err);
+    HAPAssert(GetLogFileMagic(keyValueStore.log.activeFile) == kLogPurgeMagic);
+
+    // Power cuts during the first purge.
+    OpenWithValues(&options, purgeValues, HAPArrayCount(purgeValues));
+    SchedulePowerCut(-1);
+    err = HAPPlatformKeyValueStorePurgeDomain(&keyValueStore, 0x90);
+    HAPAssert(!err);
+    long numOperations = powerCut.numOperations;
+    size_t numPurged = 0;
+    for (long cutAt = 1; cutAt <= numOperations; cutAt++) {
+        OpenWithValues(&options, purgeValues, HAPArrayCount(purgeValues));
+        SchedulePowerCut(cutAt);
+        (void) HAPPlatformKeyValueStorePurgeDomain(&keyValueStore, 0x90);
+        Restart();
+
+        bool isPurged = IsPurged();
+        HAPAssert(isPurged || IsIntact());
+        if (isPurged) {
+            numPurged++;
+            HAPAssert(GetLogFileMagic(keyValueStore.log.activeFile) == kLogPurgeMagic);
+        }
+        err = HAPPlatformKeyValueStorePurgeDomain(&keyValueStore, 0x90);
+        HAPAssert(!err);
+        Open();
+        HAPAssert(IsPurged());
+    }
+    HAPLogInfo(&logObject, "%ld power cuts, domain purged after %zu.", numOperations, numPurged);
+    HAPAssert(numPurged && numPurged < (size_t) numOperations);
+}
+
+/**
+ * A value as it is read by HAP or the app.
+ */
+typedef struct {
+    HAPPlatformKeyValueStoreDomain domain;
+    HAPPlatformKeyValueStoreKey key;
+    size_t numBytes; /**< Stored length. */
+    size_t maxBytes; /**< Size of the buffer into which the value is read. */
+} TestRead;
+
+/**
+ * Reads with HAP's key sizes.
+ */
+static const TestRead hapReads[] = {
+    { 0x40, 0x10, 400, 400 }, // Setup info: salt and SRP verifier.
+    { 0x90, 0x20, 4, 4 },     // Configuration number.
+    { 0x90, 0x21, 32, 32 },   // Long-term secret key.
+    { 0xA0, 0x00, 70, 70 },   // Pairing: identifier, public key and permissions.
+    { 0x00, 0x00, 16, 16 },   // App state.
+    { 0x00, 0x01, 5, 16 },    // App state saved by an earlier version with fewer fields.
+    { 0x40, 0x21, 33, 128 },  // Software token, read into a buffer of the maximum token size.
+};
+
+/**
+ * Reads transfer only the stored bytes, whatever the size of the buffer. Size queries transfer no bytes and open no
+ * files, and reads of missing values open no files.
+ *
+ * @param      options              Initialization options.
+ */
+static void CheckBytesPerRead(const HAPPlatformKeyValueStoreOptions* options)
+{
+    OpenEmpty(options);
+    uint8_t bytes[512];
+    for (size_t i = 0; i < HAPArrayCount(hapReads); i++) {
+        const TestRead* read = &hapReads[i];
+        HAPAssert(read->maxBytes <= sizeof bytes);
+        for (size_t j = 0; j < read->numBytes; j++) {
+            bytes[j] = (uint8_t)(i + j);
+        }
+        HAPError err = HAPPlatformKeyValueStoreSet(&keyValueStore, read->domain, read->key, bytes, read->numBytes);
+        HAPAssert(!err);
+    }
+    Open();
+
+    for (size_t i = 0; i < HAPArrayCount(hapReads); i++) {
+        const TestRead* read = &hapReads[i];
+        SimpleLinkFSStatistics fileSystemStatistics;
+        SimpleLinkFSGetStatistics(&fileSystemStatistics);
+        HAPPlatformKeyValueStoreStatistics statistics = GetStatistics();
+
+        size_t numBytes;
+        bool found;
+        HAPError err = HAPPlatformKeyValueStoreGetSize(&keyValueStore, read->domain, read->key, &numBytes, &found);
+        HAPAssert(!err);
+        HAPAssert(found && numBytes == read->numBytes);
+        SimpleLinkFSStatistics newFileSystemStatistics;
+        SimpleLinkFSGetStatistics(&newFileSystemStatistics);
+        HAPAssert(newFileSystemStatistics.numBytesRequested == fileSystemStatistics.numBytesRequested);
+        HAPAssert(newFileSystemStatistics.numOpens == fileSystemStatistics.numOpens);
+
+        err = HAPPlatformKeyValueStoreGet(
+                &keyValueStore, read->domain, read->key, bytes, read->maxBytes, &numBytes, &found);
+        HAPAssert(!err);
+        HAPAssert(found && numBytes == read->numBytes);
+        for (size_t j = 0; j < numBytes; j++) {
+            HAPAssert(bytes[j] == (uint8_t)(i + j));
+        }
+        SimpleLinkFSGetStatistics(&newFileSystemStatistics);
+        HAPAssert(newFileSystemStatistics.numBytesRequested - fileSystemStatistics.numBytesRequested == read->numBytes);
+        HAPAssert(GetStatistics().numFlashBytesRead - statistics.numFlashBytesRead == read->numBytes);
+    }
+
+    // Missing values are not opened.
+    SimpleLinkFSStatistics fileSystemStatistics;
+    SimpleLinkFSGetStatistics(&fileSystemStatistics);
+    HAPAssert(!Exists(0x90, 0x22));
+    SimpleLinkFSStatistics newFileSystemStatistics;
+    SimpleLinkFSGetStatistics(&newFileSystemStatistics);
+    HAPAssert(newFileSystemStatistics.numOpens == fileSystemStatistics.numOpens);
+    HAPAssert(newFileSystemStatistics.numBytesRequested == fileSystemStatistics.numBytesRequested);
+}
+
+/**
+ * Reads with HAP's key sizes transfer only the stored bytes, with a file per value and with the log.
+ */
+static void TestBytesPerRead(void)
+{
+    HAPLogInfo(&logObject, "%s", __func__);
+
+    CheckBytesPerRead(&(const HAPPlatformKeyValueStoreOptions) { 0 });
+
+    static HAPPlatformKeyValueStoreLogIndexEntry logIndexEntries[16];
+    CheckBytesPerRead(&(const HAPPlatformKeyValueStoreOptions) { .logIndexEntries = logIndexEntries,
+                                                                 .numLogIndexEntries = HAPArrayCount(logIndexEntries),
+                                                                 .logFileSize = 2048 });
+}
+
+/**
+ * Gets the number of file system commands so far.
+ */
+HAP_RESULT_USE_CHECK
+static uint64_t GetNumCommands(void)
+{
+    SimpleLinkFSStatistics statistics;
+    SimpleLinkFSGetStatistics(&statistics);
+    return statistics.numOpens + statistics.numReads + statistics.numWrites + statistics.numDeletes +
+           statistics.numGetInfos + statistics.numGetFileLists;
+}
+
+/**
+ * Initializes the key-value store with the values of hapReads, and reads them as during startup, with a latency per
+ * file system command.
+ *
+ * @param      options              Initialization options.
+ * @param[out] duration             Time from initialization until the last read.
+ * @param[out] numCommands          Number of file system commands from initialization until the last read, not
+ *                                  counting closes.
+ */
+static void MeasureStartupReads(
+        const HAPPlatformKeyValueStoreOptions* options,
+        HAPTime* duration,
+        uint64_t* numCommands)
+{
+    OpenEmpty(options);
+    uint8_t bytes[512];
+    for (size_t i = 0; i < HAPArrayCount(hapReads); i++) {
+        const TestRead* read = &hapReads[i];
+        for (size_t j = 0; j < read->numBytes; j++) {
+            bytes[j] = (uint8_t)(i + j);
+        }
+        HAPError err = HAPPlatformKeyValueStoreSet(&keyValueStore, read->domain, read->key, bytes, read->numBytes);
+        HAPAssert(!err);
+    }
+    SimpleLinkFSCreate(&(const SimpleLinkFSOptions) { .rootDirectory = fileSystemDirectory,
+                                                      .commandLatency = kCommandLatency,
+                                                      .commitLatency = kCommitLatency });
+
+    HAPTime startTime = HAPPlatformClockGetCurrent();
+    uint64_t numStartCommands = GetNumCommands();
+    Open();
+    HAPPlatformKeyValueStoreStatistics statistics = GetStatistics();
+    uint64_t numOpenCommands = GetNumCommands();
+
+    // HAP, the software token provider and the app read their keys separately, and most of them more than once.
+    for (size_t n = 0; n < 2; n++) {
+        for (size_t i = 0; i < HAPArrayCount(hapReads); i++) {
+            const TestRead* read = &hapReads[i];
+            size_t numBytes;
+            bool found;
+            HAPError err = HAPPlatformKeyValueStoreGet(
+                    &keyValueStore, read->domain, read->key, bytes, read->maxBytes, &numBytes, &found);
+            HAPAssert(!err);
+            HAPAssert(found && numBytes == read->numBytes);
+            HAPAssert(bytes[0] == (uint8_t) i);
+        }
+    }
+    *duration = HAPPlatformClockGetCurrent() - startTime;
+    *numCommands = GetNumCommands() - numStartCommands;
+
+    // Preloaded values are read without flash access.
+    if (options->preloadBytes) {
+        HAPAssert(GetNumCommands() == numOpenCommands);
+        HAPAssert(GetStatistics().numPreloadHits - statistics.numPreloadHits == 2 * HAPArrayCount(hapReads));
+    }
+
+    SimpleLinkFSCreate(&(const SimpleLinkFSOptions) { .rootDirectory = fileSystemDirectory });
+}
+
+/**
+ * Preloading the values at initialization shortens startup when each file system command takes time, with a file
+ * per value and with the log.
+ */
+static void TestPreloadLatency(void)
+{
+    HAPLogInfo(&logObject, "%s", __func__);
+
+    static uint8_t preloadBytes[1536];
+    static HAPPlatformKeyValueStoreLogIndexEntry logIndexEntries[16];
+    static const struct {
+        const char* name;
+        HAPPlatformKeyValueStoreOptions options;
+    } layouts[] = {
+        { "per-file", { 0 } },
+        { "log",
+          { .logIndexEntries = logIndexEntries,
+            .numLogIndexEntries = HAPArrayCount(logIndexEntries),
+            .logFileSize = 2048 } },
+    };
+    for (size_t i = 0; i < HAPArrayCount(layouts); i++) {
+        HAPTime duration;
+        uint64_t numCommands;
+        MeasureStartupReads(&layouts[i].options, &duration, &numCommands);
+
+        HAPPlatformKeyValueStoreOptions options = layouts[i].options;
+        options.preloadBytes = preloadBytes;
+        options.maxPreloadBytes = sizeof preloadBytes;
+        HAPTime preloadDuration;
+        uint64_t numPreloadCommands;
+        MeasureStartupReads(&options, &preloadDuration, &numPreloadCommands);
+
+        HAPLogInfo(
+                &logObject,
+                "%s: %llu ms / %llu commands -> %llu ms / %llu commands with preload.",
+                layouts[i].name,
+                (unsigned long long) duration,
+                (unsigned long long) numCommands,
+                (unsigned long long) preloadDuration,
+                (unsigned long long) numPreloadCommands);
+        HAPAssert(numPreloadCommands < numCommands);
+        HAPAssert(preloadDuration < duration);
+    }
+}
+
+int main()
+{
+    char* directory = mkdtemp(fileSystemDirectory);
+    HAPAssert(directory);
+
+    // Background work of the key-value store runs on the run loop, with timers that fire without delay.
+    HAPPlatformClockEnableVirtualTime(HAPPlatformClockGetCurrent());
+    HAPPlatformRunLoopCreate(&(const HAPPlatformRunLoopOptions) { .keyValueStore = &keyValueStore });
+
+    TestCacheEviction();
+    TestJournalReplay();
+    TestPairingTable();
+    TestPurgeGenerations();
+    TestLogPowerCut();
+    TestLogPurgeFormat();
+    TestBytesPerRead();
+    TestPreloadLatency();
+
+    HAPPlatformRunLoopRelease();
+
+    RemoveDirectory(fileSystemDirectory);
+    return 0;
+}
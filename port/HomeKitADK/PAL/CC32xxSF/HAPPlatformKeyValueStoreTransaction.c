@@ -0,0 +1,336 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+#include "HAPPlatformKeyValueStore+Init.h"
+
+static const HAPLogObject logObject = { .subsystem = kHAPPlatform_LogSubsystem, .category = "KeyValueStore" };
+
+HAPPlatformKeyValueStoreOperation* _Nullable HAPPlatformKeyValueStoreFindTransactionOperation(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain,
+        HAPPlatformKeyValueStoreKey key) {
+    HAPPrecondition(keyValueStore);
+    HAPPrecondition(keyValueStore->isTransactionActive);
+
+    for (size_t i = 0; i < keyValueStore->numTransactionOperations; i++) {
+        HAPPlatformKeyValueStoreOperation* operation = &keyValueStore->transactionOperations[i];
+        if (!operation->isPurge && operation->domain == domain && operation->key == key) {
+            return operation;
+        }
+    }
+    return NULL;
+}
+
+HAP_RESULT_USE_CHECK
+bool HAPPlatformKeyValueStoreIsPurgedByTransaction(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain) {
+    HAPPrecondition(keyValueStore);
+    HAPPrecondition(keyValueStore->isTransactionActive);
+
+    for (size_t i = 0; i < keyValueStore->numTransactionOperations; i++) {
+        const HAPPlatformKeyValueStoreOperation* operation = &keyValueStore->transactionOperations[i];
+        if (operation->isPurge && operation->domain == domain) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Drops a staged operation and its value from the active transaction.
+ *
+ * @param      keyValueStore        Key-value store.
+ * @param      operation            Staged operation.
+ */
+static void DropTransactionOperation(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreOperation* operation) {
+    HAPPrecondition(keyValueStore);
+    HAPPrecondition(operation);
+
+    keyValueStore->statistics.numTransactionOperationsCoalesced++;
+    size_t index = (size_t)(operation - keyValueStore->transactionOperations);
+    if (operation->numBytes) {
+        size_t offset = (size_t)((const uint8_t*) operation->bytes - keyValueStore->transactionBytes);
+        size_t numDroppedBytes = operation->numBytes;
+        HAPRawBufferCopyBytes(
+                &keyValueStore->transactionBytes[offset],
+                &keyValueStore->transactionBytes[offset + numDroppedBytes],
+                keyValueStore->numTransactionBytes - offset - numDroppedBytes);
+        keyValueStore->numTransactionBytes -= numDroppedBytes;
+        for (size_t i = index + 1; i < keyValueStore->numTransactionOperations; i++) {
+            HAPPlatformKeyValueStoreOperation* laterOperation = &keyValueStore->transactionOperations[i];
+            if (laterOperation->numBytes) {
+                laterOperation->bytes = (const uint8_t*) laterOperation->bytes - numDroppedBytes;
+            }
+        }
+    }
+    HAPRawBufferCopyBytes(
+            operation, operation + 1, (keyValueStore->numTransactionOperations - index - 1) * sizeof *operation);
+    keyValueStore->numTransactionOperations--;
+}
+
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformKeyValueStoreStageOperation(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain,
+        HAPPlatformKeyValueStoreKey key,
+        const void* _Nullable bytes,
+        size_t numBytes,
+        bool isRemove,
+        bool isPurge) {
+    HAPPrecondition(keyValueStore);
+    HAPPrecondition(keyValueStore->isTransactionActive);
+    HAPPrecondition(!numBytes || bytes);
+    HAPPrecondition(!isRemove || !numBytes);
+    HAPPrecondition(!isPurge || (isRemove && !key));
+
+    if (keyValueStore->isTransactionFailed) {
+        return kHAPError_Unknown;
+    }
+
+    HAPPlatformKeyValueStoreOperation* _Nullable operation;
+    if (isPurge) {
+        for (size_t i = keyValueStore->numTransactionOperations; i-- > 0;) {
+            operation = &keyValueStore->transactionOperations[i];
+            if (operation->domain == domain) {
+                DropTransactionOperation(keyValueStore, operation);
+            }
+        }
+    } else {
+        operation = HAPPlatformKeyValueStoreFindTransactionOperation(keyValueStore, domain, key);
+        if (operation) {
+            DropTransactionOperation(keyValueStore, operation);
+        }
+    }
+
+    if (keyValueStore->numTransactionOperations == keyValueStore->maxTransactionOperations ||
+        numBytes > keyValueStore->maxTransactionBytes - keyValueStore->numTransactionBytes) {
+        HAPLogError(&logObject, "Transaction too large. Operation on %02X.%02X not staged.", domain, key);
+        keyValueStore->isTransactionFailed = true;
+        return kHAPError_Unknown;
+    }
+
+    operation = &keyValueStore->transactionOperations[keyValueStore->numTransactionOperations++];
+    HAPRawBufferZero(operation, sizeof *operation);
+    if (numBytes) {
+        uint8_t* stagedBytes = &keyValueStore->transactionBytes[keyValueStore->numTransactionBytes];
+        HAPRawBufferCopyBytes(stagedBytes, HAPNonnullVoid(bytes), numBytes);
+        keyValueStore->numTransactionBytes += numBytes;
+        operation->bytes = stagedBytes;
+    }
+    operation->numBytes = numBytes;
+    operation->domain = domain;
+    operation->key = key;
+    operation->isRemove = isRemove;
+    operation->isPurge = isPurge;
+    return kHAPError_None;
+}
+
+static void EndTransaction(HAPPlatformKeyValueStoreRef keyValueStore) {
+    HAPPrecondition(keyValueStore);
+
+    keyValueStore->numTransactionOperations = 0;
+    keyValueStore->numTransactionBytes = 0;
+    keyValueStore->isTransactionActive = false;
+    keyValueStore->isTransactionFailed = false;
+}
+
+void HAPPlatformKeyValueStoreBeginTransaction(HAPPlatformKeyValueStoreRef keyValueStore) {
+    HAPPrecondition(keyValueStore);
+    HAPPrecondition(keyValueStore->transactionOperations);
+    HAPPrecondition(!keyValueStore->isTransactionActive);
+
+    // Operations cannot be staged while the journal of a failed transaction is pending.
+    HAPError err = HAPPlatformKeyValueStoreApplyPendingJournal(keyValueStore);
+    if (err) {
+        HAPAssert(err == kHAPError_Unknown);
+        keyValueStore->isTransactionFailed = true;
+    }
+    keyValueStore->isTransactionActive = true;
+}
+
+void HAPPlatformKeyValueStoreAbortTransaction(HAPPlatformKeyValueStoreRef keyValueStore) {
+    HAPPrecondition(keyValueStore);
+    HAPPrecondition(keyValueStore->isTransactionActive);
+
+    EndTransaction(keyValueStore);
+}
+
+/**
+ * Writes the operations of the active transaction to the value files, without a journal.
+ *
+ * - Writing the operations again has the same result.
+ *
+ * @param      keyValueStore        Key-value store.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_Unknown        If the file access failed.
+ */
+HAP_RESULT_USE_CHECK
+static HAPError ApplyTransaction(HAPPlatformKeyValueStoreRef keyValueStore) {
+    HAPPrecondition(keyValueStore);
+    HAPPrecondition(keyValueStore->transactionOperations);
+
+    HAPError err;
+
+    bool isGenerationAdvanced = false;
+    for (size_t i = 0; i < keyValueStore->numTransactionOperations; i++) {
+        const HAPPlatformKeyValueStoreOperation* operation = &keyValueStore->transactionOperations[i];
+        if (operation->isPurge) {
+            err = HAPPlatformKeyValueStorePurgeDomainFiles(keyValueStore, operation->domain, &isGenerationAdvanced);
+        } else if (operation->isRemove) {
+            err = HAPPlatformKeyValueStoreRemoveFile(keyValueStore, operation->domain, operation->key);
+        } else {
+            err = HAPPlatformKeyValueStoreWriteFile(
+                    keyValueStore,
+                    operation->domain,
+                    operation->key,
+                    operation->bytes ? operation->bytes : keyValueStore->transactionBytes,
+                    operation->numBytes);
+        }
+        if (err) {
+            HAPAssert(err == kHAPError_Unknown);
+            return err;
+        }
+    }
+    if (isGenerationAdvanced) {
+        err = HAPPlatformKeyValueStoreWriteGenerations(keyValueStore);
+        if (err) {
+            HAPAssert(err == kHAPError_Unknown);
+            return err;
+        }
+        HAPPlatformKeyValueStoreScheduleCollection(keyValueStore, /* deadline: */ 0);
+    }
+    return kHAPError_None;
+}
+
+/**
+ * Writes the operations of the active transaction to flash.
+ *
+ * @param      keyValueStore        Key-value store.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_Unknown        If the file access failed. If the journal was written, it is pending.
+ */
+HAP_RESULT_USE_CHECK
+static HAPError WriteTransaction(HAPPlatformKeyValueStoreRef keyValueStore) {
+    HAPPrecondition(keyValueStore);
+    HAPPrecondition(keyValueStore->transactionOperations);
+
+    HAPError err;
+
+    if (keyValueStore->useLog) {
+        keyValueStore->statistics.numFlashWrites++;
+        for (size_t i = 0; i < keyValueStore->numTransactionOperations; i++) {
+            const HAPPlatformKeyValueStoreOperation* operation = &keyValueStore->transactionOperations[i];
+            if (operation->isPurge) {
+                keyValueStore->statistics.numBulkPurges++;
+                continue;
+            }
+            HAPPlatformKeyValueStoreRecordValueWrite(
+                    keyValueStore, operation->domain, operation->key, operation->numBytes);
+        }
+        return HAPPlatformKeyValueStoreLogWriteBatch(
+                &keyValueStore->log,
+                HAPNonnull(keyValueStore->transactionOperations),
+                keyValueStore->numTransactionOperations);
+    }
+
+    // A single set or removal is atomic without a journal.
+    // A purge also writes the generations, after the values that are set in the new generation.
+    bool useJournal =
+            keyValueStore->numTransactionOperations > 1 || keyValueStore->transactionOperations[0].isPurge;
+    if (!useJournal) {
+        return ApplyTransaction(keyValueStore);
+    }
+    err = HAPPlatformKeyValueStoreWriteJournal(keyValueStore);
+    if (err) {
+        HAPAssert(err == kHAPError_Unknown);
+        return err;
+    }
+
+    // Once the journal is written, the transaction is rolled forward. Its operations are applied again until they
+    // are all written and the journal is removed.
+    bool isApplied = false;
+    for (size_t i = 0; i < kHAPPlatformKeyValueStore_MaxJournalAttempts; i++) {
+        if (!isApplied) {
+            err = ApplyTransaction(keyValueStore);
+            isApplied = !err;
+        }
+        if (isApplied) {
+            err = HAPPlatformKeyValueStoreRemoveJournal(keyValueStore);
+            if (!err) {
+                return kHAPError_None;
+            }
+        }
+        HAPAssert(err == kHAPError_Unknown);
+    }
+    HAPLogError(&logObject, "Failed to apply transaction. Writes are refused until its journal is applied.");
+    keyValueStore->isJournalPending = true;
+    return kHAPError_Unknown;
+}
+
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformKeyValueStoreCommitTransaction(HAPPlatformKeyValueStoreRef keyValueStore) {
+    HAPPrecondition(keyValueStore);
+    HAPPrecondition(keyValueStore->isTransactionActive);
+
+    HAPError err = kHAPError_None;
+    if (keyValueStore->isJournalPending) {
+        HAPLogError(&logObject, "Journal of a failed transaction is pending. Discarding transaction.");
+        err = kHAPError_Unknown;
+    } else if (keyValueStore->isTransactionFailed) {
+        HAPLogError(&logObject, "Transaction could not be staged completely. Discarding it.");
+        err = kHAPError_Unknown;
+    } else if (keyValueStore->numTransactionOperations) {
+        err = WriteTransaction(keyValueStore);
+
+        // The operations replace cached values, including values that have not been written yet.
+        for (size_t i = 0; i < keyValueStore->numTransactionOperations; i++) {
+            const HAPPlatformKeyValueStoreOperation* operation = &keyValueStore->transactionOperations[i];
+            if (operation->isPurge) {
+                // Cached values of the domain are dropped either way. The pairings are unknown after a failure.
+                HAPPlatformKeyValueStoreForgetDomain(keyValueStore, operation->domain);
+                if (err) {
+                    HAPPlatformKeyValueStoreInvalidatePairingTable(keyValueStore, operation->domain);
+                }
+                continue;
+            }
+            HAPPlatformKeyValueStoreDropPreloadedValues(keyValueStore, operation->domain, &operation->key);
+            if (err) {
+                HAPPlatformKeyValueStoreInvalidatePairingTable(keyValueStore, operation->domain);
+            } else {
+                HAPPlatformKeyValueStoreUpdatePairingTable(
+                        keyValueStore,
+                        operation->domain,
+                        operation->key,
+                        operation->bytes,
+                        operation->numBytes,
+                        operation->isRemove);
+            }
+            HAPPlatformKeyValueStoreCacheEntry* _Nullable entry =
+                    HAPPlatformKeyValueStoreFindCacheEntry(keyValueStore, operation->domain, operation->key);
+            if (!entry) {
+                continue;
+            }
+            if (err || operation->numBytes >= sizeof entry->bytes) {
+                entry->isValid = false;
+            } else {
+                HAPPlatformKeyValueStoreSetCacheEntry(
+                        entry, operation->bytes, operation->numBytes, /* found: */ !operation->isRemove);
+                entry->isDirty = false;
+            }
+        }
+        if (!err) {
+            keyValueStore->statistics.numTransactions++;
+        }
+    }
+
+    EndTransaction(keyValueStore);
+    return err;
+}
@@ -0,0 +1,99 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+#ifndef HAP_PLATFORM_KEY_VALUE_STORE_TRANSACTION_H
+#define HAP_PLATFORM_KEY_VALUE_STORE_TRANSACTION_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "HAPPlatform.h"
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull begin
+#endif
+
+/**@file
+ * Transactions of the key-value store.
+ *
+ * Sets, removals and purges may be grouped into a transaction that takes effect as a whole, even across a reset.
+ *
+ * - With the log, a transaction is appended as a single batch record, see HAPPlatformKeyValueStoreLog.h.
+ *
+ * - With the per-file layout, a transaction is written to a journal first, see HAPPlatformKeyValueStoreJournal.h.
+ *
+ * - While a transaction is active, HAPPlatformKeyValueStoreGet returns the staged values. Enumeration lists the
+ *   values that are in effect without the staged operations.
+ */
+
+/**
+ * Finds the staged set or removal of a key in the active transaction.
+ *
+ * @param      keyValueStore        Key-value store.
+ * @param      domain               Domain.
+ * @param      key                  Key.
+ *
+ * @return Staged operation, if the key has been set or removed in the active transaction.
+ */
+HAPPlatformKeyValueStoreOperation* _Nullable HAPPlatformKeyValueStoreFindTransactionOperation(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain,
+        HAPPlatformKeyValueStoreKey key);
+
+/**
+ * Checks whether a domain is purged by the active transaction.
+ *
+ * - Sets and removals in the domain that are staged after the purge take precedence over it.
+ *
+ * @param      keyValueStore        Key-value store.
+ * @param      domain               Domain.
+ *
+ * @return true                     If the domain is purged by the active transaction.
+ * @return false                    Otherwise.
+ */
+HAP_RESULT_USE_CHECK
+bool HAPPlatformKeyValueStoreIsPurgedByTransaction(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain);
+
+/**
+ * Stages a set, removal or purge in the active transaction.
+ *
+ * - A set or removal replaces an earlier operation on the same key.
+ *
+ * - A purge replaces all earlier operations in the same domain.
+ *
+ * @param      keyValueStore        Key-value store.
+ * @param      domain               Domain.
+ * @param      key                  Key. 0 for a purge.
+ * @param      bytes                Value to set. NULL for a removal or purge.
+ * @param      numBytes             Length of the value.
+ * @param      isRemove             Whether the value is removed.
+ * @param      isPurge              Whether all values of the domain are removed. Implies isRemove.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_Unknown        If the transaction buffers are full. The transaction fails to commit.
+ */
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformKeyValueStoreStageOperation(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain,
+        HAPPlatformKeyValueStoreKey key,
+        const void* _Nullable bytes,
+        size_t numBytes,
+        bool isRemove,
+        bool isPurge);
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull end
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,70 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+#include "HAPPlatformKeyValueStore+Init.h"
+
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformKeyValueStoreFlushCacheEntry(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreCacheEntry* entry) {
+    HAPPrecondition(keyValueStore);
+    HAPPrecondition(entry);
+    HAPPrecondition(entry->isValid);
+    HAPPrecondition(entry->isDirty);
+    HAPPrecondition(entry->isFound);
+
+    HAPError err = HAPPlatformKeyValueStoreApplyPendingJournal(keyValueStore);
+    if (err) {
+        HAPAssert(err == kHAPError_Unknown);
+        return err;
+    }
+
+    err = HAPPlatformKeyValueStoreWriteFile(
+            keyValueStore, entry->domain, entry->key, entry->bytes, entry->numBytes);
+    if (err) {
+        HAPAssert(err == kHAPError_Unknown);
+        return err;
+    }
+    entry->isDirty = false;
+    return kHAPError_None;
+}
+
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformKeyValueStoreFlushDomain(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain) {
+    HAPPrecondition(keyValueStore);
+
+    for (size_t i = 0; i < keyValueStore->numCacheEntries; i++) {
+        HAPPlatformKeyValueStoreCacheEntry* entry = &keyValueStore->cacheEntries[i];
+        if (entry->isValid && entry->isDirty && entry->domain == domain) {
+            HAPError err = HAPPlatformKeyValueStoreFlushCacheEntry(keyValueStore, entry);
+            if (err) {
+                HAPAssert(err == kHAPError_Unknown);
+                return err;
+            }
+        }
+    }
+    return kHAPError_None;
+}
+
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformKeyValueStoreFlush(HAPPlatformKeyValueStoreRef keyValueStore) {
+    HAPPrecondition(keyValueStore);
+
+    for (size_t i = 0; i < keyValueStore->numCacheEntries; i++) {
+        HAPPlatformKeyValueStoreCacheEntry* entry = &keyValueStore->cacheEntries[i];
+        if (entry->isValid && entry->isDirty) {
+            HAPError err = HAPPlatformKeyValueStoreFlushCacheEntry(keyValueStore, entry);
+            if (err) {
+                HAPAssert(err == kHAPError_Unknown);
+                return err;
+            }
+        }
+    }
+    keyValueStore->deferredWriteDeadline = 0;
+    return kHAPError_None;
+}
@@ -0,0 +1,70 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+#ifndef HAP_PLATFORM_KEY_VALUE_STORE_WRITE_BACK_H
+#define HAP_PLATFORM_KEY_VALUE_STORE_WRITE_BACK_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "HAPPlatform.h"
+#include "HAPPlatformKeyValueStoreCache.h"
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull begin
+#endif
+
+/**@file
+ * Write-back of cached values.
+ *
+ * - In write-through mode, HAPPlatformKeyValueStoreSet writes to flash before it returns.
+ *
+ * - In write-back mode, HAPPlatformKeyValueStoreSet only updates the cache for values that fit into a cache entry.
+ *   Modified values are written when HAPPlatformKeyValueStoreFlush is called, when their cache entry is evicted,
+ *   and before the domain is enumerated. Values that have not been flushed are lost on reset.
+ *
+ * Values whose write is deferred by the write budget are held in the cache the same way,
+ * see HAPPlatformKeyValueStoreWriteGovernor.h.
+ */
+
+/**
+ * Writes a modified cached value to flash.
+ *
+ * @param      keyValueStore        Key-value store.
+ * @param      entry                Cache entry.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_Unknown        If the file access failed.
+ */
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformKeyValueStoreFlushCacheEntry(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreCacheEntry* entry);
+
+/**
+ * Writes the modified cached values of a domain to flash.
+ *
+ * @param      keyValueStore        Key-value store.
+ * @param      domain               Domain.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_Unknown        If the file access failed.
+ */
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformKeyValueStoreFlushDomain(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain);
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull end
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,245 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+#include "HAPPlatformKeyValueStore+Init.h"
+
+static const HAPLogObject logObject = { .subsystem = kHAPPlatform_LogSubsystem, .category = "KeyValueStore" };
+
+/**
+ * Interval at which deferred writes are retried while the write budget is exceeded.
+ */
+#define kHAPPlatformKeyValueStore_DeferredWriteRetryInterval ((HAPTime)(1 * HAPMinute))
+
+/**
+ * Starts a new window of the write rate estimate once the current one has passed.
+ *
+ * @param      keyValueStore        Key-value store.
+ * @param      now                  Current time.
+ */
+static void UpdateWriteRateWindow(HAPPlatformKeyValueStoreRef keyValueStore, HAPTime now) {
+    HAPPrecondition(keyValueStore);
+
+    HAPTime elapsed = now - keyValueStore->writeRateWindowStart;
+    if (elapsed >= 2 * kHAPPlatformKeyValueStore_WriteRateWindow) {
+        keyValueStore->numPreviousWindowWrites = 0;
+        keyValueStore->numWindowWrites = 0;
+        keyValueStore->writeRateWindowStart = now;
+    } else if (elapsed >= kHAPPlatformKeyValueStore_WriteRateWindow) {
+        keyValueStore->numPreviousWindowWrites = keyValueStore->numWindowWrites;
+        keyValueStore->numWindowWrites = 0;
+        keyValueStore->writeRateWindowStart += kHAPPlatformKeyValueStore_WriteRateWindow;
+    }
+}
+
+HAP_RESULT_USE_CHECK
+uint32_t HAPPlatformKeyValueStoreGetWriteRate(HAPPlatformKeyValueStoreRef keyValueStore) {
+    HAPPrecondition(keyValueStore);
+
+    // Same result as UpdateWriteRateWindow followed by the estimate, without advancing the window.
+    HAPTime elapsed = HAPPlatformClockGetCurrent() - keyValueStore->writeRateWindowStart;
+    uint32_t numWindowWrites = keyValueStore->numWindowWrites;
+    uint32_t numPreviousWindowWrites = keyValueStore->numPreviousWindowWrites;
+    if (elapsed >= 2 * kHAPPlatformKeyValueStore_WriteRateWindow) {
+        return 0;
+    }
+    if (elapsed >= kHAPPlatformKeyValueStore_WriteRateWindow) {
+        numPreviousWindowWrites = numWindowWrites;
+        numWindowWrites = 0;
+        elapsed -= kHAPPlatformKeyValueStore_WriteRateWindow;
+    }
+    HAPTime remaining = kHAPPlatformKeyValueStore_WriteRateWindow - elapsed;
+    return numWindowWrites +
+           (uint32_t)(numPreviousWindowWrites * remaining / kHAPPlatformKeyValueStore_WriteRateWindow);
+}
+
+void HAPPlatformKeyValueStoreRecordFlashWrite(HAPPlatformKeyValueStoreRef keyValueStore) {
+    HAPPrecondition(keyValueStore);
+
+    UpdateWriteRateWindow(keyValueStore, HAPPlatformClockGetCurrent());
+    keyValueStore->numWindowWrites++;
+}
+
+void HAPPlatformKeyValueStoreRecordValueWrite(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain,
+        HAPPlatformKeyValueStoreKey key,
+        size_t numBytes) {
+    HAPPrecondition(keyValueStore);
+
+    HAPPlatformKeyValueStoreRecordFlashWrite(keyValueStore);
+
+    HAPPlatformKeyValueStoreWriteCounter* _Nullable counter = NULL;
+    for (size_t i = 0; i < keyValueStore->numWriteCounters; i++) {
+        HAPPlatformKeyValueStoreWriteCounter* candidate = &keyValueStore->writeCounters[i];
+        if (!candidate->isUsed) {
+            counter = candidate;
+            counter->isUsed = true;
+            counter->domain = domain;
+            counter->key = key;
+            break;
+        }
+        if (candidate->domain == domain && candidate->key == key) {
+            counter = candidate;
+            break;
+        }
+    }
+    if (counter) {
+        counter->numWrites++;
+        counter->numBytes += (uint32_t) numBytes;
+    }
+}
+
+void HAPPlatformKeyValueStoreRecordFlashWriteTime(HAPPlatformKeyValueStoreRef keyValueStore, HAPTime startTime) {
+    HAPPrecondition(keyValueStore);
+
+    HAPTime duration = HAPPlatformClockGetCurrent() - startTime;
+    keyValueStore->statistics.flashWriteTime += duration;
+    if (duration > keyValueStore->statistics.maxFlashWriteTime) {
+        keyValueStore->statistics.maxFlashWriteTime = duration;
+    }
+}
+
+void HAPPlatformKeyValueStoreGetWriteCount(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain,
+        HAPPlatformKeyValueStoreKey key,
+        uint32_t* numWrites,
+        uint32_t* numBytes) {
+    HAPPrecondition(keyValueStore);
+    HAPPrecondition(numWrites);
+    HAPPrecondition(numBytes);
+
+    *numWrites = 0;
+    *numBytes = 0;
+    for (size_t i = 0; i < keyValueStore->numWriteCounters && keyValueStore->writeCounters[i].isUsed; i++) {
+        const HAPPlatformKeyValueStoreWriteCounter* counter = &keyValueStore->writeCounters[i];
+        if (counter->domain == domain && counter->key == key) {
+            *numWrites = counter->numWrites;
+            *numBytes = counter->numBytes;
+            return;
+        }
+    }
+}
+
+void HAPPlatformKeyValueStoreGetDomainWriteCount(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain,
+        uint32_t* numWrites,
+        uint32_t* numBytes) {
+    HAPPrecondition(keyValueStore);
+    HAPPrecondition(numWrites);
+    HAPPrecondition(numBytes);
+
+    *numWrites = 0;
+    *numBytes = 0;
+    for (size_t i = 0; i < keyValueStore->numWriteCounters && keyValueStore->writeCounters[i].isUsed; i++) {
+        const HAPPlatformKeyValueStoreWriteCounter* counter = &keyValueStore->writeCounters[i];
+        if (counter->domain == domain) {
+            *numWrites += counter->numWrites;
+            *numBytes += counter->numBytes;
+        }
+    }
+}
+
+static void DeferredWriteTimerExpired(HAPPlatformTimerRef timer, void* _Nullable context);
+
+/**
+ * Schedules the next attempt to write the deferred values.
+ *
+ * @param      keyValueStore        Key-value store.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_OutOfResources If no timer is available.
+ */
+HAP_RESULT_USE_CHECK
+static HAPError ScheduleDeferredWrite(HAPPlatformKeyValueStoreRef keyValueStore) {
+    HAPPrecondition(keyValueStore);
+
+    if (keyValueStore->deferredWriteTimer) {
+        return kHAPError_None;
+    }
+    HAPTime deadline = HAPMin(
+            HAPPlatformClockGetCurrent() + kHAPPlatformKeyValueStore_DeferredWriteRetryInterval,
+            keyValueStore->deferredWriteDeadline);
+    HAPError err = HAPPlatformTimerRegister(
+            &keyValueStore->deferredWriteTimer, deadline, DeferredWriteTimerExpired, keyValueStore);
+    if (err) {
+        HAPAssert(err == kHAPError_OutOfResources);
+        keyValueStore->deferredWriteTimer = 0;
+        return err;
+    }
+    return kHAPError_None;
+}
+
+static void DeferredWriteTimerExpired(HAPPlatformTimerRef timer, void* _Nullable context) {
+    HAPPrecondition(context);
+    HAPPlatformKeyValueStoreRef keyValueStore = context;
+    HAPPrecondition(timer == keyValueStore->deferredWriteTimer);
+    keyValueStore->deferredWriteTimer = 0;
+
+    if (!keyValueStore->deferredWriteDeadline) {
+        // Deferred values have been flushed already.
+        return;
+    }
+
+    HAPError err;
+    if (HAPPlatformClockGetCurrent() >= keyValueStore->deferredWriteDeadline ||
+        HAPPlatformKeyValueStoreGetWriteRate(keyValueStore) < keyValueStore->maxWritesPerHour) {
+        err = HAPPlatformKeyValueStoreFlush(keyValueStore);
+        if (err) {
+            HAPAssert(err == kHAPError_Unknown);
+            HAPLogError(&logObject, "Failed to write deferred values. Retrying.");
+        }
+    }
+
+    // Values remain deferred until they have been flushed.
+    if (keyValueStore->deferredWriteDeadline) {
+        err = ScheduleDeferredWrite(keyValueStore);
+        if (err) {
+            HAPAssert(err == kHAPError_OutOfResources);
+            HAPLogError(&logObject, "Failed to schedule deferred write. Values are written on the next flush.");
+        }
+    }
+}
+
+HAP_RESULT_USE_CHECK
+bool HAPPlatformKeyValueStoreDeferWrite(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain) {
+    HAPPrecondition(keyValueStore);
+
+    if (!keyValueStore->maxWritesPerHour) {
+        return false;
+    }
+    bool isDeferrable = false;
+    for (size_t i = 0; i < keyValueStore->numDeferrableDomains && !isDeferrable; i++) {
+        isDeferrable = keyValueStore->deferrableDomains[i] == domain;
+    }
+    if (!isDeferrable || HAPPlatformKeyValueStoreGetWriteRate(keyValueStore) < keyValueStore->maxWritesPerHour) {
+        return false;
+    }
+
+    bool isFirstDeferral = !keyValueStore->deferredWriteDeadline;
+    if (isFirstDeferral) {
+        keyValueStore->deferredWriteDeadline = HAPPlatformClockGetCurrent() + keyValueStore->maxWriteDeferral;
+    }
+    HAPError err = ScheduleDeferredWrite(keyValueStore);
+    if (err) {
+        HAPAssert(err == kHAPError_OutOfResources);
+        if (isFirstDeferral) {
+            keyValueStore->deferredWriteDeadline = 0;
+        }
+        return false;
+    }
+    if (isFirstDeferral) {
+        HAPLogInfo(
+                &logObject,
+                "Write budget of %lu writes per hour exceeded. Deferring writes.",
+                (unsigned long) keyValueStore->maxWritesPerHour);
+    }
+    keyValueStore->statistics.numWritesDeferred++;
+    return true;
+}
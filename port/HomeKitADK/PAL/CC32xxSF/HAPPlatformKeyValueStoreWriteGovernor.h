@@ -0,0 +1,115 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+#ifndef HAP_PLATFORM_KEY_VALUE_STORE_WRITE_GOVERNOR_H
+#define HAP_PLATFORM_KEY_VALUE_STORE_WRITE_GOVERNOR_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "HAPPlatform.h"
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull begin
+#endif
+
+/**@file
+ * Write counters and write governor of the key-value store.
+ *
+ * Flash writes and removals are counted per value, and their rate is estimated over a sliding window of one hour.
+ * An optional governor keeps the rate within a write budget:
+ *
+ * - While the estimated rate exceeds the budget, writes of cacheable values in deferrable domains are held in the
+ *   cache, where later writes of the same value replace them. Writes in other domains are never deferred.
+ *
+ * - Deferred values are written once the rate is within the budget again, after the maximum deferral, when
+ *   HAPPlatformKeyValueStoreFlush is called, and when their cache entry is evicted. They are lost on reset.
+ */
+
+/**
+ * Write counter. Counts the flash writes and removals of one value since initialization.
+ */
+typedef struct {
+    // Opaque type. Do not access the instance fields directly.
+    /**@cond */
+    uint32_t numWrites;
+    uint32_t numBytes;
+    HAPPlatformKeyValueStoreDomain domain;
+    HAPPlatformKeyValueStoreKey key;
+    bool isUsed;
+    /**@endcond */
+} HAPPlatformKeyValueStoreWriteCounter;
+
+/**
+ * Window over which the flash write rate is estimated.
+ */
+#define kHAPPlatformKeyValueStore_WriteRateWindow ((HAPTime)(1 * HAPHour))
+
+/**
+ * Records a flash write or removal for the write rate estimate.
+ *
+ * @param      keyValueStore        Key-value store.
+ */
+void HAPPlatformKeyValueStoreRecordFlashWrite(HAPPlatformKeyValueStoreRef keyValueStore);
+
+/**
+ * Records a flash write or removal of a value.
+ *
+ * @param      keyValueStore        Key-value store.
+ * @param      domain               Domain.
+ * @param      key                  Key.
+ * @param      numBytes             Number of bytes written.
+ */
+void HAPPlatformKeyValueStoreRecordValueWrite(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain,
+        HAPPlatformKeyValueStoreKey key,
+        size_t numBytes);
+
+/**
+ * Accounts the time spent in a flash write or removal.
+ *
+ * @param      keyValueStore        Key-value store.
+ * @param      startTime            Time at which the flash access started.
+ */
+void HAPPlatformKeyValueStoreRecordFlashWriteTime(HAPPlatformKeyValueStoreRef keyValueStore, HAPTime startTime);
+
+/**
+ * Estimates the number of flash writes and removals over the last hour. Does not modify the key-value store.
+ *
+ * - The writes of the previous window are weighted by the part of it that overlaps the last hour.
+ *
+ * @param      keyValueStore        Key-value store.
+ *
+ * @return Estimated number of flash writes and removals per hour.
+ */
+HAP_RESULT_USE_CHECK
+uint32_t HAPPlatformKeyValueStoreGetWriteRate(HAPPlatformKeyValueStoreRef keyValueStore);
+
+/**
+ * Determines whether a write is deferred because the write budget is exceeded.
+ *
+ * @param      keyValueStore        Key-value store.
+ * @param      domain               Domain.
+ *
+ * @return true                     If the write is deferred. The caller keeps the value in the cache.
+ * @return false                    If the value needs to be written now.
+ */
+HAP_RESULT_USE_CHECK
+bool HAPPlatformKeyValueStoreDeferWrite(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain);
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull end
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
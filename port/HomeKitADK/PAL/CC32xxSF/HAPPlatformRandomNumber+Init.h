@@ -0,0 +1,68 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+#ifndef HAP_PLATFORM_RANDOM_NUMBER_INIT_H
+#define HAP_PLATFORM_RANDOM_NUMBER_INIT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "HAPPlatform.h"
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull begin
+#endif
+
+/**@file
+ * Random number generator seeding.
+ *
+ * The random number generator is seeded on first use. The entropy is read from the network processor, which takes
+ * several round trips. Without further setup, this happens in the first HAPPlatformRandomNumberFill on the run loop,
+ * which blocks the run loop for these round trips.
+ *
+ * The entropy may instead be collected on the worker in advance, see HAPPlatformWorker+Init.h. The run loop then
+ * only seeds the generator from the collected bytes.
+ */
+
+/**
+ * Number of entropy bytes that are collected in advance. Covers the entropy and the nonce of the initial seed.
+ */
+#define kHAPPlatformRandomNumber_NumSeedBytes ((size_t) 96)
+
+/**
+ * Collects entropy to seed the random number generator.
+ *
+ * - Blocks until the entropy has been read. May be called from any task, and does not access the generator.
+ *
+ * @param[out] seedBytes            Entropy.
+ */
+void HAPPlatformRandomNumberCollectSeed(uint8_t seedBytes[_Nonnull kHAPPlatformRandomNumber_NumSeedBytes]);
+
+/**
+ * Seeds the random number generator with entropy collected by HAPPlatformRandomNumberCollectSeed.
+ *
+ * - Has no effect if the random number generator has already been seeded on first use.
+ *
+ * - This function must be called from the run loop.
+ *
+ * @param      seedBytes            Entropy.
+ *
+ * @return true                     If the random number generator has been seeded from the entropy.
+ * @return false                    If the random number generator had already been seeded.
+ */
+HAP_RESULT_USE_CHECK
+bool HAPPlatformRandomNumberSeed(const uint8_t seedBytes[_Nonnull kHAPPlatformRandomNumber_NumSeedBytes]);
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull end
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
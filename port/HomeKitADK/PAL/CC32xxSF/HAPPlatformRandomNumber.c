@@ -12,25 +12,102 @@
 #include <mbedtls/ctr_drbg.h>
 
 #include "HAPPlatform.h"
+#include "HAPPlatformRandomNumber+Init.h"
 
 static const HAPLogObject logObject = { .subsystem = kHAPPlatform_LogSubsystem, .category = "RandomNumber" };
 
 static mbedtls_entropy_context entropy;
 static mbedtls_ctr_drbg_context ctr_drbg;
+static bool isInitialized = false;
 
-void HAPPlatformRandomNumberFill(void* bytes, size_t numBytes) {
-    HAPPrecondition(bytes);
+/**
+ * Entropy collected in advance, consumed while seeding.
+ */
+typedef struct {
+    const uint8_t* bytes;
+    size_t numBytes;
+} CollectedSeed;
 
-    static bool isInitialized = false;
-    if (!isInitialized) {
-        mbedtls_entropy_init(&entropy);
-        mbedtls_ctr_drbg_init(&ctr_drbg);
-        int e = mbedtls_ctr_drbg_seed(&ctr_drbg, mbedtls_entropy_func, &entropy, NULL, 0);
+/**
+ * Entropy callback that serves collected entropy, and reads further entropy once it is used up.
+ */
+static int GetCollectedEntropy(void* context, unsigned char* output, size_t len)
+{
+    HAPPrecondition(context);
+    CollectedSeed* seed = context;
+
+    if (len > seed->numBytes) {
+        return mbedtls_entropy_func(&entropy, output, len);
+    }
+    HAPRawBufferCopyBytes(output, seed->bytes, len);
+    seed->bytes += len;
+    seed->numBytes -= len;
+    return 0;
+}
+
+/**
+ * Seeds the random number generator.
+ *
+ * @param      seed                 Entropy collected in advance, or NULL to read the entropy now.
+ */
+static void Initialize(CollectedSeed* _Nullable seed)
+{
+    HAPPrecondition(!isInitialized);
+
+    mbedtls_entropy_init(&entropy);
+    mbedtls_ctr_drbg_init(&ctr_drbg);
+    int e = seed ? mbedtls_ctr_drbg_seed(&ctr_drbg, GetCollectedEntropy, seed, NULL, 0) :
+                   mbedtls_ctr_drbg_seed(&ctr_drbg, mbedtls_entropy_func, &entropy, NULL, 0);
+    if (e != 0) {
+        HAPLogError(&logObject, "mbedtls_ctr_drbg_seed failed: %d.", e);
+        HAPFatalError();
+    }
+    // Reseeds read the entropy when they happen.
+    ctr_drbg.f_entropy = mbedtls_entropy_func;
+    ctr_drbg.p_entropy = &entropy;
+    isInitialized = true;
+}
+
+void HAPPlatformRandomNumberCollectSeed(uint8_t seedBytes[_Nonnull kHAPPlatformRandomNumber_NumSeedBytes])
+{
+    HAPPrecondition(seedBytes);
+
+    mbedtls_entropy_context seedEntropy;
+    mbedtls_entropy_init(&seedEntropy);
+    for (size_t offset = 0; offset < kHAPPlatformRandomNumber_NumSeedBytes; offset += MBEDTLS_ENTROPY_BLOCK_SIZE) {
+        size_t numBytes = HAPMin(kHAPPlatformRandomNumber_NumSeedBytes - offset, (size_t) MBEDTLS_ENTROPY_BLOCK_SIZE);
+        int e = mbedtls_entropy_func(&seedEntropy, &seedBytes[offset], numBytes);
         if (e != 0) {
-            HAPLogError(&logObject, "mbedtls_ctr_drbg_seed failed: %d.", e);
+            HAPLogError(&logObject, "mbedtls_entropy_func failed: %d.", e);
             HAPFatalError();
         }
-        isInitialized = true;
+    }
+    mbedtls_entropy_free(&seedEntropy);
+}
+
+HAP_RESULT_USE_CHECK
+bool HAPPlatformRandomNumberSeed(const uint8_t seedBytes[_Nonnull kHAPPlatformRandomNumber_NumSeedBytes])
+{
+    HAPPrecondition(seedBytes);
+
+    if (isInitialized) {
+        return false;
+    }
+    CollectedSeed seed = { .bytes = seedBytes, .numBytes = kHAPPlatformRandomNumber_NumSeedBytes };
+    Initialize(&seed);
+    return true;
+}
+
+void HAPPlatformRandomNumberFill(void* bytes, size_t numBytes) {
+    HAPPrecondition(bytes);
+
+    if (!isInitialized) {
+        HAPTime startTime = HAPPlatformClockGetCurrent();
+        Initialize(NULL);
+        HAPLogInfo(
+                &logObject,
+                "Seeded on first use in %lu ms.",
+                (unsigned long) (HAPPlatformClockGetCurrent() - startTime));
     }
 
     int e = mbedtls_ctr_drbg_random(&ctr_drbg, (unsigned char *)bytes, numBytes);
@@ -27,6 +27,9 @@
 #include "HAPPlatformFileHandle.h"
 #include "HAPPlatformLog+Init.h"
 #include "HAPPlatformRunLoop+Init.h"
+#include "HAPPlatformRunLoopCallbacks.h"
+#include "HAPPlatformRunLoopCommon.h"
+#include "HAPPlatformRunLoopWatchdog.h"
 
 static const HAPLogObject logObject = { .subsystem = kHAPPlatform_LogSubsystem, .category = "RunLoop" };
 
@@ -77,36 +80,6 @@ struct HAPPlatformFileHandle {
     bool isAwaitingEvents;
 };
 
-/**
- * Internal timer type.
- */
-typedef struct HAPPlatformTimer HAPPlatformTimer;
-
-/**
- * Internal timer representation.
- */
-struct HAPPlatformTimer {
-    /**
-     * Deadline at which the timer expires.
-     */
-    HAPTime deadline;
-
-    /**
-     * Callback that is invoked when the timer expires.
-     */
-    HAPPlatformTimerCallback callback;
-
-    /**
-     * The context parameter given to the HAPPlatformTimerRegister function.
-     */
-    void* _Nullable context;
-
-    /**
-     * Next timer in linked list.
-     */
-    HAPPlatformTimer* _Nullable nextTimer;
-};
-
 /**
  * Run loop state.
  */
@@ -142,11 +115,6 @@ static struct {
      */
     HAPPlatformFileHandle* _Nullable fileHandleCursor;
 
-    /**
-     * Start of linked list of timers, ordered by deadline.
-     */
-    HAPPlatformTimer* _Nullable timers;
-    
     /**
      * Loopback file descriptor to receive data.
      */
@@ -188,7 +156,6 @@ static struct {
                                       .isAwaitingEvents = false },
               .fileHandles = &runLoop.fileHandleSentinel,
               .fileHandleCursor = &runLoop.fileHandleSentinel,
-              .timers = NULL,
               .loopbackFileDescriptor = -1 };
 
 HAP_RESULT_USE_CHECK
@@ -289,92 +256,21 @@ static void ProcessSelectedFileHandles(SlNetSock_SdSet_t* readFileDescriptors,
 
                 if (fileHandleEvents.isReadyForReading || fileHandleEvents.isReadyForWriting ||
                     fileHandleEvents.hasErrorConditionPending) {
+                    // The loopback is not measured as a whole. The callbacks that it invokes are measured individually.
+                    HAPPlatformFileHandleCallback callback = fileHandle->callback;
+                    bool isLoopback = (HAPPlatformFileHandleRef) fileHandle == runLoop.loopbackFileHandle;
+                    HAPTime dispatchStartTime = HAPPlatformRunLoopWatchdogBeginDispatch();
                     fileHandle->callback((HAPPlatformFileHandleRef) fileHandle, fileHandleEvents, fileHandle->context);
+                    if (!isLoopback) {
+                        HAPPlatformRunLoopWatchdogEndDispatch(
+                                kHAPPlatformRunLoopDispatchSource_FileHandle, (uintptr_t) callback, dispatchStartTime);
+                    }
                 }
             }
         }
     }
 }
 
-HAP_RESULT_USE_CHECK
-HAPError HAPPlatformTimerRegister(HAPPlatformTimerRef* timer_,
-                                  HAPTime deadline,
-                                  HAPPlatformTimerCallback callback,
-                                  void* _Nullable context)
-{
-    HAPPrecondition(timer_);
-    HAPPlatformTimer* _Nullable* newTimer = (HAPPlatformTimer * _Nullable*) timer_;
-    HAPPrecondition(callback);
-
-    // Prepare timer.
-    *newTimer = pvPortMalloc(sizeof(HAPPlatformTimer));
-    if (!*newTimer) {
-        HAPLog(&logObject, "Cannot allocate more timers.");
-        return kHAPError_OutOfResources;
-    }
-    HAPRawBufferZero(*newTimer, sizeof(HAPPlatformTimer));
-    (*newTimer)->deadline = deadline ? deadline : 1;
-    (*newTimer)->callback = callback;
-    (*newTimer)->context = context;
-
-    // Insert timer.
-    for (HAPPlatformTimer* _Nullable* nextTimer = &runLoop.timers;; nextTimer = &(*nextTimer)->nextTimer) {
-        if (!*nextTimer) {
-            (*newTimer)->nextTimer = NULL;
-            *nextTimer = *newTimer;
-            break;
-        }
-        if ((*nextTimer)->deadline > deadline) {
-            // Search condition must be '>' and not '>=' to ensure that timers fire in ascending order of their
-            // deadlines and that timers registered with the same deadline fire in order of registration.
-            (*newTimer)->nextTimer = *nextTimer;
-            *nextTimer = *newTimer;
-            break;
-        }
-    }
-
-    return kHAPError_None;
-}
-
-void HAPPlatformTimerDeregister(HAPPlatformTimerRef timer_) {
-    HAPPrecondition(timer_);
-    HAPPlatformTimer* timer = (HAPPlatformTimer*) timer_;
-
-    // Find and remove timer.
-    for (HAPPlatformTimer* _Nullable* nextTimer = &runLoop.timers; *nextTimer; nextTimer = &(*nextTimer)->nextTimer) {
-        if (*nextTimer == timer) {
-            *nextTimer = timer->nextTimer;
-            HAPPlatformFreeSafe(timer);
-            return;
-        }
-    }
-
-    // Timer not found.
-    HAPFatalError();
-}
-
-static void ProcessExpiredTimers(void) {
-    // Get current time.
-    HAPTime now = HAPPlatformClockGetCurrent();
-
-    // Enumerate timers.
-    while (runLoop.timers) {
-        if (runLoop.timers->deadline > now) {
-            break;
-        }
-
-        // Update head, so that reentrant add / removes do not interfere.
-        HAPPlatformTimer* expiredTimer = runLoop.timers;
-        runLoop.timers = runLoop.timers->nextTimer;
-
-        // Invoke callback.
-        expiredTimer->callback((HAPPlatformTimerRef) expiredTimer, expiredTimer->context);
-
-        // Free memory.
-        HAPPlatformFreeSafe(expiredTimer);
-    }
-}
-
 void CloseLoopback(int fileDescriptor)
 {
     if (fileDescriptor != -1) {
@@ -424,39 +320,7 @@ static void HandleLoopbackFileHandleCallback(HAPPlatformFileHandleRef fileHandle
 
     HAPAssert((size_t) n <= sizeof runLoop.loopbackBytes - runLoop.numLoopbackBytes);
     runLoop.numLoopbackBytes += (size_t) n;
-    for (;;) {
-        if (runLoop.numLoopbackBytes < sizeof (HAPPlatformRunLoopCallback) + 1) {
-            break;
-        }
-        size_t contextSize = (size_t) runLoop.loopbackBytes[sizeof (HAPPlatformRunLoopCallback)];
-        if (runLoop.numLoopbackBytes < sizeof (HAPPlatformRunLoopCallback) + 1 + contextSize) {
-            break;
-        }
-
-        HAPPlatformRunLoopCallback callback;
-        HAPRawBufferCopyBytes(
-            &callback,
-            &runLoop.loopbackBytes[0],
-            sizeof (HAPPlatformRunLoopCallback));
-        HAPRawBufferCopyBytes(
-            &runLoop.loopbackBytes[0],
-            &runLoop.loopbackBytes[sizeof (HAPPlatformRunLoopCallback) + 1],
-            runLoop.numLoopbackBytes - (sizeof (HAPPlatformRunLoopCallback) + 1));
-        runLoop.numLoopbackBytes -= (sizeof (HAPPlatformRunLoopCallback) + 1);
-
-        // Issue memory barrier to ensure visibility of data referenced by callback context.
-        __sync_synchronize();
-
-        callback(
-            contextSize ? &runLoop.loopbackBytes[0] : NULL,
-            contextSize);
-
-        HAPRawBufferCopyBytes(
-            &runLoop.loopbackBytes[0],
-            &runLoop.loopbackBytes[contextSize],
-            runLoop.numLoopbackBytes - contextSize);
-        runLoop.numLoopbackBytes -= contextSize;
-    }
+    HAPPlatformRunLoopCallbacksDispatch(runLoop.loopbackBytes, &runLoop.numLoopbackBytes);
 }
 
 void HAPPlatformRunLoopCreate(const HAPPlatformRunLoopOptions* options)
@@ -469,7 +333,8 @@ void HAPPlatformRunLoopCreate(const HAPPlatformRunLoopOptions* options)
 
     HAPLogDebug(&logObject, "Storage configuration: runLoop = %lu", (unsigned long) sizeof runLoop);
     HAPLogDebug(&logObject, "Storage configuration: fileHandle = %lu", (unsigned long) sizeof(HAPPlatformFileHandle));
-    HAPLogDebug(&logObject, "Storage configuration: timer = %lu", (unsigned long) sizeof(HAPPlatformTimer));
+
+    HAPPlatformRunLoopCommonCreate(options);
 
     // Open loopback socket.
     HAPPrecondition(runLoop.loopbackFileDescriptor == -1);
@@ -533,6 +398,8 @@ void HAPPlatformRunLoopCreate(const HAPPlatformRunLoopOptions* options)
 
 void HAPPlatformRunLoopRelease(void)
 {
+    HAPPlatformRunLoopCommonRelease();
+
     CloseLoopback(runLoop.loopbackFileDescriptor);
 
     runLoop.loopbackFileDescriptor = -1;
@@ -555,6 +422,8 @@ void HAPPlatformRunLoopRun(void)
     HAPLogInfo(&logObject, "Entering run loop.");
     runLoop.state = kHAPPlatformRunLoopState_Running;
     do {
+        HAPPlatformRunLoopCommonProcessBeforeWaitCallback();
+
         SlNetSock_SdSet_t readFileDescriptors;
         SlNetSock_SdSet_t writeFileDescriptors;
         SlNetSock_SdSet_t errorFileDescriptors;
@@ -603,7 +472,7 @@ void HAPPlatformRunLoopRun(void)
         struct timeval timeoutValue;
         struct timeval* timeout = NULL;
 
-        HAPTime nextDeadline = runLoop.timers ? runLoop.timers->deadline : 0;
+        HAPTime nextDeadline = HAPPlatformRunLoopCommonGetTimerWakeupTime();
         if (nextDeadline) {
             HAPTime now = HAPPlatformClockGetCurrent();
             HAPTime delta;
@@ -635,7 +504,7 @@ void HAPPlatformRunLoopRun(void)
             HAPFatalError();
         }
 
-        ProcessExpiredTimers();
+        HAPPlatformRunLoopCommonProcessExpiredTimers();
         ProcessSelectedFileHandles(&readFileDescriptors, &writeFileDescriptors, &errorFileDescriptors);
     } while (runLoop.state == kHAPPlatformRunLoopState_Running);
 
@@ -0,0 +1,325 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Copyright (c) 2021 John Buonagurio
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+#include <errno.h>
+
+#include <ti/net/bsd/errnoutil.h>
+#include <ti/net/slneterr.h>
+#include <ti/net/slnetif.h>
+#include <ti/net/slnetsock.h>
+#include <ti/net/slnetutils.h>
+
+#include "HAPPlatform+Init.h"
+#include "HAPPlatformLog+Init.h"
+#include "HAPPlatformTCPStreamSocket.h"
+
+static const HAPLogObject logObject = { .subsystem = kHAPPlatform_LogSubsystem, .category = "TCPStreamManager" };
+
+/**
+ * Makes a socket descriptor nonblocking.
+ *
+ * @param      sd                   Socket descriptor.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_Unknown        If the nonblocking flag could not be set.
+ */
+static HAPError SetNonblocking(int sd)
+{
+    SlNetSock_Nonblocking_t v = { .nonBlockingEnabled = 1 };
+    HAPLogBufferDebug(&logObject, &v, sizeof v, "setsockopt(%d, SOL_SOCKET, SO_NONBLOCKING, <buffer>);", sd);
+    int e = SlNetSock_setOpt((int16_t)sd, SLNETSOCK_LVL_SOCKET, SLNETSOCK_OPSOCK_NON_BLOCKING, &v, sizeof v);
+    if (e != 0) {
+        ErrnoUtil_set(e);
+        HAPPlatformLogPOSIXError(kHAPLogType_Error,
+                                 "System call 'setsockopt' to set socket options to 'O_NONBLOCK' failed.",
+                                 errno, __func__, HAP_FILE, __LINE__);
+        return kHAPError_Unknown;
+    }
+    return kHAPError_None;
+}
+
+/**
+ * Disables coalescing of small segments on a socket.
+ *
+ * @param      sd                   Socket descriptor.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_Unknown        If an error occurred while disabling coalescing of small segments.
+ */
+static HAPError SetNodelay(int sd)
+{
+    SlNetSock_NoDelay_t v = { .noDelayEnabled = 1 };
+    HAPLogBufferDebug(&logObject, &v, sizeof v, "setsockopt(%d, IPPROTO_TCP, TCP_NODELAY, <buffer>);", sd);
+    int e = SlNetSock_setOpt((int16_t)sd, SLNETSOCK_PROTO_TCP, SLNETSOCK_TCP_NODELAY, &v, sizeof v);
+    if (e != 0 && e != SLNETERR_BSD_EINVAL) {
+        ErrnoUtil_set(e);
+        HAPPlatformLogPOSIXError(kHAPLogType_Error,
+                                 "System call 'setsockopt' to set socket options to 'TCP_NODELAY' failed.",
+                                 errno, __func__, HAP_FILE, __LINE__);
+        return kHAPError_Unknown;
+    }
+    return kHAPError_None;
+}
+
+/**
+ * Enables TCP keepalives on a socket so that a peer that has stopped responding is detected within a bounded time.
+ *
+ * @param      sd                   Socket descriptor.
+ * @param      timeout              Time after which the connection is reset if the peer does not respond.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_Unknown        If an error occurred while enabling TCP keepalives.
+ */
+static HAPError SetKeepAlive(int sd, HAPTime timeout)
+{
+    HAPPrecondition(timeout);
+
+    SlNetSock_Keepalive_t v = { .keepaliveEnabled = 1 };
+    HAPLogBufferDebug(&logObject, &v, sizeof v, "setsockopt(%d, SOL_SOCKET, SO_KEEPALIVE, <buffer>);", sd);
+    int e = SlNetSock_setOpt((int16_t)sd, SLNETSOCK_LVL_SOCKET, SLNETSOCK_OPSOCK_KEEPALIVE, &v, sizeof v);
+    if (e != 0) {
+        ErrnoUtil_set(e);
+        HAPPlatformLogPOSIXError(kHAPLogType_Error,
+                                 "System call 'setsockopt' to enable TCP keepalives failed.",
+                                 errno, __func__, HAP_FILE, __LINE__);
+        return kHAPError_Unknown;
+    }
+
+    // The network processor only takes the keepalive time, in seconds. It chooses the probe interval and count, so
+    // probes start at the same time as on Linux, but the time until the reset is up to the network processor.
+    HAPPlatformTCPStreamSocketKeepAlive keepAlive;
+    HAPPlatformTCPStreamSocketGetKeepAlive(timeout, &keepAlive);
+    uint32_t keepaliveTime = (uint32_t) HAPMin(keepAlive.idleTime / HAPSecond, (HAPTime) UINT32_MAX);
+    HAPLogBufferDebug(&logObject, &keepaliveTime, sizeof keepaliveTime,
+                      "setsockopt(%d, SOL_SOCKET, SO_KEEPALIVETIME, <buffer>);", sd);
+    e = SlNetSock_setOpt(
+            (int16_t)sd, SLNETSOCK_LVL_SOCKET, SLNETSOCK_OPSOCK_KEEPALIVE_TIME, &keepaliveTime, sizeof keepaliveTime);
+    if (e != 0) {
+        ErrnoUtil_set(e);
+        HAPPlatformLogPOSIXError(kHAPLogType_Error,
+                                 "System call 'setsockopt' to set the TCP keepalive time failed.",
+                                 errno, __func__, HAP_FILE, __LINE__);
+        return kHAPError_Unknown;
+    }
+    return kHAPError_None;
+}
+
+void HAPPlatformTCPStreamSocketOpenListener(
+        const char* interfaceName,
+        HAPNetworkPort port,
+        int* fileDescriptor_,
+        uint32_t* interfaceIndex_,
+        HAPNetworkPort* listenerPort)
+{
+    HAPPrecondition(interfaceName);
+    HAPPrecondition(fileDescriptor_);
+    HAPPrecondition(interfaceIndex_);
+    HAPPrecondition(listenerPort);
+
+    int e;
+
+    uint32_t interfaceIndex;
+    if (interfaceName[0]) {
+        int32_t i = SlNetIf_getIDByName((char*) interfaceName); // if_nametoindex
+        if (i == SLNETERR_RET_CODE_INVALID_INPUT) {
+            HAPLogError(&logObject, "Mapping the local network interface name to its corresponding index failed.");
+            HAPFatalError();
+        }
+        interfaceIndex = (uint32_t) i;
+    } else {
+        interfaceIndex = 0;
+    }
+
+    int fileDescriptor = (int)SlNetSock_create(SLNETSOCK_PF_INET6, SLNETSOCK_SOCK_STREAM, SLNETSOCK_PROTO_TCP, 0, 0);
+    if (fileDescriptor < 0) {
+        HAPLogError(&logObject, "Failed to open TCP stream listener socket.");
+        HAPFatalError();
+    }
+
+    int v = 1;
+    HAPLogBufferDebug(&logObject, &v, sizeof v, "setsockopt(%d, SOL_SOCKET, SO_REUSEADDR, <buffer>);", fileDescriptor);
+    e = SlNetSock_setOpt((int16_t)fileDescriptor, SLNETSOCK_LVL_SOCKET, SLNETSOCK_OPSOCK_REUSEADDR, &v, sizeof v);
+    if (e != 0 && e != SLNETERR_BSD_ENOPROTOOPT) {
+        ErrnoUtil_set(e);
+        HAPPlatformLogPOSIXError(kHAPLogType_Error,
+                                 "System call 'setsockopt' with option 'SO_REUSEADDR' on TCP stream listener socket failed.",
+                                 errno, __func__, HAP_FILE, __LINE__);
+    }
+
+    if (interfaceIndex) {
+        HAPLog(&logObject, "Ignoring local network interface name on which to bind the TCP stream manager.");
+        interfaceIndex = 0;
+    }
+    HAPLogDebug(&logObject, "TCP stream listener interface index: %u", (unsigned int) interfaceIndex);
+
+    SlNetSock_AddrIn6_t sin6;
+    HAPRawBufferZero(&sin6, sizeof sin6);
+    sin6.sin6_family = SLNETSOCK_AF_INET6;
+    sin6.sin6_port = SlNetUtil_htons(port);
+    HAPRawBufferZero(&(sin6.sin6_addr), sizeof(SlNetSock_In6Addr_t)); // in6addr_any NYI; IPv6 unspecified address is all zeroes
+
+    HAPLogBufferDebug(&logObject, (struct SlNetSock_Addr_t*) &sin6, sizeof sin6, "bind(%d, <buffer>);", fileDescriptor);
+    e = (int)SlNetSock_bind((int16_t)fileDescriptor, (const SlNetSock_Addr_t *)&sin6, sizeof sin6);
+    if (e != 0) {
+        ErrnoUtil_set(e);
+        HAPPlatformLogPOSIXError(kHAPLogType_Error,
+                                 "System call 'bind' on TCP stream listener socket failed.",
+                                 errno, __func__, HAP_FILE, __LINE__);
+        HAPFatalError();
+    }
+
+    if (!port) {
+        SlNetSocklen_t sin6_len = sizeof sin6;
+        HAPRawBufferZero(&sin6, sizeof sin6);
+        e = (int)SlNetSock_getSockName((int16_t)fileDescriptor, (SlNetSock_Addr_t *)&sin6, &sin6_len);
+        if (e != 0) {
+            ErrnoUtil_set(e);
+            HAPPlatformLogPOSIXError(kHAPLogType_Error,
+                                     "System call 'getsockname' on TCP stream listener socket failed.",
+                                     errno, __func__, HAP_FILE, __LINE__);
+            HAPFatalError();
+        }
+        HAPAssert(sin6.sin6_port);
+        port = SlNetUtil_ntohs(sin6.sin6_port);
+    }
+    HAPLogDebug(&logObject, "TCP stream listener port: %u.", port);
+
+    HAPLogDebug(&logObject, "listen(%d, 64);", fileDescriptor);
+    e = (int)SlNetSock_listen((int16_t)fileDescriptor, 64);
+    if (e != 0) {
+        ErrnoUtil_set(e);
+        HAPPlatformLogPOSIXError(kHAPLogType_Error,
+                                 "System call 'listen' on TCP stream listener socket failed.",
+                                 errno, __func__, HAP_FILE, __LINE__);
+        HAPFatalError();
+    }
+
+    *fileDescriptor_ = fileDescriptor;
+    *interfaceIndex_ = interfaceIndex;
+    *listenerPort = port;
+}
+
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformTCPStreamSocketAccept(int listenerFileDescriptor, HAPTime deadPeerTimeout, int* fileDescriptor_)
+{
+    HAPPrecondition(listenerFileDescriptor != -1);
+    HAPPrecondition(fileDescriptor_);
+
+    HAPLogDebug(&logObject, "accept(%d, NULL, NULL);", listenerFileDescriptor);
+    int fileDescriptor = (int)SlNetSock_accept((int16_t)listenerFileDescriptor, NULL, NULL);
+    if (fileDescriptor < 0) {
+        ErrnoUtil_set(fileDescriptor);
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR && errno != ECONNABORTED && errno != EPROTO) {
+            HAPPlatformLogPOSIXError(kHAPLogType_Error,
+                                     "System call 'accept' on TCP stream listener socket failed.",
+                                     errno, __func__, HAP_FILE, __LINE__);
+            return kHAPError_Unknown;
+        }
+
+        HAPLogDebug(&logObject, "System call 'accept' on TCP stream listener socket is busy.");
+        return kHAPError_Busy;
+    }
+
+    // Configure socket.
+    (void) SetNonblocking(fileDescriptor);
+    (void) SetNodelay(fileDescriptor);
+    if (deadPeerTimeout) {
+        (void) SetKeepAlive(fileDescriptor, deadPeerTimeout);
+    }
+
+    *fileDescriptor_ = fileDescriptor;
+    return kHAPError_None;
+}
+
+void HAPPlatformTCPStreamSocketShutdownOutput(int fileDescriptor)
+{
+    HAPPrecondition(fileDescriptor != -1);
+
+    HAPLogDebug(&logObject, "shutdown(%d, SHUT_WR);", fileDescriptor);
+    int e = (int)SlNetSock_shutdown((uint16_t)fileDescriptor, (uint16_t)SLNETSOCK_SHUT_WR);
+    if (e != 0 && e != SLNETERR_RET_CODE_DOESNT_SUPPORT_NON_MANDATORY_FXN) {
+        ErrnoUtil_set(e);
+        HAPPlatformLogPOSIXError(kHAPLogType_Error,
+                                 "System call 'shutdown' on TCP stream socket failed.",
+                                 errno, __func__, HAP_FILE, __LINE__);
+    }
+}
+
+void HAPPlatformTCPStreamSocketClose(int fileDescriptor)
+{
+    HAPPrecondition(fileDescriptor != -1);
+
+    int e;
+
+    HAPLogDebug(&logObject, "shutdown(%d, SHUT_RDWR);", fileDescriptor);
+    e = (int)SlNetSock_shutdown((uint16_t)fileDescriptor, (uint16_t)SLNETSOCK_SHUT_RDWR);
+    if (e != 0 && e != SLNETERR_RET_CODE_DOESNT_SUPPORT_NON_MANDATORY_FXN) {
+        ErrnoUtil_set(e);
+        HAPPlatformLogPOSIXError(kHAPLogType_Error,
+                                 "System call 'shutdown' on TCP stream socket failed.",
+                                 errno, __func__, HAP_FILE, __LINE__);
+    }
+
+    HAPLogDebug(&logObject, "close(%d);", fileDescriptor);
+    e = (int)SlNetSock_close((int16_t)fileDescriptor);
+    if (e != 0) {
+        ErrnoUtil_set(e);
+        HAPPlatformLogPOSIXError(kHAPLogType_Error,
+                                 "System call 'close' on TCP stream socket failed.",
+                                 errno, __func__, HAP_FILE, __LINE__);
+    }
+}
+
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformTCPStreamSocketSend(int fileDescriptor, const void* bytes, size_t maxBytes, size_t* numBytes)
+{
+    HAPPrecondition(fileDescriptor != -1);
+    HAPPrecondition(bytes);
+    HAPPrecondition(numBytes);
+
+    // SlNetSock returns negative error codes. ErrnoUtil_set maps them to errno.
+    int32_t n;
+    do {
+        n = SlNetSock_send((int16_t)fileDescriptor, bytes, (uint32_t)maxBytes, 0);
+        if (n < 0) {
+            ErrnoUtil_set(n);
+        }
+    } while ((n < 0) && (errno == EINTR));
+    if (n < 0) {
+        *numBytes = 0;
+        return (errno == EAGAIN || errno == EWOULDBLOCK) ? kHAPError_Busy : kHAPError_Unknown;
+    }
+
+    HAPAssert((size_t) n <= maxBytes);
+    *numBytes = (size_t) n;
+    return kHAPError_None;
+}
+
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformTCPStreamSocketReceive(int fileDescriptor, void* bytes, size_t maxBytes, size_t* numBytes)
+{
+    HAPPrecondition(fileDescriptor != -1);
+    HAPPrecondition(bytes);
+    HAPPrecondition(numBytes);
+
+    int32_t n;
+    do {
+        n = SlNetSock_recv((int16_t)fileDescriptor, bytes, (uint32_t)maxBytes, 0);
+        if (n < 0) {
+            ErrnoUtil_set(n);
+        }
+    } while ((n < 0) && (errno == EINTR));
+    if (n < 0) {
+        *numBytes = 0;
+        return (errno == EAGAIN || errno == EWOULDBLOCK) ? kHAPError_Busy : kHAPError_Unknown;
+    }
+
+    HAPAssert((size_t) n <= maxBytes);
+    *numBytes = (size_t) n;
+    return kHAPError_None;
+}
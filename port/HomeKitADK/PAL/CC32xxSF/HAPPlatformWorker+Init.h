@@ -0,0 +1,158 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+#ifndef HAP_PLATFORM_WORKER_INIT_H
+#define HAP_PLATFORM_WORKER_INIT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "HAPPlatform.h"
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull begin
+#endif
+
+/**@file
+ * Background worker for FreeRTOS.
+ *
+ * Long running work, e.g., collecting the entropy for the random number generator, is submitted from the run loop and
+ * executed on a separate task with a lower priority than the run loop task. The run loop keeps servicing sockets and
+ * timers while a job is running, and the completion of the job is reported back on the run loop.
+ *
+ * - Job contexts are allocated from the run loop payload pool and are not copied after submission.
+ *   See HAPPlatformRunLoopOptions.
+ */
+
+/**
+ * Worker initialization options.
+ */
+typedef struct {
+    /**
+     * FreeRTOS priority of the worker task. Should be lower than the priority of the run loop task.
+     */
+    uint32_t priority;
+
+    /**
+     * Stack depth of the worker task in words.
+     */
+    uint16_t stackDepth;
+
+    /**
+     * Maximum number of jobs that may be pending at the same time.
+     */
+    size_t maxJobs;
+} HAPPlatformWorkerOptions;
+
+/**
+ * Worker statistics.
+ */
+typedef struct {
+    /**
+     * Number of jobs that were submitted.
+     */
+    uint64_t numJobsSubmitted;
+
+    /**
+     * Number of jobs that were rejected because the payload pool or the job queue was exhausted.
+     */
+    uint64_t numJobsRejected;
+
+    /**
+     * Number of jobs whose completion has been reported on the run loop.
+     */
+    uint64_t numJobsCompleted;
+
+    /**
+     * Maximum number of jobs that were pending at the same time.
+     */
+    size_t maxPendingJobs;
+
+    /**
+     * Sum of the times from submission to completion of all completed jobs.
+     */
+    HAPTime totalTurnaroundTime;
+
+    /**
+     * Maximum time from submission to completion of a job.
+     */
+    HAPTime maxTurnaroundTime;
+} HAPPlatformWorkerStatistics;
+
+/**
+ * Callback that is invoked with the context of a job.
+ *
+ * @param      context              Job context.
+ * @param      contextSize          Size of the job context.
+ */
+typedef void (*HAPPlatformWorkerCallback)(void* context, size_t contextSize);
+
+/**
+ * Creates the worker.
+ *
+ * - The run loop must be created before the worker.
+ *
+ * @param      options              Initialization options.
+ */
+void HAPPlatformWorkerCreate(const HAPPlatformWorkerOptions* options);
+
+/**
+ * Releases the worker.
+ *
+ * - A running job is finished first. Its completion remains scheduled on the run loop.
+ *
+ * - Pending jobs are discarded. Their completions are not reported.
+ */
+void HAPPlatformWorkerRelease(void);
+
+/**
+ * Submits a job to the worker.
+ *
+ * - The job context is copied once into the run loop payload pool.
+ *
+ * - The job is invoked on the worker task and may modify its context in place. It must not call into the ADK or
+ *   access state that is owned by the run loop.
+ *
+ * - The completion is invoked on the run loop with the context as modified by the job.
+ *
+ * - Jobs are executed in the order in which they were submitted.
+ *
+ * - This function must be called from the run loop.
+ *
+ * @param      job                  Function to call on the worker task.
+ * @param      completion           Function to call on the run loop after the job has finished.
+ * @param      context              Job context.
+ * @param      contextSize          Size of the job context.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_OutOfResources If the payload pool or the job queue is exhausted.
+ */
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformWorkerSubmit(
+        HAPPlatformWorkerCallback job,
+        HAPPlatformWorkerCallback completion,
+        const void* _Nullable context,
+        size_t contextSize);
+
+/**
+ * Gets the worker statistics.
+ *
+ * - This function must be called from the run loop.
+ *
+ * @param[out] statistics           Worker statistics.
+ */
+void HAPPlatformWorkerGetStatistics(HAPPlatformWorkerStatistics* statistics);
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull end
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
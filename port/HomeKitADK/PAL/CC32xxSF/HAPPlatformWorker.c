@@ -0,0 +1,207 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+#include <FreeRTOS.h>
+#include <queue.h>
+#include <task.h>
+
+#include "HAPPlatform.h"
+#include "HAPPlatformRunLoop+Init.h"
+#include "HAPPlatformWorker+Init.h"
+
+static const HAPLogObject logObject = { .subsystem = kHAPPlatform_LogSubsystem, .category = "Worker" };
+
+/**
+ * Job header. Allocated from the run loop payload pool and followed by the job context.
+ */
+typedef struct {
+    /** Function to call on the worker task. */
+    HAPPlatformWorkerCallback job;
+
+    /** Function to call on the run loop after the job has finished. */
+    HAPPlatformWorkerCallback completion;
+
+    /** Size of the job context. */
+    size_t contextSize;
+
+    /** Time at which the job was submitted. */
+    HAPTime submitTime;
+} WorkerJob;
+HAP_STATIC_ASSERT(sizeof(WorkerJob) % 8 == 0, WorkerJob_PreservesAlignment);
+
+static struct {
+    /** Worker task. */
+    TaskHandle_t _Nullable task;
+
+    /** Queue of submitted jobs. A NULL job asks the worker task to stop. */
+    QueueHandle_t _Nullable queue;
+
+    /** Task that waits for the worker task to stop. */
+    TaskHandle_t _Nullable releasingTask;
+
+    /** Number of jobs whose completion has not been reported yet. */
+    size_t numPendingJobs;
+
+    /** Statistics. */
+    HAPPlatformWorkerStatistics statistics;
+} worker = { .task = NULL, .queue = NULL, .releasingTask = NULL, .numPendingJobs = 0 };
+
+static void* GetJobContext(WorkerJob* job)
+{
+    HAPPrecondition(job);
+
+    return (uint8_t*) job + sizeof *job;
+}
+
+static void HandleJobCompletion(void* _Nullable context, size_t contextSize)
+{
+    HAPPrecondition(context);
+    HAPPrecondition(contextSize >= sizeof(WorkerJob));
+
+    WorkerJob* job = context;
+    HAPAssert(contextSize == sizeof *job + job->contextSize);
+
+    HAPTime turnaroundTime = HAPPlatformClockGetCurrent() - job->submitTime;
+    worker.statistics.numJobsCompleted++;
+    worker.statistics.totalTurnaroundTime += turnaroundTime;
+    if (turnaroundTime > worker.statistics.maxTurnaroundTime) {
+        worker.statistics.maxTurnaroundTime = turnaroundTime;
+    }
+    HAPAssert(worker.numPendingJobs);
+    worker.numPendingJobs--;
+
+    job->completion(GetJobContext(job), job->contextSize);
+}
+
+static void WorkerTask(void* _Nullable pvParameters HAP_UNUSED)
+{
+    for (;;) {
+        WorkerJob* job;
+        if (xQueueReceive(worker.queue, &job, portMAX_DELAY) != pdPASS) {
+            continue;
+        }
+        if (!job) {
+            break;
+        }
+
+        job->job(GetJobContext(job), job->contextSize);
+
+        // The job header and context are passed back to the run loop without copying.
+        HAPError err =
+                HAPPlatformRunLoopSchedulePayloadCallback(HandleJobCompletion, job, sizeof *job + job->contextSize);
+        if (err) {
+            HAPAssert(err == kHAPError_Unknown);
+            HAPLogError(&logObject, "Failed to report job completion.");
+            HAPFatalError();
+        }
+    }
+
+    // The job that was running has finished. Its completion remains scheduled on the run loop.
+    xTaskNotifyGive(HAPNonnull(worker.releasingTask));
+    vTaskDelete(NULL);
+}
+
+void HAPPlatformWorkerCreate(const HAPPlatformWorkerOptions* options)
+{
+    HAPPrecondition(options);
+    HAPPrecondition(options->maxJobs);
+    HAPPrecondition(!worker.task);
+
+    HAPLogDebug(&logObject, "Storage configuration: worker = %lu", (unsigned long) sizeof worker);
+    HAPLogDebug(&logObject, "Storage configuration: maxJobs = %lu", (unsigned long) options->maxJobs);
+
+    worker.queue = xQueueCreate(options->maxJobs, sizeof(WorkerJob*));
+    if (!worker.queue) {
+        HAPLogError(&logObject, "Failed to create job queue.");
+        HAPFatalError();
+    }
+
+    TaskHandle_t task;
+    BaseType_t rc = xTaskCreate(WorkerTask, "Worker", options->stackDepth, NULL, options->priority, &task);
+    if (rc != pdPASS) {
+        HAPLogError(&logObject, "Failed to create worker task.");
+        HAPFatalError();
+    }
+    worker.task = task;
+
+    worker.numPendingJobs = 0;
+    HAPRawBufferZero(&worker.statistics, sizeof worker.statistics);
+}
+
+void HAPPlatformWorkerRelease(void)
+{
+    if (worker.task) {
+        // Deleting the worker task while it runs a job could leave the job's resources, e.g. a SimpleLink request,
+        // in an undefined state. The stop request is queued ahead of the pending jobs, and the worker task deletes
+        // itself once the running job has finished.
+        worker.releasingTask = xTaskGetCurrentTaskHandle();
+        WorkerJob* stopRequest = NULL;
+        BaseType_t rc = xQueueSendToFront(worker.queue, &stopRequest, portMAX_DELAY);
+        HAPAssert(rc == pdPASS);
+        (void) ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        worker.releasingTask = NULL;
+        worker.task = NULL;
+    }
+    if (worker.queue) {
+        WorkerJob* job;
+        while (xQueueReceive(worker.queue, &job, 0) == pdPASS) {
+            HAPPlatformRunLoopReleasePayload(job);
+            HAPAssert(worker.numPendingJobs);
+            worker.numPendingJobs--;
+        }
+        vQueueDelete(worker.queue);
+        worker.queue = NULL;
+    }
+}
+
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformWorkerSubmit(
+        HAPPlatformWorkerCallback job,
+        HAPPlatformWorkerCallback completion,
+        const void* _Nullable context,
+        size_t contextSize)
+{
+    HAPPrecondition(job);
+    HAPPrecondition(completion);
+    HAPPrecondition(!contextSize || context);
+    HAPPrecondition(worker.queue);
+
+    worker.statistics.numJobsSubmitted++;
+
+    WorkerJob* workerJob = HAPPlatformRunLoopAllocatePayload(sizeof *workerJob + contextSize);
+    if (!workerJob) {
+        HAPLog(&logObject, "Cannot submit job: Payload pool exhausted.");
+        worker.statistics.numJobsRejected++;
+        return kHAPError_OutOfResources;
+    }
+    workerJob->job = job;
+    workerJob->completion = completion;
+    workerJob->contextSize = contextSize;
+    workerJob->submitTime = HAPPlatformClockGetCurrent();
+    if (contextSize) {
+        HAPRawBufferCopyBytes(GetJobContext(workerJob), HAPNonnullVoid(context), contextSize);
+    }
+
+    if (xQueueSend(worker.queue, &workerJob, 0) != pdPASS) {
+        HAPLog(&logObject, "Cannot submit job: Job queue full.");
+        HAPPlatformRunLoopReleasePayload(workerJob);
+        worker.statistics.numJobsRejected++;
+        return kHAPError_OutOfResources;
+    }
+
+    worker.numPendingJobs++;
+    if (worker.numPendingJobs > worker.statistics.maxPendingJobs) {
+        worker.statistics.maxPendingJobs = worker.numPendingJobs;
+    }
+    return kHAPError_None;
+}
+
+void HAPPlatformWorkerGetStatistics(HAPPlatformWorkerStatistics* statistics)
+{
+    HAPPrecondition(statistics);
+
+    *statistics = worker.statistics;
+}
@@ -0,0 +1,45 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+#ifndef HAP_PLATFORM_CRITICAL_SECTION_H
+#define HAP_PLATFORM_CRITICAL_SECTION_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "HAPPlatform.h"
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull begin
+#endif
+
+/**@file
+ * Critical section for state that the shared platform code accesses from more than one task or thread.
+ *
+ * Each backend provides the implementation: FreeRTOS critical sections on CC32xxSF, a recursive mutex on Linux.
+ * Critical sections may be nested and must be kept short. No blocking calls may be made within a critical section.
+ */
+
+/**
+ * Enters the critical section.
+ */
+void HAPPlatformEnterCriticalSection(void);
+
+/**
+ * Exits the critical section.
+ */
+void HAPPlatformExitCriticalSection(void);
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull end
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
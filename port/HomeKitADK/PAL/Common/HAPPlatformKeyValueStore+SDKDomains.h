@@ -57,6 +57,28 @@ extern "C" {
  */
 #define kSDKKeyValueStoreKey_Provisioning_MFiToken ((HAPPlatformKeyValueStoreKey) 0x21)
 
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Platform diagnostics.
+ *
+ * Purged: Never.
+ */
+#define kSDKKeyValueStoreDomain_Diagnostics ((HAPPlatformKeyValueStoreDomain) 0x41)
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Most recent run loop stalls.
+ *
+ * Format: Version (1 byte, 1), number of stalls (1 byte), followed by the stalls, most recent first:
+ *         - Source (1 byte, HAPPlatformRunLoopDispatchSource).
+ *         - Callback address (8 bytes, little endian).
+ *         - Timestamp (8 bytes, little endian).
+ *         - Duration (8 bytes, little endian).
+ */
+#define kSDKKeyValueStoreKey_Diagnostics_RunLoopStalls ((HAPPlatformKeyValueStoreKey) 0x00)
+
 #ifdef __cplusplus
 }
 #endif
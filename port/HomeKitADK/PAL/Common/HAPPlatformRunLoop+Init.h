@@ -0,0 +1,354 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+#ifndef HAP_PLATFORM_RUN_LOOP_INIT_H
+#define HAP_PLATFORM_RUN_LOOP_INIT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "HAPPlatform.h"
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull begin
+#endif
+
+/**@file
+ * Global run loop.
+ *
+ * This header is shared by the run loop backends: CC32xxSF waits on SimpleLink sockets with SlNetSock_select, and
+ * Linux waits on file descriptors with epoll. Timers, scheduled callbacks and the watchdog are common to both.
+ *
+ * The backends implement the following platform modules:
+ * - HAPPlatformRunLoop
+ * - HAPPlatformTimer
+ * - HAPPlatformFileHandle (backend-specific descriptors, see HAPPlatformFileHandle.h)
+ */
+
+/**
+ * Run loop initialization options.
+ */
+typedef struct {
+    /**
+     * Key-value store.
+     */
+    HAPPlatformKeyValueStoreRef keyValueStore;
+
+    /**
+     * Leeway of timers registered with HAPPlatformTimerRegister.
+     *
+     * - Timers may fire up to this amount of time after their deadline, so that timers with nearby deadlines are
+     *   processed by a single run loop wakeup. Timers never fire before their deadline.
+     *
+     * - 0 fires timers as close to their deadline as possible.
+     */
+    HAPTime timerLeeway;
+
+    /**
+     * Storage for payloads of callbacks scheduled with HAPPlatformRunLoopSchedulePayloadCallback.
+     *
+     * - Must be 8-byte aligned. May be empty if payload callbacks are not used.
+     *
+     * - Each payload occupies its size rounded up to a multiple of 8 bytes, plus an 8-byte header.
+     */
+    struct {
+        void* _Nullable bytes;
+        size_t numBytes;
+    } payloadPool;
+
+    /**
+     * Maximum duration of a single dispatch before it is recorded as a stall.
+     *
+     * - A dispatch is the invocation of a timer callback, of a file handle callback, or of a callback scheduled with
+     *   HAPPlatformRunLoopScheduleCallback or HAPPlatformRunLoopSchedulePayloadCallback.
+     *
+     * - Stalls are stored in the key-value store and are retained across resets.
+     *
+     * - 0 disables stall detection.
+     */
+    HAPTime dispatchBudget;
+} HAPPlatformRunLoopOptions;
+
+/**
+ * Run loop statistics.
+ */
+typedef struct {
+    /**
+     * Number of run loop iterations that expired at least one timer.
+     */
+    uint64_t numTimerWakeups;
+
+    /**
+     * Number of timers that expired.
+     */
+    uint64_t numTimersFired;
+
+    /**
+     * Number of timers that expired after their deadline plus leeway, e.g., because of a long running callback.
+     */
+    uint64_t numTimersLate;
+
+    /**
+     * Number of timer wakeups that were saved by the leeway of the first timer that expired in a run loop iteration.
+     *
+     * - Each later distinct deadline within that leeway counts once. Timers that expire together only because they
+     *   are overdue do not count.
+     */
+    uint64_t numWakeupsSaved;
+
+    /**
+     * Number of payloads allocated from the payload pool.
+     */
+    uint64_t numPayloadsAllocated;
+
+    /**
+     * Number of payload allocations that failed because the payload pool was exhausted.
+     */
+    uint64_t numPayloadAllocationFailures;
+
+    /**
+     * Maximum number of payload pool bytes in use at the same time.
+     */
+    size_t maxPayloadPoolBytesUsed;
+
+    /**
+     * Number of times the clock was advanced to the next timer wakeup because no I/O was pending.
+     *
+     * - Only used if the platform clock supports virtual time.
+     */
+    uint64_t numVirtualTimeJumps;
+} HAPPlatformRunLoopStatistics;
+
+/**
+ * Maximum number of stalls that are retained by the run loop.
+ */
+#define kHAPPlatformRunLoop_MaxStalls ((size_t) 8)
+
+/**
+ * Maximum number of distinct callbacks for which stalls are counted.
+ */
+#define kHAPPlatformRunLoop_MaxStallSources ((size_t) 8)
+
+/**
+ * Kind of run loop dispatch.
+ */
+HAP_ENUM_BEGIN(uint8_t, HAPPlatformRunLoopDispatchSource) { /**
+                                                             * Timer callback.
+                                                             */
+                                                            kHAPPlatformRunLoopDispatchSource_Timer = 1,
+
+                                                            /**
+                                                             * File handle callback.
+                                                             */
+                                                            kHAPPlatformRunLoopDispatchSource_FileHandle,
+
+                                                            /**
+                                                             * Scheduled callback.
+                                                             */
+                                                            kHAPPlatformRunLoopDispatchSource_Callback
+} HAP_ENUM_END(uint8_t, HAPPlatformRunLoopDispatchSource);
+
+/**
+ * Dispatch that exceeded the dispatch budget.
+ */
+typedef struct {
+    /**
+     * Kind of dispatch.
+     */
+    HAPPlatformRunLoopDispatchSource source;
+
+    /**
+     * Whether the stall was recorded before the last reset.
+     */
+    bool isFromPreviousBoot;
+
+    /**
+     * Address of the callback that was invoked.
+     */
+    uint64_t callback;
+
+    /**
+     * Time at which the dispatch started.
+     */
+    HAPTime timestamp;
+
+    /**
+     * Duration of the dispatch.
+     */
+    HAPTime duration;
+} HAPPlatformRunLoopStall;
+
+/**
+ * Number of stalls of a callback.
+ */
+typedef struct {
+    /**
+     * Kind of dispatch.
+     */
+    HAPPlatformRunLoopDispatchSource source;
+
+    /**
+     * Address of the callback, or 0 for the stalls of callbacks that did not fit into the table.
+     */
+    uint64_t callback;
+
+    /**
+     * Number of stalls since the run loop was created.
+     */
+    uint64_t numStalls;
+
+    /**
+     * Maximum duration of a stalled dispatch.
+     */
+    HAPTime maxDuration;
+} HAPPlatformRunLoopStallSource;
+
+/**
+ * Create run loop.
+ */
+void HAPPlatformRunLoopCreate(const HAPPlatformRunLoopOptions* options);
+
+/**
+ * Release run loop.
+ */
+void HAPPlatformRunLoopRelease(void);
+
+/**
+ * Schedule callback to HAPPlatformRunLoopStop.
+ */
+void HAPPlatformRunLoopRequestStop(void);
+
+/**
+ * Registers a timer that may fire up to a given amount of time after its deadline.
+ *
+ * - Behaves like HAPPlatformTimerRegister, but uses the given leeway instead of the run loop default.
+ *
+ * - The timer fires in the interval [deadline, deadline + leeway] unless the run loop is blocked by a callback.
+ *
+ * @param[out] timer                Non-zero Timer object if successful.
+ * @param      deadline             Deadline after which the timer expires.
+ * @param      leeway               Maximum amount of time by which the timer may be deferred after its deadline.
+ * @param      callback             Function to call when the timer expires.
+ * @param      context              Context that is passed to the callback.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_OutOfResources If no more timers can be allocated.
+ */
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformTimerRegisterWithLeeway(
+        HAPPlatformTimerRef* timer,
+        HAPTime deadline,
+        HAPTime leeway,
+        HAPPlatformTimerCallback callback,
+        void* _Nullable context);
+
+/**
+ * Callback that is invoked before the run loop waits for events.
+ *
+ * @param      context              Context.
+ */
+typedef void (*HAPPlatformRunLoopBeforeWaitCallback)(void* _Nullable context);
+
+/**
+ * Sets the callback that is invoked each time before the run loop waits for events.
+ *
+ * - Work that is deferred during a run loop iteration, e.g. coalesced writes, can be completed there before the run
+ *   loop blocks. The file handle interests that the callback updates take effect for the wait that follows.
+ *
+ * - There is a single callback. It is used by the TCP stream manager.
+ *
+ * @param      callback             Function to call, or NULL to clear the callback.
+ * @param      context              Context that is passed to the callback.
+ */
+void HAPPlatformRunLoopSetBeforeWaitCallback(
+        HAPPlatformRunLoopBeforeWaitCallback _Nullable callback,
+        void* _Nullable context);
+
+/**
+ * Allocates a payload from the payload pool.
+ *
+ * - The payload is passed to the run loop with HAPPlatformRunLoopSchedulePayloadCallback, which avoids the context
+ *   size limit and the context copies of HAPPlatformRunLoopScheduleCallback.
+ *
+ * - This function may be called from any thread.
+ *
+ * @param      numBytes             Size of the payload.
+ *
+ * @return 8-byte aligned payload if successful.
+ * @return NULL if the payload pool does not have a contiguous region of sufficient size.
+ */
+void* _Nullable HAPPlatformRunLoopAllocatePayload(size_t numBytes);
+
+/**
+ * Releases a payload that has not been scheduled.
+ *
+ * - This function may be called from any thread.
+ *
+ * @param      payload              Payload allocated with HAPPlatformRunLoopAllocatePayload.
+ */
+void HAPPlatformRunLoopReleasePayload(void* payload);
+
+/**
+ * Schedules a callback that will be called from the run loop with a payload.
+ *
+ * - Only a handle to the payload is passed to the run loop. The callback is invoked with the payload and its size,
+ *   and the payload is released when the callback returns.
+ *
+ * - Payload callbacks and callbacks scheduled with HAPPlatformRunLoopScheduleCallback are invoked in the order in
+ *   which they were scheduled.
+ *
+ * - This function may be called from any thread.
+ *
+ * @param      callback             Function to call on the run loop.
+ * @param      payload              Payload allocated with HAPPlatformRunLoopAllocatePayload.
+ * @param      numPayloadBytes      Size of the payload that is passed to the callback.
+ *
+ * @return kHAPError_None           If successful. Ownership of the payload is transferred to the run loop.
+ * @return kHAPError_Unknown        If the callback could not be scheduled. The payload remains allocated.
+ */
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformRunLoopSchedulePayloadCallback(
+        HAPPlatformRunLoopCallback callback,
+        void* payload,
+        size_t numPayloadBytes);
+
+/**
+ * Gets the most recent stalls.
+ *
+ * @param[out] stalls               Stalls, most recent first.
+ * @param      maxStalls            Capacity of the stalls array.
+ *
+ * @return Number of stalls that were written to the stalls array.
+ */
+size_t HAPPlatformRunLoopGetStalls(HAPPlatformRunLoopStall* stalls, size_t maxStalls);
+
+/**
+ * Gets the number of stalls per callback.
+ *
+ * @param[out] stallSources         Stall counts, in order of first occurrence.
+ * @param      maxStallSources      Capacity of the stall sources array.
+ *
+ * @return Number of stall counts that were written to the stall sources array.
+ */
+size_t HAPPlatformRunLoopGetStallSources(HAPPlatformRunLoopStallSource* stallSources, size_t maxStallSources);
+
+/**
+ * Gets the run loop statistics.
+ *
+ * @param[out] statistics           Run loop statistics.
+ */
+void HAPPlatformRunLoopGetStatistics(HAPPlatformRunLoopStatistics* statistics);
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull end
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
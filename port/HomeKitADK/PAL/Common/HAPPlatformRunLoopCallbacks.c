@@ -0,0 +1,251 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+#include "HAPPlatform.h"
+#include "HAPPlatformCriticalSection.h"
+#include "HAPPlatformRunLoop+Init.h"
+#include "HAPPlatformRunLoopCallbacks.h"
+#include "HAPPlatformRunLoopWatchdog.h"
+
+/**
+ * Payload block header.
+ */
+typedef struct {
+    /**
+     * Size of the block in bytes, including the header.
+     */
+    uint32_t numBytes;
+
+    /**
+     * Whether the block is allocated. Released blocks are reclaimed once all earlier blocks have been released.
+     */
+    bool isAllocated;
+} PayloadHeader;
+HAP_STATIC_ASSERT(sizeof(PayloadHeader) == 8, PayloadHeader);
+
+/**
+ * Context of a scheduled payload callback, as serialized through the loopback.
+ */
+typedef struct {
+    HAPPlatformRunLoopCallback callback;
+    void* payload;
+    size_t numPayloadBytes;
+} PayloadCallbackContext;
+
+/**
+ * Pool for payloads of callbacks scheduled with HAPPlatformRunLoopSchedulePayloadCallback.
+ *
+ * - Payloads are allocated as blocks from a ring buffer. Released blocks are reclaimed in allocation order, so
+ *   a payload that is held for a long time delays the reuse of the blocks allocated after it.
+ *
+ * - Payloads may be allocated and released from any task or thread. Access is protected by the critical section.
+ */
+static struct {
+    uint8_t* _Nullable bytes;
+    size_t numBytes;
+    size_t head;
+    size_t tail;
+    size_t numUsedBytes;
+
+    uint64_t numPayloadsAllocated;
+    uint64_t numPayloadAllocationFailures;
+    size_t maxPayloadPoolBytesUsed;
+} payloadPool;
+
+void HAPPlatformRunLoopCallbacksCreate(const HAPPlatformRunLoopOptions* options)
+{
+    HAPPrecondition(options);
+    HAPPrecondition(!options->payloadPool.numBytes || options->payloadPool.bytes);
+    HAPPrecondition(!((uintptr_t) options->payloadPool.bytes % 8));
+    HAPPrecondition(options->payloadPool.numBytes <= UINT32_MAX);
+
+    HAPPlatformEnterCriticalSection();
+    HAPRawBufferZero(&payloadPool, sizeof payloadPool);
+    payloadPool.bytes = options->payloadPool.bytes;
+    payloadPool.numBytes = options->payloadPool.numBytes & ~(size_t) 7;
+    HAPPlatformExitCriticalSection();
+}
+
+void HAPPlatformRunLoopCallbacksGetStatistics(HAPPlatformRunLoopStatistics* statistics)
+{
+    HAPPrecondition(statistics);
+
+    HAPPlatformEnterCriticalSection();
+    statistics->numPayloadsAllocated = payloadPool.numPayloadsAllocated;
+    statistics->numPayloadAllocationFailures = payloadPool.numPayloadAllocationFailures;
+    statistics->maxPayloadPoolBytesUsed = payloadPool.maxPayloadPoolBytesUsed;
+    HAPPlatformExitCriticalSection();
+}
+
+void* _Nullable HAPPlatformRunLoopAllocatePayload(size_t numBytes)
+{
+    void* _Nullable payload = NULL;
+
+    HAPPlatformEnterCriticalSection();
+    if (payloadPool.bytes && payloadPool.numBytes > sizeof(PayloadHeader) &&
+        numBytes <= payloadPool.numBytes - sizeof(PayloadHeader)) {
+        size_t numBlockBytes = (sizeof(PayloadHeader) + numBytes + 7) & ~(size_t) 7;
+        size_t numPoolBytes = payloadPool.numBytes;
+
+        if (!payloadPool.numUsedBytes) {
+            payloadPool.head = 0;
+            payloadPool.tail = 0;
+        }
+
+        // Find a contiguous region at the head of the ring buffer.
+        bool isFull = payloadPool.numUsedBytes && payloadPool.head == payloadPool.tail;
+        bool hasSpace = false;
+        if (isFull) {
+            hasSpace = false;
+        } else if (payloadPool.head >= payloadPool.tail) {
+            if (numPoolBytes - payloadPool.head >= numBlockBytes) {
+                hasSpace = true;
+            } else if (payloadPool.tail >= numBlockBytes) {
+                // Skip the remainder of the ring buffer with a released block.
+                PayloadHeader* padding = (PayloadHeader*) &payloadPool.bytes[payloadPool.head];
+                padding->numBytes = (uint32_t)(numPoolBytes - payloadPool.head);
+                padding->isAllocated = false;
+                payloadPool.numUsedBytes += padding->numBytes;
+                payloadPool.head = 0;
+                hasSpace = true;
+            }
+        } else {
+            hasSpace = payloadPool.tail - payloadPool.head >= numBlockBytes;
+        }
+
+        if (hasSpace) {
+            PayloadHeader* header = (PayloadHeader*) &payloadPool.bytes[payloadPool.head];
+            header->numBytes = (uint32_t) numBlockBytes;
+            header->isAllocated = true;
+            payloadPool.head += numBlockBytes;
+            if (payloadPool.head == numPoolBytes) {
+                payloadPool.head = 0;
+            }
+            payloadPool.numUsedBytes += numBlockBytes;
+            if (payloadPool.numUsedBytes > payloadPool.maxPayloadPoolBytesUsed) {
+                payloadPool.maxPayloadPoolBytesUsed = payloadPool.numUsedBytes;
+            }
+            payloadPool.numPayloadsAllocated++;
+            payload = &header[1];
+        }
+    }
+    if (!payload) {
+        payloadPool.numPayloadAllocationFailures++;
+    }
+    HAPPlatformExitCriticalSection();
+
+    return payload;
+}
+
+void HAPPlatformRunLoopReleasePayload(void* payload)
+{
+    HAPPrecondition(payload);
+    HAPPrecondition(payloadPool.bytes);
+    HAPPrecondition((uint8_t*) payload >= &payloadPool.bytes[sizeof(PayloadHeader)]);
+    HAPPrecondition((uint8_t*) payload < &payloadPool.bytes[payloadPool.numBytes]);
+
+    HAPPlatformEnterCriticalSection();
+    PayloadHeader* header = &((PayloadHeader*) payload)[-1];
+    HAPAssert(header->isAllocated);
+    header->isAllocated = false;
+
+    // Reclaim released blocks at the tail of the ring buffer.
+    while (payloadPool.numUsedBytes) {
+        PayloadHeader* tail = (PayloadHeader*) &payloadPool.bytes[payloadPool.tail];
+        if (tail->isAllocated) {
+            break;
+        }
+        HAPAssert(tail->numBytes <= payloadPool.numUsedBytes);
+        payloadPool.numUsedBytes -= tail->numBytes;
+        payloadPool.tail += tail->numBytes;
+        if (payloadPool.tail == payloadPool.numBytes) {
+            payloadPool.tail = 0;
+        }
+    }
+    HAPPlatformExitCriticalSection();
+}
+
+static void HandlePayloadCallback(void* _Nullable context, size_t contextSize)
+{
+    HAPPrecondition(context);
+    HAPPrecondition(contextSize == sizeof(PayloadCallbackContext));
+
+    PayloadCallbackContext payloadContext;
+    HAPRawBufferCopyBytes(&payloadContext, context, sizeof payloadContext);
+
+    payloadContext.callback(payloadContext.payload, payloadContext.numPayloadBytes);
+    HAPPlatformRunLoopReleasePayload(payloadContext.payload);
+}
+
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformRunLoopSchedulePayloadCallback(HAPPlatformRunLoopCallback callback,
+                                                   void* payload,
+                                                   size_t numPayloadBytes)
+{
+    HAPPrecondition(callback);
+    HAPPrecondition(payload);
+
+    // Only the payload handle is passed through the loopback. The payload itself is not copied.
+    PayloadCallbackContext payloadContext = { .callback = callback,
+                                              .payload = payload,
+                                              .numPayloadBytes = numPayloadBytes };
+    return HAPPlatformRunLoopScheduleCallback(HandlePayloadCallback, &payloadContext, sizeof payloadContext);
+}
+
+/**
+ * Gets the address of the callback to which the dispatch of a scheduled callback is attributed.
+ *
+ * - Payload callbacks are attributed to the scheduled callback instead of the trampoline that releases the payload.
+ */
+static uintptr_t GetScheduledCallbackAddress(HAPPlatformRunLoopCallback callback,
+                                             const void* _Nullable context,
+                                             size_t contextSize)
+{
+    HAPPrecondition(callback);
+
+    if (callback == HandlePayloadCallback && contextSize == sizeof(PayloadCallbackContext)) {
+        PayloadCallbackContext payloadContext;
+        HAPRawBufferCopyBytes(&payloadContext, HAPNonnullVoid(context), sizeof payloadContext);
+        return (uintptr_t) payloadContext.callback;
+    }
+    return (uintptr_t) callback;
+}
+
+void HAPPlatformRunLoopCallbacksDispatch(char* bytes, size_t* numBytes)
+{
+    HAPPrecondition(bytes);
+    HAPPrecondition(numBytes);
+
+    for (;;) {
+        if (*numBytes < sizeof (HAPPlatformRunLoopCallback) + 1) {
+            break;
+        }
+        size_t contextSize = (size_t) (uint8_t) bytes[sizeof (HAPPlatformRunLoopCallback)];
+        if (*numBytes < sizeof (HAPPlatformRunLoopCallback) + 1 + contextSize) {
+            break;
+        }
+
+        HAPPlatformRunLoopCallback callback;
+        HAPRawBufferCopyBytes(&callback, &bytes[0], sizeof (HAPPlatformRunLoopCallback));
+        HAPRawBufferCopyBytes(
+            &bytes[0],
+            &bytes[sizeof (HAPPlatformRunLoopCallback) + 1],
+            *numBytes - (sizeof (HAPPlatformRunLoopCallback) + 1));
+        *numBytes -= (sizeof (HAPPlatformRunLoopCallback) + 1);
+
+        // Issue memory barrier to ensure visibility of data referenced by callback context.
+        __sync_synchronize();
+
+        uintptr_t callbackAddress = GetScheduledCallbackAddress(callback, contextSize ? &bytes[0] : NULL, contextSize);
+        HAPTime dispatchStartTime = HAPPlatformRunLoopWatchdogBeginDispatch();
+        callback(contextSize ? &bytes[0] : NULL, contextSize);
+        HAPPlatformRunLoopWatchdogEndDispatch(
+            kHAPPlatformRunLoopDispatchSource_Callback, callbackAddress, dispatchStartTime);
+
+        HAPRawBufferCopyBytes(&bytes[0], &bytes[contextSize], *numBytes - contextSize);
+        *numBytes -= contextSize;
+    }
+}
@@ -0,0 +1,67 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+#ifndef HAP_PLATFORM_RUN_LOOP_CALLBACKS_H
+#define HAP_PLATFORM_RUN_LOOP_CALLBACKS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "HAPPlatform.h"
+#include "HAPPlatformRunLoop+Init.h"
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull begin
+#endif
+
+/**@file
+ * Scheduled run loop callbacks and their payloads.
+ *
+ * Each run loop implementation transports callbacks scheduled with HAPPlatformRunLoopScheduleCallback through its
+ * own loopback, serialized as:
+ * - Callback pointer.
+ * - Context size (up to UINT8_MAX).
+ * - Context (unaligned).
+ *
+ * This module dispatches the received callbacks and implements the payload pool of
+ * HAPPlatformRunLoopSchedulePayloadCallback, which only passes a handle to the payload through the loopback.
+ */
+
+/**
+ * Initializes the payload pool.
+ *
+ * @param      options              Run loop initialization options.
+ */
+void HAPPlatformRunLoopCallbacksCreate(const HAPPlatformRunLoopOptions* options);
+
+/**
+ * Invokes the callbacks that have been completely received through the loopback.
+ *
+ * - Each context is moved to the start of the buffer before its callback is invoked, so that it is 8-byte aligned.
+ *
+ * @param      bytes                8-byte aligned loopback buffer.
+ * @param[in,out] numBytes          Number of received bytes. On output, the number of bytes of a partially received
+ *                                  callback that remain at the start of the buffer.
+ */
+void HAPPlatformRunLoopCallbacksDispatch(char* bytes, size_t* numBytes);
+
+/**
+ * Gets the payload pool statistics.
+ *
+ * @param[in,out] statistics        Run loop statistics, of which the payload pool fields are set.
+ */
+void HAPPlatformRunLoopCallbacksGetStatistics(HAPPlatformRunLoopStatistics* statistics);
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull end
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,206 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Copyright (c) 2022 John Buonagurio
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+// Tests of the scheduled callbacks and the payload pool of the run loop, run by the host build on a virtual clock.
+
+#include "HAPPlatform.h"
+#include "HAPPlatformClock+Init.h"
+#include "HAPPlatformKeyValueStore+Init.h"
+#include "HAPPlatformRunLoop+Init.h"
+
+static const HAPLogObject logObject = { .subsystem = kHAPPlatform_LogSubsystem, .category = "RunLoopTest" };
+
+/**
+ * Key-value store of the run loop. It is only used by the run loop watchdog, which is not enabled.
+ */
+static HAPPlatformKeyValueStore keyValueStore;
+
+/**
+ * Storage of the payload pool.
+ */
+static uint64_t payloadPoolBytes[32];
+
+/**
+ * Size of a payload block with a payload of 24 bytes: 8-byte header plus the payload.
+ */
+#define kNumBlockBytes ((size_t) 32)
+
+static void StopRunLoop(HAPPlatformTimerRef timer, void* _Nullable context)
+{
+    (void) timer;
+    (void) context;
+    HAPPlatformRunLoopStop();
+}
+
+/**
+ * Runs the run loop for a while.
+ *
+ * @param      duration             Time to run the run loop.
+ */
+static void RunFor(HAPTime duration)
+{
+    HAPPlatformTimerRef timer;
+    HAPError err = HAPPlatformTimerRegister(&timer, HAPPlatformClockGetCurrent() + duration, StopRunLoop, NULL);
+    HAPAssert(!err);
+    HAPPlatformRunLoopRun();
+}
+
+static HAPPlatformRunLoopStatistics GetStatistics(void)
+{
+    HAPPlatformRunLoopStatistics statistics;
+    HAPPlatformRunLoopGetStatistics(&statistics);
+    return statistics;
+}
+
+/**
+ * When the payload pool is exhausted, allocations fail and are counted. Blocks are reclaimed in allocation order, so
+ * releasing a later block does not make room while an earlier one is held.
+ */
+static void TestPayloadPoolExhaustion(void)
+{
+    HAPLogInfo(&logObject, "%s", __func__);
+
+    HAPPlatformRunLoopStatistics statistics = GetStatistics();
+    void* _Nullable payloads[sizeof payloadPoolBytes / kNumBlockBytes];
+    for (size_t i = 0; i < HAPArrayCount(payloads); i++) {
+        payloads[i] = HAPPlatformRunLoopAllocatePayload(kNumBlockBytes - 8);
+        HAPAssert(payloads[i]);
+        HAPAssert(!((uintptr_t) payloads[i] % 8));
+    }
+    HAPAssert(!HAPPlatformRunLoopAllocatePayload(1));
+    HAPPlatformRunLoopStatistics newStatistics = GetStatistics();
+    HAPAssert(newStatistics.numPayloadsAllocated - statistics.numPayloadsAllocated == HAPArrayCount(payloads));
+    HAPAssert(newStatistics.numPayloadAllocationFailures == statistics.numPayloadAllocationFailures + 1);
+    HAPAssert(newStatistics.maxPayloadPoolBytesUsed == sizeof payloadPoolBytes);
+
+    // A released block is only reclaimed once the blocks allocated before it have been released.
+    HAPPlatformRunLoopReleasePayload(HAPNonnullVoid(payloads[3]));
+    HAPAssert(!HAPPlatformRunLoopAllocatePayload(1));
+    HAPPlatformRunLoopReleasePayload(HAPNonnullVoid(payloads[0]));
+    payloads[0] = HAPPlatformRunLoopAllocatePayload(kNumBlockBytes - 8);
+    HAPAssert(payloads[0]);
+    HAPAssert(!HAPPlatformRunLoopAllocatePayload(1));
+
+    HAPPlatformRunLoopReleasePayload(HAPNonnullVoid(payloads[0]));
+    for (size_t i = 1; i < HAPArrayCount(payloads); i++) {
+        if (i != 3) {
+            HAPPlatformRunLoopReleasePayload(HAPNonnullVoid(payloads[i]));
+        }
+    }
+
+    // A payload that does not fit at the end of the pool wraps around to the start of the pool once it is free.
+    void* _Nullable a = HAPPlatformRunLoopAllocatePayload(2 * kNumBlockBytes - 8);
+    void* _Nullable b = HAPPlatformRunLoopAllocatePayload(4 * kNumBlockBytes - 8);
+    void* _Nullable c = HAPPlatformRunLoopAllocatePayload(kNumBlockBytes - 8);
+    HAPAssert(a && b && c);
+    HAPAssert(!HAPPlatformRunLoopAllocatePayload(2 * kNumBlockBytes - 8));
+    HAPPlatformRunLoopReleasePayload(HAPNonnullVoid(a));
+    void* _Nullable d = HAPPlatformRunLoopAllocatePayload(2 * kNumBlockBytes - 8);
+    HAPAssert(d == a);
+    HAPAssert(!HAPPlatformRunLoopAllocatePayload(1));
+    HAPPlatformRunLoopReleasePayload(HAPNonnullVoid(b));
+    HAPPlatformRunLoopReleasePayload(HAPNonnullVoid(c));
+    HAPPlatformRunLoopReleasePayload(HAPNonnullVoid(d));
+
+    // Once all payloads are released, the whole pool is available.
+    void* _Nullable payload = HAPPlatformRunLoopAllocatePayload(sizeof payloadPoolBytes - 8);
+    HAPAssert(payload);
+    HAPPlatformRunLoopReleasePayload(HAPNonnullVoid(payload));
+    HAPAssert(!HAPPlatformRunLoopAllocatePayload(sizeof payloadPoolBytes));
+}
+
+/**
+ * Sequence numbers of the invoked callbacks, in order of invocation.
+ */
+static struct {
+    uint8_t sequenceNumbers[32];
+    size_t numCallbacks;
+} invocations;
+
+static void HandleCallback(void* _Nullable context, size_t contextSize)
+{
+    HAPPrecondition(context);
+    HAPPrecondition(contextSize == 1);
+
+    HAPAssert(invocations.numCallbacks < HAPArrayCount(invocations.sequenceNumbers));
+    invocations.sequenceNumbers[invocations.numCallbacks++] = *(const uint8_t*) context;
+}
+
+static void HandlePayloadCallback(void* _Nullable payload, size_t numPayloadBytes)
+{
+    HAPPrecondition(payload);
+    HAPPrecondition(numPayloadBytes);
+
+    // The payload is filled with its sequence number.
+    const uint8_t* bytes = payload;
+    for (size_t i = 0; i < numPayloadBytes; i++) {
+        HAPAssert(bytes[i] == bytes[0]);
+    }
+    HAPAssert(invocations.numCallbacks < HAPArrayCount(invocations.sequenceNumbers));
+    invocations.sequenceNumbers[invocations.numCallbacks++] = bytes[0];
+}
+
+/**
+ * Payload callbacks and plain scheduled callbacks are invoked in the order in which they were scheduled. Payloads
+ * are released after their callbacks have returned.
+ */
+static void TestCallbackOrder(void)
+{
+    HAPLogInfo(&logObject, "%s", __func__);
+
+    HAPRawBufferZero(&invocations, sizeof invocations);
+    uint8_t numScheduled = 0;
+    for (size_t i = 0; i < 24; i++) {
+        uint8_t sequenceNumber = numScheduled++;
+        HAPError err;
+        if (i % 3 == 1) {
+            err = HAPPlatformRunLoopScheduleCallback(HandleCallback, &sequenceNumber, sizeof sequenceNumber);
+        } else {
+            size_t numPayloadBytes = 1 + i * 5 % 40;
+            void* _Nullable payload = HAPPlatformRunLoopAllocatePayload(numPayloadBytes);
+            HAPAssert(payload);
+            uint8_t* bytes = payload;
+            for (size_t j = 0; j < numPayloadBytes; j++) {
+                bytes[j] = sequenceNumber;
+            }
+            err = HAPPlatformRunLoopSchedulePayloadCallback(
+                    HandlePayloadCallback, HAPNonnullVoid(payload), numPayloadBytes);
+        }
+        HAPAssert(!err);
+
+        // Dispatch from time to time, so that the pool wraps around.
+        if (i % 6 == 5) {
+            RunFor(HAPMillisecond);
+            HAPAssert(invocations.numCallbacks == numScheduled);
+        }
+    }
+    RunFor(HAPMillisecond);
+
+    HAPAssert(invocations.numCallbacks == numScheduled);
+    for (size_t i = 0; i < invocations.numCallbacks; i++) {
+        HAPAssert(invocations.sequenceNumbers[i] == i);
+    }
+    void* _Nullable payload = HAPPlatformRunLoopAllocatePayload(sizeof payloadPoolBytes - 8);
+    HAPAssert(payload);
+    HAPPlatformRunLoopReleasePayload(HAPNonnullVoid(payload));
+}
+
+int main()
+{
+    HAPPlatformClockEnableVirtualTime(HAPPlatformClockGetCurrent());
+    HAPPlatformRunLoopCreate(&(const HAPPlatformRunLoopOptions) {
+            .keyValueStore = &keyValueStore,
+            .payloadPool = { .bytes = payloadPoolBytes, .numBytes = sizeof payloadPoolBytes },
+    });
+
+    TestPayloadPoolExhaustion();
+    TestCallbackOrder();
+
+    HAPPlatformRunLoopRelease();
+    return 0;
+}
@@ -0,0 +1,292 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+#include <stdlib.h>
+
+#include "HAPPlatform.h"
+#include "HAPPlatform+Init.h"
+#include "HAPPlatformRunLoop+Init.h"
+#include "HAPPlatformRunLoopCallbacks.h"
+#include "HAPPlatformRunLoopCommon.h"
+#include "HAPPlatformRunLoopWatchdog.h"
+#include "HAPPlatformWakeup+Init.h"
+
+static const HAPLogObject logObject = { .subsystem = kHAPPlatform_LogSubsystem, .category = "RunLoop" };
+
+/**
+ * Internal timer type.
+ */
+typedef struct HAPPlatformTimer HAPPlatformTimer;
+
+/**
+ * Internal timer representation.
+ */
+struct HAPPlatformTimer {
+    /**
+     * Deadline at which the timer expires.
+     */
+    HAPTime deadline;
+
+    /**
+     * Latest time at which the timer should expire (deadline plus leeway).
+     */
+    HAPTime latestDeadline;
+
+    /**
+     * Callback that is invoked when the timer expires.
+     */
+    HAPPlatformTimerCallback callback;
+
+    /**
+     * The context parameter given to the HAPPlatformTimerRegister function.
+     */
+    void* _Nullable context;
+
+    /**
+     * Next timer in linked list.
+     */
+    HAPPlatformTimer* _Nullable nextTimer;
+};
+
+static struct {
+    /**
+     * Start of linked list of timers, ordered by deadline.
+     */
+    HAPPlatformTimer* _Nullable timers;
+
+    /**
+     * Leeway of timers registered with HAPPlatformTimerRegister.
+     */
+    HAPTime timerLeeway;
+
+    /**
+     * Run loop statistics.
+     */
+    HAPPlatformRunLoopStatistics statistics;
+
+    /**
+     * Wakeup source through which the next timer wakeup is published.
+     */
+    HAPPlatformWakeupSource wakeupSource;
+
+    /**
+     * Callback that is invoked before the run loop waits for events.
+     */
+    HAPPlatformRunLoopBeforeWaitCallback _Nullable beforeWaitCallback;
+
+    /**
+     * Context of the callback that is invoked before the run loop waits for events.
+     */
+    void* _Nullable beforeWaitContext;
+} runLoop;
+
+void HAPPlatformRunLoopCommonCreate(const HAPPlatformRunLoopOptions* options)
+{
+    HAPPrecondition(options);
+    HAPPrecondition(options->keyValueStore);
+
+    HAPLogDebug(&logObject, "Storage configuration: timer = %lu", (unsigned long) sizeof(HAPPlatformTimer));
+
+    runLoop.timerLeeway = options->timerLeeway;
+    HAPRawBufferZero(&runLoop.statistics, sizeof runLoop.statistics);
+
+    // Stall detection.
+    HAPPlatformRunLoopWatchdogCreate(options->keyValueStore, options->dispatchBudget);
+
+    // Timer wakeups.
+    HAPPlatformWakeupSourceRegister(&runLoop.wakeupSource, "RunLoop");
+
+    // Scheduled callbacks.
+    HAPPlatformRunLoopCallbacksCreate(options);
+}
+
+void HAPPlatformRunLoopCommonRelease(void)
+{
+    HAPPlatformRunLoopWatchdogRelease();
+    HAPPlatformWakeupSourceDeregister(&runLoop.wakeupSource);
+}
+
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformTimerRegister(HAPPlatformTimerRef* timer_,
+                                  HAPTime deadline,
+                                  HAPPlatformTimerCallback callback,
+                                  void* _Nullable context)
+{
+    return HAPPlatformTimerRegisterWithLeeway(timer_, deadline, runLoop.timerLeeway, callback, context);
+}
+
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformTimerRegisterWithLeeway(HAPPlatformTimerRef* timer_,
+                                            HAPTime deadline,
+                                            HAPTime leeway,
+                                            HAPPlatformTimerCallback callback,
+                                            void* _Nullable context)
+{
+    HAPPrecondition(timer_);
+    HAPPlatformTimer* _Nullable* newTimer = (HAPPlatformTimer * _Nullable*) timer_;
+    HAPPrecondition(callback);
+
+    // Prepare timer.
+    *newTimer = calloc(1, sizeof(HAPPlatformTimer));
+    if (!*newTimer) {
+        HAPLog(&logObject, "Cannot allocate more timers.");
+        return kHAPError_OutOfResources;
+    }
+    (*newTimer)->deadline = deadline;
+    (*newTimer)->latestDeadline =
+            (*newTimer)->deadline > UINT64_MAX - leeway ? UINT64_MAX : (*newTimer)->deadline + leeway;
+    (*newTimer)->callback = callback;
+    (*newTimer)->context = context;
+
+    // Insert timer.
+    for (HAPPlatformTimer* _Nullable* nextTimer = &runLoop.timers;; nextTimer = &(*nextTimer)->nextTimer) {
+        if (!*nextTimer) {
+            (*newTimer)->nextTimer = NULL;
+            *nextTimer = *newTimer;
+            break;
+        }
+        if ((*nextTimer)->deadline > deadline) {
+            // Search condition must be '>' and not '>=' to ensure that timers fire in ascending order of their
+            // deadlines and that timers registered with the same deadline fire in order of registration.
+            (*newTimer)->nextTimer = *nextTimer;
+            *nextTimer = *newTimer;
+            break;
+        }
+    }
+
+    return kHAPError_None;
+}
+
+void HAPPlatformTimerDeregister(HAPPlatformTimerRef timer_) {
+    HAPPrecondition(timer_);
+    HAPPlatformTimer* timer = (HAPPlatformTimer*) timer_;
+
+    // Find and remove timer.
+    for (HAPPlatformTimer* _Nullable* nextTimer = &runLoop.timers; *nextTimer; nextTimer = &(*nextTimer)->nextTimer) {
+        if (*nextTimer == timer) {
+            *nextTimer = timer->nextTimer;
+            HAPPlatformFreeSafe(timer);
+            return;
+        }
+    }
+
+    // Timer not found.
+    HAPFatalError();
+}
+
+/**
+ * Gets the time at which the run loop has to wake up to process timers.
+ *
+ * - The wakeup is deferred to the earliest latest deadline of all timers whose deadline lies before it, so that
+ *   timers with overlapping [deadline, deadline + leeway] intervals expire in a single run loop iteration.
+ *
+ * @return Wakeup time, or 0 if no timers are registered.
+ */
+static HAPTime GetTimerWakeupTime(void)
+{
+    HAPTime wakeupTime = 0;
+    for (HAPPlatformTimer* _Nullable timer = runLoop.timers; timer; timer = timer->nextTimer) {
+        if (wakeupTime && timer->deadline > wakeupTime) {
+            break;
+        }
+        // A timer with a deadline of 0 is due right away. The wakeup time 0 means that no timers are registered.
+        HAPTime latestDeadline = HAPMax(timer->latestDeadline, (HAPTime) 1);
+        if (!wakeupTime || latestDeadline < wakeupTime) {
+            wakeupTime = latestDeadline;
+        }
+    }
+    return wakeupTime;
+}
+
+HAP_RESULT_USE_CHECK
+HAPTime HAPPlatformRunLoopCommonGetTimerWakeupTime(void)
+{
+    HAPTime wakeupTime = GetTimerWakeupTime();
+    HAPPlatformWakeupSourceSetDeadline(&runLoop.wakeupSource, wakeupTime);
+    return wakeupTime;
+}
+
+void HAPPlatformRunLoopCommonProcessExpiredTimers(void)
+{
+    // Get current time.
+    HAPTime now = HAPPlatformClockGetCurrent();
+
+    // Enumerate timers.
+    bool isFirstTimer = true;
+    bool isCoalescing = false;
+    HAPTime lastDeadline = 0;
+    HAPTime leewayEnd = 0;
+    while (runLoop.timers) {
+        if (runLoop.timers->deadline > now) {
+            break;
+        }
+
+        // Update head, so that reentrant add / removes do not interfere.
+        HAPPlatformTimer* expiredTimer = runLoop.timers;
+        runLoop.timers = runLoop.timers->nextTimer;
+
+        // Update statistics. A wakeup is saved for each later deadline that falls into the leeway of the first
+        // expired timer. If the first timer is already late, e.g., after a long running callback, the timers are
+        // merely overdue and would have expired together without leeway as well.
+        if (isFirstTimer) {
+            isFirstTimer = false;
+            isCoalescing = now <= expiredTimer->latestDeadline;
+            leewayEnd = expiredTimer->latestDeadline;
+            runLoop.statistics.numTimerWakeups++;
+            HAPPlatformWakeupSourceRecordWakeup(&runLoop.wakeupSource);
+        } else if (isCoalescing && expiredTimer->deadline > lastDeadline && expiredTimer->deadline <= leewayEnd) {
+            runLoop.statistics.numWakeupsSaved++;
+        }
+        lastDeadline = HAPMax(lastDeadline, expiredTimer->deadline);
+        runLoop.statistics.numTimersFired++;
+        if (now > expiredTimer->latestDeadline) {
+            runLoop.statistics.numTimersLate++;
+        }
+
+        // Invoke callback.
+        HAPTime dispatchStartTime = HAPPlatformRunLoopWatchdogBeginDispatch();
+        expiredTimer->callback((HAPPlatformTimerRef) expiredTimer, expiredTimer->context);
+        HAPPlatformRunLoopWatchdogEndDispatch(
+                kHAPPlatformRunLoopDispatchSource_Timer, (uintptr_t) expiredTimer->callback, dispatchStartTime);
+
+        // Free memory.
+        HAPPlatformFreeSafe(expiredTimer);
+    }
+}
+
+void HAPPlatformRunLoopCommonRecordVirtualTimeJump(void)
+{
+    runLoop.statistics.numVirtualTimeJumps++;
+}
+
+void HAPPlatformRunLoopGetStatistics(HAPPlatformRunLoopStatistics* statistics)
+{
+    HAPPrecondition(statistics);
+
+    *statistics = runLoop.statistics;
+    HAPPlatformRunLoopCallbacksGetStatistics(statistics);
+}
+
+void HAPPlatformRunLoopSetBeforeWaitCallback(
+        HAPPlatformRunLoopBeforeWaitCallback _Nullable callback,
+        void* _Nullable context)
+{
+    HAPPrecondition(!callback || !runLoop.beforeWaitCallback || runLoop.beforeWaitCallback == callback);
+
+    runLoop.beforeWaitCallback = callback;
+    runLoop.beforeWaitContext = context;
+}
+
+void HAPPlatformRunLoopCommonProcessBeforeWaitCallback(void)
+{
+    HAPPlatformRunLoopBeforeWaitCallback _Nullable callback = runLoop.beforeWaitCallback;
+    if (callback) {
+        HAPTime dispatchStartTime = HAPPlatformRunLoopWatchdogBeginDispatch();
+        callback(runLoop.beforeWaitContext);
+        HAPPlatformRunLoopWatchdogEndDispatch(
+                kHAPPlatformRunLoopDispatchSource_Callback, (uintptr_t) callback, dispatchStartTime);
+    }
+}
@@ -0,0 +1,73 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+#ifndef HAP_PLATFORM_RUN_LOOP_COMMON_H
+#define HAP_PLATFORM_RUN_LOOP_COMMON_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "HAPPlatform.h"
+#include "HAPPlatformRunLoop+Init.h"
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull begin
+#endif
+
+/**@file
+ * Run loop state that does not depend on the I/O multiplexer.
+ *
+ * This implements the timers, the run loop statistics and the callback that is invoked before the run loop waits
+ * for events. Each run loop implementation only waits for events and calls into this module, like it calls into
+ * HAPPlatformRunLoopCallbacks for the callbacks that it receives through its loopback.
+ */
+
+/**
+ * Initializes the shared run loop state, including stall detection and the payload pool.
+ *
+ * @param      options              Run loop initialization options.
+ */
+void HAPPlatformRunLoopCommonCreate(const HAPPlatformRunLoopOptions* options);
+
+/**
+ * Deinitializes the shared run loop state.
+ */
+void HAPPlatformRunLoopCommonRelease(void);
+
+/**
+ * Invokes the callback that is set with HAPPlatformRunLoopSetBeforeWaitCallback.
+ */
+void HAPPlatformRunLoopCommonProcessBeforeWaitCallback(void);
+
+/**
+ * Gets the time at which the run loop has to wake up to process timers, and publishes it as the deadline of the run
+ * loop wakeup source.
+ *
+ * @return Wakeup time, or 0 if no timers are registered.
+ */
+HAP_RESULT_USE_CHECK
+HAPTime HAPPlatformRunLoopCommonGetTimerWakeupTime(void);
+
+/**
+ * Invokes the callbacks of all timers whose deadline has passed.
+ */
+void HAPPlatformRunLoopCommonProcessExpiredTimers(void);
+
+/**
+ * Records that the clock was advanced to the next timer wakeup because no I/O was pending.
+ */
+void HAPPlatformRunLoopCommonRecordVirtualTimeJump(void);
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull end
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
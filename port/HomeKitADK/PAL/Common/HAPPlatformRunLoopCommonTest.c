@@ -0,0 +1,184 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Copyright (c) 2022 John Buonagurio
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+// Tests of the run loop timers, run by the host build on a virtual clock.
+
+#include "HAPPlatform.h"
+#include "HAPPlatformClock+Init.h"
+#include "HAPPlatformKeyValueStore+Init.h"
+#include "HAPPlatformRunLoop+Init.h"
+
+static const HAPLogObject logObject = { .subsystem = kHAPPlatform_LogSubsystem, .category = "RunLoopTest" };
+
+/**
+ * Key-value store of the run loop. It is only used by the run loop watchdog, which is not enabled.
+ */
+static HAPPlatformKeyValueStore keyValueStore;
+
+/**
+ * Leeway of timers registered with HAPPlatformTimerRegister.
+ */
+#define kTimerLeeway ((HAPTime)(50 * HAPMillisecond))
+
+/**
+ * A timer under test.
+ */
+typedef struct {
+    HAPPlatformTimerRef timer;
+    HAPTime deadline;
+    HAPTime latestDeadline;
+    HAPTime fireTime;
+    size_t numFired;
+} TestTimer;
+
+static void HandleTimerExpired(HAPPlatformTimerRef timer, void* _Nullable context)
+{
+    HAPPrecondition(context);
+    TestTimer* testTimer = context;
+    HAPAssert(timer == testTimer->timer);
+
+    testTimer->fireTime = HAPPlatformClockGetCurrent();
+    testTimer->numFired++;
+}
+
+/**
+ * Registers a timer under test.
+ *
+ * @param      testTimer            Timer under test.
+ * @param      deadline             Deadline.
+ * @param      leeway               Leeway, or -1 for the leeway of HAPPlatformTimerRegister.
+ */
+static void RegisterTimer(TestTimer* testTimer, HAPTime deadline, int64_t leeway)
+{
+    HAPPrecondition(testTimer);
+
+    HAPRawBufferZero(testTimer, sizeof *testTimer);
+    testTimer->deadline = deadline;
+    testTimer->latestDeadline = deadline + (leeway < 0 ? kTimerLeeway : (HAPTime) leeway);
+    HAPError err;
+    if (leeway < 0) {
+        err = HAPPlatformTimerRegister(&testTimer->timer, deadline, HandleTimerExpired, testTimer);
+    } else {
+        err = HAPPlatformTimerRegisterWithLeeway(
+                &testTimer->timer, deadline, (HAPTime) leeway, HandleTimerExpired, testTimer);
+    }
+    HAPAssert(!err);
+}
+
+static void StopRunLoop(HAPPlatformTimerRef timer, void* _Nullable context)
+{
+    (void) timer;
+    (void) context;
+    HAPPlatformRunLoopStop();
+}
+
+/**
+ * Runs the run loop for a while.
+ *
+ * @param      duration             Time to run the run loop.
+ */
+static void RunFor(HAPTime duration)
+{
+    HAPPlatformTimerRef timer;
+    HAPError err = HAPPlatformTimerRegisterWithLeeway(
+            &timer, HAPPlatformClockGetCurrent() + duration, /* leeway: */ 0, StopRunLoop, NULL);
+    HAPAssert(!err);
+    HAPPlatformRunLoopRun();
+}
+
+static HAPPlatformRunLoopStatistics GetStatistics(void)
+{
+    HAPPlatformRunLoopStatistics statistics;
+    HAPPlatformRunLoopGetStatistics(&statistics);
+    return statistics;
+}
+
+static TestTimer timers[48];
+
+/**
+ * Timers with mixed leeway never fire before their deadline or after their deadline plus leeway, and timers with
+ * overlapping intervals share wakeups.
+ */
+static void TestTimerLeeway(void)
+{
+    HAPLogInfo(&logObject, "%s", __func__);
+
+    static const int64_t leeways[] = {
+        0, 5 * HAPMillisecond, -1, 200 * HAPMillisecond, HAPSecond, 1 * HAPMillisecond,
+    };
+    HAPPlatformRunLoopStatistics statistics = GetStatistics();
+    HAPTime now = HAPPlatformClockGetCurrent();
+    for (size_t i = 0; i < HAPArrayCount(timers); i++) {
+        HAPTime deadline = now + (HAPTime)((i * 37) % 500 + i) * HAPMillisecond;
+        RegisterTimer(&timers[i], deadline, leeways[i % HAPArrayCount(leeways)]);
+    }
+    RunFor(3 * HAPSecond);
+
+    for (size_t i = 0; i < HAPArrayCount(timers); i++) {
+        const TestTimer* timer = &timers[i];
+        HAPAssert(timer->numFired == 1);
+        HAPAssert(timer->fireTime >= timer->deadline);
+        HAPAssert(timer->fireTime <= timer->latestDeadline);
+    }
+
+    HAPPlatformRunLoopStatistics newStatistics = GetStatistics();
+    size_t numTimerWakeups = (size_t)(newStatistics.numTimerWakeups - statistics.numTimerWakeups);
+    HAPLogInfo(&logObject, "%zu timers fired in %zu wakeups.", HAPArrayCount(timers), numTimerWakeups);
+    HAPAssert(newStatistics.numTimersFired - statistics.numTimersFired == HAPArrayCount(timers) + 1);
+    HAPAssert(newStatistics.numTimersLate == statistics.numTimersLate);
+    HAPAssert(newStatistics.numWakeupsSaved > statistics.numWakeupsSaved);
+    HAPAssert(numTimerWakeups < HAPArrayCount(timers));
+}
+
+static void BlockRunLoop(HAPPlatformTimerRef timer, void* _Nullable context)
+{
+    (void) timer;
+    (void) context;
+    HAPPlatformClockAdvance(100 * HAPMillisecond);
+}
+
+/**
+ * A timer whose latest deadline passes while a callback blocks the run loop fires as soon as possible afterwards, and
+ * is counted as late. It still does not fire before its deadline.
+ */
+static void TestLateTimer(void)
+{
+    HAPLogInfo(&logObject, "%s", __func__);
+
+    HAPPlatformRunLoopStatistics statistics = GetStatistics();
+    HAPTime now = HAPPlatformClockGetCurrent();
+    HAPPlatformTimerRef blockingTimer;
+    HAPError err = HAPPlatformTimerRegisterWithLeeway(
+            &blockingTimer, now + 10 * HAPMillisecond, /* leeway: */ 0, BlockRunLoop, NULL);
+    HAPAssert(!err);
+    RegisterTimer(&timers[0], now + 20 * HAPMillisecond, 5 * HAPMillisecond);
+    RegisterTimer(&timers[1], now + 200 * HAPMillisecond, 5 * HAPMillisecond);
+    RunFor(HAPSecond);
+
+    HAPAssert(timers[0].numFired == 1);
+    HAPAssert(timers[0].fireTime == now + 110 * HAPMillisecond);
+    HAPAssert(timers[1].numFired == 1);
+    HAPAssert(timers[1].fireTime >= timers[1].deadline);
+    HAPAssert(timers[1].fireTime <= timers[1].latestDeadline);
+    HAPAssert(GetStatistics().numTimersLate == statistics.numTimersLate + 1);
+}
+
+int main()
+{
+    HAPPlatformClockEnableVirtualTime(HAPPlatformClockGetCurrent());
+    HAPPlatformRunLoopCreate(&(const HAPPlatformRunLoopOptions) {
+            .keyValueStore = &keyValueStore,
+            .timerLeeway = kTimerLeeway,
+    });
+
+    TestTimerLeeway();
+    TestLateTimer();
+
+    HAPPlatformRunLoopRelease();
+    return 0;
+}
@@ -0,0 +1,300 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+#include "HAPPlatform.h"
+#include "HAPPlatformKeyValueStore+SDKDomains.h"
+#include "HAPPlatformRunLoop+Init.h"
+#include "HAPPlatformRunLoopWatchdog.h"
+
+static const HAPLogObject logObject = { .subsystem = kHAPPlatform_LogSubsystem, .category = "RunLoop" };
+
+/**
+ * Delay after a stall before the stalls are saved to the key-value store.
+ *
+ * - Saving is deferred so that the flash access does not prolong the stall, and so that bursts of stalls are saved
+ *   with a single write.
+ */
+#define kHAPPlatformRunLoopWatchdog_SaveDelay ((HAPTime)(10 * HAPSecond))
+
+/**
+ * Version of the serialization format of saved stalls.
+ */
+#define kHAPPlatformRunLoopWatchdog_StallsFormatVersion ((uint8_t) 1)
+
+/**
+ * Size of a serialized stall.
+ */
+#define kHAPPlatformRunLoopWatchdog_NumStallBytes ((size_t)(1 + 8 + 8 + 8))
+
+static struct {
+    /**
+     * Key-value store in which stalls are saved.
+     */
+    HAPPlatformKeyValueStoreRef _Nullable keyValueStore;
+
+    /**
+     * Maximum duration of a single dispatch. 0 if stall detection is disabled.
+     */
+    HAPTime dispatchBudget;
+
+    /**
+     * Ring buffer of the most recent stalls.
+     */
+    HAPPlatformRunLoopStall stalls[kHAPPlatformRunLoop_MaxStalls];
+
+    /**
+     * Index of the most recent stall.
+     */
+    size_t stallsHead;
+
+    /**
+     * Number of stalls in the ring buffer.
+     */
+    size_t numStalls;
+
+    /**
+     * Stall counts per callback, in order of first occurrence.
+     */
+    HAPPlatformRunLoopStallSource stallSources[kHAPPlatformRunLoop_MaxStallSources];
+
+    /**
+     * Number of used stall counts.
+     */
+    size_t numStallSources;
+
+    /**
+     * Timer to save the stalls. 0 if no save is pending.
+     */
+    HAPPlatformTimerRef saveTimer;
+} watchdog;
+
+static void SaveStalls(void)
+{
+    HAPPrecondition(watchdog.keyValueStore);
+
+    uint8_t bytes[2 + kHAPPlatformRunLoop_MaxStalls * kHAPPlatformRunLoopWatchdog_NumStallBytes];
+    size_t numBytes = 0;
+    bytes[numBytes++] = kHAPPlatformRunLoopWatchdog_StallsFormatVersion;
+    bytes[numBytes++] = (uint8_t) watchdog.numStalls;
+    for (size_t i = 0; i < watchdog.numStalls; i++) {
+        const HAPPlatformRunLoopStall* stall =
+                &watchdog.stalls[(watchdog.stallsHead + kHAPPlatformRunLoop_MaxStalls - i) %
+                                 kHAPPlatformRunLoop_MaxStalls];
+        bytes[numBytes++] = stall->source;
+        HAPWriteLittleUInt64(&bytes[numBytes], stall->callback);
+        numBytes += 8;
+        HAPWriteLittleUInt64(&bytes[numBytes], stall->timestamp);
+        numBytes += 8;
+        HAPWriteLittleUInt64(&bytes[numBytes], stall->duration);
+        numBytes += 8;
+    }
+    HAPAssert(numBytes <= sizeof bytes);
+
+    HAPError err = HAPPlatformKeyValueStoreSet(
+            HAPNonnull(watchdog.keyValueStore),
+            kSDKKeyValueStoreDomain_Diagnostics,
+            kSDKKeyValueStoreKey_Diagnostics_RunLoopStalls,
+            bytes,
+            numBytes);
+    if (err) {
+        HAPAssert(err == kHAPError_Unknown);
+        HAPLogError(&logObject, "Failed to save run loop stalls.");
+    }
+}
+
+static void LoadStalls(void)
+{
+    HAPPrecondition(watchdog.keyValueStore);
+
+    uint8_t bytes[2 + kHAPPlatformRunLoop_MaxStalls * kHAPPlatformRunLoopWatchdog_NumStallBytes];
+    size_t numBytes;
+    bool found;
+    HAPError err = HAPPlatformKeyValueStoreGet(
+            HAPNonnull(watchdog.keyValueStore),
+            kSDKKeyValueStoreDomain_Diagnostics,
+            kSDKKeyValueStoreKey_Diagnostics_RunLoopStalls,
+            bytes,
+            sizeof bytes,
+            &numBytes,
+            &found);
+    if (err) {
+        HAPAssert(err == kHAPError_Unknown);
+        HAPLogError(&logObject, "Failed to load run loop stalls.");
+        return;
+    }
+    if (!found) {
+        return;
+    }
+    if (numBytes < 2 || bytes[0] != kHAPPlatformRunLoopWatchdog_StallsFormatVersion ||
+        bytes[1] > kHAPPlatformRunLoop_MaxStalls ||
+        numBytes < 2 + bytes[1] * kHAPPlatformRunLoopWatchdog_NumStallBytes) {
+        HAPLog(&logObject, "Ignoring invalid saved run loop stalls.");
+        return;
+    }
+
+    // Stalls are saved most recent first. Insert them oldest first.
+    size_t numStalls = bytes[1];
+    for (size_t i = numStalls; i > 0; i--) {
+        const uint8_t* stallBytes = &bytes[2 + (i - 1) * kHAPPlatformRunLoopWatchdog_NumStallBytes];
+        watchdog.stallsHead = (watchdog.stallsHead + 1) % kHAPPlatformRunLoop_MaxStalls;
+        HAPPlatformRunLoopStall* stall = &watchdog.stalls[watchdog.stallsHead];
+        stall->source = stallBytes[0];
+        stall->isFromPreviousBoot = true;
+        stall->callback = HAPReadLittleUInt64(&stallBytes[1]);
+        stall->timestamp = HAPReadLittleUInt64(&stallBytes[9]);
+        stall->duration = HAPReadLittleUInt64(&stallBytes[17]);
+        watchdog.numStalls++;
+
+        HAPLogInfo(
+                &logObject,
+                "Stall before reset: Callback 0x%llX (source %u) took %llu ms at %llu ms.",
+                (unsigned long long) stall->callback,
+                stall->source,
+                (unsigned long long) stall->duration,
+                (unsigned long long) stall->timestamp);
+    }
+}
+
+static void SaveTimerExpired(HAPPlatformTimerRef timer, void* _Nullable context HAP_UNUSED)
+{
+    HAPPrecondition(timer == watchdog.saveTimer);
+    watchdog.saveTimer = 0;
+
+    SaveStalls();
+}
+
+void HAPPlatformRunLoopWatchdogCreate(HAPPlatformKeyValueStoreRef keyValueStore, HAPTime dispatchBudget)
+{
+    HAPPrecondition(keyValueStore);
+
+    HAPRawBufferZero(&watchdog, sizeof watchdog);
+    watchdog.keyValueStore = keyValueStore;
+    watchdog.dispatchBudget = dispatchBudget;
+    watchdog.stallsHead = kHAPPlatformRunLoop_MaxStalls - 1;
+
+    if (dispatchBudget) {
+        LoadStalls();
+    }
+}
+
+void HAPPlatformRunLoopWatchdogRelease(void)
+{
+    if (watchdog.saveTimer) {
+        HAPPlatformTimerDeregister(watchdog.saveTimer);
+        watchdog.saveTimer = 0;
+        SaveStalls();
+    }
+    watchdog.dispatchBudget = 0;
+}
+
+HAPTime HAPPlatformRunLoopWatchdogBeginDispatch(void)
+{
+    return watchdog.dispatchBudget ? HAPPlatformClockGetCurrent() : 0;
+}
+
+void HAPPlatformRunLoopWatchdogEndDispatch(
+        HAPPlatformRunLoopDispatchSource source,
+        uintptr_t callback,
+        HAPTime startTime)
+{
+    if (!watchdog.dispatchBudget) {
+        return;
+    }
+
+    HAPTime duration = HAPPlatformClockGetCurrent() - startTime;
+    if (duration <= watchdog.dispatchBudget) {
+        return;
+    }
+
+    // Saving the stalls may itself exceed the budget. Do not record it, or it would be saved again indefinitely.
+    if (source == kHAPPlatformRunLoopDispatchSource_Timer && callback == (uintptr_t) SaveTimerExpired) {
+        return;
+    }
+
+    HAPLog(&logObject,
+           "Stall: Callback 0x%llX (source %u) took %llu ms (budget %llu ms).",
+           (unsigned long long) callback,
+           source,
+           (unsigned long long) duration,
+           (unsigned long long) watchdog.dispatchBudget);
+
+    // Record stall.
+    watchdog.stallsHead = (watchdog.stallsHead + 1) % kHAPPlatformRunLoop_MaxStalls;
+    HAPPlatformRunLoopStall* stall = &watchdog.stalls[watchdog.stallsHead];
+    stall->source = source;
+    stall->isFromPreviousBoot = false;
+    stall->callback = callback;
+    stall->timestamp = startTime;
+    stall->duration = duration;
+    if (watchdog.numStalls < kHAPPlatformRunLoop_MaxStalls) {
+        watchdog.numStalls++;
+    }
+
+    // Count stall. Once the table is full, further callbacks share the last entry.
+    HAPPlatformRunLoopStallSource* stallSource = NULL;
+    for (size_t i = 0; i < watchdog.numStallSources; i++) {
+        if (watchdog.stallSources[i].source == source && watchdog.stallSources[i].callback == callback) {
+            stallSource = &watchdog.stallSources[i];
+            break;
+        }
+    }
+    if (!stallSource) {
+        if (watchdog.numStallSources < kHAPPlatformRunLoop_MaxStallSources - 1) {
+            stallSource = &watchdog.stallSources[watchdog.numStallSources++];
+            stallSource->source = source;
+            stallSource->callback = callback;
+        } else {
+            stallSource = &watchdog.stallSources[kHAPPlatformRunLoop_MaxStallSources - 1];
+            stallSource->source = 0;
+            stallSource->callback = 0;
+            watchdog.numStallSources = kHAPPlatformRunLoop_MaxStallSources;
+        }
+    }
+    stallSource->numStalls++;
+    if (duration > stallSource->maxDuration) {
+        stallSource->maxDuration = duration;
+    }
+
+    // Schedule save.
+    if (!watchdog.saveTimer) {
+        HAPError err = HAPPlatformTimerRegister(
+                &watchdog.saveTimer,
+                HAPPlatformClockGetCurrent() + kHAPPlatformRunLoopWatchdog_SaveDelay,
+                SaveTimerExpired,
+                NULL);
+        if (err) {
+            HAPAssert(err == kHAPError_OutOfResources);
+            HAPLogError(&logObject, "Not enough resources to schedule saving of run loop stalls.");
+            watchdog.saveTimer = 0;
+        }
+    }
+}
+
+size_t HAPPlatformRunLoopGetStalls(HAPPlatformRunLoopStall* stalls, size_t maxStalls)
+{
+    HAPPrecondition(stalls);
+
+    size_t numStalls = 0;
+    while (numStalls < watchdog.numStalls && numStalls < maxStalls) {
+        stalls[numStalls] =
+                watchdog.stalls[(watchdog.stallsHead + kHAPPlatformRunLoop_MaxStalls - numStalls) %
+                                kHAPPlatformRunLoop_MaxStalls];
+        numStalls++;
+    }
+    return numStalls;
+}
+
+size_t HAPPlatformRunLoopGetStallSources(HAPPlatformRunLoopStallSource* stallSources, size_t maxStallSources)
+{
+    HAPPrecondition(stallSources);
+
+    size_t numStallSources = 0;
+    while (numStallSources < watchdog.numStallSources && numStallSources < maxStallSources) {
+        stallSources[numStallSources] = watchdog.stallSources[numStallSources];
+        numStallSources++;
+    }
+    return numStallSources;
+}
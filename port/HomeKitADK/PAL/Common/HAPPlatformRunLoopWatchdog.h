@@ -0,0 +1,72 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+#ifndef HAP_PLATFORM_RUN_LOOP_WATCHDOG_H
+#define HAP_PLATFORM_RUN_LOOP_WATCHDOG_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "HAPPlatform.h"
+#include "HAPPlatformRunLoop+Init.h"
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull begin
+#endif
+
+/**@file
+ * Run loop stall detection.
+ *
+ * The run loop brackets every dispatch with HAPPlatformRunLoopWatchdogBeginDispatch and
+ * HAPPlatformRunLoopWatchdogEndDispatch. Dispatches that exceed the dispatch budget are logged, counted per callback,
+ * and recorded in a ring that is saved to the key-value store shortly after the stall.
+ *
+ * The implementation only depends on the platform clock, timer and key-value store interfaces and is shared by all
+ * run loop implementations.
+ */
+
+/**
+ * Initializes stall detection and loads the stalls that were recorded before the last reset.
+ *
+ * @param      keyValueStore        Key-value store in which stalls are saved.
+ * @param      dispatchBudget       Maximum duration of a single dispatch. 0 disables stall detection.
+ */
+void HAPPlatformRunLoopWatchdogCreate(HAPPlatformKeyValueStoreRef keyValueStore, HAPTime dispatchBudget);
+
+/**
+ * Deinitializes stall detection. Stalls that have not been saved yet are saved.
+ */
+void HAPPlatformRunLoopWatchdogRelease(void);
+
+/**
+ * Marks the start of a dispatch.
+ *
+ * @return Start time of the dispatch, or 0 if stall detection is disabled.
+ */
+HAPTime HAPPlatformRunLoopWatchdogBeginDispatch(void);
+
+/**
+ * Marks the end of a dispatch.
+ *
+ * @param      source               Kind of dispatch.
+ * @param      callback             Address of the callback that was invoked.
+ * @param      startTime            Value returned by the corresponding HAPPlatformRunLoopWatchdogBeginDispatch.
+ */
+void HAPPlatformRunLoopWatchdogEndDispatch(
+        HAPPlatformRunLoopDispatchSource source,
+        uintptr_t callback,
+        HAPTime startTime);
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull end
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
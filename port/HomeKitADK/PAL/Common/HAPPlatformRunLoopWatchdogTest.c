@@ -0,0 +1,327 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Copyright (c) 2022 John Buonagurio
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+// Tests of the run loop stall detection, run by the host build on a virtual clock and the serial flash file system
+// emulation.
+
+#include <dirent.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "HAPPlatform.h"
+#include "HAPPlatformClock+Init.h"
+#include "HAPPlatformKeyValueStore+Init.h"
+#include "HAPPlatformKeyValueStore+SDKDomains.h"
+#include "HAPPlatformRunLoop+Init.h"
+#include "SimpleLinkFS+Init.h"
+
+static const HAPLogObject logObject = { .subsystem = kHAPPlatform_LogSubsystem, .category = "RunLoopTest" };
+
+/**
+ * Directory of the file system emulation.
+ */
+static char fileSystemDirectory[] = "/tmp/HAPPlatformRunLoopWatchdogTest.XXXXXX";
+
+/**
+ * Key-value store in which the stalls are saved.
+ */
+static HAPPlatformKeyValueStore keyValueStore;
+
+/**
+ * Maximum duration of a single dispatch.
+ */
+#define kDispatchBudget ((HAPTime)(50 * HAPMillisecond))
+
+/**
+ * Delay after a stall before the stalls are saved.
+ */
+#define kSaveDelay ((HAPTime)(10 * HAPSecond))
+
+/**
+ * Removes a directory and its contents.
+ *
+ * @param      path                 Path of the directory.
+ */
+static void RemoveDirectory(const char* path)
+{
+    DIR* dir = opendir(path);
+    HAPAssert(dir);
+
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (HAPStringAreEqual(entry->d_name, ".") || HAPStringAreEqual(entry->d_name, "..")) {
+            continue;
+        }
+
+        char entryPath[PATH_MAX];
+        HAPError err = HAPStringWithFormat(entryPath, sizeof entryPath, "%s/%s", path, entry->d_name);
+        HAPAssert(!err);
+        struct stat st;
+        int e = lstat(entryPath, &st);
+        HAPAssert(!e);
+        if (S_ISDIR(st.st_mode)) {
+            RemoveDirectory(entryPath);
+        } else {
+            e = unlink(entryPath);
+            HAPAssert(!e);
+        }
+    }
+    closedir(dir);
+
+    int e = rmdir(path);
+    HAPAssert(!e);
+}
+
+static void StopRunLoop(HAPPlatformTimerRef timer, void* _Nullable context)
+{
+    (void) timer;
+    (void) context;
+    HAPPlatformRunLoopStop();
+}
+
+/**
+ * Runs the run loop for a while.
+ *
+ * @param      duration             Time to run the run loop.
+ */
+static void RunFor(HAPTime duration)
+{
+    HAPPlatformTimerRef timer;
+    HAPError err = HAPPlatformTimerRegisterWithLeeway(
+            &timer, HAPPlatformClockGetCurrent() + duration, /* leeway: */ 0, StopRunLoop, NULL);
+    HAPAssert(!err);
+    HAPPlatformRunLoopRun();
+}
+
+/**
+ * Restarts the run loop with stall detection, as after a reset of the device.
+ */
+static void RestartRunLoop(void)
+{
+    HAPPlatformRunLoopRelease();
+    HAPPlatformRunLoopCreate(&(const HAPPlatformRunLoopOptions) {
+            .keyValueStore = &keyValueStore,
+            .dispatchBudget = kDispatchBudget,
+    });
+}
+
+/**
+ * Checks whether stalls are saved in the key-value store.
+ *
+ * @return true                     If stalls are saved.
+ * @return false                    Otherwise.
+ */
+HAP_RESULT_USE_CHECK
+static bool HasSavedStalls(void)
+{
+    bool found;
+    HAPError err = HAPPlatformKeyValueStoreGet(
+            &keyValueStore,
+            kSDKKeyValueStoreDomain_Diagnostics,
+            kSDKKeyValueStoreKey_Diagnostics_RunLoopStalls,
+            NULL,
+            0,
+            NULL,
+            &found);
+    HAPAssert(!err);
+    return found;
+}
+
+/**
+ * Scheduled callback that blocks the run loop for the duration given in its context.
+ */
+static void BlockRunLoopInCallback(void* _Nullable context, size_t contextSize)
+{
+    HAPPrecondition(context);
+    HAPPrecondition(contextSize == sizeof(HAPTime));
+
+    HAPTime duration;
+    HAPRawBufferCopyBytes(&duration, context, sizeof duration);
+    HAPPlatformClockAdvance(duration);
+}
+
+/**
+ * Timer callback that blocks the run loop for the duration given in its context.
+ */
+static void BlockRunLoopInTimer(HAPPlatformTimerRef timer, void* _Nullable context)
+{
+    (void) timer;
+    HAPPrecondition(context);
+
+    HAPPlatformClockAdvance(*(HAPTime*) context);
+}
+
+/**
+ * Durations for which the timer callbacks block the run loop.
+ */
+static HAPTime timerDurations[] = { 3 * kDispatchBudget, kDispatchBudget, 2 * kDispatchBudget };
+
+/**
+ * Dispatches that take longer than the dispatch budget are recorded as stalls, most recent first, and counted per
+ * callback. Dispatches that take exactly the budget are not stalls.
+ */
+static void TestStalls(void)
+{
+    HAPLogInfo(&logObject, "%s", __func__);
+
+    HAPPlatformRunLoopStall stalls[kHAPPlatformRunLoop_MaxStalls];
+    HAPPlatformRunLoopStallSource stallSources[kHAPPlatformRunLoop_MaxStallSources];
+    HAPAssert(!HAPPlatformRunLoopGetStalls(stalls, HAPArrayCount(stalls)));
+    HAPAssert(!HAPPlatformRunLoopGetStallSources(stallSources, HAPArrayCount(stallSources)));
+
+    HAPTime callbackStartTime = HAPPlatformClockGetCurrent();
+    HAPTime callbackDuration = kDispatchBudget + HAPMillisecond;
+    HAPError err = HAPPlatformRunLoopScheduleCallback(
+            BlockRunLoopInCallback, &callbackDuration, sizeof callbackDuration);
+    HAPAssert(!err);
+    RunFor(HAPMillisecond);
+
+    HAPTime timerStartTimes[HAPArrayCount(timerDurations)];
+    for (size_t i = 0; i < HAPArrayCount(timerDurations); i++) {
+        HAPPlatformTimerRef timer;
+        timerStartTimes[i] = HAPPlatformClockGetCurrent() + 10 * HAPMillisecond;
+        err = HAPPlatformTimerRegisterWithLeeway(
+                &timer,
+                timerStartTimes[i],
+                /* leeway: */ 0,
+                BlockRunLoopInTimer,
+                &timerDurations[i]);
+        HAPAssert(!err);
+        RunFor(20 * HAPMillisecond);
+    }
+
+    // Stalls, most recent first. The timer that took exactly the budget is not a stall.
+    HAPAssert(HAPPlatformRunLoopGetStalls(stalls, 1) == 1);
+    HAPAssert(stalls[0].timestamp == timerStartTimes[2]);
+    HAPAssert(HAPPlatformRunLoopGetStalls(stalls, HAPArrayCount(stalls)) == 3);
+    HAPAssert(stalls[0].source == kHAPPlatformRunLoopDispatchSource_Timer);
+    HAPAssert(stalls[0].callback == (uintptr_t) BlockRunLoopInTimer);
+    HAPAssert(stalls[0].timestamp == timerStartTimes[2]);
+    HAPAssert(stalls[0].duration == timerDurations[2]);
+    HAPAssert(stalls[1].source == kHAPPlatformRunLoopDispatchSource_Timer);
+    HAPAssert(stalls[1].callback == (uintptr_t) BlockRunLoopInTimer);
+    HAPAssert(stalls[1].timestamp == timerStartTimes[0]);
+    HAPAssert(stalls[1].duration == timerDurations[0]);
+    HAPAssert(stalls[2].source == kHAPPlatformRunLoopDispatchSource_Callback);
+    HAPAssert(stalls[2].callback == (uintptr_t) BlockRunLoopInCallback);
+    HAPAssert(stalls[2].timestamp == callbackStartTime);
+    HAPAssert(stalls[2].duration == callbackDuration);
+    for (size_t i = 0; i < 3; i++) {
+        HAPAssert(!stalls[i].isFromPreviousBoot);
+    }
+
+    // Stall counts, in order of first occurrence.
+    HAPAssert(HAPPlatformRunLoopGetStallSources(stallSources, HAPArrayCount(stallSources)) == 2);
+    HAPAssert(stallSources[0].source == kHAPPlatformRunLoopDispatchSource_Callback);
+    HAPAssert(stallSources[0].callback == (uintptr_t) BlockRunLoopInCallback);
+    HAPAssert(stallSources[0].numStalls == 1);
+    HAPAssert(stallSources[0].maxDuration == callbackDuration);
+    HAPAssert(stallSources[1].source == kHAPPlatformRunLoopDispatchSource_Timer);
+    HAPAssert(stallSources[1].callback == (uintptr_t) BlockRunLoopInTimer);
+    HAPAssert(stallSources[1].numStalls == 2);
+    HAPAssert(stallSources[1].maxDuration == timerDurations[0]);
+
+    // Stalls are saved once the save delay has passed since the end of the first stall.
+    HAPTime saveTime = callbackStartTime + callbackDuration + kSaveDelay;
+    RunFor(saveTime - HAPPlatformClockGetCurrent() - HAPMillisecond);
+    HAPAssert(!HasSavedStalls());
+    RunFor(2 * HAPMillisecond);
+    HAPAssert(HasSavedStalls());
+}
+
+/**
+ * Saved stalls are loaded when the run loop is created again, and are marked as being from the previous boot. Stall
+ * counts are not retained. Stalls that are pending when the run loop is released are saved immediately.
+ */
+static void TestSavedStalls(void)
+{
+    HAPLogInfo(&logObject, "%s", __func__);
+
+    HAPPlatformRunLoopStall stallsBefore[kHAPPlatformRunLoop_MaxStalls];
+    size_t numStalls = HAPPlatformRunLoopGetStalls(stallsBefore, HAPArrayCount(stallsBefore));
+    HAPAssert(numStalls == 3);
+
+    RestartRunLoop();
+    HAPPlatformRunLoopStall stalls[kHAPPlatformRunLoop_MaxStalls];
+    HAPPlatformRunLoopStallSource stallSources[kHAPPlatformRunLoop_MaxStallSources];
+    HAPAssert(HAPPlatformRunLoopGetStalls(stalls, HAPArrayCount(stalls)) == numStalls);
+    for (size_t i = 0; i < numStalls; i++) {
+        HAPAssert(stalls[i].isFromPreviousBoot);
+        HAPAssert(stalls[i].source == stallsBefore[i].source);
+        HAPAssert(stalls[i].callback == stallsBefore[i].callback);
+        HAPAssert(stalls[i].timestamp == stallsBefore[i].timestamp);
+        HAPAssert(stalls[i].duration == stallsBefore[i].duration);
+    }
+    HAPAssert(!HAPPlatformRunLoopGetStallSources(stallSources, HAPArrayCount(stallSources)));
+
+    // A stall in the new boot is recorded before the loaded stalls, and is saved when the run loop is released before
+    // the save delay has passed.
+    HAPTime callbackStartTime = HAPPlatformClockGetCurrent();
+    HAPTime callbackDuration = 4 * kDispatchBudget;
+    HAPError err = HAPPlatformRunLoopScheduleCallback(
+            BlockRunLoopInCallback, &callbackDuration, sizeof callbackDuration);
+    HAPAssert(!err);
+    RunFor(HAPMillisecond);
+    HAPAssert(HAPPlatformRunLoopGetStalls(stalls, HAPArrayCount(stalls)) == numStalls + 1);
+    HAPAssert(!stalls[0].isFromPreviousBoot);
+    HAPAssert(stalls[1].isFromPreviousBoot);
+
+    RestartRunLoop();
+    HAPAssert(HAPPlatformRunLoopGetStalls(stalls, HAPArrayCount(stalls)) == numStalls + 1);
+    HAPAssert(stalls[0].isFromPreviousBoot);
+    HAPAssert(stalls[0].source == kHAPPlatformRunLoopDispatchSource_Callback);
+    HAPAssert(stalls[0].callback == (uintptr_t) BlockRunLoopInCallback);
+    HAPAssert(stalls[0].timestamp == callbackStartTime);
+    HAPAssert(stalls[0].duration == callbackDuration);
+    for (size_t i = 0; i < numStalls; i++) {
+        HAPAssert(stalls[i + 1].timestamp == stallsBefore[i].timestamp);
+    }
+
+    // Once the ring is full, the oldest stalls are dropped.
+    for (size_t i = 0; i < kHAPPlatformRunLoop_MaxStalls; i++) {
+        err = HAPPlatformRunLoopScheduleCallback(BlockRunLoopInCallback, &callbackDuration, sizeof callbackDuration);
+        HAPAssert(!err);
+        RunFor(HAPMillisecond);
+    }
+    HAPAssert(HAPPlatformRunLoopGetStalls(stalls, HAPArrayCount(stalls)) == kHAPPlatformRunLoop_MaxStalls);
+    for (size_t i = 0; i < kHAPPlatformRunLoop_MaxStalls; i++) {
+        HAPAssert(!stalls[i].isFromPreviousBoot);
+    }
+    RestartRunLoop();
+    HAPAssert(HAPPlatformRunLoopGetStalls(stalls, HAPArrayCount(stalls)) == kHAPPlatformRunLoop_MaxStalls);
+    for (size_t i = 0; i < kHAPPlatformRunLoop_MaxStalls; i++) {
+        HAPAssert(stalls[i].isFromPreviousBoot);
+        HAPAssert(!i || stalls[i].timestamp < stalls[i - 1].timestamp);
+    }
+}
+
+int main()
+{
+    char* directory = mkdtemp(fileSystemDirectory);
+    HAPAssert(directory);
+    SimpleLinkFSCreate(&(const SimpleLinkFSOptions) { .rootDirectory = fileSystemDirectory });
+
+    // Stalls are loaded when the run loop is created, so the key-value store is initialized first.
+    HAPPlatformClockEnableVirtualTime(HAPPlatformClockGetCurrent());
+    HAPPlatformKeyValueStoreCreate(
+            &keyValueStore, &(const HAPPlatformKeyValueStoreOptions) { .rootDirectory = ".homekitstore" });
+    HAPPlatformRunLoopCreate(&(const HAPPlatformRunLoopOptions) {
+            .keyValueStore = &keyValueStore,
+            .dispatchBudget = kDispatchBudget,
+    });
+
+    TestStalls();
+    TestSavedStalls();
+
+    HAPPlatformRunLoopRelease();
+
+    RemoveDirectory(fileSystemDirectory);
+    return 0;
+}
@@ -0,0 +1,563 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Copyright (c) 2022 John Buonagurio
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+#ifndef HAP_PLATFORM_IP_INIT_H
+#define HAP_PLATFORM_IP_INIT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "HAPPlatform.h"
+#include "HAPPlatformFileHandle.h"
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull begin
+#endif
+
+/**@file
+ * TCP stream manager implementation for POSIX and SimpleLink.
+ *
+ * The TCP stream manager is shared by the backends. Each backend provides the socket calls, which are declared in
+ * HAPPlatformTCPStreamSocket.h.
+ *
+ * Free TCP streams are kept in a list, so accepting a TCP stream takes constant time. Each TCP stream records the
+ * time of its last read or write. When all TCP streams are in use and a new connection is pending, the least recently
+ * used idle TCP stream is evicted: it reports end of stream to its next read, and the new connection is accepted once
+ * the IP accessory server has closed it. This keeps a stale session, e.g. from a sleeping controller, from locking out
+ * other controllers.
+ *
+ * Optionally, the TCP streams share a pool of transmit buffers. Writes that are made during one run loop iteration are
+ * collected in a free transmit buffer and sent together before the run loop waits for events, or when the transmit
+ * buffer is full. A HAP response or event that is written in several pieces then takes a single send. A TCP stream
+ * only holds a transmit buffer until its bytes have been sent.
+ *
+ * Optionally, the TCP streams share a pool of receive buffers. A read that is smaller than a receive buffer receives
+ * all available bytes into a free receive buffer, and the following reads are served from it without further
+ * receives. A TCP stream only holds a receive buffer while it has unread bytes in it.
+ *
+ * The memory for both pools is bounded by their number of buffers regardless of the number of TCP streams, so it scales
+ * with the number of TCP streams that are active at the same time rather than with maxConcurrentTCPStreams.
+ *
+ * Optionally, the transmit buffers are backed by a few large transmit buffers. A TCP stream starts with small transmit
+ * buffers and grows to large ones once it writes a response in several writes that together do not fit into a small
+ * one, e.g. the accessory attribute database. A grown TCP stream that keeps writing while it waits for space holds its
+ * bytes back until the large transmit buffer is full, so that a long response takes fewer sends. A TCP stream that has
+ * not needed a large transmit buffer for largeTransmitBufferTimeout goes back to small ones.
+ *
+ * The following limitations apply if this code is not modified:
+ * - Non-null values for the option interfaceName are ignored on platforms without support for the socket option
+ *   SO_BINDTODEVICE which binds the socket to a particular network interface.
+ *
+ * **Example**
+
+   @code{.c}
+   // Allocate TCP stream manager object.
+   static HAPPlatformTCPStreamManager tcpStreamManager;
+
+   // Allocate transmit buffers that are shared by the TCP streams.
+   static uint8_t transmitBuffers[4][256];
+
+   // Allocate receive buffers that are shared by the TCP streams.
+   static uint8_t receiveBuffers[3][512];
+
+   // Allocate a large transmit buffer for the TCP stream that sends a long response.
+   static uint8_t largeTransmitBuffers[1][3072];
+
+   // Initialize TCP stream manager object.
+   HAPPlatformTCPStreamManagerCreate(&platform.tcpStreamManager,
+       &(const HAPPlatformTCPStreamManagerOptions) {
+           // Listen on all available network interfaces.
+           .interfaceName = NULL,
+
+           // Listen on an unused port number from the ephemeral port range.
+           .port = kHAPNetworkPort_Any,
+
+           // Allocate enough concurrent TCP streams to support the IP accessory.
+           .maxConcurrentTCPStreams = kHAPIPSessionStorage_DefaultNumElements,
+
+           // Evict a TCP stream that has been idle for a minute to accept a new TCP stream when all are in use.
+           .minIdleTimeBeforeEviction = 60 * HAPSecond,
+
+           // Reset a TCP stream whose peer has stopped responding for two minutes.
+           .deadPeerTimeout = 2 * HAPMinute,
+
+           // Gather small writes and send them together before the run loop waits.
+           .transmitBuffers = transmitBuffers,
+           .transmitBufferSize = sizeof transmitBuffers[0],
+           .numTransmitBuffers = HAPArrayCount(transmitBuffers),
+
+           // Receive all available bytes at once and serve small reads from RAM.
+           .receiveBuffers = receiveBuffers,
+           .receiveBufferSize = sizeof receiveBuffers[0],
+           .numReceiveBuffers = HAPArrayCount(receiveBuffers),
+
+           // Send long responses in large pieces, and go back to small transmit buffers after ten seconds.
+           .largeTransmitBuffers = largeTransmitBuffers,
+           .largeTransmitBufferSize = sizeof largeTransmitBuffers[0],
+           .numLargeTransmitBuffers = HAPArrayCount(largeTransmitBuffers),
+           .largeTransmitBufferTimeout = 10 * HAPSecond
+   });
+
+   @endcode
+ */
+
+/**
+ * Maximum length of a local network interface name, including the NULL terminator.
+ */
+#define kHAPPlatformTCPStreamManager_MaxInterfaceNameBytes 16
+
+/**
+ * TCP stream manager initialization options.
+ */
+typedef struct {
+    /**
+     * Local network interface name on which to bind the TCP stream manager.
+     *
+     * - A value of NULL will use all available network interfaces.
+     *
+     * - Must be shorter than kHAPPlatformTCPStreamManager_MaxInterfaceNameBytes.
+     */
+    const char* _Nullable interfaceName;
+
+    /**
+     * Local port number on which to bind the TCP stream manager.
+     *
+     * - A value of kHAPNetworkPort_Any will use an unused port number from the ephemeral port range.
+     */
+    HAPNetworkPort port;
+
+    /**
+     * Maximum number of concurrent TCP streams.
+     */
+    size_t maxConcurrentTCPStreams;
+
+    /**
+     * Minimum time without reads or writes after which a TCP stream may be evicted to accept a new TCP stream.
+     *
+     * - Only TCP streams that wait for incoming bytes and have no pending output are evicted.
+     *
+     * - A value of 0 disables eviction. New TCP streams are then only accepted once a TCP stream is closed.
+     */
+    HAPTime minIdleTimeBeforeEviction;
+
+    /**
+     * Time after which a TCP stream whose peer has stopped responding is reset, or 0 to use the system defaults.
+     *
+     * - The peer of a TCP stream is probed with TCP keepalives after half of this time without incoming bytes.
+     *
+     * - On Linux, the probes are spread over the other half, so a TCP stream is reset after this time. It is also reset
+     *   if sent bytes remain unacknowledged for this long.
+     *
+     * - On CC32xxSF, the network processor chooses the probe interval and count, and bounds unacknowledged bytes by its
+     *   retransmission timeout. A TCP stream is reset after half of this time plus the probes of the network
+     *   processor, which this port cannot configure. This may be longer than this time.
+     *
+     * - Reads and writes on a TCP stream that was reset fail, so that the IP accessory server closes it.
+     */
+    HAPTime deadPeerTimeout;
+
+    /**
+     * Transmit buffers that are shared by the TCP streams, or NULL to send each write right away.
+     *
+     * - Must provide transmitBufferSize bytes for each of the numTransmitBuffers transmit buffers.
+     *
+     * - Writes that do not fit into an empty transmit buffer, and writes while no transmit buffer is free, are sent
+     *   right away.
+     */
+    void* _Nullable transmitBuffers;
+
+    /**
+     * Size of each transmit buffer.
+     */
+    size_t transmitBufferSize;
+
+    /**
+     * Number of transmit buffers. Bounds the memory that is used for collecting writes.
+     */
+    size_t numTransmitBuffers;
+
+    /**
+     * Receive buffers that are shared by the TCP streams, or NULL to receive only as many bytes as are read.
+     *
+     * - Must provide receiveBufferSize bytes for each of the numReceiveBuffers receive buffers.
+     *
+     * - Reads that are not smaller than a receive buffer, and reads while no receive buffer is free, receive directly.
+     */
+    void* _Nullable receiveBuffers;
+
+    /**
+     * Size of each receive buffer.
+     */
+    size_t receiveBufferSize;
+
+    /**
+     * Number of receive buffers. Bounds the memory that is used for reading ahead.
+     */
+    size_t numReceiveBuffers;
+
+    /**
+     * Large transmit buffers for TCP streams that write more, or NULL to keep all TCP streams at transmitBufferSize.
+     *
+     * - Requires transmitBuffers. Must provide largeTransmitBufferSize bytes for each of the numLargeTransmitBuffers
+     *   large transmit buffers.
+     *
+     * - A TCP stream grows once the bytes that it writes between two reads do not fit into a transmit buffer. A grown
+     *   TCP stream uses a transmit buffer while no large transmit buffer is free.
+     */
+    void* _Nullable largeTransmitBuffers;
+
+    /**
+     * Size of each large transmit buffer. Must be larger than transmitBufferSize. Caps the size of a send.
+     */
+    size_t largeTransmitBufferSize;
+
+    /**
+     * Number of large transmit buffers. Bounds the number of TCP streams that send long responses in large pieces.
+     */
+    size_t numLargeTransmitBuffers;
+
+    /**
+     * Time after which a TCP stream that has not needed a large transmit buffer goes back to small ones.
+     *
+     * - A value of 0 keeps a TCP stream that has grown at large transmit buffers until it is closed.
+     */
+    HAPTime largeTransmitBufferTimeout;
+} HAPPlatformTCPStreamManagerOptions;
+
+/**
+ * TCP stream statistics.
+ *
+ * - Receives and sends are calls to the socket. Reads that are served from a receive buffer and writes that are
+ *   collected in a transmit buffer are counted once their bytes are received or sent.
+ */
+typedef struct {
+    /**
+     * Time at which the TCP stream was accepted.
+     */
+    HAPTime acceptTime;
+
+    /**
+     * Time at which the TCP stream was closed, or 0 while it is open.
+     */
+    HAPTime closeTime;
+
+    /**
+     * Number of bytes that were received.
+     */
+    uint64_t numBytesReceived;
+
+    /**
+     * Number of receives.
+     */
+    uint64_t numReceives;
+
+    /**
+     * Number of receives that would have blocked because no bytes were available.
+     */
+    uint64_t numReceivesWouldBlock;
+
+    /**
+     * Number of bytes that were sent.
+     */
+    uint64_t numBytesSent;
+
+    /**
+     * Number of sends.
+     */
+    uint64_t numSends;
+
+    /**
+     * Number of sends that would have blocked because the socket had no space.
+     */
+    uint64_t numSendsWouldBlock;
+
+    /**
+     * Peak number of bytes in the transmit buffer.
+     */
+    size_t maxTransmitBytes;
+
+    /**
+     * Peak number of unread bytes in the receive buffer.
+     */
+    size_t maxReceiveBytes;
+
+    /**
+     * Peak size of the transmit and receive buffers that were held at the same time.
+     */
+    size_t maxBufferBytes;
+} HAPPlatformTCPStreamStatistics;
+
+/**
+ * TCP stream manager statistics.
+ */
+typedef struct {
+    /**
+     * Number of TCP streams that were accepted.
+     */
+    uint64_t numAcceptedTCPStreams;
+
+    /**
+     * Number of idle TCP streams that were evicted to accept a new TCP stream.
+     */
+    uint64_t numEvictedTCPStreams;
+
+    /**
+     * Number of TCP streams that were reset because their peer stopped responding.
+     */
+    uint64_t numReclaimedTCPStreams;
+
+    /**
+     * Number of writes that were collected in a transmit buffer.
+     */
+    uint64_t numCoalescedWrites;
+
+    /**
+     * Number of sends of the contents of a transmit buffer.
+     */
+    uint64_t numTransmitBufferSends;
+
+    /**
+     * Number of writes that were sent right away because no transmit buffer was free.
+     */
+    uint64_t numTransmitBufferShortages;
+
+    /**
+     * Peak number of transmit buffers that were held by TCP streams at the same time.
+     */
+    size_t maxTransmitBuffersInUse;
+
+    /**
+     * Number of times that a TCP stream grew to large transmit buffers.
+     */
+    uint64_t numTransmitBufferGrowths;
+
+    /**
+     * Number of times that a large transmit buffer was held back for more writes when the run loop was about to wait.
+     */
+    uint64_t numHeldTransmitBuffers;
+
+    /**
+     * Peak number of large transmit buffers that were held by TCP streams at the same time.
+     */
+    size_t maxLargeTransmitBuffersInUse;
+
+    /**
+     * Number of reads that were served from a receive buffer without a receive.
+     */
+    uint64_t numReadAheadReads;
+
+    /**
+     * Number of reads that received directly because no receive buffer was free.
+     */
+    uint64_t numReceiveBufferShortages;
+
+    /**
+     * Peak number of receive buffers that were held by TCP streams at the same time.
+     */
+    size_t maxReceiveBuffersInUse;
+
+    /**
+     * Number of bytes that were received on all TCP streams.
+     */
+    uint64_t numBytesReceived;
+
+    /**
+     * Number of receives on all TCP streams.
+     */
+    uint64_t numReceives;
+
+    /**
+     * Number of receives on all TCP streams that would have blocked.
+     */
+    uint64_t numReceivesWouldBlock;
+
+    /**
+     * Number of bytes that were sent on all TCP streams.
+     */
+    uint64_t numBytesSent;
+
+    /**
+     * Number of sends on all TCP streams.
+     */
+    uint64_t numSends;
+
+    /**
+     * Number of sends on all TCP streams that would have blocked.
+     */
+    uint64_t numSendsWouldBlock;
+
+    /**
+     * Statistics of the most recently closed TCP stream.
+     */
+    HAPPlatformTCPStreamStatistics lastClosedTCPStream;
+} HAPPlatformTCPStreamManagerStatistics;
+
+// Opaque type. Do not use directly.
+/**@cond */
+typedef struct {
+    HAPPlatformTCPStreamManagerRef tcpStreamManager;
+
+    uint32_t interfaceIndex;
+    HAPNetworkPort port;
+
+    int fileDescriptor;
+    HAPPlatformFileHandleRef fileHandle;
+    HAPPlatformTCPStreamListenerCallback _Nullable callback;
+    void* _Nullable context;
+} HAPPlatformTCPStreamListener;
+/**@endcond */
+
+// Opaque type. Do not use directly.
+/**@cond */
+typedef struct {
+    uint8_t* _Nullable firstFreeBuffer;
+    size_t bufferSize;
+    size_t numBuffersInUse;
+} HAPPlatformTCPStreamBufferPool;
+/**@endcond */
+
+// Opaque type. Do not use directly.
+/**@cond */
+typedef struct {
+    HAPPlatformTCPStreamManagerRef tcpStreamManager;
+
+    int fileDescriptor;
+    HAPPlatformFileHandleRef fileHandle;
+    HAPPlatformTCPStreamEvent interests;
+    HAPPlatformTCPStreamEventCallback _Nullable callback;
+    void* _Nullable context;
+    HAPTime lastActivity;
+    bool isEvicted;
+    bool isPeerUnresponsive;
+    size_t nextFreeTCPStream;
+    uint8_t* _Nullable transmitBytes;
+    size_t transmitBufferSize;
+    size_t numTransmitBytes;
+    bool isTransmitFailed;
+    bool isCloseOutputPending;
+    bool hasWrittenBeforeWait;
+    size_t numBytesWrittenSinceRead;
+    bool isTransmitBufferGrown;
+    HAPTime transmitBufferGrowthTime;
+    uint8_t* _Nullable receiveBytes;
+    size_t receiveOffset;
+    size_t numReceiveBytes;
+    HAPPlatformTCPStreamStatistics statistics;
+} HAPPlatformTCPStream;
+/**@endcond */
+
+/**
+ * TCP stream manager.
+ */
+struct HAPPlatformTCPStreamManager {
+    // Opaque type. Do not access the instance fields directly.
+    /**@cond */
+    size_t numTCPStreams;
+    size_t maxTCPStreams;
+
+    struct {
+        char interfaceName[kHAPPlatformTCPStreamManager_MaxInterfaceNameBytes];
+        HAPNetworkPort port;
+    } tcpStreamListenerConfiguration;
+
+    HAPPlatformTCPStreamListener tcpStreamListener;
+    HAPPlatformTCPStream* _Nullable tcpStreams;
+    size_t firstFreeTCPStream;
+    HAPTime minIdleTimeBeforeEviction;
+    HAPTime deadPeerTimeout;
+    HAPPlatformTimerRef evictionTimer;
+    HAPPlatformTimerRef listenerResumeTimer;
+    HAPPlatformTCPStreamBufferPool transmitBuffers;
+    HAPPlatformTCPStreamBufferPool largeTransmitBuffers;
+    HAPTime largeTransmitBufferTimeout;
+    bool isTransmitBufferFlushScheduled;
+    HAPPlatformTCPStreamBufferPool receiveBuffers;
+    HAPPlatformTimerRef readAheadTimer;
+    HAPPlatformTCPStreamManagerStatistics statistics;
+    /**@endcond */
+};
+
+/**
+ * Initializes TCP stream manager.
+ *
+ * @param[out] tcpStreamManager     Pointer to an allocated but uninitialized HAPPlatformTCPStreamManager structure.
+ * @param      options              Initialization options.
+ */
+void HAPPlatformTCPStreamManagerCreate(
+        HAPPlatformTCPStreamManagerRef tcpStreamManager,
+        const HAPPlatformTCPStreamManagerOptions* options);
+
+/**
+ * Releases resources associated with an initialized TCP stream manager instance.
+ *
+ * - IMPORTANT: Do not use this method on TCP stream manager structures that are not initialized!
+ *
+ * @param      tcpStreamManager     TCP stream manager.
+ */
+void HAPPlatformTCPStreamManagerRelease(HAPPlatformTCPStreamManagerRef tcpStreamManager);
+
+/**
+ * Gets the TCP stream manager statistics.
+ *
+ * @param      tcpStreamManager     TCP stream manager.
+ * @param[out] statistics           TCP stream manager statistics.
+ */
+void HAPPlatformTCPStreamManagerGetStatistics(
+        HAPPlatformTCPStreamManagerRef tcpStreamManager,
+        HAPPlatformTCPStreamManagerStatistics* statistics);
+
+/**
+ * Gets the statistics of an open TCP stream.
+ *
+ * @param      tcpStreamManager     TCP stream manager.
+ * @param      tcpStream            TCP stream.
+ * @param[out] statistics           TCP stream statistics.
+ */
+void HAPPlatformTCPStreamGetStatistics(
+        HAPPlatformTCPStreamManagerRef tcpStreamManager,
+        HAPPlatformTCPStreamRef tcpStream,
+        HAPPlatformTCPStreamStatistics* statistics);
+
+/**
+ * Callback that should be invoked for each open TCP stream.
+ *
+ * @param      context              Context.
+ * @param      tcpStreamManager     TCP stream manager.
+ * @param      tcpStream            TCP stream.
+ * @param[in,out] shouldContinue    True if enumeration shall continue, False otherwise. Is set to true on input.
+ */
+typedef void (*HAPPlatformTCPStreamManagerEnumerateTCPStreamsCallback)(
+        void* _Nullable context,
+        HAPPlatformTCPStreamManagerRef tcpStreamManager,
+        HAPPlatformTCPStreamRef tcpStream,
+        bool* shouldContinue);
+
+/**
+ * Enumerates all open TCP streams.
+ *
+ * - The TCP streams must not be closed during enumeration.
+ *
+ * @param      tcpStreamManager     TCP stream manager.
+ * @param      callback             Function to call on each open TCP stream.
+ * @param      context              Context that is passed to the callback.
+ */
+void HAPPlatformTCPStreamManagerEnumerateTCPStreams(
+        HAPPlatformTCPStreamManagerRef tcpStreamManager,
+        HAPPlatformTCPStreamManagerEnumerateTCPStreamsCallback callback,
+        void* _Nullable context);
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull end
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,1464 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Copyright (c) 2022 John Buonagurio
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+#include <errno.h>
+#include <stdlib.h>
+
+#include "HAPPlatform+Init.h"
+#include "HAPPlatformLog+Init.h"
+#include "HAPPlatformRunLoop+Init.h"
+#include "HAPPlatformTCPStreamManager+Init.h"
+#include "HAPPlatformTCPStreamSocket.h"
+
+static const HAPLogObject logObject = { .subsystem = kHAPPlatform_LogSubsystem, .category = "TCPStreamManager" };
+
+/**
+ * Number of unanswered TCP keepalive probes after which the peer of a TCP stream is considered unresponsive.
+ */
+#define kHAPPlatformTCPStreamManager_NumKeepAliveProbes 4
+
+/**
+ * Sets all fields of a TCP stream listener to their initial values.
+ *
+ * @param      tcpStreamListener    TCP stream listener.
+ */
+static void InitializeTCPStreamListener(HAPPlatformTCPStreamListener* tcpStreamListener)
+{
+    HAPPrecondition(tcpStreamListener);
+
+    tcpStreamListener->tcpStreamManager = NULL;
+    tcpStreamListener->interfaceIndex = 0;
+    tcpStreamListener->port = 0;
+    tcpStreamListener->fileDescriptor = -1;
+    tcpStreamListener->fileHandle = 0;
+    tcpStreamListener->callback = NULL;
+    tcpStreamListener->context = NULL;
+}
+
+/**
+ * Sets all fields of a TCP stream to their initial values.
+ *
+ * @param      tcpStream            TCP stream.
+ */
+static void InitializeTCPStream(HAPPlatformTCPStream* tcpStream)
+{
+    HAPPrecondition(tcpStream);
+
+    tcpStream->tcpStreamManager = NULL;
+    tcpStream->fileDescriptor = -1;
+    tcpStream->fileHandle = 0;
+    tcpStream->interests.hasBytesAvailable = false;
+    tcpStream->interests.hasSpaceAvailable = false;
+    tcpStream->callback = NULL;
+    tcpStream->context = NULL;
+    tcpStream->lastActivity = 0;
+    tcpStream->isEvicted = false;
+    tcpStream->isPeerUnresponsive = false;
+    tcpStream->transmitBytes = NULL;
+    tcpStream->transmitBufferSize = 0;
+    tcpStream->numTransmitBytes = 0;
+    tcpStream->isTransmitFailed = false;
+    tcpStream->isCloseOutputPending = false;
+    tcpStream->hasWrittenBeforeWait = false;
+    tcpStream->numBytesWrittenSinceRead = 0;
+    tcpStream->isTransmitBufferGrown = false;
+    tcpStream->transmitBufferGrowthTime = 0;
+    tcpStream->receiveBytes = NULL;
+    tcpStream->receiveOffset = 0;
+    tcpStream->numReceiveBytes = 0;
+    HAPRawBufferZero(&tcpStream->statistics, sizeof tcpStream->statistics);
+}
+
+/**
+ * Takes a buffer from a free list.
+ *
+ * @param      firstFreeBuffer      First buffer of the free list.
+ *
+ * @return Buffer, or NULL if the free list is empty.
+ */
+static uint8_t* _Nullable TakeFreeBuffer(uint8_t* _Nullable* firstFreeBuffer)
+{
+    HAPPrecondition(firstFreeBuffer);
+
+    // Free buffers are linked through their first bytes.
+    uint8_t* _Nullable buffer = *firstFreeBuffer;
+    if (buffer) {
+        HAPRawBufferCopyBytes(firstFreeBuffer, HAPNonnull(buffer), sizeof(uint8_t*));
+    }
+    return buffer;
+}
+
+/**
+ * Puts a buffer onto a free list.
+ *
+ * @param      firstFreeBuffer      First buffer of the free list.
+ * @param      buffer               Buffer.
+ */
+static void PutFreeBuffer(uint8_t* _Nullable* firstFreeBuffer, uint8_t* buffer)
+{
+    HAPPrecondition(firstFreeBuffer);
+    HAPPrecondition(buffer);
+
+    HAPRawBufferCopyBytes(buffer, firstFreeBuffer, sizeof(uint8_t*));
+    *firstFreeBuffer = buffer;
+}
+
+/**
+ * Puts the buffers of a pool onto its free list.
+ *
+ * @param[out] pool                 Buffer pool.
+ * @param      buffers              Buffers, or NULL for an empty pool.
+ * @param      bufferSize           Size of each buffer.
+ * @param      numBuffers           Number of buffers.
+ */
+static void InitializeBufferPool(
+        HAPPlatformTCPStreamBufferPool* pool,
+        void* _Nullable buffers,
+        size_t bufferSize,
+        size_t numBuffers)
+{
+    HAPPrecondition(pool);
+
+    pool->firstFreeBuffer = NULL;
+    pool->bufferSize = buffers ? bufferSize : 0;
+    pool->numBuffersInUse = 0;
+    if (buffers) {
+        for (size_t i = numBuffers; i-- > 0;) {
+            PutFreeBuffer(&pool->firstFreeBuffer, &((uint8_t*) buffers)[i * bufferSize]);
+        }
+    }
+}
+
+/**
+ * Takes a free buffer from a pool.
+ *
+ * @param      pool                 Buffer pool.
+ * @param[in,out] maxBuffersInUse   Peak number of buffers that were taken from the pool at the same time.
+ *
+ * @return Buffer, or NULL if no buffer is free.
+ */
+static uint8_t* _Nullable AcquireBuffer(HAPPlatformTCPStreamBufferPool* pool, size_t* maxBuffersInUse)
+{
+    HAPPrecondition(pool);
+    HAPPrecondition(maxBuffersInUse);
+
+    uint8_t* _Nullable buffer = TakeFreeBuffer(&pool->firstFreeBuffer);
+    if (buffer) {
+        pool->numBuffersInUse++;
+        *maxBuffersInUse = HAPMax(*maxBuffersInUse, pool->numBuffersInUse);
+    }
+    return buffer;
+}
+
+/**
+ * Returns a buffer to its pool.
+ *
+ * @param      pool                 Buffer pool.
+ * @param      buffer               Buffer.
+ */
+static void ReleaseBuffer(HAPPlatformTCPStreamBufferPool* pool, uint8_t* buffer)
+{
+    HAPPrecondition(pool);
+    HAPPrecondition(buffer);
+
+    HAPAssert(pool->numBuffersInUse);
+    pool->numBuffersInUse--;
+    PutFreeBuffer(&pool->firstFreeBuffer, buffer);
+}
+
+/**
+ * Records the size of the buffers that a TCP stream holds.
+ *
+ * @param      tcpStream            TCP stream.
+ */
+static void UpdateBufferStatistics(HAPPlatformTCPStream* tcpStream)
+{
+    HAPPrecondition(tcpStream);
+    HAPPrecondition(tcpStream->tcpStreamManager);
+
+    size_t numBufferBytes = tcpStream->transmitBufferSize +
+                            (tcpStream->receiveBytes ? tcpStream->tcpStreamManager->receiveBuffers.bufferSize : 0);
+    tcpStream->statistics.maxBufferBytes = HAPMax(tcpStream->statistics.maxBufferBytes, numBufferBytes);
+}
+
+/**
+ * Updates whether a TCP stream takes large transmit buffers before a write.
+ *
+ * - A TCP stream that writes a response in several writes that together do not fit into a small transmit buffer
+ *   grows, or stays grown for another largeTransmitBufferTimeout. A response in a single write is sent right away
+ *   and does not need a large transmit buffer.
+ *
+ * - A TCP stream that has not needed a large transmit buffer for largeTransmitBufferTimeout goes back to small ones.
+ *   A large transmit buffer that it holds is kept until its bytes have been sent.
+ *
+ * @param      tcpStream            TCP stream.
+ * @param      numBytes             Number of bytes of the write.
+ */
+static void UpdateTransmitBufferGrowth(HAPPlatformTCPStream* tcpStream, size_t numBytes)
+{
+    HAPPrecondition(tcpStream);
+    HAPPrecondition(tcpStream->tcpStreamManager);
+
+    HAPPlatformTCPStreamManagerRef tcpStreamManager = tcpStream->tcpStreamManager;
+    if (!tcpStreamManager->largeTransmitBuffers.bufferSize) {
+        return;
+    }
+
+    HAPTime now = HAPPlatformClockGetCurrent();
+    if (tcpStream->numBytesWrittenSinceRead &&
+        tcpStream->numBytesWrittenSinceRead + numBytes >= tcpStreamManager->transmitBuffers.bufferSize &&
+        numBytes < tcpStreamManager->largeTransmitBuffers.bufferSize) {
+        if (!tcpStream->isTransmitBufferGrown) {
+            HAPLogDebug(&logObject, "TCP stream %d grows to large transmit buffers.", tcpStream->fileDescriptor);
+            tcpStream->isTransmitBufferGrown = true;
+            tcpStreamManager->statistics.numTransmitBufferGrowths++;
+        }
+        tcpStream->transmitBufferGrowthTime = now;
+    } else if (
+            tcpStream->isTransmitBufferGrown && tcpStreamManager->largeTransmitBufferTimeout &&
+            now - tcpStream->transmitBufferGrowthTime >= tcpStreamManager->largeTransmitBufferTimeout) {
+        HAPLogDebug(&logObject, "TCP stream %d goes back to small transmit buffers.", tcpStream->fileDescriptor);
+        tcpStream->isTransmitBufferGrown = false;
+    }
+}
+
+/**
+ * Takes a free transmit buffer for a TCP stream that is larger than a write.
+ *
+ * - A TCP stream that has grown takes a large transmit buffer while one is free.
+ *
+ * @param      tcpStream            TCP stream without transmit buffer.
+ * @param      numBytes             Number of bytes of the write.
+ *
+ * @return true                     If the TCP stream took a transmit buffer.
+ * @return false                    Otherwise.
+ */
+static bool AcquireTransmitBuffer(HAPPlatformTCPStream* tcpStream, size_t numBytes)
+{
+    HAPPrecondition(tcpStream);
+    HAPPrecondition(tcpStream->tcpStreamManager);
+    HAPPrecondition(!tcpStream->transmitBytes);
+
+    HAPPlatformTCPStreamManagerRef tcpStreamManager = tcpStream->tcpStreamManager;
+    HAPPlatformTCPStreamBufferPool* largeTransmitBuffers = &tcpStreamManager->largeTransmitBuffers;
+    HAPPlatformTCPStreamBufferPool* transmitBuffers = &tcpStreamManager->transmitBuffers;
+
+    if (tcpStream->isTransmitBufferGrown && numBytes < largeTransmitBuffers->bufferSize) {
+        tcpStream->transmitBytes =
+                AcquireBuffer(largeTransmitBuffers, &tcpStreamManager->statistics.maxLargeTransmitBuffersInUse);
+        tcpStream->transmitBufferSize = largeTransmitBuffers->bufferSize;
+    }
+    if (!tcpStream->transmitBytes && numBytes < transmitBuffers->bufferSize) {
+        tcpStream->transmitBytes =
+                AcquireBuffer(transmitBuffers, &tcpStreamManager->statistics.maxTransmitBuffersInUse);
+        tcpStream->transmitBufferSize = transmitBuffers->bufferSize;
+    }
+    if (!tcpStream->transmitBytes) {
+        tcpStream->transmitBufferSize = 0;
+        return false;
+    }
+    UpdateBufferStatistics(tcpStream);
+    return true;
+}
+
+/**
+ * Returns the transmit buffer of a TCP stream. Bytes that are left in it are discarded.
+ *
+ * @param      tcpStream            TCP stream.
+ */
+static void ReleaseTransmitBuffer(HAPPlatformTCPStream* tcpStream)
+{
+    HAPPrecondition(tcpStream);
+    HAPPrecondition(tcpStream->tcpStreamManager);
+
+    HAPPlatformTCPStreamManagerRef tcpStreamManager = tcpStream->tcpStreamManager;
+    if (tcpStream->transmitBytes) {
+        ReleaseBuffer(tcpStream->transmitBufferSize == tcpStreamManager->transmitBuffers.bufferSize ?
+                              &tcpStreamManager->transmitBuffers :
+                              &tcpStreamManager->largeTransmitBuffers,
+                      HAPNonnull(tcpStream->transmitBytes));
+        tcpStream->transmitBytes = NULL;
+    }
+    tcpStream->transmitBufferSize = 0;
+    tcpStream->numTransmitBytes = 0;
+}
+
+/**
+ * Takes a free receive buffer.
+ *
+ * @param      tcpStreamManager     TCP stream manager.
+ *
+ * @return Receive buffer, or NULL if no receive buffer is free.
+ */
+static uint8_t* _Nullable AcquireReceiveBuffer(HAPPlatformTCPStreamManagerRef tcpStreamManager)
+{
+    HAPPrecondition(tcpStreamManager);
+
+    return AcquireBuffer(&tcpStreamManager->receiveBuffers, &tcpStreamManager->statistics.maxReceiveBuffersInUse);
+}
+
+/**
+ * Returns a receive buffer.
+ *
+ * @param      tcpStreamManager     TCP stream manager.
+ * @param      receiveBuffer        Receive buffer.
+ */
+static void ReleaseReceiveBuffer(HAPPlatformTCPStreamManagerRef tcpStreamManager, uint8_t* receiveBuffer)
+{
+    HAPPrecondition(tcpStreamManager);
+    HAPPrecondition(receiveBuffer);
+
+    ReleaseBuffer(&tcpStreamManager->receiveBuffers, receiveBuffer);
+}
+
+/**
+ * Discards the unread bytes of a TCP stream and returns its receive buffer.
+ *
+ * @param      tcpStream            TCP stream.
+ */
+static void DiscardReceiveBuffer(HAPPlatformTCPStream* tcpStream)
+{
+    HAPPrecondition(tcpStream);
+    HAPPrecondition(tcpStream->tcpStreamManager);
+
+    if (tcpStream->receiveBytes) {
+        ReleaseReceiveBuffer(tcpStream->tcpStreamManager, HAPNonnull(tcpStream->receiveBytes));
+        tcpStream->receiveBytes = NULL;
+    }
+    tcpStream->receiveOffset = 0;
+    tcpStream->numReceiveBytes = 0;
+}
+
+void HAPPlatformTCPStreamSocketGetKeepAlive(HAPTime deadPeerTimeout, HAPPlatformTCPStreamSocketKeepAlive* keepAlive)
+{
+    HAPPrecondition(deadPeerTimeout);
+    HAPPrecondition(keepAlive);
+
+    // Probe after half of the timeout without incoming bytes, and spread the probes over the other half.
+    HAPTime timeout = deadPeerTimeout / HAPSecond;
+    HAPTime idleTime = HAPMax(timeout / 2, (HAPTime) 1);
+    HAPTime probeTime = timeout - HAPMin(idleTime, timeout);
+    HAPTime probeInterval = HAPMax(probeTime / kHAPPlatformTCPStreamManager_NumKeepAliveProbes, (HAPTime) 1);
+    keepAlive->idleTime = idleTime * HAPSecond;
+    keepAlive->probeInterval = probeInterval * HAPSecond;
+    keepAlive->numProbes = kHAPPlatformTCPStreamManager_NumKeepAliveProbes;
+}
+
+HAP_RESULT_USE_CHECK
+HAPNetworkPort HAPPlatformTCPStreamManagerGetListenerPort(HAPPlatformTCPStreamManagerRef tcpStreamManager)
+{
+    HAPPrecondition(tcpStreamManager);
+    HAPPrecondition(tcpStreamManager->tcpStreams);
+    HAPPrecondition(tcpStreamManager->tcpStreamListener.tcpStreamManager);
+
+    return tcpStreamManager->tcpStreamListener.port;
+}
+
+void HAPPlatformTCPStreamManagerCreate(HAPPlatformTCPStreamManagerRef tcpStreamManager,
+                                       const HAPPlatformTCPStreamManagerOptions* options)
+{
+    HAPPrecondition(tcpStreamManager);
+    HAPPrecondition(options);
+    HAPPrecondition(options->maxConcurrentTCPStreams);
+    HAPPrecondition(!options->transmitBuffers ||
+                    (options->transmitBufferSize >= sizeof(uint8_t*) && options->numTransmitBuffers));
+    HAPPrecondition(!options->receiveBuffers ||
+                    (options->receiveBufferSize >= sizeof(uint8_t*) && options->numReceiveBuffers));
+    HAPPrecondition(!options->largeTransmitBuffers ||
+                    (options->transmitBuffers && options->largeTransmitBufferSize > options->transmitBufferSize &&
+                     options->numLargeTransmitBuffers));
+
+    HAPRawBufferZero(tcpStreamManager, sizeof *tcpStreamManager);
+
+    if (options->interfaceName) {
+        size_t numInterfaceNameBytes = HAPStringGetNumBytes(HAPNonnull(options->interfaceName));
+        if ((numInterfaceNameBytes == 0) ||
+            (numInterfaceNameBytes >= sizeof tcpStreamManager->tcpStreamListenerConfiguration.interfaceName)) {
+            HAPLogError(&logObject, "Invalid local network interface name.");
+            HAPFatalError();
+        }
+        HAPRawBufferCopyBytes(
+                tcpStreamManager->tcpStreamListenerConfiguration.interfaceName,
+                HAPNonnull(options->interfaceName),
+                numInterfaceNameBytes);
+    }
+    tcpStreamManager->tcpStreamListenerConfiguration.port = options->port;
+
+    tcpStreamManager->numTCPStreams = 0;
+    tcpStreamManager->maxTCPStreams = options->maxConcurrentTCPStreams;
+    tcpStreamManager->minIdleTimeBeforeEviction = options->minIdleTimeBeforeEviction;
+    tcpStreamManager->deadPeerTimeout = options->deadPeerTimeout;
+
+    HAPLogDebug(&logObject, "Storage configuration: tcpStreamManager = %lu",
+                (unsigned long)sizeof *tcpStreamManager);
+    HAPLogDebug(&logObject, "Storage configuration: maxTCPStreams = %lu",
+                (unsigned long)tcpStreamManager->maxTCPStreams);
+    HAPLogDebug(&logObject, "Storage configuration: tcpStreams = %lu",
+                (unsigned long)tcpStreamManager->maxTCPStreams * sizeof(HAPPlatformTCPStream));
+
+    InitializeTCPStreamListener(&tcpStreamManager->tcpStreamListener);
+
+    tcpStreamManager->tcpStreams = calloc(tcpStreamManager->maxTCPStreams, sizeof(HAPPlatformTCPStream));
+    if (!tcpStreamManager->tcpStreams) {
+        HAPLogError(&logObject, "Allocating new TCP stream failed: out of memory.");
+        HAPFatalError();
+    }
+    for (size_t i = 0; i < tcpStreamManager->maxTCPStreams; i++) {
+        InitializeTCPStream(&tcpStreamManager->tcpStreams[i]);
+        tcpStreamManager->tcpStreams[i].nextFreeTCPStream = i + 1;
+    }
+    tcpStreamManager->firstFreeTCPStream = 0;
+
+    InitializeBufferPool(&tcpStreamManager->transmitBuffers,
+                         options->transmitBuffers,
+                         options->transmitBufferSize,
+                         options->numTransmitBuffers);
+    InitializeBufferPool(&tcpStreamManager->largeTransmitBuffers,
+                         options->largeTransmitBuffers,
+                         options->largeTransmitBufferSize,
+                         options->numLargeTransmitBuffers);
+    tcpStreamManager->largeTransmitBufferTimeout = options->largeTransmitBufferTimeout;
+    InitializeBufferPool(&tcpStreamManager->receiveBuffers,
+                         options->receiveBuffers,
+                         options->receiveBufferSize,
+                         options->numReceiveBuffers);
+}
+
+void HAPPlatformTCPStreamManagerRelease(HAPPlatformTCPStreamManagerRef tcpStreamManager)
+{
+    HAPPrecondition(tcpStreamManager);
+    HAPPrecondition(tcpStreamManager->tcpStreams);
+
+    if (tcpStreamManager->evictionTimer) {
+        HAPPlatformTimerDeregister(tcpStreamManager->evictionTimer);
+        tcpStreamManager->evictionTimer = 0;
+    }
+    if (tcpStreamManager->readAheadTimer) {
+        HAPPlatformTimerDeregister(tcpStreamManager->readAheadTimer);
+        tcpStreamManager->readAheadTimer = 0;
+    }
+    if (tcpStreamManager->isTransmitBufferFlushScheduled) {
+        HAPPlatformRunLoopSetBeforeWaitCallback(NULL, NULL);
+        tcpStreamManager->isTransmitBufferFlushScheduled = false;
+    }
+
+    HAPPlatformFreeSafe(tcpStreamManager->tcpStreams);
+    tcpStreamManager->tcpStreams = NULL;
+}
+
+void HAPPlatformTCPStreamManagerGetStatistics(
+        HAPPlatformTCPStreamManagerRef tcpStreamManager,
+        HAPPlatformTCPStreamManagerStatistics* statistics)
+{
+    HAPPrecondition(tcpStreamManager);
+    HAPPrecondition(statistics);
+
+    *statistics = tcpStreamManager->statistics;
+}
+
+void HAPPlatformTCPStreamGetStatistics(
+        HAPPlatformTCPStreamManagerRef tcpStreamManager,
+        HAPPlatformTCPStreamRef tcpStream_,
+        HAPPlatformTCPStreamStatistics* statistics)
+{
+    HAPPrecondition(tcpStreamManager);
+    HAPPrecondition(tcpStreamManager->tcpStreams);
+    HAPPrecondition(tcpStream_);
+    HAPPrecondition(statistics);
+
+    HAPPlatformTCPStream* tcpStream = (HAPPlatformTCPStream*) tcpStream_;
+
+    HAPPrecondition(tcpStream->tcpStreamManager == tcpStreamManager);
+    HAPPrecondition(tcpStream->fileDescriptor != -1);
+
+    *statistics = tcpStream->statistics;
+}
+
+void HAPPlatformTCPStreamManagerEnumerateTCPStreams(
+        HAPPlatformTCPStreamManagerRef tcpStreamManager,
+        HAPPlatformTCPStreamManagerEnumerateTCPStreamsCallback callback,
+        void* _Nullable context)
+{
+    HAPPrecondition(tcpStreamManager);
+    HAPPrecondition(tcpStreamManager->tcpStreams);
+    HAPPrecondition(callback);
+
+    bool shouldContinue = true;
+    for (size_t i = 0; shouldContinue && i < tcpStreamManager->maxTCPStreams; i++) {
+        HAPPlatformTCPStream* tcpStream = &tcpStreamManager->tcpStreams[i];
+        if (tcpStream->fileDescriptor != -1) {
+            callback(context, tcpStreamManager, (HAPPlatformTCPStreamRef) tcpStream, &shouldContinue);
+        }
+    }
+}
+
+HAP_RESULT_USE_CHECK
+bool HAPPlatformTCPStreamManagerIsListenerOpen(HAPPlatformTCPStreamManagerRef tcpStreamManager)
+{
+    HAPPrecondition(tcpStreamManager);
+    HAPPrecondition(tcpStreamManager->tcpStreams);
+
+    return tcpStreamManager->tcpStreamListener.tcpStreamManager != NULL;
+}
+
+static void HandleTCPStreamListenerFileHandleCallback(HAPPlatformFileHandleRef fileHandle,
+                                                      HAPPlatformFileHandleEvent fileHandleEvents,
+                                                      void* _Nullable context);
+
+void HAPPlatformTCPStreamManagerOpenListener(HAPPlatformTCPStreamManagerRef tcpStreamManager,
+                                             HAPPlatformTCPStreamListenerCallback callback,
+                                             void* _Nullable context)
+{
+    HAPPrecondition(tcpStreamManager);
+    HAPPrecondition(tcpStreamManager->tcpStreams);
+    HAPPrecondition(callback);
+
+    HAPPrecondition(!tcpStreamManager->tcpStreamListener.tcpStreamManager);
+    HAPPrecondition(tcpStreamManager->tcpStreamListener.interfaceIndex == 0);
+    HAPPrecondition(tcpStreamManager->tcpStreamListener.port == 0);
+    HAPPrecondition(tcpStreamManager->tcpStreamListener.fileDescriptor == -1);
+    HAPPrecondition(!tcpStreamManager->tcpStreamListener.fileHandle);
+    HAPPrecondition(!tcpStreamManager->tcpStreamListener.callback);
+    HAPPrecondition(!tcpStreamManager->tcpStreamListener.context);
+
+    HAPError err;
+
+    int fileDescriptor;
+    uint32_t interfaceIndex;
+    HAPNetworkPort port;
+    HAPPlatformTCPStreamSocketOpenListener(
+            tcpStreamManager->tcpStreamListenerConfiguration.interfaceName,
+            tcpStreamManager->tcpStreamListenerConfiguration.port,
+            &fileDescriptor,
+            &interfaceIndex,
+            &port);
+
+    HAPPlatformFileHandleRef fileHandle;
+
+    // HAPPlatformRunLoop.c
+    err = HAPPlatformFileHandleRegister(&fileHandle,
+                                        fileDescriptor,
+                                        (HAPPlatformFileHandleEvent) { .isReadyForReading = true,
+                                                                       .isReadyForWriting = false,
+                                                                       .hasErrorConditionPending = false },
+                                        HandleTCPStreamListenerFileHandleCallback,
+                                        &tcpStreamManager->tcpStreamListener);
+    if (err) {
+        HAPLogError(&logObject, "Failed to register TCP stream listener file handle.");
+        HAPFatalError();
+    }
+    HAPAssert(fileHandle);
+
+    tcpStreamManager->tcpStreamListener.tcpStreamManager = tcpStreamManager;
+    tcpStreamManager->tcpStreamListener.port = port;
+    tcpStreamManager->tcpStreamListener.interfaceIndex = interfaceIndex;
+    tcpStreamManager->tcpStreamListener.fileDescriptor = fileDescriptor;
+    tcpStreamManager->tcpStreamListener.fileHandle = fileHandle;
+    tcpStreamManager->tcpStreamListener.callback = callback;
+    tcpStreamManager->tcpStreamListener.context = context;
+}
+
+void HAPPlatformTCPStreamManagerCloseListener(HAPPlatformTCPStreamManagerRef tcpStreamManager)
+{
+    HAPPrecondition(tcpStreamManager);
+    HAPPrecondition(tcpStreamManager->tcpStreams);
+    HAPPrecondition(tcpStreamManager->tcpStreamListener.tcpStreamManager == tcpStreamManager);
+    HAPPrecondition(tcpStreamManager->tcpStreamListener.fileDescriptor != -1);
+    HAPPrecondition(tcpStreamManager->tcpStreamListener.fileHandle);
+    HAPPrecondition(tcpStreamManager->tcpStreamListener.callback);
+
+    if (tcpStreamManager->listenerResumeTimer) {
+        HAPPlatformTimerDeregister(tcpStreamManager->listenerResumeTimer);
+        tcpStreamManager->listenerResumeTimer = 0;
+    }
+
+    // HAPPlatformRunLoop.c
+    HAPPlatformFileHandleDeregister(tcpStreamManager->tcpStreamListener.fileHandle);
+
+    HAPPlatformTCPStreamSocketClose(tcpStreamManager->tcpStreamListener.fileDescriptor);
+
+    InitializeTCPStreamListener(&tcpStreamManager->tcpStreamListener);
+}
+
+static void HandleTCPStreamFileHandleCallback(HAPPlatformFileHandleRef fileHandle,
+                                              HAPPlatformFileHandleEvent fileHandleEvents,
+                                              void* _Nullable context);
+
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformTCPStreamManagerAcceptTCPStream(HAPPlatformTCPStreamManagerRef tcpStreamManager,
+                                                    HAPPlatformTCPStreamRef* tcpStream_)
+{
+    HAPPrecondition(tcpStreamManager);
+    HAPPrecondition(tcpStreamManager->tcpStreams);
+    HAPPrecondition(tcpStreamManager->tcpStreamListener.tcpStreamManager == tcpStreamManager);
+    HAPPrecondition(tcpStreamManager->tcpStreamListener.fileDescriptor != -1);
+    HAPPrecondition(tcpStreamManager->tcpStreamListener.fileHandle);
+    HAPPrecondition(tcpStream_);
+
+    HAPError err;
+
+    if (tcpStreamManager->numTCPStreams == tcpStreamManager->maxTCPStreams) {
+        HAPLog(&logObject, "Cannot accept more TCP streams.");
+        *tcpStream_ = (HAPPlatformTCPStreamRef) NULL;
+        return kHAPError_OutOfResources;
+    }
+
+    HAPAssert(tcpStreamManager->numTCPStreams < tcpStreamManager->maxTCPStreams);
+
+    // Take the first free TCP stream. It is removed from the list once the connection is accepted.
+    size_t i = tcpStreamManager->firstFreeTCPStream;
+    HAPAssert(i < tcpStreamManager->maxTCPStreams);
+
+    HAPPlatformTCPStream* tcpStream = &tcpStreamManager->tcpStreams[i];
+
+    HAPAssert(!tcpStream->tcpStreamManager);
+    HAPAssert(tcpStream->fileDescriptor == -1);
+    HAPAssert(!tcpStream->fileHandle);
+
+    int fileDescriptor;
+    err = HAPPlatformTCPStreamSocketAccept(
+            tcpStreamManager->tcpStreamListener.fileDescriptor, tcpStreamManager->deadPeerTimeout, &fileDescriptor);
+    if (err) {
+        HAPAssert(err == kHAPError_Unknown || err == kHAPError_Busy);
+        *tcpStream_ = (HAPPlatformTCPStreamRef) NULL;
+        return err;
+    }
+
+    HAPPlatformFileHandleRef fileHandle;
+
+    // HAPPlatformRunLoop.c
+    err = HAPPlatformFileHandleRegister(&fileHandle,
+                                        fileDescriptor,
+                                        (HAPPlatformFileHandleEvent) { .isReadyForReading = false,
+                                                                       .isReadyForWriting = false,
+                                                                       .hasErrorConditionPending = false },
+                                        HandleTCPStreamFileHandleCallback,
+                                        tcpStream);
+    if (err) {
+        HAPLogError(&logObject, "Failed to register TCP stream file handle.");
+        HAPFatalError();
+    }
+    HAPAssert(fileHandle);
+
+    tcpStream->tcpStreamManager = tcpStreamManager;
+    tcpStream->fileDescriptor = fileDescriptor;
+    tcpStream->fileHandle = fileHandle;
+    tcpStream->lastActivity = HAPPlatformClockGetCurrent();
+    tcpStream->statistics.acceptTime = tcpStream->lastActivity;
+    HAPAssert(!tcpStream->interests.hasBytesAvailable);
+    HAPAssert(!tcpStream->interests.hasSpaceAvailable);
+    HAPAssert(!tcpStream->callback);
+    HAPAssert(!tcpStream->context);
+    HAPAssert(!tcpStream->isEvicted);
+
+    tcpStreamManager->firstFreeTCPStream = tcpStream->nextFreeTCPStream;
+    tcpStream->nextFreeTCPStream = tcpStreamManager->maxTCPStreams;
+
+    *tcpStream_ = (HAPPlatformTCPStreamRef) tcpStream;
+
+    tcpStreamManager->numTCPStreams++;
+    tcpStreamManager->statistics.numAcceptedTCPStreams++;
+
+    // With eviction enabled, the listener stays active so that a pending connection can evict an idle TCP stream.
+    if (tcpStreamManager->maxTCPStreams - tcpStreamManager->numTCPStreams == 0 &&
+        !tcpStreamManager->minIdleTimeBeforeEviction) {
+        HAPLogInfo(&logObject, "Suspending accepting new TCP streams on TCP stream listener socket.");
+
+        // HAPPlatformRunLoop.c
+        HAPPlatformFileHandleUpdateInterests(tcpStreamManager->tcpStreamListener.fileHandle,
+                                             (HAPPlatformFileHandleEvent) { .isReadyForReading = false,
+                                                                            .isReadyForWriting = false,
+                                                                            .hasErrorConditionPending = false },
+                                             HandleTCPStreamListenerFileHandleCallback,
+                                             &tcpStreamManager->tcpStreamListener);
+    }
+
+    return kHAPError_None;
+}
+
+/**
+ * Records that the peer of a TCP stream has stopped responding, after a receive or send failed with ETIMEDOUT.
+ *
+ * @param      tcpStream            TCP stream.
+ */
+static void HandleUnresponsivePeer(HAPPlatformTCPStream* tcpStream)
+{
+    HAPPrecondition(tcpStream);
+    HAPPrecondition(tcpStream->tcpStreamManager);
+
+    if (!tcpStream->isPeerUnresponsive) {
+        HAPLogInfo(&logObject, "Reclaiming TCP stream %d whose peer stopped responding.", tcpStream->fileDescriptor);
+        tcpStream->isPeerUnresponsive = true;
+        tcpStream->tcpStreamManager->statistics.numReclaimedTCPStreams++;
+    }
+}
+
+/**
+ * Updates the file handle interests of a TCP stream.
+ *
+ * - While bytes are pending in the transmit buffer, the file handle also waits for space.
+ *
+ * @param      tcpStream            TCP stream.
+ */
+static void UpdateFileHandleInterests(HAPPlatformTCPStream* tcpStream)
+{
+    HAPPrecondition(tcpStream);
+    HAPPrecondition(tcpStream->fileHandle);
+
+    // HAPPlatformRunLoop.c
+    HAPPlatformFileHandleUpdateInterests(
+        tcpStream->fileHandle,
+        (HAPPlatformFileHandleEvent) { .isReadyForReading = tcpStream->interests.hasBytesAvailable,
+                                       .isReadyForWriting = tcpStream->interests.hasSpaceAvailable ||
+                                                            tcpStream->numTransmitBytes > 0,
+                                       .hasErrorConditionPending = false },
+        HandleTCPStreamFileHandleCallback,
+        tcpStream);
+}
+
+/**
+ * Shuts down the output of a TCP stream.
+ *
+ * @param      tcpStream            TCP stream.
+ */
+static void ShutdownOutput(HAPPlatformTCPStream* tcpStream)
+{
+    HAPPrecondition(tcpStream);
+
+    HAPPlatformTCPStreamSocketShutdownOutput(tcpStream->fileDescriptor);
+}
+
+/**
+ * Sends bytes on a TCP stream socket.
+ *
+ * @param      tcpStream            TCP stream.
+ * @param      bytes                Buffer with the bytes to send.
+ * @param      maxBytes             Number of bytes to send.
+ * @param[out] numBytes             Number of bytes that were sent.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_Busy           If the socket cannot take more bytes.
+ * @return kHAPError_Unknown        If the send failed.
+ */
+HAP_RESULT_USE_CHECK
+static HAPError SendBytes(HAPPlatformTCPStream* tcpStream, const void* bytes, size_t maxBytes, size_t* numBytes)
+{
+    HAPPrecondition(tcpStream);
+    HAPPrecondition(bytes);
+    HAPPrecondition(numBytes);
+
+    HAPError err = HAPPlatformTCPStreamSocketSend(tcpStream->fileDescriptor, bytes, maxBytes, numBytes);
+    tcpStream->statistics.numSends++;
+    tcpStream->tcpStreamManager->statistics.numSends++;
+    if (err) {
+        HAPAssert(err == kHAPError_Unknown || err == kHAPError_Busy);
+        if (err == kHAPError_Unknown) {
+            int errorNumber = errno;
+            HAPPlatformLogPOSIXError(kHAPLogType_Error,
+                                     "System call 'send' on TCP stream socket failed.",
+                                     errorNumber, __func__, HAP_FILE, __LINE__);
+            if (errorNumber == ETIMEDOUT) {
+                HandleUnresponsivePeer(tcpStream);
+            }
+            return err;
+        }
+
+        HAPLogDebug(&logObject, "System call 'send' on TCP stream socket is busy.");
+        tcpStream->statistics.numSendsWouldBlock++;
+        tcpStream->tcpStreamManager->statistics.numSendsWouldBlock++;
+        return err;
+    }
+
+    tcpStream->statistics.numBytesSent += *numBytes;
+    tcpStream->tcpStreamManager->statistics.numBytesSent += *numBytes;
+    return kHAPError_None;
+}
+
+/**
+ * Determines whether the bytes in the transmit buffer of a TCP stream are held back for more writes.
+ *
+ * - A TCP stream that has filled part of a large transmit buffer and waits for space is writing a long response. Its
+ *   bytes are sent once the large transmit buffer is full or once the TCP stream stops writing.
+ *
+ * @param      tcpStream            TCP stream.
+ *
+ * @return true                     If the transmit buffer is held back.
+ * @return false                    Otherwise.
+ */
+static bool IsTransmitBufferHeld(const HAPPlatformTCPStream* tcpStream)
+{
+    HAPPrecondition(tcpStream);
+    HAPPrecondition(tcpStream->tcpStreamManager);
+
+    return tcpStream->transmitBytes &&
+           tcpStream->transmitBufferSize == tcpStream->tcpStreamManager->largeTransmitBuffers.bufferSize &&
+           tcpStream->numTransmitBytes < tcpStream->transmitBufferSize && tcpStream->interests.hasSpaceAvailable &&
+           !tcpStream->isCloseOutputPending;
+}
+
+/**
+ * Sends the bytes in the transmit buffer of a TCP stream.
+ *
+ * - If the bytes cannot be sent, the failure is reported to the next write.
+ *
+ * @param      tcpStream            TCP stream.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_Busy           If some bytes remain in the transmit buffer until the socket has space.
+ * @return kHAPError_Unknown        If the send failed. The bytes in the transmit buffer are discarded.
+ */
+static HAPError FlushTransmitBuffer(HAPPlatformTCPStream* tcpStream)
+{
+    HAPPrecondition(tcpStream);
+    HAPPrecondition(tcpStream->tcpStreamManager);
+    HAPPrecondition(tcpStream->transmitBytes);
+
+    HAPError err = kHAPError_None;
+    while (tcpStream->numTransmitBytes) {
+        size_t numBytes;
+        err = SendBytes(tcpStream, HAPNonnull(tcpStream->transmitBytes), tcpStream->numTransmitBytes, &numBytes);
+        if (err) {
+            if (err != kHAPError_Busy) {
+                ReleaseTransmitBuffer(tcpStream);
+                tcpStream->isTransmitFailed = true;
+            }
+            break;
+        }
+        tcpStream->tcpStreamManager->statistics.numTransmitBufferSends++;
+        HAPRawBufferCopyBytes(
+                HAPNonnull(tcpStream->transmitBytes),
+                &tcpStream->transmitBytes[numBytes],
+                tcpStream->numTransmitBytes - numBytes);
+        tcpStream->numTransmitBytes -= numBytes;
+        if (!tcpStream->numTransmitBytes) {
+            ReleaseTransmitBuffer(tcpStream);
+        }
+    }
+
+    if (!tcpStream->numTransmitBytes && tcpStream->isCloseOutputPending) {
+        tcpStream->isCloseOutputPending = false;
+        ShutdownOutput(tcpStream);
+    }
+    UpdateFileHandleInterests(tcpStream);
+    return err;
+}
+
+/**
+ * Sends the bytes in the transmit buffers of all TCP streams.
+ *
+ * - Transmit buffers that are held back are kept, so that TCP streams do not take turns with a large transmit buffer.
+ *
+ * @param      tcpStreamManager     TCP stream manager.
+ */
+static void FlushTransmitBuffers(HAPPlatformTCPStreamManagerRef tcpStreamManager)
+{
+    HAPPrecondition(tcpStreamManager);
+
+    for (size_t i = 0; i < tcpStreamManager->maxTCPStreams; i++) {
+        HAPPlatformTCPStream* tcpStream = &tcpStreamManager->tcpStreams[i];
+        if (tcpStream->fileDescriptor != -1 && tcpStream->numTransmitBytes && !IsTransmitBufferHeld(tcpStream)) {
+            // Bytes that remain are sent once the socket has space.
+            (void) FlushTransmitBuffer(tcpStream);
+        }
+    }
+}
+
+/**
+ * Sends the bytes in the transmit buffers of all TCP streams before the run loop waits for events.
+ *
+ * - A large transmit buffer that is held back stays until the next run loop iteration if its TCP stream has written
+ *   since the last one. The socket of the TCP stream reports space right away, so the run loop does not wait for it.
+ *
+ * @param      context              TCP stream manager.
+ */
+static void HandleBeforeWaitCallback(void* _Nullable context)
+{
+    HAPPrecondition(context);
+
+    HAPPlatformTCPStreamManagerRef tcpStreamManager = context;
+    HAPPrecondition(tcpStreamManager->isTransmitBufferFlushScheduled);
+
+    HAPPlatformRunLoopSetBeforeWaitCallback(NULL, NULL);
+    tcpStreamManager->isTransmitBufferFlushScheduled = false;
+
+    for (size_t i = 0; i < tcpStreamManager->maxTCPStreams; i++) {
+        HAPPlatformTCPStream* tcpStream = &tcpStreamManager->tcpStreams[i];
+        bool hasWrittenBeforeWait = tcpStream->hasWrittenBeforeWait;
+        tcpStream->hasWrittenBeforeWait = false;
+        if (tcpStream->fileDescriptor == -1 || !tcpStream->numTransmitBytes) {
+            continue;
+        }
+        if (hasWrittenBeforeWait && IsTransmitBufferHeld(tcpStream)) {
+            tcpStreamManager->statistics.numHeldTransmitBuffers++;
+            if (!tcpStreamManager->isTransmitBufferFlushScheduled) {
+                HAPPlatformRunLoopSetBeforeWaitCallback(HandleBeforeWaitCallback, tcpStreamManager);
+                tcpStreamManager->isTransmitBufferFlushScheduled = true;
+            }
+            continue;
+        }
+        // Bytes that remain are sent once the socket has space.
+        (void) FlushTransmitBuffer(tcpStream);
+    }
+}
+
+void HAPPlatformTCPStreamCloseOutput(HAPPlatformTCPStreamManagerRef tcpStreamManager,
+                                     HAPPlatformTCPStreamRef tcpStream_)
+{
+    HAPPrecondition(tcpStreamManager);
+    HAPPrecondition(tcpStreamManager->tcpStreams);
+    HAPPrecondition(tcpStream_);
+
+    HAPPlatformTCPStream* tcpStream = (HAPPlatformTCPStream*) tcpStream_;
+
+    HAPPrecondition(tcpStream->tcpStreamManager == tcpStreamManager);
+    HAPPrecondition(tcpStream->fileDescriptor != -1);
+    HAPPrecondition(tcpStream->fileHandle);
+
+    if (tcpStream->numTransmitBytes) {
+        // The output is shut down once the transmit buffer has been sent.
+        tcpStream->isCloseOutputPending = true;
+        (void) FlushTransmitBuffer(tcpStream);
+        return;
+    }
+
+    ShutdownOutput(tcpStream);
+}
+
+void HAPPlatformTCPStreamClose(HAPPlatformTCPStreamManagerRef tcpStreamManager, HAPPlatformTCPStreamRef tcpStream_)
+{
+    HAPPrecondition(tcpStreamManager);
+    HAPPrecondition(tcpStreamManager->tcpStreams);
+    HAPPrecondition(tcpStream_);
+
+    HAPPlatformTCPStream* tcpStream = (HAPPlatformTCPStream*) tcpStream_;
+
+    HAPPrecondition(tcpStream->tcpStreamManager == tcpStreamManager);
+    HAPPrecondition(tcpStream->fileDescriptor != -1);
+    HAPPrecondition(tcpStream->fileHandle);
+
+    if (tcpStream->numTransmitBytes) {
+        // Bytes that do not fit into the socket anymore are discarded.
+        (void) FlushTransmitBuffer(tcpStream);
+    }
+
+    // HAPPlatformRunLoop.c
+    HAPPlatformFileHandleDeregister(tcpStream->fileHandle);
+
+    HAPPlatformTCPStreamSocketClose(tcpStream->fileDescriptor);
+
+    tcpStream->statistics.closeTime = HAPPlatformClockGetCurrent();
+    tcpStreamManager->statistics.lastClosedTCPStream = tcpStream->statistics;
+
+    ReleaseTransmitBuffer(tcpStream);
+    DiscardReceiveBuffer(tcpStream);
+    InitializeTCPStream(tcpStream);
+
+    size_t i = (size_t)(tcpStream - tcpStreamManager->tcpStreams);
+    HAPAssert(i < tcpStreamManager->maxTCPStreams);
+    tcpStream->nextFreeTCPStream = tcpStreamManager->firstFreeTCPStream;
+    tcpStreamManager->firstFreeTCPStream = i;
+
+    HAPAssert(tcpStreamManager->numTCPStreams <= tcpStreamManager->maxTCPStreams);
+
+    HAPAssert(tcpStreamManager->numTCPStreams > 0);
+
+    tcpStreamManager->numTCPStreams--;
+
+    if (tcpStreamManager->tcpStreamListener.fileDescriptor != -1) {
+        HAPAssert(tcpStreamManager->tcpStreamListener.tcpStreamManager == tcpStreamManager);
+        HAPAssert(tcpStreamManager->tcpStreamListener.fileHandle);
+        if (tcpStreamManager->maxTCPStreams - tcpStreamManager->numTCPStreams == 1) {
+            HAPLogInfo(&logObject, "Resuming accepting new TCP streams on TCP stream listener socket.");
+
+            if (tcpStreamManager->listenerResumeTimer) {
+                HAPPlatformTimerDeregister(tcpStreamManager->listenerResumeTimer);
+                tcpStreamManager->listenerResumeTimer = 0;
+            }
+
+            // HAPPlatformRunLoop.c
+            HAPPlatformFileHandleUpdateInterests(tcpStreamManager->tcpStreamListener.fileHandle,
+                                                 (HAPPlatformFileHandleEvent) { .isReadyForReading = true,
+                                                                                .isReadyForWriting = false,
+                                                                                .hasErrorConditionPending = false },
+                                                 HandleTCPStreamListenerFileHandleCallback,
+                                                 &tcpStreamManager->tcpStreamListener);
+        }
+    } else {
+        HAPAssert(!tcpStreamManager->tcpStreamListener.tcpStreamManager);
+        HAPAssert(!tcpStreamManager->tcpStreamListener.fileHandle);
+    }
+}
+
+static void HandleEvictionTimerExpired(HAPPlatformTimerRef timer, void* _Nullable context)
+{
+    HAPPrecondition(context);
+
+    HAPPlatformTCPStreamManagerRef tcpStreamManager = context;
+    HAPPrecondition(timer == tcpStreamManager->evictionTimer);
+    tcpStreamManager->evictionTimer = 0;
+
+    // Let evicted TCP streams read the end of stream.
+    for (size_t i = 0; i < tcpStreamManager->maxTCPStreams; i++) {
+        HAPPlatformTCPStream* tcpStream = &tcpStreamManager->tcpStreams[i];
+        if (tcpStream->isEvicted && tcpStream->interests.hasBytesAvailable) {
+            HAPAssert(tcpStream->callback);
+            tcpStream->callback(tcpStreamManager,
+                                (HAPPlatformTCPStreamRef) tcpStream,
+                                (HAPPlatformTCPStreamEvent) { .hasBytesAvailable = true, .hasSpaceAvailable = false },
+                                tcpStream->context);
+        }
+    }
+}
+
+/**
+ * Schedules a callback to the evicted TCP streams that wait for incoming bytes.
+ *
+ * @param      tcpStreamManager     TCP stream manager.
+ */
+static void ScheduleEvictionEvents(HAPPlatformTCPStreamManagerRef tcpStreamManager)
+{
+    HAPPrecondition(tcpStreamManager);
+
+    if (tcpStreamManager->evictionTimer) {
+        return;
+    }
+
+    HAPError err = HAPPlatformTimerRegister(&tcpStreamManager->evictionTimer, 0, HandleEvictionTimerExpired, tcpStreamManager);
+    if (err) {
+        HAPAssert(err == kHAPError_OutOfResources);
+        HAPLog(&logObject, "Not enough resources to schedule end of stream on evicted TCP stream.");
+        tcpStreamManager->evictionTimer = 0;
+    }
+}
+
+static void HandleReadAheadTimerExpired(HAPPlatformTimerRef timer, void* _Nullable context)
+{
+    HAPPrecondition(context);
+
+    HAPPlatformTCPStreamManagerRef tcpStreamManager = context;
+    HAPPrecondition(timer == tcpStreamManager->readAheadTimer);
+    tcpStreamManager->readAheadTimer = 0;
+
+    // Let TCP streams read the bytes that remain in their receive buffer.
+    for (size_t i = 0; i < tcpStreamManager->maxTCPStreams; i++) {
+        HAPPlatformTCPStream* tcpStream = &tcpStreamManager->tcpStreams[i];
+        if (tcpStream->numReceiveBytes && tcpStream->interests.hasBytesAvailable) {
+            HAPAssert(tcpStream->callback);
+            tcpStream->callback(tcpStreamManager,
+                                (HAPPlatformTCPStreamRef) tcpStream,
+                                (HAPPlatformTCPStreamEvent) { .hasBytesAvailable = true, .hasSpaceAvailable = false },
+                                tcpStream->context);
+        }
+    }
+}
+
+/**
+ * Schedules a callback to the TCP streams that wait for incoming bytes and have unread bytes in their receive buffer.
+ *
+ * - The socket does not report these bytes as available because they have already been received.
+ *
+ * @param      tcpStreamManager     TCP stream manager.
+ */
+static void ScheduleReadAheadEvents(HAPPlatformTCPStreamManagerRef tcpStreamManager)
+{
+    HAPPrecondition(tcpStreamManager);
+
+    if (tcpStreamManager->readAheadTimer) {
+        return;
+    }
+
+    HAPError err = HAPPlatformTimerRegister(
+            &tcpStreamManager->readAheadTimer, 0, HandleReadAheadTimerExpired, tcpStreamManager);
+    if (err) {
+        HAPAssert(err == kHAPError_OutOfResources);
+        HAPLog(&logObject, "Not enough resources to schedule reading ahead on TCP stream.");
+        tcpStreamManager->readAheadTimer = 0;
+    }
+}
+
+static void HandleListenerResumeTimerExpired(HAPPlatformTimerRef timer, void* _Nullable context)
+{
+    HAPPrecondition(context);
+
+    HAPPlatformTCPStreamManagerRef tcpStreamManager = context;
+    HAPPrecondition(timer == tcpStreamManager->listenerResumeTimer);
+    tcpStreamManager->listenerResumeTimer = 0;
+
+    HAPAssert(tcpStreamManager->tcpStreamListener.fileDescriptor != -1);
+    HAPLogDebug(&logObject, "Resuming accepting new TCP streams to check for idle TCP streams.");
+
+    // HAPPlatformRunLoop.c
+    HAPPlatformFileHandleUpdateInterests(tcpStreamManager->tcpStreamListener.fileHandle,
+                                         (HAPPlatformFileHandleEvent) { .isReadyForReading = true,
+                                                                        .isReadyForWriting = false,
+                                                                        .hasErrorConditionPending = false },
+                                         HandleTCPStreamListenerFileHandleCallback,
+                                         &tcpStreamManager->tcpStreamListener);
+}
+
+/**
+ * Evicts the least recently used idle TCP stream to make room for a pending connection.
+ *
+ * - Accepting is suspended until the evicted TCP stream is closed. If no TCP stream has been idle for long enough,
+ *   accepting is resumed once the least recently used TCP stream may have become idle.
+ *
+ * @param      tcpStreamManager     TCP stream manager.
+ */
+static void EvictIdleTCPStream(HAPPlatformTCPStreamManagerRef tcpStreamManager)
+{
+    HAPPrecondition(tcpStreamManager);
+    HAPPrecondition(tcpStreamManager->numTCPStreams == tcpStreamManager->maxTCPStreams);
+    HAPPrecondition(tcpStreamManager->minIdleTimeBeforeEviction);
+
+    HAPLogInfo(&logObject, "Suspending accepting new TCP streams on TCP stream listener socket.");
+
+    // HAPPlatformRunLoop.c
+    HAPPlatformFileHandleUpdateInterests(tcpStreamManager->tcpStreamListener.fileHandle,
+                                         (HAPPlatformFileHandleEvent) { .isReadyForReading = false,
+                                                                        .isReadyForWriting = false,
+                                                                        .hasErrorConditionPending = false },
+                                         HandleTCPStreamListenerFileHandleCallback,
+                                         &tcpStreamManager->tcpStreamListener);
+
+    // Find the least recently used TCP stream that waits for incoming bytes and has no pending output.
+    HAPPlatformTCPStream* _Nullable leastRecentlyUsedTCPStream = NULL;
+    for (size_t i = 0; i < tcpStreamManager->maxTCPStreams; i++) {
+        HAPPlatformTCPStream* tcpStream = &tcpStreamManager->tcpStreams[i];
+        HAPAssert(tcpStream->fileDescriptor != -1);
+        if (tcpStream->isEvicted) {
+            // Accepting is resumed once the evicted TCP stream is closed.
+            return;
+        }
+        if (!tcpStream->interests.hasBytesAvailable || tcpStream->interests.hasSpaceAvailable ||
+            tcpStream->numTransmitBytes || tcpStream->numReceiveBytes) {
+            continue;
+        }
+        if (!leastRecentlyUsedTCPStream || tcpStream->lastActivity < leastRecentlyUsedTCPStream->lastActivity) {
+            leastRecentlyUsedTCPStream = tcpStream;
+        }
+    }
+
+    HAPTime now = HAPPlatformClockGetCurrent();
+    if (leastRecentlyUsedTCPStream &&
+        now - leastRecentlyUsedTCPStream->lastActivity >= tcpStreamManager->minIdleTimeBeforeEviction) {
+        HAPLogInfo(&logObject, "Evicting TCP stream %d that has been idle for %llu ms to accept a new TCP stream.",
+                   leastRecentlyUsedTCPStream->fileDescriptor,
+                   (unsigned long long) (now - leastRecentlyUsedTCPStream->lastActivity));
+        leastRecentlyUsedTCPStream->isEvicted = true;
+        tcpStreamManager->statistics.numEvictedTCPStreams++;
+        ScheduleEvictionEvents(tcpStreamManager);
+        return;
+    }
+
+    HAPTime deadline = (leastRecentlyUsedTCPStream ? leastRecentlyUsedTCPStream->lastActivity : now) +
+                       tcpStreamManager->minIdleTimeBeforeEviction;
+    HAPLog(&logObject, "Cannot accept more TCP streams. No TCP stream has been idle for long enough.");
+    if (tcpStreamManager->listenerResumeTimer) {
+        HAPPlatformTimerDeregister(tcpStreamManager->listenerResumeTimer);
+        tcpStreamManager->listenerResumeTimer = 0;
+    }
+    HAPError err = HAPPlatformTimerRegister(
+            &tcpStreamManager->listenerResumeTimer, deadline, HandleListenerResumeTimerExpired, tcpStreamManager);
+    if (err) {
+        HAPAssert(err == kHAPError_OutOfResources);
+        HAPLog(&logObject, "Not enough resources to schedule resuming accepting new TCP streams.");
+        tcpStreamManager->listenerResumeTimer = 0;
+    }
+}
+
+void HAPPlatformTCPStreamUpdateInterests(HAPPlatformTCPStreamManagerRef tcpStreamManager,
+                                         HAPPlatformTCPStreamRef tcpStream_,
+                                         HAPPlatformTCPStreamEvent interests,
+                                         HAPPlatformTCPStreamEventCallback _Nullable callback,
+                                         void* _Nullable context)
+{
+    HAPPrecondition(tcpStreamManager);
+    HAPPrecondition(tcpStreamManager->tcpStreams);
+    HAPPrecondition(tcpStream_);
+    HAPPrecondition(!(interests.hasBytesAvailable || interests.hasSpaceAvailable) || callback != NULL);
+
+    HAPPlatformTCPStream* tcpStream = (HAPPlatformTCPStream*) tcpStream_;
+
+    HAPPrecondition(tcpStream->tcpStreamManager == tcpStreamManager);
+    HAPPrecondition(tcpStream->fileDescriptor != -1);
+    HAPPrecondition(tcpStream->fileHandle);
+
+    tcpStream->interests.hasBytesAvailable = interests.hasBytesAvailable;
+    tcpStream->interests.hasSpaceAvailable = interests.hasSpaceAvailable;
+    tcpStream->callback = callback;
+    tcpStream->context = context;
+
+    UpdateFileHandleInterests(tcpStream);
+
+    if (tcpStream->isEvicted && tcpStream->interests.hasBytesAvailable) {
+        ScheduleEvictionEvents(tcpStreamManager);
+    }
+    if (tcpStream->numReceiveBytes && tcpStream->interests.hasBytesAvailable) {
+        ScheduleReadAheadEvents(tcpStreamManager);
+    }
+}
+
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformTCPStreamRead(HAPPlatformTCPStreamManagerRef tcpStreamManager,
+                                  HAPPlatformTCPStreamRef tcpStream_,
+                                  void* bytes,
+                                  size_t maxBytes,
+                                  size_t* numBytes)
+{
+    HAPPrecondition(tcpStreamManager);
+    HAPPrecondition(tcpStreamManager->tcpStreams);
+    HAPPrecondition(tcpStream_);
+    HAPPrecondition(bytes);
+    HAPPrecondition(numBytes);
+
+    HAPPlatformTCPStream* tcpStream = (HAPPlatformTCPStream*) tcpStream_;
+
+    HAPPrecondition(tcpStream->tcpStreamManager == tcpStreamManager);
+    HAPPrecondition(tcpStream->fileDescriptor != -1);
+    HAPPrecondition(tcpStream->fileHandle);
+
+    if (tcpStream->isEvicted) {
+        // Report end of stream so that the TCP stream gets closed.
+        *numBytes = 0;
+        return kHAPError_None;
+    }
+
+    if (tcpStream->numReceiveBytes) {
+        HAPAssert(tcpStream->receiveBytes);
+        size_t n = HAPMin(maxBytes, tcpStream->numReceiveBytes);
+        HAPRawBufferCopyBytes(bytes, &tcpStream->receiveBytes[tcpStream->receiveOffset], n);
+        tcpStream->receiveOffset += n;
+        tcpStream->numReceiveBytes -= n;
+        if (!tcpStream->numReceiveBytes) {
+            DiscardReceiveBuffer(tcpStream);
+        } else if (n) {
+            ScheduleReadAheadEvents(tcpStreamManager);
+        }
+        tcpStreamManager->statistics.numReadAheadReads++;
+        tcpStream->numBytesWrittenSinceRead = 0;
+        *numBytes = n;
+        return kHAPError_None;
+    }
+
+    // A small read receives all available bytes into a receive buffer, which then serves the following reads.
+    uint8_t* _Nullable receiveBuffer = NULL;
+    if (maxBytes < tcpStreamManager->receiveBuffers.bufferSize) {
+        receiveBuffer = AcquireReceiveBuffer(tcpStreamManager);
+        if (!receiveBuffer) {
+            HAPLogDebug(&logObject, "No receive buffer is free. Receiving directly.");
+            tcpStreamManager->statistics.numReceiveBufferShortages++;
+        }
+    }
+    void* receiveBytes = receiveBuffer ? HAPNonnull(receiveBuffer) : bytes;
+    size_t maxReceiveBytes = receiveBuffer ? tcpStreamManager->receiveBuffers.bufferSize : maxBytes;
+
+    size_t n;
+    HAPError err = HAPPlatformTCPStreamSocketReceive(tcpStream->fileDescriptor, receiveBytes, maxReceiveBytes, &n);
+    tcpStream->statistics.numReceives++;
+    tcpStreamManager->statistics.numReceives++;
+    if ((err || !n) && receiveBuffer) {
+        ReleaseReceiveBuffer(tcpStreamManager, HAPNonnull(receiveBuffer));
+    }
+    if (err) {
+        HAPAssert(err == kHAPError_Unknown || err == kHAPError_Busy);
+        if (err == kHAPError_Unknown) {
+            int errorNumber = errno;
+            HAPPlatformLogPOSIXError(kHAPLogType_Error,
+                                     "System call 'recv' on TCP stream socket failed.",
+                                     errorNumber, __func__, HAP_FILE, __LINE__);
+            if (errorNumber == ETIMEDOUT) {
+                HandleUnresponsivePeer(tcpStream);
+            }
+            *numBytes = 0;
+            return err;
+        }
+
+        HAPLogDebug(&logObject, "System call 'recv' on TCP stream socket is busy.");
+        tcpStream->statistics.numReceivesWouldBlock++;
+        tcpStreamManager->statistics.numReceivesWouldBlock++;
+        *numBytes = 0;
+        return err;
+    }
+
+    HAPAssert(n <= maxReceiveBytes);
+    if (n) {
+        tcpStream->lastActivity = HAPPlatformClockGetCurrent();
+        tcpStream->numBytesWrittenSinceRead = 0;
+    }
+    tcpStream->statistics.numBytesReceived += n;
+    tcpStreamManager->statistics.numBytesReceived += n;
+    if (n && receiveBuffer) {
+        size_t numReadBytes = HAPMin(n, maxBytes);
+        HAPRawBufferCopyBytes(bytes, HAPNonnull(receiveBuffer), numReadBytes);
+        if (n > numReadBytes) {
+            tcpStream->receiveBytes = receiveBuffer;
+            tcpStream->receiveOffset = numReadBytes;
+            tcpStream->numReceiveBytes = n - numReadBytes;
+            tcpStream->statistics.maxReceiveBytes =
+                    HAPMax(tcpStream->statistics.maxReceiveBytes, tcpStream->numReceiveBytes);
+            UpdateBufferStatistics(tcpStream);
+            ScheduleReadAheadEvents(tcpStreamManager);
+        } else {
+            ReleaseReceiveBuffer(tcpStreamManager, HAPNonnull(receiveBuffer));
+        }
+        *numBytes = numReadBytes;
+        return kHAPError_None;
+    }
+    *numBytes = n;
+    return kHAPError_None;
+}
+
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformTCPStreamWrite(HAPPlatformTCPStreamManagerRef tcpStreamManager,
+                                   HAPPlatformTCPStreamRef tcpStream_,
+                                   const void* bytes,
+                                   size_t maxBytes,
+                                   size_t* numBytes)
+{
+    HAPPrecondition(tcpStreamManager);
+    HAPPrecondition(tcpStreamManager->tcpStreams);
+    HAPPrecondition(tcpStream_);
+    HAPPrecondition(bytes);
+    HAPPrecondition(numBytes);
+
+    HAPPlatformTCPStream* tcpStream = (HAPPlatformTCPStream*) tcpStream_;
+
+    HAPPrecondition(tcpStream->tcpStreamManager == tcpStreamManager);
+    HAPPrecondition(tcpStream->fileDescriptor != -1);
+    HAPPrecondition(tcpStream->fileHandle);
+
+    if (tcpStream->isEvicted) {
+        HAPLog(&logObject, "Cannot write to evicted TCP stream.");
+        *numBytes = 0;
+        return kHAPError_Unknown;
+    }
+
+    if (tcpStream->isTransmitFailed) {
+        HAPLog(&logObject, "Cannot write to TCP stream after buffered bytes could not be sent.");
+        *numBytes = 0;
+        return kHAPError_Unknown;
+    }
+
+    HAPError err;
+
+    if (tcpStreamManager->transmitBuffers.bufferSize) {
+        UpdateTransmitBufferGrowth(tcpStream, maxBytes);
+        if (tcpStream->numTransmitBytes && tcpStream->numTransmitBytes + maxBytes > tcpStream->transmitBufferSize &&
+            !IsTransmitBufferHeld(tcpStream)) {
+            // Send the buffered bytes first so that the bytes remain in order. A held transmit buffer is filled up
+            // instead, so that it is sent in full.
+            err = FlushTransmitBuffer(tcpStream);
+            if (err && err != kHAPError_Busy) {
+                *numBytes = 0;
+                return err;
+            }
+        }
+        size_t maxTransmitBufferSize = tcpStream->isTransmitBufferGrown ?
+                                               tcpStreamManager->largeTransmitBuffers.bufferSize :
+                                               tcpStreamManager->transmitBuffers.bufferSize;
+        if (!tcpStream->transmitBytes && maxBytes < maxTransmitBufferSize) {
+            if (!AcquireTransmitBuffer(tcpStream, maxBytes)) {
+                // The other TCP streams have completed their writes for now, so their transmit buffers can be sent
+                // early to free one.
+                FlushTransmitBuffers(tcpStreamManager);
+                (void) AcquireTransmitBuffer(tcpStream, maxBytes);
+            }
+            if (!tcpStream->transmitBytes) {
+                HAPLogDebug(&logObject, "No transmit buffer is free.");
+                tcpStreamManager->statistics.numTransmitBufferShortages++;
+            }
+        }
+        if (tcpStream->transmitBytes) {
+            size_t n = HAPMin(maxBytes, tcpStream->transmitBufferSize - tcpStream->numTransmitBytes);
+            if (!n) {
+                HAPLogDebug(&logObject, "Transmit buffer of TCP stream is full.");
+                *numBytes = 0;
+                return kHAPError_Busy;
+            }
+            HAPRawBufferCopyBytes(&tcpStream->transmitBytes[tcpStream->numTransmitBytes], bytes, n);
+            tcpStream->numTransmitBytes += n;
+            tcpStream->statistics.maxTransmitBytes =
+                    HAPMax(tcpStream->statistics.maxTransmitBytes, tcpStream->numTransmitBytes);
+            tcpStreamManager->statistics.numCoalescedWrites++;
+            tcpStream->hasWrittenBeforeWait = true;
+            tcpStream->numBytesWrittenSinceRead += n;
+            if (!tcpStreamManager->isTransmitBufferFlushScheduled) {
+                HAPPlatformRunLoopSetBeforeWaitCallback(HandleBeforeWaitCallback, tcpStreamManager);
+                tcpStreamManager->isTransmitBufferFlushScheduled = true;
+            }
+            tcpStream->lastActivity = HAPPlatformClockGetCurrent();
+            *numBytes = n;
+            return kHAPError_None;
+        }
+    }
+
+    err = SendBytes(tcpStream, bytes, maxBytes, numBytes);
+    if (!err && *numBytes) {
+        tcpStream->lastActivity = HAPPlatformClockGetCurrent();
+        tcpStream->numBytesWrittenSinceRead += *numBytes;
+    }
+    return err;
+}
+
+static void HandleTCPStreamListenerFileHandleCallback(HAPPlatformFileHandleRef fileHandle,
+                                                      HAPPlatformFileHandleEvent fileHandleEvents,
+                                                      void* _Nullable context)
+{
+    HAPAssert(fileHandle);
+    HAPAssert(context);
+
+    HAPPlatformTCPStreamListener* listener = (HAPPlatformTCPStreamListener*) context;
+
+    HAPAssert(listener->tcpStreamManager);
+    HAPAssert(listener->fileDescriptor != -1);
+    HAPAssert(listener->fileHandle == fileHandle);
+    HAPAssert(listener->callback);
+
+    HAPAssert(fileHandleEvents.isReadyForReading);
+
+    if (listener->tcpStreamManager->numTCPStreams == listener->tcpStreamManager->maxTCPStreams &&
+        listener->tcpStreamManager->minIdleTimeBeforeEviction) {
+        // The new connection is accepted once the evicted TCP stream is closed.
+        EvictIdleTCPStream(listener->tcpStreamManager);
+        return;
+    }
+
+    listener->callback(listener->tcpStreamManager, listener->context);
+}
+
+static void HandleTCPStreamFileHandleCallback(HAPPlatformFileHandleRef fileHandle,
+                                              HAPPlatformFileHandleEvent fileHandleEvents,
+                                              void* _Nullable context)
+{
+    HAPAssert(fileHandle);
+    HAPAssert(context);
+
+    HAPPlatformTCPStream* tcpStream = (HAPPlatformTCPStream*) context;
+
+    HAPAssert(tcpStream->tcpStreamManager);
+    HAPAssert(tcpStream->fileDescriptor != -1);
+    HAPAssert(tcpStream->fileHandle == fileHandle);
+
+    HAPAssert(fileHandleEvents.isReadyForReading || fileHandleEvents.isReadyForWriting);
+
+    if (fileHandleEvents.isReadyForWriting && tcpStream->numTransmitBytes && !IsTransmitBufferHeld(tcpStream)) {
+        (void) FlushTransmitBuffer(tcpStream);
+    }
+
+    HAPPlatformTCPStreamEvent tcpStreamEvents;
+    tcpStreamEvents.hasBytesAvailable = tcpStream->interests.hasBytesAvailable && fileHandleEvents.isReadyForReading;
+    tcpStreamEvents.hasSpaceAvailable = tcpStream->interests.hasSpaceAvailable && fileHandleEvents.isReadyForWriting &&
+                                        (!tcpStream->transmitBytes ||
+                                         tcpStream->numTransmitBytes < tcpStream->transmitBufferSize);
+
+    if (tcpStreamEvents.hasBytesAvailable || tcpStreamEvents.hasSpaceAvailable) {
+        HAPAssert(tcpStream->callback);
+        HAPPlatformTCPStreamRef tcpStream_ = (HAPPlatformTCPStreamRef) tcpStream;
+        tcpStream->callback(tcpStream->tcpStreamManager, tcpStream_, tcpStreamEvents, tcpStream->context);
+    }
+}
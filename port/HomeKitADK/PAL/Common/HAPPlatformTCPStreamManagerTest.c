@@ -0,0 +1,746 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Copyright (c) 2022 John Buonagurio
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+// Tests of the TCP stream manager, run by the host build with loopback connections on a virtual clock.
+
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "HAPPlatform.h"
+#include "HAPPlatformClock+Init.h"
+#include "HAPPlatformKeyValueStore+Init.h"
+#include "HAPPlatformRunLoop+Init.h"
+#include "HAPPlatformTCPStreamManager+Init.h"
+#include "HAPPlatformTCPStreamSocket.h"
+
+static const HAPLogObject logObject = { .subsystem = kHAPPlatform_LogSubsystem, .category = "TCPStreamManagerTest" };
+
+/**
+ * Maximum number of connections of a test.
+ */
+#define kMaxConnections ((size_t) 9)
+
+/**
+ * Key-value store of the run loop. It is only used by the run loop watchdog, which is not enabled.
+ */
+static HAPPlatformKeyValueStore keyValueStore;
+
+/**
+ * TCP stream manager under test.
+ */
+static HAPPlatformTCPStreamManager tcpStreamManager;
+
+/**
+ * Connections of a test, in the order in which they were made.
+ */
+static struct {
+    /**
+     * Client socket.
+     */
+    int fileDescriptor;
+
+    /**
+     * Accepted TCP stream, or 0 if the connection has not been accepted yet or has been closed.
+     */
+    HAPPlatformTCPStreamRef tcpStream;
+
+    /**
+     * Whether the connection has been accepted.
+     */
+    bool isAccepted;
+} connections[kMaxConnections];
+
+/**
+ * Number of connections of a test.
+ */
+static size_t numConnections;
+
+/**
+ * Maximum number of bytes of a response.
+ */
+#define kMaxResponseBytes ((size_t) 2048)
+
+/**
+ * Sizes of the writes in which the TCP streams respond to incoming bytes, as an encrypted frame is written as length,
+ * ciphertext and tag.
+ */
+static size_t responseWrites[3];
+
+/**
+ * Number of writes of a response, or 0 to not respond.
+ */
+static size_t numResponseWrites;
+
+/**
+ * Gets a byte of a response.
+ *
+ * @param      offset               Offset of the byte in the response.
+ *
+ * @return Byte of the response.
+ */
+HAP_RESULT_USE_CHECK
+static uint8_t GetResponseByte(size_t offset)
+{
+    return (uint8_t)(offset * 7 + 3);
+}
+
+/**
+ * Socket of a TCP stream whose receives fail as if its peer had stopped responding, or -1.
+ */
+static int unresponsiveFileDescriptor = -1;
+
+ssize_t __real_recv(int fileDescriptor, void* bytes, size_t maxBytes, int flags);
+
+/**
+ * Emulates a receive on a socket that the system has reset because its keepalive probes went unanswered.
+ * The host build links the test with --wrap=recv.
+ */
+ssize_t __wrap_recv(int fileDescriptor, void* bytes, size_t maxBytes, int flags)
+{
+    if (fileDescriptor == unresponsiveFileDescriptor) {
+        errno = ETIMEDOUT;
+        return -1;
+    }
+    return __real_recv(fileDescriptor, bytes, maxBytes, flags);
+}
+
+static void HandleTCPStreamEvent(
+        HAPPlatformTCPStreamManagerRef tcpStreamManager_,
+        HAPPlatformTCPStreamRef tcpStream,
+        HAPPlatformTCPStreamEvent event,
+        void* _Nullable context)
+{
+    HAPPrecondition(tcpStreamManager_ == &tcpStreamManager);
+    HAPPrecondition(context);
+    (void) event;
+
+    size_t* index = context;
+    uint8_t bytes[64];
+    size_t numBytes;
+    HAPError err = HAPPlatformTCPStreamRead(&tcpStreamManager, tcpStream, bytes, sizeof bytes, &numBytes);
+    if (err == kHAPError_Busy) {
+        return;
+    }
+    if (err || !numBytes) {
+        // End of stream, or the TCP stream has been reset. The IP accessory server closes the TCP stream as well.
+        HAPPlatformTCPStreamClose(&tcpStreamManager, tcpStream);
+        connections[*index].tcpStream = 0;
+        return;
+    }
+
+    uint8_t response[kMaxResponseBytes];
+    size_t numResponseBytes = 0;
+    for (size_t i = 0; i < numResponseWrites; i++) {
+        for (size_t j = 0; j < responseWrites[i]; j++) {
+            response[numResponseBytes + j] = GetResponseByte(numResponseBytes + j);
+        }
+        size_t numBytesWritten;
+        err = HAPPlatformTCPStreamWrite(
+                &tcpStreamManager, tcpStream, &response[numResponseBytes], responseWrites[i], &numBytesWritten);
+        HAPAssert(!err);
+        HAPAssert(numBytesWritten == responseWrites[i]);
+        numResponseBytes += numBytesWritten;
+    }
+}
+
+static void HandleTCPStreamListenerEvent(HAPPlatformTCPStreamManagerRef tcpStreamManager_, void* _Nullable context)
+{
+    HAPPrecondition(tcpStreamManager_ == &tcpStreamManager);
+    (void) context;
+
+    HAPPlatformTCPStreamRef tcpStream;
+    HAPError err = HAPPlatformTCPStreamManagerAcceptTCPStream(&tcpStreamManager, &tcpStream);
+    if (err == kHAPError_Busy) {
+        return;
+    }
+    HAPAssert(!err);
+
+    // Connections are accepted in the order in which they were made.
+    static size_t indices[kMaxConnections];
+    size_t index = 0;
+    while (connections[index].isAccepted) {
+        index++;
+    }
+    HAPAssert(index < numConnections);
+    connections[index].tcpStream = tcpStream;
+    connections[index].isAccepted = true;
+    indices[index] = index;
+    HAPPlatformTCPStreamUpdateInterests(
+            &tcpStreamManager,
+            tcpStream,
+            (HAPPlatformTCPStreamEvent) { .hasBytesAvailable = true },
+            HandleTCPStreamEvent,
+            &indices[index]);
+}
+
+/**
+ * Initializes the TCP stream manager and opens its listener.
+ *
+ * @param      options              Initialization options. The port is chosen from the ephemeral port range.
+ */
+static void OpenTCPStreamManager(const HAPPlatformTCPStreamManagerOptions* options)
+{
+    HAPPrecondition(options);
+
+    HAPPlatformTCPStreamManagerOptions tcpStreamManagerOptions = *options;
+    tcpStreamManagerOptions.port = kHAPNetworkPort_Any;
+    HAPPlatformTCPStreamManagerCreate(&tcpStreamManager, &tcpStreamManagerOptions);
+    HAPPlatformTCPStreamManagerOpenListener(&tcpStreamManager, HandleTCPStreamListenerEvent, NULL);
+    HAPRawBufferZero(connections, sizeof connections);
+    numConnections = 0;
+}
+
+/**
+ * Closes all connections and releases the TCP stream manager.
+ */
+static void CloseTCPStreamManager(void)
+{
+    for (size_t i = 0; i < numConnections; i++) {
+        if (connections[i].tcpStream) {
+            HAPPlatformTCPStreamClose(&tcpStreamManager, connections[i].tcpStream);
+        }
+        if (connections[i].fileDescriptor != -1) {
+            close(connections[i].fileDescriptor);
+        }
+    }
+    HAPPlatformTCPStreamManagerCloseListener(&tcpStreamManager);
+    HAPPlatformTCPStreamManagerRelease(&tcpStreamManager);
+}
+
+static void StopRunLoop(HAPPlatformTimerRef timer, void* _Nullable context)
+{
+    (void) timer;
+    (void) context;
+    HAPPlatformRunLoopStop();
+}
+
+/**
+ * Runs the run loop for a while.
+ *
+ * @param      duration             Time to run the run loop.
+ */
+static void RunFor(HAPTime duration)
+{
+    HAPPlatformTimerRef timer;
+    HAPError err = HAPPlatformTimerRegister(&timer, HAPPlatformClockGetCurrent() + duration, StopRunLoop, NULL);
+    HAPAssert(!err);
+    HAPPlatformRunLoopRun();
+}
+
+/**
+ * Makes a new connection to the listener of the TCP stream manager.
+ */
+static void Connect(void)
+{
+    HAPPrecondition(numConnections < kMaxConnections);
+
+    int fileDescriptor = socket(AF_INET6, SOCK_STREAM, 0);
+    HAPAssert(fileDescriptor != -1);
+    struct sockaddr_in6 address = {
+        .sin6_family = AF_INET6,
+        .sin6_port = htons(HAPPlatformTCPStreamManagerGetListenerPort(&tcpStreamManager)),
+        .sin6_addr = IN6ADDR_LOOPBACK_INIT,
+    };
+    int e = connect(fileDescriptor, (const struct sockaddr*) &address, sizeof address);
+    HAPAssert(!e);
+    connections[numConnections++].fileDescriptor = fileDescriptor;
+}
+
+/**
+ * Sends a byte on a connection, which counts as activity of its TCP stream once it has been read.
+ *
+ * @param      index                Index of the connection.
+ */
+static void Send(size_t index)
+{
+    HAPPrecondition(index < numConnections);
+
+    ssize_t n = send(connections[index].fileDescriptor, "x", 1, MSG_NOSIGNAL);
+    HAPAssert(n == 1);
+}
+
+/**
+ * Checks whether a connection has been closed by the TCP stream manager.
+ *
+ * @param      index                Index of the connection.
+ *
+ * @return true                     If the connection has reached end of stream.
+ * @return false                    Otherwise.
+ */
+HAP_RESULT_USE_CHECK
+static bool IsClosed(size_t index)
+{
+    HAPPrecondition(index < numConnections);
+
+    uint8_t byte;
+    ssize_t n = recv(connections[index].fileDescriptor, &byte, sizeof byte, MSG_DONTWAIT);
+    HAPAssert(n <= 0);
+    return n == 0 || (n == -1 && errno == ECONNRESET);
+}
+
+/**
+ * Requests a response on a connection and checks that the response arrives in full.
+ *
+ * @param      index                Index of the connection.
+ * @param      writes               Sizes of the writes of the response.
+ * @param      numWrites            Number of writes of the response.
+ *
+ * @return Number of sends of the response.
+ */
+HAP_RESULT_USE_CHECK
+static uint64_t Exchange(size_t index, const size_t* writes, size_t numWrites)
+{
+    HAPPrecondition(index < numConnections);
+    HAPPrecondition(connections[index].tcpStream);
+    HAPPrecondition(writes);
+    HAPPrecondition(numWrites <= HAPArrayCount(responseWrites));
+
+    size_t numResponseBytes = 0;
+    for (size_t i = 0; i < numWrites; i++) {
+        responseWrites[i] = writes[i];
+        numResponseBytes += writes[i];
+    }
+    HAPPrecondition(numResponseBytes <= kMaxResponseBytes);
+    numResponseWrites = numWrites;
+
+    HAPPlatformTCPStreamStatistics statistics;
+    HAPPlatformTCPStreamGetStatistics(&tcpStreamManager, connections[index].tcpStream, &statistics);
+    uint64_t numSends = statistics.numSends;
+    Send(index);
+    RunFor(10 * HAPMillisecond);
+    numResponseWrites = 0;
+
+    uint8_t response[kMaxResponseBytes];
+    ssize_t n = recv(connections[index].fileDescriptor, response, sizeof response, MSG_DONTWAIT);
+    HAPAssert(n == (ssize_t) numResponseBytes);
+    for (size_t i = 0; i < numResponseBytes; i++) {
+        HAPAssert(response[i] == GetResponseByte(i));
+    }
+    HAPPlatformTCPStreamGetStatistics(&tcpStreamManager, connections[index].tcpStream, &statistics);
+    return statistics.numSends - numSends;
+}
+
+/**
+ * Checks whether the TCP stream of a connection uses large transmit buffers.
+ *
+ * @param      index                Index of the connection.
+ *
+ * @return true                     If the TCP stream has grown to large transmit buffers.
+ * @return false                    Otherwise.
+ */
+HAP_RESULT_USE_CHECK
+static bool IsTransmitBufferGrown(size_t index)
+{
+    HAPPrecondition(index < numConnections);
+    HAPPrecondition(connections[index].tcpStream);
+
+    return ((const HAPPlatformTCPStream*) connections[index].tcpStream)->isTransmitBufferGrown;
+}
+
+HAP_RESULT_USE_CHECK
+static HAPPlatformTCPStreamManagerStatistics GetStatistics(void)
+{
+    HAPPlatformTCPStreamManagerStatistics statistics;
+    HAPPlatformTCPStreamManagerGetStatistics(&tcpStreamManager, &statistics);
+    return statistics;
+}
+
+/**
+ * When all TCP streams are in use, a new connection evicts the least recently used TCP stream once it has been idle
+ * for minIdleTimeBeforeEviction.
+ */
+static void TestEviction(void)
+{
+    HAPLogInfo(&logObject, "%s", __func__);
+
+    OpenTCPStreamManager(&(const HAPPlatformTCPStreamManagerOptions) {
+            .maxConcurrentTCPStreams = 4, .minIdleTimeBeforeEviction = 200 * HAPMillisecond });
+    HAPTime startTime = HAPPlatformClockGetCurrent();
+    for (size_t i = 0; i < 4; i++) {
+        Connect();
+    }
+    RunFor(100 * HAPMillisecond);
+    HAPAssert(GetStatistics().numAcceptedTCPStreams == 4);
+
+    // Connection 0 stays idle. Connections 1 to 3 are used in this order.
+    for (size_t i = 1; i < 4; i++) {
+        Send(i);
+        RunFor(10 * HAPMillisecond);
+    }
+    RunFor(startTime + 250 * HAPMillisecond - HAPPlatformClockGetCurrent());
+
+    // Connection 0 has been idle for long enough, so the new connection is accepted right away.
+    Connect();
+    RunFor(10 * HAPMillisecond);
+    HAPAssert(IsClosed(0));
+    HAPAssert(connections[4].isAccepted);
+    HAPAssert(GetStatistics().numEvictedTCPStreams == 1);
+
+    // Connection 1 is the least recently used one now. It is evicted once it has been idle for long enough.
+    Connect();
+    RunFor(20 * HAPMillisecond);
+    HAPAssert(!connections[5].isAccepted);
+    HAPAssert(!IsClosed(1));
+    RunFor(30 * HAPMillisecond);
+    HAPAssert(HAPPlatformClockGetCurrent() >= startTime + 300 * HAPMillisecond);
+    HAPAssert(IsClosed(1));
+    HAPAssert(connections[5].isAccepted);
+    for (size_t i = 2; i < 6; i++) {
+        HAPAssert(!IsClosed(i));
+    }
+    HAPAssert(GetStatistics().numEvictedTCPStreams == 2);
+    HAPAssert(GetStatistics().numAcceptedTCPStreams == 6);
+
+    CloseTCPStreamManager();
+}
+
+/**
+ * Gets a socket option of the TCP stream of a connection.
+ *
+ * @param      index                Index of the connection.
+ * @param      level                Protocol level of the option.
+ * @param      name                 Name of the option.
+ *
+ * @return Value of the option.
+ */
+HAP_RESULT_USE_CHECK
+static int GetSocketOption(size_t index, int level, int name)
+{
+    HAPPrecondition(index < numConnections);
+    HAPPrecondition(connections[index].tcpStream);
+
+    const HAPPlatformTCPStream* tcpStream = (const HAPPlatformTCPStream*) connections[index].tcpStream;
+    int value;
+    socklen_t numValueBytes = sizeof value;
+    int e = getsockopt(tcpStream->fileDescriptor, level, name, &value, &numValueBytes);
+    HAPAssert(!e);
+    return value;
+}
+
+/**
+ * TCP streams are probed with keepalives, and a TCP stream whose peer stopped responding is reset and closed without
+ * affecting the other TCP streams.
+ */
+static void TestDeadPeer(void)
+{
+    HAPLogInfo(&logObject, "%s", __func__);
+
+    OpenTCPStreamManager(&(const HAPPlatformTCPStreamManagerOptions) {
+            .maxConcurrentTCPStreams = 4, .deadPeerTimeout = 2 * HAPMinute });
+    Connect();
+    Connect();
+    RunFor(10 * HAPMillisecond);
+    HAPAssert(connections[0].tcpStream && connections[1].tcpStream);
+
+    // Probes start after a minute without incoming bytes and are spread over the second minute, and unacknowledged
+    // bytes are given two minutes. The idle time is shared with CC32xxSF, where it is the keepalive time.
+    HAPPlatformTCPStreamSocketKeepAlive keepAlive;
+    HAPPlatformTCPStreamSocketGetKeepAlive(2 * HAPMinute, &keepAlive);
+    HAPAssert(keepAlive.idleTime == HAPMinute);
+    HAPAssert(keepAlive.idleTime + (HAPTime) keepAlive.numProbes * keepAlive.probeInterval == 2 * HAPMinute);
+    HAPAssert(GetSocketOption(0, SOL_SOCKET, SO_KEEPALIVE));
+    HAPAssert(GetSocketOption(0, IPPROTO_TCP, TCP_KEEPIDLE) == 60);
+    HAPAssert(GetSocketOption(0, IPPROTO_TCP, TCP_KEEPINTVL) == (int) (keepAlive.probeInterval / HAPSecond));
+    HAPAssert(GetSocketOption(0, IPPROTO_TCP, TCP_KEEPCNT) == keepAlive.numProbes);
+    HAPAssert(GetSocketOption(0, IPPROTO_TCP, TCP_USER_TIMEOUT) == 2 * 60 * 1000);
+
+    // Short timeouts are rounded to whole seconds of at least one second.
+    HAPPlatformTCPStreamSocketGetKeepAlive(HAPSecond, &keepAlive);
+    HAPAssert(keepAlive.idleTime == HAPSecond && keepAlive.probeInterval == HAPSecond);
+    HAPPlatformTCPStreamSocketGetKeepAlive(9 * HAPSecond + 500 * HAPMillisecond, &keepAlive);
+    HAPAssert(keepAlive.idleTime == 4 * HAPSecond && keepAlive.probeInterval == HAPSecond);
+
+    // The system resets connection 0 once its probes go unanswered.
+    const HAPPlatformTCPStream* tcpStream = (const HAPPlatformTCPStream*) connections[0].tcpStream;
+    unresponsiveFileDescriptor = tcpStream->fileDescriptor;
+    Send(0);
+    Send(1);
+    RunFor(10 * HAPMillisecond);
+    unresponsiveFileDescriptor = -1;
+    HAPAssert(!connections[0].tcpStream);
+    HAPAssert(IsClosed(0));
+    HAPAssert(connections[1].tcpStream);
+    HAPAssert(!IsClosed(1));
+    HAPAssert(GetStatistics().numReclaimedTCPStreams == 1);
+
+    CloseTCPStreamManager();
+}
+
+/**
+ * A TCP stream grows to large transmit buffers once a response does not fit into a small one, so that long responses
+ * take a single send, and goes back to small transmit buffers once it has not needed a large one for a while.
+ */
+static void TestTransmitBufferGrowth(void)
+{
+    HAPLogInfo(&logObject, "%s", __func__);
+
+    static uint8_t transmitBuffers[2][256];
+    static uint8_t largeTransmitBuffers[1][kMaxResponseBytes];
+    OpenTCPStreamManager(&(const HAPPlatformTCPStreamManagerOptions) {
+            .maxConcurrentTCPStreams = 2,
+            .transmitBuffers = transmitBuffers,
+            .transmitBufferSize = sizeof transmitBuffers[0],
+            .numTransmitBuffers = HAPArrayCount(transmitBuffers),
+            .largeTransmitBuffers = largeTransmitBuffers,
+            .largeTransmitBufferSize = sizeof largeTransmitBuffers[0],
+            .numLargeTransmitBuffers = HAPArrayCount(largeTransmitBuffers),
+            .largeTransmitBufferTimeout = HAPSecond });
+    Connect();
+    RunFor(10 * HAPMillisecond);
+    HAPAssert(connections[0].tcpStream);
+
+    // A response that fits into a small transmit buffer is sent from it.
+    const size_t shortResponse[] = { 2, 100, 16 };
+    HAPAssert(Exchange(0, shortResponse, HAPArrayCount(shortResponse)) == 1);
+    HAPAssert(!IsTransmitBufferGrown(0));
+    HAPAssert(GetStatistics().numTransmitBufferGrowths == 0);
+
+    // The first long response grows the TCP stream, and the following ones take a single send. The bytes that were
+    // written before the TCP stream grew are sent separately.
+    const size_t longResponse[] = { 2, 1000, 16 };
+    HAPAssert(Exchange(0, longResponse, HAPArrayCount(longResponse)) == 2);
+    HAPAssert(IsTransmitBufferGrown(0));
+    HAPAssert(GetStatistics().numTransmitBufferGrowths == 1);
+    HAPAssert(Exchange(0, longResponse, HAPArrayCount(longResponse)) == 1);
+    HAPAssert(GetStatistics().numTransmitBufferGrowths == 1);
+    HAPAssert(GetStatistics().maxLargeTransmitBuffersInUse == 1);
+
+    // Short responses keep the large transmit buffers until the timeout.
+    RunFor(500 * HAPMillisecond);
+    HAPAssert(Exchange(0, shortResponse, HAPArrayCount(shortResponse)) == 1);
+    HAPAssert(IsTransmitBufferGrown(0));
+    RunFor(HAPSecond);
+    HAPAssert(Exchange(0, shortResponse, HAPArrayCount(shortResponse)) == 1);
+    HAPAssert(!IsTransmitBufferGrown(0));
+
+    // A later long response grows the TCP stream again.
+    HAPAssert(Exchange(0, longResponse, HAPArrayCount(longResponse)) == 2);
+    HAPAssert(IsTransmitBufferGrown(0));
+    HAPAssert(GetStatistics().numTransmitBufferGrowths == 2);
+
+    CloseTCPStreamManager();
+}
+
+/**
+ * Adds the statistics of a TCP stream to a sum.
+ */
+static void SumTCPStreamStatistics(
+        void* _Nullable context,
+        HAPPlatformTCPStreamManagerRef tcpStreamManager_,
+        HAPPlatformTCPStreamRef tcpStream,
+        bool* shouldContinue HAP_UNUSED)
+{
+    HAPPrecondition(context);
+    HAPPrecondition(tcpStreamManager_ == &tcpStreamManager);
+
+    HAPPlatformTCPStreamStatistics* sum = context;
+    HAPPlatformTCPStreamStatistics statistics;
+    HAPPlatformTCPStreamGetStatistics(&tcpStreamManager, tcpStream, &statistics);
+    HAPAssert(!statistics.closeTime);
+    sum->acceptTime++;
+    sum->numBytesReceived += statistics.numBytesReceived;
+    sum->numReceives += statistics.numReceives;
+    sum->numReceivesWouldBlock += statistics.numReceivesWouldBlock;
+    sum->numBytesSent += statistics.numBytesSent;
+    sum->numSends += statistics.numSends;
+    sum->numSendsWouldBlock += statistics.numSendsWouldBlock;
+}
+
+/**
+ * Sums the statistics of the open TCP streams.
+ *
+ * @return Sum of the statistics. The accept time holds the number of open TCP streams.
+ */
+HAP_RESULT_USE_CHECK
+static HAPPlatformTCPStreamStatistics GetTCPStreamStatisticsSum(void)
+{
+    HAPPlatformTCPStreamStatistics sum;
+    HAPRawBufferZero(&sum, sizeof sum);
+    HAPPlatformTCPStreamManagerEnumerateTCPStreams(&tcpStreamManager, SumTCPStreamStatistics, &sum);
+    return sum;
+}
+
+/**
+ * Receives, sends and their totals are counted per TCP stream and for the TCP stream manager, and the statistics of
+ * a closed TCP stream are kept until the next one is closed.
+ */
+static void TestStatistics(void)
+{
+    HAPLogInfo(&logObject, "%s", __func__);
+
+    static uint8_t transmitBuffers[2][256];
+    static uint8_t receiveBuffers[2][128];
+    OpenTCPStreamManager(&(const HAPPlatformTCPStreamManagerOptions) {
+            .maxConcurrentTCPStreams = 2,
+            .transmitBuffers = transmitBuffers,
+            .transmitBufferSize = sizeof transmitBuffers[0],
+            .numTransmitBuffers = HAPArrayCount(transmitBuffers),
+            .receiveBuffers = receiveBuffers,
+            .receiveBufferSize = sizeof receiveBuffers[0],
+            .numReceiveBuffers = HAPArrayCount(receiveBuffers) });
+    HAPPlatformTCPStreamManagerStatistics managerStatistics = GetStatistics();
+    HAPTime startTime = HAPPlatformClockGetCurrent();
+    Connect();
+    Connect();
+    RunFor(10 * HAPMillisecond);
+    HAPAssert(connections[0].tcpStream && connections[1].tcpStream);
+
+    HAPPlatformTCPStreamStatistics statistics;
+    HAPPlatformTCPStreamGetStatistics(&tcpStreamManager, connections[0].tcpStream, &statistics);
+    HAPAssert(statistics.acceptTime >= startTime && statistics.acceptTime <= HAPPlatformClockGetCurrent());
+    HAPAssert(!statistics.closeTime);
+    HAPAssert(!statistics.numBytesReceived && !statistics.numBytesSent);
+
+    // 100 bytes that arrive together are received once. The first read takes 64 of them, and the other 36 are held in
+    // the receive buffer for the next read.
+    uint8_t bytes[100];
+    HAPRawBufferZero(bytes, sizeof bytes);
+    ssize_t n = send(connections[0].fileDescriptor, bytes, sizeof bytes, MSG_NOSIGNAL);
+    HAPAssert(n == (ssize_t) sizeof bytes);
+    RunFor(10 * HAPMillisecond);
+    HAPPlatformTCPStreamGetStatistics(&tcpStreamManager, connections[0].tcpStream, &statistics);
+    HAPAssert(statistics.numBytesReceived == sizeof bytes);
+    HAPAssert(statistics.numReceives == 1);
+    HAPAssert(statistics.maxReceiveBytes == sizeof bytes - 64);
+    HAPAssert(GetStatistics().numReadAheadReads > managerStatistics.numReadAheadReads);
+
+    // A read without available bytes is counted as a receive that would block.
+    size_t numBytes;
+    HAPError err = HAPPlatformTCPStreamRead(
+            &tcpStreamManager, connections[0].tcpStream, bytes, sizeof bytes, &numBytes);
+    HAPAssert(err == kHAPError_Busy);
+    HAPPlatformTCPStreamGetStatistics(&tcpStreamManager, connections[0].tcpStream, &statistics);
+    HAPAssert(statistics.numReceivesWouldBlock == 1);
+
+    // Writes of 2 + 120 + 16 bytes are sent together.
+    const size_t response[] = { 2, 120, 16 };
+    HAPAssert(Exchange(1, response, HAPArrayCount(response)) == 1);
+    HAPPlatformTCPStreamGetStatistics(&tcpStreamManager, connections[1].tcpStream, &statistics);
+    HAPAssert(statistics.numBytesReceived == 1);
+    HAPAssert(statistics.numBytesSent == 138);
+    HAPAssert(statistics.numSends == 1);
+    HAPAssert(statistics.maxTransmitBytes == 138);
+
+    // The totals of the TCP stream manager are the sums over the TCP streams.
+    HAPPlatformTCPStreamStatistics sum = GetTCPStreamStatisticsSum();
+    HAPPlatformTCPStreamManagerStatistics newManagerStatistics = GetStatistics();
+    HAPAssert(sum.acceptTime == 2);
+    HAPAssert(newManagerStatistics.numBytesReceived - managerStatistics.numBytesReceived == sum.numBytesReceived);
+    HAPAssert(newManagerStatistics.numReceives - managerStatistics.numReceives == sum.numReceives);
+    HAPAssert(
+            newManagerStatistics.numReceivesWouldBlock - managerStatistics.numReceivesWouldBlock ==
+            sum.numReceivesWouldBlock);
+    HAPAssert(newManagerStatistics.numBytesSent - managerStatistics.numBytesSent == sum.numBytesSent);
+    HAPAssert(newManagerStatistics.numSends - managerStatistics.numSends == sum.numSends);
+    HAPAssert(newManagerStatistics.numSendsWouldBlock - managerStatistics.numSendsWouldBlock == sum.numSendsWouldBlock);
+
+    // When connection 1 is closed by its peer, its statistics are kept with the time at which it was closed.
+    HAPPlatformTCPStreamStatistics closedStatistics;
+    HAPPlatformTCPStreamGetStatistics(&tcpStreamManager, connections[1].tcpStream, &closedStatistics);
+    close(connections[1].fileDescriptor);
+    connections[1].fileDescriptor = -1;
+    HAPTime closeTime = HAPPlatformClockGetCurrent();
+    RunFor(10 * HAPMillisecond);
+    HAPAssert(!connections[1].tcpStream);
+    HAPPlatformTCPStreamStatistics lastClosedTCPStream = GetStatistics().lastClosedTCPStream;
+    HAPAssert(lastClosedTCPStream.acceptTime == closedStatistics.acceptTime);
+    HAPAssert(lastClosedTCPStream.closeTime >= closeTime);
+    HAPAssert(lastClosedTCPStream.closeTime <= HAPPlatformClockGetCurrent());
+    HAPAssert(lastClosedTCPStream.numBytesSent == closedStatistics.numBytesSent);
+    HAPAssert(lastClosedTCPStream.numSends == closedStatistics.numSends);
+    HAPAssert(lastClosedTCPStream.numBytesReceived == closedStatistics.numBytesReceived);
+    HAPAssert(GetTCPStreamStatisticsSum().acceptTime == 1);
+
+    CloseTCPStreamManager();
+}
+
+/**
+ * The shared transmit and receive buffers bound the memory of all TCP streams, whatever the number of busy TCP
+ * streams. With the buffers of the app, 9 TCP streams that receive and respond at the same time reach the high-water
+ * mark of both pools without exceeding it, and all responses arrive in full.
+ */
+static void TestBufferHighWater(void)
+{
+    HAPLogInfo(&logObject, "%s", __func__);
+
+    static uint8_t transmitBuffers[2][256];
+    static uint8_t receiveBuffers[3][512];
+    OpenTCPStreamManager(&(const HAPPlatformTCPStreamManagerOptions) {
+            .maxConcurrentTCPStreams = kMaxConnections,
+            .transmitBuffers = transmitBuffers,
+            .transmitBufferSize = sizeof transmitBuffers[0],
+            .numTransmitBuffers = HAPArrayCount(transmitBuffers),
+            .receiveBuffers = receiveBuffers,
+            .receiveBufferSize = sizeof receiveBuffers[0],
+            .numReceiveBuffers = HAPArrayCount(receiveBuffers) });
+    for (size_t i = 0; i < kMaxConnections; i++) {
+        Connect();
+    }
+    RunFor(10 * HAPMillisecond);
+
+    // Each TCP stream reads a request of 100 bytes in two reads, and responds to each read.
+    const size_t response[] = { 2, 120, 16 };
+    size_t numResponseBytes = 0;
+    for (size_t i = 0; i < HAPArrayCount(response); i++) {
+        responseWrites[i] = response[i];
+        numResponseBytes += response[i];
+    }
+    numResponseWrites = HAPArrayCount(response);
+    uint8_t bytes[100];
+    HAPRawBufferZero(bytes, sizeof bytes);
+    for (size_t i = 0; i < kMaxConnections; i++) {
+        HAPAssert(connections[i].tcpStream);
+        ssize_t n = send(connections[i].fileDescriptor, bytes, sizeof bytes, MSG_NOSIGNAL);
+        HAPAssert(n == (ssize_t) sizeof bytes);
+    }
+    RunFor(10 * HAPMillisecond);
+    numResponseWrites = 0;
+
+    for (size_t i = 0; i < kMaxConnections; i++) {
+        uint8_t responses[2 * kMaxResponseBytes];
+        ssize_t n = recv(connections[i].fileDescriptor, responses, sizeof responses, MSG_DONTWAIT);
+        HAPAssert(n == (ssize_t)(2 * numResponseBytes));
+        for (size_t j = 0; j < (size_t) n; j++) {
+            HAPAssert(responses[j] == GetResponseByte(j % numResponseBytes));
+        }
+
+        HAPPlatformTCPStreamStatistics statistics;
+        HAPPlatformTCPStreamGetStatistics(&tcpStreamManager, connections[i].tcpStream, &statistics);
+        HAPAssert(statistics.maxBufferBytes <= sizeof transmitBuffers[0] + sizeof receiveBuffers[0]);
+    }
+
+    HAPPlatformTCPStreamManagerStatistics statistics = GetStatistics();
+    HAPLogInfo(
+            &logObject,
+            "High-water marks: %zu transmit buffers, %zu receive buffers.",
+            statistics.maxTransmitBuffersInUse,
+            statistics.maxReceiveBuffersInUse);
+    HAPAssert(statistics.maxTransmitBuffersInUse == HAPArrayCount(transmitBuffers));
+    HAPAssert(statistics.maxReceiveBuffersInUse == HAPArrayCount(receiveBuffers));
+
+    CloseTCPStreamManager();
+}
+
+int main()
+{
+    // Timers fire without delay, so that the idle times of the TCP streams are exact.
+    HAPPlatformClockEnableVirtualTime(HAPPlatformClockGetCurrent());
+    HAPPlatformRunLoopCreate(&(const HAPPlatformRunLoopOptions) { .keyValueStore = &keyValueStore });
+
+    TestEviction();
+    TestDeadPeer();
+    TestTransmitBufferGrowth();
+    TestStatistics();
+    TestBufferHighWater();
+
+    HAPPlatformRunLoopRelease();
+    return 0;
+}
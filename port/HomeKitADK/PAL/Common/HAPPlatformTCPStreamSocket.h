@@ -0,0 +1,148 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+#ifndef HAP_PLATFORM_TCP_STREAM_SOCKET_H
+#define HAP_PLATFORM_TCP_STREAM_SOCKET_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "HAPPlatform.h"
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull begin
+#endif
+
+/**@file
+ * Socket calls of the TCP stream manager.
+ *
+ * HAPPlatformTCPStreamManager.c holds the buffering, eviction and statistics that do not depend on the socket API.
+ * Each backend provides the socket calls: BSD sockets on Linux, SlNetSock on CC32xxSF.
+ *
+ * All sockets are nonblocking. Calls that fail leave the error number in errno.
+ */
+
+/**
+ * TCP keepalive settings of a TCP stream socket.
+ */
+typedef struct {
+    /**
+     * Time without incoming bytes after which the peer is probed.
+     */
+    HAPTime idleTime;
+
+    /**
+     * Time between unanswered probes.
+     */
+    HAPTime probeInterval;
+
+    /**
+     * Number of unanswered probes after which the connection is reset.
+     */
+    int numProbes;
+} HAPPlatformTCPStreamSocketKeepAlive;
+
+/**
+ * Gets the TCP keepalive settings that reset a connection whose peer stopped responding. Shared by the backends.
+ *
+ * - Probes start after half of the timeout without incoming bytes, and are spread over the other half, so that the
+ *   connection is reset once the timeout has elapsed. Times are whole seconds, and at least one second.
+ *
+ * - Backends that cannot set the probe interval and count only use the idle time.
+ *
+ * @param      deadPeerTimeout      Time after which the connection is reset if its peer stopped responding.
+ * @param[out] keepAlive            TCP keepalive settings.
+ */
+void HAPPlatformTCPStreamSocketGetKeepAlive(HAPTime deadPeerTimeout, HAPPlatformTCPStreamSocketKeepAlive* keepAlive);
+
+/**
+ * Opens a nonblocking TCP stream listener socket that accepts IPv6 and IPv4 clients.
+ *
+ * - Fails fatally if the socket cannot be set up.
+ *
+ * @param      interfaceName        Local network interface name on which to listen, or empty for all interfaces.
+ * @param      port                 Port on which to listen, or kHAPNetworkPort_Any.
+ * @param[out] fileDescriptor       Socket descriptor of the listener.
+ * @param[out] interfaceIndex       Index of the local network interface, or 0 if the listener is not bound to one.
+ * @param[out] listenerPort         Port on which the listener listens.
+ */
+void HAPPlatformTCPStreamSocketOpenListener(
+        const char* interfaceName,
+        HAPNetworkPort port,
+        int* fileDescriptor,
+        uint32_t* interfaceIndex,
+        HAPNetworkPort* listenerPort);
+
+/**
+ * Accepts a pending connection on a TCP stream listener socket.
+ *
+ * - The accepted socket is nonblocking and sends small writes right away.
+ *
+ * @param      listenerFileDescriptor Socket descriptor of the listener.
+ * @param      deadPeerTimeout      Time after which the connection is reset if its peer stopped responding, or 0.
+ * @param[out] fileDescriptor       Socket descriptor of the accepted connection.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_Busy           If no connection is pending.
+ * @return kHAPError_Unknown        If the accept failed.
+ */
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformTCPStreamSocketAccept(int listenerFileDescriptor, HAPTime deadPeerTimeout, int* fileDescriptor);
+
+/**
+ * Shuts down the output of a TCP stream socket.
+ *
+ * @param      fileDescriptor       Socket descriptor.
+ */
+void HAPPlatformTCPStreamSocketShutdownOutput(int fileDescriptor);
+
+/**
+ * Shuts down and closes a TCP stream socket or TCP stream listener socket.
+ *
+ * @param      fileDescriptor       Socket descriptor.
+ */
+void HAPPlatformTCPStreamSocketClose(int fileDescriptor);
+
+/**
+ * Sends bytes on a TCP stream socket.
+ *
+ * @param      fileDescriptor       Socket descriptor.
+ * @param      bytes                Buffer with the bytes to send.
+ * @param      maxBytes             Number of bytes to send.
+ * @param[out] numBytes             Number of bytes that were sent.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_Busy           If the socket cannot take more bytes.
+ * @return kHAPError_Unknown        If the send failed. The error number is left in errno.
+ */
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformTCPStreamSocketSend(int fileDescriptor, const void* bytes, size_t maxBytes, size_t* numBytes);
+
+/**
+ * Receives bytes on a TCP stream socket.
+ *
+ * @param      fileDescriptor       Socket descriptor.
+ * @param[out] bytes                Buffer for the received bytes.
+ * @param      maxBytes             Capacity of the buffer.
+ * @param[out] numBytes             Number of bytes that were received. 0 if the peer closed its output.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_Busy           If no bytes are available.
+ * @return kHAPError_Unknown        If the receive failed. The error number is left in errno.
+ */
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformTCPStreamSocketReceive(int fileDescriptor, void* bytes, size_t maxBytes, size_t* numBytes);
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull end
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,160 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+#ifndef HAP_PLATFORM_WAKEUP_INIT_H
+#define HAP_PLATFORM_WAKEUP_INIT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "HAPPlatform.h"
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull begin
+#endif
+
+/**@file
+ * Central registry of upcoming wakeups.
+ *
+ * Every component that wakes up the system periodically or at a known time, e.g., the run loop timers or the UART
+ * supervisor, registers a wakeup source and publishes its next deadline. The registry counts how often each source
+ * wakes up the system and how the published deadlines relate to the idle time of the scheduler.
+ *
+ * - The registry does not save power by itself. With tickless idle, the kernel already bounds the idle time by the
+ *   earliest timeout of a blocked task, and each source blocks with a timeout that matches its published deadline.
+ *
+ * - All functions may be called from any task.
+ */
+
+/**
+ * Sleep window if no deadline is published.
+ */
+#define kHAPPlatformWakeup_Forever ((HAPTime) UINT64_MAX)
+
+/**
+ * Wakeup source.
+ */
+typedef struct HAPPlatformWakeupSource HAPPlatformWakeupSource;
+struct HAPPlatformWakeupSource {
+    // Opaque type. Do not access the instance fields directly.
+    /**@cond */
+    const char* name;
+    HAPTime deadline;
+    uint64_t numWakeups;
+    HAPPlatformWakeupSource* _Nullable nextSource;
+    /**@endcond */
+};
+
+/**
+ * Wakeup statistics.
+ */
+typedef struct {
+    /**
+     * Number of wakeups of all sources.
+     */
+    uint64_t numWakeups;
+
+    /**
+     * Average number of wakeups per hour since the first source was registered.
+     */
+    uint64_t numWakeupsPerHour;
+
+    /**
+     * Number of times the idle task asked for the sleep window.
+     */
+    uint64_t numIdleSleeps;
+
+    /**
+     * Number of times the sleep window was shorter than the idle time expected by the scheduler.
+     *
+     * - Expected to stay 0. Otherwise, a source published a deadline without blocking with a matching timeout.
+     */
+    uint64_t numIdleSleepsLimited;
+} HAPPlatformWakeupStatistics;
+
+/**
+ * Registers a wakeup source.
+ *
+ * @param      source               Wakeup source.
+ * @param      name                 Name of the wakeup source, for logging.
+ */
+void HAPPlatformWakeupSourceRegister(HAPPlatformWakeupSource* source, const char* name);
+
+/**
+ * Deregisters a wakeup source.
+ *
+ * @param      source               Wakeup source.
+ */
+void HAPPlatformWakeupSourceDeregister(HAPPlatformWakeupSource* source);
+
+/**
+ * Publishes the next deadline of a wakeup source.
+ *
+ * @param      source               Wakeup source.
+ * @param      deadline             Time at which the source has to run next, or 0 if it does not have a deadline.
+ */
+void HAPPlatformWakeupSourceSetDeadline(HAPPlatformWakeupSource* source, HAPTime deadline);
+
+/**
+ * Records that a wakeup source has woken up the system because its deadline was reached.
+ *
+ * @param      source               Wakeup source.
+ */
+void HAPPlatformWakeupSourceRecordWakeup(HAPPlatformWakeupSource* source);
+
+/**
+ * Gets the number of wakeups of a wakeup source.
+ *
+ * @param      source               Wakeup source.
+ *
+ * @return Number of wakeups recorded with HAPPlatformWakeupSourceRecordWakeup.
+ */
+HAP_RESULT_USE_CHECK
+uint64_t HAPPlatformWakeupSourceGetNumWakeups(const HAPPlatformWakeupSource* source);
+
+/**
+ * Gets the time until the earliest published deadline.
+ *
+ * @param      now                  Current time.
+ *
+ * @return Time until the earliest deadline, 0 if a deadline has been reached, or kHAPPlatformWakeup_Forever if no
+ *         deadline is published.
+ */
+HAP_RESULT_USE_CHECK
+HAPTime HAPPlatformWakeupGetSleepWindow(HAPTime now);
+
+/**
+ * Limits the idle time expected by the scheduler to the sleep window.
+ *
+ * - Intended for configPRE_SUPPRESS_TICKS_AND_SLEEP_PROCESSING with a tick rate of 1 kHz.
+ *
+ * - Only feeds the idle statistics in practice, as the kernel already bounds the idle time. The limit is a safeguard
+ *   against a source that publishes a deadline without blocking with a matching timeout.
+ *
+ * @param      expectedIdleTime     Idle time expected by the scheduler in milliseconds.
+ *
+ * @return Idle time in milliseconds for which the system may sleep.
+ */
+HAP_RESULT_USE_CHECK
+uint32_t HAPPlatformWakeupLimitIdleTime(uint32_t expectedIdleTime);
+
+/**
+ * Gets the wakeup statistics.
+ *
+ * @param[out] statistics           Wakeup statistics.
+ */
+void HAPPlatformWakeupGetStatistics(HAPPlatformWakeupStatistics* statistics);
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull end
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,164 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+#include "HAPPlatform.h"
+#include "HAPPlatformCriticalSection.h"
+#include "HAPPlatformWakeup+Init.h"
+
+static const HAPLogObject logObject = { .subsystem = kHAPPlatform_LogSubsystem, .category = "Wakeup" };
+
+static struct {
+    /** Registered wakeup sources. */
+    HAPPlatformWakeupSource* _Nullable sources;
+
+    /** Time at which the first wakeup source was registered. */
+    HAPTime startTime;
+
+    /** Number of wakeups of deregistered sources. */
+    uint64_t numReleasedWakeups;
+
+    /** Number of times the idle task asked for the sleep window. */
+    uint64_t numIdleSleeps;
+
+    /** Number of times the sleep window was shorter than the expected idle time. */
+    uint64_t numIdleSleepsLimited;
+} wakeup;
+
+void HAPPlatformWakeupSourceRegister(HAPPlatformWakeupSource* source, const char* name)
+{
+    HAPPrecondition(source);
+    HAPPrecondition(name);
+
+    HAPTime now = HAPPlatformClockGetCurrent();
+
+    HAPPlatformEnterCriticalSection();
+    for (HAPPlatformWakeupSource* other = wakeup.sources; other; other = other->nextSource) {
+        HAPPrecondition(other != source);
+    }
+    source->name = name;
+    source->deadline = 0;
+    source->numWakeups = 0;
+    source->nextSource = wakeup.sources;
+    if (!wakeup.sources && !wakeup.startTime) {
+        wakeup.startTime = now;
+    }
+    wakeup.sources = source;
+    HAPPlatformExitCriticalSection();
+
+    HAPLogDebug(&logObject, "Registered wakeup source %s.", name);
+}
+
+void HAPPlatformWakeupSourceDeregister(HAPPlatformWakeupSource* source)
+{
+    HAPPrecondition(source);
+
+    bool found = false;
+    HAPPlatformEnterCriticalSection();
+    for (HAPPlatformWakeupSource** link = &wakeup.sources; *link; link = &(*link)->nextSource) {
+        if (*link == source) {
+            *link = source->nextSource;
+            found = true;
+            break;
+        }
+    }
+    if (found) {
+        wakeup.numReleasedWakeups += source->numWakeups;
+        source->deadline = 0;
+        source->nextSource = NULL;
+    }
+    HAPPlatformExitCriticalSection();
+    HAPPrecondition(found);
+
+    HAPLogDebug(
+            &logObject,
+            "Deregistered wakeup source %s after %llu wakeups.",
+            source->name,
+            (unsigned long long) source->numWakeups);
+}
+
+void HAPPlatformWakeupSourceSetDeadline(HAPPlatformWakeupSource* source, HAPTime deadline)
+{
+    HAPPrecondition(source);
+
+    HAPPlatformEnterCriticalSection();
+    source->deadline = deadline;
+    HAPPlatformExitCriticalSection();
+}
+
+void HAPPlatformWakeupSourceRecordWakeup(HAPPlatformWakeupSource* source)
+{
+    HAPPrecondition(source);
+
+    HAPPlatformEnterCriticalSection();
+    source->numWakeups++;
+    HAPPlatformExitCriticalSection();
+}
+
+HAP_RESULT_USE_CHECK
+uint64_t HAPPlatformWakeupSourceGetNumWakeups(const HAPPlatformWakeupSource* source)
+{
+    HAPPrecondition(source);
+
+    HAPPlatformEnterCriticalSection();
+    uint64_t numWakeups = source->numWakeups;
+    HAPPlatformExitCriticalSection();
+    return numWakeups;
+}
+
+HAP_RESULT_USE_CHECK
+HAPTime HAPPlatformWakeupGetSleepWindow(HAPTime now)
+{
+    HAPTime nextDeadline = 0;
+    HAPPlatformEnterCriticalSection();
+    for (const HAPPlatformWakeupSource* source = wakeup.sources; source; source = source->nextSource) {
+        if (source->deadline && (!nextDeadline || source->deadline < nextDeadline)) {
+            nextDeadline = source->deadline;
+        }
+    }
+    HAPPlatformExitCriticalSection();
+
+    if (!nextDeadline) {
+        return kHAPPlatformWakeup_Forever;
+    }
+    return nextDeadline > now ? nextDeadline - now : 0;
+}
+
+HAP_RESULT_USE_CHECK
+uint32_t HAPPlatformWakeupLimitIdleTime(uint32_t expectedIdleTime)
+{
+    HAPTime sleepWindow = HAPPlatformWakeupGetSleepWindow(HAPPlatformClockGetCurrent());
+
+    HAPPlatformEnterCriticalSection();
+    wakeup.numIdleSleeps++;
+    if (sleepWindow < expectedIdleTime) {
+        wakeup.numIdleSleepsLimited++;
+    }
+    HAPPlatformExitCriticalSection();
+
+    return sleepWindow < expectedIdleTime ? (uint32_t) sleepWindow : expectedIdleTime;
+}
+
+void HAPPlatformWakeupGetStatistics(HAPPlatformWakeupStatistics* statistics)
+{
+    HAPPrecondition(statistics);
+
+    HAPTime now = HAPPlatformClockGetCurrent();
+
+    HAPRawBufferZero(statistics, sizeof *statistics);
+    HAPPlatformEnterCriticalSection();
+    statistics->numWakeups = wakeup.numReleasedWakeups;
+    for (const HAPPlatformWakeupSource* source = wakeup.sources; source; source = source->nextSource) {
+        statistics->numWakeups += source->numWakeups;
+    }
+    statistics->numIdleSleeps = wakeup.numIdleSleeps;
+    statistics->numIdleSleepsLimited = wakeup.numIdleSleepsLimited;
+    HAPTime startTime = wakeup.startTime;
+    HAPPlatformExitCriticalSection();
+
+    if (startTime && now > startTime) {
+        statistics->numWakeupsPerHour = statistics->numWakeups * HAPHour / (now - startTime);
+    }
+}
@@ -0,0 +1,207 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Copyright (c) 2022 John Buonagurio
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+// Tests of the wakeup registry and of the sleep windows published by the run loop, run by the host build on a virtual
+// clock.
+
+#include "HAPPlatform.h"
+#include "HAPPlatformClock+Init.h"
+#include "HAPPlatformKeyValueStore+Init.h"
+#include "HAPPlatformRunLoop+Init.h"
+#include "HAPPlatformWakeup+Init.h"
+
+static const HAPLogObject logObject = { .subsystem = kHAPPlatform_LogSubsystem, .category = "WakeupTest" };
+
+/**
+ * Key-value store of the run loop. It is only used by the run loop watchdog, which is not enabled.
+ */
+static HAPPlatformKeyValueStore keyValueStore;
+
+static HAPPlatformWakeupStatistics GetStatistics(void)
+{
+    HAPPlatformWakeupStatistics statistics;
+    HAPPlatformWakeupGetStatistics(&statistics);
+    return statistics;
+}
+
+/**
+ * The sleep window ends at the earliest published deadline. Sources without a deadline do not limit it, and a
+ * deadline that has been reached closes it.
+ */
+static void TestSleepWindow(void)
+{
+    HAPLogInfo(&logObject, "%s", __func__);
+
+    // Only the run loop is registered. It has not published a deadline, as it has not run yet.
+    HAPTime now = HAPPlatformClockGetCurrent();
+    HAPAssert(HAPPlatformWakeupGetSleepWindow(now) == kHAPPlatformWakeup_Forever);
+
+    HAPPlatformWakeupSource sources[3];
+    HAPPlatformWakeupSourceRegister(&sources[0], "A");
+    HAPPlatformWakeupSourceRegister(&sources[1], "B");
+    HAPPlatformWakeupSourceRegister(&sources[2], "C");
+    HAPAssert(HAPPlatformWakeupGetSleepWindow(now) == kHAPPlatformWakeup_Forever);
+
+    HAPPlatformWakeupSourceSetDeadline(&sources[0], now + 10 * HAPSecond);
+    HAPPlatformWakeupSourceSetDeadline(&sources[1], now + 3 * HAPSecond);
+    HAPAssert(HAPPlatformWakeupGetSleepWindow(now) == 3 * HAPSecond);
+    HAPAssert(HAPPlatformWakeupGetSleepWindow(now + HAPSecond) == 2 * HAPSecond);
+    HAPAssert(HAPPlatformWakeupGetSleepWindow(now + 3 * HAPSecond) == 0);
+    HAPAssert(HAPPlatformWakeupGetSleepWindow(now + 5 * HAPSecond) == 0);
+
+    // Moving or clearing the earliest deadline extends the window to the next deadline.
+    HAPPlatformWakeupSourceSetDeadline(&sources[1], 0);
+    HAPAssert(HAPPlatformWakeupGetSleepWindow(now) == 10 * HAPSecond);
+    HAPPlatformWakeupSourceSetDeadline(&sources[2], now + 500 * HAPMillisecond);
+    HAPAssert(HAPPlatformWakeupGetSleepWindow(now) == 500 * HAPMillisecond);
+    HAPPlatformWakeupSourceDeregister(&sources[2]);
+    HAPAssert(HAPPlatformWakeupGetSleepWindow(now) == 10 * HAPSecond);
+
+    // The idle time expected by the scheduler is limited to the window, and each limit is counted.
+    HAPPlatformWakeupStatistics statistics = GetStatistics();
+    HAPAssert(HAPPlatformWakeupLimitIdleTime(5000) == 5000);
+    HAPPlatformWakeupSourceSetDeadline(&sources[1], now + 300 * HAPMillisecond);
+    HAPAssert(HAPPlatformWakeupLimitIdleTime(5000) == 300);
+    HAPAssert(HAPPlatformWakeupLimitIdleTime(200) == 200);
+    HAPPlatformWakeupStatistics newStatistics = GetStatistics();
+    HAPAssert(newStatistics.numIdleSleeps == statistics.numIdleSleeps + 3);
+    HAPAssert(newStatistics.numIdleSleepsLimited == statistics.numIdleSleepsLimited + 1);
+
+    // Wakeups of deregistered sources are retained in the statistics.
+    HAPPlatformWakeupSourceRecordWakeup(&sources[0]);
+    HAPPlatformWakeupSourceRecordWakeup(&sources[1]);
+    HAPPlatformWakeupSourceRecordWakeup(&sources[1]);
+    HAPAssert(HAPPlatformWakeupSourceGetNumWakeups(&sources[1]) == 2);
+    HAPPlatformWakeupSourceDeregister(&sources[0]);
+    HAPPlatformWakeupSourceDeregister(&sources[1]);
+    HAPAssert(GetStatistics().numWakeups == newStatistics.numWakeups + 3);
+    HAPAssert(HAPPlatformWakeupGetSleepWindow(now) == kHAPPlatformWakeup_Forever);
+}
+
+/**
+ * Sleep windows observed from scheduled callbacks.
+ */
+static struct {
+    HAPTime sleepWindows[4];
+    size_t numSleepWindows;
+} observations;
+
+static void ObserveSleepWindow(void* _Nullable context, size_t contextSize)
+{
+    (void) context;
+    (void) contextSize;
+
+    HAPAssert(observations.numSleepWindows < HAPArrayCount(observations.sleepWindows));
+    observations.sleepWindows[observations.numSleepWindows++] =
+            HAPPlatformWakeupGetSleepWindow(HAPPlatformClockGetCurrent());
+}
+
+static void HandleTimerExpired(HAPPlatformTimerRef timer, void* _Nullable context)
+{
+    (void) timer;
+    (void) context;
+}
+
+static void StopRunLoop(HAPPlatformTimerRef timer, void* _Nullable context)
+{
+    (void) timer;
+    (void) context;
+    HAPPlatformRunLoopStop();
+}
+
+/**
+ * The run loop publishes its next timer wakeup. Timers whose [deadline, deadline + leeway] intervals overlap share
+ * the wakeup at the earliest latest deadline.
+ */
+static void TestRunLoopSleepWindow(void)
+{
+    HAPLogInfo(&logObject, "%s", __func__);
+
+    HAPRawBufferZero(&observations, sizeof observations);
+    HAPTime now = HAPPlatformClockGetCurrent();
+    HAPPlatformTimerRef timers[3];
+    HAPError err = HAPPlatformTimerRegisterWithLeeway(
+            &timers[0], now + 1000 * HAPMillisecond, 500 * HAPMillisecond, HandleTimerExpired, NULL);
+    HAPAssert(!err);
+    err = HAPPlatformTimerRegisterWithLeeway(
+            &timers[1], now + 1200 * HAPMillisecond, 100 * HAPMillisecond, HandleTimerExpired, NULL);
+    HAPAssert(!err);
+    err = HAPPlatformTimerRegisterWithLeeway(
+            &timers[2], now + 10 * HAPSecond, /* leeway: */ 0, StopRunLoop, NULL);
+    HAPAssert(!err);
+
+    // Callbacks are dispatched after the run loop has published its wakeup for the iteration.
+    err = HAPPlatformRunLoopScheduleCallback(ObserveSleepWindow, NULL, 0);
+    HAPAssert(!err);
+    HAPPlatformRunLoopRun();
+    HAPAssert(observations.numSleepWindows == 1);
+    HAPAssert(observations.sleepWindows[0] == 1300 * HAPMillisecond);
+
+    // Once the run loop has no timers, it does not limit the sleep window.
+    err = HAPPlatformRunLoopScheduleCallback(ObserveSleepWindow, NULL, 0);
+    HAPAssert(!err);
+    HAPPlatformRunLoopRequestStop();
+    HAPPlatformRunLoopRun();
+    HAPAssert(observations.numSleepWindows == 2);
+    HAPAssert(observations.sleepWindows[1] == kHAPPlatformWakeup_Forever);
+}
+
+/**
+ * Number of periodic timer expirations.
+ */
+static size_t numPeriodicExpirations;
+
+static void HandlePeriodicTimerExpired(HAPPlatformTimerRef timer, void* _Nullable context)
+{
+    (void) timer;
+    (void) context;
+
+    numPeriodicExpirations++;
+    HAPPlatformTimerRef nextTimer;
+    HAPError err = HAPPlatformTimerRegisterWithLeeway(
+            &nextTimer, HAPPlatformClockGetCurrent() + HAPMinute, /* leeway: */ 0, HandlePeriodicTimerExpired, NULL);
+    HAPAssert(!err);
+}
+
+/**
+ * A timer that expires once per minute wakes up the system 60 times per hour.
+ */
+static void TestWakeupsPerHour(void)
+{
+    HAPLogInfo(&logObject, "%s", __func__);
+
+    HAPPlatformWakeupStatistics statistics = GetStatistics();
+    HAPTime startTime = HAPPlatformClockGetCurrent();
+    HAPPlatformTimerRef timer;
+    HAPError err = HAPPlatformTimerRegisterWithLeeway(
+            &timer, startTime + HAPMinute, /* leeway: */ 0, HandlePeriodicTimerExpired, NULL);
+    HAPAssert(!err);
+    err = HAPPlatformTimerRegisterWithLeeway(
+            &timer, startTime + 10 * HAPHour + HAPSecond, /* leeway: */ 0, StopRunLoop, NULL);
+    HAPAssert(!err);
+    HAPPlatformRunLoopRun();
+
+    HAPAssert(numPeriodicExpirations == 10 * 60);
+    HAPPlatformWakeupStatistics newStatistics = GetStatistics();
+    HAPAssert(newStatistics.numWakeups == statistics.numWakeups + 10 * 60 + 1);
+    HAPLogInfo(&logObject, "%llu wakeups per hour.", (unsigned long long) newStatistics.numWakeupsPerHour);
+    HAPAssert(newStatistics.numWakeupsPerHour >= 59 && newStatistics.numWakeupsPerHour <= 61);
+}
+
+int main()
+{
+    HAPPlatformClockEnableVirtualTime(HAPPlatformClockGetCurrent());
+    HAPPlatformRunLoopCreate(&(const HAPPlatformRunLoopOptions) { .keyValueStore = &keyValueStore });
+
+    TestSleepWindow();
+    TestRunLoopSleepWindow();
+    TestWakeupsPerHour();
+
+    HAPPlatformRunLoopRelease();
+    return 0;
+}
@@ -0,0 +1,64 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Copyright (c) 2022 John Buonagurio
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+#ifndef HAP_PLATFORM_CLOCK_INIT_H
+#define HAP_PLATFORM_CLOCK_INIT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "HAPPlatform.h"
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull begin
+#endif
+
+/**@file
+ * Clock for POSIX.
+ *
+ * By default, the clock follows CLOCK_MONOTONIC. For deterministic testing, e.g., of timer and stall handling, the
+ * clock may be switched to virtual time, which only advances when requested.
+ */
+
+/**
+ * Switches the clock to virtual time.
+ *
+ * - The clock must not be switched back to CLOCK_MONOTONIC.
+ *
+ * @param      now                  Initial time. Must not be earlier than the current time.
+ */
+void HAPPlatformClockEnableVirtualTime(HAPTime now);
+
+/**
+ * Returns whether the clock uses virtual time.
+ *
+ * @return true                     If the clock uses virtual time.
+ * @return false                    Otherwise.
+ */
+HAP_RESULT_USE_CHECK
+bool HAPPlatformClockIsVirtualTime(void);
+
+/**
+ * Advances virtual time.
+ *
+ * - This function must be called from the run loop.
+ *
+ * @param      delta                Amount of time by which to advance the clock.
+ */
+void HAPPlatformClockAdvance(HAPTime delta);
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull end
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
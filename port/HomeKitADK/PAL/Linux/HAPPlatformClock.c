@@ -0,0 +1,90 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Copyright (c) 2022 John Buonagurio
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+#include <errno.h>
+#include <time.h>
+
+#include "HAPPlatform.h"
+#include "HAPPlatformClock+Init.h"
+#include "HAPPlatformLog+Init.h"
+
+static const HAPLogObject logObject = { .subsystem = kHAPPlatform_LogSubsystem, .category = "Clock" };
+
+static HAPTime previousNow = 0;
+
+static struct {
+    /**
+     * Whether the clock uses virtual time.
+     */
+    bool isEnabled;
+
+    /**
+     * Current virtual time.
+     */
+    HAPTime now;
+} virtualTime;
+
+void HAPPlatformClockEnableVirtualTime(HAPTime now)
+{
+    HAPPrecondition(!virtualTime.isEnabled);
+    HAPPrecondition(now >= previousNow);
+    HAPPrecondition(!(now & (1ull << 63)));
+
+    HAPLogInfo(&logObject, "Using virtual time starting at %llu ms.", (unsigned long long) now);
+    virtualTime.isEnabled = true;
+    virtualTime.now = now;
+}
+
+bool HAPPlatformClockIsVirtualTime(void)
+{
+    return virtualTime.isEnabled;
+}
+
+void HAPPlatformClockAdvance(HAPTime delta)
+{
+    HAPPrecondition(virtualTime.isEnabled);
+
+    if (delta > (1ull << 63) - 1 - virtualTime.now) {
+        HAPLogFault(&logObject, "Time overflowed (capped at 2^63 - 1).");
+        HAPFatalError();
+    }
+    virtualTime.now += delta;
+}
+
+HAPTime HAPPlatformClockGetCurrent(void)
+{
+    if (virtualTime.isEnabled) {
+        previousNow = virtualTime.now;
+        return virtualTime.now;
+    }
+
+    // CLOCK_MONOTONIC is not affected by discontinuous jumps in the system time.
+    struct timespec t;
+    int e = clock_gettime(CLOCK_MONOTONIC, &t);
+    if (e) {
+        HAPPlatformLogPOSIXError(kHAPLogType_Error,
+                                 "System call 'clock_gettime' failed.",
+                                 errno, __func__, HAP_FILE, __LINE__);
+        HAPFatalError();
+    }
+
+    HAPTime now = (HAPTime) t.tv_sec * 1000u + (HAPTime) t.tv_nsec / 1000000u;
+
+    if (now < previousNow) {
+        HAPLogFault(&logObject, "Time jumped backwards by %llu ms.", (unsigned long long) (previousNow - now));
+        HAPFatalError();
+    }
+
+    if (now & (1ull << 63)) {
+        HAPLogFault(&logObject, "Time overflowed (capped at 2^63 - 1).");
+        HAPFatalError();
+    }
+
+    previousNow = now;
+    return now;
+}
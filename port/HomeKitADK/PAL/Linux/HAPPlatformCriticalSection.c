@@ -0,0 +1,44 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+#include <pthread.h>
+
+#include "HAPPlatform.h"
+#include "HAPPlatformCriticalSection.h"
+
+/**
+ * Mutex backing the critical section. Recursive, so that critical sections may be nested like on FreeRTOS.
+ */
+static pthread_mutex_t criticalSectionMutex;
+
+static pthread_once_t criticalSectionOnce = PTHREAD_ONCE_INIT;
+
+static void InitializeCriticalSection(void)
+{
+    pthread_mutexattr_t attr;
+    int e = pthread_mutexattr_init(&attr);
+    HAPAssert(!e);
+    e = pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    HAPAssert(!e);
+    e = pthread_mutex_init(&criticalSectionMutex, &attr);
+    HAPAssert(!e);
+    e = pthread_mutexattr_destroy(&attr);
+    HAPAssert(!e);
+}
+
+void HAPPlatformEnterCriticalSection(void)
+{
+    int e = pthread_once(&criticalSectionOnce, InitializeCriticalSection);
+    HAPAssert(!e);
+    e = pthread_mutex_lock(&criticalSectionMutex);
+    HAPAssert(!e);
+}
+
+void HAPPlatformExitCriticalSection(void)
+{
+    int e = pthread_mutex_unlock(&criticalSectionMutex);
+    HAPAssert(!e);
+}
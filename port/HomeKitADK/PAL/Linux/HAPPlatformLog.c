@@ -0,0 +1,183 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Copyright (c) 2022 John Buonagurio
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "HAP.h"
+#include "HAPPlatformLog+Init.h"
+
+static const HAPLogObject logObject = { .subsystem = kHAPPlatform_LogSubsystem, .category = "Log" };
+
+void HAPPlatformLogPOSIXError(HAPLogType type, const char *_Nonnull message, int errorNumber,
+                              const char *_Nonnull function, const char *_Nonnull file, int line)
+{
+    HAPPrecondition(message);
+    HAPPrecondition(function);
+    HAPPrecondition(file);
+
+    HAPError err;
+
+    // Get error message. Glibc provides the XSI-compliant version of 'strerror_r' unless _GNU_SOURCE is defined.
+    char errorString[256];
+    int e = strerror_r(errorNumber, errorString, sizeof errorString);
+    if (e == EINVAL) {
+        err = HAPStringWithFormat(errorString, sizeof errorString, "Unknown error %d", errorNumber);
+        HAPAssert(!err);
+    } else if (e) {
+        HAPAssert(e == ERANGE);
+        HAPLog(&logObject, "strerror_r error: ERANGE.");
+        return;
+    }
+
+    // Perform logging.
+    HAPLogWithType(&logObject, type, "%s:%d:%s - %s @ %s:%d", message, errorNumber, errorString, function, file, line);
+}
+
+HAP_RESULT_USE_CHECK
+HAPPlatformLogEnabledTypes HAPPlatformLogGetEnabledTypes(const HAPLogObject* _Nonnull log HAP_UNUSED) {
+    switch (HAP_LOG_LEVEL) {
+        case 0: {
+            return kHAPPlatformLogEnabledTypes_None;
+        }
+        case 1: {
+            return kHAPPlatformLogEnabledTypes_Default;
+        }
+        case 2: {
+            return kHAPPlatformLogEnabledTypes_Info;
+        }
+        case 3: {
+            return kHAPPlatformLogEnabledTypes_Debug;
+        }
+        default: {
+            HAPFatalError();
+        }
+    }
+}
+
+void HAPPlatformLogCapture(
+        const HAPLogObject* log,
+        HAPLogType type,
+        const char* message,
+        const void* _Nullable bufferBytes,
+        size_t numBufferBytes) HAP_DIAGNOSE_ERROR(!bufferBytes && numBufferBytes, "empty buffer cannot have a length")
+{
+    static bool isTerminal;
+    static bool isInitialized = false;
+    if (!isInitialized) {
+        isTerminal = isatty(STDERR_FILENO) == 1;
+        isInitialized = true;
+    }
+
+    flockfile(stderr);
+
+    // ANSI Color.
+    if (isTerminal) {
+        switch (type) {
+            case kHAPLogType_Debug: {
+                (void) fprintf(stderr, "\x1B[0m");
+            } break;
+            case kHAPLogType_Info: {
+                (void) fprintf(stderr, "\x1B[32m");
+            } break;
+            case kHAPLogType_Default: {
+                (void) fprintf(stderr, "\x1B[35m");
+            } break;
+            case kHAPLogType_Error: {
+                (void) fprintf(stderr, "\x1B[31m");
+            } break;
+            case kHAPLogType_Fault: {
+                (void) fprintf(stderr, "\x1B[1m\x1B[41m");
+            } break;
+        }
+    }
+
+    // Time.
+    HAPTime now = HAPPlatformClockGetCurrent();
+    (void) fprintf(stderr, "%8lu.%03lu\t",
+        (unsigned long) (now / HAPSecond), (unsigned long) (now % HAPSecond));
+
+    // Type.
+    switch (type) {
+        case kHAPLogType_Debug:
+            (void) fprintf(stderr, "Debug");
+            break;
+        case kHAPLogType_Info:
+            (void) fprintf(stderr, "Info");
+            break;
+        case kHAPLogType_Default:
+            (void) fprintf(stderr, "Default");
+            break;
+        case kHAPLogType_Error:
+            (void) fprintf(stderr, "Error");
+            break;
+        case kHAPLogType_Fault:
+            (void) fprintf(stderr, "Fault");
+            break;
+    }
+    (void) fprintf(stderr, "\t");
+
+    // Subsystem / Category.
+    if (log->subsystem) {
+        (void) fprintf(stderr, "[%s", log->subsystem);
+        if (log->category) {
+            (void) fprintf(stderr, ":%s", log->category);
+        }
+        (void) fprintf(stderr, "] ");
+    }
+
+    // Message.
+    (void) fprintf(stderr, "%s", message);
+    (void) fprintf(stderr, "\n");
+
+    // Buffer.
+    if (bufferBytes) {
+        size_t i, n;
+        const uint8_t* b = bufferBytes;
+        size_t length = numBufferBytes;
+        if (length == 0) {
+            (void) fprintf(stderr, "\n");
+        } else {
+            i = 0;
+            do {
+                (void) fprintf(stderr, "    %04zx ", i);
+                for (n = 0; n != 8 * 4; n++) {
+                    if (n % 4 == 0) {
+                        (void) fprintf(stderr, " ");
+                    }
+                    if ((n <= length) && (i < length - n)) {
+                        (void) fprintf(stderr, "%02x", b[i + n] & 0xff);
+                    } else {
+                        (void) fprintf(stderr, "  ");
+                    }
+                };
+                (void) fprintf(stderr, "    ");
+                for (n = 0; n != 8 * 4; n++) {
+                    if (i != length) {
+                        if ((32 <= b[i]) && (b[i] < 127)) {
+                            (void) fprintf(stderr, "%c", b[i]);
+                        } else {
+                            (void) fprintf(stderr, ".");
+                        }
+                        i++;
+                    }
+                }
+                (void) fprintf(stderr, "\n");
+            } while (i != length);
+        }
+    }
+
+    // Reset color.
+    if (isTerminal) {
+        (void) fprintf(stderr, "\x1B[0m");
+    }
+
+    funlockfile(stderr);
+}
@@ -0,0 +1,644 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Copyright (c) 2022 John Buonagurio
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+// This implementation is based on `epoll`. File descriptors are only registered with the epoll instance while the
+// file handle has at least one interest, so that hang-up and error conditions on idle descriptors do not cause the
+// run loop to spin.
+//
+// If the clock uses virtual time, the run loop polls for I/O and advances the clock to the next timer wakeup whenever
+// no I/O is pending, so that timer driven behavior runs as fast as possible in a reproducible order.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#include "HAPPlatform.h"
+#include "HAPPlatform+Init.h"
+#include "HAPPlatformClock+Init.h"
+#include "HAPPlatformFileHandle.h"
+#include "HAPPlatformLog+Init.h"
+#include "HAPPlatformRunLoop+Init.h"
+#include "HAPPlatformRunLoopCallbacks.h"
+#include "HAPPlatformRunLoopCommon.h"
+#include "HAPPlatformRunLoopWatchdog.h"
+
+static const HAPLogObject logObject = { .subsystem = kHAPPlatform_LogSubsystem, .category = "RunLoop" };
+
+/**
+ * Maximum number of events returned by a single call to epoll_wait.
+ */
+#define kHAPPlatformRunLoop_MaxEvents ((size_t) 16)
+
+/**
+ * Internal file handle type, representing the registration of a platform-specific file descriptor.
+ */
+typedef struct HAPPlatformFileHandle HAPPlatformFileHandle;
+
+/**
+ * Internal file handle representation.
+ */
+struct HAPPlatformFileHandle {
+    /**
+     * Platform-specific file descriptor.
+     */
+    int fileDescriptor;
+
+    /**
+     * Set of file handle events on which the callback shall be invoked.
+     */
+    HAPPlatformFileHandleEvent interests;
+
+    /**
+     * Function to call when one or more events occur on the given file descriptor.
+     */
+    HAPPlatformFileHandleCallback callback;
+
+    /**
+     * The context parameter given to the HAPPlatformFileHandleRegister function.
+     */
+    void* _Nullable context;
+
+    /**
+     * Previous file handle in linked list.
+     */
+    HAPPlatformFileHandle* _Nullable prevFileHandle;
+
+    /**
+     * Next file handle in linked list.
+     */
+    HAPPlatformFileHandle* _Nullable nextFileHandle;
+
+    /**
+     * Flag indicating whether the platform-specific file descriptor is registered with an I/O multiplexer or not.
+     */
+    bool isAwaitingEvents;
+
+    /**
+     * Events reported by the last call to epoll_wait that have not yet been dispatched.
+     */
+    uint32_t pendingEvents;
+};
+
+/**
+ * Run loop state.
+ */
+HAP_ENUM_BEGIN(uint8_t, HAPPlatformRunLoopState) { /**
+                                                    * Idle.
+                                                    */
+                                                   kHAPPlatformRunLoopState_Idle,
+
+                                                   /**
+                                                    * Running.
+                                                    */
+                                                   kHAPPlatformRunLoopState_Running,
+
+                                                   /**
+                                                    * Stopping.
+                                                    */
+                                                   kHAPPlatformRunLoopState_Stopping
+} HAP_ENUM_END(uint8_t, HAPPlatformRunLoopState);
+
+static struct {
+    /**
+     * Sentinel node of a circular doubly-linked list of file handles
+     */
+    HAPPlatformFileHandle fileHandleSentinel;
+
+    /**
+     * Pointer to sentinel node, representing a circular doubly-linked list of file handles
+     */
+    HAPPlatformFileHandle* _Nullable fileHandles;
+
+    /**
+     * File handle cursor, used to handle reentrant modifications of global file handle list during iteration.
+     */
+    HAPPlatformFileHandle* _Nullable fileHandleCursor;
+
+    /**
+     * epoll instance file descriptor.
+     */
+    int epollFileDescriptor;
+
+    /**
+     * Self-pipe file descriptor to receive data.
+     */
+    volatile int loopbackFileDescriptor0;
+
+    /**
+     * Self-pipe file descriptor to send data.
+     */
+    volatile int loopbackFileDescriptor1;
+
+    /**
+     * Self-pipe byte buffer.
+     *
+     * - Callbacks are serialized into the buffer as:
+     *   - 8-byte aligned callback pointer.
+     *   - Context size (up to UINT8_MAX).
+     *   - Context (unaligned). When invoking the callback, the context is first moved to be 8-byte aligned.
+     */
+    HAP_ALIGNAS(8)
+    char loopbackBytes[sizeof(HAPPlatformRunLoopCallback) + 1 + UINT8_MAX];
+
+    /**
+     * Number of bytes in self-pipe byte buffer.
+     */
+    size_t numLoopbackBytes;
+
+    /**
+     * File handle for self-pipe.
+     */
+    HAPPlatformFileHandleRef loopbackFileHandle;
+
+    /**
+     * Current run loop state.
+     */
+    HAPPlatformRunLoopState state;
+} runLoop = { .fileHandleSentinel = { .fileDescriptor = -1,
+                                      .interests = { .isReadyForReading = false,
+                                                     .isReadyForWriting = false,
+                                                     .hasErrorConditionPending = false },
+                                      .callback = NULL,
+                                      .context = NULL,
+                                      .prevFileHandle = &runLoop.fileHandleSentinel,
+                                      .nextFileHandle = &runLoop.fileHandleSentinel,
+                                      .isAwaitingEvents = false },
+              .fileHandles = &runLoop.fileHandleSentinel,
+              .fileHandleCursor = &runLoop.fileHandleSentinel,
+              .epollFileDescriptor = -1,
+              .loopbackFileDescriptor0 = -1,
+              .loopbackFileDescriptor1 = -1 };
+
+/**
+ * Synchronizes the epoll registration of a file handle with its interests.
+ *
+ * @param      fileHandle           File handle.
+ */
+static void UpdateEpollRegistration(HAPPlatformFileHandle* fileHandle)
+{
+    HAPPrecondition(fileHandle);
+    HAPPrecondition(runLoop.epollFileDescriptor != -1);
+
+    bool hasInterests = fileHandle->fileDescriptor != -1 &&
+                        (fileHandle->interests.isReadyForReading || fileHandle->interests.isReadyForWriting ||
+                         fileHandle->interests.hasErrorConditionPending);
+
+    int op;
+    if (hasInterests) {
+        op = fileHandle->isAwaitingEvents ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+    } else if (fileHandle->isAwaitingEvents) {
+        op = EPOLL_CTL_DEL;
+    } else {
+        return;
+    }
+
+    struct epoll_event event;
+    HAPRawBufferZero(&event, sizeof event);
+    event.events = (fileHandle->interests.isReadyForReading ? EPOLLIN : 0u) |
+                   (fileHandle->interests.isReadyForWriting ? EPOLLOUT : 0u) |
+                   (fileHandle->interests.hasErrorConditionPending ? EPOLLPRI : 0u);
+    event.data.ptr = fileHandle;
+
+    int e = epoll_ctl(runLoop.epollFileDescriptor, op, fileHandle->fileDescriptor, &event);
+    if (e) {
+        HAPPlatformLogPOSIXError(kHAPLogType_Error, "System call 'epoll_ctl' failed.",
+                                 errno, __func__, HAP_FILE, __LINE__);
+        HAPFatalError();
+    }
+    fileHandle->isAwaitingEvents = op != EPOLL_CTL_DEL;
+    if (!fileHandle->isAwaitingEvents) {
+        fileHandle->pendingEvents = 0;
+    }
+}
+
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformFileHandleRegister(HAPPlatformFileHandleRef* fileHandle_,
+                                       int fileDescriptor,
+                                       HAPPlatformFileHandleEvent interests,
+                                       HAPPlatformFileHandleCallback callback,
+                                       void* _Nullable context)
+{
+    HAPPrecondition(fileHandle_);
+
+    // Prepare fileHandle.
+    HAPPlatformFileHandle* fileHandle = calloc(1, sizeof(HAPPlatformFileHandle));
+    if (!fileHandle) {
+        HAPLog(&logObject, "Cannot allocate more file handles.");
+        *fileHandle_ = 0;
+        return kHAPError_OutOfResources;
+    }
+    fileHandle->fileDescriptor = fileDescriptor;
+    fileHandle->interests = interests;
+    fileHandle->callback = callback;
+    fileHandle->context = context;
+    fileHandle->prevFileHandle = runLoop.fileHandles->prevFileHandle;
+    fileHandle->nextFileHandle = runLoop.fileHandles;
+    fileHandle->isAwaitingEvents = false;
+    fileHandle->pendingEvents = 0;
+    runLoop.fileHandles->prevFileHandle->nextFileHandle = fileHandle;
+    runLoop.fileHandles->prevFileHandle = fileHandle;
+
+    UpdateEpollRegistration(fileHandle);
+
+    *fileHandle_ = (HAPPlatformFileHandleRef) fileHandle;
+    return kHAPError_None;
+}
+
+void HAPPlatformFileHandleUpdateInterests(HAPPlatformFileHandleRef fileHandle_,
+                                          HAPPlatformFileHandleEvent interests,
+                                          HAPPlatformFileHandleCallback callback,
+                                          void* _Nullable context)
+{
+    HAPPrecondition(fileHandle_);
+    HAPPlatformFileHandle* fileHandle = (HAPPlatformFileHandle * _Nonnull) fileHandle_;
+
+    bool interestsChanged = fileHandle->interests.isReadyForReading != interests.isReadyForReading ||
+                            fileHandle->interests.isReadyForWriting != interests.isReadyForWriting ||
+                            fileHandle->interests.hasErrorConditionPending != interests.hasErrorConditionPending;
+
+    fileHandle->interests = interests;
+    fileHandle->callback = callback;
+    fileHandle->context = context;
+
+    if (interestsChanged) {
+        UpdateEpollRegistration(fileHandle);
+    }
+}
+
+void HAPPlatformFileHandleDeregister(HAPPlatformFileHandleRef fileHandle_)
+{
+    HAPPrecondition(fileHandle_);
+    HAPPlatformFileHandle* fileHandle = (HAPPlatformFileHandle * _Nonnull) fileHandle_;
+
+    HAPPrecondition(fileHandle->prevFileHandle);
+    HAPPrecondition(fileHandle->nextFileHandle);
+
+    if (fileHandle->isAwaitingEvents) {
+        fileHandle->interests.isReadyForReading = false;
+        fileHandle->interests.isReadyForWriting = false;
+        fileHandle->interests.hasErrorConditionPending = false;
+        UpdateEpollRegistration(fileHandle);
+    }
+
+    if (fileHandle == runLoop.fileHandleCursor) {
+        runLoop.fileHandleCursor = fileHandle->nextFileHandle;
+    }
+
+    fileHandle->prevFileHandle->nextFileHandle = fileHandle->nextFileHandle;
+    fileHandle->nextFileHandle->prevFileHandle = fileHandle->prevFileHandle;
+
+    fileHandle->fileDescriptor = -1;
+    fileHandle->interests.isReadyForReading = false;
+    fileHandle->interests.isReadyForWriting = false;
+    fileHandle->interests.hasErrorConditionPending = false;
+    fileHandle->callback = NULL;
+    fileHandle->context = NULL;
+    fileHandle->nextFileHandle = NULL;
+    fileHandle->prevFileHandle = NULL;
+    fileHandle->isAwaitingEvents = false;
+    fileHandle->pendingEvents = 0;
+    HAPPlatformFreeSafe(fileHandle);
+}
+
+/**
+ * Records the events returned by epoll_wait on their file handles.
+ *
+ * - Must be called right after epoll_wait, before any callback runs. Timer and file handle callbacks may deregister
+ *   file handles, which frees them, so the event array must not be accessed afterwards. Deregistering a file handle
+ *   removes it from the list that ProcessSelectedFileHandles walks, together with its pending events.
+ *
+ * @param      events               Events returned by epoll_wait.
+ * @param      numEvents            Number of events.
+ */
+static void RecordSelectedFileHandles(const struct epoll_event* events, size_t numEvents)
+{
+    HAPPrecondition(events);
+
+    for (size_t i = 0; i < numEvents; i++) {
+        HAPPlatformFileHandle* fileHandle = events[i].data.ptr;
+        HAPAssert(fileHandle);
+        fileHandle->pendingEvents = events[i].events;
+    }
+}
+
+/**
+ * Dispatches the events that RecordSelectedFileHandles recorded on the file handles that are still registered.
+ */
+static void ProcessSelectedFileHandles(void)
+{
+    runLoop.fileHandleCursor = runLoop.fileHandles->nextFileHandle;
+    while (runLoop.fileHandleCursor != runLoop.fileHandles) {
+        HAPPlatformFileHandle* fileHandle = runLoop.fileHandleCursor;
+        runLoop.fileHandleCursor = fileHandle->nextFileHandle;
+
+        uint32_t pendingEvents = fileHandle->pendingEvents;
+        fileHandle->pendingEvents = 0;
+        if (pendingEvents && fileHandle->isAwaitingEvents) {
+            HAPAssert(fileHandle->fileDescriptor != -1);
+            if (fileHandle->callback) {
+                // Hang-up and error conditions are reported to readers and writers so that the subsequent
+                // read or write call observes the condition.
+                bool isClosed = (pendingEvents & (EPOLLHUP | EPOLLERR)) != 0;
+
+                HAPPlatformFileHandleEvent fileHandleEvents;
+                fileHandleEvents.isReadyForReading = fileHandle->interests.isReadyForReading &&
+                                                     ((pendingEvents & EPOLLIN) || isClosed);
+                fileHandleEvents.isReadyForWriting = fileHandle->interests.isReadyForWriting &&
+                                                     ((pendingEvents & EPOLLOUT) || isClosed);
+                fileHandleEvents.hasErrorConditionPending = fileHandle->interests.hasErrorConditionPending &&
+                                                            (pendingEvents & EPOLLPRI);
+
+                if (fileHandleEvents.isReadyForReading || fileHandleEvents.isReadyForWriting ||
+                    fileHandleEvents.hasErrorConditionPending) {
+                    // The loopback is not measured as a whole. The callbacks that it invokes are measured individually.
+                    HAPPlatformFileHandleCallback callback = fileHandle->callback;
+                    bool isLoopback = (HAPPlatformFileHandleRef) fileHandle == runLoop.loopbackFileHandle;
+                    HAPTime dispatchStartTime = HAPPlatformRunLoopWatchdogBeginDispatch();
+                    fileHandle->callback((HAPPlatformFileHandleRef) fileHandle, fileHandleEvents, fileHandle->context);
+                    if (!isLoopback) {
+                        HAPPlatformRunLoopWatchdogEndDispatch(
+                                kHAPPlatformRunLoopDispatchSource_FileHandle, (uintptr_t) callback, dispatchStartTime);
+                    }
+                }
+            }
+        }
+    }
+}
+
+static void CloseFileDescriptor(int fileDescriptor)
+{
+    if (fileDescriptor != -1) {
+        HAPLogDebug(&logObject, "close(%d);", fileDescriptor);
+        int e = close(fileDescriptor);
+        if (e) {
+            HAPPlatformLogPOSIXError(kHAPLogType_Error,
+                                     "System call 'close' failed.",
+                                     errno, __func__, HAP_FILE, __LINE__);
+        }
+    }
+}
+
+static void HandleLoopbackFileHandleCallback(HAPPlatformFileHandleRef fileHandle,
+                                             HAPPlatformFileHandleEvent fileHandleEvents,
+                                             void *_Nullable context HAP_UNUSED)
+{
+    HAPAssert(fileHandle);
+    HAPAssert(fileHandle == runLoop.loopbackFileHandle);
+    HAPAssert(fileHandleEvents.isReadyForReading);
+
+    HAPAssert(runLoop.numLoopbackBytes < sizeof runLoop.loopbackBytes);
+
+    ssize_t n;
+    do {
+        n = read(runLoop.loopbackFileDescriptor0,
+                 &runLoop.loopbackBytes[runLoop.numLoopbackBytes],
+                 sizeof runLoop.loopbackBytes - runLoop.numLoopbackBytes);
+    } while (n == -1 && errno == EINTR);
+    if (n == -1 && errno == EAGAIN) {
+        return;
+    }
+
+    if (n < 0) {
+        HAPAssert(n == -1);
+        HAPPlatformLogPOSIXError(kHAPLogType_Error,
+                                 "Loopback read failed.",
+                                 errno, __func__, HAP_FILE, __LINE__);
+        HAPFatalError();
+    }
+    if (n == 0) {
+        HAPLogError(&logObject, "Self-pipe returned EOF.");
+        HAPFatalError();
+    }
+
+    HAPAssert((size_t) n <= sizeof runLoop.loopbackBytes - runLoop.numLoopbackBytes);
+    runLoop.numLoopbackBytes += (size_t) n;
+    HAPPlatformRunLoopCallbacksDispatch(runLoop.loopbackBytes, &runLoop.numLoopbackBytes);
+}
+
+void HAPPlatformRunLoopCreate(const HAPPlatformRunLoopOptions* options)
+{
+    HAPPrecondition(options);
+    HAPPrecondition(options->keyValueStore);
+
+    int e;
+    HAPError err;
+
+    HAPLogDebug(&logObject, "Storage configuration: runLoop = %lu", (unsigned long) sizeof runLoop);
+    HAPLogDebug(&logObject, "Storage configuration: fileHandle = %lu", (unsigned long) sizeof(HAPPlatformFileHandle));
+
+    HAPPlatformRunLoopCommonCreate(options);
+
+    // Open epoll instance.
+    HAPPrecondition(runLoop.epollFileDescriptor == -1);
+    runLoop.epollFileDescriptor = epoll_create1(EPOLL_CLOEXEC);
+    if (runLoop.epollFileDescriptor == -1) {
+        HAPPlatformLogPOSIXError(kHAPLogType_Error,
+                                 "epoll creation failed (log, call 'epoll_create1').",
+                                 errno, __func__, HAP_FILE, __LINE__);
+        HAPFatalError();
+    }
+
+    // Open loopback self-pipe.
+    HAPPrecondition(runLoop.loopbackFileDescriptor0 == -1);
+    HAPPrecondition(runLoop.loopbackFileDescriptor1 == -1);
+    int fileDescriptors[2];
+    e = pipe(fileDescriptors);
+    if (e) {
+        HAPPlatformLogPOSIXError(kHAPLogType_Error,
+                                 "Self-pipe creation failed (log, call 'pipe').",
+                                 errno, __func__, HAP_FILE, __LINE__);
+        HAPFatalError();
+    }
+
+    for (size_t i = 0; i < HAPArrayCount(fileDescriptors); i++) {
+        e = fcntl(fileDescriptors[i], F_SETFL, O_NONBLOCK);
+        if (e == -1) {
+            HAPPlatformLogPOSIXError(kHAPLogType_Error,
+                                     "System call 'fcntl' to set self-pipe options to 'O_NONBLOCK' failed.",
+                                     errno, __func__, HAP_FILE, __LINE__);
+            HAPFatalError();
+        }
+    }
+
+    runLoop.loopbackFileDescriptor0 = fileDescriptors[0];
+    runLoop.loopbackFileDescriptor1 = fileDescriptors[1];
+
+    err = HAPPlatformFileHandleRegister(&runLoop.loopbackFileHandle,
+        runLoop.loopbackFileDescriptor0,
+        (HAPPlatformFileHandleEvent) {
+            .isReadyForReading = true,
+            .isReadyForWriting = false,
+            .hasErrorConditionPending = false
+        },
+        HandleLoopbackFileHandleCallback, NULL);
+    if (err) {
+        HAPAssert(err == kHAPError_OutOfResources);
+        HAPLogError(&logObject, "Failed to register loopback file handle.");
+        HAPFatalError();
+    }
+    HAPAssert(runLoop.loopbackFileHandle);
+
+    runLoop.state = kHAPPlatformRunLoopState_Idle;
+
+    // Issue memory barrier to ensure visibility of write to runLoop.loopbackFileDescriptor1 on other threads.
+    __sync_synchronize();
+}
+
+void HAPPlatformRunLoopRelease(void)
+{
+    HAPPlatformRunLoopCommonRelease();
+
+    if (runLoop.loopbackFileHandle) {
+        HAPPlatformFileHandleDeregister(runLoop.loopbackFileHandle);
+        runLoop.loopbackFileHandle = 0;
+    }
+
+    CloseFileDescriptor(runLoop.loopbackFileDescriptor0);
+    CloseFileDescriptor(runLoop.loopbackFileDescriptor1);
+    CloseFileDescriptor(runLoop.epollFileDescriptor);
+
+    runLoop.loopbackFileDescriptor0 = -1;
+    runLoop.loopbackFileDescriptor1 = -1;
+    runLoop.epollFileDescriptor = -1;
+
+    runLoop.state = kHAPPlatformRunLoopState_Idle;
+
+    // Issue memory barrier to ensure visibility of write to runLoop.loopbackFileDescriptor1 on other threads.
+    __sync_synchronize();
+}
+
+void HAPPlatformRunLoopRun(void)
+{
+    HAPPrecondition(runLoop.state == kHAPPlatformRunLoopState_Idle);
+
+    HAPLogInfo(&logObject, "Entering run loop.");
+    runLoop.state = kHAPPlatformRunLoopState_Running;
+    do {
+        HAPPlatformRunLoopCommonProcessBeforeWaitCallback();
+
+        int timeout = -1;
+
+        HAPTime nextDeadline = HAPPlatformRunLoopCommonGetTimerWakeupTime();
+        if (nextDeadline) {
+            HAPTime now = HAPPlatformClockGetCurrent();
+            HAPTime delta;
+            if (nextDeadline > now) {
+                delta = nextDeadline - now;
+            } else {
+                delta = 0;
+            }
+            timeout = delta > INT_MAX ? INT_MAX : (int) delta;
+        }
+
+        // In virtual time, pending I/O is only polled while timers are registered. Time does not pass while waiting.
+        bool isVirtualTime = HAPPlatformClockIsVirtualTime();
+        if (isVirtualTime && nextDeadline) {
+            timeout = 0;
+        }
+
+        struct epoll_event events[kHAPPlatformRunLoop_MaxEvents];
+        int e = epoll_wait(runLoop.epollFileDescriptor, events, (int) HAPArrayCount(events), timeout);
+        if (e == -1 && errno == EINTR) {
+            continue;
+        }
+        if (e < 0) {
+            HAPPlatformLogPOSIXError(kHAPLogType_Error, "System call 'epoll_wait' failed.",
+                                     errno, __func__, HAP_FILE, __LINE__);
+            HAPFatalError();
+        }
+        RecordSelectedFileHandles(events, (size_t) e);
+
+        // If no I/O is pending, jump straight to the next timer wakeup.
+        if (isVirtualTime && nextDeadline && !e) {
+            HAPTime now = HAPPlatformClockGetCurrent();
+            if (nextDeadline > now) {
+                HAPPlatformClockAdvance(nextDeadline - now);
+                HAPPlatformRunLoopCommonRecordVirtualTimeJump();
+            }
+        }
+
+        HAPPlatformRunLoopCommonProcessExpiredTimers();
+        ProcessSelectedFileHandles();
+    } while (runLoop.state == kHAPPlatformRunLoopState_Running);
+
+    HAPLogInfo(&logObject, "Exiting run loop.");
+    HAPAssert(runLoop.state == kHAPPlatformRunLoopState_Stopping);
+    runLoop.state = kHAPPlatformRunLoopState_Idle;
+}
+
+void HAPPlatformRunLoopStop(void)
+{
+    if (runLoop.state == kHAPPlatformRunLoopState_Running) {
+        runLoop.state = kHAPPlatformRunLoopState_Stopping;
+    }
+}
+
+static void HAPPlatformRunLoopStopCallback(void *_Nullable context HAP_UNUSED, size_t contextSize HAP_UNUSED)
+{
+    HAPPlatformRunLoopStop();
+}
+
+void HAPPlatformRunLoopRequestStop(void)
+{
+    HAPError err = HAPPlatformRunLoopScheduleCallback(HAPPlatformRunLoopStopCallback, NULL, 0);
+    if (err) {
+        HAPLogError(&kHAPLog_Default, "HAPPlatformRunLoopScheduleCallback failed.");
+        HAPFatalError();
+    }
+}
+
+HAPError HAPPlatformRunLoopScheduleCallback(HAPPlatformRunLoopCallback callback,
+                                            void* _Nullable const context,
+                                            size_t contextSize)
+{
+    HAPPrecondition(callback);
+    HAPPrecondition(!contextSize || context);
+
+    if (contextSize > UINT8_MAX) {
+        HAPLogError(&logObject, "Contexts larger than UINT8_MAX are not supported.");
+        return kHAPError_OutOfResources;
+    }
+    if (contextSize + 1 + sizeof callback > PIPE_BUF) {
+        HAPLogError(&logObject, "Context too large (PIPE_BUF).");
+        return kHAPError_OutOfResources;
+    }
+
+    // Serialize event context.
+    // Format: Callback pointer followed by 1 byte context size and context data.
+    // Context is copied to offset 0 when invoking the callback to ensure proper alignment.
+    uint8_t bytes[sizeof callback + 1 + UINT8_MAX];
+    size_t numBytes = 0;
+    HAPRawBufferCopyBytes(&bytes[numBytes], &callback, sizeof callback);
+    numBytes += sizeof callback;
+    bytes[numBytes] = (uint8_t) contextSize;
+    numBytes++;
+    if (context) {
+        HAPRawBufferCopyBytes(&bytes[numBytes], context, contextSize);
+        numBytes += contextSize;
+    }
+    HAPAssert(numBytes <= sizeof bytes);
+
+    // Writes of up to PIPE_BUF bytes to a pipe are atomic, so callbacks may be scheduled from any thread.
+    ssize_t n;
+    do {
+        n = write(runLoop.loopbackFileDescriptor1, bytes, numBytes);
+    } while (n == -1 && errno == EINTR);
+    if (n == -1) {
+        HAPPlatformLogPOSIXError(kHAPLogType_Error,
+                                 "Self-pipe failed to send data (log, call 'write').",
+                                 errno, __func__, HAP_FILE, __LINE__);
+        return kHAPError_Unknown;
+    }
+    HAPAssert((size_t) n == numBytes);
+
+    return kHAPError_None;
+}
@@ -0,0 +1,226 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Copyright (c) 2022 John Buonagurio
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+// Tests of the epoll run loop, run by the host build on a virtual clock.
+
+#include <malloc.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "HAPPlatform.h"
+#include "HAPPlatformClock+Init.h"
+#include "HAPPlatformFileHandle.h"
+#include "HAPPlatformKeyValueStore+Init.h"
+#include "HAPPlatformRunLoop+Init.h"
+
+static const HAPLogObject logObject = { .subsystem = kHAPPlatform_LogSubsystem, .category = "RunLoopTest" };
+
+/**
+ * Key-value store of the run loop. It is only used by the run loop watchdog, which is not enabled.
+ */
+static HAPPlatformKeyValueStore keyValueStore;
+
+/**
+ * Byte with which freed memory is filled while it is quarantined.
+ */
+#define kFreedByte ((uint8_t) 0xA5)
+
+/**
+ * Memory that has been freed while the test watches for writes after free.
+ */
+static struct {
+    bool isEnabled;
+    void* _Nullable blocks[16];
+    size_t numBytes[16];
+    size_t numBlocks;
+} quarantine;
+
+void __real_free(void* _Nullable ptr);
+
+/**
+ * Fills freed memory with a pattern and keeps it from being reused while the quarantine is enabled. The host build
+ * links the test with --wrap=free.
+ */
+void __wrap_free(void* _Nullable ptr)
+{
+    if (!ptr || !quarantine.isEnabled || quarantine.numBlocks == HAPArrayCount(quarantine.blocks)) {
+        __real_free(ptr);
+        return;
+    }
+    size_t numBytes = malloc_usable_size(ptr);
+    memset(ptr, kFreedByte, numBytes);
+    quarantine.blocks[quarantine.numBlocks] = ptr;
+    quarantine.numBytes[quarantine.numBlocks] = numBytes;
+    quarantine.numBlocks++;
+}
+
+/**
+ * Starts to quarantine freed memory.
+ */
+static void EnableQuarantine(void)
+{
+    HAPPrecondition(!quarantine.isEnabled);
+    quarantine.isEnabled = true;
+}
+
+/**
+ * Checks that the quarantined memory has not been written to, and frees it.
+ *
+ * @return Number of blocks that were quarantined.
+ */
+HAP_RESULT_USE_CHECK
+static size_t ReleaseQuarantine(void)
+{
+    HAPPrecondition(quarantine.isEnabled);
+
+    size_t numBlocks = quarantine.numBlocks;
+    for (size_t i = 0; i < numBlocks; i++) {
+        const uint8_t* bytes = quarantine.blocks[i];
+        for (size_t j = 0; j < quarantine.numBytes[i]; j++) {
+            HAPAssert(bytes[j] == kFreedByte);
+        }
+        __real_free(quarantine.blocks[i]);
+    }
+    HAPRawBufferZero(&quarantine, sizeof quarantine);
+    return numBlocks;
+}
+
+/**
+ * A pipe with a file handle on its read end.
+ */
+typedef struct {
+    int fileDescriptors[2];
+    HAPPlatformFileHandleRef fileHandle;
+    size_t numCallbacks;
+} Pipe;
+
+static void HandleFileHandleEvent(
+        HAPPlatformFileHandleRef fileHandle,
+        HAPPlatformFileHandleEvent fileHandleEvents,
+        void* _Nullable context)
+{
+    HAPPrecondition(context);
+    Pipe* pipe_ = context;
+    HAPAssert(fileHandle == pipe_->fileHandle);
+    HAPAssert(fileHandleEvents.isReadyForReading);
+
+    pipe_->numCallbacks++;
+    uint8_t byte;
+    ssize_t n = read(pipe_->fileDescriptors[0], &byte, sizeof byte);
+    HAPAssert(n == 1);
+}
+
+/**
+ * Opens a pipe and registers a file handle that waits for bytes on its read end.
+ */
+static void OpenPipe(Pipe* pipe_)
+{
+    HAPPrecondition(pipe_);
+
+    HAPRawBufferZero(pipe_, sizeof *pipe_);
+    int e = pipe(pipe_->fileDescriptors);
+    HAPAssert(!e);
+    HAPError err = HAPPlatformFileHandleRegister(
+            &pipe_->fileHandle,
+            pipe_->fileDescriptors[0],
+            (HAPPlatformFileHandleEvent) { .isReadyForReading = true },
+            HandleFileHandleEvent,
+            pipe_);
+    HAPAssert(!err);
+}
+
+/**
+ * Deregisters the file handle of a pipe and closes the pipe.
+ */
+static void ClosePipe(Pipe* pipe_)
+{
+    HAPPrecondition(pipe_);
+
+    if (pipe_->fileHandle) {
+        HAPPlatformFileHandleDeregister(pipe_->fileHandle);
+        pipe_->fileHandle = 0;
+    }
+    close(pipe_->fileDescriptors[0]);
+    close(pipe_->fileDescriptors[1]);
+}
+
+static void StopRunLoop(HAPPlatformTimerRef timer, void* _Nullable context)
+{
+    (void) timer;
+    (void) context;
+    HAPPlatformRunLoopStop();
+}
+
+/**
+ * Runs the run loop for a while.
+ *
+ * @param      duration             Time to run the run loop.
+ */
+static void RunFor(HAPTime duration)
+{
+    HAPPlatformTimerRef timer;
+    HAPError err = HAPPlatformTimerRegister(&timer, HAPPlatformClockGetCurrent() + duration, StopRunLoop, NULL);
+    HAPAssert(!err);
+    HAPPlatformRunLoopRun();
+}
+
+static Pipe pipes[2];
+
+static void ClosePipes(HAPPlatformTimerRef timer, void* _Nullable context)
+{
+    (void) timer;
+    (void) context;
+
+    for (size_t i = 0; i < HAPArrayCount(pipes); i++) {
+        ClosePipe(&pipes[i]);
+    }
+}
+
+/**
+ * A timer that expires in the same run loop iteration as file handle events may deregister the file handles. Their
+ * events are then dropped without accessing the freed file handles.
+ */
+static void TestCloseFileHandlesWithPendingEvents(void)
+{
+    HAPLogInfo(&logObject, "%s", __func__);
+
+    for (size_t i = 0; i < HAPArrayCount(pipes); i++) {
+        OpenPipe(&pipes[i]);
+        ssize_t n = write(pipes[i].fileDescriptors[1], "x", 1);
+        HAPAssert(n == 1);
+    }
+    HAPPlatformTimerRef timer;
+    HAPError err = HAPPlatformTimerRegister(&timer, HAPPlatformClockGetCurrent(), ClosePipes, NULL);
+    HAPAssert(!err);
+
+    EnableQuarantine();
+    RunFor(10 * HAPMillisecond);
+    HAPAssert(ReleaseQuarantine() >= HAPArrayCount(pipes));
+    for (size_t i = 0; i < HAPArrayCount(pipes); i++) {
+        HAPAssert(!pipes[i].numCallbacks);
+    }
+
+    // File handles that are registered later receive their events.
+    OpenPipe(&pipes[0]);
+    ssize_t n = write(pipes[0].fileDescriptors[1], "x", 1);
+    HAPAssert(n == 1);
+    RunFor(10 * HAPMillisecond);
+    HAPAssert(pipes[0].numCallbacks == 1);
+    ClosePipe(&pipes[0]);
+}
+
+int main()
+{
+    HAPPlatformClockEnableVirtualTime(HAPPlatformClockGetCurrent());
+    HAPPlatformRunLoopCreate(&(const HAPPlatformRunLoopOptions) { .keyValueStore = &keyValueStore });
+
+    TestCloseFileHandlesWithPendingEvents();
+
+    HAPPlatformRunLoopRelease();
+    return 0;
+}
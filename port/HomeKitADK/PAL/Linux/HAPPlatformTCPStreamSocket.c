@@ -0,0 +1,337 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Copyright (c) 2022 John Buonagurio
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "HAPPlatform+Init.h"
+#include "HAPPlatformLog+Init.h"
+#include "HAPPlatformTCPStreamSocket.h"
+
+static const HAPLogObject logObject = { .subsystem = kHAPPlatform_LogSubsystem, .category = "TCPStreamManager" };
+
+/**
+ * Makes a socket descriptor nonblocking.
+ *
+ * @param      sd                   Socket descriptor.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_Unknown        If the nonblocking flag could not be set.
+ */
+static HAPError SetNonblocking(int sd)
+{
+    HAPLogDebug(&logObject, "fcntl(%d, F_SETFL, O_NONBLOCK);", sd);
+    int flags = fcntl(sd, F_GETFL, 0);
+    if (flags == -1 || fcntl(sd, F_SETFL, flags | O_NONBLOCK) == -1) {
+        HAPPlatformLogPOSIXError(kHAPLogType_Error,
+                                 "System call 'fcntl' to set socket options to 'O_NONBLOCK' failed.",
+                                 errno, __func__, HAP_FILE, __LINE__);
+        return kHAPError_Unknown;
+    }
+    return kHAPError_None;
+}
+
+/**
+ * Disables coalescing of small segments on a socket.
+ *
+ * @param      sd                   Socket descriptor.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_Unknown        If an error occurred while disabling coalescing of small segments.
+ */
+static HAPError SetNodelay(int sd)
+{
+    int v = 1;
+    HAPLogBufferDebug(&logObject, &v, sizeof v, "setsockopt(%d, IPPROTO_TCP, TCP_NODELAY, <buffer>);", sd);
+    int e = setsockopt(sd, IPPROTO_TCP, TCP_NODELAY, &v, sizeof v);
+    if (e != 0) {
+        HAPPlatformLogPOSIXError(kHAPLogType_Error,
+                                 "System call 'setsockopt' to set socket options to 'TCP_NODELAY' failed.",
+                                 errno, __func__, HAP_FILE, __LINE__);
+        return kHAPError_Unknown;
+    }
+    return kHAPError_None;
+}
+
+/**
+ * Enables TCP keepalives on a socket so that a peer that has stopped responding is detected within a bounded time.
+ *
+ * @param      sd                   Socket descriptor.
+ * @param      timeout              Time after which the connection is reset if the peer does not respond.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_Unknown        If an error occurred while enabling TCP keepalives.
+ */
+static HAPError SetKeepAlive(int sd, HAPTime timeout)
+{
+    HAPPrecondition(timeout);
+
+    HAPPlatformTCPStreamSocketKeepAlive keepAlive;
+    HAPPlatformTCPStreamSocketGetKeepAlive(timeout, &keepAlive);
+    const struct {
+        int level;
+        int name;
+        const char* description;
+        int value;
+    } options[] = {
+        { SOL_SOCKET, SO_KEEPALIVE, "SOL_SOCKET, SO_KEEPALIVE", 1 },
+        { IPPROTO_TCP, TCP_KEEPIDLE, "IPPROTO_TCP, TCP_KEEPIDLE", (int) (keepAlive.idleTime / HAPSecond) },
+        { IPPROTO_TCP, TCP_KEEPINTVL, "IPPROTO_TCP, TCP_KEEPINTVL", (int) (keepAlive.probeInterval / HAPSecond) },
+        { IPPROTO_TCP, TCP_KEEPCNT, "IPPROTO_TCP, TCP_KEEPCNT", keepAlive.numProbes },
+        // Also bounds the time that sent bytes may remain unacknowledged. Takes precedence over the probe count.
+        { IPPROTO_TCP, TCP_USER_TIMEOUT, "IPPROTO_TCP, TCP_USER_TIMEOUT", (int) HAPMin(timeout, (HAPTime) INT32_MAX) },
+    };
+    for (size_t i = 0; i < HAPArrayCount(options); i++) {
+        HAPLogBufferDebug(&logObject, &options[i].value, sizeof options[i].value,
+                          "setsockopt(%d, %s, <buffer>);", sd, options[i].description);
+        int e = setsockopt(sd, options[i].level, options[i].name, &options[i].value, sizeof options[i].value);
+        if (e != 0) {
+            HAPPlatformLogPOSIXError(kHAPLogType_Error,
+                                     "System call 'setsockopt' to enable TCP keepalives failed.",
+                                     errno, __func__, HAP_FILE, __LINE__);
+            return kHAPError_Unknown;
+        }
+    }
+    return kHAPError_None;
+}
+
+void HAPPlatformTCPStreamSocketOpenListener(
+        const char* interfaceName,
+        HAPNetworkPort port,
+        int* fileDescriptor_,
+        uint32_t* interfaceIndex_,
+        HAPNetworkPort* listenerPort)
+{
+    HAPPrecondition(interfaceName);
+    HAPPrecondition(fileDescriptor_);
+    HAPPrecondition(interfaceIndex_);
+    HAPPrecondition(listenerPort);
+
+    HAPError err;
+    int e;
+
+    uint32_t interfaceIndex;
+    if (interfaceName[0]) {
+        unsigned int i = if_nametoindex(interfaceName);
+        if (i == 0) {
+            HAPPlatformLogPOSIXError(kHAPLogType_Error,
+                                     "Mapping the local network interface name to its corresponding index failed.",
+                                     errno, __func__, HAP_FILE, __LINE__);
+            HAPFatalError();
+        }
+        interfaceIndex = (uint32_t) i;
+    } else {
+        interfaceIndex = 0;
+    }
+
+    int fileDescriptor = socket(PF_INET6, SOCK_STREAM | SOCK_CLOEXEC, IPPROTO_TCP);
+    if (fileDescriptor == -1) {
+        HAPPlatformLogPOSIXError(kHAPLogType_Error,
+                                 "Failed to open TCP stream listener socket.",
+                                 errno, __func__, HAP_FILE, __LINE__);
+        HAPFatalError();
+    }
+
+    int v = 1;
+    HAPLogBufferDebug(&logObject, &v, sizeof v, "setsockopt(%d, SOL_SOCKET, SO_REUSEADDR, <buffer>);", fileDescriptor);
+    e = setsockopt(fileDescriptor, SOL_SOCKET, SO_REUSEADDR, &v, sizeof v);
+    if (e != 0) {
+        HAPPlatformLogPOSIXError(kHAPLogType_Error,
+                                 "System call 'setsockopt' with option 'SO_REUSEADDR' on TCP stream listener socket failed.",
+                                 errno, __func__, HAP_FILE, __LINE__);
+    }
+
+    // Accept IPv4 clients through IPv4-mapped IPv6 addresses regardless of the system default.
+    v = 0;
+    HAPLogBufferDebug(&logObject, &v, sizeof v, "setsockopt(%d, IPPROTO_IPV6, IPV6_V6ONLY, <buffer>);", fileDescriptor);
+    e = setsockopt(fileDescriptor, IPPROTO_IPV6, IPV6_V6ONLY, &v, sizeof v);
+    if (e != 0) {
+        HAPPlatformLogPOSIXError(kHAPLogType_Error,
+                                 "System call 'setsockopt' with option 'IPV6_V6ONLY' on TCP stream listener socket failed.",
+                                 errno, __func__, HAP_FILE, __LINE__);
+    }
+
+    if (interfaceIndex) {
+        HAPLogDebug(&logObject, "setsockopt(%d, SOL_SOCKET, SO_BINDTODEVICE, %s);", fileDescriptor, interfaceName);
+        e = setsockopt(fileDescriptor, SOL_SOCKET, SO_BINDTODEVICE,
+                       interfaceName, (socklen_t) HAPStringGetNumBytes(interfaceName));
+        if (e != 0) {
+            HAPPlatformLogPOSIXError(kHAPLogType_Error,
+                                     "System call 'setsockopt' with option 'SO_BINDTODEVICE' on TCP stream listener socket failed.",
+                                     errno, __func__, HAP_FILE, __LINE__);
+            HAPFatalError();
+        }
+    }
+    HAPLogDebug(&logObject, "TCP stream listener interface index: %u", (unsigned int) interfaceIndex);
+
+    struct sockaddr_in6 sin6;
+    HAPRawBufferZero(&sin6, sizeof sin6);
+    sin6.sin6_family = AF_INET6;
+    sin6.sin6_port = htons(port);
+    sin6.sin6_addr = in6addr_any;
+
+    HAPLogBufferDebug(&logObject, &sin6, sizeof sin6, "bind(%d, <buffer>);", fileDescriptor);
+    e = bind(fileDescriptor, (const struct sockaddr*) &sin6, sizeof sin6);
+    if (e != 0) {
+        HAPPlatformLogPOSIXError(kHAPLogType_Error,
+                                 "System call 'bind' on TCP stream listener socket failed.",
+                                 errno, __func__, HAP_FILE, __LINE__);
+        HAPFatalError();
+    }
+
+    if (!port) {
+        socklen_t sin6_len = sizeof sin6;
+        HAPRawBufferZero(&sin6, sizeof sin6);
+        e = getsockname(fileDescriptor, (struct sockaddr*) &sin6, &sin6_len);
+        if (e != 0) {
+            HAPPlatformLogPOSIXError(kHAPLogType_Error,
+                                     "System call 'getsockname' on TCP stream listener socket failed.",
+                                     errno, __func__, HAP_FILE, __LINE__);
+            HAPFatalError();
+        }
+        HAPAssert(sin6.sin6_port);
+        port = ntohs(sin6.sin6_port);
+    }
+    HAPLogDebug(&logObject, "TCP stream listener port: %u.", port);
+
+    err = SetNonblocking(fileDescriptor);
+    if (err) {
+        HAPFatalError();
+    }
+
+    HAPLogDebug(&logObject, "listen(%d, 64);", fileDescriptor);
+    e = listen(fileDescriptor, 64);
+    if (e != 0) {
+        HAPPlatformLogPOSIXError(kHAPLogType_Error,
+                                 "System call 'listen' on TCP stream listener socket failed.",
+                                 errno, __func__, HAP_FILE, __LINE__);
+        HAPFatalError();
+    }
+
+    *fileDescriptor_ = fileDescriptor;
+    *interfaceIndex_ = interfaceIndex;
+    *listenerPort = port;
+}
+
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformTCPStreamSocketAccept(int listenerFileDescriptor, HAPTime deadPeerTimeout, int* fileDescriptor_)
+{
+    HAPPrecondition(listenerFileDescriptor != -1);
+    HAPPrecondition(fileDescriptor_);
+
+    HAPLogDebug(&logObject, "accept(%d, NULL, NULL);", listenerFileDescriptor);
+    int fileDescriptor = accept(listenerFileDescriptor, NULL, NULL);
+    if (fileDescriptor == -1) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR && errno != ECONNABORTED && errno != EPROTO) {
+            HAPPlatformLogPOSIXError(kHAPLogType_Error,
+                                     "System call 'accept' on TCP stream listener socket failed.",
+                                     errno, __func__, HAP_FILE, __LINE__);
+            return kHAPError_Unknown;
+        }
+
+        HAPLogDebug(&logObject, "System call 'accept' on TCP stream listener socket is busy.");
+        return kHAPError_Busy;
+    }
+
+    // Configure socket.
+    (void) fcntl(fileDescriptor, F_SETFD, FD_CLOEXEC);
+    (void) SetNonblocking(fileDescriptor);
+    (void) SetNodelay(fileDescriptor);
+    if (deadPeerTimeout) {
+        (void) SetKeepAlive(fileDescriptor, deadPeerTimeout);
+    }
+
+    *fileDescriptor_ = fileDescriptor;
+    return kHAPError_None;
+}
+
+void HAPPlatformTCPStreamSocketShutdownOutput(int fileDescriptor)
+{
+    HAPPrecondition(fileDescriptor != -1);
+
+    HAPLogDebug(&logObject, "shutdown(%d, SHUT_WR);", fileDescriptor);
+    int e = shutdown(fileDescriptor, SHUT_WR);
+    if (e != 0 && errno != ENOTCONN) {
+        HAPPlatformLogPOSIXError(kHAPLogType_Error,
+                                 "System call 'shutdown' on TCP stream socket failed.",
+                                 errno, __func__, HAP_FILE, __LINE__);
+    }
+}
+
+void HAPPlatformTCPStreamSocketClose(int fileDescriptor)
+{
+    HAPPrecondition(fileDescriptor != -1);
+
+    int e;
+
+    HAPLogDebug(&logObject, "shutdown(%d, SHUT_RDWR);", fileDescriptor);
+    e = shutdown(fileDescriptor, SHUT_RDWR);
+    if (e != 0 && errno != ENOTCONN) {
+        HAPPlatformLogPOSIXError(kHAPLogType_Error,
+                                 "System call 'shutdown' on TCP stream socket failed.",
+                                 errno, __func__, HAP_FILE, __LINE__);
+    }
+
+    HAPLogDebug(&logObject, "close(%d);", fileDescriptor);
+    e = close(fileDescriptor);
+    if (e != 0) {
+        HAPPlatformLogPOSIXError(kHAPLogType_Error,
+                                 "System call 'close' on TCP stream socket failed.",
+                                 errno, __func__, HAP_FILE, __LINE__);
+    }
+}
+
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformTCPStreamSocketSend(int fileDescriptor, const void* bytes, size_t maxBytes, size_t* numBytes)
+{
+    HAPPrecondition(fileDescriptor != -1);
+    HAPPrecondition(bytes);
+    HAPPrecondition(numBytes);
+
+    // MSG_NOSIGNAL: Report a closed peer as EPIPE instead of raising SIGPIPE.
+    ssize_t n;
+    do {
+        n = send(fileDescriptor, bytes, maxBytes, MSG_NOSIGNAL);
+    } while ((n == -1) && (errno == EINTR));
+    if (n == -1) {
+        *numBytes = 0;
+        return (errno == EAGAIN || errno == EWOULDBLOCK) ? kHAPError_Busy : kHAPError_Unknown;
+    }
+
+    HAPAssert(n >= 0);
+    HAPAssert((size_t) n <= maxBytes);
+    *numBytes = (size_t) n;
+    return kHAPError_None;
+}
+
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformTCPStreamSocketReceive(int fileDescriptor, void* bytes, size_t maxBytes, size_t* numBytes)
+{
+    HAPPrecondition(fileDescriptor != -1);
+    HAPPrecondition(bytes);
+    HAPPrecondition(numBytes);
+
+    ssize_t n;
+    do {
+        n = recv(fileDescriptor, bytes, maxBytes, 0);
+    } while ((n == -1) && (errno == EINTR));
+    if (n == -1) {
+        *numBytes = 0;
+        return (errno == EAGAIN || errno == EWOULDBLOCK) ? kHAPError_Busy : kHAPError_Unknown;
+    }
+
+    HAPAssert(n >= 0);
+    HAPAssert((size_t) n <= maxBytes);
+    *numBytes = (size_t) n;
+    return kHAPError_None;
+}
@@ -0,0 +1,278 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Copyright (c) 2022 John Buonagurio
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "HAPPlatform.h"
+#include "HAPPlatformClock+Init.h"
+#include "HAPPlatformLog+Init.h"
+#include "HAPPlatformRunLoop+Init.h"
+#include "HAPPlatformWorker+Init.h"
+
+static const HAPLogObject logObject = { .subsystem = kHAPPlatform_LogSubsystem, .category = "Worker" };
+
+/**
+ * Job header. Allocated from the run loop payload pool and followed by the job context.
+ */
+typedef struct {
+    /** Function to call on the worker thread. */
+    HAPPlatformWorkerCallback job;
+
+    /** Function to call on the run loop after the job has finished. */
+    HAPPlatformWorkerCallback completion;
+
+    /** Size of the job context. */
+    size_t contextSize;
+
+    /** Time at which the job was submitted. */
+    HAPTime submitTime;
+} WorkerJob;
+HAP_STATIC_ASSERT(sizeof(WorkerJob) % 8 == 0, WorkerJob_PreservesAlignment);
+
+static struct {
+    /** Whether the worker thread has been started. */
+    bool isStarted;
+
+    /** Whether the worker thread has been requested to exit. */
+    bool isStopRequested;
+
+    /** Worker thread. */
+    pthread_t thread;
+
+    /** Nice value increment of the worker thread. */
+    int niceIncrement;
+
+    /** Mutex protecting the job queue. */
+    pthread_mutex_t mutex;
+
+    /** Condition that is signaled when a job is queued or the worker thread is requested to exit. */
+    pthread_cond_t condition;
+
+    /** Ring buffer of submitted jobs. */
+    WorkerJob* _Nullable* _Nullable queue;
+
+    /** Capacity of the job queue. */
+    size_t maxJobs;
+
+    /** Index of the oldest queued job. */
+    size_t head;
+
+    /** Number of queued jobs. */
+    size_t numQueuedJobs;
+
+    /** Number of jobs whose completion has not been reported yet. */
+    size_t numPendingJobs;
+
+    /** Statistics. */
+    HAPPlatformWorkerStatistics statistics;
+} worker = { .isStarted = false,
+             .mutex = PTHREAD_MUTEX_INITIALIZER,
+             .condition = PTHREAD_COND_INITIALIZER,
+             .queue = NULL };
+
+static void* GetJobContext(WorkerJob* job)
+{
+    HAPPrecondition(job);
+
+    return (uint8_t*) job + sizeof *job;
+}
+
+static void HandleJobCompletion(void* _Nullable context, size_t contextSize)
+{
+    HAPPrecondition(context);
+    HAPPrecondition(contextSize >= sizeof(WorkerJob));
+
+    WorkerJob* job = context;
+    HAPAssert(contextSize == sizeof *job + job->contextSize);
+
+    HAPTime turnaroundTime = HAPPlatformClockGetCurrent() - job->submitTime;
+    worker.statistics.numJobsCompleted++;
+    worker.statistics.totalTurnaroundTime += turnaroundTime;
+    if (turnaroundTime > worker.statistics.maxTurnaroundTime) {
+        worker.statistics.maxTurnaroundTime = turnaroundTime;
+    }
+    HAPAssert(worker.numPendingJobs);
+    worker.numPendingJobs--;
+
+    job->completion(GetJobContext(job), job->contextSize);
+}
+
+static void RunJob(WorkerJob* job)
+{
+    HAPPrecondition(job);
+
+    job->job(GetJobContext(job), job->contextSize);
+
+    // The job header and context are passed back to the run loop without copying.
+    HAPError err = HAPPlatformRunLoopSchedulePayloadCallback(HandleJobCompletion, job, sizeof *job + job->contextSize);
+    if (err) {
+        HAPAssert(err == kHAPError_Unknown);
+        HAPLogError(&logObject, "Failed to report job completion.");
+        HAPFatalError();
+    }
+}
+
+static void* _Nullable WorkerThread(void* _Nullable arg HAP_UNUSED)
+{
+    // On Linux, the nice value is a per-thread attribute.
+    errno = 0;
+    if (nice(worker.niceIncrement) == -1 && errno) {
+        int _errno = errno;
+        HAPPlatformLogPOSIXError(kHAPLogType_Error, "nice failed.", _errno, __func__, HAP_FILE, __LINE__);
+    }
+
+    for (;;) {
+        int e = pthread_mutex_lock(&worker.mutex);
+        HAPAssert(!e);
+        while (!worker.numQueuedJobs && !worker.isStopRequested) {
+            e = pthread_cond_wait(&worker.condition, &worker.mutex);
+            HAPAssert(!e);
+        }
+        if (worker.isStopRequested) {
+            e = pthread_mutex_unlock(&worker.mutex);
+            HAPAssert(!e);
+            break;
+        }
+        WorkerJob* job = HAPNonnull(HAPNonnull(worker.queue)[worker.head]);
+        worker.head = (worker.head + 1) % worker.maxJobs;
+        worker.numQueuedJobs--;
+        e = pthread_mutex_unlock(&worker.mutex);
+        HAPAssert(!e);
+
+        RunJob(job);
+    }
+
+    return NULL;
+}
+
+void HAPPlatformWorkerCreate(const HAPPlatformWorkerOptions* options)
+{
+    HAPPrecondition(options);
+    HAPPrecondition(options->maxJobs);
+    HAPPrecondition(!worker.isStarted);
+
+    HAPLogDebug(&logObject, "Storage configuration: worker = %lu", (unsigned long) sizeof worker);
+    HAPLogDebug(&logObject, "Storage configuration: maxJobs = %lu", (unsigned long) options->maxJobs);
+
+    worker.queue = calloc(options->maxJobs, sizeof(WorkerJob*));
+    if (!worker.queue) {
+        HAPLogError(&logObject, "Failed to allocate job queue.");
+        HAPFatalError();
+    }
+    worker.maxJobs = options->maxJobs;
+    worker.head = 0;
+    worker.numQueuedJobs = 0;
+    worker.numPendingJobs = 0;
+    worker.niceIncrement = options->niceIncrement;
+    worker.isStopRequested = false;
+    HAPRawBufferZero(&worker.statistics, sizeof worker.statistics);
+
+    int e = pthread_create(&worker.thread, NULL, WorkerThread, NULL);
+    if (e) {
+        HAPPlatformLogPOSIXError(kHAPLogType_Error, "pthread_create failed.", e, __func__, HAP_FILE, __LINE__);
+        HAPFatalError();
+    }
+    worker.isStarted = true;
+}
+
+void HAPPlatformWorkerRelease(void)
+{
+    if (!worker.isStarted) {
+        return;
+    }
+
+    int e = pthread_mutex_lock(&worker.mutex);
+    HAPAssert(!e);
+    worker.isStopRequested = true;
+    e = pthread_cond_signal(&worker.condition);
+    HAPAssert(!e);
+    e = pthread_mutex_unlock(&worker.mutex);
+    HAPAssert(!e);
+
+    // A running job is finished before the thread exits. Its completion remains scheduled on the run loop.
+    e = pthread_join(worker.thread, NULL);
+    HAPAssert(!e);
+    worker.isStarted = false;
+
+    for (size_t i = 0; i < worker.numQueuedJobs; i++) {
+        HAPPlatformRunLoopReleasePayload(HAPNonnull(HAPNonnull(worker.queue)[(worker.head + i) % worker.maxJobs]));
+    }
+    free(worker.queue);
+    worker.queue = NULL;
+    worker.numPendingJobs -= worker.numQueuedJobs;
+    worker.numQueuedJobs = 0;
+}
+
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformWorkerSubmit(
+        HAPPlatformWorkerCallback job,
+        HAPPlatformWorkerCallback completion,
+        const void* _Nullable context,
+        size_t contextSize)
+{
+    HAPPrecondition(job);
+    HAPPrecondition(completion);
+    HAPPrecondition(!contextSize || context);
+    HAPPrecondition(worker.isStarted);
+
+    worker.statistics.numJobsSubmitted++;
+
+    WorkerJob* workerJob = HAPPlatformRunLoopAllocatePayload(sizeof *workerJob + contextSize);
+    if (!workerJob) {
+        HAPLog(&logObject, "Cannot submit job: Payload pool exhausted.");
+        worker.statistics.numJobsRejected++;
+        return kHAPError_OutOfResources;
+    }
+    workerJob->job = job;
+    workerJob->completion = completion;
+    workerJob->contextSize = contextSize;
+    workerJob->submitTime = HAPPlatformClockGetCurrent();
+    if (contextSize) {
+        HAPRawBufferCopyBytes(GetJobContext(workerJob), HAPNonnullVoid(context), contextSize);
+    }
+
+    // In virtual time, jobs run synchronously so that their completions are reported in a reproducible order.
+    if (HAPPlatformClockIsVirtualTime()) {
+        RunJob(workerJob);
+    } else {
+        int e = pthread_mutex_lock(&worker.mutex);
+        HAPAssert(!e);
+        bool isQueued = worker.numQueuedJobs < worker.maxJobs;
+        if (isQueued) {
+            HAPNonnull(worker.queue)[(worker.head + worker.numQueuedJobs) % worker.maxJobs] = workerJob;
+            worker.numQueuedJobs++;
+            e = pthread_cond_signal(&worker.condition);
+            HAPAssert(!e);
+        }
+        e = pthread_mutex_unlock(&worker.mutex);
+        HAPAssert(!e);
+
+        if (!isQueued) {
+            HAPLog(&logObject, "Cannot submit job: Job queue full.");
+            HAPPlatformRunLoopReleasePayload(workerJob);
+            worker.statistics.numJobsRejected++;
+            return kHAPError_OutOfResources;
+        }
+    }
+
+    worker.numPendingJobs++;
+    if (worker.numPendingJobs > worker.statistics.maxPendingJobs) {
+        worker.statistics.maxPendingJobs = worker.numPendingJobs;
+    }
+    return kHAPError_None;
+}
+
+void HAPPlatformWorkerGetStatistics(HAPPlatformWorkerStatistics* statistics)
+{
+    HAPPrecondition(statistics);
+
+    *statistics = worker.statistics;
+}
@@ -0,0 +1,106 @@
+// Copyright (c) 2022 John Buonagurio
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+#ifndef SIMPLELINK_FS_INIT_H
+#define SIMPLELINK_FS_INIT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "HAPPlatform.h"
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull begin
+#endif
+
+/**@file
+ * SimpleLink serial flash file system emulation for development hosts.
+ *
+ * - Each SimpleLink file is stored as a host file below the root directory. File names containing '/' are mapped
+ *   to subdirectories.
+ * - Files created with SL_FS_CREATE_FAILSAFE are written to a shadow copy which replaces the original on
+ *   sl_FsClose, matching the commit semantics of the serial flash file system.
+ * - Files opened with SL_FS_WRITE keep their content. Writes to non-failsafe files are made in place, and only the
+ *   blocks spanned by the writes are counted as programmed.
+ * - Maximum file size and write counter are stored in a header in front of the file content.
+ * - On a virtual clock, each command can be made to take time, to measure the flash access of code under test.
+ *
+ * **Example**
+
+   @code{.c}
+   SimpleLinkFSCreate(&(const SimpleLinkFSOptions) { .rootDirectory = ".fanboard" });
+   @endcode
+ */
+
+/**
+ * Initialization options.
+ */
+typedef struct {
+    /**
+     * Host directory below which the files are stored. Created if it does not exist.
+     */
+    const char* rootDirectory;
+
+    /**
+     * Time by which each successful command advances the virtual clock. 0 if the emulation takes no time.
+     *
+     * - Requires virtual time, see HAPPlatformClockEnableVirtualTime.
+     */
+    HAPTime commandLatency;
+
+    /**
+     * Additional time by which a close that commits written data advances the virtual clock.
+     *
+     * - Requires virtual time, see HAPPlatformClockEnableVirtualTime.
+     */
+    HAPTime commitLatency;
+} SimpleLinkFSOptions;
+
+/**
+ * File system operation statistics.
+ */
+typedef struct {
+    uint64_t numOpens;            /**< Number of successful sl_FsOpen calls. */
+    uint64_t numReads;            /**< Number of successful sl_FsRead calls. */
+    uint64_t numWrites;           /**< Number of successful sl_FsWrite calls. */
+    uint64_t numDeletes;          /**< Number of successful sl_FsDel calls. */
+    uint64_t numGetInfos;         /**< Number of successful sl_FsGetInfo calls. */
+    uint64_t numGetFileLists;     /**< Number of successful sl_FsGetFileList calls. */
+    uint64_t numBytesRead;        /**< Number of content bytes read. */
+    uint64_t numBytesRequested;   /**< Number of content bytes requested by sl_FsRead calls. */
+    uint64_t numBytesWritten;     /**< Number of content bytes written. */
+    uint64_t numBlocksWritten;    /**< Number of flash blocks programmed when committing written files. */
+} SimpleLinkFSStatistics;
+
+/**
+ * Initializes the file system emulation.
+ *
+ * @param      options              Initialization options.
+ */
+void SimpleLinkFSCreate(const SimpleLinkFSOptions* options);
+
+/**
+ * Gets the file system operation statistics.
+ *
+ * @param[out] statistics           Statistics.
+ */
+void SimpleLinkFSGetStatistics(SimpleLinkFSStatistics* statistics);
+
+/**
+ * Resets the file system operation statistics.
+ */
+void SimpleLinkFSResetStatistics(void);
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull end
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
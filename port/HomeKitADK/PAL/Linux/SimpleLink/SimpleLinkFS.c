@@ -0,0 +1,706 @@
+// Copyright (c) 2022 John Buonagurio
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <ti/drivers/net/wifi/simplelink.h>
+
+#include "HAPPlatform.h"
+#include "HAPPlatformClock+Init.h"
+#include "HAPPlatformLog+Init.h"
+#include "SimpleLinkFS+Init.h"
+
+static const HAPLogObject logObject = { .subsystem = kHAPPlatform_LogSubsystem, .category = "SimpleLinkFS" };
+
+/**
+ * Maximum number of concurrently open files.
+ */
+#define kSimpleLinkFS_MaxOpenFiles ((size_t) 8)
+
+/**
+ * Magic number identifying the file header.
+ */
+#define kSimpleLinkFS_Magic ((uint32_t) 0x53464C53) // 'SLFS'
+
+/**
+ * Suffix of shadow copies used for failsafe files.
+ */
+#define kSimpleLinkFS_ShadowSuffix "~"
+
+/**
+ * File header, stored in front of the file content.
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t maxSize;
+    uint32_t flags;
+    uint32_t writeCounter;
+} FileHeader;
+
+/**
+ * Open file.
+ */
+typedef struct {
+    bool isOpen;
+    bool isWritable;
+    bool isFailsafe;
+    bool didWrite;
+    bool isInPlace;
+    uint32_t minWriteOffset;
+    uint32_t maxWriteOffset;
+    int fileDescriptor;
+    FileHeader header;
+    char path[PATH_MAX];
+    char shadowPath[PATH_MAX];
+} OpenFile;
+
+static struct {
+    char rootDirectory[PATH_MAX];
+    OpenFile files[kSimpleLinkFS_MaxOpenFiles];
+    SimpleLinkFSStatistics statistics;
+    HAPTime commandLatency;
+    HAPTime commitLatency;
+} fs;
+
+/**
+ * Advances the virtual clock by the time that a command takes.
+ *
+ * @param      latency              Time that the command takes.
+ */
+static void SimulateLatency(HAPTime latency)
+{
+    if (latency) {
+        HAPPlatformClockAdvance(latency);
+    }
+}
+
+/**
+ * Creates all missing directories of a path, excluding the last path component.
+ *
+ * @param      path                 Path.
+ *
+ * @return 0                        If successful.
+ * @return -1                       Otherwise. errno is set.
+ */
+static int CreateParentDirectories(const char* path)
+{
+    char directory[PATH_MAX];
+    size_t numBytes = HAPStringGetNumBytes(path);
+    HAPAssert(numBytes < sizeof directory);
+    HAPRawBufferCopyBytes(directory, path, numBytes + 1);
+
+    for (char* c = &directory[1]; *c; c++) {
+        if (*c != '/') {
+            continue;
+        }
+        *c = '\0';
+        if (mkdir(directory, 0700) == -1 && errno != EEXIST) {
+            return -1;
+        }
+        *c = '/';
+    }
+    return 0;
+}
+
+/**
+ * Maps a SimpleLink file name to a host path.
+ *
+ * @param      fileName             SimpleLink file name.
+ * @param[out] path                 Host path.
+ * @param      maxPathBytes         Capacity of the path buffer.
+ *
+ * @return true                     If the file name is valid.
+ * @return false                    Otherwise.
+ */
+static bool GetHostPath(const _u8* fileName, char* path, size_t maxPathBytes)
+{
+    HAPPrecondition(fs.rootDirectory[0]);
+
+    if (!fileName) {
+        return false;
+    }
+    const char* name = (const char*) fileName;
+    size_t numNameBytes = HAPStringGetNumBytes(name);
+    if (!numNameBytes || numNameBytes >= SL_FS_MAX_FILE_NAME_LENGTH || name[0] == '/' || strstr(name, "..") ||
+        (numNameBytes >= sizeof kSimpleLinkFS_ShadowSuffix - 1 &&
+         HAPStringAreEqual(&name[numNameBytes - (sizeof kSimpleLinkFS_ShadowSuffix - 1)],
+                           kSimpleLinkFS_ShadowSuffix))) {
+        return false;
+    }
+
+    HAPError err = HAPStringWithFormat(path, maxPathBytes, "%s/%s", fs.rootDirectory, name);
+    return !err;
+}
+
+/**
+ * Reads the header of a file.
+ *
+ * @param      fileDescriptor       File descriptor.
+ * @param[out] header               File header.
+ *
+ * @return true                     If the header is valid.
+ * @return false                    Otherwise.
+ */
+static bool ReadHeader(int fileDescriptor, FileHeader* header)
+{
+    ssize_t n = pread(fileDescriptor, header, sizeof *header, 0);
+    return n == (ssize_t) sizeof *header && header->magic == kSimpleLinkFS_Magic;
+}
+
+/**
+ * Returns the number of flash blocks allocated for a file.
+ *
+ * @param      header               File header.
+ *
+ * @return Number of allocated flash blocks.
+ */
+static uint32_t GetAllocatedBlocks(const FileHeader* header)
+{
+    uint32_t numBlocks = (header->maxSize + SL_FS_BLOCK_SIZE - 1) / SL_FS_BLOCK_SIZE;
+    if (!numBlocks) {
+        numBlocks = 1;
+    }
+    return (header->flags & SL_FS_CREATE_FAILSAFE) ? 2 * numBlocks : numBlocks;
+}
+
+/**
+ * Copies the content of one file descriptor to another.
+ *
+ * @return 0                        If successful.
+ * @return -1                       Otherwise. errno is set.
+ */
+static int CopyFile(int sourceFileDescriptor, int destinationFileDescriptor)
+{
+    char bytes[SL_FS_BLOCK_SIZE];
+    off_t offset = 0;
+    for (;;) {
+        ssize_t n = pread(sourceFileDescriptor, bytes, sizeof bytes, offset);
+        if (n < 0) {
+            return -1;
+        }
+        if (n == 0) {
+            return 0;
+        }
+        if (pwrite(destinationFileDescriptor, bytes, (size_t) n, offset) != n) {
+            return -1;
+        }
+        offset += n;
+    }
+}
+
+void SimpleLinkFSCreate(const SimpleLinkFSOptions* options)
+{
+    HAPPrecondition(options);
+    HAPPrecondition(options->rootDirectory);
+
+    for (size_t i = 0; i < HAPArrayCount(fs.files); i++) {
+        HAPPrecondition(!fs.files[i].isOpen);
+    }
+    HAPRawBufferZero(&fs, sizeof fs);
+
+    size_t numBytes = HAPStringGetNumBytes(options->rootDirectory);
+    HAPPrecondition(numBytes && numBytes < sizeof fs.rootDirectory - SL_FS_MAX_FILE_NAME_LENGTH - 2);
+    HAPRawBufferCopyBytes(fs.rootDirectory, options->rootDirectory, numBytes + 1);
+    fs.commandLatency = options->commandLatency;
+    fs.commitLatency = options->commitLatency;
+
+    char path[PATH_MAX];
+    HAPError err = HAPStringWithFormat(path, sizeof path, "%s/", fs.rootDirectory);
+    HAPAssert(!err);
+    if (CreateParentDirectories(path) == -1) {
+        HAPPlatformLogPOSIXError(kHAPLogType_Error,
+                                 "Creating the root directory failed.",
+                                 errno, __func__, HAP_FILE, __LINE__);
+        HAPFatalError();
+    }
+
+    HAPLogInfo(&logObject, "Serial flash file system root directory: %s.", fs.rootDirectory);
+}
+
+void SimpleLinkFSGetStatistics(SimpleLinkFSStatistics* statistics)
+{
+    HAPPrecondition(statistics);
+
+    *statistics = fs.statistics;
+}
+
+void SimpleLinkFSResetStatistics(void)
+{
+    HAPRawBufferZero(&fs.statistics, sizeof fs.statistics);
+}
+
+_i32 sl_FsOpen(const _u8* pFileName, const _u32 AccessModeAndMaxSize, _u32* pToken HAP_UNUSED)
+{
+    // Find free file.
+    size_t i = 0;
+    while (i < HAPArrayCount(fs.files) && fs.files[i].isOpen) {
+        i++;
+    }
+    if (i == HAPArrayCount(fs.files)) {
+        return SL_ERROR_FS_NO_AVAILABLE_FILE_HANDLES;
+    }
+    OpenFile* file = &fs.files[i];
+    HAPRawBufferZero(file, sizeof *file);
+
+    if (!GetHostPath(pFileName, file->path, sizeof file->path)) {
+        return SL_ERROR_FS_INVALID_ARGS;
+    }
+
+    bool isWritable = (AccessModeAndMaxSize & (SL_FS_WRITE | SL_FS_CREATE | SL_FS_OVERWRITE)) != 0;
+
+    int fileDescriptor = open(file->path, isWritable ? O_RDWR : O_RDONLY);
+    if (fileDescriptor == -1 && errno != ENOENT) {
+        HAPPlatformLogPOSIXError(kHAPLogType_Error, "System call 'open' failed.", errno, __func__, HAP_FILE, __LINE__);
+        return SL_ERROR_FS_DEVICE_IO_ERROR;
+    }
+    bool exists = fileDescriptor != -1;
+
+    FileHeader header;
+    if (exists && !ReadHeader(fileDescriptor, &header)) {
+        HAPLogError(&logObject, "Invalid file header: %s.", file->path);
+        (void) close(fileDescriptor);
+        return SL_ERROR_FS_DEVICE_IO_ERROR;
+    }
+
+    if (!isWritable) {
+        if (!exists) {
+            return SL_ERROR_FS_FILE_NOT_EXISTS;
+        }
+        file->isOpen = true;
+        file->fileDescriptor = fileDescriptor;
+        file->header = header;
+        fs.statistics.numOpens++;
+        SimulateLatency(fs.commandLatency);
+        return (_i32)(i + 1);
+    }
+
+    if (!exists && !(AccessModeAndMaxSize & SL_FS_CREATE)) {
+        return SL_ERROR_FS_FILE_NOT_EXISTS;
+    }
+
+    // Files are (re)created with the requested properties. Existing files opened for writing keep theirs.
+    bool isOverwrite = !exists || (AccessModeAndMaxSize & SL_FS_OVERWRITE);
+    if (!exists || (AccessModeAndMaxSize & SL_FS_CREATE)) {
+        header.magic = kSimpleLinkFS_Magic;
+        header.maxSize = AccessModeAndMaxSize & SL_FS_CREATE_MAX_SIZE_MASK;
+        header.flags = AccessModeAndMaxSize & ~SL_FS_CREATE_MAX_SIZE_MASK;
+        header.writeCounter = exists ? header.writeCounter : 0;
+    }
+    file->header = header;
+    file->isFailsafe = (header.flags & SL_FS_CREATE_FAILSAFE) != 0;
+
+    if (CreateParentDirectories(file->path) == -1) {
+        HAPPlatformLogPOSIXError(kHAPLogType_Error, "Creating directories failed.", errno, __func__, HAP_FILE, __LINE__);
+        if (exists) {
+            (void) close(fileDescriptor);
+        }
+        return SL_ERROR_FS_DEVICE_IO_ERROR;
+    }
+
+    if (file->isFailsafe) {
+        // Modifications are applied to a shadow copy which is committed on close.
+        HAPError err = HAPStringWithFormat(file->shadowPath, sizeof file->shadowPath, "%s%s",
+                                           file->path, kSimpleLinkFS_ShadowSuffix);
+        HAPAssert(!err);
+        int shadowFileDescriptor = open(file->shadowPath, O_RDWR | O_CREAT | O_TRUNC, 0600);
+        if (shadowFileDescriptor == -1) {
+            HAPPlatformLogPOSIXError(kHAPLogType_Error, "System call 'open' failed.", errno, __func__, HAP_FILE, __LINE__);
+            if (exists) {
+                (void) close(fileDescriptor);
+            }
+            return SL_ERROR_FS_DEVICE_IO_ERROR;
+        }
+        if (exists && !isOverwrite && CopyFile(fileDescriptor, shadowFileDescriptor) == -1) {
+            HAPPlatformLogPOSIXError(kHAPLogType_Error, "Copying file failed.", errno, __func__, HAP_FILE, __LINE__);
+            (void) close(shadowFileDescriptor);
+            (void) unlink(file->shadowPath);
+            (void) close(fileDescriptor);
+            return SL_ERROR_FS_DEVICE_IO_ERROR;
+        }
+        if (exists) {
+            (void) close(fileDescriptor);
+        }
+        fileDescriptor = shadowFileDescriptor;
+    } else {
+        if (!exists) {
+            fileDescriptor = open(file->path, O_RDWR | O_CREAT, 0600);
+            if (fileDescriptor == -1) {
+                HAPPlatformLogPOSIXError(kHAPLogType_Error, "System call 'open' failed.", errno, __func__, HAP_FILE, __LINE__);
+                return SL_ERROR_FS_DEVICE_IO_ERROR;
+            }
+        }
+        if (isOverwrite && ftruncate(fileDescriptor, 0) == -1) {
+            HAPPlatformLogPOSIXError(kHAPLogType_Error, "System call 'ftruncate' failed.", errno, __func__, HAP_FILE, __LINE__);
+            (void) close(fileDescriptor);
+            return SL_ERROR_FS_DEVICE_IO_ERROR;
+        }
+    }
+
+    if (pwrite(fileDescriptor, &file->header, sizeof file->header, 0) != (ssize_t) sizeof file->header) {
+        HAPPlatformLogPOSIXError(kHAPLogType_Error, "System call 'pwrite' failed.", errno, __func__, HAP_FILE, __LINE__);
+        (void) close(fileDescriptor);
+        return SL_ERROR_FS_DEVICE_IO_ERROR;
+    }
+
+    file->isOpen = true;
+    file->isWritable = true;
+    file->didWrite = isOverwrite;
+    file->isInPlace = !file->isFailsafe && !isOverwrite;
+    file->fileDescriptor = fileDescriptor;
+    fs.statistics.numOpens++;
+    SimulateLatency(fs.commandLatency);
+    return (_i32)(i + 1);
+}
+
+/**
+ * Gets the open file for a handle.
+ *
+ * @param      FileHdl              File handle.
+ *
+ * @return Open file, or NULL if the handle is invalid.
+ */
+static OpenFile* _Nullable GetOpenFile(_i32 FileHdl)
+{
+    if (FileHdl < 1 || (size_t) FileHdl > HAPArrayCount(fs.files) || !fs.files[FileHdl - 1].isOpen) {
+        return NULL;
+    }
+    return &fs.files[FileHdl - 1];
+}
+
+_i16 sl_FsClose(const _i32 FileHdl, const _u8* pCeritificateFileName HAP_UNUSED, const _u8* pSignature, const _u32 SignatureLen)
+{
+    OpenFile* file = GetOpenFile(FileHdl);
+    if (!file) {
+        return SL_ERROR_FS_INVALID_HANDLE;
+    }
+
+    // A signature of "A" aborts the changes to a failsafe file.
+    bool isAbort = pSignature && SignatureLen == 1 && pSignature[0] == 'A';
+
+    _i16 rc = 0;
+    if (file->isWritable && file->didWrite && !isAbort) {
+        file->header.writeCounter++;
+        struct stat st;
+        if (pwrite(file->fileDescriptor, &file->header, sizeof file->header, 0) != (ssize_t) sizeof file->header ||
+            fstat(file->fileDescriptor, &st) == -1) {
+            HAPPlatformLogPOSIXError(kHAPLogType_Error, "Committing file failed.", errno, __func__, HAP_FILE, __LINE__);
+            rc = SL_ERROR_FS_DEVICE_IO_ERROR;
+        } else {
+            uint64_t numContentBytes = (uint64_t) st.st_size - sizeof file->header;
+            uint64_t numBlocks = (numContentBytes + SL_FS_BLOCK_SIZE - 1) / SL_FS_BLOCK_SIZE;
+            if (file->isInPlace) {
+                // Only the blocks spanned by the writes are programmed.
+                numBlocks = (file->maxWriteOffset - 1) / SL_FS_BLOCK_SIZE - file->minWriteOffset / SL_FS_BLOCK_SIZE + 1;
+            }
+            fs.statistics.numBlocksWritten += numBlocks ? numBlocks : 1;
+        }
+    }
+
+    (void) close(file->fileDescriptor);
+
+    if (file->isFailsafe && file->isWritable) {
+        if (isAbort || rc) {
+            (void) unlink(file->shadowPath);
+        } else if (rename(file->shadowPath, file->path) == -1) {
+            HAPPlatformLogPOSIXError(kHAPLogType_Error, "System call 'rename' failed.", errno, __func__, HAP_FILE, __LINE__);
+            (void) unlink(file->shadowPath);
+            rc = SL_ERROR_FS_DEVICE_IO_ERROR;
+        }
+    }
+
+    if (!rc) {
+        bool isCommit = file->isWritable && file->didWrite && !isAbort;
+        SimulateLatency(fs.commandLatency + (isCommit ? fs.commitLatency : 0));
+    }
+
+    HAPRawBufferZero(file, sizeof *file);
+    return rc;
+}
+
+_i32 sl_FsRead(const _i32 FileHdl, _u32 Offset, _u8* pData, _u32 Len)
+{
+    OpenFile* file = GetOpenFile(FileHdl);
+    if (!file) {
+        return SL_ERROR_FS_INVALID_HANDLE;
+    }
+    if (file->isWritable) {
+        return SL_ERROR_FS_FILE_ACCESS_IS_DIFFERENT;
+    }
+    if (Len && !pData) {
+        return SL_ERROR_FS_INVALID_ARGS;
+    }
+
+    ssize_t n = pread(file->fileDescriptor, pData, Len, (off_t) sizeof file->header + Offset);
+    if (n < 0) {
+        HAPPlatformLogPOSIXError(kHAPLogType_Error, "System call 'pread' failed.", errno, __func__, HAP_FILE, __LINE__);
+        return SL_ERROR_FS_DEVICE_IO_ERROR;
+    }
+
+    fs.statistics.numReads++;
+    SimulateLatency(fs.commandLatency);
+    fs.statistics.numBytesRead += (uint64_t) n;
+    fs.statistics.numBytesRequested += Len;
+    return (_i32) n;
+}
+
+_i32 sl_FsWrite(const _i32 FileHdl, _u32 Offset, _u8* pData, _u32 Len)
+{
+    OpenFile* file = GetOpenFile(FileHdl);
+    if (!file) {
+        return SL_ERROR_FS_INVALID_HANDLE;
+    }
+    if (!file->isWritable) {
+        return SL_ERROR_FS_FILE_ACCESS_IS_DIFFERENT;
+    }
+    if (Len && !pData) {
+        return SL_ERROR_FS_INVALID_ARGS;
+    }
+    if ((uint64_t) Offset + Len > file->header.maxSize) {
+        return SL_ERROR_FS_OFFSET_OUT_OF_RANGE;
+    }
+
+    ssize_t n = pwrite(file->fileDescriptor, pData, Len, (off_t) sizeof file->header + Offset);
+    if (n != (ssize_t) Len) {
+        HAPPlatformLogPOSIXError(kHAPLogType_Error, "System call 'pwrite' failed.", errno, __func__, HAP_FILE, __LINE__);
+        return SL_ERROR_FS_DEVICE_IO_ERROR;
+    }
+
+    if (Len) {
+        if (!file->didWrite || Offset < file->minWriteOffset) {
+            file->minWriteOffset = Offset;
+        }
+        if (!file->didWrite || Offset + Len > file->maxWriteOffset) {
+            file->maxWriteOffset = Offset + Len;
+        }
+        file->didWrite = true;
+    }
+    fs.statistics.numWrites++;
+    SimulateLatency(fs.commandLatency);
+    fs.statistics.numBytesWritten += Len;
+    return (_i32) n;
+}
+
+_i16 sl_FsGetInfo(const _u8* pFileName, const _u32 Token HAP_UNUSED, SlFsFileInfo_t* pFsFileInfo)
+{
+    if (!pFsFileInfo) {
+        return SL_ERROR_FS_INVALID_ARGS;
+    }
+
+    char path[PATH_MAX];
+    if (!GetHostPath(pFileName, path, sizeof path)) {
+        return SL_ERROR_FS_INVALID_ARGS;
+    }
+
+    int fileDescriptor = open(path, O_RDONLY);
+    if (fileDescriptor == -1) {
+        return errno == ENOENT ? SL_ERROR_FS_FILE_NOT_EXISTS : SL_ERROR_FS_DEVICE_IO_ERROR;
+    }
+
+    FileHeader header;
+    struct stat st;
+    bool isValid = ReadHeader(fileDescriptor, &header) && fstat(fileDescriptor, &st) == 0;
+    (void) close(fileDescriptor);
+    if (!isValid) {
+        return SL_ERROR_FS_DEVICE_IO_ERROR;
+    }
+
+    HAPRawBufferZero(pFsFileInfo, sizeof *pFsFileInfo);
+    pFsFileInfo->Flags = (header.flags & SL_FS_CREATE_FAILSAFE) ? 0 : SL_FS_INFO_NOT_FAILSAFE;
+    pFsFileInfo->Len = (_u32)((uint64_t) st.st_size - sizeof header);
+    pFsFileInfo->MaxSize = header.maxSize;
+    pFsFileInfo->StorageSize = GetAllocatedBlocks(&header) * SL_FS_BLOCK_SIZE;
+    pFsFileInfo->WriteCounter = header.writeCounter;
+    fs.statistics.numGetInfos++;
+    SimulateLatency(fs.commandLatency);
+    return 0;
+}
+
+_i16 sl_FsDel(const _u8* pFileName, const _u32 Token HAP_UNUSED)
+{
+    char path[PATH_MAX];
+    if (!GetHostPath(pFileName, path, sizeof path)) {
+        return SL_ERROR_FS_INVALID_ARGS;
+    }
+
+    for (size_t i = 0; i < HAPArrayCount(fs.files); i++) {
+        if (fs.files[i].isOpen && HAPStringAreEqual(fs.files[i].path, path)) {
+            return SL_ERROR_FS_FILE_IS_ALREADY_OPENED;
+        }
+    }
+
+    if (unlink(path) == -1) {
+        if (errno == ENOENT) {
+            return SL_ERROR_FS_FILE_NOT_EXISTS;
+        }
+        HAPPlatformLogPOSIXError(kHAPLogType_Error, "System call 'unlink' failed.", errno, __func__, HAP_FILE, __LINE__);
+        return SL_ERROR_FS_DEVICE_IO_ERROR;
+    }
+
+    fs.statistics.numDeletes++;
+    SimulateLatency(fs.commandLatency);
+    return 0;
+}
+
+/**
+ * File list, used to enumerate files in a stable order.
+ */
+typedef struct {
+    char (*names)[SL_FS_MAX_FILE_NAME_LENGTH];
+    size_t numNames;
+    size_t maxNames;
+} FileList;
+
+/**
+ * Recursively appends the files below a directory to a file list.
+ *
+ * @param      fileList             File list.
+ * @param      prefix               SimpleLink file name prefix of the directory.
+ *
+ * @return 0                        If successful.
+ * @return -1                       Otherwise.
+ */
+static int ListFiles(FileList* fileList, const char* prefix)
+{
+    char path[PATH_MAX];
+    HAPError err = HAPStringWithFormat(path, sizeof path, "%s/%s", fs.rootDirectory, prefix);
+    if (err) {
+        return -1;
+    }
+
+    DIR* dir = opendir(path);
+    if (!dir) {
+        return -1;
+    }
+
+    int rc = 0;
+    struct dirent* entry;
+    while (rc == 0 && (entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.' &&
+            (entry->d_name[1] == '\0' || (entry->d_name[1] == '.' && entry->d_name[2] == '\0'))) {
+            continue;
+        }
+
+        char name[SL_FS_MAX_FILE_NAME_LENGTH];
+        err = HAPStringWithFormat(name, sizeof name, "%s%s", prefix, entry->d_name);
+        if (err) {
+            continue;
+        }
+
+        char entryPath[PATH_MAX];
+        err = HAPStringWithFormat(entryPath, sizeof entryPath, "%s/%s", fs.rootDirectory, name);
+        struct stat st;
+        if (err || stat(entryPath, &st) == -1) {
+            continue;
+        }
+
+        if (S_ISDIR(st.st_mode)) {
+            char directoryPrefix[SL_FS_MAX_FILE_NAME_LENGTH];
+            err = HAPStringWithFormat(directoryPrefix, sizeof directoryPrefix, "%s/", name);
+            if (!err) {
+                rc = ListFiles(fileList, directoryPrefix);
+            }
+            continue;
+        }
+
+        // Skip uncommitted shadow copies.
+        size_t numNameBytes = HAPStringGetNumBytes(name);
+        if (numNameBytes >= sizeof kSimpleLinkFS_ShadowSuffix - 1 &&
+            HAPStringAreEqual(&name[numNameBytes - (sizeof kSimpleLinkFS_ShadowSuffix - 1)],
+                              kSimpleLinkFS_ShadowSuffix)) {
+            continue;
+        }
+
+        if (fileList->numNames == fileList->maxNames) {
+            size_t maxNames = fileList->maxNames ? 2 * fileList->maxNames : 16;
+            void* names = realloc(fileList->names, maxNames * sizeof fileList->names[0]);
+            if (!names) {
+                rc = -1;
+                break;
+            }
+            fileList->names = names;
+            fileList->maxNames = maxNames;
+        }
+        HAPRawBufferCopyBytes(fileList->names[fileList->numNames], name, numNameBytes + 1);
+        fileList->numNames++;
+    }
+
+    (void) closedir(dir);
+    return rc;
+}
+
+static int CompareFileNames(const void* a, const void* b)
+{
+    return strcmp((const char*) a, (const char*) b);
+}
+
+_i32 sl_FsGetFileList(_i32* pIndex, _u8 Count, _u8 MaxEntryLen, _u8* pBuff, SlFileListFlags_t Flags)
+{
+    if (!pIndex || !pBuff) {
+        return SL_ERROR_FS_INVALID_ARGS;
+    }
+
+    size_t numAttributeBytes = (Flags & SL_FS_GET_FILE_ATTRIBUTES) ? sizeof(SlFileAttributes_t) : 0;
+    if (MaxEntryLen <= numAttributeBytes) {
+        return SL_ERROR_FS_INVALID_ARGS;
+    }
+    size_t maxNameBytes = MaxEntryLen - numAttributeBytes;
+
+    FileList fileList = { .names = NULL, .numNames = 0, .maxNames = 0 };
+    if (ListFiles(&fileList, "") == -1) {
+        free(fileList.names);
+        return SL_ERROR_FS_DEVICE_IO_ERROR;
+    }
+    qsort(fileList.names, fileList.numNames, sizeof fileList.names[0], CompareFileNames);
+
+    // The index is updated to the index of the last returned file. -1 starts at the first file.
+    size_t startIndex = *pIndex < 0 ? 0 : (size_t) *pIndex + 1;
+    _i32 numEntries = 0;
+    for (size_t i = startIndex; i < fileList.numNames && numEntries < Count; i++) {
+        _u8* entry = &pBuff[(size_t) numEntries * MaxEntryLen];
+        HAPRawBufferZero(entry, MaxEntryLen);
+
+        if (numAttributeBytes) {
+            char path[PATH_MAX];
+            SlFileAttributes_t attributes;
+            HAPRawBufferZero(&attributes, sizeof attributes);
+            if (GetHostPath((const _u8*) fileList.names[i], path, sizeof path)) {
+                int fileDescriptor = open(path, O_RDONLY);
+                FileHeader header;
+                if (fileDescriptor != -1 && ReadHeader(fileDescriptor, &header)) {
+                    attributes.FileMaxSize = header.maxSize;
+                    attributes.Properties = header.flags;
+                    attributes.FileAllocatedBlocks = GetAllocatedBlocks(&header);
+                }
+                if (fileDescriptor != -1) {
+                    (void) close(fileDescriptor);
+                }
+            }
+            HAPRawBufferCopyBytes(entry, &attributes, sizeof attributes);
+        }
+
+        size_t numNameBytes = HAPStringGetNumBytes(fileList.names[i]);
+        if (numNameBytes >= maxNameBytes) {
+            numNameBytes = maxNameBytes - 1;
+        }
+        HAPRawBufferCopyBytes(&entry[numAttributeBytes], fileList.names[i], numNameBytes);
+
+        *pIndex = (_i32) i;
+        numEntries++;
+    }
+
+    free(fileList.names);
+    fs.statistics.numGetFileLists++;
+    SimulateLatency(fs.commandLatency);
+    return numEntries;
+}
@@ -0,0 +1,132 @@
+// Copyright (c) 2022 John Buonagurio
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+#ifndef SIMPLELINK_H
+#define SIMPLELINK_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**@file
+ * Host subset of the SimpleLink Wi-Fi host driver API.
+ *
+ * Only the file system API used by the platform adaptation layer is provided. Files are emulated by
+ * SimpleLinkFS.c below a host directory, so that HAPPlatformKeyValueStore.c for CC32xxSF can be used unmodified
+ * on a development host. Flag and error values are host specific and must not be persisted.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+
+typedef uint8_t _u8;
+typedef uint16_t _u16;
+typedef uint32_t _u32;
+typedef int8_t _i8;
+typedef int16_t _i16;
+typedef int32_t _i32;
+
+/**
+ * Maximum file name length, including the NULL-terminator.
+ */
+#define SL_FS_MAX_FILE_NAME_LENGTH (180)
+
+/**
+ * Size of a flash block, the allocation unit of the serial flash file system.
+ */
+#define SL_FS_BLOCK_SIZE (4096)
+
+/**
+ * sl_FsOpen access modes and flags.
+ */
+/**@{*/
+#define SL_FS_READ                   ((_u32) 0x00000000)
+#define SL_FS_WRITE                  ((_u32) 0x01000000)
+#define SL_FS_CREATE                 ((_u32) 0x02000000)
+#define SL_FS_OVERWRITE              ((_u32) 0x04000000)
+#define SL_FS_CREATE_FAILSAFE        ((_u32) 0x08000000)
+#define SL_FS_CREATE_NOSIGNATURE     ((_u32) 0x10000000)
+#define SL_FS_CREATE_STATIC_TOKEN    ((_u32) 0x20000000)
+#define SL_FS_CREATE_PUBLIC_WRITE    ((_u32) 0x40000000)
+#define SL_FS_CREATE_PUBLIC_READ     ((_u32) 0x80000000)
+#define SL_FS_CREATE_MAX_SIZE_MASK   ((_u32) 0x00FFFFFF)
+#define SL_FS_CREATE_MAX_SIZE(size)  (((_u32) (size)) & SL_FS_CREATE_MAX_SIZE_MASK)
+/**@}*/
+
+/**
+ * File system error codes.
+ */
+/**@{*/
+#define SL_ERROR_FS_FILE_NOT_EXISTS           (-10341L)
+#define SL_ERROR_FS_FILE_IS_ALREADY_OPENED    (-10342L)
+#define SL_ERROR_FS_INVALID_HANDLE            (-10343L)
+#define SL_ERROR_FS_NO_AVAILABLE_FILE_HANDLES (-10344L)
+#define SL_ERROR_FS_OFFSET_OUT_OF_RANGE       (-10345L)
+#define SL_ERROR_FS_INVALID_ARGS              (-10346L)
+#define SL_ERROR_FS_FILE_ACCESS_IS_DIFFERENT  (-10347L)
+#define SL_ERROR_FS_DEVICE_IO_ERROR           (-10348L)
+/**@}*/
+
+/**
+ * sl_FsGetFileList flags.
+ */
+typedef enum {
+    SL_FS_GET_FILE_ATTRIBUTES = 0x1
+} SlFileListFlags_t;
+
+/**
+ * File attributes returned by sl_FsGetFileList.
+ */
+typedef struct {
+    _u32 FileMaxSize;
+    _u32 Properties;
+    _u32 FileAllocatedBlocks;
+} SlFileAttributes_t;
+
+/**
+ * sl_FsGetInfo flags.
+ */
+/**@{*/
+#define SL_FS_INFO_MUST_COMMIT     ((_u16) 0x1)
+#define SL_FS_INFO_BUNDLE_FILE     ((_u16) 0x2)
+#define SL_FS_INFO_PENDING_COMMIT  ((_u16) 0x4)
+#define SL_FS_INFO_PENDING_BUNDLE_COMMIT ((_u16) 0x8)
+#define SL_FS_INFO_NOT_FAILSAFE    ((_u16) 0x20)
+#define SL_FS_INFO_NOT_VALID       ((_u16) 0x100)
+#define SL_FS_INFO_SYS_FILE        ((_u16) 0x40)
+/**@}*/
+
+/**
+ * File information returned by sl_FsGetInfo.
+ */
+typedef struct {
+    _u16 Flags;
+    _u32 Len;
+    _u32 MaxSize;
+    _u32 Token[4];
+    _u32 StorageSize;
+    _u32 WriteCounter;
+} SlFsFileInfo_t;
+
+_i32 sl_FsOpen(const _u8* pFileName, const _u32 AccessModeAndMaxSize, _u32* pToken);
+
+_i16 sl_FsClose(const _i32 FileHdl, const _u8* pCeritificateFileName, const _u8* pSignature, const _u32 SignatureLen);
+
+_i32 sl_FsRead(const _i32 FileHdl, _u32 Offset, _u8* pData, _u32 Len);
+
+_i32 sl_FsWrite(const _i32 FileHdl, _u32 Offset, _u8* pData, _u32 Len);
+
+_i16 sl_FsGetInfo(const _u8* pFileName, const _u32 Token, SlFsFileInfo_t* pFsFileInfo);
+
+_i16 sl_FsDel(const _u8* pFileName, const _u32 Token);
+
+_i32 sl_FsGetFileList(_i32* pIndex, _u8 Count, _u8 MaxEntryLen, _u8* pBuff, SlFileListFlags_t Flags);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,1291 @@
+//  Copyright 2022 John Buonagurio
+//
+//  Distributed under the Boost Software License, Version 1.0.
+//
+//  See accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt
+
+#include "Controller.h"
+
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <mbedtls/bignum.h>
+
+static const HAPLogObject logObject = { .subsystem = "hapload", .category = "Controller" };
+
+/**
+ * TLV types of the pairing protocols.
+ */
+enum {
+    kPairingTLVType_Method = 0x00,
+    kPairingTLVType_Identifier = 0x01,
+    kPairingTLVType_Salt = 0x02,
+    kPairingTLVType_PublicKey = 0x03,
+    kPairingTLVType_Proof = 0x04,
+    kPairingTLVType_EncryptedData = 0x05,
+    kPairingTLVType_State = 0x06,
+    kPairingTLVType_Error = 0x07,
+    kPairingTLVType_Signature = 0x0A,
+    kPairingTLVType_Permissions = 0x0B
+};
+
+/**
+ * Pairing methods.
+ */
+enum { kPairingMethod_PairSetup = 0x00, kPairingMethod_AddPairing = 0x03 };
+
+/**
+ * Pairing errors.
+ */
+enum {
+    kPairingError_Unknown = 0x01,
+    kPairingError_Authentication = 0x02,
+    kPairingError_Backoff = 0x03,
+    kPairingError_MaxPeers = 0x04,
+    kPairingError_MaxTries = 0x05,
+    kPairingError_Unavailable = 0x06,
+    kPairingError_Busy = 0x07
+};
+
+/**
+ * Maximum plaintext length of an encrypted frame.
+ */
+#define kController_MaxFrameBytes ((size_t) 1024)
+
+/**
+ * SRP group generator.
+ */
+#define kSRPGenerator ((uint8_t) 5)
+
+/**
+ * SRP group prime (3072-bit group of RFC 5054).
+ */
+static const uint8_t kSRPPrime[SRP_PRIME_BYTES] = {
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xC9, 0x0F, 0xDA, 0xA2, 0x21, 0x68, 0xC2, 0x34,
+    0xC4, 0xC6, 0x62, 0x8B, 0x80, 0xDC, 0x1C, 0xD1, 0x29, 0x02, 0x4E, 0x08, 0x8A, 0x67, 0xCC, 0x74,
+    0x02, 0x0B, 0xBE, 0xA6, 0x3B, 0x13, 0x9B, 0x22, 0x51, 0x4A, 0x08, 0x79, 0x8E, 0x34, 0x04, 0xDD,
+    0xEF, 0x95, 0x19, 0xB3, 0xCD, 0x3A, 0x43, 0x1B, 0x30, 0x2B, 0x0A, 0x6D, 0xF2, 0x5F, 0x14, 0x37,
+    0x4F, 0xE1, 0x35, 0x6D, 0x6D, 0x51, 0xC2, 0x45, 0xE4, 0x85, 0xB5, 0x76, 0x62, 0x5E, 0x7E, 0xC6,
+    0xF4, 0x4C, 0x42, 0xE9, 0xA6, 0x37, 0xED, 0x6B, 0x0B, 0xFF, 0x5C, 0xB6, 0xF4, 0x06, 0xB7, 0xED,
+    0xEE, 0x38, 0x6B, 0xFB, 0x5A, 0x89, 0x9F, 0xA5, 0xAE, 0x9F, 0x24, 0x11, 0x7C, 0x4B, 0x1F, 0xE6,
+    0x49, 0x28, 0x66, 0x51, 0xEC, 0xE4, 0x5B, 0x3D, 0xC2, 0x00, 0x7C, 0xB8, 0xA1, 0x63, 0xBF, 0x05,
+    0x98, 0xDA, 0x48, 0x36, 0x1C, 0x55, 0xD3, 0x9A, 0x69, 0x16, 0x3F, 0xA8, 0xFD, 0x24, 0xCF, 0x5F,
+    0x83, 0x65, 0x5D, 0x23, 0xDC, 0xA3, 0xAD, 0x96, 0x1C, 0x62, 0xF3, 0x56, 0x20, 0x85, 0x52, 0xBB,
+    0x9E, 0xD5, 0x29, 0x07, 0x70, 0x96, 0x96, 0x6D, 0x67, 0x0C, 0x35, 0x4E, 0x4A, 0xBC, 0x98, 0x04,
+    0xF1, 0x74, 0x6C, 0x08, 0xCA, 0x18, 0x21, 0x7C, 0x32, 0x90, 0x5E, 0x46, 0x2E, 0x36, 0xCE, 0x3B,
+    0xE3, 0x9E, 0x77, 0x2C, 0x18, 0x0E, 0x86, 0x03, 0x9B, 0x27, 0x83, 0xA2, 0xEC, 0x07, 0xA2, 0x8F,
+    0xB5, 0xC5, 0x5D, 0xF0, 0x6F, 0x4C, 0x52, 0xC9, 0xDE, 0x2B, 0xCB, 0xF6, 0x95, 0x58, 0x17, 0x18,
+    0x39, 0x95, 0x49, 0x7C, 0xEA, 0x95, 0x6A, 0xE5, 0x15, 0xD2, 0x26, 0x18, 0x98, 0xFA, 0x05, 0x10,
+    0x15, 0x72, 0x8E, 0x5A, 0x8A, 0xAA, 0xC4, 0x2D, 0xAD, 0x33, 0x17, 0x0D, 0x04, 0x50, 0x7A, 0x33,
+    0xA8, 0x55, 0x21, 0xAB, 0xDF, 0x1C, 0xBA, 0x64, 0xEC, 0xFB, 0x85, 0x04, 0x58, 0xDB, 0xEF, 0x0A,
+    0x8A, 0xEA, 0x71, 0x57, 0x5D, 0x06, 0x0C, 0x7D, 0xB3, 0x97, 0x0F, 0x85, 0xA6, 0xE1, 0xE4, 0xC7,
+    0xAB, 0xF5, 0xAE, 0x8C, 0xDB, 0x09, 0x33, 0xD7, 0x1E, 0x8C, 0x94, 0xE0, 0x4A, 0x25, 0x61, 0x9D,
+    0xCE, 0xE3, 0xD2, 0x26, 0x1A, 0xD2, 0xEE, 0x6B, 0xF1, 0x2F, 0xFA, 0x06, 0xD9, 0x8A, 0x08, 0x64,
+    0xD8, 0x76, 0x02, 0x73, 0x3E, 0xC8, 0x6A, 0x64, 0x52, 0x1F, 0x2B, 0x18, 0x17, 0x7B, 0x20, 0x0C,
+    0xBB, 0xE1, 0x17, 0x57, 0x7A, 0x61, 0x5D, 0x6C, 0x77, 0x09, 0x88, 0xC0, 0xBA, 0xD9, 0x46, 0xE2,
+    0x08, 0xE2, 0x4F, 0xA0, 0x74, 0xE5, 0xAB, 0x31, 0x43, 0xDB, 0x5B, 0xFC, 0xE0, 0xFD, 0x10, 0x8E,
+    0x4B, 0x82, 0xD1, 0x20, 0xA9, 0x3A, 0xD2, 0xCA, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF
+};
+
+/**
+ * SRP user name of pair-setup.
+ */
+static const char kSRPUserName[] = "Pair-Setup";
+
+/**
+ * Serializes access to the random number generator, which is not thread-safe.
+ */
+static pthread_mutex_t randomNumberMutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Fills a buffer with random bytes.
+ *
+ * @param[out] bytes                Buffer to fill.
+ * @param      numBytes             Length of the buffer.
+ */
+static void FillRandom(void* bytes, size_t numBytes)
+{
+    pthread_mutex_lock(&randomNumberMutex);
+    HAPPlatformRandomNumberFill(bytes, numBytes);
+    pthread_mutex_unlock(&randomNumberMutex);
+}
+
+/**
+ * Derives a 32 byte key with HKDF-SHA-512.
+ *
+ * @param[out] key                  Derived key.
+ * @param      inputKey             Input key material.
+ * @param      numInputKeyBytes     Length of the input key material.
+ * @param      salt                 Salt string.
+ * @param      info                 Info string.
+ */
+static void DeriveKey(uint8_t key[32], const uint8_t* inputKey, size_t numInputKeyBytes, const char* salt, const char* info)
+{
+    HAP_hkdf_sha512(
+            key,
+            32,
+            inputKey,
+            numInputKeyBytes,
+            (const uint8_t*) salt,
+            strlen(salt),
+            (const uint8_t*) info,
+            strlen(info));
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+
+/**
+ * TLV8 message under construction.
+ */
+typedef struct {
+    uint8_t* bytes;
+    size_t maxBytes;
+    size_t numBytes;
+} TLVWriter;
+
+/**
+ * Appends a TLV item. Values longer than 255 bytes are split into consecutive fragments.
+ *
+ * @param      writer               TLV writer.
+ * @param      type                 Type of the item.
+ * @param      value                Value of the item.
+ * @param      numValueBytes        Length of the value.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_OutOfResources If the buffer is too small.
+ */
+HAP_RESULT_USE_CHECK
+static HAPError AppendTLV(TLVWriter* writer, uint8_t type, const void* value, size_t numValueBytes)
+{
+    HAPPrecondition(writer);
+    HAPPrecondition(value || !numValueBytes);
+
+    const uint8_t* valueBytes = value;
+    do {
+        size_t numFragmentBytes = numValueBytes < UINT8_MAX ? numValueBytes : UINT8_MAX;
+        if (writer->maxBytes - writer->numBytes < 2 + numFragmentBytes) {
+            return kHAPError_OutOfResources;
+        }
+        writer->bytes[writer->numBytes++] = type;
+        writer->bytes[writer->numBytes++] = (uint8_t) numFragmentBytes;
+        if (numFragmentBytes) {
+            HAPRawBufferCopyBytes(&writer->bytes[writer->numBytes], valueBytes, numFragmentBytes);
+        }
+        writer->numBytes += numFragmentBytes;
+        valueBytes += numFragmentBytes;
+        numValueBytes -= numFragmentBytes;
+    } while (numValueBytes);
+    return kHAPError_None;
+}
+
+/**
+ * Appends a TLV item with a single byte value.
+ */
+HAP_RESULT_USE_CHECK
+static HAPError AppendTLVUInt8(TLVWriter* writer, uint8_t type, uint8_t value)
+{
+    return AppendTLV(writer, type, &value, sizeof value);
+}
+
+/**
+ * Finds a TLV item and reassembles its fragments.
+ *
+ * @param      bytes                TLV8 message.
+ * @param      numBytes             Length of the message.
+ * @param      type                 Type of the item.
+ * @param[out] value                Value of the item.
+ * @param      maxValueBytes        Capacity of the value buffer.
+ * @param[out] numValueBytes        Length of the value.
+ *
+ * @return true                     If the item was found and fits into the value buffer.
+ * @return false                    Otherwise.
+ */
+static bool FindTLV(
+        const uint8_t* bytes,
+        size_t numBytes,
+        uint8_t type,
+        uint8_t* value,
+        size_t maxValueBytes,
+        size_t* numValueBytes)
+{
+    HAPPrecondition(bytes || !numBytes);
+    HAPPrecondition(value);
+    HAPPrecondition(numValueBytes);
+
+    size_t i = 0;
+    while (i + 2 <= numBytes) {
+        size_t numItemBytes = bytes[i + 1];
+        if (numBytes - i - 2 < numItemBytes) {
+            return false;
+        }
+        if (bytes[i] != type) {
+            i += 2 + numItemBytes;
+            continue;
+        }
+        // Reassemble the fragments that follow a full fragment.
+        *numValueBytes = 0;
+        for (;;) {
+            if (maxValueBytes - *numValueBytes < numItemBytes) {
+                return false;
+            }
+            HAPRawBufferCopyBytes(&value[*numValueBytes], &bytes[i + 2], numItemBytes);
+            *numValueBytes += numItemBytes;
+            i += 2 + numItemBytes;
+            if (numItemBytes != UINT8_MAX || i + 2 > numBytes || bytes[i] != type) {
+                return true;
+            }
+            numItemBytes = bytes[i + 1];
+            if (numBytes - i - 2 < numItemBytes) {
+                return false;
+            }
+        }
+    }
+    return false;
+}
+
+/**
+ * Finds a TLV item whose value has a fixed length.
+ */
+static bool FindTLVWithLength(const uint8_t* bytes, size_t numBytes, uint8_t type, uint8_t* value, size_t numValueBytes)
+{
+    size_t numFoundBytes;
+    return FindTLV(bytes, numBytes, type, value, numValueBytes, &numFoundBytes) && numFoundBytes == numValueBytes;
+}
+
+/**
+ * Checks the state of a pairing response and maps a reported error.
+ *
+ * @param      bytes                TLV8 response.
+ * @param      numBytes             Length of the response.
+ * @param      expectedState        Expected state.
+ * @param      procedure            Name of the pairing procedure for logging.
+ *
+ * @return kHAPError_None           If the response has the expected state and no error.
+ * @return kHAPError_NotAuthorized  If the accessory reported an authentication error or is unavailable.
+ * @return kHAPError_OutOfResources If the accessory cannot store more pairings.
+ * @return kHAPError_Busy           If the accessory is busy or refuses further attempts.
+ * @return kHAPError_Unknown        Otherwise.
+ */
+HAP_RESULT_USE_CHECK
+static HAPError CheckPairingResponse(const uint8_t* bytes, size_t numBytes, uint8_t expectedState, const char* procedure)
+{
+    uint8_t state, error;
+    if (FindTLVWithLength(bytes, numBytes, kPairingTLVType_Error, &error, sizeof error)) {
+        HAPLogError(&logObject, "%s M%u: accessory reported error %u.", procedure, expectedState, error);
+        switch (error) {
+            case kPairingError_Authentication:
+            case kPairingError_Unavailable: {
+                return kHAPError_NotAuthorized;
+            }
+            case kPairingError_MaxPeers: {
+                return kHAPError_OutOfResources;
+            }
+            case kPairingError_Backoff:
+            case kPairingError_MaxTries:
+            case kPairingError_Busy: {
+                return kHAPError_Busy;
+            }
+            default: {
+                return kHAPError_Unknown;
+            }
+        }
+    }
+    if (!FindTLVWithLength(bytes, numBytes, kPairingTLVType_State, &state, sizeof state) || state != expectedState) {
+        HAPLogError(&logObject, "%s M%u: unexpected response.", procedure, expectedState);
+        return kHAPError_Unknown;
+    }
+    return kHAPError_None;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+
+/**
+ * Sends all bytes over the connection.
+ */
+HAP_RESULT_USE_CHECK
+static HAPError SendAll(ControllerSession* session, const uint8_t* bytes, size_t numBytes)
+{
+    while (numBytes) {
+        ssize_t n = send(session->fileDescriptor, bytes, numBytes, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            HAPLogError(&logObject, "send failed: %s.", n < 0 ? strerror(errno) : "connection closed");
+            return kHAPError_Unknown;
+        }
+        bytes += n;
+        numBytes -= (size_t) n;
+    }
+    return kHAPError_None;
+}
+
+/**
+ * Receives exactly the requested number of bytes from the connection.
+ */
+HAP_RESULT_USE_CHECK
+static HAPError ReceiveAll(ControllerSession* session, uint8_t* bytes, size_t numBytes)
+{
+    while (numBytes) {
+        ssize_t n = recv(session->fileDescriptor, bytes, numBytes, 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            HAPLogError(&logObject, "recv failed: %s.", n < 0 ? strerror(errno) : "connection closed");
+            return kHAPError_Unknown;
+        }
+        bytes += n;
+        numBytes -= (size_t) n;
+    }
+    return kHAPError_None;
+}
+
+/**
+ * Sends a message, encrypted if the session is secured.
+ */
+HAP_RESULT_USE_CHECK
+static HAPError SendMessage(ControllerSession* session, const uint8_t* bytes, size_t numBytes)
+{
+    if (!session->isSecure) {
+        return SendAll(session, bytes, numBytes);
+    }
+
+    uint8_t frame[2 + kController_MaxFrameBytes + CHACHA20_POLY1305_TAG_BYTES];
+    while (numBytes) {
+        size_t numFrameBytes = numBytes < kController_MaxFrameBytes ? numBytes : kController_MaxFrameBytes;
+        uint8_t nonce[8];
+        HAPWriteLittleUInt64(nonce, session->controllerToAccessoryCount);
+        HAPWriteLittleUInt16(frame, numFrameBytes);
+        HAP_chacha20_poly1305_encrypt_aad(
+                &frame[2 + numFrameBytes],
+                &frame[2],
+                bytes,
+                numFrameBytes,
+                frame,
+                2,
+                nonce,
+                sizeof nonce,
+                session->controllerToAccessoryKey);
+        session->controllerToAccessoryCount++;
+
+        HAPError err = SendAll(session, frame, 2 + numFrameBytes + CHACHA20_POLY1305_TAG_BYTES);
+        if (err) {
+            return err;
+        }
+        bytes += numFrameBytes;
+        numBytes -= numFrameBytes;
+    }
+    return kHAPError_None;
+}
+
+/**
+ * Receives more plaintext into the inbound buffer: one frame if the session is secured, or whatever is available
+ * otherwise.
+ */
+HAP_RESULT_USE_CHECK
+static HAPError ReceiveMore(ControllerSession* session)
+{
+    uint8_t* bytes = &session->inboundBytes[session->numInboundBytes];
+    size_t maxBytes = sizeof session->inboundBytes - session->numInboundBytes;
+
+    if (!session->isSecure) {
+        for (;;) {
+            ssize_t n = recv(session->fileDescriptor, bytes, maxBytes, 0);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                HAPLogError(&logObject, "recv failed: %s.", n < 0 ? strerror(errno) : "connection closed");
+                return kHAPError_Unknown;
+            }
+            session->numInboundBytes += (size_t) n;
+            return kHAPError_None;
+        }
+    }
+
+    uint8_t frame[2 + kController_MaxFrameBytes + CHACHA20_POLY1305_TAG_BYTES];
+    HAPError err = ReceiveAll(session, frame, 2);
+    if (err) {
+        return err;
+    }
+    size_t numFrameBytes = HAPReadLittleUInt16(frame);
+    if (numFrameBytes > kController_MaxFrameBytes || numFrameBytes > maxBytes) {
+        HAPLogError(&logObject, "Frame of %zu bytes too long.", numFrameBytes);
+        return kHAPError_Unknown;
+    }
+    err = ReceiveAll(session, &frame[2], numFrameBytes + CHACHA20_POLY1305_TAG_BYTES);
+    if (err) {
+        return err;
+    }
+    uint8_t nonce[8];
+    HAPWriteLittleUInt64(nonce, session->accessoryToControllerCount);
+    if (HAP_chacha20_poly1305_decrypt_aad(
+                &frame[2 + numFrameBytes],
+                bytes,
+                &frame[2],
+                numFrameBytes,
+                frame,
+                2,
+                nonce,
+                sizeof nonce,
+                session->accessoryToControllerKey) != 0) {
+        HAPLogError(&logObject, "Frame could not be decrypted.");
+        return kHAPError_Unknown;
+    }
+    session->accessoryToControllerCount++;
+    session->numInboundBytes += numFrameBytes;
+    return kHAPError_None;
+}
+
+/**
+ * Finds the empty line that ends the header of the received HTTP message.
+ *
+ * @return Start of the empty line, or NULL if the header is incomplete.
+ */
+static char* _Nullable FindHeaderEnd(ControllerSession* session)
+{
+    for (size_t i = 0; i + 4 <= session->numInboundBytes; i++) {
+        if (HAPRawBufferAreEqual(&session->inboundBytes[i], "\r\n\r\n", 4)) {
+            return (char*) &session->inboundBytes[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Receives an HTTP response. Event notifications received before the response are counted and skipped.
+ *
+ * @param      session              Controller session.
+ * @param[out] status               HTTP status code.
+ * @param[out] body                 Response body.
+ * @param      maxBodyBytes         Capacity of the body buffer.
+ * @param[out] numBodyBytes         Length of the response body.
+ */
+HAP_RESULT_USE_CHECK
+static HAPError ReceiveResponse(
+        ControllerSession* session,
+        unsigned* status,
+        uint8_t* _Nullable body,
+        size_t maxBodyBytes,
+        size_t* numBodyBytes)
+{
+    for (;;) {
+        // Wait for the complete header.
+        char* headerEnd;
+        for (;;) {
+            headerEnd = FindHeaderEnd(session);
+            if (headerEnd) {
+                break;
+            }
+            if (session->numInboundBytes == sizeof session->inboundBytes) {
+                HAPLogError(&logObject, "HTTP header too long.");
+                return kHAPError_Unknown;
+            }
+            HAPError err = ReceiveMore(session);
+            if (err) {
+                return err;
+            }
+        }
+        size_t numHeaderBytes = (size_t)((uint8_t*) headerEnd - session->inboundBytes) + 4;
+
+        // Status line and content length.
+        char* header = (char*) session->inboundBytes;
+        bool isEvent = numHeaderBytes >= 10 && !strncmp(header, "EVENT/1.0 ", 10);
+        if (!isEvent && (numHeaderBytes < 12 || strncmp(header, "HTTP/1.1 ", 9) != 0)) {
+            HAPLogError(&logObject, "Malformed HTTP response.");
+            return kHAPError_Unknown;
+        }
+        unsigned statusCode = (unsigned) strtoul(&header[isEvent ? 10 : 9], NULL, 10);
+        size_t numContentBytes = 0;
+        for (char* line = memchr(header, '\n', numHeaderBytes); line && line < headerEnd;
+             line = memchr(line, '\n', (size_t)(headerEnd - line))) {
+            line++;
+            if (!strncasecmp(line, "Content-Length:", 15)) {
+                numContentBytes = (size_t) strtoul(&line[15], NULL, 10);
+            }
+        }
+        if (numContentBytes > sizeof session->inboundBytes - numHeaderBytes) {
+            HAPLogError(&logObject, "HTTP body of %zu bytes too long.", numContentBytes);
+            return kHAPError_Unknown;
+        }
+
+        // Wait for the complete body.
+        while (session->numInboundBytes < numHeaderBytes + numContentBytes) {
+            HAPError err = ReceiveMore(session);
+            if (err) {
+                return err;
+            }
+        }
+
+        if (!isEvent) {
+            if (body && numContentBytes > maxBodyBytes) {
+                HAPLogError(&logObject, "HTTP body of %zu bytes too long.", numContentBytes);
+                return kHAPError_Unknown;
+            }
+            *status = statusCode;
+            *numBodyBytes = numContentBytes;
+            if (body && numContentBytes) {
+                HAPRawBufferCopyBytes(body, &session->inboundBytes[numHeaderBytes], numContentBytes);
+            }
+        } else {
+            session->numEvents++;
+        }
+
+        // Consume the message.
+        size_t numMessageBytes = numHeaderBytes + numContentBytes;
+        session->numInboundBytes -= numMessageBytes;
+        memmove(session->inboundBytes, &session->inboundBytes[numMessageBytes], session->numInboundBytes);
+        if (!isEvent) {
+            return kHAPError_None;
+        }
+    }
+}
+
+/**
+ * Performs an HTTP request.
+ *
+ * @param      session              Controller session.
+ * @param      method               HTTP method.
+ * @param      path                 Request path.
+ * @param      contentType          Content type of the request body, or NULL if there is no body.
+ * @param      body                 Request body.
+ * @param      numBodyBytes         Length of the request body.
+ * @param[out] status               HTTP status code.
+ * @param[out] responseBody         Response body, or NULL to discard it.
+ * @param      maxResponseBodyBytes Capacity of the response body buffer.
+ * @param[out] numResponseBodyBytes Length of the response body.
+ */
+HAP_RESULT_USE_CHECK
+static HAPError PerformRequest(
+        ControllerSession* session,
+        const char* method,
+        const char* path,
+        const char* _Nullable contentType,
+        const void* _Nullable body,
+        size_t numBodyBytes,
+        unsigned* status,
+        uint8_t* _Nullable responseBody,
+        size_t maxResponseBodyBytes,
+        size_t* numResponseBodyBytes)
+{
+    char* request = (char*) session->outboundBytes;
+    size_t maxRequestBytes = sizeof session->outboundBytes;
+    int n = contentType ? snprintf(request,
+                                  maxRequestBytes,
+                                  "%s %s HTTP/1.1\r\nHost: hapload\r\nContent-Type: %s\r\nContent-Length: %zu\r\n\r\n",
+                                  method,
+                                  path,
+                                  contentType,
+                                  numBodyBytes) :
+                          snprintf(request, maxRequestBytes, "%s %s HTTP/1.1\r\nHost: hapload\r\n\r\n", method, path);
+    if (n < 0 || (size_t) n + numBodyBytes > maxRequestBytes) {
+        HAPLogError(&logObject, "%s %s: request too long.", method, path);
+        return kHAPError_OutOfResources;
+    }
+    if (numBodyBytes) {
+        HAPRawBufferCopyBytes(&request[n], body, numBodyBytes);
+    }
+
+    HAPError err = SendMessage(session, session->outboundBytes, (size_t) n + numBodyBytes);
+    if (err) {
+        return err;
+    }
+    return ReceiveResponse(session, status, responseBody, maxResponseBodyBytes, numResponseBodyBytes);
+}
+
+/**
+ * Exchanges TLV8 messages of a pairing procedure.
+ */
+HAP_RESULT_USE_CHECK
+static HAPError PostTLV(
+        ControllerSession* session,
+        const char* path,
+        const TLVWriter* request,
+        uint8_t* response,
+        size_t maxResponseBytes,
+        size_t* numResponseBytes)
+{
+    unsigned status;
+    HAPError err = PerformRequest(
+            session,
+            "POST",
+            path,
+            "application/pairing+tlv8",
+            request->bytes,
+            request->numBytes,
+            &status,
+            response,
+            maxResponseBytes,
+            numResponseBytes);
+    if (err) {
+        return err;
+    }
+    if (status != 200) {
+        HAPLogError(&logObject, "POST %s: HTTP status %u.", path, status);
+        return kHAPError_Unknown;
+    }
+    return kHAPError_None;
+}
+
+/**
+ * Performs a request on /characteristics and checks for the expected status.
+ */
+HAP_RESULT_USE_CHECK
+static HAPError PerformCharacteristicsRequest(
+        ControllerSession* session,
+        const char* method,
+        const char* path,
+        const char* _Nullable body,
+        unsigned expectedStatus)
+{
+    unsigned status;
+    size_t numResponseBytes;
+    HAPError err = PerformRequest(
+            session,
+            method,
+            path,
+            body ? "application/hap+json" : NULL,
+            body,
+            body ? strlen(body) : 0,
+            &status,
+            NULL,
+            0,
+            &numResponseBytes);
+    if (err) {
+        return err;
+    }
+    if (status != expectedStatus) {
+        HAPLogError(&logObject, "%s %s: HTTP status %u.", method, path, status);
+        return kHAPError_Unknown;
+    }
+    return kHAPError_None;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+
+void ControllerIdentityCreate(ControllerIdentity* identity)
+{
+    HAPPrecondition(identity);
+
+    uint8_t uuid[16];
+    FillRandom(uuid, sizeof uuid);
+    uuid[6] = (uint8_t)((uuid[6] & 0x0F) | 0x40);
+    uuid[8] = (uint8_t)((uuid[8] & 0x3F) | 0x80);
+    snprintf(
+            identity->pairingID,
+            sizeof identity->pairingID,
+            "%02X%02X%02X%02X-%02X%02X-%02X%02X-%02X%02X-%02X%02X%02X%02X%02X%02X",
+            uuid[0], uuid[1], uuid[2], uuid[3], uuid[4], uuid[5], uuid[6], uuid[7],
+            uuid[8], uuid[9], uuid[10], uuid[11], uuid[12], uuid[13], uuid[14], uuid[15]);
+    FillRandom(identity->secretKey, sizeof identity->secretKey);
+    ControllerIdentityDerivePublicKey(identity);
+}
+
+void ControllerIdentityDerivePublicKey(ControllerIdentity* identity)
+{
+    HAPPrecondition(identity);
+
+    HAP_ed25519_public_key(identity->publicKey, identity->secretKey);
+}
+
+HAPError ControllerSessionOpen(ControllerSession* session, const struct sockaddr* address, socklen_t numAddressBytes)
+{
+    HAPPrecondition(session);
+    HAPPrecondition(address);
+
+    session->isSecure = false;
+    session->numInboundBytes = 0;
+    session->controllerToAccessoryCount = 0;
+    session->accessoryToControllerCount = 0;
+
+    session->fileDescriptor = socket(address->sa_family, SOCK_STREAM, 0);
+    if (session->fileDescriptor < 0) {
+        HAPLogError(&logObject, "socket failed: %s.", strerror(errno));
+        return kHAPError_Unknown;
+    }
+
+    // Requests are written in one piece and should not wait for the acknowledgement of the previous response.
+    int v = 1;
+    (void) setsockopt(session->fileDescriptor, IPPROTO_TCP, TCP_NODELAY, &v, sizeof v);
+
+    struct timeval timeout = { .tv_sec = (time_t)(kController_Timeout / HAPSecond),
+                               .tv_usec = (suseconds_t)(kController_Timeout % HAPSecond * 1000) };
+    (void) setsockopt(session->fileDescriptor, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof timeout);
+    (void) setsockopt(session->fileDescriptor, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof timeout);
+
+    if (connect(session->fileDescriptor, address, numAddressBytes) != 0) {
+        HAPLogError(&logObject, "connect failed: %s.", strerror(errno));
+        ControllerSessionClose(session);
+        return kHAPError_Unknown;
+    }
+    return kHAPError_None;
+}
+
+void ControllerSessionClose(ControllerSession* session)
+{
+    HAPPrecondition(session);
+
+    if (session->fileDescriptor >= 0) {
+        (void) close(session->fileDescriptor);
+        session->fileDescriptor = -1;
+    }
+    session->isSecure = false;
+    session->numInboundBytes = 0;
+}
+
+/**
+ * Client side of SRP-6a as used by pair-setup.
+ *
+ * @param      setupCode            Setup code.
+ * @param      salt                 Salt chosen by the accessory.
+ * @param      publicKeyB           Public key of the accessory.
+ * @param[out] publicKeyA           Public key of the controller.
+ * @param[out] sessionKey           Shared session key.
+ * @param[out] proofM1              Proof of the controller.
+ * @param[out] expectedProofM2      Proof expected from the accessory.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_Unknown        If the public key of the accessory is invalid.
+ */
+HAP_RESULT_USE_CHECK
+static HAPError ComputeSRPClientProof(
+        const char* setupCode,
+        const uint8_t salt[SRP_SALT_BYTES],
+        const uint8_t publicKeyB[SRP_PUBLIC_KEY_BYTES],
+        uint8_t publicKeyA[SRP_PUBLIC_KEY_BYTES],
+        uint8_t sessionKey[SRP_SESSION_KEY_BYTES],
+        uint8_t proofM1[SRP_PROOF_BYTES],
+        uint8_t expectedProofM2[SRP_PROOF_BYTES])
+{
+    HAPError err = kHAPError_Unknown;
+
+    // x = H(s | H(I | ":" | P)).
+    char identity[64];
+    int numIdentityBytes = snprintf(identity, sizeof identity, "%s:%s", kSRPUserName, setupCode);
+    if (numIdentityBytes < 0 || (size_t) numIdentityBytes >= sizeof identity) {
+        HAPLogError(&logObject, "Invalid setup code.");
+        return kHAPError_Unknown;
+    }
+    uint8_t hash[SHA512_BYTES + SRP_SALT_BYTES];
+    HAPRawBufferCopyBytes(hash, salt, SRP_SALT_BYTES);
+    HAP_sha512(&hash[SRP_SALT_BYTES], (const uint8_t*) identity, (size_t) numIdentityBytes);
+    uint8_t x[SHA512_BYTES];
+    HAP_sha512(x, hash, sizeof hash);
+
+    // v = g^x.
+    uint8_t v[SRP_VERIFIER_BYTES];
+    HAP_srp_verifier(
+            v, salt, (const uint8_t*) kSRPUserName, sizeof kSRPUserName - 1, (const uint8_t*) setupCode, strlen(setupCode));
+
+    // k = H(N | PAD(g)).
+    uint8_t kInput[2 * SRP_PRIME_BYTES] = { 0 };
+    HAPRawBufferCopyBytes(kInput, kSRPPrime, SRP_PRIME_BYTES);
+    kInput[sizeof kInput - 1] = kSRPGenerator;
+    uint8_t k[SHA512_BYTES];
+    HAP_sha512(k, kInput, sizeof kInput);
+
+    uint8_t a[SRP_SECRET_KEY_BYTES];
+    FillRandom(a, sizeof a);
+
+    uint8_t u[SRP_SCRAMBLING_PARAMETER_BYTES];
+    uint8_t premasterSecret[SRP_PREMASTER_SECRET_BYTES];
+
+    mbedtls_mpi N, G, A, B, X, K, V, U, E, T, S;
+    mbedtls_mpi_init(&N);
+    mbedtls_mpi_init(&G);
+    mbedtls_mpi_init(&A);
+    mbedtls_mpi_init(&B);
+    mbedtls_mpi_init(&X);
+    mbedtls_mpi_init(&K);
+    mbedtls_mpi_init(&V);
+    mbedtls_mpi_init(&U);
+    mbedtls_mpi_init(&E);
+    mbedtls_mpi_init(&T);
+    mbedtls_mpi_init(&S);
+
+    if (mbedtls_mpi_read_binary(&N, kSRPPrime, SRP_PRIME_BYTES) || mbedtls_mpi_lset(&G, kSRPGenerator) ||
+        mbedtls_mpi_read_binary(&B, publicKeyB, SRP_PUBLIC_KEY_BYTES) || mbedtls_mpi_read_binary(&X, x, sizeof x) ||
+        mbedtls_mpi_read_binary(&K, k, sizeof k) || mbedtls_mpi_read_binary(&V, v, sizeof v)) {
+        goto cleanup;
+    }
+
+    // B must not be 0 mod N.
+    if (mbedtls_mpi_mod_mpi(&T, &B, &N) || !mbedtls_mpi_cmp_int(&T, 0)) {
+        HAPLogError(&logObject, "Invalid SRP public key of the accessory.");
+        goto cleanup;
+    }
+
+    // A = g^a.
+    if (mbedtls_mpi_read_binary(&E, a, sizeof a) || mbedtls_mpi_exp_mod(&A, &G, &E, &N, NULL) ||
+        mbedtls_mpi_write_binary(&A, publicKeyA, SRP_PUBLIC_KEY_BYTES)) {
+        goto cleanup;
+    }
+
+    // u = H(A | B).
+    HAP_srp_scrambling_parameter(u, publicKeyA, publicKeyB);
+
+    // S = (B - k * v)^(a + u * x).
+    if (mbedtls_mpi_read_binary(&U, u, sizeof u) || mbedtls_mpi_mul_mpi(&T, &K, &V) ||
+        mbedtls_mpi_sub_mpi(&T, &B, &T) || mbedtls_mpi_mod_mpi(&T, &T, &N) || mbedtls_mpi_mul_mpi(&U, &U, &X) ||
+        mbedtls_mpi_add_mpi(&E, &E, &U) || mbedtls_mpi_exp_mod(&S, &T, &E, &N, NULL) ||
+        mbedtls_mpi_write_binary(&S, premasterSecret, sizeof premasterSecret)) {
+        goto cleanup;
+    }
+
+    HAP_srp_session_key(sessionKey, premasterSecret);
+    HAP_srp_proof_m1(
+            proofM1, (const uint8_t*) kSRPUserName, sizeof kSRPUserName - 1, salt, publicKeyA, publicKeyB, sessionKey);
+    HAP_srp_proof_m2(expectedProofM2, publicKeyA, proofM1, sessionKey);
+    err = kHAPError_None;
+
+cleanup:
+    mbedtls_mpi_free(&N);
+    mbedtls_mpi_free(&G);
+    mbedtls_mpi_free(&A);
+    mbedtls_mpi_free(&B);
+    mbedtls_mpi_free(&X);
+    mbedtls_mpi_free(&K);
+    mbedtls_mpi_free(&V);
+    mbedtls_mpi_free(&U);
+    mbedtls_mpi_free(&E);
+    mbedtls_mpi_free(&T);
+    mbedtls_mpi_free(&S);
+    HAPRawBufferZero(a, sizeof a);
+    HAPRawBufferZero(x, sizeof x);
+    HAPRawBufferZero(premasterSecret, sizeof premasterSecret);
+    return err;
+}
+
+HAPError ControllerPairSetup(
+        ControllerSession* session,
+        const char* setupCode,
+        const ControllerIdentity* controller,
+        ControllerAccessoryIdentity* accessory)
+{
+    HAPPrecondition(session);
+    HAPPrecondition(!session->isSecure);
+    HAPPrecondition(setupCode);
+    HAPPrecondition(controller);
+    HAPPrecondition(accessory);
+
+    HAPError err;
+    uint8_t requestBytes[1024];
+    TLVWriter request = { .bytes = requestBytes, .maxBytes = sizeof requestBytes };
+    uint8_t response[1024];
+    size_t numResponseBytes;
+
+    // M1: SRP start request.
+    if ((err = AppendTLVUInt8(&request, kPairingTLVType_State, 1)) ||
+        (err = AppendTLVUInt8(&request, kPairingTLVType_Method, kPairingMethod_PairSetup))) {
+        return err;
+    }
+    err = PostTLV(session, "/pair-setup", &request, response, sizeof response, &numResponseBytes);
+    if (err) {
+        return err;
+    }
+
+    // M2: SRP start response.
+    err = CheckPairingResponse(response, numResponseBytes, 2, "Pair Setup");
+    if (err) {
+        return err;
+    }
+    uint8_t salt[SRP_SALT_BYTES];
+    uint8_t publicKeyB[SRP_PUBLIC_KEY_BYTES] = { 0 };
+    size_t numPublicKeyBBytes;
+    if (!FindTLVWithLength(response, numResponseBytes, kPairingTLVType_Salt, salt, sizeof salt) ||
+        !FindTLV(response,
+                 numResponseBytes,
+                 kPairingTLVType_PublicKey,
+                 publicKeyB,
+                 sizeof publicKeyB,
+                 &numPublicKeyBBytes)) {
+        HAPLogError(&logObject, "Pair Setup M2: malformed response.");
+        return kHAPError_Unknown;
+    }
+    // Left-pad B to the length of the prime.
+    memmove(&publicKeyB[sizeof publicKeyB - numPublicKeyBBytes], publicKeyB, numPublicKeyBBytes);
+    HAPRawBufferZero(publicKeyB, sizeof publicKeyB - numPublicKeyBBytes);
+
+    // M3: SRP verify request.
+    uint8_t publicKeyA[SRP_PUBLIC_KEY_BYTES];
+    uint8_t sessionKey[SRP_SESSION_KEY_BYTES];
+    uint8_t proofM1[SRP_PROOF_BYTES];
+    uint8_t expectedProofM2[SRP_PROOF_BYTES];
+    err = ComputeSRPClientProof(setupCode, salt, publicKeyB, publicKeyA, sessionKey, proofM1, expectedProofM2);
+    if (err) {
+        return err;
+    }
+    request.numBytes = 0;
+    if ((err = AppendTLVUInt8(&request, kPairingTLVType_State, 3)) ||
+        (err = AppendTLV(&request, kPairingTLVType_PublicKey, publicKeyA, sizeof publicKeyA)) ||
+        (err = AppendTLV(&request, kPairingTLVType_Proof, proofM1, sizeof proofM1))) {
+        return err;
+    }
+    err = PostTLV(session, "/pair-setup", &request, response, sizeof response, &numResponseBytes);
+    if (err) {
+        return err;
+    }
+
+    // M4: SRP verify response.
+    err = CheckPairingResponse(response, numResponseBytes, 4, "Pair Setup");
+    if (err) {
+        return err;
+    }
+    uint8_t proofM2[SRP_PROOF_BYTES];
+    if (!FindTLVWithLength(response, numResponseBytes, kPairingTLVType_Proof, proofM2, sizeof proofM2) ||
+        !HAPRawBufferAreEqual(proofM2, expectedProofM2, sizeof proofM2)) {
+        HAPLogError(&logObject, "Pair Setup M4: accessory could not be authenticated.");
+        return kHAPError_Unknown;
+    }
+
+    // M5: exchange request.
+    uint8_t encryptionKey[CHACHA20_POLY1305_KEY_BYTES];
+    DeriveKey(encryptionKey, sessionKey, sizeof sessionKey, "Pair-Setup-Encrypt-Salt", "Pair-Setup-Encrypt-Info");
+
+    uint8_t info[32 + kController_MaxPairingIDBytes + ED25519_PUBLIC_KEY_BYTES];
+    size_t numPairingIDBytes = strlen(controller->pairingID);
+    DeriveKey(
+            info,
+            sessionKey,
+            sizeof sessionKey,
+            "Pair-Setup-Controller-Sign-Salt",
+            "Pair-Setup-Controller-Sign-Info");
+    HAPRawBufferCopyBytes(&info[32], controller->pairingID, numPairingIDBytes);
+    HAPRawBufferCopyBytes(&info[32 + numPairingIDBytes], controller->publicKey, ED25519_PUBLIC_KEY_BYTES);
+    uint8_t signature[ED25519_BYTES];
+    HAP_ed25519_sign(
+            signature,
+            info,
+            32 + numPairingIDBytes + ED25519_PUBLIC_KEY_BYTES,
+            controller->secretKey,
+            controller->publicKey);
+
+    uint8_t subBytes[256];
+    TLVWriter sub = { .bytes = subBytes, .maxBytes = sizeof subBytes - CHACHA20_POLY1305_TAG_BYTES };
+    if ((err = AppendTLV(&sub, kPairingTLVType_Identifier, controller->pairingID, numPairingIDBytes)) ||
+        (err = AppendTLV(&sub, kPairingTLVType_PublicKey, controller->publicKey, ED25519_PUBLIC_KEY_BYTES)) ||
+        (err = AppendTLV(&sub, kPairingTLVType_Signature, signature, sizeof signature))) {
+        return err;
+    }
+    HAP_chacha20_poly1305_encrypt(
+            &subBytes[sub.numBytes], subBytes, subBytes, sub.numBytes, (const uint8_t*) "PS-Msg05", 8, encryptionKey);
+    request.numBytes = 0;
+    if ((err = AppendTLVUInt8(&request, kPairingTLVType_State, 5)) ||
+        (err = AppendTLV(
+                 &request, kPairingTLVType_EncryptedData, subBytes, sub.numBytes + CHACHA20_POLY1305_TAG_BYTES))) {
+        return err;
+    }
+    err = PostTLV(session, "/pair-setup", &request, response, sizeof response, &numResponseBytes);
+    if (err) {
+        return err;
+    }
+
+    // M6: exchange response.
+    err = CheckPairingResponse(response, numResponseBytes, 6, "Pair Setup");
+    if (err) {
+        return err;
+    }
+    size_t numEncryptedBytes;
+    if (!FindTLV(response, numResponseBytes, kPairingTLVType_EncryptedData, subBytes, sizeof subBytes, &numEncryptedBytes) ||
+        numEncryptedBytes < CHACHA20_POLY1305_TAG_BYTES) {
+        HAPLogError(&logObject, "Pair Setup M6: malformed response.");
+        return kHAPError_Unknown;
+    }
+    numEncryptedBytes -= CHACHA20_POLY1305_TAG_BYTES;
+    if (HAP_chacha20_poly1305_decrypt(
+                &subBytes[numEncryptedBytes],
+                subBytes,
+                subBytes,
+                numEncryptedBytes,
+                (const uint8_t*) "PS-Msg06",
+                8,
+                encryptionKey) != 0) {
+        HAPLogError(&logObject, "Pair Setup M6: decryption failed.");
+        return kHAPError_Unknown;
+    }
+    size_t numAccessoryPairingIDBytes;
+    HAPRawBufferZero(accessory, sizeof *accessory);
+    if (!FindTLV(subBytes,
+                 numEncryptedBytes,
+                 kPairingTLVType_Identifier,
+                 (uint8_t*) accessory->pairingID,
+                 kController_MaxAccessoryPairingIDBytes,
+                 &numAccessoryPairingIDBytes) ||
+        !FindTLVWithLength(
+                subBytes, numEncryptedBytes, kPairingTLVType_PublicKey, accessory->publicKey, ED25519_PUBLIC_KEY_BYTES) ||
+        !FindTLVWithLength(subBytes, numEncryptedBytes, kPairingTLVType_Signature, signature, sizeof signature)) {
+        HAPLogError(&logObject, "Pair Setup M6: malformed response.");
+        return kHAPError_Unknown;
+    }
+    DeriveKey(
+            info, sessionKey, sizeof sessionKey, "Pair-Setup-Accessory-Sign-Salt", "Pair-Setup-Accessory-Sign-Info");
+    HAPRawBufferCopyBytes(&info[32], accessory->pairingID, numAccessoryPairingIDBytes);
+    HAPRawBufferCopyBytes(&info[32 + numAccessoryPairingIDBytes], accessory->publicKey, ED25519_PUBLIC_KEY_BYTES);
+    if (HAP_ed25519_verify(
+                signature, info, 32 + numAccessoryPairingIDBytes + ED25519_PUBLIC_KEY_BYTES, accessory->publicKey) !=
+        0) {
+        HAPLogError(&logObject, "Pair Setup M6: accessory signature is invalid.");
+        return kHAPError_Unknown;
+    }
+    return kHAPError_None;
+}
+
+HAPError ControllerPairVerify(
+        ControllerSession* session,
+        const ControllerIdentity* controller,
+        const ControllerAccessoryIdentity* accessory)
+{
+    HAPPrecondition(session);
+    HAPPrecondition(!session->isSecure);
+    HAPPrecondition(controller);
+    HAPPrecondition(accessory);
+
+    HAPError err;
+    uint8_t requestBytes[256];
+    TLVWriter request = { .bytes = requestBytes, .maxBytes = sizeof requestBytes };
+    uint8_t response[512];
+    size_t numResponseBytes;
+
+    // M1: verify start request.
+    uint8_t secretKey[X25519_SCALAR_BYTES];
+    uint8_t publicKey[X25519_BYTES];
+    FillRandom(secretKey, sizeof secretKey);
+    HAP_X25519_scalarmult_base(publicKey, secretKey);
+    if ((err = AppendTLVUInt8(&request, kPairingTLVType_State, 1)) ||
+        (err = AppendTLV(&request, kPairingTLVType_PublicKey, publicKey, sizeof publicKey))) {
+        return err;
+    }
+    err = PostTLV(session, "/pair-verify", &request, response, sizeof response, &numResponseBytes);
+    if (err) {
+        return err;
+    }
+
+    // M2: verify start response.
+    err = CheckPairingResponse(response, numResponseBytes, 2, "Pair Verify");
+    if (err) {
+        return err;
+    }
+    uint8_t accessoryPublicKey[X25519_BYTES];
+    uint8_t subBytes[256];
+    size_t numEncryptedBytes;
+    if (!FindTLVWithLength(
+                response, numResponseBytes, kPairingTLVType_PublicKey, accessoryPublicKey, sizeof accessoryPublicKey) ||
+        !FindTLV(response, numResponseBytes, kPairingTLVType_EncryptedData, subBytes, sizeof subBytes, &numEncryptedBytes) ||
+        numEncryptedBytes < CHACHA20_POLY1305_TAG_BYTES) {
+        HAPLogError(&logObject, "Pair Verify M2: malformed response.");
+        return kHAPError_Unknown;
+    }
+    uint8_t sharedSecret[X25519_BYTES];
+    HAP_X25519_scalarmult(sharedSecret, secretKey, accessoryPublicKey);
+    HAPRawBufferZero(secretKey, sizeof secretKey);
+    uint8_t encryptionKey[CHACHA20_POLY1305_KEY_BYTES];
+    DeriveKey(encryptionKey, sharedSecret, sizeof sharedSecret, "Pair-Verify-Encrypt-Salt", "Pair-Verify-Encrypt-Info");
+
+    numEncryptedBytes -= CHACHA20_POLY1305_TAG_BYTES;
+    if (HAP_chacha20_poly1305_decrypt(
+                &subBytes[numEncryptedBytes],
+                subBytes,
+                subBytes,
+                numEncryptedBytes,
+                (const uint8_t*) "PV-Msg02",
+                8,
+                encryptionKey) != 0) {
+        HAPLogError(&logObject, "Pair Verify M2: decryption failed.");
+        return kHAPError_Unknown;
+    }
+    char accessoryPairingID[kController_MaxAccessoryPairingIDBytes + 1] = { 0 };
+    size_t numAccessoryPairingIDBytes;
+    uint8_t signature[ED25519_BYTES];
+    if (!FindTLV(subBytes,
+                 numEncryptedBytes,
+                 kPairingTLVType_Identifier,
+                 (uint8_t*) accessoryPairingID,
+                 kController_MaxAccessoryPairingIDBytes,
+                 &numAccessoryPairingIDBytes) ||
+        !FindTLVWithLength(subBytes, numEncryptedBytes, kPairingTLVType_Signature, signature, sizeof signature)) {
+        HAPLogError(&logObject, "Pair Verify M2: malformed response.");
+        return kHAPError_Unknown;
+    }
+    if (strcmp(accessoryPairingID, accessory->pairingID) != 0) {
+        HAPLogError(&logObject, "Pair Verify M2: unexpected accessory %s.", accessoryPairingID);
+        return kHAPError_Unknown;
+    }
+
+    // Accessory signature over its public key, pairing ID and the controller public key.
+    uint8_t info[X25519_BYTES + kController_MaxPairingIDBytes + X25519_BYTES];
+    HAPRawBufferCopyBytes(info, accessoryPublicKey, X25519_BYTES);
+    HAPRawBufferCopyBytes(&info[X25519_BYTES], accessoryPairingID, numAccessoryPairingIDBytes);
+    HAPRawBufferCopyBytes(&info[X25519_BYTES + numAccessoryPairingIDBytes], publicKey, X25519_BYTES);
+    if (HAP_ed25519_verify(signature, info, X25519_BYTES + numAccessoryPairingIDBytes + X25519_BYTES, accessory->publicKey) !=
+        0) {
+        HAPLogError(&logObject, "Pair Verify M2: accessory signature is invalid.");
+        return kHAPError_Unknown;
+    }
+
+    // M3: verify finish request.
+    size_t numPairingIDBytes = strlen(controller->pairingID);
+    HAPRawBufferCopyBytes(info, publicKey, X25519_BYTES);
+    HAPRawBufferCopyBytes(&info[X25519_BYTES], controller->pairingID, numPairingIDBytes);
+    HAPRawBufferCopyBytes(&info[X25519_BYTES + numPairingIDBytes], accessoryPublicKey, X25519_BYTES);
+    HAP_ed25519_sign(
+            signature,
+            info,
+            X25519_BYTES + numPairingIDBytes + X25519_BYTES,
+            controller->secretKey,
+            controller->publicKey);
+    TLVWriter sub = { .bytes = subBytes, .maxBytes = sizeof subBytes - CHACHA20_POLY1305_TAG_BYTES };
+    if ((err = AppendTLV(&sub, kPairingTLVType_Identifier, controller->pairingID, numPairingIDBytes)) ||
+        (err = AppendTLV(&sub, kPairingTLVType_Signature, signature, sizeof signature))) {
+        return err;
+    }
+    HAP_chacha20_poly1305_encrypt(
+            &subBytes[sub.numBytes], subBytes, subBytes, sub.numBytes, (const uint8_t*) "PV-Msg03", 8, encryptionKey);
+    request.numBytes = 0;
+    if ((err = AppendTLVUInt8(&request, kPairingTLVType_State, 3)) ||
+        (err = AppendTLV(
+                 &request, kPairingTLVType_EncryptedData, subBytes, sub.numBytes + CHACHA20_POLY1305_TAG_BYTES))) {
+        return err;
+    }
+    err = PostTLV(session, "/pair-verify", &request, response, sizeof response, &numResponseBytes);
+    if (err) {
+        return err;
+    }
+
+    // M4: verify finish response.
+    err = CheckPairingResponse(response, numResponseBytes, 4, "Pair Verify");
+    if (err) {
+        return err;
+    }
+
+    // All further messages are encrypted with the control channel keys.
+    DeriveKey(
+            session->controllerToAccessoryKey,
+            sharedSecret,
+            sizeof sharedSecret,
+            "Control-Salt",
+            "Control-Write-Encryption-Key");
+    DeriveKey(
+            session->accessoryToControllerKey,
+            sharedSecret,
+            sizeof sharedSecret,
+            "Control-Salt",
+            "Control-Read-Encryption-Key");
+    HAPRawBufferZero(sharedSecret, sizeof sharedSecret);
+    session->controllerToAccessoryCount = 0;
+    session->accessoryToControllerCount = 0;
+    session->isSecure = true;
+    return kHAPError_None;
+}
+
+HAPError ControllerAddPairing(ControllerSession* session, const ControllerIdentity* controller, bool isAdmin)
+{
+    HAPPrecondition(session);
+    HAPPrecondition(session->isSecure);
+    HAPPrecondition(controller);
+
+    HAPError err;
+    uint8_t requestBytes[128];
+    TLVWriter request = { .bytes = requestBytes, .maxBytes = sizeof requestBytes };
+    uint8_t response[64];
+    size_t numResponseBytes;
+
+    if ((err = AppendTLVUInt8(&request, kPairingTLVType_State, 1)) ||
+        (err = AppendTLVUInt8(&request, kPairingTLVType_Method, kPairingMethod_AddPairing)) ||
+        (err = AppendTLV(&request, kPairingTLVType_Identifier, controller->pairingID, strlen(controller->pairingID))) ||
+        (err = AppendTLV(&request, kPairingTLVType_PublicKey, controller->publicKey, ED25519_PUBLIC_KEY_BYTES)) ||
+        (err = AppendTLVUInt8(&request, kPairingTLVType_Permissions, isAdmin ? 1 : 0))) {
+        return err;
+    }
+    err = PostTLV(session, "/pairings", &request, response, sizeof response, &numResponseBytes);
+    if (err) {
+        return err;
+    }
+    return CheckPairingResponse(response, numResponseBytes, 2, "Add Pairing");
+}
+
+HAPError ControllerReadCharacteristics(ControllerSession* session, const char* ids)
+{
+    HAPPrecondition(session);
+    HAPPrecondition(session->isSecure);
+    HAPPrecondition(ids);
+
+    char path[256];
+    int n = snprintf(path, sizeof path, "/characteristics?id=%s", ids);
+    if (n < 0 || (size_t) n >= sizeof path) {
+        return kHAPError_OutOfResources;
+    }
+    return PerformCharacteristicsRequest(session, "GET", path, NULL, 200);
+}
+
+HAPError ControllerWriteCharacteristic(ControllerSession* session, uint64_t aid, uint64_t iid, const char* value)
+{
+    HAPPrecondition(session);
+    HAPPrecondition(session->isSecure);
+    HAPPrecondition(value);
+
+    char body[256];
+    int n = snprintf(
+            body,
+            sizeof body,
+            "{\"characteristics\":[{\"aid\":%llu,\"iid\":%llu,\"value\":%s}]}",
+            (unsigned long long) aid,
+            (unsigned long long) iid,
+            value);
+    if (n < 0 || (size_t) n >= sizeof body) {
+        return kHAPError_OutOfResources;
+    }
+    // A partial failure is reported as 207 Multi-Status.
+    return PerformCharacteristicsRequest(session, "PUT", "/characteristics", body, 204);
+}
+
+HAPError ControllerSubscribeCharacteristics(ControllerSession* session, const char* ids)
+{
+    HAPPrecondition(session);
+    HAPPrecondition(session->isSecure);
+    HAPPrecondition(ids);
+
+    char body[1024];
+    size_t numBodyBytes = 0;
+    int n = snprintf(body, sizeof body, "{\"characteristics\":[");
+    HAPAssert(n > 0);
+    numBodyBytes += (size_t) n;
+    for (const char* id = ids; *id;) {
+        bool isFirst = id == ids;
+        unsigned long long aid, iid;
+        int numIDBytes;
+        if (sscanf(id, "%llu.%llu%n", &aid, &iid, &numIDBytes) != 2) {
+            HAPLogError(&logObject, "Invalid characteristic list: %s.", ids);
+            return kHAPError_InvalidData;
+        }
+        id += numIDBytes;
+        n = snprintf(
+                &body[numBodyBytes],
+                sizeof body - numBodyBytes,
+                "%s{\"aid\":%llu,\"iid\":%llu,\"ev\":true}",
+                isFirst ? "" : ",",
+                aid,
+                iid);
+        if (n < 0 || (size_t) n >= sizeof body - numBodyBytes) {
+            return kHAPError_OutOfResources;
+        }
+        numBodyBytes += (size_t) n;
+        if (*id == ',') {
+            id++;
+        }
+    }
+    n = snprintf(&body[numBodyBytes], sizeof body - numBodyBytes, "]}");
+    if (n < 0 || (size_t) n >= sizeof body - numBodyBytes) {
+        return kHAPError_OutOfResources;
+    }
+    return PerformCharacteristicsRequest(session, "PUT", "/characteristics", body, 204);
+}
@@ -0,0 +1,209 @@
+//  Copyright 2022 John Buonagurio
+//
+//  Distributed under the Boost Software License, Version 1.0.
+//
+//  See accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt
+
+#pragma once
+
+#include <HAP.h>
+
+#include <sys/socket.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Maximum length of a controller pairing identifier.
+ */
+#define kController_MaxPairingIDBytes ((size_t) 36)
+
+/**
+ * Maximum length of an accessory pairing identifier ("XX:XX:XX:XX:XX:XX").
+ */
+#define kController_MaxAccessoryPairingIDBytes ((size_t) 17)
+
+/**
+ * Maximum size of an HTTP message exchanged with the accessory.
+ */
+#define kController_MaxMessageBytes ((size_t) 4096)
+
+/**
+ * Send and receive timeout of a controller session.
+ */
+#define kController_Timeout ((HAPTime)(10 * HAPSecond))
+
+/**
+ * Long-term identity of a controller.
+ */
+typedef struct {
+    char pairingID[kController_MaxPairingIDBytes + 1];
+    uint8_t secretKey[ED25519_SECRET_KEY_BYTES];
+    uint8_t publicKey[ED25519_PUBLIC_KEY_BYTES];
+} ControllerIdentity;
+
+/**
+ * Long-term identity of the accessory, as learned during pair-setup.
+ */
+typedef struct {
+    char pairingID[kController_MaxAccessoryPairingIDBytes + 1];
+    uint8_t publicKey[ED25519_PUBLIC_KEY_BYTES];
+} ControllerAccessoryIdentity;
+
+/**
+ * Connection of a controller to the accessory.
+ *
+ * After pair-verify, all messages are exchanged in encrypted frames. Event notifications that arrive while waiting for
+ * a response are counted and skipped.
+ */
+typedef struct {
+    int fileDescriptor;
+    bool isSecure;
+
+    uint8_t controllerToAccessoryKey[CHACHA20_POLY1305_KEY_BYTES];
+    uint8_t accessoryToControllerKey[CHACHA20_POLY1305_KEY_BYTES];
+    uint64_t controllerToAccessoryCount;
+    uint64_t accessoryToControllerCount;
+
+    // Received plaintext that has not been consumed yet.
+    uint8_t inboundBytes[kController_MaxMessageBytes];
+    size_t numInboundBytes;
+
+    // Scratch space for outbound messages and frames.
+    uint8_t outboundBytes[kController_MaxMessageBytes + 64];
+
+    // Number of event notifications received.
+    uint64_t numEvents;
+} ControllerSession;
+
+/**
+ * Creates a controller identity with a random pairing identifier and a new long-term key pair.
+ *
+ * @param[out] identity             Controller identity.
+ */
+void ControllerIdentityCreate(ControllerIdentity* identity);
+
+/**
+ * Derives the public key of a controller identity from its secret key.
+ *
+ * @param      identity             Controller identity with pairing identifier and secret key set.
+ */
+void ControllerIdentityDerivePublicKey(ControllerIdentity* identity);
+
+/**
+ * Opens a TCP connection to the accessory.
+ *
+ * @param[out] session              Controller session.
+ * @param      address              Address of the accessory.
+ * @param      numAddressBytes      Length of the address.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_Unknown        If the connection could not be established.
+ */
+HAP_RESULT_USE_CHECK
+HAPError ControllerSessionOpen(
+        ControllerSession* session,
+        const struct sockaddr* address,
+        socklen_t numAddressBytes);
+
+/**
+ * Closes the connection to the accessory.
+ *
+ * @param      session              Controller session.
+ */
+void ControllerSessionClose(ControllerSession* session);
+
+/**
+ * Pairs with the accessory as its admin controller.
+ *
+ * @param      session              Unsecured controller session.
+ * @param      setupCode            Setup code of the accessory ("XXX-XX-XXX").
+ * @param      controller           Identity of the new admin controller.
+ * @param[out] accessory            Identity of the accessory.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_Unknown        If communication failed or the accessory could not be authenticated.
+ * @return kHAPError_NotAuthorized  If the accessory rejected the setup code or is already paired.
+ * @return kHAPError_Busy           If the accessory is busy with another pair-setup or refuses further attempts.
+ */
+HAP_RESULT_USE_CHECK
+HAPError ControllerPairSetup(
+        ControllerSession* session,
+        const char* setupCode,
+        const ControllerIdentity* controller,
+        ControllerAccessoryIdentity* accessory);
+
+/**
+ * Establishes a secured session with pair-verify.
+ *
+ * @param      session              Unsecured controller session.
+ * @param      controller           Identity of a paired controller.
+ * @param      accessory            Identity of the accessory.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_Unknown        If communication failed or the accessory could not be authenticated.
+ * @return kHAPError_NotAuthorized  If the accessory does not know the controller.
+ */
+HAP_RESULT_USE_CHECK
+HAPError ControllerPairVerify(
+        ControllerSession* session,
+        const ControllerIdentity* controller,
+        const ControllerAccessoryIdentity* accessory);
+
+/**
+ * Adds a pairing for another controller.
+ *
+ * @param      session              Secured session of an admin controller.
+ * @param      controller           Identity of the controller to add.
+ * @param      isAdmin              Whether the added controller has admin permissions.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_Unknown        If communication failed or the accessory rejected the request.
+ * @return kHAPError_OutOfResources If the accessory cannot store more pairings.
+ */
+HAP_RESULT_USE_CHECK
+HAPError ControllerAddPairing(ControllerSession* session, const ControllerIdentity* controller, bool isAdmin);
+
+/**
+ * Reads characteristics.
+ *
+ * @param      session              Secured controller session.
+ * @param      ids                  Comma-separated list of characteristics ("aid.iid,aid.iid,...").
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_Unknown        If communication failed or the accessory reported an error.
+ */
+HAP_RESULT_USE_CHECK
+HAPError ControllerReadCharacteristics(ControllerSession* session, const char* ids);
+
+/**
+ * Writes a characteristic.
+ *
+ * @param      session              Secured controller session.
+ * @param      aid                  Accessory instance ID.
+ * @param      iid                  Characteristic instance ID.
+ * @param      value                JSON value to write.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_Unknown        If communication failed or the accessory reported an error.
+ */
+HAP_RESULT_USE_CHECK
+HAPError ControllerWriteCharacteristic(ControllerSession* session, uint64_t aid, uint64_t iid, const char* value);
+
+/**
+ * Subscribes to event notifications of characteristics.
+ *
+ * @param      session              Secured controller session.
+ * @param      ids                  Comma-separated list of characteristics ("aid.iid,aid.iid,...").
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_Unknown        If communication failed or the accessory reported an error.
+ */
+HAP_RESULT_USE_CHECK
+HAPError ControllerSubscribeCharacteristics(ControllerSession* session, const char* ids);
+
+#ifdef __cplusplus
+}
+#endif
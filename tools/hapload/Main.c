@@ -0,0 +1,733 @@
+//  Copyright 2022 John Buonagurio
+//
+//  Distributed under the Boost Software License, Version 1.0.
+//
+//  See accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt
+
+// Load generator that acts as a number of HomeKit controllers against an accessory on the network, such as the host
+// build or a board. It pairs once, then runs pair-verify, characteristic reads and writes and event subscriptions on
+// all controllers in parallel and reports throughput, latency percentiles and failures per operation.
+
+#include "Controller.h"
+
+#include <errno.h>
+#include <getopt.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// Default address of the accessory. The host build listens on this port.
+#define kHapload_DefaultHost "localhost"
+#define kHapload_DefaultPort "10000"
+
+// Default setup code, as loaded by the constant accessory setup of the host build.
+#define kHapload_DefaultSetupCode "111-22-333"
+
+// Default file that holds the pairings between runs.
+#define kHapload_DefaultPairingFile "hapload.pairing"
+
+// Default characteristics to read and to subscribe to: fan active and rotation speed, light bulb on and brightness.
+#define kHapload_DefaultReadIDs "1.51,1.52,1.66,1.67"
+
+// Default characteristic to write and the values written in turn: fan rotation speed.
+#define kHapload_DefaultWrite "1.52=25,50,75,100"
+
+// Maximum number of controller pairings. Every accessory supports at least this many pairings.
+#define kHapload_MaxControllerIdentities ((size_t) kHAPPairingStorage_MinElements)
+
+// Maximum number of simulated controllers. Controllers beyond the number of pairings share them.
+#define kHapload_MaxControllers ((size_t) 256)
+
+// Maximum number of values that are written in turn.
+#define kHapload_MaxWriteValues ((size_t) 16)
+
+// Delay before a controller reconnects after a failed pair-verify.
+#define kHapload_RetryDelay ((uint64_t) 100000) // us
+
+static const HAPLogObject logObject = { .subsystem = "hapload", .category = "Main" };
+
+/**
+ * Operations whose latency is measured.
+ */
+typedef enum {
+    kOperation_PairVerify,
+    kOperation_Read,
+    kOperation_Write,
+    kOperation_Subscribe,
+    kOperation_Count
+} Operation;
+
+static const char* const kOperationNames[kOperation_Count] = { "pair-verify", "read", "write", "subscribe" };
+
+/**
+ * Latencies and failures of one operation.
+ */
+typedef struct {
+    uint32_t* latencies; // us
+    size_t numLatencies;
+    size_t maxLatencies;
+    uint64_t numFailures;
+} OperationStatistics;
+
+/**
+ * Simulated controller.
+ */
+typedef struct {
+    size_t index;
+    pthread_t thread;
+    const ControllerIdentity* identity;
+    ControllerSession session;
+    OperationStatistics operations[kOperation_Count];
+} Controller;
+
+/**
+ * Command line options.
+ */
+static struct {
+    size_t numControllers;
+    double duration;
+    double rate;
+    unsigned writePercentage;
+    unsigned reconnectInterval;
+    bool subscribe;
+    const char* setupCode;
+    const char* pairingFile;
+    const char* readIDs;
+    uint64_t writeAID;
+    uint64_t writeIID;
+    char* writeValues[kHapload_MaxWriteValues];
+    size_t numWriteValues;
+    struct sockaddr_storage address;
+    socklen_t numAddressBytes;
+} options = { .numControllers = 1,
+              .duration = 10,
+              .writePercentage = 20,
+              .setupCode = kHapload_DefaultSetupCode,
+              .pairingFile = kHapload_DefaultPairingFile,
+              .readIDs = kHapload_DefaultReadIDs };
+
+static ControllerAccessoryIdentity accessory;
+static ControllerIdentity identities[kHapload_MaxControllerIdentities];
+static size_t numIdentities;
+
+static atomic_bool stopRequested;
+
+/**
+ * Returns the time of the monotonic clock in microseconds.
+ */
+static uint64_t GetMicroseconds(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t) t.tv_sec * 1000000 + (uint64_t) t.tv_nsec / 1000;
+}
+
+/**
+ * Sleeps until the given time of the monotonic clock.
+ */
+static void SleepUntil(uint64_t microseconds)
+{
+    struct timespec t = { .tv_sec = (time_t)(microseconds / 1000000),
+                          .tv_nsec = (long) (microseconds % 1000000 * 1000) };
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &t, NULL) == EINTR) {
+    }
+}
+
+/**
+ * Records the outcome of an operation.
+ *
+ * @param      statistics           Statistics of the operation.
+ * @param      startTime            Time at which the operation was started or scheduled.
+ * @param      err                  Outcome of the operation.
+ */
+static void RecordOperation(OperationStatistics* statistics, uint64_t startTime, HAPError err)
+{
+    if (err) {
+        statistics->numFailures++;
+        return;
+    }
+    if (statistics->numLatencies == statistics->maxLatencies) {
+        size_t maxLatencies = statistics->maxLatencies ? 2 * statistics->maxLatencies : 1024;
+        uint32_t* latencies = realloc(statistics->latencies, maxLatencies * sizeof latencies[0]);
+        if (!latencies) {
+            HAPLogError(&logObject, "Out of memory.");
+            HAPFatalError();
+        }
+        statistics->latencies = latencies;
+        statistics->maxLatencies = maxLatencies;
+    }
+    uint64_t latency = GetMicroseconds() - startTime;
+    statistics->latencies[statistics->numLatencies++] = latency < UINT32_MAX ? (uint32_t) latency : UINT32_MAX;
+}
+
+/**
+ * Connects a controller and establishes a secured session, subscribing to events if requested.
+ */
+HAP_RESULT_USE_CHECK
+static HAPError ConnectController(Controller* controller)
+{
+    ControllerSession* session = &controller->session;
+
+    uint64_t startTime = GetMicroseconds();
+    HAPError err = ControllerSessionOpen(session, (const struct sockaddr*) &options.address, options.numAddressBytes);
+    if (!err) {
+        err = ControllerPairVerify(session, controller->identity, &accessory);
+    }
+    RecordOperation(&controller->operations[kOperation_PairVerify], startTime, err);
+    if (err || !options.subscribe) {
+        return err;
+    }
+
+    startTime = GetMicroseconds();
+    err = ControllerSubscribeCharacteristics(session, options.readIDs);
+    RecordOperation(&controller->operations[kOperation_Subscribe], startTime, err);
+    return err;
+}
+
+/**
+ * Main function of a controller thread. Runs requests until the end of the measurement.
+ */
+static void* RunController(void* context)
+{
+    Controller* controller = context;
+    ControllerSession* session = &controller->session;
+    session->fileDescriptor = -1;
+
+    unsigned seed = (unsigned) (GetMicroseconds() ^ (controller->index * 2654435761u));
+    size_t writeIndex = controller->index;
+
+    // With a rate, requests are sent on a fixed schedule, staggered across controllers. Latencies are measured from
+    // the scheduled time, so that a stalled accessory shows up in the percentiles and not only in the throughput.
+    uint64_t interval = options.rate > 0 ? (uint64_t)(1000000 / options.rate) : 0;
+    uint64_t nextTime = GetMicroseconds() + interval * controller->index / options.numControllers;
+
+    unsigned numRequests = 0;
+    while (!atomic_load(&stopRequested)) {
+        if (!session->isSecure) {
+            HAPError err = ConnectController(controller);
+            if (err) {
+                ControllerSessionClose(session);
+                SleepUntil(GetMicroseconds() + kHapload_RetryDelay);
+                nextTime = GetMicroseconds();
+                continue;
+            }
+            numRequests = 0;
+        }
+
+        uint64_t startTime = GetMicroseconds();
+        if (interval) {
+            if (nextTime > startTime) {
+                SleepUntil(nextTime);
+                if (atomic_load(&stopRequested)) {
+                    break;
+                }
+            }
+            startTime = nextTime;
+            nextTime += interval;
+        }
+
+        HAPError err;
+        if ((unsigned) rand_r(&seed) % 100 < options.writePercentage) {
+            err = ControllerWriteCharacteristic(
+                    session,
+                    options.writeAID,
+                    options.writeIID,
+                    options.writeValues[writeIndex++ % options.numWriteValues]);
+            RecordOperation(&controller->operations[kOperation_Write], startTime, err);
+        } else {
+            err = ControllerReadCharacteristics(session, options.readIDs);
+            RecordOperation(&controller->operations[kOperation_Read], startTime, err);
+        }
+
+        if (err || (options.reconnectInterval && ++numRequests >= options.reconnectInterval)) {
+            ControllerSessionClose(session);
+        }
+    }
+    ControllerSessionClose(session);
+    return NULL;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+
+/**
+ * Parses a hex string of a fixed length.
+ */
+static bool ParseHex(const char* string, uint8_t* bytes, size_t numBytes)
+{
+    if (strlen(string) != 2 * numBytes) {
+        return false;
+    }
+    for (size_t i = 0; i < numBytes; i++) {
+        unsigned value;
+        if (sscanf(&string[2 * i], "%2x", &value) != 1) {
+            return false;
+        }
+        bytes[i] = (uint8_t) value;
+    }
+    return true;
+}
+
+/**
+ * Writes bytes as a hex string.
+ */
+static void PrintHex(FILE* file, const uint8_t* bytes, size_t numBytes)
+{
+    for (size_t i = 0; i < numBytes; i++) {
+        fprintf(file, "%02X", bytes[i]);
+    }
+}
+
+/**
+ * Loads the accessory identity and the controller identities from the pairing file.
+ *
+ * The file has one line per identity: "accessory <pairing ID> <public key>" and "controller <pairing ID> <secret key>",
+ * with keys in hex. The first controller is the admin controller that paired with the accessory.
+ *
+ * @return true                     If the pairing file exists and is valid.
+ * @return false                    If the pairing file does not exist.
+ */
+static bool LoadPairings(void)
+{
+    FILE* file = fopen(options.pairingFile, "r");
+    if (!file) {
+        if (errno != ENOENT) {
+            fprintf(stderr, "hapload: %s: %s\n", options.pairingFile, strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        return false;
+    }
+
+    bool hasAccessory = false;
+    char line[256];
+    while (fgets(line, sizeof line, file)) {
+        char kind[16], pairingID[64], key[128];
+        if (line[0] == '#' || line[0] == '\n') {
+            continue;
+        }
+        if (sscanf(line, "%15s %63s %127s", kind, pairingID, key) != 3) {
+            goto invalid;
+        }
+        if (!strcmp(kind, "accessory") && strlen(pairingID) <= kController_MaxAccessoryPairingIDBytes &&
+            ParseHex(key, accessory.publicKey, sizeof accessory.publicKey)) {
+            strcpy(accessory.pairingID, pairingID);
+            hasAccessory = true;
+        } else if (
+                !strcmp(kind, "controller") && strlen(pairingID) <= kController_MaxPairingIDBytes &&
+                numIdentities < kHapload_MaxControllerIdentities) {
+            ControllerIdentity* identity = &identities[numIdentities];
+            strcpy(identity->pairingID, pairingID);
+            if (!ParseHex(key, identity->secretKey, sizeof identity->secretKey)) {
+                goto invalid;
+            }
+            ControllerIdentityDerivePublicKey(identity);
+            numIdentities++;
+        } else {
+            goto invalid;
+        }
+    }
+    fclose(file);
+    if (!hasAccessory || !numIdentities) {
+        goto invalid;
+    }
+    return true;
+
+invalid:
+    fprintf(stderr, "hapload: %s: invalid pairing file\n", options.pairingFile);
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * Saves the accessory identity and the controller identities to the pairing file.
+ */
+static void SavePairings(void)
+{
+    FILE* file = fopen(options.pairingFile, "w");
+    if (!file) {
+        fprintf(stderr, "hapload: %s: %s\n", options.pairingFile, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    fprintf(file, "# hapload pairings. Remove the pairings from the accessory before deleting this file.\n");
+    fprintf(file, "accessory %s ", accessory.pairingID);
+    PrintHex(file, accessory.publicKey, sizeof accessory.publicKey);
+    fprintf(file, "\n");
+    for (size_t i = 0; i < numIdentities; i++) {
+        fprintf(file, "controller %s ", identities[i].pairingID);
+        PrintHex(file, identities[i].secretKey, sizeof identities[i].secretKey);
+        fprintf(file, "\n");
+    }
+    if (fclose(file) != 0) {
+        fprintf(stderr, "hapload: %s: %s\n", options.pairingFile, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+}
+
+/**
+ * Pairs with the accessory unless a pairing file exists, and adds pairings until every controller has its own identity
+ * or the accessory runs out of pairings.
+ */
+static void PrepareIdentities(void)
+{
+    static ControllerSession session = { .fileDescriptor = -1 };
+    HAPError err;
+
+    if (!LoadPairings()) {
+        ControllerIdentityCreate(&identities[0]);
+        uint64_t startTime = GetMicroseconds();
+        err = ControllerSessionOpen(&session, (const struct sockaddr*) &options.address, options.numAddressBytes);
+        if (!err) {
+            err = ControllerPairSetup(&session, options.setupCode, &identities[0], &accessory);
+        }
+        ControllerSessionClose(&session);
+        if (err) {
+            fprintf(stderr,
+                    "hapload: pair-setup failed%s\n",
+                    err == kHAPError_NotAuthorized ? " (wrong setup code, or accessory already paired)" : "");
+            exit(EXIT_FAILURE);
+        }
+        numIdentities = 1;
+        SavePairings();
+        printf("Paired with accessory %s in %.1f ms.\n",
+               accessory.pairingID,
+               (double) (GetMicroseconds() - startTime) / 1000);
+    }
+
+    size_t numRequiredIdentities = HAPMin(options.numControllers, kHapload_MaxControllerIdentities);
+    if (numIdentities >= numRequiredIdentities) {
+        return;
+    }
+    err = ControllerSessionOpen(&session, (const struct sockaddr*) &options.address, options.numAddressBytes);
+    if (!err) {
+        err = ControllerPairVerify(&session, &identities[0], &accessory);
+    }
+    size_t numAddedIdentities = 0;
+    while (!err && numIdentities < numRequiredIdentities) {
+        ControllerIdentityCreate(&identities[numIdentities]);
+        err = ControllerAddPairing(&session, &identities[numIdentities], /* isAdmin: */ false);
+        if (!err) {
+            numIdentities++;
+            numAddedIdentities++;
+        }
+    }
+    ControllerSessionClose(&session);
+    if (err && err != kHAPError_OutOfResources) {
+        fprintf(stderr, "hapload: adding pairings failed\n");
+        exit(EXIT_FAILURE);
+    }
+    if (numAddedIdentities) {
+        SavePairings();
+        printf("Added %zu pairings.\n", numAddedIdentities);
+    }
+    if (numIdentities < numRequiredIdentities) {
+        printf("Accessory is out of pairings: %zu controllers share %zu pairings.\n",
+               options.numControllers,
+               numIdentities);
+    }
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+
+static int CompareLatencies(const void* a, const void* b)
+{
+    uint32_t x = *(const uint32_t*) a;
+    uint32_t y = *(const uint32_t*) b;
+    return x < y ? -1 : x > y;
+}
+
+/**
+ * Returns the latency at a percentile (nearest rank) in milliseconds.
+ */
+static double GetPercentile(const uint32_t* latencies, size_t numLatencies, unsigned percentile)
+{
+    size_t rank = (numLatencies * percentile + 99) / 100;
+    return (double) latencies[rank ? rank - 1 : 0] / 1000;
+}
+
+/**
+ * Merges the statistics of all controllers and prints them.
+ */
+static void PrintReport(Controller* controllers, double elapsedTime)
+{
+    printf("%zu controller(s), %.1f s, ", options.numControllers, elapsedTime);
+    if (options.rate > 0) {
+        printf("%.1f requests/s per controller", options.rate);
+    } else {
+        printf("closed loop");
+    }
+    printf(", %u%% writes", options.writePercentage);
+    if (options.reconnectInterval) {
+        printf(", reconnect every %u requests", options.reconnectInterval);
+    }
+    printf("%s\n\n", options.subscribe ? ", events" : "");
+
+    printf("%-12s %9s %9s %9s %9s %9s %9s %9s\n", "operation", "count", "failures", "ops/s", "p50 ms", "p95 ms",
+           "p99 ms", "max ms");
+    for (size_t op = 0; op < kOperation_Count; op++) {
+        size_t numLatencies = 0;
+        uint64_t numFailures = 0;
+        for (size_t i = 0; i < options.numControllers; i++) {
+            numLatencies += controllers[i].operations[op].numLatencies;
+            numFailures += controllers[i].operations[op].numFailures;
+        }
+        if (!numLatencies && !numFailures) {
+            continue;
+        }
+        printf("%-12s %9zu %9llu %9.1f",
+               kOperationNames[op],
+               numLatencies,
+               (unsigned long long) numFailures,
+               (double) numLatencies / elapsedTime);
+        if (!numLatencies) {
+            printf("\n");
+            continue;
+        }
+
+        uint32_t* latencies = malloc(numLatencies * sizeof latencies[0]);
+        if (!latencies) {
+            HAPLogError(&logObject, "Out of memory.");
+            HAPFatalError();
+        }
+        size_t n = 0;
+        for (size_t i = 0; i < options.numControllers; i++) {
+            const OperationStatistics* statistics = &controllers[i].operations[op];
+            HAPRawBufferCopyBytes(&latencies[n], statistics->latencies, statistics->numLatencies * sizeof latencies[0]);
+            n += statistics->numLatencies;
+        }
+        qsort(latencies, numLatencies, sizeof latencies[0], CompareLatencies);
+        printf(" %9.2f %9.2f %9.2f %9.2f\n",
+               GetPercentile(latencies, numLatencies, 50),
+               GetPercentile(latencies, numLatencies, 95),
+               GetPercentile(latencies, numLatencies, 99),
+               (double) latencies[numLatencies - 1] / 1000);
+        free(latencies);
+    }
+
+    uint64_t numEvents = 0;
+    for (size_t i = 0; i < options.numControllers; i++) {
+        numEvents += controllers[i].session.numEvents;
+    }
+    if (options.subscribe) {
+        printf("\nevents received: %llu (%.1f/s)\n", (unsigned long long) numEvents, (double) numEvents / elapsedTime);
+    }
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+
+static void PrintUsage(void)
+{
+    printf("Usage: hapload [options] [host[:port]]\n"
+           "\n"
+           "Simulates HomeKit controllers against an accessory (default " kHapload_DefaultHost
+           ":" kHapload_DefaultPort ").\n"
+           "Pairs once with the setup code and keeps the pairings in the pairing file for later runs.\n"
+           "\n"
+           "  -c, --controllers N      number of simulated controllers (default 1)\n"
+           "  -d, --duration SECONDS   duration of the measurement (default 10)\n"
+           "  -r, --rate N             requests per second per controller, 0 for back-to-back (default 0)\n"
+           "  -w, --writes PERCENT     share of requests that are writes (default 20)\n"
+           "  -k, --reconnect N        reconnect and pair-verify after every N requests, 0 for never (default 0)\n"
+           "  -e, --events             subscribe to events on the characteristics that are read\n"
+           "      --read IDS           characteristics to read (default " kHapload_DefaultReadIDs ")\n"
+           "      --write ID=VALUES    characteristic to write and values to write in turn\n"
+           "                           (default " kHapload_DefaultWrite ")\n"
+           "  -s, --setup-code CODE    setup code (default " kHapload_DefaultSetupCode ")\n"
+           "  -p, --pairing-file FILE  pairing file (default " kHapload_DefaultPairingFile ")\n"
+           "  -h, --help               show this help\n");
+}
+
+/**
+ * Parses the characteristic to write and its values ("aid.iid=value,value,...").
+ */
+static bool ParseWrite(const char* string)
+{
+    static char values[256];
+    unsigned long long aid, iid;
+    int n;
+    if (sscanf(string, "%llu.%llu=%n", &aid, &iid, &n) != 2 || !string[n] || strlen(&string[n]) >= sizeof values) {
+        return false;
+    }
+    options.writeAID = aid;
+    options.writeIID = iid;
+    strcpy(values, &string[n]);
+    options.numWriteValues = 0;
+    for (char* value = strtok(values, ","); value; value = strtok(NULL, ",")) {
+        if (options.numWriteValues == kHapload_MaxWriteValues) {
+            return false;
+        }
+        options.writeValues[options.numWriteValues++] = value;
+    }
+    return options.numWriteValues != 0;
+}
+
+/**
+ * Resolves the address of the accessory ("host", "host:port", "[ipv6]:port" or "ipv6").
+ */
+static bool ResolveAddress(const char* string)
+{
+    char host[256];
+    const char* port = kHapload_DefaultPort;
+    if (strlen(string) >= sizeof host) {
+        return false;
+    }
+    strcpy(host, string);
+    char* colon = strrchr(host, ':');
+    if (host[0] == '[') {
+        char* end = strchr(host, ']');
+        if (!end) {
+            return false;
+        }
+        *end = '\0';
+        if (end[1] == ':') {
+            port = &end[2];
+        } else if (end[1]) {
+            return false;
+        }
+        memmove(host, &host[1], strlen(host));
+    } else if (colon && colon == strchr(host, ':')) {
+        *colon = '\0';
+        port = &colon[1];
+    }
+
+    struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM };
+    struct addrinfo* result;
+    int e = getaddrinfo(host, port, &hints, &result);
+    if (e) {
+        fprintf(stderr, "hapload: %s: %s\n", string, gai_strerror(e));
+        return false;
+    }
+    HAPRawBufferCopyBytes(&options.address, result->ai_addr, result->ai_addrlen);
+    options.numAddressBytes = result->ai_addrlen;
+    freeaddrinfo(result);
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    enum { kOption_Read = 0x100, kOption_Write };
+    static const struct option longOptions[] = { { "controllers", required_argument, NULL, 'c' },
+                                                 { "duration", required_argument, NULL, 'd' },
+                                                 { "rate", required_argument, NULL, 'r' },
+                                                 { "writes", required_argument, NULL, 'w' },
+                                                 { "reconnect", required_argument, NULL, 'k' },
+                                                 { "events", no_argument, NULL, 'e' },
+                                                 { "read", required_argument, NULL, kOption_Read },
+                                                 { "write", required_argument, NULL, kOption_Write },
+                                                 { "setup-code", required_argument, NULL, 's' },
+                                                 { "pairing-file", required_argument, NULL, 'p' },
+                                                 { "help", no_argument, NULL, 'h' },
+                                                 { NULL, 0, NULL, 0 } };
+
+    bool isValid = ParseWrite(kHapload_DefaultWrite);
+    HAPAssert(isValid);
+
+    int c;
+    while ((c = getopt_long(argc, argv, "c:d:r:w:k:es:p:h", longOptions, NULL)) != -1) {
+        char* end = NULL;
+        switch (c) {
+            case 'c': {
+                options.numControllers = strtoul(optarg, &end, 10);
+                isValid = options.numControllers >= 1 && options.numControllers <= kHapload_MaxControllers;
+                break;
+            }
+            case 'd': {
+                options.duration = strtod(optarg, &end);
+                isValid = options.duration > 0;
+                break;
+            }
+            case 'r': {
+                options.rate = strtod(optarg, &end);
+                isValid = options.rate >= 0;
+                break;
+            }
+            case 'w': {
+                options.writePercentage = (unsigned) strtoul(optarg, &end, 10);
+                isValid = options.writePercentage <= 100;
+                break;
+            }
+            case 'k': {
+                options.reconnectInterval = (unsigned) strtoul(optarg, &end, 10);
+                break;
+            }
+            case 'e': {
+                options.subscribe = true;
+                break;
+            }
+            case kOption_Read: {
+                options.readIDs = optarg;
+                break;
+            }
+            case kOption_Write: {
+                isValid = ParseWrite(optarg);
+                break;
+            }
+            case 's': {
+                options.setupCode = optarg;
+                break;
+            }
+            case 'p': {
+                options.pairingFile = optarg;
+                break;
+            }
+            case 'h': {
+                PrintUsage();
+                return EXIT_SUCCESS;
+            }
+            default: {
+                PrintUsage();
+                return EXIT_FAILURE;
+            }
+        }
+        if (!isValid || (end && *end)) {
+            fprintf(stderr, "hapload: invalid argument for -%c: %s\n", c < 0x100 ? c : '-', optarg);
+            return EXIT_FAILURE;
+        }
+    }
+    if (argc - optind > 1) {
+        PrintUsage();
+        return EXIT_FAILURE;
+    }
+    if (!ResolveAddress(optind < argc ? argv[optind] : kHapload_DefaultHost)) {
+        return EXIT_FAILURE;
+    }
+
+    PrepareIdentities();
+
+    Controller* controllers = calloc(options.numControllers, sizeof controllers[0]);
+    if (!controllers) {
+        HAPLogError(&logObject, "Out of memory.");
+        HAPFatalError();
+    }
+    uint64_t startTime = GetMicroseconds();
+    for (size_t i = 0; i < options.numControllers; i++) {
+        controllers[i].index = i;
+        controllers[i].identity = &identities[i % numIdentities];
+        int e = pthread_create(&controllers[i].thread, NULL, RunController, &controllers[i]);
+        if (e) {
+            HAPLogError(&logObject, "pthread_create failed: %s.", strerror(e));
+            HAPFatalError();
+        }
+    }
+    SleepUntil(startTime + (uint64_t)(options.duration * 1000000));
+    atomic_store(&stopRequested, true);
+    for (size_t i = 0; i < options.numControllers; i++) {
+        pthread_join(controllers[i].thread, NULL);
+    }
+    double elapsedTime = (double) (GetMicroseconds() - startTime) / 1000000;
+
+    PrintReport(controllers, elapsedTime);
+
+    bool hasFailures = false;
+    for (size_t i = 0; i < options.numControllers; i++) {
+        for (size_t op = 0; op < kOperation_Count; op++) {
+            hasFailures |= controllers[i].operations[op].numFailures != 0;
+            free(controllers[i].operations[op].latencies);
+        }
+    }
+    free(controllers);
+    return hasFailures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,73 @@
+#!/bin/bash
+
+# Smoke test of the host build: starts the host accessory on a fresh key-value store, pairs hapload with it, and runs
+# two short load runs, the second one with the stored pairings. Fails if any operation fails or the accessory exits.
+
+if [ $# -gt 1 ] || [ "$1" == "-h" ] || [ "$1" == "--help" ]; then
+	echo Usage: $0 \[build-directory\] >&2
+	exit 2
+fi
+
+BUILD_DIR=${1:-build-host}
+HOST=$BUILD_DIR/fanboard_host
+HAPLOAD=$BUILD_DIR/hapload
+PORT=10000
+
+for BINARY in "$HOST" "$HAPLOAD"; do
+	if [ ! -x "$BINARY" ]; then
+		echo "$(basename $0): $BINARY not found. Build the host build first." >&2
+		exit 2
+	fi
+done
+
+WORK_DIR=$(mktemp -d)
+HOST_PID=
+
+cleanup() {
+	if [ -n "$HOST_PID" ]; then
+		kill $HOST_PID 2>/dev/null
+		wait $HOST_PID 2>/dev/null
+	fi
+	rm -rf "$WORK_DIR"
+}
+trap cleanup EXIT
+
+fail() {
+	echo "$(basename $0): $1" >&2
+	echo "--- accessory log (last 50 lines) ---" >&2
+	tail -n 50 "$WORK_DIR/host.log" >&2
+	exit 1
+}
+
+echo Starting host accessory...
+FANBOARD_FS_ROOT="$WORK_DIR/fs" "$HOST" > "$WORK_DIR/host.log" 2>&1 &
+HOST_PID=$!
+
+# Wait until the accessory accepts connections.
+for i in $(seq 50); do
+	if (exec 3<>/dev/tcp/127.0.0.1/$PORT) 2>/dev/null; then
+		break
+	fi
+	kill -0 $HOST_PID 2>/dev/null || fail "Accessory exited during startup."
+	sleep 0.2
+done
+(exec 3<>/dev/tcp/127.0.0.1/$PORT) 2>/dev/null || fail "Accessory does not accept connections on port $PORT."
+
+echo Pairing and running load...
+"$HAPLOAD" -c 4 -d 5 -w 20 -k 50 --events -p "$WORK_DIR/hapload.pairing" 127.0.0.1:$PORT \
+	|| fail "First run failed."
+
+echo Running load with the stored pairings...
+"$HAPLOAD" -c 8 -d 5 -r 20 -w 20 -p "$WORK_DIR/hapload.pairing" 127.0.0.1:$PORT \
+	|| fail "Second run failed."
+
+kill -0 $HOST_PID 2>/dev/null || fail "Accessory exited during the load runs."
+
+echo Stopping host accessory...
+kill -TERM $HOST_PID
+wait $HOST_PID
+STATUS=$?
+HOST_PID=
+[ $STATUS -eq 0 ] || fail "Accessory exited with status $STATUS."
+
+echo Smoke test passed.